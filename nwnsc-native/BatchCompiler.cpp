@@ -0,0 +1,736 @@
+/** @file BatchCompiler.cpp
+ * Compiles a list of scripts with a pool of native compiler (CScriptCompiler) workers.
+ *
+ * The compiler API callbacks are plain function pointers without user data, so every
+ * worker thread publishes its current state through a thread_local context.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <algorithm>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "exobase.h"
+#include "scriptcomp.h"
+#include "scriptcompincludecache.h"
+#include "scripterrors.h"
+
+#include "BatchCompiler.h"
+#include "CompilerMessages.h"
+#include "ScriptDependencies.h"
+
+using namespace NWScriptCli;
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsedMs(Clock::time_point since)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+}
+
+// Per-thread state consumed by the compiler API callbacks
+struct WorkerContext
+{
+	IncludeCache* cache = nullptr;
+	const CompilerSettings* settings = nullptr;
+
+	// Script being compiled (null while loading the identifier specification)
+	FileResult* current = nullptr;
+	IncludeCache::EntryPtr mainFile;
+	std::string mainStem;
+	fs::path mainDir;
+
+	// Outputs of the current script, handed to the output writer once it compiled
+	std::vector<NWScriptPlugin::OutputWriter::File> outputs;
+};
+
+static thread_local WorkerContext* t_context = nullptr;
+
+static const char* const includeFileMessage = "File appears to be an include file - no void main() or StartingConditional() inside. Ignored.";
+
+// CScriptCompiler seeds its hash tables with rand() on construction
+static std::mutex g_compilerConstructionLock;
+
+static bool equalsNoCase(const std::string& a, const std::string& b)
+{
+	return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(),
+		[](char x, char y) { return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y)); });
+}
+
+static const char* resTypeToExt(RESTYPE nResType)
+{
+	switch (nResType)
+	{
+	case NWN_RESTYPE_NSS: return "nss";
+	case NWN_RESTYPE_NCS: return "ncs";
+	case NWN_RESTYPE_NDB: return "ndb";
+	default: return nullptr;
+	}
+}
+
+static std::string toLower(std::string s)
+{
+	std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	return s;
+}
+
+// Compiler requests come as "ALIAS:name" for outputs and plain names for sources.
+static std::string resourceStem(const char* sFileName)
+{
+	std::string name(sFileName);
+	size_t colon = name.rfind(':');
+	if (colon != std::string::npos)
+		name.erase(0, colon + 1);
+	return fs::path(name).stem().string();
+}
+
+static BOOL ResManUpdateResourceDirectory(const char*)
+{
+	return TRUE;
+}
+
+static const char* ResManLoadScriptSourceFile(const char* sFileName, RESTYPE nResType)
+{
+	WorkerContext* ctx = t_context;
+	const char* ext = resTypeToExt(nResType);
+	if (!ctx || !ext)
+		return nullptr;
+
+	std::string stem = resourceStem(sFileName);
+	if (ctx->current && ctx->mainFile && equalsNoCase(stem, ctx->mainStem))
+		return ctx->mainFile->contents.c_str();
+
+	Clock::time_point start = Clock::now();
+	IncludeCache::EntryPtr entry = ctx->cache->resolve(stem, ext, ctx->mainDir);
+
+	if (ctx->current)
+	{
+		ctx->current->loadMs += elapsedMs(start);
+		// Precompiled include modules load their files again, to check them.
+		if (entry && std::find(ctx->current->includes.begin(), ctx->current->includes.end(), entry->path) == ctx->current->includes.end())
+			ctx->current->includes.push_back(entry->path);
+	}
+
+	// Entries are never evicted during a batch, so the buffer outlives the compile.
+	return entry ? entry->contents.c_str() : nullptr;
+}
+
+static int32_t ResManWriteToFile(const char* sFileName, RESTYPE nResType, const uint8_t* pData, size_t nSize, bool)
+{
+	WorkerContext* ctx = t_context;
+	const char* ext = resTypeToExt(nResType);
+	if (!ctx || !ctx->current || !ext)
+		return STRREF_CSCRIPTCOMPILER_ERROR_UNABLE_TO_OPEN_FILE_FOR_WRITING;
+
+	Clock::time_point start = Clock::now();
+
+	fs::path outputDir = ctx->settings->outputDir.empty() ? ctx->mainDir : ctx->settings->outputDir;
+	fs::path outputPath = outputDir / (resourceStem(sFileName) + "." + ext);
+
+	// pData is the compiler's own buffer, reused by the next compile: this is the only copy.
+	ctx->outputs.push_back({ outputPath, std::vector<uint8_t>(pData, pData + nSize) });
+	ctx->current->outputs.push_back(outputPath.string());
+	ctx->current->outputBytes += nSize;
+
+	ctx->current->writeMs += elapsedMs(start);
+	return 0;
+}
+
+static const char* TlkResolve(STRREF strRef)
+{
+	return resolveCompilerMessage(strRef);
+}
+
+// Captured errors look like "script.nss(12): Error: ...". Extract the line number.
+static int parseErrorLine(const std::string& message)
+{
+	size_t open = message.find('(');
+	size_t close = message.find("):");
+	if (open == std::string::npos || close == std::string::npos || close < open)
+		return 0;
+
+	return std::atoi(message.substr(open + 1, close - open - 1).c_str());
+}
+
+// Applies the per-run settings. Cheap, so it is done at the start of every run.
+static void configureCompiler(CScriptCompiler& compiler, const CompilerSettings& settings, CScriptCompilerIncludeCache* precompiledIncludes)
+{
+	// Same setup the plugin uses (see NWScriptCompiler::compileScriptNative)
+	compiler.SetGenerateDebuggerOutput(settings.generateSymbols);
+	uint32_t optimizationFlags = settings.generateSymbols ? CSCRIPTCOMPILER_OPTIMIZE_NOTHING :
+		settings.optimizeScript ? CSCRIPTCOMPILER_OPTIMIZE_EVERYTHING : CSCRIPTCOMPILER_OPTIMIZE_NOTHING;
+	compiler.SetOptimizationFlags(optimizationFlags);
+	compiler.SetCompileConditionalOrMain(1);
+	compiler.SetOutputAlias("");
+	compiler.SetIncludeCache(settings.precompiledIncludes ? precompiledIncludes : nullptr);
+	compiler.SetMaxErrors(settings.maxErrors);
+}
+
+// The first compiler parses the identifier specification; the others share what it read
+// (languageContext, guarded by languageContextLock).
+static std::unique_ptr<CScriptCompiler> createCompiler(const CompilerSettings& settings,
+	std::shared_ptr<const CScriptCompilerLanguageContext>& languageContext, std::mutex& languageContextLock,
+	std::string& errorMessage)
+{
+	CScriptCompilerAPI cAPI;
+	cAPI.ResManLoadScriptSourceFile = ResManLoadScriptSourceFile;
+	cAPI.ResManUpdateResourceDirectory = ResManUpdateResourceDirectory;
+	cAPI.ResManWriteToFile = ResManWriteToFile;
+	cAPI.TlkResolve = TlkResolve;
+
+	std::unique_ptr<CScriptCompiler> compiler;
+	{
+		std::lock_guard<std::mutex> guard(g_compilerConstructionLock);
+		compiler = std::make_unique<CScriptCompiler>(NWN_RESTYPE_NSS, NWN_RESTYPE_NCS, NWN_RESTYPE_NDB, cAPI);
+	}
+
+	// Workers starting together wait here for the one parsing nwscript.nss, rather than each parsing it.
+	std::lock_guard<std::mutex> guard(languageContextLock);
+	if (languageContext)
+	{
+		compiler->SetLanguageContext(languageContext);
+		return compiler;
+	}
+
+	compiler->SetIdentifierSpecification(settings.languageSource.c_str());
+
+	// Identifier specification errors are only reported through the captured error.
+	errorMessage = compiler->GetCapturedError()->CStr();
+	while (!errorMessage.empty() && (errorMessage.back() == '\n' || errorMessage.back() == '\r'))
+		errorMessage.pop_back();
+
+	// The compiler names no file for the specification (".nss(12): ..."): give its full path instead.
+	if (errorMessage.compare(0, 4, ".nss") == 0)
+	{
+		IncludeCache::EntryPtr entry = t_context ? t_context->cache->resolve(settings.languageSource, "nss") : nullptr;
+		errorMessage.replace(0, 4, entry ? entry->path : settings.languageSource + ".nss");
+	}
+
+	if (errorMessage.empty())
+		languageContext = compiler->GetLanguageContext();
+
+	return compiler;
+}
+
+static void compileOne(CScriptCompiler& compiler, WorkerContext& ctx, FileResult& result)
+{
+	Clock::time_point start = Clock::now();
+
+	ctx.current = &result;
+	ctx.mainDir = result.source.parent_path();
+	ctx.mainStem = result.source.stem().string();
+	ctx.mainFile = ctx.cache->load(result.source);
+	result.loadMs += elapsedMs(start);
+	if (ctx.mainFile)
+		result.sourceBytes = ctx.mainFile->contents.size();
+
+	if (!ctx.mainFile)
+	{
+		result.status = FileResult::Status::Failed;
+		result.code = -STRREF_CSCRIPTCOMPILER_ERROR_FILE_NOT_FOUND;
+		result.message = std::string(resolveCompilerMessage(result.code)) + ": " + result.source.string();
+	}
+	else
+	{
+		int32_t code = compiler.CompileFile(ctx.mainStem.c_str());
+
+		// Sometimes CompileFile returns 1 or -1; the real error is in the captured STRREF.
+		if (code == 1 || code == -1)
+		{
+			code = compiler.GetCapturedErrorStrRef();
+			if (code == 0)
+				code = STRREF_CSCRIPTCOMPILER_ERROR_FATAL_COMPILER_ERROR;
+		}
+
+		result.code = std::abs(code);
+		if (code == 0)
+			result.status = FileResult::Status::Success;
+		else if (code == STRREF_CSCRIPTCOMPILER_ERROR_NO_FUNCTION_MAIN_IN_SCRIPT)
+		{
+			// Include files have no entry point. Same downgrade as the plugin.
+			result.status = FileResult::Status::SkippedInclude;
+			result.message = includeFileMessage;
+		}
+		else
+		{
+			result.status = FileResult::Status::Failed;
+			result.message = compiler.GetCapturedError()->CStr();
+			if (result.message.empty())
+				result.message = resolveCompilerMessage(code);
+			while (!result.message.empty() && (result.message.back() == '\n' || result.message.back() == '\r'))
+				result.message.pop_back();
+			result.line = parseErrorLine(result.message);
+
+			const std::vector<CScriptCompilerDiagnostic>& diagnostics = compiler.GetDiagnostics();
+			if (diagnostics.size() > 1)
+			{
+				for (const CScriptCompilerDiagnostic& d : diagnostics)
+				{
+					Diagnostic diagnostic;
+					diagnostic.code = std::abs(d.m_nError);
+					diagnostic.file = d.m_sFileName.CStr();
+					diagnostic.line = d.m_nLine;
+					diagnostic.message = d.m_sErrorText.CStr();
+					result.diagnostics.push_back(std::move(diagnostic));
+				}
+			}
+		}
+	}
+
+	ctx.current = nullptr;
+	ctx.mainFile.reset();
+
+	result.totalMs = elapsedMs(start);
+	result.compileMs = std::max(0.0, result.totalMs - result.loadMs - result.writeMs);
+}
+
+BatchCompiler::BatchCompiler(const CompilerSettings& settings, IncludeCache& cache)
+	: _settings(settings), _cache(cache), _precompiledIncludes(std::make_unique<CScriptCompilerIncludeCache>())
+{
+}
+
+BatchCompiler::~BatchCompiler() = default;
+
+void BatchCompiler::setSettings(const CompilerSettings& settings)
+{
+	if (settings.languageSource != _settings.languageSource)
+		resetCompilers();
+
+	_settings = settings;
+}
+
+void BatchCompiler::resetCompilers()
+{
+	_compilers.clear();
+	_languageContext.reset();
+
+	// Modules hold identifiers of the old identifier specification.
+	_precompiledIncludes->Clear();
+}
+
+uint64_t BatchCompiler::precompiledIncludeHits() const
+{
+	return _precompiledIncludes->GetHits();
+}
+
+uint64_t BatchCompiler::precompiledIncludeMisses() const
+{
+	return _precompiledIncludes->GetMisses();
+}
+
+bool BatchCompiler::validate(std::string& errorMessage)
+{
+	if (!_cache.resolve(_settings.languageSource, "nss"))
+	{
+		errorMessage = "Unable to find " + _settings.languageSource + ".nss on any include path.";
+		return false;
+	}
+
+	if (!_settings.outputDir.empty())
+	{
+		std::error_code ec;
+		if (!fs::is_directory(_settings.outputDir, ec))
+		{
+			errorMessage = "Output directory does not exist: " + _settings.outputDir.string();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool BatchCompiler::compileCacheKey(FileResult& result, NWScriptPlugin::CompileCache::Key& key, std::vector<std::string>& keyedFiles)
+{
+	// Includes resolve exactly as the compiler will: through the same cache, script directory first
+	IncludeCache::EntryPtr script = _cache.load(result.source);
+	IncludeCache::EntryPtr languageSource = _cache.resolve(_settings.languageSource, "nss");
+	DependencyList dependencies;
+	if (!script || !languageSource || !collectDependencies(_cache, result.source, dependencies) || !dependencies.missing.empty())
+		return false;
+
+	// Names are hashed without their folders (and in lowercase, as the game sees them), so
+	// the key is the same wherever the sources are checked out.
+	NWScriptPlugin::CompileCache::KeyBuilder builder;
+	builder.add(NWScriptPlugin::CompileCache::buildId());
+	builder.add("native");
+	builder.add(static_cast<uint64_t>(_settings.optimizeScript)).add(static_cast<uint64_t>(_settings.generateSymbols));
+	builder.add(toLower(_settings.languageSource)).add(languageSource->contents);
+	builder.add(toLower(result.source.stem().string())).add(script->contents);
+	for (const std::string& includePath : dependencies.includes)
+	{
+		IncludeCache::EntryPtr include = _cache.load(includePath);
+		if (!include)
+			return false;
+		builder.add(toLower(fs::path(includePath).stem().string())).add(include->contents);
+	}
+
+	key = builder.finish();
+	result.sourceBytes = script->contents.size();
+
+	keyedFiles = std::move(dependencies.includes);
+	keyedFiles.push_back(languageSource->path);
+	return true;
+}
+
+// Whether every file the compiler loaded went into the key. The scan can't know what the
+// compiler will resolve in every case: an entry missing one of them could go stale unseen.
+static bool keyCoversIncludes(const std::vector<std::string>& keyedFiles, const FileResult& result)
+{
+	return std::all_of(result.includes.begin(), result.includes.end(), [&](const std::string& include) {
+		return std::find(keyedFiles.begin(), keyedFiles.end(), include) != keyedFiles.end();
+	});
+}
+
+// Fills a script's result and outputs from a compile cache entry, as if it had just compiled.
+static void useCachedEntry(const NWScriptPlugin::CompileCache::Entry& entry, const CompilerSettings& settings, WorkerContext& ctx, FileResult& result)
+{
+	result.cached = true;
+	if (entry.include)
+	{
+		result.status = FileResult::Status::SkippedInclude;
+		result.code = STRREF_CSCRIPTCOMPILER_ERROR_NO_FUNCTION_MAIN_IN_SCRIPT;
+		result.message = includeFileMessage;
+		return;
+	}
+
+	result.status = FileResult::Status::Success;
+	fs::path outputDir = settings.outputDir.empty() ? result.source.parent_path() : settings.outputDir;
+	for (const NWScriptPlugin::CompileCache::Output& output : entry.outputs)
+	{
+		fs::path outputPath = outputDir / (result.source.stem().string() + "." + output.extension);
+		result.outputs.push_back(outputPath.string());
+		result.outputBytes += output.data.size();
+		ctx.outputs.push_back({ outputPath, output.data });
+	}
+}
+
+int BatchCompiler::workerCount(size_t files) const
+{
+	int threads = _settings.threads > 0 ? _settings.threads : static_cast<int>(std::thread::hardware_concurrency());
+	return std::max(1, static_cast<int>(std::min<size_t>(static_cast<size_t>(std::max(threads, 1)), std::max<size_t>(files, 1))));
+}
+
+bool BatchCompiler::warmUp(std::string& errorMessage)
+{
+	int threads = workerCount(SIZE_MAX);
+	if (_compilers.size() < static_cast<size_t>(threads))
+		_compilers.resize(threads);
+
+	std::mutex errorLock;
+	auto worker = [&](int slot) {
+		if (_compilers[slot])
+			return;
+
+		WorkerContext ctx;
+		ctx.cache = &_cache;
+		ctx.settings = &_settings;
+		t_context = &ctx;
+
+		std::string setupError;
+		_compilers[slot] = createCompiler(_settings, _languageContext, _languageContextLock, setupError);
+		if (!setupError.empty())
+		{
+			_compilers[slot].reset();
+			std::lock_guard<std::mutex> guard(errorLock);
+			errorMessage = setupError;
+		}
+
+		t_context = nullptr;
+	};
+
+	std::vector<std::thread> pool;
+	for (int i = 1; i < threads; i++)
+		pool.emplace_back(worker, i);
+	worker(0);
+	for (std::thread& t : pool)
+		t.join();
+
+	return errorMessage.empty();
+}
+
+// Per-phase timings of a finished file, as telemetry wants them
+static NWScriptPlugin::BatchTelemetry::FileTimings fileTimings(const FileResult& result)
+{
+	NWScriptPlugin::BatchTelemetry::FileTimings timings;
+	timings.path = result.source.string();
+	timings.failed = result.status == FileResult::Status::Failed;
+	timings.bytesRead = result.sourceBytes;
+	timings.bytesWritten = result.outputBytes;
+	timings.loadMs = result.loadMs;
+	timings.compileMs = result.compileMs;
+	timings.writeMs = result.writeMs;
+	timings.totalMs = result.totalMs;
+	return timings;
+}
+
+BatchSummary BatchCompiler::run(const std::vector<fs::path>& files, FileCallback onFileDone, NWScriptPlugin::BatchTelemetry* telemetry)
+{
+	return run([&files](const AddFileFunction& addFile) {
+		for (const fs::path& file : files)
+			addFile(file);
+	}, files.size(), std::move(onFileDone), telemetry);
+}
+
+BatchSummary BatchCompiler::run(const FileSource& source, FileCallback onFileDone, NWScriptPlugin::BatchTelemetry* telemetry)
+{
+	return run(source, SIZE_MAX, std::move(onFileDone), telemetry);
+}
+
+BatchSummary BatchCompiler::run(const FileSource& source, size_t maxFiles, FileCallback onFileDone, NWScriptPlugin::BatchTelemetry* telemetry)
+{
+	BatchSummary summary;
+	Clock::time_point start = Clock::now();
+
+	int threads = workerCount(maxFiles);
+	summary.threads = threads;
+
+	// Files as the source adds them. Results are kept in a deque, whose elements stay in place
+	// while it grows: workers and output callbacks hold on to theirs.
+	std::deque<FileResult> results;
+	size_t nextFile = 0;
+	bool bSourceDone = false;
+	std::mutex filesLock;
+	std::condition_variable filesAdded;
+
+	std::atomic<uint64_t> setupMicroseconds = 0;
+	std::mutex callbackLock;
+	_cancel = false;
+
+	// Cache counters keep going between runs (compile server): telemetry shows this run's share
+	const NWScriptPlugin::BatchTelemetry::CacheCounters includeBaseline = { precompiledIncludeHits(), precompiledIncludeMisses() };
+	const NWScriptPlugin::BatchTelemetry::CacheCounters resourceBaseline = { _cache.hits(), _cache.misses() };
+	const NWScriptPlugin::BatchTelemetry::CacheCounters compileBaseline = { _compileCache ? _compileCache->hits() : 0, _compileCache ? _compileCache->misses() : 0 };
+	auto compileCacheCounters = [&]() -> NWScriptPlugin::BatchTelemetry::CacheCounters {
+		if (!_compileCache)
+			return {};
+		return { _compileCache->hits() - compileBaseline.hits, _compileCache->misses() - compileBaseline.misses };
+	};
+	auto updateCacheCounters = [&]() {
+		telemetry->setCacheCounters(
+			{ precompiledIncludeHits() - includeBaseline.hits, precompiledIncludeMisses() - includeBaseline.misses },
+			{ _cache.hits() - resourceBaseline.hits, _cache.misses() - resourceBaseline.misses },
+			compileCacheCounters());
+	};
+
+	if (telemetry)
+		telemetry->start(threads);
+
+	std::thread producer([&]() {
+		source([&](const fs::path& file) {
+			{
+				std::lock_guard<std::mutex> guard(filesLock);
+				results.emplace_back().source = file;
+			}
+			if (telemetry)
+				telemetry->filesQueued();
+			filesAdded.notify_one();
+		});
+
+		std::lock_guard<std::mutex> guard(filesLock);
+		bSourceDone = true;
+		filesAdded.notify_all();
+	});
+
+	// Waits for the next file. Null once the source is done and every file taken, or on cancel.
+	auto takeNextFile = [&]() -> FileResult* {
+		std::unique_lock<std::mutex> guard(filesLock);
+		// Nobody notifies cancellations, so check them once in a while
+		while (nextFile >= results.size() && !bSourceDone && !_cancel)
+			filesAdded.wait_for(guard, std::chrono::milliseconds(100));
+
+		if (_cancel || nextFile >= results.size())
+			return nullptr;
+		return &results[nextFile++];
+	};
+
+	// Compilers are kept between runs: each worker slot owns one warm instance.
+	if (_compilers.size() < static_cast<size_t>(threads))
+		_compilers.resize(threads);
+
+	auto worker = [&](int slot) {
+		WorkerContext ctx;
+		ctx.cache = &_cache;
+		ctx.settings = &_settings;
+		t_context = &ctx;
+
+		std::unique_ptr<CScriptCompiler>& compiler = _compilers[slot];
+		if (!compiler)
+		{
+			Clock::time_point setupStart = Clock::now();
+			std::string setupError;
+			compiler = createCompiler(_settings, _languageContext, _languageContextLock, setupError);
+			setupMicroseconds += static_cast<uint64_t>(elapsedMs(setupStart) * 1000.0);
+
+			if (!setupError.empty())
+			{
+				// Drop the broken instance, so a later run can retry after nwscript.nss is fixed.
+				compiler.reset();
+
+				std::lock_guard<std::mutex> guard(callbackLock);
+				if (summary.setupError.empty())
+					summary.setupError = setupError;
+				_cancel = true;
+			}
+		}
+
+		if (compiler)
+			configureCompiler(*compiler, _settings, _precompiledIncludes.get());
+
+		for (;;)
+		{
+			if (_cancel)
+				break;
+
+			FileResult* next = takeNextFile();
+			if (!next)
+				break;
+
+			FileResult& result = *next;
+			if (telemetry)
+				telemetry->fileStarted();
+
+			// Unchanged scripts take their outputs from the compile cache. New results go in once
+			// compiled, written by the output thread along with the outputs.
+			Clock::time_point cacheStart = Clock::now();
+			NWScriptPlugin::CompileCache::Key cacheKey;
+			NWScriptPlugin::CompileCache::Entry cacheEntry;
+			std::vector<std::string> keyedFiles;
+			const bool bCacheable = _compileCache && compileCacheKey(result, cacheKey, keyedFiles);
+			if (bCacheable && _compileCache->lookup(cacheKey, cacheEntry))
+			{
+				useCachedEntry(cacheEntry, _settings, ctx, result);
+				result.loadMs = result.totalMs = elapsedMs(cacheStart);
+			}
+			else
+			{
+				// Hashing the sources counts as loading them
+				const double cacheMs = _compileCache ? elapsedMs(cacheStart) : 0.0;
+				compileOne(*compiler, ctx, result);
+				result.loadMs += cacheMs;
+				result.totalMs += cacheMs;
+
+				if (bCacheable && (result.status == FileResult::Status::Success || result.status == FileResult::Status::SkippedInclude) &&
+					keyCoversIncludes(keyedFiles, result))
+				{
+					cacheEntry.include = result.status == FileResult::Status::SkippedInclude;
+					for (const NWScriptPlugin::OutputWriter::File& output : ctx.outputs)
+						cacheEntry.outputs.push_back({ output.path.extension().string().substr(1), output.data });
+
+					std::vector<NWScriptPlugin::OutputWriter::File> entryFile;
+					entryFile.push_back({ _compileCache->entryPath(cacheKey), NWScriptPlugin::CompileCache::serialize(cacheEntry) });
+					_writer.submit(std::move(entryFile));
+				}
+			}
+			if (telemetry)
+			{
+				telemetry->fileCompleted();
+				updateCacheCounters();
+			}
+
+			if (result.status == FileResult::Status::Failed && _settings.stopOnError)
+				_cancel = true;
+
+			if (result.status == FileResult::Status::Success && !ctx.outputs.empty())
+			{
+				// The file is reported once its outputs are written (or failed to).
+				_writer.submit(std::move(ctx.outputs), [&, next](const std::vector<NWScriptPlugin::OutputWriter::Result>& written, double writeMs) {
+					FileResult& done = *next;
+					done.writeMs += writeMs;
+					for (const NWScriptPlugin::OutputWriter::Result& output : written)
+					{
+						if (output.status == NWScriptPlugin::OutputWriter::Result::Status::Unchanged)
+							done.outputsUnchanged++;
+						else if (output.status == NWScriptPlugin::OutputWriter::Result::Status::Failed)
+						{
+							done.status = FileResult::Status::Failed;
+							done.code = -STRREF_CSCRIPTCOMPILER_ERROR_UNABLE_TO_OPEN_FILE_FOR_WRITING;
+							done.message = output.errorMessage;
+							if (_settings.stopOnError)
+								_cancel = true;
+						}
+					}
+
+					if (telemetry)
+						telemetry->fileDone(fileTimings(done));
+					if (onFileDone)
+					{
+						std::lock_guard<std::mutex> guard(callbackLock);
+						onFileDone(done);
+					}
+				});
+				ctx.outputs.clear();
+				continue;
+			}
+			ctx.outputs.clear();
+
+			if (telemetry)
+				telemetry->fileDone(fileTimings(result));
+			if (onFileDone)
+			{
+				std::lock_guard<std::mutex> guard(callbackLock);
+				onFileDone(result);
+			}
+		}
+
+		t_context = nullptr;
+	};
+
+	std::vector<std::thread> pool;
+	for (int i = 1; i < threads; i++)
+		pool.emplace_back(worker, i);
+	worker(0);
+	for (std::thread& t : pool)
+		t.join();
+	_writer.flush();
+
+	// After a cancel the source still runs to its end: files not taken stay pending
+	producer.join();
+	summary.files.assign(std::make_move_iterator(results.begin()), std::make_move_iterator(results.end()));
+
+	if (_compileCache)
+	{
+		summary.compileCacheHits = compileCacheCounters().hits;
+		summary.compileCacheMisses = compileCacheCounters().misses;
+		summary.compileCacheEvictions = _compileCache->trim();
+	}
+
+	for (const FileResult& result : summary.files)
+	{
+		summary.outputsUnchanged += result.outputsUnchanged;
+		if (result.status == FileResult::Status::Success)
+			summary.outputsWritten += result.outputs.size() - result.outputsUnchanged;
+
+		switch (result.status)
+		{
+		case FileResult::Status::Success: summary.succeeded++; break;
+		case FileResult::Status::Failed: summary.failed++; break;
+		case FileResult::Status::SkippedInclude: summary.skipped++; break;
+		default: break;
+		}
+	}
+
+	summary.cancelled = _cancel;
+	summary.setupMs = static_cast<double>(setupMicroseconds.load()) / 1000.0 / threads;
+	summary.warm = setupMicroseconds.load() == 0;
+	summary.cacheHits = _cache.hits();
+	summary.cacheMisses = _cache.misses();
+	summary.precompiledIncludeHits = precompiledIncludeHits();
+	summary.precompiledIncludeMisses = precompiledIncludeMisses();
+	summary.wallMs = elapsedMs(start);
+
+	if (telemetry)
+	{
+		updateCacheCounters();
+		telemetry->finish();
+	}
+	return summary;
+}
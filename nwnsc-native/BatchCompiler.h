@@ -0,0 +1,197 @@
+/** @file BatchCompiler.h
+ * Compiles a list of scripts with a pool of native compiler (CScriptCompiler) workers.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "BatchTelemetry.h"
+#include "CompileCache.h"
+#include "IncludeCache.h"
+#include "OutputWriter.h"
+
+class CScriptCompiler;
+class CScriptCompilerIncludeCache;
+class CScriptCompilerLanguageContext;
+
+namespace fs = std::filesystem;
+
+// NWN resource types used by the native compiler
+#define NWN_RESTYPE_NSS 2009
+#define NWN_RESTYPE_NCS 2010
+#define NWN_RESTYPE_NDB 2064
+
+namespace NWScriptCli
+{
+	struct CompilerSettings
+	{
+		bool optimizeScript = false;
+		bool generateSymbols = false;
+		bool stopOnError = false;
+		int threads = 0;                          // 0 = one per hardware thread
+		fs::path outputDir;                       // Empty = write next to each source file
+		std::string languageSource = "nwscript";  // Identifier specification resource
+		bool precompiledIncludes = true;          // Splice includes parsed by earlier scripts instead of parsing them again
+		int maxErrors = 0;                        // Errors reported per script before it is given up on (0 = the first)
+	};
+
+	struct Diagnostic
+	{
+		int32_t code = 0;                         // Compiler STRREF (positive)
+		std::string file;                         // Script or include the error is in
+		int line = 0;                             // 0 when not tied to a line
+		std::string message;
+	};
+
+	struct FileResult
+	{
+		enum class Status { Pending, Success, Failed, SkippedInclude };
+
+		fs::path source;
+		Status status = Status::Pending;
+		int32_t code = 0;                         // Compiler STRREF (positive), 0 on success
+		int line = 0;                             // Line of the diagnostic, when known
+		std::string message;
+		std::vector<Diagnostic> diagnostics;      // Every error, when the compile went on past the first (maxErrors)
+		std::vector<std::string> outputs;         // Files written (or already up to date)
+		size_t outputsUnchanged = 0;              // Outputs left untouched: identical contents on disk
+		bool cached = false;                      // Outputs taken from the compile cache, not compiled
+		std::vector<std::string> includes;        // Resolved include paths, in load order
+		uint64_t sourceBytes = 0;
+		uint64_t outputBytes = 0;
+
+		// Timings in milliseconds. compileMs excludes time spent loading and writing;
+		// writeMs is spent on the output thread.
+		double loadMs = 0;
+		double compileMs = 0;
+		double writeMs = 0;
+		double totalMs = 0;
+	};
+
+	struct BatchSummary
+	{
+		std::vector<FileResult> files;
+		int threads = 0;
+		double wallMs = 0;
+		double setupMs = 0;                       // Worker creation + identifier specification parsing
+		size_t succeeded = 0;
+		size_t failed = 0;
+		size_t skipped = 0;
+		uint64_t cacheHits = 0;
+		uint64_t cacheMisses = 0;
+		uint64_t precompiledIncludeHits = 0;      // Includes spliced from a module parsed by an earlier script
+		uint64_t precompiledIncludeMisses = 0;
+		uint64_t compileCacheHits = 0;            // Scripts whose outputs came from the compile cache
+		uint64_t compileCacheMisses = 0;
+		size_t compileCacheEvictions = 0;         // Least recently used entries removed after the run
+		size_t outputsWritten = 0;
+		size_t outputsUnchanged = 0;
+		bool cancelled = false;
+		bool warm = false;                        // Every worker reused an already initialized compiler
+		std::string setupError;                   // Identifier specification failed to parse
+	};
+
+	class BatchCompiler final
+	{
+	public:
+
+		// Called once per finished file (serialized), from the worker thread that processed it,
+		// or from the output thread once the file's outputs are on disk.
+		typedef std::function<void(const FileResult&)> FileCallback;
+
+		// Feeds a batch while it runs: calls addFile for every script, in order, as they are
+		// found, and returns once there are no more. Runs on a thread of its own.
+		typedef std::function<void(const fs::path& file)> AddFileFunction;
+		typedef std::function<void(const AddFileFunction& addFile)> FileSource;
+
+		BatchCompiler(const CompilerSettings& settings, IncludeCache& cache);
+		~BatchCompiler();
+
+		BatchCompiler(const BatchCompiler&) = delete;
+		BatchCompiler& operator=(const BatchCompiler&) = delete;
+
+		const CompilerSettings& settings() const {
+			return _settings;
+		}
+
+		// Changes settings for the next runs. Warm compilers are kept unless the
+		// identifier specification changes.
+		void setSettings(const CompilerSettings& settings);
+
+		// Creates every worker's compiler up front (the first one parsing the identifier
+		// specification, the others sharing it), so the first run doesn't pay for it.
+		// Returns false with the parse error on failure.
+		bool warmUp(std::string& errorMessage);
+
+		// Discards the warm compilers: the next run parses the identifier specification again.
+		void resetCompilers();
+
+		// Lookups of precompiled include modules since the compilers were created.
+		uint64_t precompiledIncludeHits() const;
+		uint64_t precompiledIncludeMisses() const;
+
+		// Skips compiling scripts whose outputs are in this cache (none by default). Not owned.
+		void setCompileCache(NWScriptPlugin::CompileCache* compileCache) {
+			_compileCache = compileCache;
+		}
+
+		// Checks that the identifier specification (nwscript.nss) can be found.
+		bool validate(std::string& errorMessage);
+
+		// Compiles every file. Results keep the order of the input list. Progress goes to
+		// telemetry, when given (started here, finished on return).
+		// Not reentrant: one run at a time per BatchCompiler.
+		BatchSummary run(const std::vector<fs::path>& files, FileCallback onFileDone = nullptr,
+			NWScriptPlugin::BatchTelemetry* telemetry = nullptr);
+
+		// Same, compiling the files of source as it hands them out: workers start on the first
+		// file while the others are still being found. Results keep the order they were added in.
+		BatchSummary run(const FileSource& source, FileCallback onFileDone = nullptr,
+			NWScriptPlugin::BatchTelemetry* telemetry = nullptr);
+
+		// Requests running batches to stop after the files currently being compiled.
+		void cancel() {
+			_cancel = true;
+		}
+
+	private:
+
+		CompilerSettings _settings;
+		IncludeCache& _cache;
+		NWScriptPlugin::CompileCache* _compileCache = nullptr;
+		std::atomic<bool> _cancel = false;
+
+		// Compiled outputs are written on its own thread, while workers move on to the next file.
+		NWScriptPlugin::OutputWriter _writer;
+
+		// One per worker slot, kept alive between runs (the identifier table stays parsed)
+		std::vector<std::unique_ptr<CScriptCompiler>> _compilers;
+
+		// The parsed identifier specification, shared (read-only) by every worker's compiler.
+		std::shared_ptr<const CScriptCompilerLanguageContext> _languageContext;
+		std::mutex _languageContextLock;
+
+		// Include parse trees shared by every worker, kept as long as the compilers.
+		std::unique_ptr<CScriptCompilerIncludeCache> _precompiledIncludes;
+
+		int workerCount(size_t files) const;
+
+		// Both run() overloads: maxFiles bounds the number of workers worth starting.
+		BatchSummary run(const FileSource& source, size_t maxFiles, FileCallback onFileDone,
+			NWScriptPlugin::BatchTelemetry* telemetry);
+
+		// Key of a script's outputs in the compile cache, and the files it covers. False when the
+		// script or one of its includes can't be read: the compile reports why.
+		bool compileCacheKey(FileResult& result, NWScriptPlugin::CompileCache::Key& key, std::vector<std::string>& keyedFiles);
+	};
+}
@@ -0,0 +1,172 @@
+/** @file BatchDisassembler.cpp
+ * Disassembles a list of compiled scripts (NCS) in parallel, into .ncs.pcode listings.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include "exobase.h"
+#include "scriptcomp.h"
+#include "scripterrors.h"
+
+#include "BatchDisassembler.h"
+#include "MappedFile.h"
+#include "NdbFile.h"
+
+using namespace NWScriptCli;
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsedMs(Clock::time_point since)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+}
+
+void BatchDisassembler::disassembleOne(FileResult& result, std::vector<NWScriptPlugin::OutputWriter::File>& outputs) const
+{
+	Clock::time_point start = Clock::now();
+
+	MappedFile binary;
+	if (!binary.open(result.source))
+	{
+		result.status = FileResult::Status::Failed;
+		result.code = -STRREF_CSCRIPTCOMPILER_ERROR_FILE_NOT_FOUND;
+		result.message = "Unable to read file.";
+		return;
+	}
+
+	NWScriptPlugin::NdbFile symbols;
+	bool haveSymbols = false;
+	if (_settings.useSymbols)
+	{
+		fs::path symbolsFile = result.source;
+		symbolsFile.replace_extension(".ndb");
+		std::error_code ec;
+		std::string symbolsError;
+		if (fs::is_regular_file(symbolsFile, ec))
+			haveSymbols = symbols.load(symbolsFile, symbolsError);
+	}
+	result.loadMs = elapsedMs(start);
+
+	Clock::time_point decodeStart = Clock::now();
+	std::string listing;
+	std::string errorMessage;
+	NWScriptPlugin::NcsDisassembler disassembler(_settings.options);
+	bool success = disassembler.disassemble(binary.data(), binary.size(), haveSymbols ? &symbols : nullptr, listing, errorMessage);
+	result.compileMs = elapsedMs(decodeStart);
+
+	if (!success)
+	{
+		result.status = FileResult::Status::Failed;
+		result.message = errorMessage;
+		return;
+	}
+
+	fs::path outputDir = _settings.outputDir.empty() ? result.source.parent_path() : _settings.outputDir;
+	fs::path outputFile = outputDir / (result.source.stem().string() + ".ncs.pcode");
+	outputs.push_back({ outputFile, std::vector<uint8_t>(listing.begin(), listing.end()) });
+	result.outputs.push_back(outputFile.string());
+	result.status = FileResult::Status::Success;
+}
+
+BatchSummary BatchDisassembler::run(const std::vector<fs::path>& files, BatchCompiler::FileCallback onFileDone)
+{
+	BatchSummary summary;
+	Clock::time_point start = Clock::now();
+
+	summary.files.resize(files.size());
+	for (size_t i = 0; i < files.size(); i++)
+		summary.files[i].source = files[i];
+
+	int threads = _settings.threads > 0 ? _settings.threads : static_cast<int>(std::thread::hardware_concurrency());
+	threads = std::max(1, std::min<int>(threads, static_cast<int>(std::max<size_t>(files.size(), 1))));
+	summary.threads = threads;
+
+	std::atomic<size_t> nextFile = 0;
+	std::mutex callbackLock;
+	_cancel = false;
+
+	auto worker = [&]() {
+		std::vector<NWScriptPlugin::OutputWriter::File> outputs;
+		for (;;)
+		{
+			if (_cancel)
+				break;
+
+			size_t index = nextFile.fetch_add(1);
+			if (index >= summary.files.size())
+				break;
+
+			FileResult& result = summary.files[index];
+			disassembleOne(result, outputs);
+			result.totalMs = result.loadMs + result.compileMs;
+
+			if (result.status == FileResult::Status::Failed)
+			{
+				if (_settings.stopOnError)
+					_cancel = true;
+				if (onFileDone)
+				{
+					std::lock_guard<std::mutex> guard(callbackLock);
+					onFileDone(result);
+				}
+				continue;
+			}
+
+			_writer.submit(std::move(outputs), [&, index](const std::vector<NWScriptPlugin::OutputWriter::Result>& written, double writeMs) {
+				FileResult& done = summary.files[index];
+				done.writeMs += writeMs;
+				for (const NWScriptPlugin::OutputWriter::Result& output : written)
+				{
+					if (output.status == NWScriptPlugin::OutputWriter::Result::Status::Unchanged)
+						done.outputsUnchanged++;
+					else if (output.status == NWScriptPlugin::OutputWriter::Result::Status::Failed)
+					{
+						done.status = FileResult::Status::Failed;
+						done.code = -STRREF_CSCRIPTCOMPILER_ERROR_UNABLE_TO_OPEN_FILE_FOR_WRITING;
+						done.message = output.errorMessage;
+						if (_settings.stopOnError)
+							_cancel = true;
+					}
+				}
+
+				if (onFileDone)
+				{
+					std::lock_guard<std::mutex> guard(callbackLock);
+					onFileDone(done);
+				}
+			});
+			outputs.clear();
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (int i = 1; i < threads; i++)
+		pool.emplace_back(worker);
+	worker();
+	for (std::thread& t : pool)
+		t.join();
+	_writer.flush();
+
+	for (const FileResult& result : summary.files)
+	{
+		summary.outputsUnchanged += result.outputsUnchanged;
+		if (result.status == FileResult::Status::Success)
+		{
+			summary.succeeded++;
+			summary.outputsWritten += result.outputs.size() - result.outputsUnchanged;
+		}
+		else if (result.status == FileResult::Status::Failed)
+			summary.failed++;
+	}
+
+	summary.cancelled = _cancel;
+	summary.warm = true;
+	summary.wallMs = elapsedMs(start);
+	return summary;
+}
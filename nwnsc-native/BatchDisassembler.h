@@ -0,0 +1,58 @@
+/** @file BatchDisassembler.h
+ * Disassembles a list of compiled scripts (NCS) in parallel, into .ncs.pcode listings.
+ *
+ * Each script's .ndb, when present next to it, annotates the listing with function names
+ * and source lines. Listings are written through the OutputWriter, so the ones that didn't
+ * change are left untouched: disassembling a whole module built by two compiler versions
+ * into the same directory, the modified timestamps point at the scripts that differ.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <vector>
+
+#include "BatchCompiler.h"
+#include "NcsDisassembler.h"
+#include "OutputWriter.h"
+
+namespace fs = std::filesystem;
+
+namespace NWScriptCli
+{
+	struct DisassemblerSettings
+	{
+		int threads = 0;                          // 0 = one per hardware thread
+		fs::path outputDir;                       // Empty = write next to each binary
+		bool useSymbols = true;                   // Annotate from the .ndb next to each binary
+		bool stopOnError = false;
+		NWScriptPlugin::NcsDisassembler::Options options;
+	};
+
+	class BatchDisassembler final
+	{
+	public:
+
+		explicit BatchDisassembler(const DisassemblerSettings& settings) : _settings(settings) {}
+
+		// Disassembles every file. Results keep the order of the input list; the callback is
+		// serialized and called once each listing is on disk.
+		BatchSummary run(const std::vector<fs::path>& files, BatchCompiler::FileCallback onFileDone = nullptr);
+
+		void cancel() {
+			_cancel = true;
+		}
+
+	private:
+
+		DisassemblerSettings _settings;
+		std::atomic<bool> _cancel = false;
+		NWScriptPlugin::OutputWriter _writer;
+
+		void disassembleOne(FileResult& result, std::vector<NWScriptPlugin::OutputWriter::File>& outputs) const;
+	};
+}
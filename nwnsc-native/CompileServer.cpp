@@ -0,0 +1,571 @@
+/** @file CompileServer.cpp
+ * Long running compile server. Keeps the compilers (with nwscript.nss already parsed) and
+ * the include cache warm between requests.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+#include "CompileServer.h"
+#include "InputCollector.h"
+#include "JsonReader.h"
+#include "JsonWriter.h"
+#include "Report.h"
+#include "ResourceIndex.h"
+#include "ScriptDependencies.h"
+
+using namespace NWScriptCli;
+
+typedef std::chrono::steady_clock Clock;
+
+#define READ_CHUNK_SIZE    65536
+#define MAX_REQUEST_LENGTH (16 * 1024 * 1024)
+
+static volatile sig_atomic_t g_stopRequested = 0;
+
+static void onStopSignal(int)
+{
+	g_stopRequested = 1;
+}
+
+static void installSignalHandlers()
+{
+	struct sigaction action = {};
+	action.sa_handler = onStopSignal;
+	sigemptyset(&action.sa_mask);
+	action.sa_flags = 0;    // No SA_RESTART: poll() must wake up
+	sigaction(SIGINT, &action, nullptr);
+	sigaction(SIGTERM, &action, nullptr);
+
+	signal(SIGPIPE, SIG_IGN);
+}
+
+static bool writeAll(int fd, const std::string& data)
+{
+	size_t written = 0;
+	while (written < data.size())
+	{
+		ssize_t ret = write(fd, data.data() + written, data.size() - written);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		written += static_cast<size_t>(ret);
+	}
+	return true;
+}
+
+// Splits complete lines out of a receive buffer. Returns false if a line is too long, or if the
+// handler stopped (it returns false when its response couldn't be written, or on shutdown).
+template <typename Handler>
+static bool consumeLines(std::string& buffer, Handler handler)
+{
+	size_t start = 0;
+	for (;;)
+	{
+		size_t newline = buffer.find('\n', start);
+		if (newline == std::string::npos)
+			break;
+
+		std::string line = buffer.substr(start, newline - start);
+		start = newline + 1;
+
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		if (line.find_first_not_of(" \t") == std::string::npos)
+			continue;
+
+		if (!handler(line))
+		{
+			buffer.erase(0, start);
+			return false;
+		}
+	}
+
+	buffer.erase(0, start);
+	return buffer.size() <= MAX_REQUEST_LENGTH;
+}
+
+static bool equalsNoCase(const std::string& a, const std::string& b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); i++)
+		if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i])))
+			return false;
+	return true;
+}
+
+static void writeId(JsonWriter& json, const JsonValue& id)
+{
+	json.key("id");
+	if (id.isString())
+		json.value(id.asString());
+	else if (id.isNumber() && std::floor(id.asNumber()) == id.asNumber())
+		json.value(static_cast<long long>(id.asNumber()));
+	else if (id.isNumber())
+		json.value(id.asNumber());
+	else
+		json.null();
+}
+
+static void writeStringArray(JsonWriter& json, const char* name, const std::vector<std::string>& values)
+{
+	json.key(name).beginArray();
+	for (const std::string& v : values)
+		json.value(v);
+	json.endArray();
+}
+
+CompileServer::CompileServer(BatchCompiler& compiler, IncludeCache& cache)
+	: _compiler(compiler), _cache(cache), _defaultSettings(compiler.settings()), _startTime(Clock::now())
+{
+	for (const fs::path& dir : _cache.searchPaths())
+		_watcher.watch(dir);
+}
+
+void CompileServer::processChanges()
+{
+	_watcher.drain([this](const fs::path& path) { onFileChanged(path); });
+}
+
+void CompileServer::onFileChanged(const fs::path& path)
+{
+	_invalidations++;
+
+	if (path.empty())
+	{
+		// Lost events: nothing in the cache can be trusted anymore.
+		_cache.clear();
+		_compiler.resetCompilers();
+		return;
+	}
+
+	_cache.invalidate(path);
+
+	// The identifier table is parsed once per compiler: a new nwscript.nss needs new compilers.
+	if (equalsNoCase(path.stem().string(), _compiler.settings().languageSource) &&
+		equalsNoCase(path.extension().string(), ".nss"))
+		_compiler.resetCompilers();
+}
+
+std::string CompileServer::handleRequest(const std::string& line, bool& shutdownRequested)
+{
+	Clock::time_point start = Clock::now();
+	_requests++;
+
+	// Changes that happened before this request arrived must be seen by it.
+	processChanges();
+
+	std::ostringstream out;
+	JsonWriter json(out);
+
+	JsonValue request;
+	std::string error;
+	json.beginObject();
+
+	if (!JsonValue::parse(line, request, error) || !request.isObject())
+	{
+		json.key("id").null();
+		json.member("ok", false);
+		json.member("error", error.empty() ? std::string("Request must be a JSON object") : "Malformed request: " + error);
+		json.endObject();
+		return out.str();
+	}
+
+	std::string command = request.getString("command");
+	writeId(json, request["id"]);
+	json.member("command", command);
+
+	bool success = false;
+	if (command == "compile")
+		success = doCompile(request, json, error);
+	else if (command == "preprocess")
+		success = doPreprocess(request, json, error);
+	else if (command == "dependencies")
+		success = doDependencies(request, json, error);
+	else if (command == "invalidate")
+		success = doInvalidate(request, json, error);
+	else if (command == "status")
+	{
+		doStatus(json);
+		success = true;
+	}
+	else if (command == "shutdown")
+	{
+		shutdownRequested = true;
+		success = true;
+	}
+	else
+		error = "Unknown command: \"" + command + "\"";
+
+	json.member("ok", success);
+	if (!success)
+		json.member("error", error);
+	json.member("elapsedMs", std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+	json.endObject();
+
+	return out.str();
+}
+
+bool CompileServer::doCompile(const JsonValue& request, JsonWriter& json, std::string& error)
+{
+	std::vector<std::string> inputs;
+	if (request["files"].isArray())
+	{
+		for (const JsonValue& v : request["files"].asArray())
+			if (v.isString())
+				inputs.push_back(v.asString());
+	}
+	if (request["file"].isString())
+		inputs.push_back(request.getString("file"));
+
+	if (inputs.empty())
+	{
+		error = "No files to compile";
+		return false;
+	}
+
+	CompilerSettings settings = _defaultSettings;
+	settings.optimizeScript = request.getBool("optimize", settings.optimizeScript);
+	settings.generateSymbols = request.getBool("symbols", settings.generateSymbols);
+	settings.stopOnError = request.getBool("stopOnError", settings.stopOnError);
+	settings.precompiledIncludes = request.getBool("precompiledIncludes", settings.precompiledIncludes);
+	settings.maxErrors = std::max(0, static_cast<int>(request.getNumber("maxErrors", settings.maxErrors)));
+	if (request["outputDir"].isString())
+		settings.outputDir = request.getString("outputDir");
+
+	std::error_code ec;
+	if (!settings.outputDir.empty() && !fs::is_directory(settings.outputDir, ec))
+	{
+		error = "Output directory does not exist: " + settings.outputDir.string();
+		return false;
+	}
+
+	InputCollector collector("nss", request.getBool("recurse", false));
+	std::vector<std::string> notFound;
+	for (const std::string& input : inputs)
+	{
+		if (!collector.add(input))
+			notFound.push_back(input);
+	}
+
+	if (collector.files().empty())
+	{
+		error = "No scripts found for the given inputs";
+		return false;
+	}
+
+	// Start watching every directory we compile from, so later edits invalidate the cache.
+	for (const fs::path& file : collector.files())
+		_watcher.watch(file.parent_path());
+
+	_compiler.setSettings(settings);
+	BatchSummary summary = _compiler.run(collector.files());
+	_compiler.setSettings(_defaultSettings);
+
+	if (!summary.setupError.empty())
+	{
+		error = "Failed to load the identifier specification: " + summary.setupError;
+		return false;
+	}
+
+	json.key("summary").beginObject();
+	json.member("files", summary.files.size());
+	json.member("succeeded", summary.succeeded);
+	json.member("failed", summary.failed);
+	json.member("skipped", summary.skipped);
+	json.member("cancelled", summary.cancelled);
+	json.member("warm", summary.warm);
+	json.member("outputsWritten", summary.outputsWritten);
+	json.member("outputsUnchanged", summary.outputsUnchanged);
+	json.member("wallMs", summary.wallMs);
+	json.endObject();
+
+	writeStringArray(json, "notFound", notFound);
+
+	json.key("results").beginArray();
+	for (const FileResult& result : summary.files)
+		writeFileResult(json, result);
+	json.endArray();
+
+	return true;
+}
+
+bool CompileServer::doPreprocess(const JsonValue& request, JsonWriter& json, std::string& error)
+{
+	fs::path script = request.getString("file");
+	if (script.empty())
+	{
+		error = "Missing \"file\"";
+		return false;
+	}
+
+	script = fs::absolute(script);
+	std::string output;
+	DependencyList dependencies;
+	if (!expandIncludes(_cache, script, output, dependencies))
+	{
+		error = "Unable to read " + script.string();
+		return false;
+	}
+
+	_watcher.watch(script.parent_path());
+
+	json.member("file", script.string());
+	writeStringArray(json, "includes", dependencies.includes);
+	writeStringArray(json, "missing", dependencies.missing);
+	json.member("output", output);
+	return true;
+}
+
+bool CompileServer::doDependencies(const JsonValue& request, JsonWriter& json, std::string& error)
+{
+	fs::path script = request.getString("file");
+	if (script.empty())
+	{
+		error = "Missing \"file\"";
+		return false;
+	}
+
+	script = fs::absolute(script);
+	DependencyList dependencies;
+	if (!collectDependencies(_cache, script, dependencies))
+	{
+		error = "Unable to read " + script.string();
+		return false;
+	}
+
+	_watcher.watch(script.parent_path());
+
+	json.member("file", script.string());
+	writeStringArray(json, "includes", dependencies.includes);
+	writeStringArray(json, "missing", dependencies.missing);
+	return true;
+}
+
+bool CompileServer::doInvalidate(const JsonValue& request, JsonWriter& json, std::string&)
+{
+	size_t invalidated = 0;
+	if (request["paths"].isArray() && !request["paths"].asArray().empty())
+	{
+		for (const JsonValue& v : request["paths"].asArray())
+		{
+			if (!v.isString())
+				continue;
+			onFileChanged(fs::absolute(v.asString()));
+			invalidated++;
+		}
+	}
+	else
+	{
+		onFileChanged(fs::path());
+		invalidated = 1;
+	}
+
+	json.member("invalidated", invalidated);
+	return true;
+}
+
+void CompileServer::doStatus(JsonWriter& json)
+{
+	json.member("uptimeMs", std::chrono::duration<double, std::milli>(Clock::now() - _startTime).count());
+	json.member("requests", _requests);
+	json.member("cachedFiles", _cache.size());
+	json.member("cacheHits", _cache.hits());
+	json.member("cacheMisses", _cache.misses());
+	json.member("precompiledIncludeHits", _compiler.precompiledIncludeHits());
+	json.member("precompiledIncludeMisses", _compiler.precompiledIncludeMisses());
+	json.member("invalidations", _invalidations);
+	json.member("watching", _watcher.isAvailable());
+	json.member("watchedDirectories", _watcher.watchCount());
+	if (const ResourceIndex* index = _cache.resourceIndex())
+	{
+		json.key("resourceIndex").beginObject();
+		json.member("complete", index->isComplete());
+		json.member("resources", index->size());
+		json.member("archives", index->archiveCount());
+		if (index->isComplete())
+		{
+			json.member("loadedFromDisk", index->loadedFromDisk());
+			json.member("buildMs", index->buildMs());
+		}
+		std::string error = index->errorMessage();
+		if (!error.empty())
+			json.member("error", error);
+		json.endObject();
+	}
+}
+
+int CompileServer::runStdio()
+{
+	installSignalHandlers();
+
+	std::string buffer;
+	bool shutdown = false;
+	std::vector<char> chunk(READ_CHUNK_SIZE);
+
+	while (!shutdown && !g_stopRequested)
+	{
+		struct pollfd fds[2] = { { STDIN_FILENO, POLLIN, 0 }, { _watcher.fd(), POLLIN, 0 } };
+		int ret = poll(fds, _watcher.isAvailable() ? 2 : 1, -1);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			std::perror("poll");
+			return 1;
+		}
+
+		if (_watcher.isAvailable() && (fds[1].revents & POLLIN))
+			processChanges();
+
+		if (!(fds[0].revents & (POLLIN | POLLHUP | POLLERR)))
+			continue;
+
+		ssize_t length = read(STDIN_FILENO, chunk.data(), chunk.size());
+		if (length < 0 && errno == EINTR)
+			continue;
+		if (length <= 0)
+			break;
+
+		buffer.append(chunk.data(), static_cast<size_t>(length));
+		bool consumed = consumeLines(buffer, [&](const std::string& line) {
+			std::string response = handleRequest(line, shutdown);
+			if (!writeAll(STDOUT_FILENO, response + "\n"))
+				shutdown = true;
+			return !shutdown;
+		});
+
+		// Stopping for a shutdown (stdout closed included) isn't an error
+		if (!consumed && !shutdown)
+		{
+			std::fprintf(stderr, "Error: Request exceeds %d bytes.\n", MAX_REQUEST_LENGTH);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int CompileServer::runSocket(const std::string& socketPath)
+{
+	installSignalHandlers();
+
+	struct sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(address.sun_path))
+	{
+		std::fprintf(stderr, "Error: Socket path too long: %s\n", socketPath.c_str());
+		return 1;
+	}
+	std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+	// Remove a stale socket left by a previous instance (never remove other file types).
+	struct stat st;
+	if (lstat(socketPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(socketPath.c_str());
+
+	int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listenFd < 0 || bind(listenFd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0 ||
+		listen(listenFd, 16) < 0)
+	{
+		std::fprintf(stderr, "Error: Unable to listen on %s: %s\n", socketPath.c_str(), std::strerror(errno));
+		if (listenFd >= 0)
+			close(listenFd);
+		return 1;
+	}
+
+	struct Client
+	{
+		int fd;
+		std::string buffer;
+	};
+	std::vector<Client> clients;
+	std::vector<char> chunk(READ_CHUNK_SIZE);
+	bool shutdown = false;
+
+	while (!shutdown && !g_stopRequested)
+	{
+		std::vector<struct pollfd> fds;
+		fds.push_back({ listenFd, POLLIN, 0 });
+		fds.push_back({ _watcher.fd(), static_cast<short>(_watcher.isAvailable() ? POLLIN : 0), 0 });
+		for (const Client& client : clients)
+			fds.push_back({ client.fd, POLLIN, 0 });
+
+		int ret = poll(fds.data(), fds.size(), -1);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			std::perror("poll");
+			break;
+		}
+
+		if (fds[1].revents & POLLIN)
+			processChanges();
+
+		// Serve existing clients first (their indexes match fds[2..])
+		for (size_t i = 0; i < clients.size() && !shutdown; i++)
+		{
+			if (!(fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+
+			Client& client = clients[i];
+			ssize_t length = read(client.fd, chunk.data(), chunk.size());
+			if (length < 0 && errno == EINTR)
+				continue;
+
+			bool drop = length <= 0;
+			if (!drop)
+			{
+				client.buffer.append(chunk.data(), static_cast<size_t>(length));
+				drop = !consumeLines(client.buffer, [&](const std::string& line) {
+					std::string response = handleRequest(line, shutdown);
+					if (!writeAll(client.fd, response + "\n"))
+						return false;
+					return !shutdown;
+				});
+			}
+
+			if (drop)
+			{
+				close(client.fd);
+				client.fd = -1;
+			}
+		}
+
+		clients.erase(std::remove_if(clients.begin(), clients.end(), [](const Client& c) { return c.fd < 0; }), clients.end());
+
+		if (fds[0].revents & POLLIN)
+		{
+			int clientFd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+			if (clientFd >= 0)
+				clients.push_back({ clientFd, std::string() });
+		}
+	}
+
+	for (const Client& client : clients)
+		close(client.fd);
+	close(listenFd);
+	unlink(socketPath.c_str());
+
+	return 0;
+}
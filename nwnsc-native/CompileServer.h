@@ -0,0 +1,70 @@
+/** @file CompileServer.h
+ * Long running compile server. Keeps the compilers (with nwscript.nss already parsed) and
+ * the include cache warm between requests, and watches source directories to invalidate
+ * cached files when they change.
+ *
+ * Protocol: one JSON object per line in, one JSON object per line out. Requests:
+ *   {"id":1, "command":"compile", "files":["a.nss", "dir", "*.nss"], "optimize":true, "symbols":false, "outputDir":"out",
+ *    "maxErrors":20}
+ *   {"id":2, "command":"preprocess", "file":"a.nss"}
+ *   {"id":3, "command":"dependencies", "file":"a.nss"}
+ *   {"id":4, "command":"invalidate", "paths":["inc/x.nss"]}   (no paths = drop everything)
+ *   {"id":5, "command":"status"}
+ *   {"id":6, "command":"shutdown"}
+ * Every response carries the request "id", "ok" and, on failure, "error".
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <chrono>
+#include <string>
+
+#include "BatchCompiler.h"
+#include "DirectoryWatcher.h"
+#include "IncludeCache.h"
+
+namespace NWScriptCli
+{
+	class JsonValue;
+	class JsonWriter;
+
+	class CompileServer final
+	{
+	public:
+
+		CompileServer(BatchCompiler& compiler, IncludeCache& cache);
+
+		// Serves requests from stdin, answering on stdout, until EOF or "shutdown".
+		int runStdio();
+
+		// Serves requests from clients of a Unix domain socket until "shutdown" or a signal.
+		int runSocket(const std::string& socketPath);
+
+		// Processes a single request line and returns the response line (without newline).
+		// Sets shutdownRequested when the client asked the server to stop.
+		std::string handleRequest(const std::string& line, bool& shutdownRequested);
+
+	private:
+
+		BatchCompiler& _compiler;
+		IncludeCache& _cache;
+		DirectoryWatcher _watcher;
+		CompilerSettings _defaultSettings;
+		std::chrono::steady_clock::time_point _startTime;
+		uint64_t _requests = 0;
+		uint64_t _invalidations = 0;
+
+		// Applies pending file change notifications to the caches.
+		void processChanges();
+		void onFileChanged(const fs::path& path);
+
+		bool doCompile(const JsonValue& request, JsonWriter& json, std::string& error);
+		bool doPreprocess(const JsonValue& request, JsonWriter& json, std::string& error);
+		bool doDependencies(const JsonValue& request, JsonWriter& json, std::string& error);
+		bool doInvalidate(const JsonValue& request, JsonWriter& json, std::string& error);
+		void doStatus(JsonWriter& json);
+	};
+}
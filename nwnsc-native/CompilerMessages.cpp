@@ -0,0 +1,128 @@
+/** @file CompilerMessages.cpp
+ * Resolves native compiler error STRREFs into readable text (replaces the game's TLK lookup).
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <cstdlib>
+#include <unordered_map>
+#include <string>
+
+#include "CompilerMessages.h"
+
+using namespace NWScriptCli;
+
+// Same table the plugin uses in NWScriptCompiler.cpp
+static const std::unordered_map<int, std::string> CompileErrorTlk = {
+    {560, "Error: Unexpected character"},
+    {561, "Error: Fatal compiler error"},
+    {562, "Error: Program compound statement at start"},
+    {563, "Error: Unexpected end compound statement"},
+    {564, "Error: After compound statement at end"},
+    {565, "Error: Parsing variable list"},
+    {566, "Error: Unknown state in compiler"},
+    {567, "Error: Invalid declaration type"},
+    {568, "Error: No left bracket on expression"},
+    {569, "Error: No right bracket on expression"},
+    {570, "Error: Bad start of statement"},
+    {571, "Error: No left bracket on arg list"},
+    {572, "Error: No right bracket on arg list"},
+    {573, "Error: No semicolon after expression"},
+    {574, "Error: Parsing assignment statement"},
+    {575, "Error: Bad lvalue"},
+    {576, "Error: Bad constant type"},
+    {577, "Error: Identifier list full"},
+    {578, "Error: Non integer id for integer constant"},
+    {579, "Error: Non float id for float constant"},
+    {580, "Error: Non string id for string constant"},
+    {581, "Error: Variable already used within scope"},
+    {582, "Error: Variable defined without type"},
+    {583, "Error: Incorrect variable state left on stack"},
+    {584, "Error: Non integer expression where integer required"},
+    {585, "Error: Void expression where non void required"},
+    {586, "Error: Invalid parameters for assignment"},
+    {587, "Error: Declaration does not match parameters"},
+    {588, "Error: Logical operation has invalid operands"},
+    {589, "Error: Equality test has invalid operands"},
+    {590, "Error: Comparison test has invalid operands"},
+    {591, "Error: Shift operation has invalid operands"},
+    {592, "Error: Arithmetic operation has invalid operands"},
+    {593, "Error: Unknown operation in semantic check"},
+    {594, "Error: Script too large"},
+    {595, "Error: Return statement has no parameters"},
+    {596, "Error: No while after do keyword"},
+    {597, "Error: Function definition missing name"},
+    {598, "Error: Function definition missing parameter list"},
+    {599, "Error: Malformed parameter list"},
+    {600, "Error: Bad type specifier"},
+    {601, "Error: No semicolon after structure"},
+    {602, "Error: Ellipsis in identifier"},
+    {603, "Error: File not found"},
+    {604, "Error: Include recursive"},
+    {605, "Error: Include too many levels"},
+    {606, "Error: Parsing return statement"},
+    {607, "Error: Parsing identifier list"},
+    {608, "Error: Parsing function declaration"},
+    {609, "Error: Duplicate function implementation"},
+    {610, "Error: Token too long"},
+    {611, "Error: Undefined structure"},
+    {612, "Error: Left of structure part not structure"},
+    {613, "Error: Right of structure part not field in structure"},
+    {614, "Error: Undefined field in structure"},
+    {615, "Error: Structure redefined"},
+    {616, "Error: Variable used twice in same structure"},
+    {617, "Error: Function implementation and definition differ"},
+    {618, "Error: Mismatched types"},
+    {619, "Error: Integer not at top of stack"},
+    {620, "Error: Return type and function type mismatched"},
+    {621, "Error: Not all control paths return a value"},
+    {622, "Error: Undefined identifier"},
+    {623, "Error: No function main in script"},
+    {624, "Error: Function main must have void return value"},
+    {625, "Error: Function main must have no parameters"},
+    {626, "Error: Non void function cannot be a statement"},
+    {627, "Error: Bad variable name"},
+    {628, "Error: Non optional parameter cannot follow optional parameter"},
+    {629, "Error: Type does not have an optional parameter"},
+    {630, "Error: Non constant in function declaration"},
+    {631, "Error: Parsing constant vector"},
+    {1594, "Error: Operand must be an integer lvalue"},
+    {1595, "Error: Conditional requires second expression"},
+    {1596, "Error: Conditional must have matching return types"},
+    {1597, "Error: Multiple default statements within switch"},
+    {1598, "Error: Multiple case constant statements within switch"},
+    {1599, "Error: Case parameter not a constant integer"},
+    {1600, "Error: Switch must evaluate to an integer"},
+    {1601, "Error: No colon after default label"},
+    {1602, "Error: No colon after case label"},
+    {1603, "Error: No semicolon after statement"},
+    {4834, "Error: Break outside of loop or case statement"},
+    {4835, "Error: Too many parameters on function"},
+    {4836, "Error: Unable to open file for writing"},
+    {4855, "Error: Unterminated string constant"},
+    {5182, "Error: No function intsc in script"},
+    {5183, "Error: Function intsc must have void return value"},
+    {5184, "Error: Function intsc must have no parameters"},
+    {6804, "Error: Jumping over declaration statements case disallowed"},
+    {6805, "Error: Jumping over declaration statements default disallowed"},
+    {6823, "Error: Else without corresponding if"},
+    {3741, "Error: Invalid type for const keyword"},
+    {3742, "Error: Const keyword cannot be used on non global variables"},
+    {3752, "Error: Invalid value assigned to constant"},
+    {9081, "Error: Switch condition cannot be followed by a null statement"},
+    {9082, "Error: While condition cannot be followed by a null statement"},
+    {9083, "Error: For statement cannot be followed by a null statement"},
+    {9155, "Error: Cannot include this file twice"},
+    {10407, "If condition cannot be followed by a null statement"},
+    {40104, "Else cannot be followed by a null statement"}
+};
+
+const char* NWScriptCli::resolveCompilerMessage(STRREF strRef)
+{
+	auto it = CompileErrorTlk.find(std::abs(static_cast<int>(strRef)));
+	if (it != CompileErrorTlk.end())
+		return it->second.c_str();
+
+	return "Error: Unknown error code";
+}
@@ -0,0 +1,17 @@
+/** @file CompilerMessages.h
+ * Resolves native compiler error STRREFs into readable text (replaces the game's TLK lookup).
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include "exobase.h"
+
+namespace NWScriptCli
+{
+	// Returns the message associated with a compiler STRREF (positive or negative).
+	// Never returns null; unknown codes resolve to a generic message.
+	const char* resolveCompilerMessage(STRREF strRef);
+}
@@ -0,0 +1,100 @@
+/** @file DirectoryWatcher.cpp
+ * Non-recursive directory change notifications (inotify), used by the compile server
+ * to invalidate cached sources.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <cerrno>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "DirectoryWatcher.h"
+
+using namespace NWScriptCli;
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB)
+
+DirectoryWatcher::DirectoryWatcher()
+{
+	_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+	if (_fd >= 0)
+		close(_fd);
+}
+
+bool DirectoryWatcher::watch(const fs::path& dir)
+{
+	if (_fd < 0)
+		return false;
+
+	std::string key = fs::absolute(dir).lexically_normal().string();
+	if (_watchedDirs.count(key))
+		return true;
+
+	int wd = inotify_add_watch(_fd, key.c_str(), WATCH_EVENTS | IN_ONLYDIR);
+	if (wd < 0)
+		return false;
+
+	_watches[wd] = key;
+	_watchedDirs[key] = wd;
+	return true;
+}
+
+size_t DirectoryWatcher::drain(const ChangeCallback& onChange)
+{
+	if (_fd < 0)
+		return 0;
+
+	size_t changes = 0;
+	alignas(struct inotify_event) char buffer[16 * 1024];
+
+	for (;;)
+	{
+		ssize_t length = read(_fd, buffer, sizeof(buffer));
+		if (length <= 0)
+		{
+			if (length < 0 && errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (char* p = buffer; p < buffer + length; )
+		{
+			const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+			p += sizeof(struct inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				onChange(fs::path());
+				changes++;
+				continue;
+			}
+
+			if (event->mask & IN_IGNORED)
+			{
+				// Directory removed or unmounted
+				auto it = _watches.find(event->wd);
+				if (it != _watches.end())
+				{
+					_watchedDirs.erase(it->second);
+					_watches.erase(it);
+				}
+				continue;
+			}
+
+			auto it = _watches.find(event->wd);
+			if (it == _watches.end() || event->len == 0)
+				continue;
+
+			onChange(it->second / event->name);
+			changes++;
+		}
+	}
+
+	return changes;
+}
@@ -0,0 +1,59 @@
+/** @file DirectoryWatcher.h
+ * Non-recursive directory change notifications (inotify), used by the compile server
+ * to invalidate cached sources.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+namespace NWScriptCli
+{
+	class DirectoryWatcher final
+	{
+	public:
+
+		// Receives the full path of a changed file. An empty path means events were
+		// lost (queue overflow) and everything must be considered changed.
+		typedef std::function<void(const fs::path&)> ChangeCallback;
+
+		DirectoryWatcher();
+		~DirectoryWatcher();
+
+		DirectoryWatcher(const DirectoryWatcher&) = delete;
+		DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+		bool isAvailable() const {
+			return _fd >= 0;
+		}
+
+		// Pollable descriptor, readable when events are pending.
+		int fd() const {
+			return _fd;
+		}
+
+		// Starts watching a directory. Watching the same directory twice is a no-op.
+		bool watch(const fs::path& dir);
+
+		size_t watchCount() const {
+			return _watches.size();
+		}
+
+		// Reads every pending event without blocking. Returns the number of changes reported.
+		size_t drain(const ChangeCallback& onChange);
+
+	private:
+
+		int _fd = -1;
+		std::unordered_map<int, fs::path> _watches;
+		std::unordered_map<std::string, int> _watchedDirs;
+	};
+}
@@ -0,0 +1,162 @@
+/** @file IncludeCache.cpp
+ * Resolves script resources (includes, nwscript.nss) against a list of search paths.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+
+#include "IncludeCache.h"
+#include "ResourceIndex.h"
+
+using namespace NWScriptCli;
+
+void IncludeCache::addSearchPath(const fs::path& dir)
+{
+	if (dir.empty())
+		return;
+
+	fs::path normalized = fs::absolute(dir).lexically_normal();
+	if (std::find(_searchPaths.begin(), _searchPaths.end(), normalized) == _searchPaths.end())
+		_searchPaths.push_back(normalized);
+}
+
+IncludeCache::EntryPtr IncludeCache::resolve(const std::string& resourceName, const std::string& extension,
+	const fs::path& localDir)
+{
+	// Resource names are case insensitive inside the game; files on disk usually are lowercase.
+	std::string fileName = resourceName + "." + extension;
+	std::string lowerName = fileName;
+	std::transform(lowerName.begin(), lowerName.end(), lowerName.begin(),
+		[](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+	auto probe = [&](const fs::path& dir) -> EntryPtr {
+		EntryPtr entry = load(dir / fileName);
+		if (!entry && lowerName != fileName)
+			entry = load(dir / lowerName);
+		return entry;
+	};
+
+	if (!localDir.empty())
+	{
+		if (EntryPtr entry = probe(localDir))
+			return entry;
+	}
+
+	for (const fs::path& dir : _searchPaths)
+	{
+		if (EntryPtr entry = probe(dir))
+			return entry;
+	}
+
+	if (_resourceIndex)
+		return loadFromIndex(resourceName, extension);
+
+	return nullptr;
+}
+
+IncludeCache::EntryPtr IncludeCache::loadFromIndex(const std::string& resourceName, const std::string& extension)
+{
+	uint16_t resType = ResourceIndex::resourceTypeFromExtension(extension);
+	ResourceIndex::Entry resource;
+	if (resType == 0 || !_resourceIndex->find(resourceName, resType, resource))
+		return nullptr;
+
+	// Archive resources are keyed as "<archive>/<resref>.<ext>", for reporting and invalidation.
+	std::string key = _resourceIndex->archivePath(resource.archive) + "/" +
+		std::string(resource.resRef, strnlen(resource.resRef, sizeof(resource.resRef))) + "." + extension;
+
+	EntryPtr entry;
+	if (lookup(key, entry))
+	{
+		_hits.fetch_add(1, std::memory_order_relaxed);
+		return entry;
+	}
+	_misses.fetch_add(1, std::memory_order_relaxed);
+
+	// The compiler needs null-terminated text, so the mapped view is copied once here.
+	std::string_view contents = _resourceIndex->view(resource);
+	EntryPtr loaded;
+	if (contents.size() == resource.size)
+	{
+		auto created = std::make_shared<Entry>();
+		created->path = key;
+		created->contents.assign(contents.data(), contents.size());
+		loaded = std::move(created);
+	}
+
+	std::unique_lock<std::shared_mutex> guard(_lock);
+	auto inserted = _entries.emplace(key, loaded);
+	return inserted.first->second;
+}
+
+IncludeCache::EntryPtr IncludeCache::load(const fs::path& filePath)
+{
+	std::string key = filePath.lexically_normal().string();
+
+	EntryPtr entry;
+	if (lookup(key, entry))
+	{
+		_hits.fetch_add(1, std::memory_order_relaxed);
+		return entry;
+	}
+
+	_misses.fetch_add(1, std::memory_order_relaxed);
+	return readAndStore(key);
+}
+
+bool IncludeCache::invalidate(const fs::path& filePath)
+{
+	std::unique_lock<std::shared_mutex> guard(_lock);
+	return _entries.erase(filePath.lexically_normal().string()) > 0;
+}
+
+size_t IncludeCache::size() const
+{
+	std::shared_lock<std::shared_mutex> guard(_lock);
+	return _entries.size();
+}
+
+void IncludeCache::clear()
+{
+	std::unique_lock<std::shared_mutex> guard(_lock);
+	_entries.clear();
+}
+
+bool IncludeCache::lookup(const std::string& key, EntryPtr& entry) const
+{
+	std::shared_lock<std::shared_mutex> guard(_lock);
+	auto it = _entries.find(key);
+	if (it == _entries.end())
+		return false;
+
+	entry = it->second;
+	return true;
+}
+
+IncludeCache::EntryPtr IncludeCache::readAndStore(const std::string& key)
+{
+	// Read outside the lock; if two workers race for the same file the first insert wins.
+	EntryPtr loaded;
+	std::error_code ec;
+	if (fs::is_regular_file(key, ec))
+	{
+		std::ifstream in(key, std::ios::binary);
+		if (in)
+		{
+			auto entry = std::make_shared<Entry>();
+			entry->path = key;
+			entry->contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+			loaded = std::move(entry);
+		}
+	}
+
+	std::unique_lock<std::shared_mutex> guard(_lock);
+	auto inserted = _entries.emplace(key, loaded);
+	return inserted.first->second;
+}
@@ -0,0 +1,96 @@
+/** @file IncludeCache.h
+ * Resolves script resources (includes, nwscript.nss) against a list of search paths.
+ * Loaded files are shared by all compiler workers: each file is read from disk once per run.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace NWScriptCli
+{
+	class ResourceIndex;
+
+	class IncludeCache final
+	{
+	public:
+
+		// An immutable loaded resource. Contents are always null-terminated.
+		struct Entry
+		{
+			std::string path;
+			std::string contents;
+		};
+
+		typedef std::shared_ptr<const Entry> EntryPtr;
+
+		IncludeCache() = default;
+		IncludeCache(const IncludeCache&) = delete;
+		IncludeCache& operator=(const IncludeCache&) = delete;
+
+		// Appends a directory to the end of the search list.
+		void addSearchPath(const fs::path& dir);
+
+		const std::vector<fs::path>& searchPaths() const {
+			return _searchPaths;
+		}
+
+		// Game resource archives, probed after every search path. Not owned; must outlive the cache.
+		void setResourceIndex(const ResourceIndex* index) {
+			_resourceIndex = index;
+		}
+
+		const ResourceIndex* resourceIndex() const {
+			return _resourceIndex;
+		}
+
+		// Finds "resourceName.extension". The optional localDir is probed before the
+		// search path list (the directory of the script being compiled), and the
+		// resource index (if any) after it.
+		// Returns nullptr if the resource could not be found on any path.
+		EntryPtr resolve(const std::string& resourceName, const std::string& extension,
+			const fs::path& localDir = fs::path());
+
+		// Loads one file by its full path, through the same cache.
+		EntryPtr load(const fs::path& filePath);
+
+		// Drops the cached state of one file (e.g.: after it changed on disk).
+		// Returns true if the file was known to the cache.
+		bool invalidate(const fs::path& filePath);
+
+		// Drops every cached entry (positive and negative).
+		void clear();
+
+		size_t size() const;
+
+		uint64_t hits() const { return _hits.load(std::memory_order_relaxed); }
+		uint64_t misses() const { return _misses.load(std::memory_order_relaxed); }
+
+	private:
+
+		std::vector<fs::path> _searchPaths;
+		const ResourceIndex* _resourceIndex = nullptr;
+
+		// Keyed by full path. A null entry records a file known not to exist.
+		std::unordered_map<std::string, EntryPtr> _entries;
+		mutable std::shared_mutex _lock;
+
+		std::atomic<uint64_t> _hits = 0;
+		std::atomic<uint64_t> _misses = 0;
+
+		bool lookup(const std::string& key, EntryPtr& entry) const;
+		EntryPtr readAndStore(const std::string& key);
+		EntryPtr loadFromIndex(const std::string& resourceName, const std::string& extension);
+	};
+}
@@ -0,0 +1,128 @@
+/** @file InputCollector.cpp
+ * Expands command line inputs (files, directories, glob patterns and @response files)
+ * into the list of scripts to process.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <atomic>
+#include <fstream>
+#include <glob.h>
+
+#include "DirectoryWalker.h"
+#include "InputCollector.h"
+
+using namespace NWScriptCli;
+
+#define MAX_RESPONSE_FILE_DEPTH 8
+
+bool NWScriptCli::expandResponseFile(const fs::path& responseFile, std::vector<std::string>& arguments,
+	std::string& errorMessage, int depth)
+{
+	if (depth > MAX_RESPONSE_FILE_DEPTH)
+	{
+		errorMessage = "Response files nested too deeply: " + responseFile.string();
+		return false;
+	}
+
+	std::ifstream in(responseFile);
+	if (!in)
+	{
+		errorMessage = "Unable to open response file: " + responseFile.string();
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(in, line))
+	{
+		// Trim whitespace and Windows line endings
+		size_t first = line.find_first_not_of(" \t\r");
+		if (first == std::string::npos)
+			continue;
+		size_t last = line.find_last_not_of(" \t\r");
+		line = line.substr(first, last - first + 1);
+
+		if (line[0] == '#')
+			continue;
+
+		if (line.size() > 1 && line[0] == '@')
+		{
+			if (!expandResponseFile(line.substr(1), arguments, errorMessage, depth + 1))
+				return false;
+			continue;
+		}
+
+		arguments.push_back(line);
+	}
+
+	return true;
+}
+
+bool InputCollector::add(const std::string& input)
+{
+	if (input.find_first_of("*?[") != std::string::npos)
+		return addGlob(input);
+
+	std::error_code ec;
+	fs::path path(input);
+	if (fs::is_directory(path, ec))
+		return addDirectory(path);
+
+	if (fs::is_regular_file(path, ec))
+		return addFile(path);
+
+	return false;
+}
+
+bool InputCollector::addFile(const fs::path& file)
+{
+	std::error_code ec;
+	fs::path canonical = fs::weakly_canonical(file, ec);
+	if (ec)
+		canonical = fs::absolute(file);
+
+	if (_seen.insert(canonical.string()).second)
+	{
+		_files.push_back(canonical);
+		if (_onFileAdded)
+			_onFileAdded(canonical);
+	}
+
+	return true;
+}
+
+bool InputCollector::addDirectory(const fs::path& dir)
+{
+	// Files are reported in path order, whatever the walker threads' timings: runs stay reproducible.
+	const std::atomic<bool> noCancel = false;
+	NWScriptPlugin::DirectoryWalker::Walk(dir.string(), { "*." + _extension }, _recurse, noCancel,
+		[this](const std::string& filePath) { addFile(filePath); });
+
+	return true;
+}
+
+bool InputCollector::addGlob(const std::string& pattern)
+{
+	glob_t results = {};
+	int ret = glob(pattern.c_str(), 0, nullptr, &results);
+	if (ret != 0)
+	{
+		globfree(&results);
+		return false;
+	}
+
+	bool any = false;
+	for (size_t i = 0; i < results.gl_pathc; i++)
+	{
+		std::error_code ec;
+		fs::path match(results.gl_pathv[i]);
+		if (fs::is_directory(match, ec))
+			any |= addDirectory(match);
+		else if (fs::is_regular_file(match, ec))
+			any |= addFile(match);
+	}
+
+	globfree(&results);
+	return any;
+}
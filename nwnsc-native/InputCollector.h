@@ -0,0 +1,66 @@
+/** @file InputCollector.h
+ * Expands command line inputs (files, directories, glob patterns and @response files)
+ * into the list of scripts to process.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace NWScriptCli
+{
+	// Reads a response file: one argument per line, blank lines and lines starting with '#' ignored.
+	// Nested @files are expanded recursively. Returns false if the file can't be read.
+	bool expandResponseFile(const fs::path& responseFile, std::vector<std::string>& arguments,
+		std::string& errorMessage, int depth = 0);
+
+	class InputCollector final
+	{
+	public:
+
+		// Extension (without dot) used when scanning directories.
+		explicit InputCollector(const std::string& extension = "nss", bool recurse = false)
+			: _extension(extension), _recurse(recurse) {}
+
+		void setRecurse(bool recurse) {
+			_recurse = recurse;
+		}
+
+		// Receives every new file as soon as it is found, in the order files() lists them.
+		typedef std::function<void(const fs::path& file)> FileCallback;
+
+		void setFileCallback(FileCallback onFileAdded) {
+			_onFileAdded = std::move(onFileAdded);
+		}
+
+		// Adds a file, a directory or a glob pattern. Returns false if nothing matched.
+		// Directories are walked by DirectoryWalker: sorted by path, each file reported as found.
+		bool add(const std::string& input);
+
+		// Collected files, in order of addition, without duplicates.
+		const std::vector<fs::path>& files() const {
+			return _files;
+		}
+
+	private:
+
+		std::string _extension;
+		bool _recurse;
+		std::vector<fs::path> _files;
+		std::unordered_set<std::string> _seen;
+		FileCallback _onFileAdded;
+
+		bool addFile(const fs::path& file);
+		bool addDirectory(const fs::path& dir);
+		bool addGlob(const std::string& pattern);
+	};
+}
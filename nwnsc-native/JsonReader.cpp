@@ -0,0 +1,320 @@
+/** @file JsonReader.cpp
+ * Minimal JSON parser for the compile server protocol (one request object per line).
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <cstdlib>
+#include <cstring>
+
+#include "JsonReader.h"
+
+namespace NWScriptCli
+{
+	#define JSON_MAX_DEPTH 64
+
+	class JsonParser final
+	{
+	public:
+
+		explicit JsonParser(const std::string& text) : _text(text) {}
+
+		bool parseDocument(JsonValue& value, std::string& errorMessage)
+		{
+			if (!parseValue(value, 0))
+			{
+				errorMessage = _error + " at offset " + std::to_string(_pos);
+				return false;
+			}
+
+			skipWhitespace();
+			if (_pos != _text.size())
+			{
+				errorMessage = "Unexpected trailing characters at offset " + std::to_string(_pos);
+				return false;
+			}
+
+			return true;
+		}
+
+	private:
+
+		const std::string& _text;
+		size_t _pos = 0;
+		std::string _error;
+
+		bool fail(const char* message) {
+			_error = message;
+			return false;
+		}
+
+		void skipWhitespace() {
+			while (_pos < _text.size() && (_text[_pos] == ' ' || _text[_pos] == '\t' || _text[_pos] == '\r' || _text[_pos] == '\n'))
+				_pos++;
+		}
+
+		bool consumeLiteral(const char* literal) {
+			size_t len = std::strlen(literal);
+			if (_text.compare(_pos, len, literal) != 0)
+				return fail("Invalid literal");
+			_pos += len;
+			return true;
+		}
+
+		bool parseValue(JsonValue& value, int depth)
+		{
+			if (depth > JSON_MAX_DEPTH)
+				return fail("Document nested too deeply");
+
+			skipWhitespace();
+			if (_pos >= _text.size())
+				return fail("Unexpected end of input");
+
+			char c = _text[_pos];
+			switch (c)
+			{
+			case '{': return parseObject(value, depth);
+			case '[': return parseArray(value, depth);
+			case '"':
+				value._type = JsonValue::Type::String;
+				return parseString(value._string);
+			case 't':
+				value._type = JsonValue::Type::Bool;
+				value._bool = true;
+				return consumeLiteral("true");
+			case 'f':
+				value._type = JsonValue::Type::Bool;
+				value._bool = false;
+				return consumeLiteral("false");
+			case 'n':
+				value._type = JsonValue::Type::Null;
+				return consumeLiteral("null");
+			default:
+				if (c == '-' || (c >= '0' && c <= '9'))
+					return parseNumber(value);
+				return fail("Unexpected character");
+			}
+		}
+
+		bool parseNumber(JsonValue& value)
+		{
+			const char* start = _text.c_str() + _pos;
+			char* end = nullptr;
+			value._number = std::strtod(start, &end);
+			if (end == start)
+				return fail("Invalid number");
+
+			value._type = JsonValue::Type::Number;
+			_pos += static_cast<size_t>(end - start);
+			return true;
+		}
+
+		static void appendUtf8(std::string& out, unsigned codePoint)
+		{
+			if (codePoint < 0x80)
+				out += static_cast<char>(codePoint);
+			else if (codePoint < 0x800)
+			{
+				out += static_cast<char>(0xC0 | (codePoint >> 6));
+				out += static_cast<char>(0x80 | (codePoint & 0x3F));
+			}
+			else if (codePoint < 0x10000)
+			{
+				out += static_cast<char>(0xE0 | (codePoint >> 12));
+				out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+				out += static_cast<char>(0x80 | (codePoint & 0x3F));
+			}
+			else
+			{
+				out += static_cast<char>(0xF0 | (codePoint >> 18));
+				out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+				out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+				out += static_cast<char>(0x80 | (codePoint & 0x3F));
+			}
+		}
+
+		bool parseHex4(unsigned& codePoint)
+		{
+			if (_pos + 4 > _text.size())
+				return fail("Truncated unicode escape");
+
+			codePoint = 0;
+			for (int i = 0; i < 4; i++)
+			{
+				char h = _text[_pos++];
+				codePoint <<= 4;
+				if (h >= '0' && h <= '9') codePoint |= h - '0';
+				else if (h >= 'a' && h <= 'f') codePoint |= h - 'a' + 10;
+				else if (h >= 'A' && h <= 'F') codePoint |= h - 'A' + 10;
+				else return fail("Invalid unicode escape");
+			}
+			return true;
+		}
+
+		bool parseString(std::string& out)
+		{
+			_pos++; // Opening quote
+			out.clear();
+
+			while (_pos < _text.size())
+			{
+				char c = _text[_pos++];
+				if (c == '"')
+					return true;
+
+				if (c != '\\')
+				{
+					out += c;
+					continue;
+				}
+
+				if (_pos >= _text.size())
+					break;
+
+				char e = _text[_pos++];
+				switch (e)
+				{
+				case '"': out += '"'; break;
+				case '\\': out += '\\'; break;
+				case '/': out += '/'; break;
+				case 'b': out += '\b'; break;
+				case 'f': out += '\f'; break;
+				case 'n': out += '\n'; break;
+				case 'r': out += '\r'; break;
+				case 't': out += '\t'; break;
+				case 'u': {
+					unsigned codePoint;
+					if (!parseHex4(codePoint))
+						return false;
+					// Surrogate pair
+					if (codePoint >= 0xD800 && codePoint <= 0xDBFF && _text.compare(_pos, 2, "\\u") == 0)
+					{
+						_pos += 2;
+						unsigned low;
+						if (!parseHex4(low))
+							return false;
+						codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+					}
+					appendUtf8(out, codePoint);
+					break;
+				}
+				default:
+					return fail("Invalid escape sequence");
+				}
+			}
+
+			return fail("Unterminated string");
+		}
+
+		bool parseArray(JsonValue& value, int depth)
+		{
+			_pos++;
+			value._type = JsonValue::Type::Array;
+
+			skipWhitespace();
+			if (_pos < _text.size() && _text[_pos] == ']')
+			{
+				_pos++;
+				return true;
+			}
+
+			for (;;)
+			{
+				value._array.emplace_back();
+				if (!parseValue(value._array.back(), depth + 1))
+					return false;
+
+				skipWhitespace();
+				if (_pos >= _text.size())
+					return fail("Unterminated array");
+
+				char c = _text[_pos++];
+				if (c == ']')
+					return true;
+				if (c != ',')
+					return fail("Expected ',' or ']'");
+			}
+		}
+
+		bool parseObject(JsonValue& value, int depth)
+		{
+			_pos++;
+			value._type = JsonValue::Type::Object;
+
+			skipWhitespace();
+			if (_pos < _text.size() && _text[_pos] == '}')
+			{
+				_pos++;
+				return true;
+			}
+
+			for (;;)
+			{
+				skipWhitespace();
+				if (_pos >= _text.size() || _text[_pos] != '"')
+					return fail("Expected member name");
+
+				std::string key;
+				if (!parseString(key))
+					return false;
+
+				skipWhitespace();
+				if (_pos >= _text.size() || _text[_pos] != ':')
+					return fail("Expected ':'");
+				_pos++;
+
+				if (!parseValue(value._object[key], depth + 1))
+					return false;
+
+				skipWhitespace();
+				if (_pos >= _text.size())
+					return fail("Unterminated object");
+
+				char c = _text[_pos++];
+				if (c == '}')
+					return true;
+				if (c != ',')
+					return fail("Expected ',' or '}'");
+			}
+		}
+	};
+}
+
+using namespace NWScriptCli;
+
+bool JsonValue::parse(const std::string& text, JsonValue& value, std::string& errorMessage)
+{
+	value = JsonValue();
+	JsonParser parser(text);
+	return parser.parseDocument(value, errorMessage);
+}
+
+const JsonValue& JsonValue::operator[](const std::string& key) const
+{
+	static const JsonValue nullValue;
+
+	if (_type != Type::Object)
+		return nullValue;
+
+	auto it = _object.find(key);
+	return it != _object.end() ? it->second : nullValue;
+}
+
+std::string JsonValue::getString(const std::string& key, const std::string& defaultValue) const
+{
+	const JsonValue& v = (*this)[key];
+	return v.isString() ? v.asString() : defaultValue;
+}
+
+bool JsonValue::getBool(const std::string& key, bool defaultValue) const
+{
+	const JsonValue& v = (*this)[key];
+	return v.isBool() ? v.asBool() : defaultValue;
+}
+
+double JsonValue::getNumber(const std::string& key, double defaultValue) const
+{
+	const JsonValue& v = (*this)[key];
+	return v.isNumber() ? v.asNumber() : defaultValue;
+}
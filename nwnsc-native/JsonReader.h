@@ -0,0 +1,61 @@
+/** @file JsonReader.h
+ * Minimal JSON parser for the compile server protocol (one request object per line).
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace NWScriptCli
+{
+	class JsonValue final
+	{
+	public:
+
+		enum class Type { Null, Bool, Number, String, Array, Object };
+
+		JsonValue() = default;
+
+		// Parses a complete JSON document. Returns false and fills errorMessage on malformed input.
+		static bool parse(const std::string& text, JsonValue& value, std::string& errorMessage);
+
+		Type type() const { return _type; }
+		bool isNull() const { return _type == Type::Null; }
+		bool isString() const { return _type == Type::String; }
+		bool isNumber() const { return _type == Type::Number; }
+		bool isBool() const { return _type == Type::Bool; }
+		bool isArray() const { return _type == Type::Array; }
+		bool isObject() const { return _type == Type::Object; }
+
+		const std::string& asString() const { return _string; }
+		double asNumber() const { return _number; }
+		bool asBool() const { return _bool; }
+		const std::vector<JsonValue>& asArray() const { return _array; }
+		const std::map<std::string, JsonValue>& asObject() const { return _object; }
+
+		// Object member lookup. Returns a shared Null value when missing.
+		const JsonValue& operator[](const std::string& key) const;
+
+		// Convenience accessors with defaults for missing or mistyped members
+		std::string getString(const std::string& key, const std::string& defaultValue = "") const;
+		bool getBool(const std::string& key, bool defaultValue = false) const;
+		double getNumber(const std::string& key, double defaultValue = 0) const;
+
+	private:
+
+		Type _type = Type::Null;
+		bool _bool = false;
+		double _number = 0;
+		std::string _string;
+		std::vector<JsonValue> _array;
+		std::map<std::string, JsonValue> _object;
+
+		friend class JsonParser;
+	};
+}
@@ -0,0 +1,109 @@
+/** @file JsonWriter.h
+ * Minimal streaming JSON writer for machine readable reports.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace NWScriptCli
+{
+	// Writes compact JSON. Commas are handled automatically:
+	//   json.beginObject().key("a").value(1).key("b").beginArray().value("x").endArray().endObject();
+	class JsonWriter final
+	{
+	public:
+
+		explicit JsonWriter(std::ostream& out) : _out(out) {}
+
+		JsonWriter& beginObject() { separate(); _out << '{'; _first.push_back(true); return *this; }
+		JsonWriter& endObject() { _first.pop_back(); _out << '}'; return *this; }
+		JsonWriter& beginArray() { separate(); _out << '['; _first.push_back(true); return *this; }
+		JsonWriter& endArray() { _first.pop_back(); _out << ']'; return *this; }
+
+		JsonWriter& key(const std::string& name) {
+			separate();
+			writeString(name);
+			_out << ':';
+			_afterKey = true;
+			return *this;
+		}
+
+		JsonWriter& value(const std::string& s) { separate(); writeString(s); return *this; }
+		JsonWriter& value(const char* s) { separate(); writeString(s ? s : ""); return *this; }
+		JsonWriter& value(bool b) { separate(); _out << (b ? "true" : "false"); return *this; }
+		JsonWriter& value(int v) { separate(); _out << v; return *this; }
+		JsonWriter& value(long v) { separate(); _out << v; return *this; }
+		JsonWriter& value(long long v) { separate(); _out << v; return *this; }
+		JsonWriter& value(unsigned v) { separate(); _out << v; return *this; }
+		JsonWriter& value(unsigned long v) { separate(); _out << v; return *this; }
+		JsonWriter& value(unsigned long long v) { separate(); _out << v; return *this; }
+
+		// Doubles are written with 3 decimal places (timings are in milliseconds)
+		JsonWriter& value(double d) {
+			separate();
+			char buffer[64];
+			std::snprintf(buffer, sizeof(buffer), "%.3f", d);
+			_out << buffer;
+			return *this;
+		}
+
+		JsonWriter& null() { separate(); _out << "null"; return *this; }
+
+		template <typename T>
+		JsonWriter& member(const std::string& name, const T& v) {
+			return key(name).value(v);
+		}
+
+	private:
+
+		std::ostream& _out;
+		std::vector<bool> _first;
+		bool _afterKey = false;
+
+		void separate() {
+			if (_afterKey)
+			{
+				_afterKey = false;
+				return;
+			}
+			if (!_first.empty())
+			{
+				if (!_first.back())
+					_out << ',';
+				_first.back() = false;
+			}
+		}
+
+		void writeString(const std::string& s) {
+			_out << '"';
+			for (unsigned char c : s)
+			{
+				switch (c)
+				{
+				case '"': _out << "\\\""; break;
+				case '\\': _out << "\\\\"; break;
+				case '\n': _out << "\\n"; break;
+				case '\r': _out << "\\r"; break;
+				case '\t': _out << "\\t"; break;
+				default:
+					if (c < 0x20)
+					{
+						char buffer[8];
+						std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+						_out << buffer;
+					}
+					else
+						_out << static_cast<char>(c);
+				}
+			}
+			_out << '"';
+		}
+	};
+}
@@ -0,0 +1,159 @@
+/** @file MappedFile.cpp
+ * Read-only memory mapped file.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <utility>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "MappedFile.h"
+
+using namespace NWScriptCli;
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		close();
+		std::swap(_data, other._data);
+		std::swap(_size, other._size);
+		std::swap(_open, other._open);
+#ifdef _WIN32
+		std::swap(_fileHandle, other._fileHandle);
+		std::swap(_mappingHandle, other._mappingHandle);
+#endif
+	}
+	return *this;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const fs::path& path)
+{
+	close();
+
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize))
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	_fileHandle = file;
+	_size = static_cast<size_t>(fileSize.QuadPart);
+	_open = true;
+
+	if (_size == 0)
+		return true;
+
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping)
+	{
+		close();
+		return false;
+	}
+
+	_mappingHandle = mapping;
+	_data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!_data)
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (_data)
+		UnmapViewOfFile(_data);
+	if (_mappingHandle)
+		CloseHandle(_mappingHandle);
+	if (_fileHandle)
+		CloseHandle(_fileHandle);
+
+	_data = nullptr;
+	_mappingHandle = nullptr;
+	_fileHandle = nullptr;
+	_size = 0;
+	_open = false;
+}
+
+#else
+
+bool MappedFile::open(const fs::path& path)
+{
+	close();
+
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+	{
+		::close(fd);
+		return false;
+	}
+
+	_size = static_cast<size_t>(st.st_size);
+	_open = true;
+
+	if (_size > 0)
+	{
+		void* mapping = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping == MAP_FAILED)
+		{
+			::close(fd);
+			_size = 0;
+			_open = false;
+			return false;
+		}
+
+		// Resources are read at scattered offsets, never sequentially.
+		madvise(mapping, _size, MADV_RANDOM);
+		_data = static_cast<const uint8_t*>(mapping);
+	}
+
+	// The mapping keeps its own reference to the file.
+	::close(fd);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (_data)
+		munmap(const_cast<uint8_t*>(_data), _size);
+
+	_data = nullptr;
+	_size = 0;
+	_open = false;
+}
+
+#endif
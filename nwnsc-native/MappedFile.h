@@ -0,0 +1,64 @@
+/** @file MappedFile.h
+ * Read-only memory mapped file.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+
+namespace fs = std::filesystem;
+
+namespace NWScriptCli
+{
+	class MappedFile final
+	{
+	public:
+
+		MappedFile() = default;
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		MappedFile(MappedFile&& other) noexcept;
+		MappedFile& operator=(MappedFile&& other) noexcept;
+
+		// Maps the whole file. Empty files are opened successfully with a null data pointer.
+		bool open(const fs::path& path);
+		void close();
+
+		bool isOpen() const {
+			return _open;
+		}
+
+		const uint8_t* data() const {
+			return _data;
+		}
+
+		size_t size() const {
+			return _size;
+		}
+
+		// Bounds checked view into the mapping. Returns an empty view when out of range.
+		std::string_view view(size_t offset, size_t length) const {
+			if (offset > _size || length > _size - offset)
+				return std::string_view();
+			return std::string_view(reinterpret_cast<const char*>(_data) + offset, length);
+		}
+
+	private:
+
+		const uint8_t* _data = nullptr;
+		size_t _size = 0;
+		bool _open = false;
+#ifdef _WIN32
+		void* _fileHandle = nullptr;
+		void* _mappingHandle = nullptr;
+#endif
+	};
+}
@@ -0,0 +1,559 @@
+/** @file NcsActionTable.cpp
+ * Engine functions (ACTIONs) available to the NCS virtual machine.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "NcsActionTable.h"
+#include "NcsVirtualMachine.h"
+
+using namespace NWScriptCli;
+
+typedef NcsActionTable::ValueType ValueType;
+typedef ValueType::Kind Kind;
+
+bool NcsActionTable::load(const fs::path& nwscriptFile, std::string& errorMessage)
+{
+	std::ifstream in(nwscriptFile, std::ios::binary);
+	if (!in)
+	{
+		errorMessage = "Unable to read engine definitions: " + nwscriptFile.string();
+		return false;
+	}
+
+	std::stringstream contents;
+	contents << in.rdbuf();
+	if (!parse(contents.str(), errorMessage))
+	{
+		errorMessage = nwscriptFile.string() + ": " + errorMessage;
+		return false;
+	}
+	return true;
+}
+
+// Removes comments, keeping string literals (and line breaks, for error messages) intact.
+static std::string stripComments(std::string_view source)
+{
+	std::string result;
+	result.reserve(source.size());
+
+	size_t i = 0;
+	while (i < source.size())
+	{
+		char c = source[i];
+		if (c == '"')
+		{
+			size_t end = i + 1;
+			while (end < source.size() && source[end] != '"' && source[end] != '\n')
+				end += (source[end] == '\\' && end + 1 < source.size()) ? 2 : 1;
+			end = std::min(end + 1, source.size());
+			result.append(source.substr(i, end - i));
+			i = end;
+		}
+		else if (c == '/' && i + 1 < source.size() && source[i + 1] == '/')
+		{
+			while (i < source.size() && source[i] != '\n')
+				i++;
+		}
+		else if (c == '/' && i + 1 < source.size() && source[i + 1] == '*')
+		{
+			size_t end = source.find("*/", i + 2);
+			end = (end == std::string_view::npos) ? source.size() : end + 2;
+			result.append(static_cast<size_t>(std::count(source.begin() + i, source.begin() + end, '\n')), '\n');
+			i = end;
+		}
+		else
+		{
+			result.push_back(c);
+			i++;
+		}
+	}
+
+	return result;
+}
+
+static std::string_view trim(std::string_view text)
+{
+	while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front())))
+		text.remove_prefix(1);
+	while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back())))
+		text.remove_suffix(1);
+	return text;
+}
+
+static std::string_view firstToken(std::string_view text)
+{
+	text = trim(text);
+	size_t end = 0;
+	while (end < text.size() && (std::isalnum(static_cast<unsigned char>(text[end])) || text[end] == '_'))
+		end++;
+	return text.substr(0, end);
+}
+
+static bool parseType(std::string_view name, const std::vector<std::string>& engineStructures, ValueType& type)
+{
+	static const std::pair<const char*, Kind> builtIn[] = {
+		{ "void", Kind::Void }, { "int", Kind::Integer }, { "float", Kind::Float }, { "string", Kind::String },
+		{ "object", Kind::Object }, { "vector", Kind::Vector }, { "action", Kind::Action }
+	};
+
+	type = ValueType();
+	for (const auto& entry : builtIn)
+	{
+		if (name == entry.first)
+		{
+			type.kind = entry.second;
+			return true;
+		}
+	}
+
+	for (size_t i = 0; i < engineStructures.size(); i++)
+	{
+		if (!engineStructures[i].empty() && name == engineStructures[i])
+		{
+			type.kind = Kind::EngineStructure;
+			type.engineStructure = static_cast<uint8_t>(i);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool NcsActionTable::parse(std::string_view source, std::string& errorMessage)
+{
+	_definitions.clear();
+	_handlers.clear();
+	_byName.clear();
+
+	std::string text = stripComments(source);
+	std::vector<std::string> engineStructures(10);
+
+	// Preprocessor lines: only the engine structure names matter
+	std::string statements;
+	statements.reserve(text.size());
+	size_t pos = 0;
+	while (pos < text.size())
+	{
+		size_t end = text.find('\n', pos);
+		if (end == std::string::npos)
+			end = text.size();
+		std::string_view line = std::string_view(text).substr(pos, end - pos);
+		pos = end + 1;
+
+		std::string_view trimmed = trim(line);
+		if (!trimmed.empty() && trimmed[0] == '#')
+		{
+			static const std::string_view prefix = "#define ENGINE_STRUCTURE_";
+			if (trimmed.substr(0, prefix.size()) == prefix && trimmed.size() > prefix.size() &&
+				std::isdigit(static_cast<unsigned char>(trimmed[prefix.size()])))
+			{
+				size_t index = static_cast<size_t>(trimmed[prefix.size()] - '0');
+				engineStructures[index] = std::string(firstToken(trimmed.substr(prefix.size() + 1)));
+			}
+			statements.push_back('\n');
+			continue;
+		}
+
+		statements.append(line);
+		statements.push_back('\n');
+	}
+
+	// Statements end at a top level ';'. Prototypes are the ones with a '(' before any '='.
+	size_t start = 0;
+	int depth = 0;
+	bool inString = false;
+	for (size_t i = 0; i < statements.size(); i++)
+	{
+		char c = statements[i];
+		if (inString)
+		{
+			if (c == '\\')
+				i++;
+			else if (c == '"')
+				inString = false;
+			continue;
+		}
+
+		if (c == '"')
+			inString = true;
+		else if (c == '(' || c == '[')
+			depth++;
+		else if (c == ')' || c == ']')
+			depth--;
+		else if (c == ';' && depth == 0)
+		{
+			std::string_view statement = trim(std::string_view(statements).substr(start, i - start));
+			start = i + 1;
+
+			size_t paren = statement.find('(');
+			size_t equals = statement.find('=');
+			if (paren == std::string_view::npos || (equals != std::string_view::npos && equals < paren))
+				continue;
+
+			Definition definition;
+			std::string_view returnType = firstToken(statement);
+			if (!parseType(returnType, engineStructures, definition.returnType))
+			{
+				errorMessage = "Unknown return type '" + std::string(returnType) + "' in: " + std::string(statement.substr(0, paren));
+				return false;
+			}
+
+			std::string_view head = trim(statement.substr(0, paren));
+			size_t nameStart = head.find_last_of(" \t\r\n");
+			definition.name = std::string(nameStart == std::string_view::npos ? head : head.substr(nameStart + 1));
+
+			size_t close = statement.rfind(')');
+			std::string_view parameters = (close != std::string_view::npos && close > paren) ?
+				statement.substr(paren + 1, close - paren - 1) : std::string_view();
+
+			// Parameters split at top level commas; defaults may hold vectors [x, y, z] or calls
+			size_t parameterStart = 0;
+			int parameterDepth = 0;
+			bool parameterString = false;
+			for (size_t j = 0; j <= parameters.size(); j++)
+			{
+				char p = j < parameters.size() ? parameters[j] : ',';
+				if (parameterString)
+				{
+					if (p == '\\')
+						j++;
+					else if (p == '"')
+						parameterString = false;
+					continue;
+				}
+				if (p == '"')
+					parameterString = true;
+				else if (p == '(' || p == '[')
+					parameterDepth++;
+				else if (p == ')' || p == ']')
+					parameterDepth--;
+				else if (p == ',' && parameterDepth == 0)
+				{
+					std::string_view parameter = trim(parameters.substr(parameterStart, j - parameterStart));
+					parameterStart = j + 1;
+					if (parameter.empty() || parameter == "void")
+						continue;
+
+					ValueType type;
+					std::string_view typeName = firstToken(parameter);
+					if (!parseType(typeName, engineStructures, type) || type.kind == Kind::Void)
+					{
+						errorMessage = "Unknown parameter type '" + std::string(typeName) + "' in " + definition.name + "()";
+						return false;
+					}
+					definition.parameters.push_back(type);
+				}
+			}
+
+			_byName.emplace(definition.name, static_cast<uint32_t>(_definitions.size()));
+			_definitions.push_back(std::move(definition));
+		}
+	}
+
+	_handlers.resize(_definitions.size());
+	return true;
+}
+
+const NcsActionTable::Definition* NcsActionTable::definition(uint32_t action) const
+{
+	return action < _definitions.size() ? &_definitions[action] : nullptr;
+}
+
+int32_t NcsActionTable::find(std::string_view name) const
+{
+	auto it = _byName.find(std::string(name));
+	return it == _byName.end() ? -1 : static_cast<int32_t>(it->second);
+}
+
+bool NcsActionTable::setHandler(std::string_view name, Handler handler)
+{
+	int32_t action = find(name);
+	if (action < 0)
+		return false;
+	_handlers[action] = std::move(handler);
+	return true;
+}
+
+void NcsActionTable::call(NcsVirtualMachine& vm, uint32_t action, uint32_t argumentCount) const
+{
+	const Definition* definition = this->definition(action);
+	if (!definition)
+	{
+		vm.fail("Action " + std::to_string(action) + " is not declared in nwscript.nss.");
+		return;
+	}
+
+	if (argumentCount != definition->parameters.size())
+	{
+		vm.fail(definition->name + "() called with " + std::to_string(argumentCount) + " arguments, nwscript.nss declares " +
+			std::to_string(definition->parameters.size()) + ". Is it the nwscript.nss the script was compiled with?");
+		return;
+	}
+
+	if (_handlers[action])
+		_handlers[action](vm, *definition, argumentCount);
+	else
+		stub(vm, *definition, argumentCount);
+}
+
+// Pops parameters [first, count) of an action, whatever their values.
+static void discardArguments(NcsVirtualMachine& vm, const NcsActionTable::Definition& definition, uint32_t first, uint32_t count)
+{
+	for (uint32_t i = first; i < count && !vm.failed(); i++)
+	{
+		switch (definition.parameters[i].kind)
+		{
+		case Kind::Integer: vm.popInteger(); break;
+		case Kind::Float: vm.popFloat(); break;
+		case Kind::String: vm.popString(); break;
+		case Kind::Object: vm.popObject(); break;
+		case Kind::Vector: vm.popVector(); break;
+		case Kind::EngineStructure: vm.popEngineStructure(); break;
+		case Kind::Action:
+		{
+			NcsVirtualMachine::StoredState state;
+			vm.takeStoredState(state);
+			break;
+		}
+		case Kind::Void: break;
+		}
+	}
+}
+
+static void pushDefault(NcsVirtualMachine& vm, const ValueType& type)
+{
+	switch (type.kind)
+	{
+	case Kind::Integer: vm.pushInteger(0); break;
+	case Kind::Float: vm.pushFloat(0.0f); break;
+	case Kind::String: vm.pushString(std::string()); break;
+	case Kind::Object: vm.pushObject(NCS_OBJECT_INVALID); break;
+	case Kind::Vector: vm.pushVector(NcsVector()); break;
+	case Kind::EngineStructure: vm.pushEngineStructure(type.engineStructure); break;
+	case Kind::Void:
+	case Kind::Action: break;
+	}
+}
+
+void NcsActionTable::stub(NcsVirtualMachine& vm, const Definition& definition, uint32_t argumentCount)
+{
+	discardArguments(vm, definition, 0, argumentCount);
+	if (!vm.failed())
+		pushDefault(vm, definition.returnType);
+}
+
+//-------------------------------------------------------------------------------------
+// Standard handlers
+
+namespace
+{
+	// An action argument, popped according to its declared type.
+	struct Argument
+	{
+		NcsValue value;
+		NcsVector vector;
+		NcsVirtualMachine::StoredState state;
+
+		int32_t integer() const { return value.intValue; }
+		float real() const { return value.floatValue; }
+		uint32_t object() const { return value.objectValue; }
+		const std::string& text() const { return value.text; }
+	};
+
+	typedef std::function<void(NcsVirtualMachine& vm, std::vector<Argument>& arguments)> Body;
+}
+
+static void popArguments(NcsVirtualMachine& vm, const NcsActionTable::Definition& definition, uint32_t count,
+	std::vector<Argument>& arguments)
+{
+	arguments.resize(count);
+	for (uint32_t i = 0; i < count && !vm.failed(); i++)
+	{
+		Argument& argument = arguments[i];
+		switch (definition.parameters[i].kind)
+		{
+		case Kind::Integer: argument.value.intValue = vm.popInteger(); break;
+		case Kind::Float: argument.value.floatValue = vm.popFloat(); break;
+		case Kind::String: argument.value.text = vm.popString(); break;
+		case Kind::Object: argument.value.objectValue = vm.popObject(); break;
+		case Kind::Vector: argument.vector = vm.popVector(); break;
+		case Kind::EngineStructure: argument.value = vm.popEngineStructure(); break;
+		case Kind::Action: vm.takeStoredState(argument.state); break;
+		case Kind::Void: break;
+		}
+	}
+}
+
+static std::string formatFloat(float value, int width, int decimals)
+{
+	char buffer[512];
+	std::snprintf(buffer, sizeof(buffer), "%*.*f", std::clamp(width, 0, 128), std::clamp(decimals, 0, 128), static_cast<double>(value));
+	return buffer;
+}
+
+static std::string formatObject(uint32_t object)
+{
+	char buffer[16];
+	std::snprintf(buffer, sizeof(buffer), "%x", object);
+	return buffer;
+}
+
+static std::string toCase(std::string text, bool upper)
+{
+	for (char& c : text)
+		c = static_cast<char>(upper ? std::toupper(static_cast<unsigned char>(c)) : std::tolower(static_cast<unsigned char>(c)));
+	return text;
+}
+
+static int32_t rollDice(NcsVirtualMachine& vm, int32_t sides, int32_t dice)
+{
+	int32_t total = 0;
+	for (int32_t i = 0; i < std::max(dice, 1); i++)
+		total += vm.random(sides) + 1;
+	return total;
+}
+
+void NcsActionTable::addStandardHandlers()
+{
+	// Installs a handler if nwscript.nss declares the function with the expected return type
+	// and at least the expected leading parameters; otherwise the stub stays. The body gets
+	// every argument already popped and pushes the result.
+	auto add = [this](const char* name, Kind returnKind, std::initializer_list<Kind> parameters, Body body)
+	{
+		int32_t action = find(name);
+		if (action < 0)
+			return;
+
+		const Definition& definition = _definitions[action];
+		if (definition.returnType.kind != returnKind || definition.parameters.size() < parameters.size() ||
+			!std::equal(parameters.begin(), parameters.end(), definition.parameters.begin(),
+				[](Kind kind, const ValueType& type) { return kind == type.kind; }))
+			return;
+
+		_handlers[action] = [body](NcsVirtualMachine& vm, const Definition& definition, uint32_t argumentCount)
+		{
+			std::vector<Argument> arguments;
+			popArguments(vm, definition, argumentCount, arguments);
+			if (!vm.failed())
+				body(vm, arguments);
+		};
+	};
+
+	typedef std::vector<Argument> Args;
+
+	// Output
+	add("PrintString", Kind::Void, { Kind::String }, [](NcsVirtualMachine& vm, Args& a) { vm.print(a[0].text()); });
+	add("PrintInteger", Kind::Void, { Kind::Integer }, [](NcsVirtualMachine& vm, Args& a) { vm.print(std::to_string(a[0].integer())); });
+	add("PrintFloat", Kind::Void, { Kind::Float, Kind::Integer, Kind::Integer },
+		[](NcsVirtualMachine& vm, Args& a) { vm.print(formatFloat(a[0].real(), a[1].integer(), a[2].integer())); });
+	add("PrintObject", Kind::Void, { Kind::Object }, [](NcsVirtualMachine& vm, Args& a) { vm.print(formatObject(a[0].object())); });
+	add("PrintVector", Kind::Void, { Kind::Vector, Kind::Integer }, [](NcsVirtualMachine& vm, Args& a)
+		{
+			const NcsVector& v = a[0].vector;
+			vm.print((a[1].integer() ? "PRINTVECTOR:" : "") + formatFloat(v.x, 0, 3) + " " + formatFloat(v.y, 0, 3) + " " + formatFloat(v.z, 0, 3));
+		});
+	add("WriteTimestampedLogEntry", Kind::Void, { Kind::String }, [](NcsVirtualMachine& vm, Args& a) { vm.print(a[0].text()); });
+
+	// Conversions
+	add("IntToString", Kind::String, { Kind::Integer }, [](NcsVirtualMachine& vm, Args& a) { vm.pushString(std::to_string(a[0].integer())); });
+	add("IntToFloat", Kind::Float, { Kind::Integer }, [](NcsVirtualMachine& vm, Args& a) { vm.pushFloat(static_cast<float>(a[0].integer())); });
+	add("FloatToInt", Kind::Integer, { Kind::Float }, [](NcsVirtualMachine& vm, Args& a) { vm.pushInteger(static_cast<int32_t>(a[0].real())); });
+	add("FloatToString", Kind::String, { Kind::Float, Kind::Integer, Kind::Integer },
+		[](NcsVirtualMachine& vm, Args& a) { vm.pushString(formatFloat(a[0].real(), a[1].integer(), a[2].integer())); });
+	add("StringToInt", Kind::Integer, { Kind::String },
+		[](NcsVirtualMachine& vm, Args& a) { vm.pushInteger(static_cast<int32_t>(std::strtol(a[0].text().c_str(), nullptr, 10))); });
+	add("StringToFloat", Kind::Float, { Kind::String },
+		[](NcsVirtualMachine& vm, Args& a) { vm.pushFloat(std::strtof(a[0].text().c_str(), nullptr)); });
+	add("IntToHexString", Kind::String, { Kind::Integer }, [](NcsVirtualMachine& vm, Args& a)
+		{
+			char buffer[16];
+			std::snprintf(buffer, sizeof(buffer), "0x%08x", static_cast<uint32_t>(a[0].integer()));
+			vm.pushString(buffer);
+		});
+	add("ObjectToString", Kind::String, { Kind::Object }, [](NcsVirtualMachine& vm, Args& a) { vm.pushString(formatObject(a[0].object())); });
+	add("GetIsObjectValid", Kind::Integer, { Kind::Object },
+		[](NcsVirtualMachine& vm, Args& a) { vm.pushInteger(a[0].object() != NCS_OBJECT_INVALID); });
+
+	// Strings
+	add("GetStringLength", Kind::Integer, { Kind::String },
+		[](NcsVirtualMachine& vm, Args& a) { vm.pushInteger(static_cast<int32_t>(a[0].text().size())); });
+	add("GetStringUpperCase", Kind::String, { Kind::String }, [](NcsVirtualMachine& vm, Args& a) { vm.pushString(toCase(a[0].text(), true)); });
+	add("GetStringLowerCase", Kind::String, { Kind::String }, [](NcsVirtualMachine& vm, Args& a) { vm.pushString(toCase(a[0].text(), false)); });
+	add("GetStringLeft", Kind::String, { Kind::String, Kind::Integer }, [](NcsVirtualMachine& vm, Args& a)
+		{
+			int32_t count = std::max(a[1].integer(), 0);
+			vm.pushString(a[0].text().substr(0, static_cast<size_t>(count)));
+		});
+	add("GetStringRight", Kind::String, { Kind::String, Kind::Integer }, [](NcsVirtualMachine& vm, Args& a)
+		{
+			const std::string& text = a[0].text();
+			size_t count = std::min(static_cast<size_t>(std::max(a[1].integer(), 0)), text.size());
+			vm.pushString(text.substr(text.size() - count));
+		});
+	add("GetSubString", Kind::String, { Kind::String, Kind::Integer, Kind::Integer }, [](NcsVirtualMachine& vm, Args& a)
+		{
+			const std::string& text = a[0].text();
+			int32_t start = a[1].integer(), count = a[2].integer();
+			if (start < 0 || count < 0 || static_cast<size_t>(start) >= text.size())
+				vm.pushString(std::string());
+			else
+				vm.pushString(text.substr(static_cast<size_t>(start), static_cast<size_t>(count)));
+		});
+	add("FindSubString", Kind::Integer, { Kind::String, Kind::String }, [](NcsVirtualMachine& vm, Args& a)
+		{
+			int32_t start = a.size() > 2 ? std::max(a[2].integer(), 0) : 0;
+			size_t found = a[0].text().find(a[1].text(), static_cast<size_t>(start));
+			vm.pushInteger(found == std::string::npos ? -1 : static_cast<int32_t>(found));
+		});
+
+	// Math
+	add("abs", Kind::Integer, { Kind::Integer }, [](NcsVirtualMachine& vm, Args& a)
+		{
+			int32_t value = a[0].integer();
+			vm.pushInteger(value < 0 ? static_cast<int32_t>(0u - static_cast<uint32_t>(value)) : value);
+		});
+	add("fabs", Kind::Float, { Kind::Float }, [](NcsVirtualMachine& vm, Args& a) { vm.pushFloat(std::fabs(a[0].real())); });
+	add("sqrt", Kind::Float, { Kind::Float }, [](NcsVirtualMachine& vm, Args& a) { vm.pushFloat(a[0].real() < 0.0f ? 0.0f : std::sqrt(a[0].real())); });
+	add("pow", Kind::Float, { Kind::Float, Kind::Float }, [](NcsVirtualMachine& vm, Args& a) { vm.pushFloat(std::pow(a[0].real(), a[1].real())); });
+	add("log", Kind::Float, { Kind::Float }, [](NcsVirtualMachine& vm, Args& a) { vm.pushFloat(a[0].real() <= 0.0f ? 0.0f : std::log(a[0].real())); });
+	add("cos", Kind::Float, { Kind::Float }, [](NcsVirtualMachine& vm, Args& a) { vm.pushFloat(std::cos(a[0].real() * 3.14159265f / 180.0f)); });
+	add("sin", Kind::Float, { Kind::Float }, [](NcsVirtualMachine& vm, Args& a) { vm.pushFloat(std::sin(a[0].real() * 3.14159265f / 180.0f)); });
+	add("tan", Kind::Float, { Kind::Float }, [](NcsVirtualMachine& vm, Args& a) { vm.pushFloat(std::tan(a[0].real() * 3.14159265f / 180.0f)); });
+	add("Random", Kind::Integer, { Kind::Integer }, [](NcsVirtualMachine& vm, Args& a) { vm.pushInteger(vm.random(a[0].integer())); });
+
+	static const std::pair<const char*, int32_t> dice[] = {
+		{ "d2", 2 }, { "d3", 3 }, { "d4", 4 }, { "d6", 6 }, { "d8", 8 }, { "d10", 10 }, { "d12", 12 }, { "d20", 20 }, { "d100", 100 }
+	};
+	for (const auto& die : dice)
+	{
+		int32_t sides = die.second;
+		add(die.first, Kind::Integer, { Kind::Integer },
+			[sides](NcsVirtualMachine& vm, Args& a) { vm.pushInteger(rollDice(vm, sides, a[0].integer())); });
+	}
+
+	// Vectors
+	add("Vector", Kind::Vector, { Kind::Float, Kind::Float, Kind::Float },
+		[](NcsVirtualMachine& vm, Args& a) { vm.pushVector(NcsVector{ a[0].real(), a[1].real(), a[2].real() }); });
+	add("VectorMagnitude", Kind::Float, { Kind::Vector }, [](NcsVirtualMachine& vm, Args& a)
+		{
+			const NcsVector& v = a[0].vector;
+			vm.pushFloat(std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z));
+		});
+
+	// Deferred actions: run once the script returns, in game time order
+	add("DelayCommand", Kind::Void, { Kind::Float, Kind::Action },
+		[](NcsVirtualMachine& vm, Args& a) { vm.defer(std::move(a[1].state), a[0].real()); });
+	add("AssignCommand", Kind::Void, { Kind::Object, Kind::Action },
+		[](NcsVirtualMachine& vm, Args& a) { vm.defer(std::move(a[1].state), 0.0f); });
+	add("ActionDoCommand", Kind::Void, { Kind::Action },
+		[](NcsVirtualMachine& vm, Args& a) { vm.defer(std::move(a[0].state), 0.0f); });
+}
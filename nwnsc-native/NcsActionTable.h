@@ -0,0 +1,83 @@
+/** @file NcsActionTable.h
+ * Engine functions (ACTIONs) available to the NCS virtual machine.
+ *
+ * The table is generated from nwscript.nss: the n-th function prototype declared there is
+ * action n, exactly as the compiler numbers them. Every action starts as a stub that pops
+ * its arguments and pushes a default return value (0, 0.0, "", OBJECT_INVALID...), so any
+ * script runs offline; handlers can be replaced one by one where a real implementation
+ * matters (printing, string functions, DelayCommand...).
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace NWScriptCli
+{
+	class NcsVirtualMachine;
+
+	class NcsActionTable final
+	{
+	public:
+
+		struct ValueType
+		{
+			enum class Kind : uint8_t { Void, Integer, Float, String, Object, Vector, Action, EngineStructure };
+
+			Kind kind = Kind::Void;
+			uint8_t engineStructure = 0;   // ENGINE_STRUCTURE_n index, for Kind::EngineStructure
+		};
+
+		struct Definition
+		{
+			std::string name;
+			ValueType returnType;
+			std::vector<ValueType> parameters;
+		};
+
+		// Called with the action's arguments on the VM stack, first argument on top.
+		// Must pop argumentCount arguments and push the return value, if any.
+		typedef std::function<void(NcsVirtualMachine& vm, const Definition& definition, uint32_t argumentCount)> Handler;
+
+		// Reads the action prototypes from nwscript.nss. Every handler is reset to the stub.
+		bool load(const fs::path& nwscriptFile, std::string& errorMessage);
+		bool parse(std::string_view source, std::string& errorMessage);
+
+		size_t size() const { return _definitions.size(); }
+		const Definition* definition(uint32_t action) const;
+
+		// Action id of a function, or -1 if nwscript.nss doesn't declare it.
+		int32_t find(std::string_view name) const;
+
+		// Replaces the stub of an action. Returns false if nwscript.nss doesn't declare it.
+		bool setHandler(std::string_view name, Handler handler);
+
+		// Implements the engine functions that don't need a game world: printing, string and
+		// math functions, Random (deterministic), and DelayCommand/AssignCommand/ActionDoCommand,
+		// which queue their action to run once the script returns.
+		void addStandardHandlers();
+
+		// Runs an action: its handler, or the stub.
+		void call(NcsVirtualMachine& vm, uint32_t action, uint32_t argumentCount) const;
+
+		// The stub: pops the arguments and pushes a default return value.
+		static void stub(NcsVirtualMachine& vm, const Definition& definition, uint32_t argumentCount);
+
+	private:
+
+		std::vector<Definition> _definitions;
+		std::vector<Handler> _handlers;
+		std::unordered_map<std::string, uint32_t> _byName;
+	};
+}
@@ -0,0 +1,509 @@
+/** @file NcsRunner.cpp
+ * ncs-run: runs compiled NWScript (NCS) files offline on the reference virtual machine and
+ * reports where the instructions went, per opcode, function and source line.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "JsonWriter.h"
+#include "NcsActionTable.h"
+#include "NcsInstruction.h"
+#include "NcsVirtualMachine.h"
+#include "NdbFile.h"
+
+using namespace NWScriptCli;
+using namespace NWScriptPlugin;
+
+#define NCS_RUN_VERSION "1.0"
+
+#define EXIT_CODE_SUCCESS       0
+#define EXIT_CODE_SCRIPT_ERROR  1
+#define EXIT_CODE_USAGE_ERROR   2
+
+struct CommandLine
+{
+	std::string input;
+	std::string nwscriptFile;
+	std::vector<std::string> includePaths;
+	std::string ndbFile;
+	std::string summaryFile;
+	bool noNdb = false;
+	uint32_t repeat = 1;
+	uint32_t top = 20;
+	NcsVirtualMachine::Options options;
+	bool showProfile = false;
+	bool quiet = false;
+	bool help = false;
+};
+
+static void printUsage()
+{
+	std::printf(
+		"ncs-run " NCS_RUN_VERSION " - NWScript bytecode (NCS) interpreter and profiler\n"
+		"\n"
+		"Usage: ncs-run [options] <script.ncs>\n"
+		"\n"
+		"Engine functions are stubs generated from nwscript.nss: they consume their arguments and\n"
+		"return a default value. Printing, string, math and Random (deterministic) functions are\n"
+		"implemented; DelayCommand, AssignCommand and ActionDoCommand run their action after the script.\n"
+		"\n"
+		"Options:\n"
+		"  -w, --nwscript <file>       nwscript.nss the script was compiled with.\n"
+		"  -i, --include <paths>       Where to look for nwscript.nss, separated by ';' or ':'\n"
+		"                              (default: the script's directory).\n"
+		"  -d, --ndb <file>            Debug symbols (default: the script's .ndb, if there is one).\n"
+		"      --no-ndb                Don't load debug symbols.\n"
+		"  -r, --repeat <n>            Run the script n times (counts accumulate).\n"
+		"  -m, --max-instructions <n>  Abort a run after n instructions (default: 500000000, 0 = no limit).\n"
+		"      --no-deferred           Don't run the actions queued by DelayCommand and friends.\n"
+		"  -p, --profile               Print instruction counts per opcode, function and line.\n"
+		"      --top <n>               Rows per profile table (default: 20, 0 = all).\n"
+		"  -s, --summary <file>        Write the profile as JSON ('-' = stdout).\n"
+		"  -q, --quiet                 Don't print the script's output.\n"
+		"  -h, --help                  Show this help.\n"
+		"\n"
+		"Exit codes: 0 = success, 1 = the script aborted, 2 = usage or setup error.\n");
+}
+
+static void splitPaths(const std::string& value, std::vector<std::string>& out)
+{
+	size_t start = 0;
+	while (start <= value.size())
+	{
+		size_t end = value.find_first_of(";:", start);
+		if (end == std::string::npos)
+			end = value.size();
+		if (end > start)
+			out.push_back(value.substr(start, end - start));
+		start = end + 1;
+	}
+}
+
+static bool parseNumber(const std::string& arg, const std::string& value, uint64_t& number)
+{
+	char* end = nullptr;
+	unsigned long long parsed = std::strtoull(value.c_str(), &end, 10);
+	if (value.empty() || *end != 0)
+	{
+		std::fprintf(stderr, "Error: Invalid number \"%s\" for option \"%s\".\n", value.c_str(), arg.c_str());
+		return false;
+	}
+	number = parsed;
+	return true;
+}
+
+static bool parseArguments(int argc, char** argv, CommandLine& cmd)
+{
+	cmd.options.maxInstructions = 500000000;
+
+	std::vector<std::string> args(argv + 1, argv + argc);
+	for (size_t i = 0; i < args.size(); i++)
+	{
+		const std::string& arg = args[i];
+
+		auto nextValue = [&](std::string& value) -> bool {
+			if (i + 1 >= args.size())
+			{
+				std::fprintf(stderr, "Error: Missing value for option \"%s\".\n", arg.c_str());
+				return false;
+			}
+			value = args[++i];
+			return true;
+		};
+
+		if (arg.size() < 2 || arg[0] != '-')
+		{
+			if (!cmd.input.empty())
+			{
+				std::fprintf(stderr, "Error: Only one script can be run at a time.\n");
+				return false;
+			}
+			cmd.input = arg;
+			continue;
+		}
+
+		std::string value;
+		uint64_t number = 0;
+		if (arg == "-w" || arg == "--nwscript")
+		{
+			if (!nextValue(cmd.nwscriptFile))
+				return false;
+		}
+		else if (arg == "-i" || arg == "--include")
+		{
+			if (!nextValue(value))
+				return false;
+			splitPaths(value, cmd.includePaths);
+		}
+		else if (arg == "-d" || arg == "--ndb")
+		{
+			if (!nextValue(cmd.ndbFile))
+				return false;
+		}
+		else if (arg == "--no-ndb")
+			cmd.noNdb = true;
+		else if (arg == "-r" || arg == "--repeat")
+		{
+			if (!nextValue(value) || !parseNumber(arg, value, number))
+				return false;
+			cmd.repeat = static_cast<uint32_t>(std::max<uint64_t>(number, 1));
+		}
+		else if (arg == "-m" || arg == "--max-instructions")
+		{
+			if (!nextValue(value) || !parseNumber(arg, value, number))
+				return false;
+			cmd.options.maxInstructions = number;
+		}
+		else if (arg == "--no-deferred")
+			cmd.options.runDeferredActions = false;
+		else if (arg == "-p" || arg == "--profile")
+			cmd.showProfile = true;
+		else if (arg == "--top")
+		{
+			if (!nextValue(value) || !parseNumber(arg, value, number))
+				return false;
+			cmd.top = static_cast<uint32_t>(number);
+		}
+		else if (arg == "-s" || arg == "--summary")
+		{
+			if (!nextValue(cmd.summaryFile))
+				return false;
+		}
+		else if (arg == "-q" || arg == "--quiet")
+			cmd.quiet = true;
+		else if (arg == "-h" || arg == "--help")
+			cmd.help = true;
+		else
+		{
+			std::fprintf(stderr, "Error: Unknown option \"%s\".\n", arg.c_str());
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool readFile(const fs::path& file, std::vector<uint8_t>& contents)
+{
+	std::ifstream in(file, std::ios::binary);
+	if (!in)
+		return false;
+	contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	return !in.bad();
+}
+
+static fs::path findNwscript(const CommandLine& cmd)
+{
+	if (!cmd.nwscriptFile.empty())
+		return cmd.nwscriptFile;
+
+	std::vector<fs::path> searchPaths;
+	searchPaths.push_back(fs::path(cmd.input).parent_path());
+	for (const std::string& path : cmd.includePaths)
+		searchPaths.push_back(path);
+
+	for (const fs::path& path : searchPaths)
+	{
+		std::error_code ec;
+		fs::path candidate = (path.empty() ? fs::path(".") : path) / "nwscript.nss";
+		if (fs::is_regular_file(candidate, ec))
+			return candidate;
+	}
+	return fs::path();
+}
+
+//-------------------------------------------------------------------------------------
+// Reports
+
+struct OpcodeRow
+{
+	std::string name;
+	uint64_t count;
+};
+
+static std::vector<OpcodeRow> opcodeRows(const NcsVirtualMachine::Profile& profile)
+{
+	std::vector<OpcodeRow> rows;
+	for (size_t i = 0; i < profile.opcodeCounts.size(); i++)
+	{
+		if (profile.opcodeCounts[i] == 0)
+			continue;
+		uint8_t opcode = static_cast<uint8_t>(i >> 8), auxcode = static_cast<uint8_t>(i & 0xff);
+		const NcsOpcodeInfo& info = ncsOpcodeInfo(opcode);
+		std::string name = info.mnemonic;
+		if (info.operands != NcsOperands::StoreState)   // Its auxcode is an offset, not a type
+			name += ncsAuxcodeSuffix(auxcode);
+		rows.push_back(OpcodeRow{ name, profile.opcodeCounts[i] });
+	}
+	std::stable_sort(rows.begin(), rows.end(), [](const OpcodeRow& a, const OpcodeRow& b) { return a.count > b.count; });
+	return rows;
+}
+
+static std::vector<const NcsVirtualMachine::FunctionProfile*> functionRows(const NcsVirtualMachine::Profile& profile)
+{
+	std::vector<const NcsVirtualMachine::FunctionProfile*> rows;
+	for (const auto& entry : profile.functions)
+		rows.push_back(&entry.second);
+	std::sort(rows.begin(), rows.end(), [](const auto* a, const auto* b)
+		{ return a->selfInstructions != b->selfInstructions ? a->selfInstructions > b->selfInstructions : a->entry < b->entry; });
+	return rows;
+}
+
+struct LineRow
+{
+	uint32_t file;
+	uint32_t line;
+	uint64_t count;
+};
+
+// A source line may own several address ranges (a for loop's condition and increment...)
+static std::vector<LineRow> lineRows(const NcsVirtualMachine::Profile& profile, const NdbFile& symbols)
+{
+	std::map<std::pair<uint32_t, uint32_t>, uint64_t> counts;
+	for (size_t i = 0; i < profile.lineCounts.size(); i++)
+		if (profile.lineCounts[i])
+			counts[{ symbols.lines()[i].file, symbols.lines()[i].line }] += profile.lineCounts[i];
+
+	std::vector<LineRow> rows;
+	for (const auto& entry : counts)
+		rows.push_back(LineRow{ entry.first.first, entry.first.second, entry.second });
+	std::stable_sort(rows.begin(), rows.end(), [](const LineRow& a, const LineRow& b) { return a.count > b.count; });
+	return rows;
+}
+
+static std::string fileName(const NdbFile& symbols, uint32_t file)
+{
+	return file < symbols.files().size() ? symbols.files()[file] : std::string("?");
+}
+
+static double percent(uint64_t count, uint64_t total)
+{
+	return total ? 100.0 * static_cast<double>(count) / static_cast<double>(total) : 0.0;
+}
+
+static void printProfile(const CommandLine& cmd, const NcsVirtualMachine& vm, const NdbFile* symbols)
+{
+	const NcsVirtualMachine::Profile& profile = vm.profile();
+	size_t top = cmd.top ? cmd.top : SIZE_MAX;
+
+	std::printf("\nInstructions by opcode:\n");
+	std::vector<OpcodeRow> opcodes = opcodeRows(profile);
+	for (size_t i = 0; i < opcodes.size() && i < top; i++)
+		std::printf("  %-16s %14llu %6.2f%%\n", opcodes[i].name.c_str(), static_cast<unsigned long long>(opcodes[i].count),
+			percent(opcodes[i].count, profile.instructions));
+
+	std::printf("\nInstructions by function (self, total, calls):\n");
+	std::vector<const NcsVirtualMachine::FunctionProfile*> functions = functionRows(profile);
+	for (size_t i = 0; i < functions.size() && i < top; i++)
+	{
+		const NcsVirtualMachine::FunctionProfile& function = *functions[i];
+		std::printf("  %-32s %14llu %6.2f%% %14llu %10llu\n", vm.functionName(function.entry).c_str(),
+			static_cast<unsigned long long>(function.selfInstructions), percent(function.selfInstructions, profile.instructions),
+			static_cast<unsigned long long>(function.totalInstructions), static_cast<unsigned long long>(function.calls));
+	}
+
+	if (symbols)
+	{
+		std::printf("\nInstructions by line:\n");
+		std::vector<LineRow> lines = lineRows(profile, *symbols);
+		for (size_t i = 0; i < lines.size() && i < top; i++)
+		{
+			std::string name = fileName(*symbols, lines[i].file) + ".nss(" + std::to_string(lines[i].line) + ")";
+			std::printf("  %-32s %14llu %6.2f%%\n", name.c_str(), static_cast<unsigned long long>(lines[i].count),
+				percent(lines[i].count, profile.instructions));
+		}
+	}
+
+	bool anyAction = false;
+	for (size_t i = 0; i < profile.actionCounts.size(); i++)
+	{
+		if (!profile.actionCounts[i])
+			continue;
+		if (!anyAction)
+			std::printf("\nEngine function calls:\n");
+		anyAction = true;
+		std::printf("  %-32s %14llu\n", vm.actions().definition(static_cast<uint32_t>(i))->name.c_str(),
+			static_cast<unsigned long long>(profile.actionCounts[i]));
+	}
+}
+
+static void writeSummary(std::ostream& out, const CommandLine& cmd, const NcsVirtualMachine& vm, const NdbFile* symbols,
+	bool success, const std::string& errorMessage, double wallMs)
+{
+	const NcsVirtualMachine::Profile& profile = vm.profile();
+	JsonWriter json(out);
+	json.beginObject();
+	json.member("script", cmd.input);
+	json.member("success", success);
+	if (!success)
+		json.member("error", errorMessage);
+	json.member("runs", static_cast<unsigned long long>(profile.runs));
+	json.member("wallMs", wallMs);
+	json.member("instructions", static_cast<unsigned long long>(profile.instructions));
+	json.member("deferredActions", static_cast<unsigned long long>(profile.deferredActions));
+	json.member("deferredActionsDropped", static_cast<unsigned long long>(profile.deferredActionsDropped));
+	if (vm.hasConditionResult())
+		json.member("conditionResult", static_cast<int>(vm.conditionResult()));
+
+	json.key("opcodes").beginArray();
+	for (const OpcodeRow& row : opcodeRows(profile))
+		json.beginObject().member("opcode", row.name).member("count", static_cast<unsigned long long>(row.count)).endObject();
+	json.endArray();
+
+	json.key("functions").beginArray();
+	for (const NcsVirtualMachine::FunctionProfile* function : functionRows(profile))
+	{
+		json.beginObject();
+		json.member("name", vm.functionName(function->entry));
+		json.member("address", static_cast<unsigned>(function->entry));
+		json.member("calls", static_cast<unsigned long long>(function->calls));
+		json.member("self", static_cast<unsigned long long>(function->selfInstructions));
+		json.member("total", static_cast<unsigned long long>(function->totalInstructions));
+		json.endObject();
+	}
+	json.endArray();
+
+	if (symbols)
+	{
+		json.key("lines").beginArray();
+		for (const LineRow& row : lineRows(profile, *symbols))
+		{
+			json.beginObject();
+			json.member("file", fileName(*symbols, row.file));
+			json.member("line", static_cast<unsigned>(row.line));
+			json.member("count", static_cast<unsigned long long>(row.count));
+			json.endObject();
+		}
+		json.endArray();
+	}
+
+	json.key("actions").beginArray();
+	for (size_t i = 0; i < profile.actionCounts.size(); i++)
+	{
+		if (profile.actionCounts[i])
+			json.beginObject().member("name", vm.actions().definition(static_cast<uint32_t>(i))->name)
+				.member("count", static_cast<unsigned long long>(profile.actionCounts[i])).endObject();
+	}
+	json.endArray();
+
+	json.endObject();
+	out << '\n';
+}
+
+int main(int argc, char** argv)
+{
+	CommandLine cmd;
+	if (!parseArguments(argc, argv, cmd))
+		return EXIT_CODE_USAGE_ERROR;
+
+	if (cmd.help || cmd.input.empty())
+	{
+		printUsage();
+		return cmd.help ? EXIT_CODE_SUCCESS : EXIT_CODE_USAGE_ERROR;
+	}
+
+	std::string errorMessage;
+	fs::path nwscript = findNwscript(cmd);
+	NcsActionTable actions;
+	if (nwscript.empty())
+	{
+		std::fprintf(stderr, "Error: nwscript.nss not found; use --nwscript or --include.\n");
+		return EXIT_CODE_USAGE_ERROR;
+	}
+	if (!actions.load(nwscript, errorMessage))
+	{
+		std::fprintf(stderr, "Error: %s\n", errorMessage.c_str());
+		return EXIT_CODE_USAGE_ERROR;
+	}
+	actions.addStandardHandlers();
+
+	std::vector<uint8_t> code;
+	if (!readFile(cmd.input, code))
+	{
+		std::fprintf(stderr, "Error: Unable to read \"%s\".\n", cmd.input.c_str());
+		return EXIT_CODE_USAGE_ERROR;
+	}
+
+	NcsVirtualMachine vm(actions, cmd.options);
+	if (!vm.load(std::move(code), errorMessage))
+	{
+		std::fprintf(stderr, "Error: %s: %s\n", cmd.input.c_str(), errorMessage.c_str());
+		return EXIT_CODE_USAGE_ERROR;
+	}
+
+	NdbFile symbols;
+	bool haveSymbols = false;
+	if (!cmd.noNdb)
+	{
+		fs::path ndb = cmd.ndbFile.empty() ? fs::path(cmd.input).replace_extension(".ndb") : fs::path(cmd.ndbFile);
+		std::error_code ec;
+		if (!cmd.ndbFile.empty() || fs::is_regular_file(ndb, ec))
+		{
+			if (!symbols.load(ndb, errorMessage))
+			{
+				std::fprintf(stderr, "Error: %s\n", errorMessage.c_str());
+				return EXIT_CODE_USAGE_ERROR;
+			}
+			vm.setSymbols(&symbols);
+			haveSymbols = true;
+		}
+	}
+
+	if (!cmd.quiet)
+		vm.setPrinter([](std::string_view text) { std::printf("%.*s\n", static_cast<int>(text.size()), text.data()); });
+
+	auto start = std::chrono::steady_clock::now();
+	bool success = true;
+	for (uint32_t i = 0; i < cmd.repeat && success; i++)
+		success = vm.run(errorMessage);
+	double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	if (!success)
+		std::fprintf(stderr, "Error: %s: %s\n", cmd.input.c_str(), errorMessage.c_str());
+
+	if (!cmd.quiet || cmd.showProfile)
+	{
+		const NcsVirtualMachine::Profile& profile = vm.profile();
+		std::printf("%llu instruction(s) in %llu run(s), %llu deferred action(s), %.1f ms.",
+			static_cast<unsigned long long>(profile.instructions), static_cast<unsigned long long>(profile.runs),
+			static_cast<unsigned long long>(profile.deferredActions), wallMs);
+		if (vm.hasConditionResult())
+			std::printf(" Condition result: %d.", vm.conditionResult());
+		std::printf("\n");
+	}
+
+	if (cmd.showProfile)
+		printProfile(cmd, vm, haveSymbols ? &symbols : nullptr);
+
+	if (!cmd.summaryFile.empty())
+	{
+		if (cmd.summaryFile == "-")
+		{
+			std::fflush(stdout);
+			writeSummary(std::cout, cmd, vm, haveSymbols ? &symbols : nullptr, success, errorMessage, wallMs);
+		}
+		else
+		{
+			std::ofstream out(cmd.summaryFile, std::ios::trunc);
+			if (!out)
+			{
+				std::fprintf(stderr, "Error: Unable to write summary file \"%s\".\n", cmd.summaryFile.c_str());
+				return EXIT_CODE_USAGE_ERROR;
+			}
+			writeSummary(out, cmd, vm, haveSymbols ? &symbols : nullptr, success, errorMessage, wallMs);
+		}
+	}
+
+	return success ? EXIT_CODE_SUCCESS : EXIT_CODE_SCRIPT_ERROR;
+}
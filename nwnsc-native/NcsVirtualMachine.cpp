@@ -0,0 +1,833 @@
+/** @file NcsVirtualMachine.cpp
+ * Reference interpreter for compiled NWScript (NCS) bytecode, with instruction profiling.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+
+#include "exobase.h"
+#include "scriptcomp.h"
+#include "scriptinternal.h"
+
+#include "NcsInstruction.h"
+#include "NcsVirtualMachine.h"
+#include "NdbFile.h"
+
+using namespace NWScriptCli;
+using namespace NWScriptPlugin;
+
+NcsVirtualMachine::NcsVirtualMachine(const NcsActionTable& actions, const Options& options)
+	: _actions(actions), _options(options)
+{
+	_profile.opcodeCounts.assign(256 * 256, 0);
+	_profile.actionCounts.assign(actions.size(), 0);
+}
+
+bool NcsVirtualMachine::load(std::vector<uint8_t>&& code, std::string& errorMessage)
+{
+	if (!checkNcsHeader(code.data(), code.size(), errorMessage))
+		return false;
+
+	_code = std::move(code);
+	setSymbols(_symbols);
+	return true;
+}
+
+void NcsVirtualMachine::setSymbols(const NdbFile* symbols)
+{
+	_symbols = symbols;
+	_lineAtAddress.clear();
+	_profile.lineCounts.clear();
+	if (!_symbols)
+		return;
+
+	// One lookup per instruction is too slow for a profiler: resolve every address once
+	_lineAtAddress.assign(_code.size(), -1);
+	const std::vector<NdbFile::Line>& lines = _symbols->lines();
+	for (size_t i = 0; i < lines.size(); i++)
+	{
+		uint32_t end = std::min<uint32_t>(lines[i].end, static_cast<uint32_t>(_code.size()));
+		for (uint32_t address = lines[i].start; address < end; address++)
+			_lineAtAddress[address] = static_cast<int32_t>(i);
+	}
+	_profile.lineCounts.assign(lines.size(), 0);
+}
+
+std::string NcsVirtualMachine::functionName(uint32_t entry) const
+{
+	if (_symbols)
+	{
+		int32_t index = _symbols->functionIndexStartingAt(entry);
+		if (index >= 0)
+			return _symbols->functions()[index].name;
+
+		// Deferred actions start inside the function that queued them
+		index = _symbols->functionIndexAt(entry);
+		if (index >= 0)
+		{
+			char offset[16];
+			std::snprintf(offset, sizeof(offset), "+0x%x", entry - _symbols->functions()[index].start);
+			return _symbols->functions()[index].name + offset;
+		}
+	}
+
+	char buffer[16];
+	std::snprintf(buffer, sizeof(buffer), "sub_%08x", entry);
+	return buffer;
+}
+
+void NcsVirtualMachine::print(std::string_view text) const
+{
+	if (_printer)
+		_printer(text);
+}
+
+void NcsVirtualMachine::fail(std::string message)
+{
+	if (_failed)
+		return;
+	_failed = true;
+	_errorMessage = std::move(message);
+}
+
+int32_t NcsVirtualMachine::random(int32_t limit)
+{
+	if (limit <= 0)
+		return 0;
+	// Numerical Recipes LCG: same sequence on every platform
+	_randomState = _randomState * 1664525u + 1013904223u;
+	return static_cast<int32_t>((_randomState >> 8) % static_cast<uint32_t>(limit));
+}
+
+//-------------------------------------------------------------------------------------
+// Stack
+
+bool NcsVirtualMachine::push(NcsValue&& value)
+{
+	if (stackPointer() + 4 > _options.maxStackBytes)
+	{
+		fail("Stack overflow (more than " + std::to_string(_options.maxStackBytes) + " bytes).");
+		return false;
+	}
+	_stack.push_back(std::move(value));
+	return true;
+}
+
+bool NcsVirtualMachine::pop(NcsValue& value, NcsType type)
+{
+	if (_stack.empty())
+	{
+		fail("Stack underflow.");
+		return false;
+	}
+	if (_stack.back().type != type)
+	{
+		fail("Type mismatch on the stack: expected " + std::string(ncsAuxcodeSuffix(static_cast<uint8_t>(type))) +
+			", found " + ncsAuxcodeSuffix(static_cast<uint8_t>(_stack.back().type)) + ".");
+		return false;
+	}
+	value = std::move(_stack.back());
+	_stack.pop_back();
+	return true;
+}
+
+NcsValue* NcsVirtualMachine::cellAt(uint32_t pointer, int32_t offset, int32_t size)
+{
+	int64_t start = static_cast<int64_t>(pointer) + offset;
+	if ((offset & 3) != 0 || (size & 3) != 0 || size < 0 || start < 0 || start + size > static_cast<int64_t>(stackPointer()))
+	{
+		fail("Stack access out of range (offset " + std::to_string(offset) + ", size " + std::to_string(size) + ").");
+		return nullptr;
+	}
+	return _stack.data() + start / 4;
+}
+
+int32_t NcsVirtualMachine::popInteger()
+{
+	NcsValue value;
+	return pop(value, NcsType::Integer) ? value.intValue : 0;
+}
+
+float NcsVirtualMachine::popFloat()
+{
+	NcsValue value;
+	return pop(value, NcsType::Float) ? value.floatValue : 0.0f;
+}
+
+std::string NcsVirtualMachine::popString()
+{
+	NcsValue value;
+	return pop(value, NcsType::String) ? std::move(value.text) : std::string();
+}
+
+uint32_t NcsVirtualMachine::popObject()
+{
+	NcsValue value;
+	return pop(value, NcsType::Object) ? value.objectValue : NCS_OBJECT_INVALID;
+}
+
+NcsVector NcsVirtualMachine::popVector()
+{
+	NcsVector vector;
+	vector.z = popFloat();
+	vector.y = popFloat();
+	vector.x = popFloat();
+	return vector;
+}
+
+NcsValue NcsVirtualMachine::popEngineStructure()
+{
+	NcsValue value;
+	if (_stack.empty())
+		fail("Stack underflow.");
+	else if (_stack.back().type < NcsType::EngineStructure0)
+		fail("Type mismatch on the stack: expected an engine structure.");
+	else
+	{
+		value = std::move(_stack.back());
+		_stack.pop_back();
+	}
+	return value;
+}
+
+void NcsVirtualMachine::pushInteger(int32_t value)
+{
+	NcsValue cell;
+	cell.type = NcsType::Integer;
+	cell.intValue = value;
+	push(std::move(cell));
+}
+
+void NcsVirtualMachine::pushFloat(float value)
+{
+	NcsValue cell;
+	cell.type = NcsType::Float;
+	cell.floatValue = value;
+	push(std::move(cell));
+}
+
+void NcsVirtualMachine::pushString(std::string value)
+{
+	NcsValue cell;
+	cell.type = NcsType::String;
+	cell.text = std::move(value);
+	push(std::move(cell));
+}
+
+void NcsVirtualMachine::pushObject(uint32_t value)
+{
+	NcsValue cell;
+	cell.type = NcsType::Object;
+	cell.objectValue = value;
+	push(std::move(cell));
+}
+
+void NcsVirtualMachine::pushVector(const NcsVector& value)
+{
+	pushFloat(value.x);
+	pushFloat(value.y);
+	pushFloat(value.z);
+}
+
+void NcsVirtualMachine::pushEngineStructure(uint8_t engineStructure, int32_t id, std::string payload)
+{
+	NcsValue cell;
+	cell.type = static_cast<NcsType>(static_cast<uint8_t>(NcsType::EngineStructure0) + engineStructure);
+	cell.intValue = id;
+	cell.text = std::move(payload);
+	push(std::move(cell));
+}
+
+bool NcsVirtualMachine::takeStoredState(StoredState& state)
+{
+	if (_storedStates.empty())
+	{
+		fail("Action argument without a stored state (STORE_STATE).");
+		return false;
+	}
+	state = std::move(_storedStates.back());
+	_storedStates.pop_back();
+	return true;
+}
+
+void NcsVirtualMachine::defer(StoredState&& state, float delaySeconds)
+{
+	if (!_options.runDeferredActions)
+		return;
+
+	if (_deferred.size() >= _options.maxDeferredActions)
+	{
+		_profile.deferredActionsDropped++;
+		return;
+	}
+
+	DeferredAction action;
+	action.time = _time + std::max(delaySeconds, 0.0f);
+	action.sequence = _deferredSequence++;
+	action.state = std::move(state);
+	_deferred.push_back(std::move(action));
+}
+
+//-------------------------------------------------------------------------------------
+// Execution
+
+NcsVirtualMachine::FunctionProfile* NcsVirtualMachine::functionProfile(uint32_t entry)
+{
+	if (!_options.profile)
+		return nullptr;
+	FunctionProfile& function = _profile.functions[entry];
+	function.entry = entry;
+	return &function;
+}
+
+static inline bool sameCell(const NcsValue& a, const NcsValue& b)
+{
+	if (a.type != b.type)
+		return false;
+	switch (a.type)
+	{
+	case NcsType::Float: return a.floatValue == b.floatValue;
+	case NcsType::String: return a.text == b.text;
+	case NcsType::Integer:
+	case NcsType::Object: return a.intValue == b.intValue;
+	default: return a.intValue == b.intValue && a.text == b.text;
+	}
+}
+
+bool NcsVirtualMachine::run(std::string& errorMessage)
+{
+	_stack.clear();
+	_frames.clear();
+	_storedStates.clear();
+	_deferred.clear();
+	_bp = 0;
+	_time = 0.0;
+	_deferredSequence = 0;
+	_runInstructions = 0;
+	_randomState = _options.randomSeed + static_cast<uint32_t>(_profile.runs);
+	_failed = false;
+	_errorMessage.clear();
+	_hasConditionResult = false;
+	_profile.runs++;
+
+	bool result = execute(NCS_HEADER_SIZE);
+	if (result && _stack.size() == 1 && _stack[0].type == NcsType::Integer)
+	{
+		_hasConditionResult = true;
+		_conditionResult = _stack[0].intValue;
+	}
+
+	// Actions run in game time order; the ones queued at the same time, in queue order
+	while (result && !_deferred.empty())
+	{
+		auto next = std::min_element(_deferred.begin(), _deferred.end(), [](const DeferredAction& a, const DeferredAction& b)
+			{ return a.time != b.time ? a.time < b.time : a.sequence < b.sequence; });
+		DeferredAction action = std::move(*next);
+		_deferred.erase(next);
+
+		_time = action.time;
+		_profile.deferredActions++;
+		_stack = std::move(action.state.globals);
+		_bp = stackPointer();
+		_stack.insert(_stack.end(), std::make_move_iterator(action.state.locals.begin()), std::make_move_iterator(action.state.locals.end()));
+		result = execute(action.state.address);
+	}
+
+	if (!result)
+	{
+		std::string where;
+		char buffer[32];
+		std::snprintf(buffer, sizeof(buffer), "0x%08x", _ip);
+		where = buffer;
+		if (_symbols)
+		{
+			int32_t function = _symbols->functionIndexAt(_ip);
+			if (function >= 0)
+				where += " in " + _symbols->functions()[function].name + "()";
+			int32_t line = _lineAtAddress.empty() || _ip >= _lineAtAddress.size() ? -1 : _lineAtAddress[_ip];
+			if (line >= 0)
+			{
+				const NdbFile::Line& entry = _symbols->lines()[line];
+				std::string file = entry.file < _symbols->files().size() ? _symbols->files()[entry.file] : std::string();
+				where += ", " + file + ".nss(" + std::to_string(entry.line) + ")";
+			}
+		}
+		errorMessage = "Script aborted at " + where + ": " + _errorMessage;
+	}
+
+	return result;
+}
+
+bool NcsVirtualMachine::execute(uint32_t entry)
+{
+	const uint8_t* code = _code.data();
+	const size_t codeSize = _code.size();
+	NcsInstruction instruction;
+
+	_frames.clear();
+	_frames.push_back(Frame{ 0, functionProfile(entry), _profile.instructions });
+	if (_frames.back().function)
+		_frames.back().function->calls++;
+
+	_ip = entry;
+	while (!_failed)
+	{
+		if (!decodeNcsInstruction(code, codeSize, _ip, instruction))
+		{
+			fail("Invalid instruction.");
+			break;
+		}
+
+		if (_options.maxInstructions && ++_runInstructions > _options.maxInstructions)
+		{
+			fail("Instruction limit exceeded (" + std::to_string(_options.maxInstructions) + ").");
+			break;
+		}
+
+		_profile.instructions++;
+		if (_options.profile)
+		{
+			_profile.opcodeCounts[instruction.opcode * 256 + instruction.auxcode]++;
+			if (_frames.back().function)
+				_frames.back().function->selfInstructions++;
+			if (!_lineAtAddress.empty())
+			{
+				int32_t line = _lineAtAddress[_ip];
+				if (line >= 0)
+					_profile.lineCounts[line]++;
+			}
+		}
+
+		uint32_t next = _ip + instruction.size;
+		const uint8_t aux = instruction.auxcode;
+
+		switch (instruction.opcode)
+		{
+		case CVIRTUALMACHINE_OPCODE_ASSIGNMENT:         // CPDOWNSP
+		case CVIRTUALMACHINE_OPCODE_ASSIGNMENT_BASE:    // CPDOWNBP
+		{
+			int32_t size = instruction.operand2;
+			uint32_t base = instruction.opcode == CVIRTUALMACHINE_OPCODE_ASSIGNMENT ? stackPointer() : _bp;
+			NcsValue* source = cellAt(stackPointer(), -size, size);
+			NcsValue* target = cellAt(base, instruction.operand1, size);
+			if (source && target && source != target)
+				std::copy(source, source + size / 4, target);
+			break;
+		}
+
+		case CVIRTUALMACHINE_OPCODE_RUNSTACK_COPY:         // CPTOPSP
+		case CVIRTUALMACHINE_OPCODE_RUNSTACK_COPY_BASE:    // CPTOPBP
+		{
+			int32_t size = instruction.operand2;
+			uint32_t base = instruction.opcode == CVIRTUALMACHINE_OPCODE_RUNSTACK_COPY ? stackPointer() : _bp;
+			NcsValue* source = cellAt(base, instruction.operand1, size);
+			if (!source)
+				break;
+			size_t first = static_cast<size_t>(source - _stack.data());
+			for (int32_t i = 0; i < size / 4 && !_failed; i++)
+			{
+				NcsValue copy = _stack[first + i];
+				push(std::move(copy));
+			}
+			break;
+		}
+
+		case CVIRTUALMACHINE_OPCODE_RUNSTACK_ADD:    // RSADD
+			switch (aux)
+			{
+			case CVIRTUALMACHINE_AUXCODE_TYPE_INTEGER: pushInteger(0); break;
+			case CVIRTUALMACHINE_AUXCODE_TYPE_FLOAT: pushFloat(0.0f); break;
+			case CVIRTUALMACHINE_AUXCODE_TYPE_STRING: pushString(std::string()); break;
+			case CVIRTUALMACHINE_AUXCODE_TYPE_OBJECT: pushObject(NCS_OBJECT_INVALID); break;
+			default:
+				if (aux >= CVIRTUALMACHINE_AUXCODE_TYPE_ENGST0 && aux <= CVIRTUALMACHINE_AUXCODE_TYPE_ENGST9)
+					pushEngineStructure(static_cast<uint8_t>(aux - CVIRTUALMACHINE_AUXCODE_TYPE_ENGST0));
+				else
+					fail("Invalid RSADD type.");
+			}
+			break;
+
+		case CVIRTUALMACHINE_OPCODE_CONSTANT:    // CONST
+			switch (aux)
+			{
+			case CVIRTUALMACHINE_AUXCODE_TYPE_INTEGER: pushInteger(instruction.operand1); break;
+			case CVIRTUALMACHINE_AUXCODE_TYPE_FLOAT: pushFloat(instruction.floatValue); break;
+			case CVIRTUALMACHINE_AUXCODE_TYPE_STRING: pushString(std::string(instruction.stringValue)); break;
+			case CVIRTUALMACHINE_AUXCODE_TYPE_OBJECT:
+				// The compiler only emits OBJECT_SELF (0) and OBJECT_INVALID (1)
+				pushObject(instruction.operand1 == 0 ? _options.objectSelf : NCS_OBJECT_INVALID);
+				break;
+			case CVIRTUALMACHINE_AUXCODE_TYPE_ENGST2:
+				pushEngineStructure(2, instruction.operand1);
+				break;
+			case CVIRTUALMACHINE_AUXCODE_TYPE_ENGST7:
+				pushEngineStructure(7, 0, std::string(instruction.stringValue));
+				break;
+			}
+			break;
+
+		case CVIRTUALMACHINE_OPCODE_EXECUTE_COMMAND:    // ACTION
+		{
+			uint32_t action = static_cast<uint32_t>(instruction.operand1);
+			if (_options.profile && action < _profile.actionCounts.size())
+				_profile.actionCounts[action]++;
+			_actions.call(*this, action, static_cast<uint32_t>(instruction.operand2));
+			break;
+		}
+
+		case CVIRTUALMACHINE_OPCODE_LOGICAL_AND:
+		case CVIRTUALMACHINE_OPCODE_LOGICAL_OR:
+		case CVIRTUALMACHINE_OPCODE_INCLUSIVE_OR:
+		case CVIRTUALMACHINE_OPCODE_EXCLUSIVE_OR:
+		case CVIRTUALMACHINE_OPCODE_BOOLEAN_AND:
+		case CVIRTUALMACHINE_OPCODE_SHIFT_LEFT:
+		case CVIRTUALMACHINE_OPCODE_SHIFT_RIGHT:
+		case CVIRTUALMACHINE_OPCODE_USHIFT_RIGHT:
+		case CVIRTUALMACHINE_OPCODE_MODULUS:
+		{
+			if (aux != CVIRTUALMACHINE_AUXCODE_TYPETYPE_INTEGER_INTEGER)
+			{
+				fail("Invalid operand types.");
+				break;
+			}
+			int32_t right = popInteger();
+			int32_t left = popInteger();
+			uint32_t uleft = static_cast<uint32_t>(left);
+			int32_t result = 0;
+			switch (instruction.opcode)
+			{
+			case CVIRTUALMACHINE_OPCODE_LOGICAL_AND: result = left && right; break;
+			case CVIRTUALMACHINE_OPCODE_LOGICAL_OR: result = left || right; break;
+			case CVIRTUALMACHINE_OPCODE_INCLUSIVE_OR: result = left | right; break;
+			case CVIRTUALMACHINE_OPCODE_EXCLUSIVE_OR: result = left ^ right; break;
+			case CVIRTUALMACHINE_OPCODE_BOOLEAN_AND: result = left & right; break;
+			// Shift counts wrap at 32 like on x86; >> keeps the sign, >>> doesn't
+			case CVIRTUALMACHINE_OPCODE_SHIFT_LEFT: result = static_cast<int32_t>(uleft << (right & 31)); break;
+			case CVIRTUALMACHINE_OPCODE_SHIFT_RIGHT: result = left >> (right & 31); break;
+			case CVIRTUALMACHINE_OPCODE_USHIFT_RIGHT: result = static_cast<int32_t>(uleft >> (right & 31)); break;
+			case CVIRTUALMACHINE_OPCODE_MODULUS:
+				if (right == 0)
+					fail("Division by zero.");
+				else
+					result = (right == -1) ? 0 : left % right;
+				break;
+			}
+			pushInteger(result);
+			break;
+		}
+
+		case CVIRTUALMACHINE_OPCODE_EQUAL:
+		case CVIRTUALMACHINE_OPCODE_NOT_EQUAL:
+		{
+			int32_t size = (aux == CVIRTUALMACHINE_AUXCODE_TYPETYPE_STRUCT_STRUCT) ? instruction.operand2 :
+				(aux == CVIRTUALMACHINE_AUXCODE_TYPETYPE_VECTOR_VECTOR) ? 12 : 4;
+			NcsValue* left = cellAt(stackPointer(), -2 * size, 2 * size);
+			if (!left)
+				break;
+			bool equal = std::equal(left, left + size / 4, left + size / 4, sameCell);
+			_stack.resize(_stack.size() - static_cast<size_t>(size / 2));
+			pushInteger((instruction.opcode == CVIRTUALMACHINE_OPCODE_EQUAL) == equal);
+			break;
+		}
+
+		case CVIRTUALMACHINE_OPCODE_GEQ:
+		case CVIRTUALMACHINE_OPCODE_GT:
+		case CVIRTUALMACHINE_OPCODE_LT:
+		case CVIRTUALMACHINE_OPCODE_LEQ:
+		{
+			int comparison = 0;
+			if (aux == CVIRTUALMACHINE_AUXCODE_TYPETYPE_INTEGER_INTEGER)
+			{
+				int32_t right = popInteger();
+				int32_t left = popInteger();
+				comparison = (left > right) - (left < right);
+			}
+			else if (aux == CVIRTUALMACHINE_AUXCODE_TYPETYPE_FLOAT_FLOAT)
+			{
+				float right = popFloat();
+				float left = popFloat();
+				comparison = (left > right) - (left < right);
+			}
+			else
+			{
+				fail("Invalid operand types.");
+				break;
+			}
+
+			bool result = false;
+			switch (instruction.opcode)
+			{
+			case CVIRTUALMACHINE_OPCODE_GEQ: result = comparison >= 0; break;
+			case CVIRTUALMACHINE_OPCODE_GT: result = comparison > 0; break;
+			case CVIRTUALMACHINE_OPCODE_LT: result = comparison < 0; break;
+			case CVIRTUALMACHINE_OPCODE_LEQ: result = comparison <= 0; break;
+			}
+			pushInteger(result);
+			break;
+		}
+
+		case CVIRTUALMACHINE_OPCODE_ADD:
+		case CVIRTUALMACHINE_OPCODE_SUB:
+		case CVIRTUALMACHINE_OPCODE_MUL:
+		case CVIRTUALMACHINE_OPCODE_DIV:
+		{
+			const uint8_t opcode = instruction.opcode;
+			switch (aux)
+			{
+			case CVIRTUALMACHINE_AUXCODE_TYPETYPE_INTEGER_INTEGER:
+			{
+				int32_t right = popInteger();
+				int32_t left = popInteger();
+				uint32_t a = static_cast<uint32_t>(left), b = static_cast<uint32_t>(right);
+				int32_t result = 0;
+				// Two's complement wrap around, like the engine
+				if (opcode == CVIRTUALMACHINE_OPCODE_ADD) result = static_cast<int32_t>(a + b);
+				else if (opcode == CVIRTUALMACHINE_OPCODE_SUB) result = static_cast<int32_t>(a - b);
+				else if (opcode == CVIRTUALMACHINE_OPCODE_MUL) result = static_cast<int32_t>(a * b);
+				else if (right == 0 || (left == INT_MIN && right == -1)) fail(right == 0 ? "Division by zero." : "Integer overflow in division.");
+				else result = left / right;
+				pushInteger(result);
+				break;
+			}
+
+			case CVIRTUALMACHINE_AUXCODE_TYPETYPE_FLOAT_FLOAT:
+			case CVIRTUALMACHINE_AUXCODE_TYPETYPE_INTEGER_FLOAT:
+			case CVIRTUALMACHINE_AUXCODE_TYPETYPE_FLOAT_INTEGER:
+			{
+				float right = aux == CVIRTUALMACHINE_AUXCODE_TYPETYPE_FLOAT_INTEGER ? static_cast<float>(popInteger()) : popFloat();
+				float left = aux == CVIRTUALMACHINE_AUXCODE_TYPETYPE_INTEGER_FLOAT ? static_cast<float>(popInteger()) : popFloat();
+				float result = 0.0f;
+				if (opcode == CVIRTUALMACHINE_OPCODE_ADD) result = left + right;
+				else if (opcode == CVIRTUALMACHINE_OPCODE_SUB) result = left - right;
+				else if (opcode == CVIRTUALMACHINE_OPCODE_MUL) result = left * right;
+				else if (right == 0.0f) fail("Division by zero.");
+				else result = left / right;
+				pushFloat(result);
+				break;
+			}
+
+			case CVIRTUALMACHINE_AUXCODE_TYPETYPE_STRING_STRING:
+			{
+				if (opcode != CVIRTUALMACHINE_OPCODE_ADD)
+				{
+					fail("Invalid operand types.");
+					break;
+				}
+				std::string right = popString();
+				std::string left = popString();
+				pushString(left + right);
+				break;
+			}
+
+			case CVIRTUALMACHINE_AUXCODE_TYPETYPE_VECTOR_VECTOR:
+			{
+				if (opcode != CVIRTUALMACHINE_OPCODE_ADD && opcode != CVIRTUALMACHINE_OPCODE_SUB)
+				{
+					fail("Invalid operand types.");
+					break;
+				}
+				NcsVector right = popVector();
+				NcsVector left = popVector();
+				float sign = opcode == CVIRTUALMACHINE_OPCODE_ADD ? 1.0f : -1.0f;
+				pushVector(NcsVector{ left.x + sign * right.x, left.y + sign * right.y, left.z + sign * right.z });
+				break;
+			}
+
+			case CVIRTUALMACHINE_AUXCODE_TYPETYPE_VECTOR_FLOAT:
+			case CVIRTUALMACHINE_AUXCODE_TYPETYPE_FLOAT_VECTOR:
+			{
+				bool vectorFirst = aux == CVIRTUALMACHINE_AUXCODE_TYPETYPE_VECTOR_FLOAT;
+				if (opcode != CVIRTUALMACHINE_OPCODE_MUL && !(opcode == CVIRTUALMACHINE_OPCODE_DIV && vectorFirst))
+				{
+					fail("Invalid operand types.");
+					break;
+				}
+				NcsVector vector;
+				float scalar;
+				if (vectorFirst)
+				{
+					scalar = popFloat();
+					vector = popVector();
+				}
+				else
+				{
+					vector = popVector();
+					scalar = popFloat();
+				}
+				if (opcode == CVIRTUALMACHINE_OPCODE_DIV)
+				{
+					if (scalar == 0.0f)
+					{
+						fail("Division by zero.");
+						break;
+					}
+					scalar = 1.0f / scalar;
+				}
+				pushVector(NcsVector{ vector.x * scalar, vector.y * scalar, vector.z * scalar });
+				break;
+			}
+
+			default:
+				fail("Invalid operand types.");
+			}
+			break;
+		}
+
+		case CVIRTUALMACHINE_OPCODE_NEGATION:
+			if (aux == CVIRTUALMACHINE_AUXCODE_TYPE_INTEGER)
+				pushInteger(static_cast<int32_t>(0u - static_cast<uint32_t>(popInteger())));
+			else if (aux == CVIRTUALMACHINE_AUXCODE_TYPE_FLOAT)
+				pushFloat(-popFloat());
+			else
+				fail("Invalid operand type.");
+			break;
+
+		case CVIRTUALMACHINE_OPCODE_ONES_COMPLEMENT:
+			pushInteger(~popInteger());
+			break;
+
+		case CVIRTUALMACHINE_OPCODE_BOOLEAN_NOT:
+			pushInteger(!popInteger());
+			break;
+
+		case CVIRTUALMACHINE_OPCODE_MODIFY_STACK_POINTER:    // MOVSP
+		{
+			int32_t offset = instruction.operand1;
+			if (offset > 0 || (offset & 3) != 0 || static_cast<uint32_t>(-static_cast<int64_t>(offset)) > stackPointer())
+				fail("Invalid stack pointer adjustment.");
+			else
+				_stack.resize(_stack.size() - static_cast<size_t>(-offset / 4));
+			break;
+		}
+
+		case CVIRTUALMACHINE_OPCODE_JMP:
+			next = _ip + static_cast<uint32_t>(instruction.operand1);
+			break;
+
+		case CVIRTUALMACHINE_OPCODE_JSR:
+		{
+			if (_frames.size() >= _options.maxCallDepth)
+			{
+				fail("Call stack overflow (more than " + std::to_string(_options.maxCallDepth) + " nested calls).");
+				break;
+			}
+			uint32_t target = _ip + static_cast<uint32_t>(instruction.operand1);
+			FunctionProfile* function = functionProfile(target);
+			if (function)
+				function->calls++;
+			_frames.push_back(Frame{ next, function, _profile.instructions });
+			next = target;
+			break;
+		}
+
+		case CVIRTUALMACHINE_OPCODE_JZ:
+		case CVIRTUALMACHINE_OPCODE_JNZ:
+		{
+			int32_t condition = popInteger();
+			if ((condition == 0) == (instruction.opcode == CVIRTUALMACHINE_OPCODE_JZ))
+				next = _ip + static_cast<uint32_t>(instruction.operand1);
+			break;
+		}
+
+		case CVIRTUALMACHINE_OPCODE_RET:
+		{
+			Frame frame = _frames.back();
+			_frames.pop_back();
+			if (frame.function)
+				frame.function->totalInstructions += _profile.instructions - frame.instructionsAtCall;
+			if (_frames.empty())
+				return true;
+			next = frame.returnAddress;
+			break;
+		}
+
+		case CVIRTUALMACHINE_OPCODE_DE_STRUCT:    // DESTRUCT: keep [offset, offset + size) of the top bytes
+		{
+			int32_t total = instruction.operand1, keepOffset = instruction.operand2, keepSize = instruction.operand3;
+			NcsValue* block = cellAt(stackPointer(), -total, total);
+			if (!block || keepOffset + keepSize > total || ((keepOffset | keepSize) & 3) != 0)
+			{
+				fail("Invalid DESTRUCT.");
+				break;
+			}
+			size_t first = static_cast<size_t>(block - _stack.data());
+			std::move(_stack.begin() + first + keepOffset / 4, _stack.begin() + first + (keepOffset + keepSize) / 4, _stack.begin() + first);
+			_stack.resize(first + static_cast<size_t>(keepSize / 4));
+			break;
+		}
+
+		case CVIRTUALMACHINE_OPCODE_DECREMENT:         // DECISP
+		case CVIRTUALMACHINE_OPCODE_INCREMENT:         // INCISP
+		case CVIRTUALMACHINE_OPCODE_DECREMENT_BASE:    // DECIBP
+		case CVIRTUALMACHINE_OPCODE_INCREMENT_BASE:    // INCIBP
+		{
+			bool base = instruction.opcode == CVIRTUALMACHINE_OPCODE_DECREMENT_BASE || instruction.opcode == CVIRTUALMACHINE_OPCODE_INCREMENT_BASE;
+			bool increment = instruction.opcode == CVIRTUALMACHINE_OPCODE_INCREMENT || instruction.opcode == CVIRTUALMACHINE_OPCODE_INCREMENT_BASE;
+			NcsValue* cell = cellAt(base ? _bp : stackPointer(), instruction.operand1, 4);
+			if (!cell)
+				break;
+			if (cell->type != NcsType::Integer)
+			{
+				fail("Type mismatch on the stack: expected I.");
+				break;
+			}
+			cell->intValue = static_cast<int32_t>(static_cast<uint32_t>(cell->intValue) + (increment ? 1u : ~0u));
+			break;
+		}
+
+		case CVIRTUALMACHINE_OPCODE_SAVE_BASE_POINTER:    // SAVEBP: the new frame starts here, old BP saved on top
+		{
+			uint32_t previous = _bp;
+			_bp = stackPointer();
+			pushInteger(static_cast<int32_t>(previous));
+			break;
+		}
+
+		case CVIRTUALMACHINE_OPCODE_RESTORE_BASE_POINTER:    // RESTOREBP
+			_bp = static_cast<uint32_t>(popInteger());
+			break;
+
+		case CVIRTUALMACHINE_OPCODE_STORE_STATE:    // Saved for the action parameter of the next ACTION
+		{
+			int32_t globalsSize = instruction.operand1, localsSize = instruction.operand2;
+			NcsValue* globals = cellAt(_bp, -globalsSize, globalsSize);
+			NcsValue* locals = cellAt(stackPointer(), -localsSize, localsSize);
+			if (!globals || !locals)
+				break;
+			StoredState state;
+			state.address = _ip + aux;
+			state.globals.assign(globals, globals + globalsSize / 4);
+			state.locals.assign(locals, locals + localsSize / 4);
+			_storedStates.push_back(std::move(state));
+			break;
+		}
+
+		case CVIRTUALMACHINE_OPCODE_NO_OPERATION:
+			break;
+
+		default:
+			fail("Unsupported instruction " + std::string(ncsOpcodeInfo(instruction.opcode).mnemonic) + ".");
+		}
+
+		if (_failed)
+			break;
+
+		if (next >= codeSize)
+		{
+			fail("Jump outside of the code.");
+			break;
+		}
+		_ip = next;
+	}
+
+	// Close the frames left open, so inclusive counts stay consistent
+	for (auto frame = _frames.rbegin(); frame != _frames.rend(); ++frame)
+		if (frame->function)
+			frame->function->totalInstructions += _profile.instructions - frame->instructionsAtCall;
+	_frames.clear();
+	return false;
+}
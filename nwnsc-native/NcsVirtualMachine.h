@@ -0,0 +1,215 @@
+/** @file NcsVirtualMachine.h
+ * Reference interpreter for compiled NWScript (NCS) bytecode, with instruction profiling.
+ *
+ * Implements the CVIRTUALMACHINE_OPCODE_* instruction set of the native compiler: a stack
+ * of 4 byte cells addressed in bytes from the stack and base pointers, a separate return
+ * address stack for JSR/RETN, SAVEBP/RESTOREBP for globals and STORE_STATE for action
+ * arguments. Engine functions are dispatched to an NcsActionTable.
+ *
+ * Every executed instruction is counted per opcode (and operand type), per function and,
+ * when NDB symbols are given, per source line.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "NcsActionTable.h"
+
+#define NCS_OBJECT_INVALID 0x7f000000u
+
+namespace NWScriptPlugin
+{
+	class NdbFile;
+}
+
+namespace NWScriptCli
+{
+	using NWScriptPlugin::NdbFile;
+
+	// Type of a stack cell. Values are the CVIRTUALMACHINE_AUXCODE_TYPE_* the instructions use.
+	enum class NcsType : uint8_t
+	{
+		Integer = 0x03,
+		Float = 0x04,
+		String = 0x05,
+		Object = 0x06,
+		EngineStructure0 = 0x10   // + ENGINE_STRUCTURE_n index, up to 9
+	};
+
+	struct NcsValue
+	{
+		NcsType type = NcsType::Integer;
+		union
+		{
+			int32_t intValue = 0;
+			float floatValue;
+			uint32_t objectValue;
+		};
+		std::string text;   // String contents, or engine structure payload (json text...)
+	};
+
+	struct NcsVector
+	{
+		float x = 0.0f, y = 0.0f, z = 0.0f;
+	};
+
+	class NcsVirtualMachine final
+	{
+	public:
+
+		struct Options
+		{
+			uint64_t maxInstructions = 0;           // Per run, deferred actions included. 0 = unlimited
+			uint32_t maxStackBytes = 4 * 1024 * 1024;
+			uint32_t maxCallDepth = 8192;
+			uint32_t maxDeferredActions = 10000;    // Pending DelayCommand and friends; more are dropped
+			bool runDeferredActions = true;
+			bool profile = true;
+			uint32_t objectSelf = 1;                // What OBJECT_SELF evaluates to
+			uint32_t randomSeed = 1;
+		};
+
+		// A snapshot taken by STORE_STATE, consumed by an action parameter.
+		struct StoredState
+		{
+			uint32_t address = 0;
+			std::vector<NcsValue> globals;
+			std::vector<NcsValue> locals;
+		};
+
+		struct FunctionProfile
+		{
+			uint32_t entry = 0;
+			uint64_t calls = 0;
+			uint64_t selfInstructions = 0;
+			uint64_t totalInstructions = 0;   // Including callees
+		};
+
+		struct Profile
+		{
+			uint64_t instructions = 0;
+			uint64_t runs = 0;
+			uint64_t deferredActions = 0;
+			uint64_t deferredActionsDropped = 0;
+			std::vector<uint64_t> opcodeCounts;                        // [opcode * 256 + auxcode]
+			std::unordered_map<uint32_t, FunctionProfile> functions;   // By entry address
+			std::vector<uint64_t> lineCounts;                          // Per NdbFile::lines() entry
+			std::vector<uint64_t> actionCounts;                        // Per action id
+		};
+
+		NcsVirtualMachine(const NcsActionTable& actions, const Options& options);
+
+		// Takes the NCS file contents. Fails on a bad header.
+		bool load(std::vector<uint8_t>&& code, std::string& errorMessage);
+
+		// Optional: function names and per line counts. Must outlive the VM.
+		void setSymbols(const NdbFile* symbols);
+
+		// Runs the script from its loader, then the actions it queued. Returns false if the
+		// script aborted (errorMessage tells why and where). Profile counts accumulate over runs.
+		bool run(std::string& errorMessage);
+
+		// Return value of a StartingConditional script (last run), if it returned one.
+		bool hasConditionResult() const { return _hasConditionResult; }
+		int32_t conditionResult() const { return _conditionResult; }
+
+		const Profile& profile() const { return _profile; }
+		const NcsActionTable& actions() const { return _actions; }
+		const Options& options() const { return _options; }
+		const std::vector<uint8_t>& code() const { return _code; }
+
+		// Name of the function at an entry address ("main+0x1f" for a deferred action,
+		// "sub_0000003d" without symbols).
+		std::string functionName(uint32_t entry) const;
+
+		// Where script output (PrintString...) goes.
+		void setPrinter(std::function<void(std::string_view)> printer) { _printer = std::move(printer); }
+		void print(std::string_view text) const;
+
+		// For action handlers. Pops fail (and abort the script) on underflow or a type mismatch.
+		int32_t popInteger();
+		float popFloat();
+		std::string popString();
+		uint32_t popObject();
+		NcsVector popVector();
+		NcsValue popEngineStructure();
+		void pushInteger(int32_t value);
+		void pushFloat(float value);
+		void pushString(std::string value);
+		void pushObject(uint32_t value);
+		void pushVector(const NcsVector& value);
+		void pushEngineStructure(uint8_t engineStructure, int32_t id = 0, std::string payload = std::string());
+
+		// The state saved for the action argument being passed (consumed).
+		bool takeStoredState(StoredState& state);
+
+		// Runs a stored action after the current script returns, delaySeconds later in game time.
+		void defer(StoredState&& state, float delaySeconds);
+
+		// Deterministic pseudo random number in [0, limit).
+		int32_t random(int32_t limit);
+
+		// Aborts the script with an error.
+		void fail(std::string message);
+		bool failed() const { return _failed; }
+
+	private:
+
+		struct Frame
+		{
+			uint32_t returnAddress;
+			FunctionProfile* function;
+			uint64_t instructionsAtCall;
+		};
+
+		struct DeferredAction
+		{
+			double time;
+			uint64_t sequence;
+			StoredState state;
+		};
+
+		const NcsActionTable& _actions;
+		Options _options;
+		std::vector<uint8_t> _code;
+		const NdbFile* _symbols = nullptr;
+		std::vector<int32_t> _lineAtAddress;
+
+		std::vector<NcsValue> _stack;
+		uint32_t _bp = 0;                 // In bytes, like the stack pointer
+		std::vector<Frame> _frames;
+		std::vector<StoredState> _storedStates;
+		std::vector<DeferredAction> _deferred;
+		double _time = 0.0;
+		uint64_t _deferredSequence = 0;
+		uint64_t _runInstructions = 0;
+		uint32_t _randomState = 1;
+
+		bool _failed = false;
+		std::string _errorMessage;
+		uint32_t _ip = 0;
+
+		bool _hasConditionResult = false;
+		int32_t _conditionResult = 0;
+
+		Profile _profile;
+		std::function<void(std::string_view)> _printer;
+
+		uint32_t stackPointer() const { return static_cast<uint32_t>(_stack.size() * 4); }
+		bool execute(uint32_t entry);
+		FunctionProfile* functionProfile(uint32_t entry);
+		NcsValue* cellAt(uint32_t pointer, int32_t offset, int32_t size);
+		bool pop(NcsValue& value, NcsType type);
+		bool push(NcsValue&& value);
+	};
+}
@@ -0,0 +1,130 @@
+/** @file Report.cpp
+ * JSON serialization of compile results, shared by the batch summary and the compile server,
+ * and of batch telemetry snapshots.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include "Report.h"
+
+using namespace NWScriptCli;
+
+const char* NWScriptCli::statusToString(FileResult::Status status)
+{
+	switch (status)
+	{
+	case FileResult::Status::Success: return "success";
+	case FileResult::Status::Failed: return "error";
+	case FileResult::Status::SkippedInclude: return "include";
+	default: return "notprocessed";
+	}
+}
+
+void NWScriptCli::writeFileResult(JsonWriter& json, const FileResult& result)
+{
+	json.beginObject();
+	json.member("source", result.source.string());
+	json.member("status", statusToString(result.status));
+
+	json.key("timings").beginObject();
+	json.member("totalMs", result.totalMs);
+	json.member("loadMs", result.loadMs);
+	json.member("compileMs", result.compileMs);
+	json.member("writeMs", result.writeMs);
+	json.endObject();
+
+	json.key("outputs").beginArray();
+	for (const std::string& o : result.outputs)
+		json.value(o);
+	json.endArray();
+	json.member("outputsUnchanged", result.outputsUnchanged);
+	json.member("cached", result.cached);
+
+	json.key("includes").beginArray();
+	for (const std::string& inc : result.includes)
+		json.value(inc);
+	json.endArray();
+
+	json.key("diagnostics").beginArray();
+	if (!result.diagnostics.empty())
+	{
+		for (const Diagnostic& d : result.diagnostics)
+		{
+			json.beginObject();
+			json.member("severity", "error");
+			json.member("code", "NSC" + std::to_string(d.code));
+			json.member("file", d.file);
+			json.member("line", d.line);
+			json.member("message", d.message);
+			json.endObject();
+		}
+	}
+	else if (result.status == FileResult::Status::Failed || result.status == FileResult::Status::SkippedInclude)
+	{
+		json.beginObject();
+		json.member("severity", result.status == FileResult::Status::Failed ? "error" : "warning");
+		json.member("code", "NSC" + std::to_string(result.code));
+		json.member("line", result.line);
+		json.member("message", result.message);
+		json.endObject();
+	}
+	json.endArray();
+
+	json.endObject();
+}
+
+static void writeCacheCounters(JsonWriter& json, const std::string& name, const NWScriptPlugin::BatchTelemetry::CacheCounters& counters)
+{
+	json.key(name).beginObject();
+	json.member("hits", counters.hits);
+	json.member("misses", counters.misses);
+	json.member("hitRate", counters.hitRate());
+	json.endObject();
+}
+
+void NWScriptCli::writeTelemetry(JsonWriter& json, const NWScriptPlugin::BatchTelemetry::Snapshot& snapshot)
+{
+	json.beginObject();
+	json.member("elapsedMs", snapshot.elapsedMs);
+	json.member("finished", snapshot.finished);
+
+	json.member("filesQueued", snapshot.filesQueued);
+	json.member("filesStarted", snapshot.filesStarted);
+	json.member("filesDone", snapshot.filesDone);
+	json.member("filesFailed", snapshot.filesFailed);
+	json.member("queueDepth", snapshot.queueDepth);
+
+	json.member("bytesRead", snapshot.bytesRead);
+	json.member("bytesWritten", snapshot.bytesWritten);
+	json.member("filesPerSecond", snapshot.filesPerSecond);
+	json.member("bytesPerSecond", snapshot.bytesPerSecond);
+
+	json.member("workers", snapshot.workers);
+	json.member("workersBusy", snapshot.workersBusy);
+	json.member("workerUtilization", snapshot.workerUtilization);
+
+	writeCacheCounters(json, "includeCache", snapshot.includeCache);
+	writeCacheCounters(json, "resourceCache", snapshot.resourceCache);
+	writeCacheCounters(json, "compileCache", snapshot.compileCache);
+
+	json.key("slowest").beginArray();
+	for (const NWScriptPlugin::BatchTelemetry::FileTimings& file : snapshot.slowest)
+	{
+		json.beginObject();
+		json.member("source", file.path);
+		json.member("failed", file.failed);
+		json.member("bytesRead", file.bytesRead);
+		json.member("bytesWritten", file.bytesWritten);
+		json.key("timings").beginObject();
+		json.member("totalMs", file.totalMs);
+		json.member("loadMs", file.loadMs);
+		json.member("compileMs", file.compileMs);
+		json.member("writeMs", file.writeMs);
+		json.endObject();
+		json.endObject();
+	}
+	json.endArray();
+
+	json.endObject();
+}
@@ -0,0 +1,23 @@
+/** @file Report.h
+ * JSON serialization of compile results, shared by the batch summary and the compile server,
+ * and of batch telemetry snapshots.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include "BatchCompiler.h"
+#include "JsonWriter.h"
+
+namespace NWScriptCli
+{
+	const char* statusToString(FileResult::Status status);
+
+	// Writes one file result as a JSON object (source, status, timings, outputs, includes, diagnostics).
+	void writeFileResult(JsonWriter& json, const FileResult& result);
+
+	// Writes a telemetry snapshot as a JSON object (progress, rates, cache hit rates, slowest files).
+	void writeTelemetry(JsonWriter& json, const NWScriptPlugin::BatchTelemetry::Snapshot& snapshot);
+}
@@ -0,0 +1,714 @@
+/** @file ResourceIndex.cpp
+ * Memory mapped, indexed access to game resource archives (KEY/BIF and ERF/HAK/MOD).
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <chrono>
+#include <fstream>
+
+#include "ResourceIndex.h"
+
+using namespace NWScriptCli;
+
+// Persisted index format
+#define RESOURCEINDEX_MAGIC   "NWRI"
+#define RESOURCEINDEX_VERSION 2
+
+// Archive formats (all little-endian)
+#define KEY_HEADER_SIZE        64
+#define KEY_FILE_ENTRY_SIZE    12
+#define KEY_KEY_ENTRY_SIZE     22
+#define BIF_HEADER_SIZE        20
+#define BIF_VARIABLE_ENTRY_SIZE 16
+#define ERF_HEADER_SIZE        160
+#define ERF_RESOURCE_ENTRY_SIZE 8
+
+static_assert(sizeof(ResourceIndex::Entry) == 28, "Index entries are persisted as raw records");
+
+template <typename T>
+static T readLE(const uint8_t* p)
+{
+	T value;
+	std::memcpy(&value, p, sizeof(T));
+	return value;
+}
+
+// Copies a ResRef into the fixed, lowercase, zero padded index representation.
+// Returns false if it doesn't fit.
+static bool normalizeResRef(std::string_view resRef, char (&out)[RESOURCEINDEX_RESREF_LENGTH])
+{
+	size_t length = resRef.size();
+	while (length > 0 && resRef[length - 1] == '\0')
+		length--;
+	if (length > RESOURCEINDEX_RESREF_LENGTH)
+		return false;
+
+	std::memset(out, 0, sizeof(out));
+	for (size_t i = 0; i < length && resRef[i] != '\0'; i++)
+		out[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(resRef[i])));
+	return true;
+}
+
+static bool entryLess(const ResourceIndex::Entry& a, const ResourceIndex::Entry& b)
+{
+	int cmp = std::memcmp(a.resRef, b.resRef, RESOURCEINDEX_RESREF_LENGTH);
+	return cmp < 0 || (cmp == 0 && a.resType < b.resType);
+}
+
+// KEY files store Windows style relative paths ("data\\xp1.bif"). Retail installs
+// copied from Windows may also differ in case, so fall back to a case insensitive match.
+static fs::path resolveArchivePath(const fs::path& installDir, const fs::path& keyDir, std::string name)
+{
+	std::replace(name.begin(), name.end(), '\\', '/');
+
+	std::error_code ec;
+	for (const fs::path& base : { installDir, keyDir })
+	{
+		fs::path candidate = base / name;
+		if (fs::is_regular_file(candidate, ec))
+			return candidate;
+
+		// Case insensitive lookup of each component
+		fs::path resolved = base;
+		bool found = true;
+		for (const fs::path& part : fs::path(name))
+		{
+			bool partFound = false;
+			for (auto it = fs::directory_iterator(resolved, ec); !ec && it != fs::directory_iterator(); it.increment(ec))
+			{
+				std::string a = it->path().filename().string();
+				std::string b = part.string();
+				if (a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(),
+					[](char x, char y) { return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y)); }))
+				{
+					resolved /= a;
+					partFound = true;
+					break;
+				}
+			}
+			if (!partFound)
+			{
+				found = false;
+				break;
+			}
+		}
+
+		if (found && fs::is_regular_file(resolved, ec))
+			return resolved;
+	}
+
+	return installDir / name;
+}
+
+bool ResourceIndex::FileStamp::read()
+{
+	std::error_code ec;
+	size = fs::file_size(path, ec);
+	if (ec)
+		return false;
+
+	fs::file_time_type time = fs::last_write_time(path, ec);
+	if (ec)
+		return false;
+
+	mtime = static_cast<int64_t>(time.time_since_epoch().count());
+	return true;
+}
+
+ResourceIndex::ResourceIndex() = default;
+
+ResourceIndex::~ResourceIndex()
+{
+	if (_builder.joinable())
+		_builder.join();
+}
+
+void ResourceIndex::addKeyFile(const fs::path& keyFile, const fs::path& installDir)
+{
+	_sources.push_back({ Source::Type::Key, fs::absolute(keyFile).lexically_normal(), fs::absolute(installDir).lexically_normal() });
+}
+
+void ResourceIndex::addErf(const fs::path& erfFile)
+{
+	_sources.push_back({ Source::Type::Erf, fs::absolute(erfFile).lexically_normal(), fs::path() });
+}
+
+uint16_t ResourceIndex::addArchive(const fs::path& path, bool isBif)
+{
+	std::string key = path.lexically_normal().string();
+
+	std::lock_guard<std::mutex> guard(_archiveLock);
+	for (size_t i = 0; i < _archives.size(); i++)
+	{
+		if (_archives[i]->path == key)
+			return static_cast<uint16_t>(i);
+	}
+
+	auto archive = std::make_unique<Archive>();
+	archive->path = key;
+	archive->isBif = isBif;
+	_archives.push_back(std::move(archive));
+	return static_cast<uint16_t>(_archives.size() - 1);
+}
+
+ResourceIndex::Archive* ResourceIndex::archiveAt(uint16_t archive) const
+{
+	std::lock_guard<std::mutex> guard(_archiveLock);
+	return archive < _archives.size() ? _archives[archive].get() : nullptr;
+}
+
+ResourceIndex::Archive* ResourceIndex::mapArchive(uint16_t archive) const
+{
+	Archive* a = archiveAt(archive);
+	if (!a)
+		return nullptr;
+
+	std::call_once(a->mapOnce, [a]() {
+		if (!a->map.open(a->path))
+			return;
+
+		if (a->isBif)
+		{
+			// Only the BIF's resource table is needed: resources are located through it.
+			if (a->map.size() < BIF_HEADER_SIZE || std::memcmp(a->map.data(), "BIFF", 4) != 0)
+				return;
+			a->variableCount = readLE<uint32_t>(a->map.data() + 8);
+			a->variableTableOffset = readLE<uint32_t>(a->map.data() + 16);
+			if (static_cast<uint64_t>(a->variableTableOffset) + static_cast<uint64_t>(a->variableCount) * BIF_VARIABLE_ENTRY_SIZE > a->map.size())
+				return;
+		}
+
+		a->mapped = true;
+	});
+
+	return a->mapped ? a : nullptr;
+}
+
+void ResourceIndex::buildAsync(const fs::path& persistFile)
+{
+	if (_builder.joinable())
+		_builder.join();
+
+	{
+		std::lock_guard<std::mutex> guard(_archiveLock);
+		_archives.clear();
+	}
+
+	_sourceIndexes.clear();
+	_sourceIndexes.resize(_sources.size());
+	_loadedFromDisk = false;
+	_buildMs = 0;
+	_complete = false;
+
+	_builder = std::thread(&ResourceIndex::run, this, persistFile);
+}
+
+bool ResourceIndex::wait(std::string& errorMessage)
+{
+	waitForCompletion();
+	if (_builder.joinable())
+		_builder.join();
+
+	errorMessage = this->errorMessage();
+	return errorMessage.empty();
+}
+
+bool ResourceIndex::isComplete() const
+{
+	std::lock_guard<std::mutex> guard(_stateLock);
+	return _complete;
+}
+
+std::string ResourceIndex::errorMessage() const
+{
+	std::lock_guard<std::mutex> guard(_stateLock);
+	for (const SourceIndex& source : _sourceIndexes)
+	{
+		if (source.ready && !source.error.empty())
+			return source.error;
+	}
+	return std::string();
+}
+
+bool ResourceIndex::build(std::string& errorMessage, const fs::path& persistFile)
+{
+	buildAsync(persistFile);
+	return wait(errorMessage);
+}
+
+void ResourceIndex::run(fs::path persistFile)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	bool stampsRead = true;
+	for (size_t i = 0; i < _sources.size(); i++)
+	{
+		_sourceIndexes[i].stamp.path = _sources[i].path.string();
+		stampsRead = _sourceIndexes[i].stamp.read() && stampsRead;
+	}
+
+	bool loaded = stampsRead && !persistFile.empty() && load(persistFile);
+
+	if (!loaded)
+	{
+		// One thread per source: there are only a handful (a KEY chain plus some HAKs),
+		// and each publishes its table as soon as it is done, unblocking lookups early.
+		std::vector<std::thread> workers;
+		for (size_t i = 0; i < _sources.size(); i++)
+		{
+			workers.emplace_back([this, i]() {
+				const Source& source = _sources[i];
+				std::vector<Entry> entries;
+				std::string errorMessage;
+
+				bool success = source.type == Source::Type::Key ?
+					indexKeyFile(source, entries, errorMessage) : indexErf(source, entries, errorMessage);
+				if (success)
+					sortAndDeduplicate(entries);
+				else
+					entries.clear();
+
+				publish(i, std::move(entries), std::move(errorMessage));
+			});
+		}
+
+		for (std::thread& worker : workers)
+			worker.join();
+
+		bool failed = std::any_of(_sourceIndexes.begin(), _sourceIndexes.end(),
+			[](const SourceIndex& source) { return !source.error.empty(); });
+		if (!persistFile.empty() && !failed)
+			save(persistFile);
+	}
+
+	std::lock_guard<std::mutex> guard(_stateLock);
+	_loadedFromDisk = loaded;
+	_buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	_complete = true;
+	_stateChanged.notify_all();
+}
+
+void ResourceIndex::publish(size_t source, std::vector<Entry>&& entries, std::string&& error)
+{
+	std::lock_guard<std::mutex> guard(_stateLock);
+	_sourceIndexes[source].entries = std::move(entries);
+	_sourceIndexes[source].error = std::move(error);
+	_sourceIndexes[source].ready = true;
+	_stateChanged.notify_all();
+}
+
+void ResourceIndex::waitForSource(size_t source) const
+{
+	std::unique_lock<std::mutex> guard(_stateLock);
+	_stateChanged.wait(guard, [this, source]() { return _sourceIndexes[source].ready; });
+}
+
+void ResourceIndex::waitForCompletion() const
+{
+	std::unique_lock<std::mutex> guard(_stateLock);
+	_stateChanged.wait(guard, [this]() { return _complete; });
+}
+
+bool ResourceIndex::loadedFromDisk() const
+{
+	waitForCompletion();
+	std::lock_guard<std::mutex> guard(_stateLock);
+	return _loadedFromDisk;
+}
+
+double ResourceIndex::buildMs() const
+{
+	waitForCompletion();
+	std::lock_guard<std::mutex> guard(_stateLock);
+	return _buildMs;
+}
+
+size_t ResourceIndex::size() const
+{
+	std::lock_guard<std::mutex> guard(_stateLock);
+	size_t count = 0;
+	for (const SourceIndex& source : _sourceIndexes)
+	{
+		if (source.ready)
+			count += source.entries.size();
+	}
+	return count;
+}
+
+size_t ResourceIndex::archiveCount() const
+{
+	std::lock_guard<std::mutex> guard(_archiveLock);
+	return _archives.size();
+}
+
+bool ResourceIndex::indexKeyFile(const Source& source, std::vector<Entry>& entries, std::string& errorMessage)
+{
+	MappedFile key;
+	if (!key.open(source.path) || key.size() < KEY_HEADER_SIZE)
+	{
+		errorMessage = "Unable to read KEY file: " + source.path.string();
+		return false;
+	}
+
+	const uint8_t* data = key.data();
+	if (std::memcmp(data, "KEY ", 4) != 0 || std::memcmp(data + 4, "V1  ", 4) != 0)
+	{
+		errorMessage = "Not a KEY V1 file: " + source.path.string();
+		return false;
+	}
+
+	uint32_t bifCount = readLE<uint32_t>(data + 8);
+	uint32_t keyCount = readLE<uint32_t>(data + 12);
+	uint32_t fileTableOffset = readLE<uint32_t>(data + 16);
+	uint32_t keyTableOffset = readLE<uint32_t>(data + 20);
+
+	if (static_cast<uint64_t>(fileTableOffset) + static_cast<uint64_t>(bifCount) * KEY_FILE_ENTRY_SIZE > key.size() ||
+		static_cast<uint64_t>(keyTableOffset) + static_cast<uint64_t>(keyCount) * KEY_KEY_ENTRY_SIZE > key.size())
+	{
+		errorMessage = "Corrupted KEY file: " + source.path.string();
+		return false;
+	}
+
+	// BIFs are only registered here. They are mapped (and their resource tables read)
+	// the first time one of their resources is requested.
+	std::vector<uint16_t> bifArchives(bifCount);
+	fs::path keyDir = source.path.parent_path();
+
+	for (uint32_t i = 0; i < bifCount; i++)
+	{
+		const uint8_t* fileEntry = data + fileTableOffset + i * KEY_FILE_ENTRY_SIZE;
+		uint32_t nameOffset = readLE<uint32_t>(fileEntry + 4);
+		uint16_t nameSize = readLE<uint16_t>(fileEntry + 8);
+		std::string_view name = key.view(nameOffset, nameSize);
+		while (!name.empty() && name.back() == '\0')
+			name.remove_suffix(1);
+
+		bifArchives[i] = addArchive(resolveArchivePath(source.installDir, keyDir, std::string(name)), true);
+	}
+
+	entries.reserve(entries.size() + keyCount);
+	for (uint32_t i = 0; i < keyCount; i++)
+	{
+		const uint8_t* keyEntry = data + keyTableOffset + i * KEY_KEY_ENTRY_SIZE;
+		uint32_t resId = readLE<uint32_t>(keyEntry + 18);
+		uint32_t bifIndex = resId >> 20;
+		if (bifIndex >= bifCount)
+			continue;
+
+		Entry entry;
+		if (!normalizeResRef(std::string_view(reinterpret_cast<const char*>(keyEntry), RESOURCEINDEX_RESREF_LENGTH), entry.resRef))
+			continue;
+		entry.resType = readLE<uint16_t>(keyEntry + 16);
+		entry.archive = bifArchives[bifIndex];
+		entry.offset = resId & 0xFFFFF;
+		entry.size = 0;
+		entries.push_back(entry);
+	}
+
+	return true;
+}
+
+bool ResourceIndex::indexErf(const Source& source, std::vector<Entry>& entries, std::string& errorMessage)
+{
+	uint16_t archive = addArchive(source.path, false);
+	const Archive* erfArchive = mapArchive(archive);
+	if (!erfArchive || erfArchive->map.size() < ERF_HEADER_SIZE)
+	{
+		errorMessage = "Unable to read ERF file: " + source.path.string();
+		return false;
+	}
+
+	const MappedFile& erf = erfArchive->map;
+	const uint8_t* data = erf.data();
+	size_t resRefLength;
+	if (std::memcmp(data + 4, "V1.0", 4) == 0)
+		resRefLength = 16;
+	else if (std::memcmp(data + 4, "V1.1", 4) == 0)
+		resRefLength = 32;
+	else
+	{
+		errorMessage = "Unsupported ERF version: " + source.path.string();
+		return false;
+	}
+
+	const size_t keyEntrySize = resRefLength + 8;
+	uint32_t entryCount = readLE<uint32_t>(data + 16);
+	uint32_t keyListOffset = readLE<uint32_t>(data + 24);
+	uint32_t resourceListOffset = readLE<uint32_t>(data + 28);
+
+	if (static_cast<uint64_t>(keyListOffset) + static_cast<uint64_t>(entryCount) * keyEntrySize > erf.size() ||
+		static_cast<uint64_t>(resourceListOffset) + static_cast<uint64_t>(entryCount) * ERF_RESOURCE_ENTRY_SIZE > erf.size())
+	{
+		errorMessage = "Corrupted ERF file: " + source.path.string();
+		return false;
+	}
+
+	entries.reserve(entries.size() + entryCount);
+	for (uint32_t i = 0; i < entryCount; i++)
+	{
+		const uint8_t* keyEntry = data + keyListOffset + i * keyEntrySize;
+		uint32_t resId = readLE<uint32_t>(keyEntry + resRefLength);
+		uint16_t resType = readLE<uint16_t>(keyEntry + resRefLength + 4);
+		if (resId >= entryCount)
+			continue;
+
+		const uint8_t* resEntry = data + resourceListOffset + resId * ERF_RESOURCE_ENTRY_SIZE;
+
+		Entry entry;
+		if (!normalizeResRef(std::string_view(reinterpret_cast<const char*>(keyEntry), resRefLength), entry.resRef))
+			continue;
+		entry.resType = resType;
+		entry.archive = archive;
+		entry.offset = readLE<uint32_t>(resEntry);
+		entry.size = readLE<uint32_t>(resEntry + 4);
+		entries.push_back(entry);
+	}
+
+	return true;
+}
+
+void ResourceIndex::sortAndDeduplicate(std::vector<Entry>& entries)
+{
+	// Within a source the first occurrence wins: a stable sort keeps it first.
+	std::stable_sort(entries.begin(), entries.end(), entryLess);
+	auto last = std::unique(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+		return !entryLess(a, b) && !entryLess(b, a);
+	});
+	entries.erase(last, entries.end());
+	entries.shrink_to_fit();
+}
+
+bool ResourceIndex::find(std::string_view resRef, uint16_t resType, Entry& entry) const
+{
+	Entry key = {};
+	if (!normalizeResRef(resRef, key.resRef))
+		return false;
+	key.resType = resType;
+
+	// Sources in priority order; each one is only waited for when we get to it.
+	for (size_t i = 0; i < _sourceIndexes.size(); i++)
+	{
+		waitForSource(i);
+
+		const std::vector<Entry>& entries = _sourceIndexes[i].entries;
+		auto it = std::lower_bound(entries.begin(), entries.end(), key, entryLess);
+		if (it == entries.end() || entryLess(key, *it))
+			continue;
+
+		Entry found = *it;
+		const Archive* archive = mapArchive(found.archive);
+		if (!archive)
+			continue;
+
+		if (archive->isBif)
+		{
+			if (found.offset >= archive->variableCount)
+				continue;
+
+			const uint8_t* varEntry = archive->map.data() + archive->variableTableOffset + found.offset * BIF_VARIABLE_ENTRY_SIZE;
+			found.offset = readLE<uint32_t>(varEntry + 4);
+			found.size = readLE<uint32_t>(varEntry + 8);
+		}
+
+		entry = found;
+		return true;
+	}
+
+	return false;
+}
+
+std::string_view ResourceIndex::view(const Entry& entry) const
+{
+	const Archive* archive = mapArchive(entry.archive);
+	if (!archive)
+		return std::string_view();
+
+	return archive->map.view(entry.offset, entry.size);
+}
+
+bool ResourceIndex::lookup(std::string_view resRef, uint16_t resType, std::string_view& contents) const
+{
+	Entry entry;
+	if (!find(resRef, resType, entry))
+		return false;
+
+	contents = view(entry);
+	return contents.size() == entry.size;
+}
+
+std::string ResourceIndex::archivePath(uint16_t archive) const
+{
+	const Archive* a = archiveAt(archive);
+	return a ? a->path : std::string();
+}
+
+uint16_t ResourceIndex::resourceTypeFromExtension(std::string_view extension)
+{
+	// Only the resource types scripts and tools deal with
+	static const struct { const char* extension; uint16_t type; } types[] = {
+		{ "2da", 2017 }, { "nss", 2009 }, { "ncs", 2010 }, { "ndb", 2064 },
+		{ "ini", 2016 }, { "txt", 10 }, { "set", 2013 }, { "are", 2012 },
+		{ "ifo", 2014 }, { "git", 2023 }, { "utc", 2027 }, { "dlg", 2029 }
+	};
+
+	for (const auto& t : types)
+	{
+		if (extension.size() == std::strlen(t.extension) &&
+			std::equal(extension.begin(), extension.end(), t.extension,
+				[](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; }))
+			return t.type;
+	}
+	return 0;
+}
+
+// Persisted format:
+
+// Persisted format:
+//   char magic[4]; uint32 version; uint32 sourceCount; uint32 archiveCount;
+//   sourceCount x stamp; archiveCount x (string path; uint8 isBif);
+//   sourceCount x (uint32 entryCount; entryCount x Entry)
+// with string = uint32 length; char data[length] and stamp = string path; uint64 size; int64 mtime.
+// BIF entries don't depend on the BIF contents (see Entry), so only the sources are stamped.
+
+static void writeString(std::ofstream& out, const std::string& value)
+{
+	uint32_t length = static_cast<uint32_t>(value.size());
+	out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+	out.write(value.data(), length);
+}
+
+static bool readString(std::ifstream& in, std::string& value)
+{
+	uint32_t length = 0;
+	if (!in.read(reinterpret_cast<char*>(&length), sizeof(length)) || length > 4096)
+		return false;
+
+	value.resize(length);
+	return static_cast<bool>(in.read(value.data(), length));
+}
+
+template <typename T>
+static void writeValue(std::ofstream& out, T value)
+{
+	out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static bool readValue(std::ifstream& in, T& value)
+{
+	return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+bool ResourceIndex::save(const fs::path& file) const
+{
+	// Write to a temporary file first, so concurrent readers never see a partial index.
+	fs::path temp = file;
+	temp += ".tmp";
+
+	{
+		std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+		if (!out)
+			return false;
+
+		std::lock_guard<std::mutex> guard(_archiveLock);
+
+		out.write(RESOURCEINDEX_MAGIC, 4);
+		writeValue<uint32_t>(out, RESOURCEINDEX_VERSION);
+		writeValue<uint32_t>(out, static_cast<uint32_t>(_sourceIndexes.size()));
+		writeValue<uint32_t>(out, static_cast<uint32_t>(_archives.size()));
+
+		for (const SourceIndex& source : _sourceIndexes)
+		{
+			writeString(out, source.stamp.path);
+			writeValue(out, source.stamp.size);
+			writeValue(out, source.stamp.mtime);
+		}
+
+		for (const auto& archive : _archives)
+		{
+			writeString(out, archive->path);
+			writeValue<uint8_t>(out, archive->isBif ? 1 : 0);
+		}
+
+		for (const SourceIndex& source : _sourceIndexes)
+		{
+			writeValue<uint32_t>(out, static_cast<uint32_t>(source.entries.size()));
+			out.write(reinterpret_cast<const char*>(source.entries.data()), static_cast<std::streamsize>(source.entries.size() * sizeof(Entry)));
+		}
+
+		if (!out)
+			return false;
+	}
+
+	std::error_code ec;
+	fs::rename(temp, file, ec);
+	return !ec;
+}
+
+bool ResourceIndex::load(const fs::path& file)
+{
+	std::ifstream in(file, std::ios::binary);
+	if (!in)
+		return false;
+
+	char magic[4];
+	uint32_t version = 0, sourceCount = 0, archiveCount = 0;
+	if (!in.read(magic, 4) || std::memcmp(magic, RESOURCEINDEX_MAGIC, 4) != 0 ||
+		!readValue(in, version) || version != RESOURCEINDEX_VERSION ||
+		!readValue(in, sourceCount) || !readValue(in, archiveCount))
+		return false;
+
+	// Must have been built from exactly the same, unchanged, sources
+	if (sourceCount != _sourceIndexes.size())
+		return false;
+	for (const SourceIndex& expected : _sourceIndexes)
+	{
+		FileStamp stamp;
+		if (!readString(in, stamp.path) || !readValue(in, stamp.size) || !readValue(in, stamp.mtime) || !(stamp == expected.stamp))
+			return false;
+	}
+
+	std::vector<std::unique_ptr<Archive>> archives;
+	for (uint32_t i = 0; i < archiveCount; i++)
+	{
+		auto archive = std::make_unique<Archive>();
+		uint8_t isBif = 0;
+		if (!readString(in, archive->path) || !readValue(in, isBif))
+			return false;
+		archive->isBif = isBif != 0;
+		archives.push_back(std::move(archive));
+	}
+
+	std::vector<std::vector<Entry>> tables(sourceCount);
+	for (std::vector<Entry>& entries : tables)
+	{
+		uint32_t entryCount = 0;
+		if (!readValue(in, entryCount) || entryCount > (1u << 24))
+			return false;
+
+		entries.resize(entryCount);
+		if (!in.read(reinterpret_cast<char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(Entry))))
+			return false;
+
+		for (const Entry& entry : entries)
+		{
+			if (entry.archive >= archives.size())
+				return false;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(_archiveLock);
+		_archives = std::move(archives);
+	}
+
+	for (size_t i = 0; i < tables.size(); i++)
+		publish(i, std::move(tables[i]), std::string());
+
+	return true;
+}
@@ -0,0 +1,179 @@
+/** @file ResourceIndex.h
+ * Memory mapped, indexed access to game resource archives (KEY/BIF and ERF/HAK/MOD).
+ *
+ * Every source (KEY or ERF file) is indexed into a compact table sorted by (ResRef, ResType),
+ * which maps each resource to (archive, offset, size). Sources are indexed in parallel on
+ * background threads, and a lookup only waits for the sources it has to search. BIF resource
+ * tables are only read when a resource inside that BIF is first requested.
+ *
+ * The tables can be persisted to disk and are reused while the sources don't change.
+ * Resource contents are handed out as zero-copy views into the mapped archive files.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "MappedFile.h"
+
+namespace fs = std::filesystem;
+
+#define RESOURCEINDEX_RESREF_LENGTH 16
+
+namespace NWScriptCli
+{
+	class ResourceIndex final
+	{
+	public:
+
+		// 28 bytes per resource. ResRef is lowercase and zero padded.
+		// Inside the index, BIF resources hold their slot in the BIF's resource table
+		// in offset (and 0 in size): find() resolves both from the mapped BIF.
+		struct Entry
+		{
+			char resRef[RESOURCEINDEX_RESREF_LENGTH];
+			uint16_t resType;
+			uint16_t archive;
+			uint32_t offset;
+			uint32_t size;
+		};
+
+		ResourceIndex();
+		~ResourceIndex();
+
+		ResourceIndex(const ResourceIndex&) = delete;
+		ResourceIndex& operator=(const ResourceIndex&) = delete;
+
+		// Registers sources. When the same resource exists in more than one source,
+		// the source registered first wins (register overrides before base game files).
+		// BIF file names inside a KEY are resolved relative to installDir.
+		void addKeyFile(const fs::path& keyFile, const fs::path& installDir);
+		void addErf(const fs::path& erfFile);
+
+		// Starts indexing every registered source in the background and returns immediately.
+		// When persistFile is given, a persisted index is reused if it was built from the same,
+		// unchanged, sources; otherwise the new index is saved there once complete.
+		void buildAsync(const fs::path& persistFile = fs::path());
+
+		// Waits for background indexing to finish. Returns false if any source could not be indexed.
+		bool wait(std::string& errorMessage);
+
+		// Non-blocking progress checks. errorMessage() returns the first failure so far, if any.
+		bool isComplete() const;
+		std::string errorMessage() const;
+
+		// buildAsync() + wait()
+		bool build(std::string& errorMessage, const fs::path& persistFile = fs::path());
+
+		// True if the index was read back from a persisted file. Waits for indexing.
+		bool loadedFromDisk() const;
+
+		// Milliseconds spent indexing (or loading the persisted index). Waits for indexing.
+		double buildMs() const;
+
+		// Finds a resource. resRef is case insensitive. Blocks until every source
+		// with a higher priority than the one holding the resource is indexed.
+		bool find(std::string_view resRef, uint16_t resType, Entry& entry) const;
+
+		// Zero-copy view of a resource's contents (an entry returned by find()). Valid while
+		// the index lives. Returns an empty view if the archive can't be mapped or the
+		// entry is out of bounds.
+		std::string_view view(const Entry& entry) const;
+
+		// find() + view(). Returns false if the resource doesn't exist.
+		bool lookup(std::string_view resRef, uint16_t resType, std::string_view& contents) const;
+
+		std::string archivePath(uint16_t archive) const;
+
+		// Number of resources indexed so far (duplicates across sources included).
+		size_t size() const;
+
+		size_t archiveCount() const;
+
+		// Maps a file extension ("nss") to its resource type. Returns 0 if unknown.
+		static uint16_t resourceTypeFromExtension(std::string_view extension);
+
+	private:
+
+		struct Source
+		{
+			enum class Type : uint8_t { Key, Erf };
+			Type type;
+			fs::path path;
+			fs::path installDir;
+		};
+
+		struct FileStamp
+		{
+			std::string path;
+			uint64_t size = 0;
+			int64_t mtime = 0;
+
+			bool read();
+			bool operator==(const FileStamp& other) const {
+				return path == other.path && size == other.size && mtime == other.mtime;
+			}
+		};
+
+		// Resources of one source, sorted. Immutable once ready.
+		struct SourceIndex
+		{
+			FileStamp stamp;
+			std::vector<Entry> entries;
+			std::string error;
+			bool ready = false;
+		};
+
+		// A data file resources point into (BIF or ERF), mapped on first access
+		struct Archive
+		{
+			std::string path;
+			bool isBif = false;
+			MappedFile map;
+			std::once_flag mapOnce;
+			bool mapped = false;
+			uint32_t variableCount = 0;        // BIF resource table
+			uint32_t variableTableOffset = 0;
+		};
+
+		std::vector<Source> _sources;
+		std::vector<SourceIndex> _sourceIndexes;
+		bool _loadedFromDisk = false;
+		double _buildMs = 0;
+		bool _complete = true;
+		mutable std::mutex _stateLock;
+		mutable std::condition_variable _stateChanged;
+		std::thread _builder;
+
+		// Archives are appended concurrently by the indexing threads; elements never move.
+		std::vector<std::unique_ptr<Archive>> _archives;
+		mutable std::mutex _archiveLock;
+
+		void run(fs::path persistFile);
+		void publish(size_t source, std::vector<Entry>&& entries, std::string&& error);
+		void waitForSource(size_t source) const;
+		void waitForCompletion() const;
+
+		Archive* archiveAt(uint16_t archive) const;
+		Archive* mapArchive(uint16_t archive) const;
+		uint16_t addArchive(const fs::path& path, bool isBif);
+
+		bool indexKeyFile(const Source& source, std::vector<Entry>& entries, std::string& errorMessage);
+		bool indexErf(const Source& source, std::vector<Entry>& entries, std::string& errorMessage);
+		static void sortAndDeduplicate(std::vector<Entry>& entries);
+
+		bool save(const fs::path& file) const;
+		bool load(const fs::path& file);
+	};
+}
@@ -0,0 +1,93 @@
+/** @file ScriptDependencies.cpp
+ * Include dependency scanning and include expansion ("preprocessing") for NWScript sources.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <algorithm>
+#include <unordered_set>
+
+#include "ScriptDependencies.h"
+
+using namespace NWScriptCli;
+
+// Same limit as CSCRIPTCOMPILER_MAX_INCLUDE_LEVELS
+#define MAX_INCLUDE_LEVELS 16
+
+namespace
+{
+	struct IncludeWalker
+	{
+		IncludeCache& cache;
+		fs::path scriptDir;
+		DependencyList& dependencies;
+		std::string* output;
+		std::unordered_set<std::string> visited;
+		std::unordered_set<std::string> missing;
+
+		void walk(const IncludeCache::Entry& file, int level)
+		{
+			std::vector<IncludeDirective> directives = scanIncludeDirectives(file.contents);
+			size_t copied = 0;
+
+			for (const IncludeDirective& directive : directives)
+			{
+				if (output)
+					output->append(file.contents, copied, directive.begin - copied);
+				copied = directive.end;
+
+				IncludeCache::EntryPtr include = cache.resolve(directive.name, "nss", scriptDir);
+				if (!include)
+				{
+					if (missing.insert(directive.name).second)
+						dependencies.missing.push_back(directive.name);
+					if (output)
+						output->append("// #include \"" + directive.name + "\" (not found)");
+					continue;
+				}
+
+				if (!visited.insert(include->path).second || level + 1 >= MAX_INCLUDE_LEVELS)
+				{
+					if (output)
+						output->append("// #include \"" + directive.name + "\" (already included)");
+					continue;
+				}
+
+				dependencies.includes.push_back(include->path);
+
+				if (output)
+					output->append("// ---- begin include: " + include->path + "\n");
+				walk(*include, level + 1);
+				if (output)
+					output->append("\n// ---- end include: " + include->path);
+			}
+
+			if (output)
+				output->append(file.contents, copied, std::string::npos);
+		}
+	};
+}
+
+static bool walkScript(IncludeCache& cache, const fs::path& script, std::string* output, DependencyList& dependencies)
+{
+	IncludeCache::EntryPtr entry = cache.load(script);
+	if (!entry)
+		return false;
+
+	IncludeWalker walker{ cache, script.parent_path(), dependencies, output, {}, {} };
+	walker.visited.insert(entry->path);
+	walker.walk(*entry, 0);
+	return true;
+}
+
+bool NWScriptCli::collectDependencies(IncludeCache& cache, const fs::path& script, DependencyList& dependencies)
+{
+	return walkScript(cache, script, nullptr, dependencies);
+}
+
+bool NWScriptCli::expandIncludes(IncludeCache& cache, const fs::path& script, std::string& output, DependencyList& dependencies)
+{
+	output.clear();
+	return walkScript(cache, script, &output, dependencies);
+}
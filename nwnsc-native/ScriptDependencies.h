@@ -0,0 +1,38 @@
+/** @file ScriptDependencies.h
+ * Include dependency scanning and include expansion ("preprocessing") for NWScript sources.
+ * The native compiler has no separate preprocessor pass; this mirrors how it resolves
+ * #include directives through the same IncludeCache.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "IncludeCache.h"
+#include "IncludeDirectives.h"
+
+namespace NWScriptCli
+{
+	// The directive scanner is shared with the plugin
+	using NWScriptPlugin::IncludeDirective;
+	using NWScriptPlugin::scanIncludeDirectives;
+
+	struct DependencyList
+	{
+		std::vector<std::string> includes;   // Resolved include paths, depth-first, no duplicates
+		std::vector<std::string> missing;    // Include names that could not be resolved
+	};
+
+	// Collects the transitive include closure of a script. Includes are resolved like the
+	// compiler does: script directory first, then the search paths.
+	// Returns false if the script itself can't be read.
+	bool collectDependencies(IncludeCache& cache, const fs::path& script, DependencyList& dependencies);
+
+	// Produces the script text with every include expanded in place (each file once).
+	// Returns false if the script itself can't be read.
+	bool expandIncludes(IncludeCache& cache, const fs::path& script, std::string& output, DependencyList& dependencies);
+}
@@ -0,0 +1,686 @@
+/** @file main.cpp
+ * nwnsc-native: headless NWScript batch compiler for Linux, driving the native
+ * (Beamdog) CScriptCompiler directly.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BatchCompiler.h"
+#include "BatchDisassembler.h"
+#include "CompileCache.h"
+#include "CompileServer.h"
+#include "IncludeCache.h"
+#include "InputCollector.h"
+#include "JsonWriter.h"
+#include "Report.h"
+#include "ResourceIndex.h"
+
+using namespace NWScriptCli;
+
+#define NWNSC_NATIVE_VERSION "1.0"
+
+#define EXIT_CODE_SUCCESS       0
+#define EXIT_CODE_COMPILE_ERROR 1
+#define EXIT_CODE_USAGE_ERROR   2
+
+struct CommandLine
+{
+	CompilerSettings settings;
+	std::vector<std::string> includePaths;
+	std::vector<std::string> inputs;
+	std::vector<std::string> erfFiles;
+	std::string installDir;
+	std::string indexCacheFile;
+	std::string compileCacheDir;
+	uint64_t compileCacheMaxMB = 512;
+	std::string summaryFile;
+	std::string telemetryFile;
+	int telemetryIntervalMs = 1000;
+	std::string socketPath;
+	bool server = false;
+	bool disassemble = false;
+	bool addresses = true;
+	bool recurse = false;
+	bool quiet = false;
+	bool help = false;
+};
+
+static void printUsage()
+{
+	std::printf(
+		"nwnsc-native " NWNSC_NATIVE_VERSION " - NWScript batch compiler (native compiler engine)\n"
+		"\n"
+		"Usage: nwnsc-native [options] <inputs...>\n"
+		"\n"
+		"Inputs may be script files, directories, glob patterns (quote them: \"dir/*.nss\")\n"
+		"or @responsefile (one argument per line; options are accepted too).\n"
+		"\n"
+		"Options:\n"
+		"  -i, --include <paths>    Include search paths, separated by ';' or ':' (repeatable).\n"
+		"                           The directory of each script is always searched first.\n"
+		"  -n, --install <dir>      Game install directory: includes not found on the search paths\n"
+		"                           are read from the game's KEY/BIF archives.\n"
+		"  -E, --erf <file>         Also read includes from an ERF/HAK/MOD archive (repeatable;\n"
+		"                           searched in order, before the game archives).\n"
+		"      --index-cache <file> Persist the archive index there, reusing it while unchanged.\n"
+		"  -b, --output <dir>       Output directory (default: next to each source file).\n"
+		"  -c, --compile-cache <dir>\n"
+		"                           Reuse the outputs of scripts compiled before, when neither they, their\n"
+		"                           includes, nwscript.nss, the settings nor the compiler changed. The\n"
+		"                           directory can be shared between checkouts, branches and machines.\n"
+		"      --compile-cache-size <MB>\n"
+		"                           Size of the compile cache, least recently used entries going first\n"
+		"                           (default: 512).\n"
+		"  -j, --jobs <n>           Number of worker threads (default: hardware threads).\n"
+		"  -r, --recurse            Recurse into subdirectories of directory inputs.\n"
+		"  -o, --optimize           Optimize the compiled output.\n"
+		"  -g, --symbols            Generate .ndb debug symbols (disables optimizations).\n"
+		"  -e, --stop-on-error      Stop the batch after the first failed script.\n"
+		"  -m, --max-errors <n>     Go on past errors in a script, reporting up to n of them\n"
+		"                           (default: stop at the first one).\n"
+		"      --no-precompiled-includes\n"
+		"                           Parse every include for every script, instead of reusing the\n"
+		"                           parse of includes shared with scripts compiled before.\n"
+		"  -s, --summary <file>     Write a JSON summary of timings and diagnostics ('-' = stdout).\n"
+		"  -t, --telemetry <file>   Write batch progress as JSON lines while compiling ('-' = stdout):\n"
+		"                           throughput, queue depth, worker utilization, cache hit rates\n"
+		"                           and the slowest files, then a final line once done.\n"
+		"      --telemetry-interval <ms>\n"
+		"                           Time between telemetry lines (default: 1000).\n"
+		"  -q, --quiet              Only print errors.\n"
+		"  -d, --disassemble        Disassemble compiled scripts (.ncs inputs) into .ncs.pcode listings,\n"
+		"                           annotated from the .ndb next to each one when present.\n"
+		"      --no-addresses       Leave addresses and raw bytes out of listings (for diffing builds).\n"
+		"      --server             Run as a compile server on stdin/stdout (JSON lines protocol).\n"
+		"      --socket <path>      Run as a compile server on a Unix domain socket.\n"
+		"  -h, --help               Show this help.\n"
+		"\n"
+		"Exit codes: 0 = success, 1 = one or more scripts failed, 2 = usage or setup error.\n");
+}
+
+static void splitPaths(const std::string& value, std::vector<std::string>& out)
+{
+	size_t start = 0;
+	while (start <= value.size())
+	{
+		size_t end = value.find_first_of(";:", start);
+		if (end == std::string::npos)
+			end = value.size();
+		if (end > start)
+			out.push_back(value.substr(start, end - start));
+		start = end + 1;
+	}
+}
+
+static bool parseArguments(const std::vector<std::string>& args, CommandLine& cmd)
+{
+	for (size_t i = 0; i < args.size(); i++)
+	{
+		const std::string& arg = args[i];
+
+		auto nextValue = [&](std::string& value) -> bool {
+			if (i + 1 >= args.size())
+			{
+				std::fprintf(stderr, "Error: Missing value for option \"%s\".\n", arg.c_str());
+				return false;
+			}
+			value = args[++i];
+			return true;
+		};
+
+		if (arg.size() < 2 || arg[0] != '-')
+		{
+			cmd.inputs.push_back(arg);
+			continue;
+		}
+
+		std::string value;
+		if (arg == "-i" || arg == "--include")
+		{
+			if (!nextValue(value))
+				return false;
+			splitPaths(value, cmd.includePaths);
+		}
+		else if (arg == "-n" || arg == "--install")
+		{
+			if (!nextValue(value))
+				return false;
+			cmd.installDir = value;
+		}
+		else if (arg == "-E" || arg == "--erf")
+		{
+			if (!nextValue(value))
+				return false;
+			cmd.erfFiles.push_back(value);
+		}
+		else if (arg == "--index-cache")
+		{
+			if (!nextValue(value))
+				return false;
+			cmd.indexCacheFile = value;
+		}
+		else if (arg == "-c" || arg == "--compile-cache")
+		{
+			if (!nextValue(value))
+				return false;
+			cmd.compileCacheDir = value;
+		}
+		else if (arg == "--compile-cache-size")
+		{
+			if (!nextValue(value))
+				return false;
+			long long size = std::atoll(value.c_str());
+			if (size <= 0)
+			{
+				std::fprintf(stderr, "Error: Invalid compile cache size \"%s\".\n", value.c_str());
+				return false;
+			}
+			cmd.compileCacheMaxMB = static_cast<uint64_t>(size);
+		}
+		else if (arg == "-b" || arg == "--output")
+		{
+			if (!nextValue(value))
+				return false;
+			cmd.settings.outputDir = value;
+		}
+		else if (arg == "-j" || arg == "--jobs")
+		{
+			if (!nextValue(value))
+				return false;
+			cmd.settings.threads = std::atoi(value.c_str());
+			if (cmd.settings.threads < 0)
+			{
+				std::fprintf(stderr, "Error: Invalid number of jobs \"%s\".\n", value.c_str());
+				return false;
+			}
+		}
+		else if (arg == "-m" || arg == "--max-errors")
+		{
+			if (!nextValue(value))
+				return false;
+			cmd.settings.maxErrors = std::atoi(value.c_str());
+			if (cmd.settings.maxErrors < 0)
+			{
+				std::fprintf(stderr, "Error: Invalid number of errors \"%s\".\n", value.c_str());
+				return false;
+			}
+		}
+		else if (arg == "-s" || arg == "--summary")
+		{
+			if (!nextValue(value))
+				return false;
+			cmd.summaryFile = value;
+		}
+		else if (arg == "-t" || arg == "--telemetry")
+		{
+			if (!nextValue(value))
+				return false;
+			cmd.telemetryFile = value;
+		}
+		else if (arg == "--telemetry-interval")
+		{
+			if (!nextValue(value))
+				return false;
+			cmd.telemetryIntervalMs = std::atoi(value.c_str());
+			if (cmd.telemetryIntervalMs <= 0)
+			{
+				std::fprintf(stderr, "Error: Invalid telemetry interval \"%s\".\n", value.c_str());
+				return false;
+			}
+		}
+		else if (arg == "--socket")
+		{
+			if (!nextValue(value))
+				return false;
+			cmd.socketPath = value;
+			cmd.server = true;
+		}
+		else if (arg == "--server")
+			cmd.server = true;
+		else if (arg == "-r" || arg == "--recurse")
+			cmd.recurse = true;
+		else if (arg == "-d" || arg == "--disassemble")
+			cmd.disassemble = true;
+		else if (arg == "--no-addresses")
+			cmd.addresses = false;
+		else if (arg == "-o" || arg == "--optimize")
+			cmd.settings.optimizeScript = true;
+		else if (arg == "-g" || arg == "--symbols")
+			cmd.settings.generateSymbols = true;
+		else if (arg == "-e" || arg == "--stop-on-error")
+			cmd.settings.stopOnError = true;
+		else if (arg == "--no-precompiled-includes")
+			cmd.settings.precompiledIncludes = false;
+		else if (arg == "-q" || arg == "--quiet")
+			cmd.quiet = true;
+		else if (arg == "-h" || arg == "--help")
+			cmd.help = true;
+		else
+		{
+			std::fprintf(stderr, "Error: Unrecognized option \"%s\".\n", arg.c_str());
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Registers the game archives the same way the plugin loads script resources
+// (NWN:EE ships a single data/nwn_base.key, older versions a chain of KEY files)
+// and starts indexing them in the background.
+static bool startResourceIndex(const CommandLine& cmd, ResourceIndex& index)
+{
+	for (const std::string& erf : cmd.erfFiles)
+		index.addErf(erf);
+
+	if (!cmd.installDir.empty())
+	{
+		fs::path installDir = cmd.installDir;
+		std::error_code ec;
+		if (fs::is_regular_file(installDir / "data" / "nwn_base.key", ec))
+			index.addKeyFile(installDir / "data" / "nwn_base.key", installDir);
+		else
+		{
+			bool found = false;
+			for (const char* key : { "xp3", "xp2patch", "xp2", "xp1", "chitin" })
+			{
+				fs::path keyFile = installDir / (std::string(key) + ".key");
+				if (fs::is_regular_file(keyFile, ec))
+				{
+					index.addKeyFile(keyFile, installDir);
+					found = true;
+				}
+			}
+
+			if (!found)
+			{
+				std::fprintf(stderr, "Error: No game KEY files found in \"%s\".\n", cmd.installDir.c_str());
+				return false;
+			}
+		}
+	}
+
+	index.buildAsync(cmd.indexCacheFile);
+	return true;
+}
+
+static void writeSummary(std::ostream& out, const CommandLine& cmd, const IncludeCache& cache, const BatchSummary& summary)
+{
+	JsonWriter json(out);
+
+	json.beginObject();
+	json.member("tool", "nwnsc-native");
+	json.member("version", NWNSC_NATIVE_VERSION);
+
+	json.key("settings").beginObject();
+	json.member("optimizeScript", cmd.settings.optimizeScript);
+	json.member("generateSymbols", cmd.settings.generateSymbols);
+	json.member("stopOnError", cmd.settings.stopOnError);
+	json.member("precompiledIncludes", cmd.settings.precompiledIncludes);
+	json.member("maxErrors", cmd.settings.maxErrors);
+	json.member("threads", summary.threads);
+	json.member("outputDir", cmd.settings.outputDir.string());
+	json.member("compileCache", cmd.compileCacheDir);
+	json.key("includePaths").beginArray();
+	for (const fs::path& p : cache.searchPaths())
+		json.value(p.string());
+	json.endArray();
+	json.endObject();
+
+	json.key("totals").beginObject();
+	json.member("files", summary.files.size());
+	json.member("succeeded", summary.succeeded);
+	json.member("failed", summary.failed);
+	json.member("skipped", summary.skipped);
+	json.member("cancelled", summary.cancelled);
+	json.member("setupError", summary.setupError);
+	json.member("wallMs", summary.wallMs);
+	json.member("setupMs", summary.setupMs);
+	json.member("includeCacheHits", summary.cacheHits);
+	json.member("includeCacheMisses", summary.cacheMisses);
+	json.member("precompiledIncludeHits", summary.precompiledIncludeHits);
+	json.member("precompiledIncludeMisses", summary.precompiledIncludeMisses);
+	json.member("compileCacheHits", summary.compileCacheHits);
+	json.member("compileCacheMisses", summary.compileCacheMisses);
+	json.member("compileCacheEvictions", summary.compileCacheEvictions);
+	json.member("outputsWritten", summary.outputsWritten);
+	json.member("outputsUnchanged", summary.outputsUnchanged);
+	json.endObject();
+
+	if (const ResourceIndex* index = cache.resourceIndex())
+	{
+		json.key("resourceIndex").beginObject();
+		json.member("resources", index->size());
+		json.member("archives", index->archiveCount());
+		json.member("loadedFromDisk", index->loadedFromDisk());
+		json.member("buildMs", index->buildMs());
+		json.endObject();
+	}
+
+	json.key("files").beginArray();
+	for (const FileResult& result : summary.files)
+		writeFileResult(json, result);
+	json.endArray();
+
+	json.endObject();
+	out << '\n';
+}
+
+// Server mode: everything on stdout belongs to the protocol, messages go to stderr.
+static int runServer(const CommandLine& cmd)
+{
+	IncludeCache cache;
+	for (const std::string& path : cmd.includePaths)
+		cache.addSearchPath(path);
+
+	// Indexing continues in the background while the server runs; the status command reports its progress.
+	ResourceIndex index;
+	if (!cmd.installDir.empty() || !cmd.erfFiles.empty())
+	{
+		if (!startResourceIndex(cmd, index))
+			return EXIT_CODE_USAGE_ERROR;
+		cache.setResourceIndex(&index);
+	}
+
+	BatchCompiler compiler(cmd.settings, cache);
+	std::string errorMessage;
+	NWScriptPlugin::CompileCache compileCache(cmd.compileCacheDir, cmd.compileCacheMaxMB << 20);
+	if (!cmd.compileCacheDir.empty())
+	{
+		if (!compileCache.open(errorMessage))
+		{
+			std::fprintf(stderr, "Error: %s\n", errorMessage.c_str());
+			return EXIT_CODE_USAGE_ERROR;
+		}
+		compiler.setCompileCache(&compileCache);
+	}
+
+	if (!compiler.validate(errorMessage) || !compiler.warmUp(errorMessage))
+	{
+		std::fprintf(stderr, "Error: %s\n", errorMessage.c_str());
+		return EXIT_CODE_USAGE_ERROR;
+	}
+
+	CompileServer server(compiler, cache);
+	if (cmd.socketPath.empty())
+		return server.runStdio();
+
+	if (!cmd.quiet)
+		std::fprintf(stderr, "nwnsc-native: listening on %s\n", cmd.socketPath.c_str());
+	return server.runSocket(cmd.socketPath);
+}
+
+static bool writeSummaryFile(const CommandLine& cmd, const IncludeCache& cache, const BatchSummary& summary)
+{
+	if (cmd.summaryFile == "-")
+	{
+		std::fflush(stdout);
+		writeSummary(std::cout, cmd, cache, summary);
+		return true;
+	}
+
+	std::ofstream out(cmd.summaryFile, std::ios::trunc);
+	if (!out)
+	{
+		std::fprintf(stderr, "Error: Unable to write summary file \"%s\".\n", cmd.summaryFile.c_str());
+		return false;
+	}
+	writeSummary(out, cmd, cache, summary);
+	return true;
+}
+
+// One telemetry snapshot per line. Lines are written with a single call, so they don't get
+// mixed with the per-file messages when both go to stdout.
+static void writeTelemetryLine(std::ostream* file, const NWScriptPlugin::BatchTelemetry& telemetry)
+{
+	std::ostringstream line;
+	JsonWriter json(line);
+	writeTelemetry(json, telemetry.snapshot());
+	line << '\n';
+
+	if (file)
+		*file << line.str() << std::flush;
+	else
+	{
+		std::fputs(line.str().c_str(), stdout);
+		std::fflush(stdout);
+	}
+}
+
+// Disassembly mode: .ncs inputs, one .ncs.pcode listing per script.
+static int runDisassembler(const CommandLine& cmd)
+{
+	InputCollector collector("ncs", cmd.recurse);
+	for (const std::string& input : cmd.inputs)
+	{
+		if (!collector.add(input))
+			std::fprintf(stderr, "Warning: No compiled scripts found for input \"%s\".\n", input.c_str());
+	}
+
+	if (collector.files().empty())
+	{
+		std::fprintf(stderr, "Error: No input files to process.\n");
+		return EXIT_CODE_USAGE_ERROR;
+	}
+
+	DisassemblerSettings settings;
+	settings.threads = cmd.settings.threads;
+	settings.outputDir = cmd.settings.outputDir;
+	settings.stopOnError = cmd.settings.stopOnError;
+	settings.options.addresses = cmd.addresses;
+	settings.options.rawBytes = cmd.addresses;
+
+	bool quiet = cmd.quiet;
+	BatchDisassembler disassembler(settings);
+	BatchSummary summary = disassembler.run(collector.files(), [quiet](const FileResult& result) {
+		if (result.status == FileResult::Status::Failed)
+			std::fprintf(stderr, "%s: %s\n", result.source.string().c_str(), result.message.c_str());
+		else if (!quiet)
+			std::printf("Disassembled %s (%.1f ms)%s\n", result.source.string().c_str(), result.totalMs,
+				result.outputsUnchanged ? ", unchanged" : "");
+	});
+
+	if (!cmd.quiet)
+	{
+		std::printf("Total: %zu file(s), %zu succeeded, %zu failed, %zu listing(s) changed in %.1f ms using %d thread(s).\n",
+			summary.files.size(), summary.succeeded, summary.failed, summary.outputsWritten, summary.wallMs, summary.threads);
+	}
+
+	if (!cmd.summaryFile.empty() && !writeSummaryFile(cmd, IncludeCache(), summary))
+		return EXIT_CODE_USAGE_ERROR;
+
+	return (summary.failed > 0 || summary.cancelled) ? EXIT_CODE_COMPILE_ERROR : EXIT_CODE_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+	// Expand response files first, so they can carry options as well as inputs.
+	std::vector<std::string> args;
+	for (int i = 1; i < argc; i++)
+	{
+		if (argv[i][0] == '@' && argv[i][1] != 0)
+		{
+			std::string errorMessage;
+			if (!expandResponseFile(argv[i] + 1, args, errorMessage))
+			{
+				std::fprintf(stderr, "Error: %s\n", errorMessage.c_str());
+				return EXIT_CODE_USAGE_ERROR;
+			}
+		}
+		else
+			args.push_back(argv[i]);
+	}
+
+	CommandLine cmd;
+	if (!parseArguments(args, cmd))
+		return EXIT_CODE_USAGE_ERROR;
+
+	if (cmd.help || (cmd.inputs.empty() && !cmd.server))
+	{
+		printUsage();
+		return cmd.help ? EXIT_CODE_SUCCESS : EXIT_CODE_USAGE_ERROR;
+	}
+
+	if (cmd.server)
+		return runServer(cmd);
+
+	if (cmd.disassemble)
+		return runDisassembler(cmd);
+
+	// Game archives are indexed in the background while inputs are gathered and compilers
+	// created; a lookup only waits for the archives it has to search.
+	ResourceIndex index;
+	if (!cmd.installDir.empty() || !cmd.erfFiles.empty())
+	{
+		if (!startResourceIndex(cmd, index))
+			return EXIT_CODE_USAGE_ERROR;
+	}
+
+	IncludeCache cache;
+	for (const std::string& path : cmd.includePaths)
+		cache.addSearchPath(path);
+	if (!cmd.installDir.empty() || !cmd.erfFiles.empty())
+		cache.setResourceIndex(&index);
+
+	BatchCompiler compiler(cmd.settings, cache);
+	std::string errorMessage;
+	NWScriptPlugin::CompileCache compileCache(cmd.compileCacheDir, cmd.compileCacheMaxMB << 20);
+	if (!cmd.compileCacheDir.empty())
+	{
+		if (!compileCache.open(errorMessage))
+		{
+			std::fprintf(stderr, "Error: %s\n", errorMessage.c_str());
+			return EXIT_CODE_USAGE_ERROR;
+		}
+		compiler.setCompileCache(&compileCache);
+	}
+
+	if (!compiler.validate(errorMessage))
+	{
+		// A broken archive is the more useful explanation for a missing nwscript.nss
+		std::string indexError;
+		if (cache.resourceIndex() && !index.wait(indexError))
+			errorMessage = indexError;
+		std::fprintf(stderr, "Error: %s\n", errorMessage.c_str());
+		return EXIT_CODE_USAGE_ERROR;
+	}
+
+	// Telemetry lines are written from their own thread while the batch runs
+	NWScriptPlugin::BatchTelemetry telemetry;
+	std::ofstream telemetryFile;
+	std::thread telemetryReporter;
+	std::mutex telemetryLock;
+	std::condition_variable telemetryWakeUp;
+	bool batchDone = false;
+	if (!cmd.telemetryFile.empty())
+	{
+		if (cmd.telemetryFile != "-")
+		{
+			telemetryFile.open(cmd.telemetryFile, std::ios::trunc);
+			if (!telemetryFile)
+			{
+				std::fprintf(stderr, "Error: Unable to write telemetry file \"%s\".\n", cmd.telemetryFile.c_str());
+				return EXIT_CODE_USAGE_ERROR;
+			}
+		}
+
+		telemetryReporter = std::thread([&]() {
+			std::unique_lock<std::mutex> guard(telemetryLock);
+			while (!telemetryWakeUp.wait_for(guard, std::chrono::milliseconds(cmd.telemetryIntervalMs), [&]() { return batchDone; }))
+				writeTelemetryLine(telemetryFile.is_open() ? &telemetryFile : nullptr, telemetry);
+		});
+	}
+
+	// Inputs are gathered while the batch runs: workers start on the first script found, while
+	// the folders are still being walked.
+	InputCollector collector("nss", cmd.recurse);
+	auto gatherInputs = [&](const BatchCompiler::AddFileFunction& addFile) {
+		collector.setFileCallback(addFile);
+		for (const std::string& input : cmd.inputs)
+		{
+			if (!collector.add(input))
+				std::fprintf(stderr, "Warning: No scripts found for input \"%s\".\n", input.c_str());
+		}
+	};
+
+	bool quiet = cmd.quiet;
+	BatchSummary summary = compiler.run(gatherInputs, [quiet](const FileResult& result) {
+		switch (result.status)
+		{
+		case FileResult::Status::Failed:
+			if (result.diagnostics.empty())
+				std::fprintf(stderr, "%s: %s\n", result.source.string().c_str(), result.message.c_str());
+			for (const Diagnostic& d : result.diagnostics)
+			{
+				if (d.line > 0)
+					std::fprintf(stderr, "%s: %s(%d): %s\n", result.source.string().c_str(), d.file.c_str(), d.line, d.message.c_str());
+				else
+					std::fprintf(stderr, "%s: %s: %s\n", result.source.string().c_str(), d.file.c_str(), d.message.c_str());
+			}
+			break;
+		case FileResult::Status::SkippedInclude:
+			if (!quiet)
+				std::printf("%s: Warning: %s\n", result.source.string().c_str(), result.message.c_str());
+			break;
+		default:
+			if (!quiet)
+				std::printf("Compiled %s (%.1f ms)%s\n", result.source.string().c_str(), result.totalMs, result.cached ? ", from cache" : "");
+			break;
+		}
+	}, cmd.telemetryFile.empty() ? nullptr : &telemetry);
+
+	if (telemetryReporter.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> guard(telemetryLock);
+			batchDone = true;
+		}
+		telemetryWakeUp.notify_all();
+		telemetryReporter.join();
+		writeTelemetryLine(telemetryFile.is_open() ? &telemetryFile : nullptr, telemetry);
+	}
+
+	if (summary.files.empty())
+	{
+		std::fprintf(stderr, "Error: No input files to process.\n");
+		return EXIT_CODE_USAGE_ERROR;
+	}
+
+	if (!summary.setupError.empty())
+		std::fprintf(stderr, "Error: Failed to load the identifier specification: %s\n", summary.setupError.c_str());
+
+	std::string indexError;
+	if (cache.resourceIndex() && !index.wait(indexError))
+		std::fprintf(stderr, "Error: %s\n", indexError.c_str());
+
+	if (!cmd.quiet)
+	{
+		std::printf("Total: %zu file(s), %zu succeeded, %zu failed, %zu include(s) skipped in %.1f ms using %d thread(s).\n",
+			summary.files.size(), summary.succeeded, summary.failed, summary.skipped, summary.wallMs, summary.threads);
+		if (!cmd.compileCacheDir.empty())
+			std::printf("Compile cache: %llu hit(s), %llu miss(es), %zu entr%s evicted.\n", static_cast<unsigned long long>(summary.compileCacheHits),
+				static_cast<unsigned long long>(summary.compileCacheMisses), summary.compileCacheEvictions, summary.compileCacheEvictions == 1 ? "y" : "ies");
+	}
+
+	if (!cmd.summaryFile.empty() && !writeSummaryFile(cmd, cache, summary))
+		return EXIT_CODE_USAGE_ERROR;
+
+	if (!summary.setupError.empty() || !indexError.empty())
+		return EXIT_CODE_USAGE_ERROR;
+
+	return (summary.failed > 0 || summary.cancelled) ? EXIT_CODE_COMPILE_ERROR : EXIT_CODE_SUCCESS;
+}
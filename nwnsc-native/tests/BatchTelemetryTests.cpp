@@ -0,0 +1,140 @@
+/** @file BatchTelemetryTests.cpp
+ * What BatchTelemetry reports of a batch run: file and failure counts, an empty queue and the
+ * finished flag at the end, a worker utilization between 0 and 1, the slowest files (slowest
+ * first, no more than asked for) and cache counters for this run only, though the caches
+ * outlive it.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include "BatchCompiler.h"
+#include "BatchTelemetry.h"
+#include "CompileCache.h"
+#include "IncludeCache.h"
+#include "TestSupport.h"
+
+using namespace NWScriptCli;
+using NWScriptPlugin::BatchTelemetry;
+
+static constexpr size_t slowestCount = 3;
+
+static std::vector<fs::path> makeScripts(const fs::path& dir)
+{
+	NWScriptTests::writeFile(dir / "inc_shared.nss", "int Twice(int n) { return n * 2; }\n");
+
+	std::vector<fs::path> scripts;
+	for (int i = 0; i < 5; i++)
+	{
+		scripts.push_back(dir / ("s_script" + std::to_string(i) + ".nss"));
+		NWScriptTests::writeFile(scripts.back(), "#include \"inc_shared\"\nvoid main() { PrintInteger(Twice(" + std::to_string(i) + ")); }\n");
+	}
+
+	scripts.push_back(dir / "s_broken.nss");
+	NWScriptTests::writeFile(scripts.back(), "void main() { PrintInteger(; }\n");
+	return scripts;
+}
+
+// Checks what doesn't depend on the caches. Returns the snapshot for those checks.
+static BatchTelemetry::Snapshot checkRun(const BatchTelemetry& telemetry, const BatchSummary& summary, const std::vector<fs::path>& scripts)
+{
+	const BatchTelemetry::Snapshot snapshot = telemetry.snapshot();
+
+	CHECK(summary.setupError.empty());
+	CHECK_EQUAL(summary.failed, 1u);
+
+	CHECK(snapshot.finished);
+	CHECK_EQUAL(snapshot.filesQueued, scripts.size());
+	CHECK_EQUAL(snapshot.filesStarted, scripts.size());
+	CHECK_EQUAL(snapshot.filesDone, scripts.size());
+	CHECK_EQUAL(snapshot.filesFailed, 1u);
+	CHECK_EQUAL(snapshot.queueDepth, 0u);
+	CHECK_EQUAL(snapshot.workersBusy, 0);
+	CHECK_EQUAL(snapshot.workers, summary.threads);
+	CHECK(snapshot.workerUtilization >= 0.0 && snapshot.workerUtilization <= 1.0);
+	CHECK(snapshot.elapsedMs > 0);
+
+	if (CHECK_EQUAL(snapshot.slowest.size(), slowestCount))
+	{
+		for (size_t i = 1; i < snapshot.slowest.size(); i++)
+			CHECK(snapshot.slowest[i - 1].totalMs >= snapshot.slowest[i].totalMs);
+
+		// The slowest kept are slower than every file left out
+		for (const FileResult& file : summary.files)
+		{
+			const bool kept = std::any_of(snapshot.slowest.begin(), snapshot.slowest.end(),
+				[&](const BatchTelemetry::FileTimings& timings) { return timings.path == file.source.string(); });
+			if (!kept)
+				CHECK(file.totalMs <= snapshot.slowest.back().totalMs);
+		}
+	}
+
+	// The snapshot doesn't move once finished
+	CHECK_EQUAL(telemetry.snapshot().elapsedMs, snapshot.elapsedMs);
+	return snapshot;
+}
+
+// Include and resource counters: the difference between the totals before and after the run
+static void checkCacheCounters(const BatchTelemetry::Snapshot& snapshot, const BatchSummary& before, const BatchSummary& after)
+{
+	CHECK_EQUAL(snapshot.includeCache.hits, after.precompiledIncludeHits - before.precompiledIncludeHits);
+	CHECK_EQUAL(snapshot.includeCache.misses, after.precompiledIncludeMisses - before.precompiledIncludeMisses);
+	CHECK_EQUAL(snapshot.resourceCache.hits, after.cacheHits - before.cacheHits);
+	CHECK_EQUAL(snapshot.resourceCache.misses, after.cacheMisses - before.cacheMisses);
+}
+
+static void testRuns()
+{
+	NWScriptTests::TemporaryDirectory dir;
+	const std::vector<fs::path> scripts = makeScripts(dir.path() / "src");
+
+	IncludeCache includes;
+	includes.addSearchPath(NWScriptTests::dataDirectory());
+
+	CompilerSettings settings;
+	settings.threads = 2;
+	settings.outputDir = dir.path() / "out";
+	fs::create_directories(settings.outputDir);
+
+	NWScriptPlugin::CompileCache compileCache(dir.path() / "cache", 64 << 20);
+	std::string error;
+	if (!CHECK(compileCache.open(error)))
+		return;
+
+	BatchCompiler compiler(settings, includes);
+	compiler.setCompileCache(&compileCache);
+	BatchTelemetry telemetry(slowestCount);
+
+	// Everything compiled: the include is parsed once, the sources read from disk
+	const BatchSummary first = compiler.run(scripts, nullptr, &telemetry);
+	BatchTelemetry::Snapshot snapshot = checkRun(telemetry, first, scripts);
+	checkCacheCounters(snapshot, BatchSummary(), first);
+	CHECK(snapshot.includeCache.misses > 0);
+	CHECK(snapshot.resourceCache.misses > 0);
+	CHECK_EQUAL(snapshot.compileCache.hits, 0u);
+	CHECK_EQUAL(snapshot.compileCache.misses, scripts.size());
+
+	// The same scripts again: the outputs come from the compile cache, but the broken script
+	const BatchSummary second = compiler.run(scripts, nullptr, &telemetry);
+	snapshot = checkRun(telemetry, second, scripts);
+	checkCacheCounters(snapshot, first, second);
+	CHECK_EQUAL(snapshot.compileCache.hits, scripts.size() - 1);
+	CHECK_EQUAL(snapshot.compileCache.misses, 1u);
+
+	// And compiled without it: the include comes from the modules parsed by the first run
+	compiler.setCompileCache(nullptr);
+	const BatchSummary third = compiler.run(scripts, nullptr, &telemetry);
+	snapshot = checkRun(telemetry, third, scripts);
+	checkCacheCounters(snapshot, second, third);
+	CHECK(snapshot.includeCache.hits > 0);
+	CHECK_EQUAL(snapshot.includeCache.misses, 0u);
+	CHECK_EQUAL(snapshot.resourceCache.misses, 0u);
+	CHECK_EQUAL(snapshot.compileCache.hits, 0u);
+	CHECK_EQUAL(snapshot.compileCache.misses, 0u);
+}
+
+int main()
+{
+	testRuns();
+	return NWScriptTests::testResult();
+}
@@ -0,0 +1,104 @@
+/** @file CompileCacheTests.cpp
+ * The compile cache must never hand out outputs compiled from other sources than the ones
+ * on disk: every include the compiler reads is part of the key.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include "BatchCompiler.h"
+#include "CompileCache.h"
+#include "IncludeCache.h"
+#include "TestSupport.h"
+
+using namespace NWScriptCli;
+
+struct CompileRun
+{
+	FileResult::Status status = FileResult::Status::Pending;
+	bool cached = false;
+	std::string output;       // The compiled .ncs
+};
+
+// One nwnsc-native run: nothing is shared with the previous ones but the cache directory.
+static CompileRun compile(const fs::path& script, const fs::path& outputDir, const fs::path& cacheDir)
+{
+	IncludeCache includes;
+	includes.addSearchPath(NWScriptTests::dataDirectory());
+
+	CompilerSettings settings;
+	settings.threads = 1;
+	settings.outputDir = outputDir;
+	fs::create_directories(outputDir);
+
+	BatchCompiler compiler(settings, includes);
+	NWScriptPlugin::CompileCache compileCache(cacheDir, 64 << 20);
+	std::string error;
+	if (!cacheDir.empty() && CHECK(compileCache.open(error)))
+		compiler.setCompileCache(&compileCache);
+
+	BatchSummary summary = compiler.run({ script });
+	CHECK(summary.setupError.empty());
+
+	CompileRun run;
+	if (CHECK_EQUAL(summary.files.size(), 1u))
+	{
+		run.status = summary.files[0].status;
+		run.cached = summary.files[0].cached;
+	}
+	run.output = NWScriptTests::readFile(outputDir / (script.stem().string() + ".ncs"));
+	return run;
+}
+
+// An include on the same line as other code is still an include: editing it must invalidate
+// the scripts using it.
+static void testMidLineIncludeInvalidates()
+{
+	NWScriptTests::TemporaryDirectory dir;
+	const fs::path script = dir.path() / "src" / "c_midline.nss";
+	const fs::path include = dir.path() / "src" / "inc_q.nss";
+	const fs::path cacheDir = dir.path() / "cache";
+
+	NWScriptTests::writeFile(script, "int z; #include \"inc_q\"\nvoid main() { PrintInteger(Value()); }\n");
+	NWScriptTests::writeFile(include, "int Value() { return 1; }\n");
+
+	CompileRun first = compile(script, dir.path() / "out1", cacheDir);
+	CHECK(first.status == FileResult::Status::Success);
+	CHECK(!first.cached);
+	CHECK(!first.output.empty());
+
+	CompileRun again = compile(script, dir.path() / "out2", cacheDir);
+	CHECK(again.cached);
+	CHECK(again.output == first.output);
+
+	NWScriptTests::writeFile(include, "int Value() { return 2; }\n");
+
+	CompileRun changed = compile(script, dir.path() / "out3", cacheDir);
+	CompileRun uncached = compile(script, dir.path() / "out4", fs::path());
+	CHECK(changed.status == FileResult::Status::Success);
+	CHECK(!changed.cached);
+	CHECK(changed.output != first.output);
+	CHECK(changed.output == uncached.output);
+}
+
+// Include files have nothing to write, but are cached too
+static void testIncludeFileCached()
+{
+	NWScriptTests::TemporaryDirectory dir;
+	const fs::path script = dir.path() / "inc_only.nss";
+	NWScriptTests::writeFile(script, "int Value() { return 1; }\n");
+
+	CompileRun first = compile(script, dir.path() / "out", dir.path() / "cache");
+	CompileRun again = compile(script, dir.path() / "out", dir.path() / "cache");
+	CHECK(first.status == FileResult::Status::SkippedInclude);
+	CHECK(!first.cached);
+	CHECK(again.status == FileResult::Status::SkippedInclude);
+	CHECK(again.cached);
+}
+
+int main()
+{
+	testMidLineIncludeInvalidates();
+	testIncludeFileCached();
+	return NWScriptTests::testResult();
+}
@@ -0,0 +1,274 @@
+/** @file DeclarationScannerTests.cpp
+ * Differential test of the plugin's script declaration parser. The declarations of every script are
+ * read twice: by ScriptDeclarationScanner (what NWScriptParser uses now) and by the PCRE pipeline it
+ * replaced, kept here as the reference: strip comments, strip function definitions, then one match
+ * pass per kind of member and one more per prototype for its parameters. Both must find the same
+ * engine structures, prototypes and constants, with the same values and parameters.
+ *
+ * The scripts are those of tests/data/declarations and the other test scripts, each with LF and CRLF
+ * line ends, plus a generated nwscript.nss-like header with a few thousand members. The cases where
+ * the regular expressions were wrong are checked on their own, as the only differences expected.
+ *
+ * Only built where PCRE2 is found (see CMakeLists.txt).
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <algorithm>
+#include <random>
+
+#include "jpcre2.hpp"
+
+#include "ScriptDeclarationScanner.h"
+#include "TestSupport.h"
+
+using NWScriptPlugin::ScriptDeclaration;
+using NWScriptPlugin::ScriptDeclarationScanner;
+
+namespace {
+
+	typedef jpcre2::select<char> pcre2;
+
+	// The regular expressions of NWScriptParser before the scanner, unchanged
+	const std::string BASEREGEX = R"((?(DEFINE)(?<word>[\w\d.\-]++)(?<string>"(?>\\.|[^"\\]*+)*+")(?<token>\g<word>|\g<string>)(?<tokenVector>\[\s*+(?>\g<validValue>(?=\])|\g<validValue>,(?=\g<validValue>))*+\])(?<object>\{\s*+(?>\g<validValue>(?=\})|\g<validValue>,(?=\g<validValue>))*+\})(?<validValue>\s*+(?>\g<token>|\g<tokenVector>|\g<object>)\s*+)(?'param'\s*+(?>const)?\s*+(?#paramType)\w+\s*+(?#paramName)\w+\s*+(?>=\s*+(?#paramDefaultValue)\g<validValue>)?\s*+)(?<fnContents>{(?:[^{"}]*+|\g<string>|\g<fnContents>)*})))";
+	const std::string COMMENTSREGEX = R"((?(DEFINE)(?'commentLine'\/\/.*+)(?'comment'\/\*(?>\*\/|(?>(?>.|\n)(?!\*\/))*+)(?>(?>.|\n)(?=\*\/)\*\/)?)(?'cnotnull'(?>\g<commentLine>|\g<comment>)++)(?'c'\g<cnotnull>?))\g<cnotnull>)";
+	const std::string ENGINESTRUCTREGEX = R"(^\s*+\K(?>#define)\s++(?>ENGINE_STRUCTURE_\d++)\s++(?<name>\w++))";
+	const std::string FUNCTIONDECLARATIONREGEX = BASEREGEX + R"(^\s*+\K(?<type>\w+)\s*+(?<name>\w+)\s*+\((?<parametersString>(?>\g<param>(?=\))|\g<param>,(?=\g<param>))*+)\)\s*+;)";
+	const std::string FUNCTIONSDEFINITIONREGEX = BASEREGEX + R"(^\s*+\K(?>\w+)\s*+(?>\w+)\s*+\((?>(?>\g<param>,(?=\g<param>)|\g<param>(?=\))))*+\)\s*+\g<fnContents>)";
+	const std::string FUNTIONPARAMETERREGEX = BASEREGEX + R"(\s*+(?>const)?\s*+(?'type'\w+)\s*+(?'name'\w+)\s*+(?>=\s*+(?'defaultValue'\g<validValue>))?\s*+,?)";
+	const std::string CONSTANTREGEX = BASEREGEX + R"(^\s*+(?>const)?\s*+\K(?<type>\w+)\s*+(?<name>\w+)\s*+=\s*+(?<value>\g<validValue>)\s*+;)";
+
+	const pcre2::Regex commentsRegEx(COMMENTSREGEX, PCRE2_MULTILINE, jpcre2::JIT_COMPILE);
+	const pcre2::Regex engineStructRegEx(ENGINESTRUCTREGEX, PCRE2_MULTILINE, jpcre2::JIT_COMPILE);
+	const pcre2::Regex functionsDeclarationRegEx(FUNCTIONDECLARATIONREGEX, PCRE2_MULTILINE, jpcre2::JIT_COMPILE);
+	const pcre2::Regex functionsDefinitionRegEx(FUNCTIONSDEFINITIONREGEX, PCRE2_MULTILINE, jpcre2::JIT_COMPILE);
+	const pcre2::Regex functionsParamRegEx(FUNTIONPARAMETERREGEX, PCRE2_MULTILINE, jpcre2::JIT_COMPILE);
+	const pcre2::Regex constantsRegEx(CONSTANTREGEX, PCRE2_MULTILINE, jpcre2::JIT_COMPILE);
+
+	std::vector<ScriptDeclaration> regexDeclarations(const std::string& sFileContents)
+	{
+		std::vector<ScriptDeclaration> declarations;
+
+		std::string cleanFile = pcre2::Regex(commentsRegEx).replace(sFileContents, "", "gm");
+		cleanFile = pcre2::Regex(functionsDefinitionRegEx).replace(cleanFile, "", "gm");
+
+		pcre2::VecNas captureGroup;
+		pcre2::RegexMatch regexMatch(&engineStructRegEx);
+		regexMatch.setSubject(cleanFile);
+		regexMatch.addModifier("gm");
+		regexMatch.setNamedSubstringVector(&captureGroup);
+		size_t count = regexMatch.match();
+		for (size_t i = 0; i < count; i++)
+		{
+			ScriptDeclaration declaration;
+			declaration.kind = ScriptDeclaration::Kind::EngineStruct;
+			declaration.sName = captureGroup[i]["name"];
+			declarations.push_back(std::move(declaration));
+		}
+
+		regexMatch.setRegexObject(&functionsDeclarationRegEx);
+		count = regexMatch.match();
+
+		pcre2::RegexMatch regexMatchSubString(&functionsParamRegEx);
+		regexMatchSubString.addModifier("gm");
+		pcre2::VecNas captureSubGroup;
+		regexMatchSubString.setNamedSubstringVector(&captureSubGroup);
+		for (size_t i = 0; i < count; i++)
+		{
+			ScriptDeclaration declaration;
+			declaration.kind = ScriptDeclaration::Kind::Function;
+			declaration.sType = captureGroup[i]["type"];
+			declaration.sName = captureGroup[i]["name"];
+
+			regexMatchSubString.setSubject(captureGroup[i]["parametersString"]);
+			const size_t nParams = regexMatchSubString.match();
+			for (size_t j = 0; j < nParams; j++)
+				declaration.params.push_back({ captureSubGroup[j]["type"], captureSubGroup[j]["name"], captureSubGroup[j]["defaultValue"] });
+			declarations.push_back(std::move(declaration));
+		}
+
+		regexMatch.setRegexObject(&constantsRegEx);
+		count = regexMatch.match();
+		for (size_t i = 0; i < count; i++)
+		{
+			ScriptDeclaration declaration;
+			declaration.kind = ScriptDeclaration::Kind::Constant;
+			declaration.sType = captureGroup[i]["type"];
+			declaration.sName = captureGroup[i]["name"];
+			declaration.sValue = captureGroup[i]["value"];
+			declarations.push_back(std::move(declaration));
+		}
+
+		return declarations;
+	}
+
+	std::vector<ScriptDeclaration> scannerDeclarations(const std::string& sFileContents)
+	{
+		std::vector<ScriptDeclaration> declarations;
+		ScriptDeclarationScanner::DeclarationCallback addDeclaration = [&](ScriptDeclaration&& declaration) {
+			declarations.push_back(std::move(declaration));
+		};
+		ScriptDeclarationScanner scanner(sFileContents, addDeclaration);
+		scanner.Scan();
+		return declarations;
+	}
+
+	// One line per declaration, sorted: the regular expressions find each kind of member in a pass of
+	// its own, so only the set of declarations can be compared, not their order.
+	std::vector<std::string> describe(const std::vector<ScriptDeclaration>& declarations)
+	{
+		static const char* const kinds[] = { "struct", "function", "constant" };
+
+		std::vector<std::string> lines;
+		for (const ScriptDeclaration& declaration : declarations)
+		{
+			std::string line = std::string(kinds[static_cast<int>(declaration.kind)]) + " [" + declaration.sType + "] ["
+				+ declaration.sName + "] [" + declaration.sValue + "]";
+			for (const ScriptDeclaration::Param& param : declaration.params)
+				line += " ([" + param.sType + "] [" + param.sName + "] [" + param.sDefaultValue + "])";
+			lines.push_back(std::move(line));
+		}
+		std::sort(lines.begin(), lines.end());
+		return lines;
+	}
+
+	size_t g_nScripts = 0;
+	size_t g_nDeclarations = 0;
+
+	void compare(const std::string& what, const std::string& sContents)
+	{
+		g_nScripts++;
+		const std::vector<std::string> expected = describe(regexDeclarations(sContents));
+		const std::vector<std::string> found = describe(scannerDeclarations(sContents));
+		g_nDeclarations += found.size();
+
+		// The first difference is enough to go on
+		const auto difference = std::mismatch(found.begin(), found.end(), expected.begin(), expected.end());
+		if (difference.first != found.end() || difference.second != expected.end())
+		{
+			CHECK_EQUAL(what + ": " + (difference.first != found.end() ? *difference.first : std::string("(none)")),
+				what + ": " + (difference.second != expected.end() ? *difference.second : std::string("(none)")));
+		}
+	}
+
+	std::string withCrLf(const std::string& sContents)
+	{
+		std::string result;
+		for (char c : sContents)
+		{
+			if (c == '\n')
+				result.push_back('\r');
+			result.push_back(c);
+		}
+		return result;
+	}
+
+	void testCorpus()
+	{
+		std::vector<fs::path> scripts;
+		for (const fs::directory_entry& entry : fs::recursive_directory_iterator(NWScriptTests::dataDirectory()))
+		{
+			// Not the tokenizer's corpus: malformed on purpose, it's where the regular expressions go wrong
+			if (entry.path().extension() == ".nss" && entry.path().parent_path().filename() != "lexer")
+				scripts.push_back(entry.path());
+		}
+		std::sort(scripts.begin(), scripts.end());
+
+		CHECK(std::any_of(scripts.begin(), scripts.end(), [](const fs::path& script) { return script.parent_path().filename() == "declarations"; }));
+		for (const fs::path& script : scripts)
+		{
+			const std::string sContents = NWScriptTests::readFile(script);
+			const std::string name = script.lexically_relative(NWScriptTests::dataDirectory()).generic_string();
+			compare(name, sContents);
+			compare(name + " (CRLF)", withCrLf(sContents));
+		}
+	}
+
+	// Where the regular expressions were wrong, and the scanner is not: the only differences expected
+	void testRegexArtifacts()
+	{
+		struct Case
+		{
+			const char* sSource;
+			std::vector<std::string> regex;
+			std::vector<std::string> scanner;
+		};
+
+		const Case cases[] = {
+			// Comment markers in strings start comments for the comment stripping
+			{ "string S = \"// not a comment\";\n", {}, { "constant [string] [S] [\"// not a comment\"]" } },
+			{ "string S = \"/* not a comment */\";\n", { "constant [string] [S] [\"\"]" }, { "constant [string] [S] [\"/* not a comment */\"]" } },
+			// Backtracking splits a word in two to make up a <type> <name> pair
+			{ "int F(int);\n", { "function [int] [F] [] ([in] [t] [])" }, {} },
+			{ "const VALUE = 3;\n", { "constant [VALU] [E] [3]" }, { "constant [const] [VALUE] [3]" } },
+			// Whitespace alone between the parentheses
+			{ "void F( );\n", {}, { "function [void] [F] []" } },
+			// Definitions with a struct parameter are not stripped, and their locals become members
+			{ "void F(struct S s)\n{\n\tint n = 0;\n}\n", { "constant [int] [n] [0]" }, {} },
+		};
+
+		for (const Case& c : cases)
+		{
+			CHECK(describe(regexDeclarations(c.sSource)) == c.regex);
+			CHECK(describe(scannerDeclarations(c.sSource)) == c.scanner);
+		}
+	}
+
+	// A header the size of the game's nwscript.nss, members written the ways it writes them
+	void testGeneratedHeader()
+	{
+		static const char* const types[] = { "int", "float", "string", "object", "vector", "location", "effect" };
+		static const char* const values[] = { "0", "-1", "2.5f", "0x10", "\"text\"", "\"\"", "OBJECT_SELF", "[0.0, 1.0, 2.0]", "TRUE" };
+		static const char* const spaces[] = { " ", "  ", "\t", " \t " };
+
+		std::mt19937 random(20221019);
+		auto pick = [&](const auto& choices) { return choices[random() % std::size(choices)]; };
+
+		std::string sHeader = "#define ENGINE_NUM_STRUCTURES 10\n";
+		for (int i = 0; i < 10; i++)
+			sHeader += "#define ENGINE_STRUCTURE_" + std::to_string(i) + " structure" + std::to_string(i) + "\n";
+
+		for (int i = 0; i < 3000; i++)
+		{
+			const std::string name = "MEMBER_" + std::to_string(i);
+			switch (random() % 4)
+			{
+			case 0:
+				sHeader += std::string(pick(types)) + pick(spaces) + name + pick(spaces) + "=" + pick(spaces) + pick(values) + ";\n";
+				break;
+			case 1:
+				sHeader += "// " + std::to_string(i) + ": a function\n// int NOT_A_MEMBER = 1;\n";
+				[[fallthrough]];
+			default:
+			{
+				sHeader += std::string(pick(types)) + " " + name + "(";
+				const int nParams = random() % 5;
+				for (int p = 0; p < nParams; p++)
+				{
+					sHeader += std::string(p > 0 ? "," : "") + pick(spaces) + pick(types) + " p" + std::to_string(p);
+					if (random() % 3 == 0)
+						sHeader += std::string(pick(spaces)) + "=" + pick(spaces) + pick(values);
+				}
+				sHeader += ");\n";
+				if (random() % 8 == 0)
+					sHeader += "/*\n" + std::string(pick(types)) + " " + name + "_COMMENTED = 1;\n*/\n";
+				break;
+			}
+			}
+		}
+
+		compare("generated header", sHeader);
+		compare("generated header (CRLF)", withCrLf(sHeader));
+	}
+
+}
+
+int main()
+{
+	testCorpus();
+	testRegexArtifacts();
+	testGeneratedHeader();
+	std::cout << g_nScripts << " script(s), " << g_nDeclarations << " declaration(s) compared." << std::endl;
+	return NWScriptTests::testResult();
+}
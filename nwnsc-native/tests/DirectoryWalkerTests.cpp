@@ -0,0 +1,168 @@
+/** @file DirectoryWalkerTests.cpp
+ * The directory walker reports the same files in the same order on every run, whatever its
+ * threads' timings, and batches compile them while the walk is still going on.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <algorithm>
+#include <mutex>
+#include <thread>
+
+#include "BatchCompiler.h"
+#include "DirectoryWalker.h"
+#include "InputCollector.h"
+#include "TestSupport.h"
+
+using namespace NWScriptCli;
+using NWScriptPlugin::DirectoryWalker;
+
+static std::vector<std::string> walk(const fs::path& root, const std::vector<std::string>& masks, bool bRecurse)
+{
+	std::vector<std::string> files;
+	const std::atomic<bool> noCancel = false;
+	DirectoryWalker::Walk(root.string(), masks, bRecurse, noCancel, [&](const std::string& filePath) {
+		files.push_back(fs::path(filePath).lexically_relative(root).string());
+	});
+	return files;
+}
+
+// A tree wide and deep enough for the walker threads to finish directories out of order
+static std::vector<std::string> makeTree(const fs::path& root)
+{
+	std::vector<std::string> expected;
+	for (int a = 0; a < 6; a++)
+	{
+		const std::string dirA = std::string("d").append(std::to_string(a));
+		for (int b = 0; b < 5; b++)
+		{
+			const std::string dirB = dirA + "/s" + std::to_string(b);
+			for (int f = 0; f < 4; f++)
+			{
+				const std::string file = dirB + "/f" + std::to_string(f) + ".nss";
+				NWScriptTests::writeFile(root / file, "void main() {}\n");
+				expected.push_back(file);
+			}
+			NWScriptTests::writeFile(root / (dirB + "/notes.txt"), "");
+		}
+		NWScriptTests::writeFile(root / (dirA + ".nss"), "void main() {}\n");
+		expected.push_back(dirA + ".nss");
+	}
+	NWScriptTests::writeFile(root / "UPPER.NSS", "void main() {}\n");
+	expected.push_back("UPPER.NSS");
+
+	// Path order, component by component: what the walk must give
+	std::sort(expected.begin(), expected.end(), [](const std::string& a, const std::string& b) { return fs::path(a) < fs::path(b); });
+	return expected;
+}
+
+static void testOrderIsFixed()
+{
+	NWScriptTests::TemporaryDirectory dir;
+	const std::vector<std::string> expected = makeTree(dir.path());
+
+	for (int run = 0; run < 20; run++)
+	{
+		if (!CHECK(walk(dir.path(), { "*.nss" }, true) == expected))
+			break;
+	}
+
+	// Without recursion: the top directory only
+	CHECK_EQUAL(walk(dir.path(), { "*.nss" }, false).size(), 7u);
+}
+
+static void testMasks()
+{
+	CHECK(DirectoryWalker::MatchesMask("script.nss", "*.nss"));
+	CHECK(DirectoryWalker::MatchesMask("SCRIPT.NSS", "*.nss"));
+	CHECK(DirectoryWalker::MatchesMask("a.b.nss", "*.nss"));
+	CHECK(DirectoryWalker::MatchesMask("x_1.nss", "x_?.nss"));
+	CHECK(DirectoryWalker::MatchesMask("noext", "*.*"));
+	CHECK(!DirectoryWalker::MatchesMask("script.nss.bak", "*.nss"));
+	CHECK(!DirectoryWalker::MatchesMask("script.ncs", "*.nss"));
+
+	// Several masks, one walk: each file once
+	NWScriptTests::TemporaryDirectory dir;
+	NWScriptTests::writeFile(dir.path() / "a.nss", "");
+	NWScriptTests::writeFile(dir.path() / "b.ncs", "");
+	NWScriptTests::writeFile(dir.path() / "c.txt", "");
+	std::vector<std::string> files = walk(dir.path(), { "*.nss", "*.ncs", "a.*" }, false);
+	CHECK(files == std::vector<std::string>({ "a.nss", "b.ncs" }));
+}
+
+static void testDirectoryLinksNotFollowed()
+{
+	NWScriptTests::TemporaryDirectory dir;
+	NWScriptTests::writeFile(dir.path() / "sub" / "a.nss", "");
+	NWScriptTests::writeFile(dir.path() / "target.nss", "");
+
+	std::error_code ec;
+	fs::create_directory_symlink(dir.path(), dir.path() / "sub" / "loop", ec);
+	fs::create_symlink(dir.path() / "target.nss", dir.path() / "sub" / "link.nss", ec);
+	if (ec)
+		return;
+
+	std::vector<std::string> files = walk(dir.path(), { "*.nss" }, true);
+	CHECK(files == std::vector<std::string>({ "sub/a.nss", "sub/link.nss", "target.nss" }));
+}
+
+// Files found are compiled before the walk is over, and results keep the walk order
+static void testBatchStartsDuringWalk()
+{
+	NWScriptTests::TemporaryDirectory dir;
+	const std::vector<std::string> expected = makeTree(dir.path() / "src");
+
+	IncludeCache includes;
+	includes.addSearchPath(NWScriptTests::dataDirectory());
+	CompilerSettings settings;
+	settings.threads = 4;
+	settings.outputDir = dir.path() / "out";
+	fs::create_directories(settings.outputDir);
+	BatchCompiler compiler(settings, includes);
+
+	std::mutex lock;
+	bool bSourceDone = false;
+	size_t doneBeforeSourceEnded = 0;
+
+	InputCollector collector("nss", true);
+	BatchSummary summary = compiler.run([&](const BatchCompiler::AddFileFunction& addFile) {
+		collector.setFileCallback(addFile);
+		CHECK(collector.add((dir.path() / "src").string()));
+
+		// Holds the end of the "walk" until some files are compiled
+		for (int wait = 0; wait < 500; wait++)
+		{
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				if (doneBeforeSourceEnded > 0)
+					break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		std::lock_guard<std::mutex> guard(lock);
+		bSourceDone = true;
+	}, [&](const FileResult&) {
+		std::lock_guard<std::mutex> guard(lock);
+		if (!bSourceDone)
+			doneBeforeSourceEnded++;
+	});
+
+	CHECK(doneBeforeSourceEnded > 0);
+	CHECK_EQUAL(summary.succeeded, expected.size());
+	if (CHECK_EQUAL(summary.files.size(), expected.size()))
+	{
+		for (size_t i = 0; i < expected.size(); i++)
+			CHECK_EQUAL(summary.files[i].source.lexically_relative(fs::weakly_canonical(dir.path() / "src")).string(), expected[i]);
+	}
+	CHECK(collector.files().size() == expected.size());
+}
+
+int main()
+{
+	testOrderIsFixed();
+	testMasks();
+	testDirectoryLinksNotFollowed();
+	testBatchStartsDuringWalk();
+	return NWScriptTests::testResult();
+}
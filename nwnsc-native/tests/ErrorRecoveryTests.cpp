@@ -0,0 +1,115 @@
+/** @file ErrorRecoveryTests.cpp
+ * Compiles the scripts of tests/data/recovery going on past errors, and compares the diagnostics
+ * with the list at the top of each script: every error once, at its line, and none made up by the
+ * statements recovery dropped.
+ *
+ * The expected list is the comment block following a "// Expected diagnostics:" line, one
+ * "//   <line>: <message>" per error, in the order they are reported.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <algorithm>
+
+#include "BatchCompiler.h"
+#include "IncludeCache.h"
+#include "TestSupport.h"
+
+using namespace NWScriptCli;
+
+static std::vector<std::string> expectedDiagnostics(const fs::path& script)
+{
+	std::vector<std::string> expected;
+	std::istringstream source(NWScriptTests::readFile(script));
+	std::string line;
+	bool bInList = false;
+	while (std::getline(source, line))
+	{
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		if (line == "// Expected diagnostics:")
+			bInList = true;
+		else if (bInList && line.rfind("//   ", 0) == 0)
+			expected.push_back(line.substr(5));
+		else if (bInList)
+			break;
+	}
+	return expected;
+}
+
+static FileResult compile(const fs::path& script, const fs::path& outputDir, int maxErrors)
+{
+	IncludeCache includes;
+	includes.addSearchPath(NWScriptTests::dataDirectory());
+
+	CompilerSettings settings;
+	settings.threads = 1;
+	settings.maxErrors = maxErrors;
+	settings.outputDir = outputDir;
+	fs::create_directories(outputDir);
+
+	BatchCompiler compiler(settings, includes);
+	BatchSummary summary = compiler.run({ script });
+	if (!CHECK_EQUAL(summary.files.size(), 1u))
+		return FileResult();
+	return summary.files[0];
+}
+
+// "<line>: <message>", without the "script.nss(12): Error: " prefix of the compiler's messages
+static std::string describeError(int line, const std::string& message)
+{
+	const size_t text = message.find("Error: ");
+	return std::to_string(line) + ": " + (text == std::string::npos ? message : message.substr(text + 7));
+}
+
+static void testRecoveryScript(const fs::path& script)
+{
+	NWScriptTests::TemporaryDirectory dir;
+	const std::vector<std::string> expected = expectedDiagnostics(script);
+	if (!CHECK(!expected.empty()))
+		return;
+
+	FileResult result = compile(script, dir.path(), 20);
+	CHECK(result.status == FileResult::Status::Failed);
+
+	// The list is only filled past the first error
+	std::vector<std::string> reported;
+	for (const Diagnostic& diagnostic : result.diagnostics)
+	{
+		CHECK_EQUAL(diagnostic.file, script.filename().string());
+		reported.push_back(describeError(diagnostic.line, diagnostic.message));
+	}
+	if (reported.empty())
+		reported.push_back(describeError(result.line, result.message));
+
+	// Named after the script, for the failures to say which one it is
+	const std::string name = script.filename().string() + " ";
+	for (size_t i = 0; i < std::max(expected.size(), reported.size()); i++)
+	{
+		CHECK_EQUAL(name + (i < reported.size() ? reported[i] : std::string()),
+			name + (i < expected.size() ? expected[i] : std::string()));
+	}
+
+	// Stopping at the first error (the default) reports the same first error
+	FileResult first = compile(script, dir.path(), 0);
+	CHECK(first.status == FileResult::Status::Failed);
+	CHECK_EQUAL(describeError(first.line, first.message), expected.front());
+	CHECK(first.diagnostics.empty());
+}
+
+int main()
+{
+	std::vector<fs::path> scripts;
+	for (const fs::directory_entry& entry : fs::directory_iterator(NWScriptTests::dataDirectory() / "recovery"))
+	{
+		if (entry.path().extension() == ".nss")
+			scripts.push_back(entry.path());
+	}
+	std::sort(scripts.begin(), scripts.end());
+
+	CHECK(!scripts.empty());
+	for (const fs::path& script : scripts)
+		testRecoveryScript(script);
+	return NWScriptTests::testResult();
+}
@@ -0,0 +1,198 @@
+/** @file FoldingTests.cpp
+ * Constant folding must not change what a script computes. Every script is compiled with and
+ * without CSCRIPTCOMPILER_OPTIMIZE_FOLD_CONSTANTS and both are run on the NCS virtual machine:
+ * they must print the same, and stop on the same error where the operation fails at run time.
+ *
+ * The scripts cover the edges of the fold functions: integer wrap around, INT_MIN / -1, division
+ * and modulus by zero (left for run time), shift counts of 32 and more, ints promoted to float,
+ * vector and float arithmetic, string comparisons and the conditional jumps a constant condition
+ * removes.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include "ScriptRunner.h"
+
+// Opcodes; after scriptcomp.h, which it relies on
+#include "scriptinternal.h"
+
+using namespace NWScriptTests;
+
+// What folding must do to the code, besides keeping its results
+enum class Folding
+{
+	Shrinks,               // Something folds: the code gets smaller
+	KeepsDivision,         // The failing DIV is left for run time
+	KeepsModulus,          // The failing MODII is left for run time
+	RemovesJumps           // Constant conditions: no JZ left
+};
+
+struct FoldingCase
+{
+	std::string name;
+	std::string body;      // Of main()
+	std::string output;    // Printed by both versions
+	std::string error;     // Part of the run time error both stop on, empty if they finish
+	Folding folding;
+};
+
+// Prints a float to the last bit that matters
+static const std::string printFloat = "void PrintF(float f) { PrintString(FloatToString(f, 0, 9)); }\n";
+static const std::string printVector = "void PrintV(vector v) { PrintString(FloatToString(v.x, 0, 9) + \" \" + "
+	"FloatToString(v.y, 0, 9) + \" \" + FloatToString(v.z, 0, 9)); }\n";
+
+static const std::vector<FoldingCase> g_cases =
+{
+	{ "integers",
+		"PrintInteger(2147483647 + 1);\n"
+		"PrintInteger(65536 * 65536 + 7);\n"
+		"PrintInteger(-7 / 2);\n"
+		"PrintInteger(-7 % 2);\n"
+		"PrintInteger((-2147483647 - 1) % -1);\n"
+		"PrintInteger(~5 ^ 3);\n"
+		"PrintInteger(!0 + !7);\n"
+		"PrintInteger(12 & 10 | 1);\n",
+		"-2147483648\n7\n-3\n-1\n0\n-7\n1\n9\n", "", Folding::Shrinks },
+
+	{ "int_min_division",
+		"PrintString(\"before\");\n"
+		"PrintInteger((-2147483647 - 1) / -1);\n"
+		"PrintString(\"after\");\n",
+		"before\n", "overflow", Folding::KeepsDivision },
+
+	{ "division_by_zero",
+		"PrintString(\"before\");\n"
+		"PrintInteger(1 / 0);\n"
+		"PrintString(\"after\");\n",
+		"before\n", "Division by zero", Folding::KeepsDivision },
+
+	{ "modulus_by_zero",
+		"PrintString(\"before\");\n"
+		"PrintInteger(1 % 0);\n"
+		"PrintString(\"after\");\n",
+		"before\n", "Division by zero", Folding::KeepsModulus },
+
+	{ "float_division_by_zero",
+		"PrintString(\"before\");\n"
+		"PrintF(1.0 / 0.0);\n"
+		"PrintString(\"after\");\n",
+		"before\n", "Division by zero", Folding::KeepsDivision },
+
+	{ "shifts",
+		"PrintInteger(1 << 32);\n"
+		"PrintInteger(1 << 33);\n"
+		"PrintInteger(3 << 31);\n"
+		"PrintInteger(1 << -1);\n"
+		"PrintInteger(-8 >> 32);\n"
+		"PrintInteger(-8 >> 33);\n"
+		"PrintInteger(-8 >>> 1);\n"
+		"PrintInteger(-1 >>> 63);\n",
+		"1\n2\n-2147483648\n-2147483648\n-8\n-4\n2147483644\n1\n", "", Folding::Shrinks },
+
+	{ "int_to_float",
+		"PrintF(3.0 + 1);\n"
+		"PrintF(1 - 0.25);\n"
+		"PrintF(1 / 3.0);\n"
+		"PrintF(16777217 * 1.0);\n"
+		"PrintF(0.1 * 3);\n"
+		"PrintInteger(0.1 + 0.2 == 0.3);\n"
+		"PrintInteger(2.5 > 2.25);\n",
+		"4.000000000\n0.750000000\n0.333333343\n16777216.000000000\n0.300000012\n1\n1\n", "", Folding::Shrinks },
+
+	{ "vectors",
+		"PrintV([1.0, 2.0, 3.0] + [0.5, 0.25, 0.125]);\n"
+		"PrintV([1.0, 2.0, 3.0] - [1.0, 2.0, 3.0]);\n"
+		"PrintV([1.0, 2.0, 3.0] * 0.1);\n"
+		"PrintV(0.1 * [1.0, 2.0, 3.0]);\n"
+		"PrintV([1.0, 2.0, 3.0] / 2.0);\n"
+		"PrintV([1.0, 2.0, 3.0] / -0.25);\n"
+		"PrintV([1.0, 2.0, 3.0] / 3.0);\n",
+		"1.500000000 2.250000000 3.125000000\n"
+		"0.000000000 0.000000000 0.000000000\n"
+		"0.100000001 0.200000003 0.300000012\n"
+		"0.100000001 0.200000003 0.300000012\n"
+		"0.500000000 1.000000000 1.500000000\n"
+		"-4.000000000 -8.000000000 -12.000000000\n"
+		"0.333333343 0.666666687 1.000000000\n", "", Folding::Shrinks },
+
+	{ "strings",
+		"PrintInteger(\"abc\" == \"abc\");\n"
+		"PrintInteger(\"abc\" == \"abd\");\n"
+		"PrintInteger(\"abc\" != \"ABC\");\n"
+		"PrintInteger(\"ab\" + \"c\" == \"abc\");\n"
+		"PrintInteger(\"\" != \"\");\n"
+		"PrintString(\"con\" + \"cat\");\n",
+		"1\n0\n1\n1\n0\nconcat\n", "", Folding::Shrinks },
+
+	{ "constant_conditions",
+		"if (1) PrintString(\"if true\"); else PrintString(\"if true, else\");\n"
+		"if (0) PrintString(\"if false\"); else PrintString(\"if false, else\");\n"
+		"if (2 > 1 && \"a\" == \"a\") PrintString(\"folded condition\");\n"
+		"int n = 0;\n"
+		"while (0) n = n + 100;\n"
+		"do { n = n + 1; } while (0);\n"
+		"while (1) { n = n + 2; break; }\n"
+		"PrintInteger(n);\n"
+		"PrintInteger(1 ? 10 : 20);\n"
+		"PrintInteger(0 ? 10 : 20);\n",
+		"if true\nif false, else\nfolded condition\n3\n10\n20\n", "", Folding::RemovesJumps },
+};
+
+// The error a run stopped on, without the address (folding moves the code)
+static std::string runError(const ScriptRun& run)
+{
+	const size_t address = run.error.find(" at 0x");
+	const size_t end = address == std::string::npos ? std::string::npos : run.error.find(": ", address);
+	return end == std::string::npos ? run.error : run.error.substr(0, address) + run.error.substr(end);
+}
+
+static void testCase(ScriptRunner& runner, const FoldingCase& test)
+{
+	const std::string source = printFloat + printVector + "void main()\n{\n" + test.body + "}\n";
+
+	const CompiledScript plain = runner.compile(source, CSCRIPTCOMPILER_OPTIMIZE_NOTHING);
+	const CompiledScript folded = runner.compile(source, CSCRIPTCOMPILER_OPTIMIZE_FOLD_CONSTANTS);
+	if (!CHECK_EQUAL(test.name + ": " + plain.error, test.name + ": ") || !CHECK_EQUAL(test.name + ": " + folded.error, test.name + ": "))
+		return;
+
+	const ScriptRun plainRun = runner.run(plain.ncs);
+	const ScriptRun foldedRun = runner.run(folded.ncs);
+
+	// Folding keeps the results...
+	CHECK_EQUAL(test.name + ":\n" + foldedRun.output, test.name + ":\n" + plainRun.output);
+	CHECK_EQUAL(test.name + ": " + runError(foldedRun), test.name + ": " + runError(plainRun));
+	CHECK_EQUAL(foldedRun.success, plainRun.success);
+
+	// ...which are those expected, so a case doesn't pass by failing the same way twice
+	CHECK_EQUAL(test.name + ":\n" + plainRun.output, test.name + ":\n" + test.output);
+	if (test.error.empty())
+		CHECK_EQUAL(test.name + ": " + plainRun.error, test.name + ": ");
+	else
+		CHECK(!plainRun.success && plainRun.error.find(test.error) != std::string::npos);
+
+	switch (test.folding)
+	{
+	case Folding::Shrinks:
+		CHECK(folded.ncs.size() < plain.ncs.size());
+		break;
+	case Folding::KeepsDivision:
+		CHECK_EQUAL(ScriptRunner::countOpcode(folded.ncs, CVIRTUALMACHINE_OPCODE_DIV), 1u);
+		break;
+	case Folding::KeepsModulus:
+		CHECK_EQUAL(ScriptRunner::countOpcode(folded.ncs, CVIRTUALMACHINE_OPCODE_MODULUS), 1u);
+		break;
+	case Folding::RemovesJumps:
+		CHECK(ScriptRunner::countOpcode(plain.ncs, CVIRTUALMACHINE_OPCODE_JZ) > 0);
+		CHECK_EQUAL(ScriptRunner::countOpcode(folded.ncs, CVIRTUALMACHINE_OPCODE_JZ), 0u);
+		break;
+	}
+}
+
+int main()
+{
+	ScriptRunner runner;
+	for (const FoldingCase& test : g_cases)
+		testCase(runner, test);
+	return testResult();
+}
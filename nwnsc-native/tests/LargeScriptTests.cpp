@@ -0,0 +1,167 @@
+/** @file LargeScriptTests.cpp
+ * Compiles generated scripts with very large functions and very deep nesting, on a thread with a
+ * small stack: the parse tree walks must not recurse once per statement, branch or operand. Each
+ * compile is timed, so the test doubles as a benchmark of the tree walks.
+ *
+ * The scripts: a flat list of statements, an else-if chain, a switch, a long chain of additions,
+ * nested if blocks and nested parentheses, each of them <size> long (10,000 by default).
+ * The optimizer is run on a smaller size as well, being much slower on these shapes.
+ *
+ * Usage as a benchmark: LargeScriptTests [size] [--optimize]
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <cstring>
+#include <functional>
+
+#include <pthread.h>
+
+#include "BatchCompiler.h"
+#include "IncludeCache.h"
+#include "TestSupport.h"
+
+using namespace NWScriptCli;
+
+// The stack the tree walks used to overflow on 10,000 statements (the default is 8 MB here)
+static constexpr size_t compilerStackSize = 512 * 1024;
+
+static std::string statementList(int size)
+{
+	std::string script = "int g;\nvoid main()\n{\n\tint a = 0;\n";
+	for (int i = 0; i < size; i++)
+		script += "\ta = a + " + std::to_string(i) + " * 2 - (3 + 4);\n";
+	return script + "}\n";
+}
+
+static std::string elseIfChain(int size)
+{
+	std::string script = "int F(int x)\n{\n\tif (x == 0) return 0;\n";
+	for (int i = 1; i < size; i++)
+		script += "\telse if (x == " + std::to_string(i) + ") return " + std::to_string(i) + ";\n";
+	return script + "\telse return -1;\n}\nvoid main() { F(3); }\n";
+}
+
+static std::string switchCases(int size)
+{
+	std::string script = "void main()\n{\n\tint a = 0; int x = 5;\n\tswitch (x)\n\t{\n";
+	for (int i = 0; i < size; i++)
+		script += "\tcase " + std::to_string(i) + ": a = " + std::to_string(i) + "; break;\n";
+	return script + "\t}\n}\n";
+}
+
+static std::string longExpression(int size)
+{
+	std::string script = "void main()\n{\n\tint a = 0";
+	for (int i = 1; i < size; i++)
+		script += " + " + std::to_string(i);
+	return script + ";\n}\n";
+}
+
+static std::string nestedBlocks(int size)
+{
+	std::string script = "void main()\n{\n\tint a = 0;\n";
+	for (int i = 0; i < size; i++)
+		script += "\tif (a < " + std::to_string(i) + ")\n\t{\n";
+	script += "\ta = 1;\n";
+	for (int i = 0; i < size; i++)
+		script += "\t}\n";
+	return script + "}\n";
+}
+
+static std::string nestedParentheses(int size)
+{
+	return "void main()\n{\n\tint a = " + std::string(size, '(') + "1" + std::string(size, ')') + ";\n}\n";
+}
+
+// Runs f on a thread of its own with a stack of stackSize bytes. False if the thread can't be made.
+static bool runWithStack(size_t stackSize, const std::function<void()>& f)
+{
+	pthread_attr_t attributes;
+	pthread_attr_init(&attributes);
+	pthread_attr_setstacksize(&attributes, stackSize);
+
+	pthread_t thread;
+	auto entry = [](void* argument) -> void* {
+		(*static_cast<const std::function<void()>*>(argument))();
+		return nullptr;
+	};
+	const int error = pthread_create(&thread, &attributes, entry, const_cast<std::function<void()>*>(&f));
+	pthread_attr_destroy(&attributes);
+	if (error != 0)
+	{
+		std::cerr << "pthread_create: " << std::strerror(error) << std::endl;
+		return false;
+	}
+
+	pthread_join(thread, nullptr);
+	return true;
+}
+
+static void testScript(const std::string& name, const std::string& script, bool bOptimize)
+{
+	NWScriptTests::TemporaryDirectory dir;
+	const fs::path source = dir.path() / (name + ".nss");
+	NWScriptTests::writeFile(source, script);
+
+	IncludeCache includes;
+	includes.addSearchPath(NWScriptTests::dataDirectory());
+
+	CompilerSettings settings;
+	settings.threads = 1;           // Compiles on the calling thread: the one with the small stack
+	settings.optimizeScript = bOptimize;
+	settings.outputDir = dir.path() / "out";
+	fs::create_directories(settings.outputDir);
+
+	BatchSummary summary;
+	const auto start = std::chrono::steady_clock::now();
+	CHECK(runWithStack(compilerStackSize, [&]() {
+		BatchCompiler compiler(settings, includes);
+		summary = compiler.run({ source });
+	}));
+	const double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	if (!CHECK_EQUAL(summary.files.size(), 1u))
+		return;
+	const FileResult& result = summary.files[0];
+	CHECK_EQUAL(name + ": " + result.message, name + ": ");
+	CHECK(result.status == FileResult::Status::Success);
+	CHECK(fs::exists(settings.outputDir / (name + ".ncs")));
+
+	std::cout << name << (bOptimize ? " (optimized)" : "") << ": " << script.size() / 1024 << " KB, "
+		<< static_cast<int>(result.compileMs) << " ms compiling, " << static_cast<int>(elapsedMs) << " ms in all" << std::endl;
+}
+
+static void testScripts(int size, bool bOptimize)
+{
+	const std::string suffix = "_" + std::to_string(size);
+	testScript("statements" + suffix, statementList(size), bOptimize);
+	testScript("elseif" + suffix, elseIfChain(size), bOptimize);
+	testScript("switch" + suffix, switchCases(size), bOptimize);
+	testScript("expression" + suffix, longExpression(size), bOptimize);
+	testScript("nested_blocks" + suffix, nestedBlocks(size), bOptimize);
+	testScript("nested_parentheses" + suffix, nestedParentheses(size), bOptimize);
+}
+
+int main(int argc, char* argv[])
+{
+	int size = 0;
+	bool bOptimize = false;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--optimize") == 0)
+			bOptimize = true;
+		else
+			size = std::atoi(argv[i]);
+	}
+
+	if (size > 0)
+		testScripts(size, bOptimize);
+	else
+	{
+		testScripts(10000, false);
+		testScripts(1000, true);
+	}
+	return NWScriptTests::testResult();
+}
@@ -0,0 +1,101 @@
+/** @file ScriptDependenciesTests.cpp
+ * The include scan must find every directive the compiler's lexer accepts, and nothing else:
+ * the compile cache and the compile server key and invalidate scripts by it.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include "ScriptDependencies.h"
+#include "TestSupport.h"
+
+using namespace NWScriptCli;
+
+static std::vector<std::string> includeNames(const std::string& source)
+{
+	std::vector<std::string> names;
+	for (const IncludeDirective& directive : scanIncludeDirectives(source))
+		names.push_back(directive.name);
+	return names;
+}
+
+static std::string joined(const std::vector<std::string>& names)
+{
+	std::string result;
+	for (const std::string& name : names)
+		result += (result.empty() ? "" : ",") + name;
+	return result;
+}
+
+static void testDirectivePositions()
+{
+	CHECK_EQUAL(joined(includeNames("#include \"inc_a\"\nvoid main() {}\n")), "inc_a");
+	CHECK_EQUAL(joined(includeNames("   \t#include \"inc_a\"\n")), "inc_a");
+
+	// '#' starts a token wherever it is: the compiler takes these too
+	CHECK_EQUAL(joined(includeNames("int z; #include \"inc_q\"\nvoid main() {}\n")), "inc_q");
+	CHECK_EQUAL(joined(includeNames("int z;#include\"inc_q\"")), "inc_q");
+	CHECK_EQUAL(joined(includeNames("/* header */ #include \"inc_q\"")), "inc_q");
+
+	// The file name is the next token, wherever it is
+	CHECK_EQUAL(joined(includeNames("#include\n\"inc_a\"")), "inc_a");
+	CHECK_EQUAL(joined(includeNames("#include /* which */ \"inc_a\"")), "inc_a");
+	CHECK_EQUAL(joined(includeNames("#include // which\n \"inc_a\"")), "inc_a");
+	CHECK_EQUAL(joined(includeNames("#include r\"inc_a\"")), "inc_a");
+	CHECK_EQUAL(joined(includeNames("#include \"inc_a.nss\"")), "inc_a");
+}
+
+static void testIgnoredText()
+{
+	CHECK_EQUAL(joined(includeNames("// #include \"inc_a\"\n")), "");
+	CHECK_EQUAL(joined(includeNames("/* #include \"inc_a\" */")), "");
+	CHECK_EQUAL(joined(includeNames("string s = \"#include \\\"inc_a\\\"\";")), "");
+	CHECK_EQUAL(joined(includeNames("string s = r\"\n#include \"\"inc_a\"\"\n\";")), "");
+
+	// Another identifier, not the keyword
+	CHECK_EQUAL(joined(includeNames("#include2 \"inc_a\"")), "");
+	CHECK_EQUAL(joined(includeNames("#includes \"inc_a\"")), "");
+
+	// No file name
+	CHECK_EQUAL(joined(includeNames("#include inc_a")), "");
+	CHECK_EQUAL(joined(includeNames("#include \"inc_a\n\"")), "");
+}
+
+static void testLinesAndOffsets()
+{
+	const std::string source = "/* a\n b */\nint z; #include\n \"inc_b\" void main() {}";
+	std::vector<IncludeDirective> directives = scanIncludeDirectives(source);
+	if (!CHECK_EQUAL(directives.size(), 1u))
+		return;
+
+	CHECK_EQUAL(directives[0].line, 3);
+	CHECK_EQUAL(source.substr(directives[0].begin, directives[0].end - directives[0].begin), "#include\n \"inc_b\"");
+
+	// Lines keep counting after the directive
+	directives = scanIncludeDirectives("#include\n\"inc_a\"\n#include \"inc_b\"");
+	if (CHECK_EQUAL(directives.size(), 2u))
+		CHECK_EQUAL(directives[1].line, 3);
+}
+
+static void testMidLineClosure()
+{
+	NWScriptTests::TemporaryDirectory dir;
+	NWScriptTests::writeFile(dir.path() / "main.nss", "int z; #include \"inc_q\"\nvoid main() {}\n");
+	NWScriptTests::writeFile(dir.path() / "inc_q.nss", "int a = 1; #include \"inc_r\"\n");
+	NWScriptTests::writeFile(dir.path() / "inc_r.nss", "int b = 2;\n");
+
+	IncludeCache cache;
+	DependencyList dependencies;
+	CHECK(collectDependencies(cache, dir.path() / "main.nss", dependencies));
+	CHECK_EQUAL(dependencies.includes.size(), 2u);
+	CHECK(dependencies.missing.empty());
+}
+
+int main()
+{
+	testDirectivePositions();
+	testIgnoredText();
+	testLinesAndOffsets();
+	testMidLineClosure();
+	return NWScriptTests::testResult();
+}
@@ -0,0 +1,164 @@
+/** @file ScriptRunner.h
+ * Compiles scripts in memory with chosen optimization flags and runs them on the NCS virtual
+ * machine, for the tests that check what the generated code computes rather than what it looks like.
+ *
+ * The language specification is tests/data/vm/nwscript.nss: printing and conversion actions with
+ * standard handlers, so a script shows its results through PrintString() and friends.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <memory>
+
+#include "exobase.h"
+#include "scriptcomp.h"
+#include "scripterrors.h"
+
+#include "BatchCompiler.h"
+#include "CompilerMessages.h"
+#include "NcsActionTable.h"
+#include "NcsInstruction.h"
+#include "NcsVirtualMachine.h"
+#include "TestSupport.h"
+
+namespace NWScriptTests
+{
+	struct CompiledScript
+	{
+		bool compiled = false;
+		int32_t code = 0;            // Error STRREF when it didn't, 0 otherwise
+		std::string error;           // Captured error message
+		std::vector<uint8_t> ncs;    // Compiled file
+	};
+
+	struct ScriptRun
+	{
+		bool success = false;
+		std::string error;           // Why the virtual machine stopped
+		std::string output;          // Everything printed, a line per call
+		bool hasConditionResult = false;
+		int32_t conditionResult = 0;
+	};
+
+	class ScriptRunner final
+	{
+	public:
+
+		ScriptRunner() {
+			sources()["nwscript"] = readFile(dataDirectory() / "vm" / "nwscript.nss");
+
+			std::string errorMessage;
+			if (!CHECK(_actions.parse(sources()["nwscript"], errorMessage)))
+				std::cerr << errorMessage << std::endl;
+			_actions.addStandardHandlers();
+		}
+
+		// The compiler API callbacks take no user data: one script at a time, on one thread.
+		CompiledScript compile(const std::string& source, uint32_t optimizationFlags) {
+			CScriptCompilerAPI cAPI;
+			cAPI.ResManLoadScriptSourceFile = ResManLoadScriptSourceFile;
+			cAPI.ResManUpdateResourceDirectory = ResManUpdateResourceDirectory;
+			cAPI.ResManWriteToFile = ResManWriteToFile;
+			cAPI.TlkResolve = TlkResolve;
+
+			CScriptCompiler compiler(NWN_RESTYPE_NSS, NWN_RESTYPE_NCS, NWN_RESTYPE_NDB, cAPI);
+			compiler.SetOptimizationFlags(optimizationFlags);
+			compiler.SetCompileConditionalOrMain(1);
+			compiler.SetOutputAlias("");
+			compiler.SetIdentifierSpecification("nwscript");
+
+			sources()["script"] = source;
+			output().clear();
+
+			CompiledScript script;
+			script.code = compiler.CompileFile("script");
+
+			// Sometimes CompileFile returns 1 or -1; the real error is in the captured STRREF.
+			if (script.code == 1 || script.code == -1)
+			{
+				script.code = compiler.GetCapturedErrorStrRef();
+				if (script.code == 0)
+					script.code = STRREF_CSCRIPTCOMPILER_ERROR_FATAL_COMPILER_ERROR;
+			}
+			script.compiled = script.code == 0;
+			script.error = compiler.GetCapturedError()->CStr();
+			script.ncs.assign(output().begin(), output().end());
+			return script;
+		}
+
+		ScriptRun run(const std::vector<uint8_t>& ncs) const {
+			NWScriptCli::NcsVirtualMachine::Options options;
+			options.maxInstructions = 10000000;
+			options.profile = false;
+
+			ScriptRun result;
+			NWScriptCli::NcsVirtualMachine vm(_actions, options);
+			vm.setPrinter([&](std::string_view text) { result.output.append(text).append("\n"); });
+
+			std::vector<uint8_t> copy(ncs);
+			if (!vm.load(std::move(copy), result.error))
+				return result;
+			result.success = vm.run(result.error);
+			result.hasConditionResult = vm.hasConditionResult();
+			result.conditionResult = vm.conditionResult();
+			return result;
+		}
+
+		// Instructions of a compiled script with the given opcode
+		static size_t countOpcode(const std::vector<uint8_t>& ncs, uint8_t opcode) {
+			size_t count = 0;
+			NWScriptPlugin::NcsInstruction instruction;
+			for (uint32_t address = NCS_HEADER_SIZE; address < ncs.size(); address += instruction.size)
+			{
+				if (!NWScriptPlugin::decodeNcsInstruction(ncs.data(), ncs.size(), address, instruction))
+					break;
+				if (instruction.opcode == opcode)
+					count++;
+			}
+			return count;
+		}
+
+	private:
+
+		static std::map<std::string, std::string>& sources() {
+			static std::map<std::string, std::string> scripts;   // By name, without extension
+			return scripts;
+		}
+
+		static std::string& output() {
+			static std::string ncs;                               // Of the last compile
+			return ncs;
+		}
+
+		static BOOL ResManUpdateResourceDirectory(const char*) {
+			return TRUE;
+		}
+
+		static const char* ResManLoadScriptSourceFile(const char* sFileName, RESTYPE nResType) {
+			if (nResType != NWN_RESTYPE_NSS)
+				return nullptr;
+
+			std::string name(sFileName);
+			std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+			std::map<std::string, std::string>::const_iterator source = sources().find(name);
+			return source != sources().end() ? source->second.c_str() : nullptr;
+		}
+
+		static int32_t ResManWriteToFile(const char*, RESTYPE nResType, const uint8_t* pData, size_t nSize, bool) {
+			if (nResType == NWN_RESTYPE_NCS)
+				output().assign(reinterpret_cast<const char*>(pData), nSize);
+			return 0;
+		}
+
+		static const char* TlkResolve(STRREF strRef) {
+			return NWScriptCli::resolveCompilerMessage(strRef);
+		}
+
+		NWScriptCli::NcsActionTable _actions;
+	};
+}
@@ -0,0 +1,232 @@
+/** @file SwitchTests.cpp
+ * Switch dispatch on the NCS virtual machine. Every switch is compiled twice, with the binary
+ * decision tree (CSCRIPTCOMPILER_OPTIMIZE_SWITCH_TREES) and with the linear list of tests, and run
+ * on every case value, its neighbours and the ends of the int range. Both must print what a C
+ * switch would: the labels from the one taken up to the next break.
+ *
+ * The switches are dense and sparse, negative, with INT_MIN and INT_MAX as labels, with and
+ * without default, with fall-through, and with just below and above
+ * CSCRIPTCOMPILER_SWITCH_TREE_THRESHOLD cases. Duplicate case values must still be errors.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <climits>
+#include <set>
+
+#include "ScriptRunner.h"
+
+// Opcodes and the tree threshold; after scriptcomp.h, which it relies on
+#include "scriptinternal.h"
+
+using namespace NWScriptTests;
+
+static constexpr uint32_t linearDispatch = CSCRIPTCOMPILER_OPTIMIZE_EVERYTHING & ~CSCRIPTCOMPILER_OPTIMIZE_SWITCH_TREES;
+static constexpr uint32_t treeDispatch = CSCRIPTCOMPILER_OPTIMIZE_EVERYTHING;
+
+struct SwitchLabel
+{
+	bool isDefault;
+	int32_t value;
+	bool breaks;           // Ends with a break, or falls through into the next label
+};
+
+struct SwitchShape
+{
+	std::string name;
+	std::vector<int32_t> values;   // Case values, in source order
+	int defaultPosition;           // Index of the label the default goes before, -1 for none
+	int fallThroughEvery;          // Every nth label falls through, 0 for none
+};
+
+static std::vector<SwitchLabel> makeLabels(const SwitchShape& shape)
+{
+	std::vector<SwitchLabel> labels;
+	for (size_t i = 0; i <= shape.values.size(); i++)
+	{
+		if (shape.defaultPosition == static_cast<int>(i))
+			labels.push_back({ true, 0, true });
+		if (i < shape.values.size())
+			labels.push_back({ false, shape.values[i], true });
+	}
+
+	for (size_t i = 0; i + 1 < labels.size(); i++)
+		labels[i].breaks = shape.fallThroughEvery == 0 || (i + 1) % shape.fallThroughEvery != 0;
+	return labels;
+}
+
+// INT_MIN has no literal: 2147483648 doesn't fit an int
+static std::string literal(int32_t value)
+{
+	return value == INT_MIN ? "-2147483647 - 1" : std::to_string(value);
+}
+
+static std::string labelText(const SwitchLabel& label)
+{
+	return label.isDefault ? "default" : "case " + std::to_string(label.value);
+}
+
+static std::string switchScript(const std::vector<SwitchLabel>& labels, const std::vector<int32_t>& probes)
+{
+	std::string script = "void Test(int n)\n{\n\tswitch (n)\n\t{\n";
+	for (const SwitchLabel& label : labels)
+	{
+		script += label.isDefault ? "\tdefault:" : "\tcase " + literal(label.value) + ":";
+		script += " PrintString(\"" + labelText(label) + "\");";
+		script += label.breaks ? " break;\n" : "\n";
+	}
+	script += "\t}\n\tPrintString(\"end\");\n}\n\nvoid main()\n{\n";
+	for (int32_t probe : probes)
+		script += "\tTest(" + literal(probe) + ");\n";
+	return script + "}\n";
+}
+
+// What a C switch does with n
+static std::string reference(const std::vector<SwitchLabel>& labels, int32_t n)
+{
+	size_t start = labels.size();
+	for (size_t i = 0; i < labels.size(); i++)
+	{
+		if (!labels[i].isDefault && labels[i].value == n)
+		{
+			start = i;
+			break;
+		}
+	}
+	for (size_t i = 0; i < labels.size() && start == labels.size(); i++)
+	{
+		if (labels[i].isDefault)
+			start = i;
+	}
+
+	std::string output;
+	for (size_t i = start; i < labels.size(); i++)
+	{
+		output += labelText(labels[i]) + "\n";
+		if (labels[i].breaks)
+			break;
+	}
+	return output + "end\n";
+}
+
+// Every case value, the values around it (missing every leaf of the tree) and the ends of the range
+static std::vector<int32_t> probeValues(const std::vector<int32_t>& values)
+{
+	std::set<int32_t> probes = { INT_MIN, INT_MIN + 1, -1, 0, 1, INT_MAX - 1, INT_MAX };
+	for (int32_t value : values)
+	{
+		probes.insert(value);
+		if (value > INT_MIN)
+			probes.insert(value - 1);
+		if (value < INT_MAX)
+			probes.insert(value + 1);
+	}
+	return std::vector<int32_t>(probes.begin(), probes.end());
+}
+
+static void testShape(ScriptRunner& runner, const SwitchShape& shape)
+{
+	const std::vector<SwitchLabel> labels = makeLabels(shape);
+	const std::vector<int32_t> probes = probeValues(shape.values);
+	const std::string script = switchScript(labels, probes);
+
+	std::string expected;
+	for (int32_t probe : probes)
+		expected += reference(labels, probe);
+
+	const CompiledScript linear = runner.compile(script, linearDispatch);
+	const CompiledScript tree = runner.compile(script, treeDispatch);
+	if (!CHECK_EQUAL(shape.name + ": " + linear.error, shape.name + ": ") || !CHECK_EQUAL(shape.name + ": " + tree.error, shape.name + ": "))
+		return;
+
+	const ScriptRun linearRun = runner.run(linear.ncs);
+	const ScriptRun treeRun = runner.run(tree.ncs);
+	CHECK_EQUAL(shape.name + " (linear): " + linearRun.error, shape.name + " (linear): ");
+	CHECK_EQUAL(shape.name + " (tree): " + treeRun.error, shape.name + " (tree): ");
+	CHECK_EQUAL(shape.name + " (linear):\n" + linearRun.output, shape.name + " (linear):\n" + expected);
+	CHECK_EQUAL(shape.name + " (tree):\n" + treeRun.output, shape.name + " (tree):\n" + expected);
+
+	// The tree is there from the threshold on, and only with the optimization (it alone compares with LTII)
+	const bool bTree = shape.values.size() >= CSCRIPTCOMPILER_SWITCH_TREE_THRESHOLD;
+	CHECK_EQUAL(shape.name + ": " + std::to_string(ScriptRunner::countOpcode(tree.ncs, CVIRTUALMACHINE_OPCODE_LT) > 0),
+		shape.name + ": " + std::to_string(bTree));
+	CHECK_EQUAL(ScriptRunner::countOpcode(linear.ncs, CVIRTUALMACHINE_OPCODE_LT), 0u);
+}
+
+static std::vector<int32_t> range(int32_t first, int32_t count)
+{
+	std::vector<int32_t> values;
+	for (int32_t i = 0; i < count; i++)
+		values.push_back(first + i);
+	return values;
+}
+
+static void testDispatch(ScriptRunner& runner)
+{
+	const int32_t threshold = CSCRIPTCOMPILER_SWITCH_TREE_THRESHOLD;
+
+	// Runs of values with one missing here and there: leaves bounded by their own values that still have holes
+	std::vector<int32_t> gaps;
+	for (int32_t value = 0; value < 4 * threshold; value++)
+	{
+		if (value % 5 != 3)
+			gaps.push_back(value);
+	}
+
+	const std::vector<SwitchShape> shapes =
+	{
+		{ "dense_below_threshold", range(0, threshold - 1), static_cast<int>(threshold - 1), 0 },
+		{ "dense_at_threshold", range(0, threshold), static_cast<int>(threshold), 0 },
+		{ "dense_above_threshold", range(1, threshold + 1), -1, 0 },
+		{ "dense_large", range(-20, 64), 30, 0 },
+		{ "dense_with_gaps", gaps, -1, 0 },
+		{ "sparse_below_threshold", { 900, -70, 3, 100000, -2000000, 12, 5000 }, 0, 0 },
+		{ "sparse", { 42, -1000000, 7, 65536, -3, 1 << 30, 1000, -5000, 2147483000 }, 4, 3 },
+		{ "sparse_no_default", { 42, -1000000, 7, 65536, -3, 1 << 30, 1000, -5000, 2147483000, 11, -11, 0 }, -1, 0 },
+		{ "negative", range(-12, 12), -1, 2 },
+		{ "extremes", { INT_MAX, INT_MIN, 100, INT_MIN + 1, -1, 0, 1, INT_MAX - 1 }, 3, 0 },
+		{ "dense_at_int_min", range(INT_MIN, 10), -1, 0 },
+		{ "dense_at_int_max", range(INT_MAX - 9, 10), 10, 0 },
+		{ "fall_through", range(0, 2 * threshold), 2 * threshold, 2 },
+		{ "fall_through_into_default", { 5, 10, 15, 20, 25, 30, 35, 40, 45 }, 5, 1 },
+	};
+
+	for (const SwitchShape& shape : shapes)
+		testShape(runner, shape);
+}
+
+static void testDuplicateCases(ScriptRunner& runner)
+{
+	const int32_t duplicateCase = std::abs(STRREF_CSCRIPTCOMPILER_ERROR_MULTIPLE_CASE_CONSTANT_STATEMENTS_WITHIN_SWITCH);
+	auto compileSwitch = [&](const std::string& cases)
+	{
+		return runner.compile("void main()\n{\n\tint n = 3;\n\tswitch (n)\n\t{\n" + cases + "\t}\n}\n", treeDispatch);
+	};
+
+	std::string manyCases;
+	for (int32_t i = 0; i < 2 * CSCRIPTCOMPILER_SWITCH_TREE_THRESHOLD; i++)
+		manyCases += "\tcase " + std::to_string(i * 7) + ": break;\n";
+
+	CHECK_EQUAL(std::abs(compileSwitch("\tcase 1: break;\n\tcase 2: break;\n\tcase 1: break;\n").code), duplicateCase);
+	CHECK_EQUAL(std::abs(compileSwitch("\tcase 2: break;\n\tcase 1 + 1: break;\n").code), duplicateCase);
+	CHECK_EQUAL(std::abs(compileSwitch("\tcase -5: break;\n\tcase 0 - 5: break;\n").code), duplicateCase);
+	CHECK_EQUAL(std::abs(compileSwitch(manyCases + "\tcase 0: break;\n").code), duplicateCase);
+	CHECK_EQUAL(compileSwitch(manyCases + "\tcase -5: break;\n\tcase 5: break;\n").code, 0);
+
+	// Each switch has its own values: an inner switch may repeat the outer one's
+	const CompiledScript nested = compileSwitch(
+		"\tcase 1: break;\n"
+		"\tcase 3: switch (n) { case 1: break; case 3: PrintString(\"inner 3\"); break; }\n"
+		"\t\tPrintString(\"outer 3\"); break;\n");
+	if (CHECK_EQUAL(nested.error, ""))
+		CHECK_EQUAL(runner.run(nested.ncs).output, "inner 3\nouter 3\n");
+}
+
+int main()
+{
+	ScriptRunner runner;
+	testDispatch(runner);
+	testDuplicateCases(runner);
+	return testResult();
+}
@@ -0,0 +1,116 @@
+/** @file TestSupport.h
+ * Minimal checks and file helpers shared by the nwnsc-native regression tests.
+ *
+ * Every test is its own executable: checks report their failures and keep going, and
+ * main() returns testResult(), which ctest reads as the outcome.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace NWScriptTests
+{
+	inline int& failureCount()
+	{
+		static int failures = 0;
+		return failures;
+	}
+
+	template <typename A, typename B>
+	bool checkEqual(const A& actual, const B& expected, const char* actualText, const char* file, int line)
+	{
+		if (actual == expected)
+			return true;
+
+		std::ostringstream message;
+		message << file << "(" << line << "): " << actualText << " is \"" << actual << "\", expected \"" << expected << "\"";
+		std::cerr << message.str() << std::endl;
+		failureCount()++;
+		return false;
+	}
+
+	inline bool check(bool condition, const char* conditionText, const char* file, int line)
+	{
+		if (condition)
+			return true;
+
+		std::cerr << file << "(" << line << "): check failed: " << conditionText << std::endl;
+		failureCount()++;
+		return false;
+	}
+
+	// Exit code of the test: 0 when every check passed
+	inline int testResult()
+	{
+		if (failureCount() > 0)
+			std::cerr << failureCount() << " check(s) failed." << std::endl;
+		return failureCount() > 0 ? 1 : 0;
+	}
+
+	inline std::string readFile(const fs::path& path)
+	{
+		std::ifstream in(path, std::ios::binary);
+		return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+
+	inline void writeFile(const fs::path& path, const std::string& contents)
+	{
+		fs::create_directories(path.parent_path());
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		out << contents;
+	}
+
+	// Bundled test files (tests/data)
+	inline fs::path dataDirectory()
+	{
+		return NWNSC_TEST_DATA_DIR;
+	}
+
+	// A scratch directory, removed with everything in it when the test is done
+	class TemporaryDirectory final
+	{
+	public:
+
+		TemporaryDirectory() {
+			static std::atomic<unsigned> counter = 0;
+			_path = fs::temp_directory_path() / ("nwnsc-test-" + std::to_string(getpid()) + "-" + std::to_string(counter++));
+			fs::remove_all(_path);
+			fs::create_directories(_path);
+		}
+
+		~TemporaryDirectory() {
+			std::error_code ec;
+			fs::remove_all(_path, ec);
+		}
+
+		TemporaryDirectory(const TemporaryDirectory&) = delete;
+		TemporaryDirectory& operator=(const TemporaryDirectory&) = delete;
+
+		const fs::path& path() const {
+			return _path;
+		}
+
+	private:
+
+		fs::path _path;
+	};
+}
+
+#define CHECK(condition) NWScriptTests::check((condition), #condition, __FILE__, __LINE__)
+#define CHECK_EQUAL(actual, expected) NWScriptTests::checkEqual((actual), (expected), #actual, __FILE__, __LINE__)
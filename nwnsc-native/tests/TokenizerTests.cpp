@@ -0,0 +1,298 @@
+/** @file TokenizerTests.cpp
+ * Differential test of the native compiler's tokenizer. Every script is compiled twice: consuming
+ * runs of characters in bulk (the tokenizer in use), and one character at a time (the tokenizer as
+ * it was before the runs). Both must hand the parser the same tokens, at the same lines and columns,
+ * and end with the same errors and outputs.
+ *
+ * The scripts are those of tests/data/lexer and variants made from them: CRLF line ends, every
+ * prefix (constructs cut at every character), tokens around the length limit, bytes above 0x7F
+ * and random sequences of token fragments.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <random>
+
+#include "exobase.h"
+#include "scriptcomp.h"
+
+#include "BatchCompiler.h"
+#include "CompilerMessages.h"
+#include "TestSupport.h"
+
+// The compiler API callbacks take no user data; the test runs on one thread.
+static std::map<std::string, std::string> g_sources;      // Scripts by lowercase name, without extension
+static std::map<std::string, std::string> g_outputs;      // Files written by the last compile, by name
+
+static std::string toLower(std::string s)
+{
+	std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	return s;
+}
+
+static BOOL ResManUpdateResourceDirectory(const char*)
+{
+	return TRUE;
+}
+
+static const char* ResManLoadScriptSourceFile(const char* sFileName, RESTYPE nResType)
+{
+	if (nResType != NWN_RESTYPE_NSS)
+		return nullptr;
+
+	std::map<std::string, std::string>::const_iterator source = g_sources.find(toLower(sFileName));
+	return source != g_sources.end() ? source->second.c_str() : nullptr;
+}
+
+static int32_t ResManWriteToFile(const char* sFileName, RESTYPE nResType, const uint8_t* pData, size_t nSize, bool)
+{
+	g_outputs[std::string(sFileName) + "." + std::to_string(nResType)].assign(reinterpret_cast<const char*>(pData), nSize);
+	return 0;
+}
+
+static const char* TlkResolve(STRREF strRef)
+{
+	return NWScriptCli::resolveCompilerMessage(strRef);
+}
+
+// All a compile shows of its tokenizer
+struct CompileTrace
+{
+	std::vector<std::string> tokens;
+	std::vector<std::string> errors;
+	std::map<std::string, std::string> outputs;
+};
+
+static std::string describeToken(const CScriptCompilerToken& token)
+{
+	return std::to_string(token.m_nLine) + ":" + std::to_string(token.m_nCharacterOnLine) + " [" +
+		std::to_string(token.m_nTokenStatus) + "] " + std::string(token.m_sToken.CStr(), token.m_sToken.GetLength());
+}
+
+class Tokenizer
+{
+public:
+	explicit Tokenizer(bool bCharacterRuns)
+	{
+		CScriptCompilerAPI cAPI;
+		cAPI.ResManLoadScriptSourceFile = ResManLoadScriptSourceFile;
+		cAPI.ResManUpdateResourceDirectory = ResManUpdateResourceDirectory;
+		cAPI.ResManWriteToFile = ResManWriteToFile;
+		cAPI.TlkResolve = TlkResolve;
+
+		_compiler = std::make_unique<CScriptCompiler>(NWN_RESTYPE_NSS, NWN_RESTYPE_NCS, NWN_RESTYPE_NDB, cAPI);
+		_compiler->SetCharacterRuns(bCharacterRuns ? TRUE : FALSE);
+		_compiler->SetTokenTrace(&_tokens);
+		_compiler->SetGenerateDebuggerOutput(1);
+		_compiler->SetCompileConditionalOrMain(1);
+		_compiler->SetOutputAlias("");
+		_compiler->SetMaxErrors(8);
+
+		// The language specification goes through the same tokenizer
+		_compiler->SetIdentifierSpecification("nwscript");
+		_specification = takeTrace("");
+	}
+
+	const CompileTrace& specification() const { return _specification; }
+
+	CompileTrace compile(const std::string& name)
+	{
+		int32_t code = _compiler->CompileFile(name.c_str());
+		return takeTrace(std::to_string(code) + " " + std::to_string(_compiler->GetCapturedErrorStrRef()));
+	}
+
+private:
+	CompileTrace takeTrace(const std::string& result)
+	{
+		CompileTrace trace;
+		for (const CScriptCompilerToken& token : _tokens)
+			trace.tokens.push_back(describeToken(token));
+		_tokens.clear();
+
+		trace.errors.push_back(result + " " + _compiler->GetCapturedError()->CStr());
+		for (const CScriptCompilerDiagnostic& diagnostic : _compiler->GetDiagnostics())
+			trace.errors.push_back(std::string(diagnostic.m_sFileName.CStr()) + "(" + std::to_string(diagnostic.m_nLine) + "): " + diagnostic.m_sErrorText.CStr());
+
+		trace.outputs.swap(g_outputs);
+		g_outputs.clear();
+		return trace;
+	}
+
+	std::unique_ptr<CScriptCompiler> _compiler;
+	std::vector<CScriptCompilerToken> _tokens;
+	CompileTrace _specification;
+};
+
+// Reports the first difference between the two traces
+static bool sameTraces(const std::string& what, const CompileTrace& runs, const CompileTrace& characters)
+{
+	const size_t nTokens = std::max(runs.tokens.size(), characters.tokens.size());
+	for (size_t i = 0; i < nTokens; i++)
+	{
+		const std::string a = i < runs.tokens.size() ? runs.tokens[i] : "(no token)";
+		const std::string b = i < characters.tokens.size() ? characters.tokens[i] : "(no token)";
+		if (!CHECK_EQUAL(what + ", token " + std::to_string(i) + ": " + a, what + ", token " + std::to_string(i) + ": " + b))
+			return false;
+	}
+
+	if (!CHECK_EQUAL(runs.errors.size(), characters.errors.size()))
+		return false;
+	for (size_t i = 0; i < runs.errors.size(); i++)
+	{
+		if (!CHECK_EQUAL(what + ": " + runs.errors[i], what + ": " + characters.errors[i]))
+			return false;
+	}
+
+	if (!CHECK_EQUAL(runs.outputs.size(), characters.outputs.size()))
+		return false;
+	for (const auto& [name, contents] : runs.outputs)
+	{
+		std::map<std::string, std::string>::const_iterator other = characters.outputs.find(name);
+		if (!CHECK(other != characters.outputs.end()) || !CHECK(other->second == contents))
+		{
+			std::cerr << what << ": output " << name << " differs." << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+struct Tokenizers
+{
+	Tokenizer runs{ true };
+	Tokenizer characters{ false };
+	size_t compared = 0;
+
+	// Compiles the script as "lexer_test", both ways
+	bool compare(const std::string& what, const std::string& source)
+	{
+		g_sources["lexer_test"] = source;
+		compared++;
+		if (sameTraces(what, runs.compile("lexer_test"), characters.compile("lexer_test")))
+			return true;
+
+		if (source.size() < 1000)
+			std::cerr << what << ":" << std::endl << source << std::endl;
+		return false;
+	}
+};
+
+static std::string withCrlf(const std::string& source)
+{
+	std::string converted;
+	for (char c : source)
+	{
+		if (c == '\n')
+			converted += '\r';
+		converted += c;
+	}
+	return converted;
+}
+
+static void testCorpus(Tokenizers& tokenizers, const std::map<std::string, std::string>& corpus)
+{
+	for (const auto& [name, source] : corpus)
+	{
+		if (!tokenizers.compare(name, source) || !tokenizers.compare(name + " (CRLF)", withCrlf(source)))
+			continue;
+
+		// Every construct cut short, at every character
+		for (size_t length = 0; length < source.size(); length++)
+		{
+			if (!tokenizers.compare(name + " (first " + std::to_string(length) + " characters)", source.substr(0, length)))
+				break;
+		}
+	}
+}
+
+// Identifiers, numbers, strings and comments around CSCRIPTCOMPILER_MAX_TOKEN_LENGTH
+static void testLongTokens(Tokenizers& tokenizers)
+{
+	for (int length = CSCRIPTCOMPILER_MAX_TOKEN_LENGTH - 2; length <= CSCRIPTCOMPILER_MAX_TOKEN_LENGTH + 1; length++)
+	{
+		const std::string run(static_cast<size_t>(length), 'a');
+		const std::string digits(static_cast<size_t>(length), '7');
+		const std::string what = " of " + std::to_string(length) + " characters";
+
+		tokenizers.compare("identifier" + what, "void main() { int " + run + " = 1; }\n");
+		tokenizers.compare("integer" + what, "void main() { int i = " + digits + "; }\n");
+		tokenizers.compare("hex integer" + what, "void main() { int i = 0x" + digits + "; }\n");
+		tokenizers.compare("float" + what, "void main() { float f = 1." + digits + "f; }\n");
+		tokenizers.compare("string" + what, "void main() { string s = \"" + run + "\"; }\n");
+		tokenizers.compare("escaped string" + what, "void main() { string s = \"\\n" + run + "\"; }\n");
+		tokenizers.compare("hex escape" + what, "void main() { string s = \"" + run + "\\x41\"; }\n");
+		tokenizers.compare("raw string" + what, "void main() { string s = r\"" + run + "\"; }\n");
+		tokenizers.compare("comment" + what, "void main() { /*" + run + "*/ }\n//" + run + "\n");
+	}
+}
+
+// Bytes above 0x7F in identifiers, strings and comments (chars are signed on most compilers)
+static void testHighBytes(Tokenizers& tokenizers)
+{
+	for (int byte : { 0x80, 0xA0, 0xE9, 0xFE, 0xFF })
+	{
+		const std::string c(1, static_cast<char>(byte));
+		const std::string what = " with byte " + std::to_string(byte);
+		tokenizers.compare("identifier" + what, "void main() { int ab" + c + "cd = 1; }\n");
+		tokenizers.compare("string" + what, "void main() { string s = \"ab" + c + "cd\"; PrintString(s); }\n");
+		tokenizers.compare("raw string" + what, "void main() { string s = r\"ab" + c + "cd\"; PrintString(s); }\n");
+		tokenizers.compare("comment" + what, "void main() { /* ab" + c + "cd */ } // " + c + "\n");
+		tokenizers.compare("blank space" + what, "void main() {" + c + "}\n");
+	}
+}
+
+// Random sequences of the fragments the tokenizer treats differently
+static void testRandomFragments(Tokenizers& tokenizers)
+{
+	static const char* const fragments[] = {
+		"void", "main", "(", ")", "{", "}", " ", "  ", "\t", "\n", "\r\n", "int", "a", "b1", "_c", "r", "R",
+		"\"", "r\"", "R\"", "\"\"", "\\", "\\n", "\\x4", "\\x41", "\\\"", "/", "*", "/*", "*/", "//", "#include",
+		"#", "0", "7", "0x", "0xAf", "1.5", ".5", "3.f", "2.5f", "f", ".", ";", ",", "=", "==", "!=", "<", "<<",
+		">", ">>", ">>>", ">>=", "&&", "||", "&", "|", "^", "~", "!", "+", "++", "-", "--", "%", "?", ":", "[", "]",
+		"\xE9", "\xFF", "@", "string", "float", "const", "struct", "PrintString",
+	};
+	const size_t nFragments = sizeof(fragments) / sizeof(fragments[0]);
+
+	std::mt19937 random(20221024);
+	for (int script = 0; script < 400; script++)
+	{
+		std::string source = script % 2 ? "void main()\n{\n" : "";
+		const size_t length = 1 + random() % 60;
+		for (size_t i = 0; i < length; i++)
+			source += fragments[random() % nFragments];
+
+		if (!tokenizers.compare("random script " + std::to_string(script), source))
+			break;
+	}
+}
+
+int main()
+{
+	std::map<std::string, std::string> corpus;
+	g_sources["nwscript"] = NWScriptTests::readFile(NWScriptTests::dataDirectory() / "nwscript.nss");
+	for (const fs::directory_entry& entry : fs::directory_iterator(NWScriptTests::dataDirectory() / "lexer"))
+	{
+		if (entry.path().extension() != ".nss")
+			continue;
+		const std::string source = NWScriptTests::readFile(entry.path());
+		g_sources[toLower(entry.path().stem().string())] = source;
+		corpus[entry.path().filename().string()] = source;
+	}
+	CHECK(!corpus.empty());
+
+	Tokenizers tokenizers;
+	CHECK(!tokenizers.runs.specification().tokens.empty());
+	sameTraces("nwscript.nss", tokenizers.runs.specification(), tokenizers.characters.specification());
+
+	testCorpus(tokenizers, corpus);
+	testLongTokens(tokenizers);
+	testHighBytes(tokenizers);
+	testRandomFragments(tokenizers);
+
+	std::cout << tokenizers.compared << " script(s) compared." << std::endl;
+	return NWScriptTests::testResult();
+}
@@ -0,0 +1,446 @@
+/** @file AutoCompleteIndex.cpp
+ * Ranked, fuzzy auto-completion over the engine and user-defined tokens.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include "pch.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+
+#include "AutoCompleteIndex.h"
+
+using namespace NWScriptPlugin;
+
+namespace {
+
+	// Names longer than this only match by prefix (word starts are kept in 64 bits)
+	constexpr size_t maxFuzzyLength = 64;
+	constexpr int32_t noMatch = INT32_MIN / 2;
+
+	// Match scores. Prefix matches get prefixTier on top, so they always come before abbreviations.
+	constexpr int32_t prefixTier = 1000;
+	constexpr int32_t scoreChar = 16;
+	constexpr int32_t bonusNameStart = 32;
+	constexpr int32_t bonusWordStart = 24;
+	constexpr int32_t bonusConsecutive = 12;
+	constexpr int32_t bonusSameCase = 2;
+	constexpr int32_t bonusExactName = 20;
+	constexpr int32_t penaltyGap = 2;
+
+	// Ranking, added to the match scores
+	constexpr int32_t bonusUsageStep = 12;
+	constexpr int32_t bonusUsageMax = 48;
+	constexpr int32_t bonusExpectedType = 40;
+	constexpr int32_t bonusUserDefined = 6;
+	constexpr int32_t bonusKeyword = 4;
+	constexpr int32_t penaltyParam = 2;
+
+	// Characters used in names: a-z, 0-9 and _ (anything else shares the last slot)
+	inline uint8_t charClass(char c)
+	{
+		if (c >= 'a' && c <= 'z')
+			return static_cast<uint8_t>(c - 'a');
+		if (c >= 'A' && c <= 'Z')
+			return static_cast<uint8_t>(c - 'A');
+		if (c >= '0' && c <= '9')
+			return static_cast<uint8_t>(26 + c - '0');
+		if (c == '_')
+			return 36;
+		return 63;
+	}
+
+	inline bool isLower(char c) { return c >= 'a' && c <= 'z'; }
+	inline bool isUpper(char c) { return c >= 'A' && c <= 'Z'; }
+	inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+	inline bool isWordChar(char c) { return isLower(c) || isUpper(c) || isDigit(c) || c == '_'; }
+	inline char toLower(char c) { return isUpper(c) ? static_cast<char>(c - 'A' + 'a') : c; }
+
+	// Whether a word starts at name[i]: GetPCSpeaker -> Get, PC, Speaker; OBJECT_TYPE_CREATURE -> OBJECT, TYPE, CREATURE
+	bool isWordStart(std::string_view name, size_t i)
+	{
+		if (i == 0)
+			return true;
+
+		const char c = name[i];
+		const char prev = name[i - 1];
+		if (c == '_')
+			return false;
+		if (prev == '_')
+			return true;
+		if (isUpper(c) && (isLower(prev) || isDigit(prev)))
+			return true;
+		if (isUpper(c) && isUpper(prev) && i + 1 < name.size() && isLower(name[i + 1]))
+			return true;
+		return isDigit(c) && !isDigit(prev);
+	}
+
+	std::string lowerCase(std::string_view s)
+	{
+		std::string lower(s);
+		for (char& c : lower)
+			c = toLower(c);
+		return lower;
+	}
+
+	uint64_t wordStartsMask(std::string_view name)
+	{
+		uint64_t mask = 0;
+		for (size_t j = 0; j < name.size() && j < maxFuzzyLength; j++)
+		{
+			if (isWordStart(name, j))
+				mask |= uint64_t(1) << j;
+		}
+		return mask;
+	}
+
+	// Best alignment of the typed characters in a name, in order, where each one either starts a word or
+	// follows the one before it (gpcs -> Get PC Speaker, otc -> OBJECT TYPE CREATURE). Scores each matched
+	// character, with bonuses for word starts and runs, and penalties for the words skipped in between.
+	int32_t fuzzyScore(std::string_view typed, std::string_view lowerTyped, std::string_view name, std::string_view lowerName,
+		uint64_t wordStarts)
+	{
+		const size_t m = typed.size();
+		const size_t n = name.size();
+		if (n > maxFuzzyLength || m > n)
+			return noMatch;
+
+		auto isStart = [wordStarts](size_t j) { return (wordStarts >> j) & 1; };
+		auto charScore = [&](size_t i, size_t j) {
+			int32_t score = scoreChar;
+			if (j == 0)
+				score += bonusNameStart;
+			else if (isStart(j))
+				score += bonusWordStart;
+			if (name[j] == typed[i])
+				score += bonusSameCase;
+			return score;
+		};
+
+		// prev[j]: best score with the previous typed character matched at name[j]
+		int32_t rows[2][maxFuzzyLength];
+		int32_t* prev = rows[0];
+		int32_t* cur = rows[1];
+
+		for (size_t j = 0; j < n; j++)
+			prev[j] = (lowerName[j] == lowerTyped[0] && isStart(j)) ? charScore(0, j) - static_cast<int32_t>(j) : noMatch;
+
+		for (size_t i = 1; i < m; i++)
+		{
+			// Best of prev[k] + penaltyGap * k for k <= j - 2 (a gap before j), kept as j goes
+			int32_t bestWithGap = noMatch;
+			cur[0] = noMatch;
+			for (size_t j = 1; j < n; j++)
+			{
+				if (j >= 2 && prev[j - 2] != noMatch)
+					bestWithGap = (std::max)(bestWithGap, prev[j - 2] + penaltyGap * static_cast<int32_t>(j - 2));
+
+				cur[j] = noMatch;
+				if (lowerName[j] != lowerTyped[i])
+					continue;
+
+				int32_t best = noMatch;
+				if (prev[j - 1] != noMatch)
+					best = prev[j - 1] + (isStart(j) ? 0 : bonusConsecutive);
+				if (bestWithGap != noMatch && isStart(j))
+					best = (std::max)(best, bestWithGap - penaltyGap * static_cast<int32_t>(j - 1));
+				if (best != noMatch)
+					cur[j] = best + charScore(i, j);
+			}
+			std::swap(prev, cur);
+		}
+
+		int32_t best = noMatch;
+		for (size_t j = m - 1; j < n; j++)
+			best = (std::max)(best, prev[j]);
+		if (best == noMatch)
+			return noMatch;
+
+		// Of two equally good matches, the shorter name leaves less to type around
+		return best - static_cast<int32_t>((n - m) / 4);
+	}
+
+	int32_t prefixScore(std::string_view typed, std::string_view name)
+	{
+		const size_t m = typed.size();
+		int32_t score = prefixTier + scoreChar * static_cast<int32_t>(m) - static_cast<int32_t>((name.size() - m) / 2);
+		if (name.compare(0, m, typed) == 0)
+			score += bonusSameCase * static_cast<int32_t>(m);
+		if (name.size() == m)
+			score += bonusExactName;
+		return score;
+	}
+
+	bool betterMatch(const AutoCompleteIndex::Match& a, const AutoCompleteIndex::Match& b)
+	{
+		// Symbols are sorted by name, so ties stay alphabetical
+		if (a.nScore != b.nScore)
+			return a.nScore > b.nScore;
+		return a.nSymbol < b.nSymbol;
+	}
+}
+
+void AutoCompleteIndex::Clear()
+{
+	_symbols.clear();
+	_lowerNames.clear();
+	_charMasks.clear();
+	_wordStartMasks.clear();
+	_usage.clear();
+	for (std::vector<uint32_t>& wordStarts : _wordStarts)
+		wordStarts.clear();
+	_symbolByName.clear();
+	_types.clear();
+}
+
+void AutoCompleteIndex::AddMembers(const NWScriptParser::ScriptParseResults& results, bool bUserDefined)
+{
+	_symbols.reserve(_symbols.size() + results.MembersCount());
+	results.ForEachMember([&](const NWScriptParser::ScriptMember& m) {
+		if (m.sName.empty())
+			return;
+
+		Symbol& s = _symbols.emplace_back();
+		s.sName = m.sName;
+		s.sType = m.sType;
+		s.mID = m.mID;
+		s.nParams = static_cast<uint8_t>((std::min)(m.params.size(), size_t(255)));
+		s.bUserDefined = bUserDefined;
+	});
+}
+
+void AutoCompleteIndex::Build()
+{
+	// Sort by name, then drop repeated names. The stable sort keeps the one added first.
+	std::stable_sort(_symbols.begin(), _symbols.end(), [](const Symbol& a, const Symbol& b) { return a.sName < b.sName; });
+	_symbols.erase(std::unique(_symbols.begin(), _symbols.end(),
+		[](const Symbol& a, const Symbol& b) { return a.sName == b.sName; }), _symbols.end());
+
+	// Then case-insensitive, which is how prefixes are looked up
+	std::vector<std::string> lowerNames;
+	lowerNames.reserve(_symbols.size());
+	for (const Symbol& s : _symbols)
+		lowerNames.push_back(lowerCase(s.sName));
+
+	std::vector<uint32_t> order(_symbols.size());
+	for (uint32_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+		if (lowerNames[a] != lowerNames[b])
+			return lowerNames[a] < lowerNames[b];
+		return _symbols[a].sName < _symbols[b].sName;
+		});
+
+	std::vector<Symbol> symbols;
+	symbols.reserve(_symbols.size());
+	_lowerNames.clear();
+	_lowerNames.reserve(_symbols.size());
+	for (uint32_t i : order)
+	{
+		symbols.push_back(std::move(_symbols[i]));
+		_lowerNames.push_back(std::move(lowerNames[i]));
+	}
+	_symbols = std::move(symbols);
+
+	_charMasks.assign(_symbols.size(), 0);
+	_wordStartMasks.assign(_symbols.size(), 0);
+	for (std::vector<uint32_t>& wordStarts : _wordStarts)
+		wordStarts.clear();
+	_symbolByName.clear();
+	_symbolByName.reserve(_symbols.size());
+	_types.clear();
+
+	for (uint32_t i = 0; i < _symbols.size(); i++)
+	{
+		const std::string& name = _symbols[i].sName;
+		for (size_t j = 0; j < name.size(); j++)
+		{
+			const uint8_t c = charClass(name[j]);
+			_charMasks[i] |= uint64_t(1) << c;
+			if (isWordStart(name, j) && (_wordStarts[c].empty() || _wordStarts[c].back() != i))
+				_wordStarts[c].push_back(i);
+		}
+
+		_wordStartMasks[i] = wordStartsMask(name);
+		_symbolByName.insert({ name, i });
+		if (!_symbols[i].sType.empty())
+			_types.insert(_symbols[i].sType);
+	}
+
+	recountUsage();
+}
+
+void AutoCompleteIndex::Query(std::string_view sTyped, std::vector<Match>& outMatches, size_t maxResults,
+	std::string_view sExpectedType) const
+{
+	outMatches.clear();
+	if (sTyped.empty() || _symbols.empty() || maxResults == 0)
+		return;
+
+	// Only types some symbol has are worth favoring (the line may end in something like "return x =")
+	if (!sExpectedType.empty() && _types.find(sExpectedType) == _types.end())
+		sExpectedType = {};
+
+	const std::string lowerTyped = lowerCase(sTyped);
+	const size_t m = lowerTyped.size();
+
+	// All names starting with the typed text
+	const auto first = std::lower_bound(_lowerNames.begin(), _lowerNames.end(), lowerTyped,
+		[m](const std::string& name, const std::string& typed) { return name.compare(0, m, typed) < 0; });
+	const auto last = std::upper_bound(first, _lowerNames.end(), lowerTyped,
+		[m](const std::string& typed, const std::string& name) { return name.compare(0, m, typed) > 0; });
+	const uint32_t prefixBegin = static_cast<uint32_t>(first - _lowerNames.begin());
+	const uint32_t prefixEnd = static_cast<uint32_t>(last - _lowerNames.begin());
+
+	for (uint32_t i = prefixBegin; i < prefixEnd; i++)
+		outMatches.push_back({ i, rank(i, prefixScore(sTyped, _symbols[i].sName), sExpectedType) });
+
+	// Abbreviations, among the names with a word starting like the typed text and all of its characters.
+	// Single characters would match too much to be any help.
+	if (m >= 2)
+	{
+		uint64_t typedMask = 0;
+		for (char c : lowerTyped)
+			typedMask |= uint64_t(1) << charClass(c);
+
+		for (uint32_t i : _wordStarts[charClass(lowerTyped[0])])
+		{
+			if ((i >= prefixBegin && i < prefixEnd) || (_charMasks[i] & typedMask) != typedMask)
+				continue;
+
+			const int32_t score = fuzzyScore(sTyped, lowerTyped, _symbols[i].sName, _lowerNames[i], _wordStartMasks[i]);
+			if (score != noMatch)
+				outMatches.push_back({ i, rank(i, score, sExpectedType) });
+		}
+	}
+
+	if (outMatches.size() > maxResults)
+	{
+		std::nth_element(outMatches.begin(), outMatches.begin() + maxResults, outMatches.end(), betterMatch);
+		outMatches.resize(maxResults);
+	}
+	std::sort(outMatches.begin(), outMatches.end(), betterMatch);
+}
+
+void AutoCompleteIndex::SetDocumentUsage(uintptr_t nDocumentID, std::string_view sText)
+{
+	std::unordered_map<std::string_view, uint32_t> counts;
+	size_t i = 0;
+	while (i < sText.size())
+	{
+		if (!isWordChar(sText[i]))
+		{
+			i++;
+			continue;
+		}
+
+		const size_t start = i;
+		while (i < sText.size() && isWordChar(sText[i]))
+			i++;
+
+		// Numbers (including 0x1F and such) aren't identifiers
+		if (!isDigit(sText[start]))
+			counts[sText.substr(start, i - start)]++;
+	}
+
+	std::vector<std::pair<std::string, uint32_t>>& usage = _documentUsage[nDocumentID];
+	usage.clear();
+	usage.reserve(counts.size());
+	for (const auto& [identifier, count] : counts)
+		usage.push_back({ std::string(identifier), count });
+
+	recountUsage();
+}
+
+void AutoCompleteIndex::RemoveDocument(uintptr_t nDocumentID)
+{
+	if (_documentUsage.erase(nDocumentID) > 0)
+		recountUsage();
+}
+
+std::string_view AutoCompleteIndex::ExpectedType(std::string_view sLineBeforeWord)
+{
+	size_t end = sLineBeforeWord.size();
+	auto skipSpaces = [&]() {
+		while (end > 0 && (sLineBeforeWord[end - 1] == ' ' || sLineBeforeWord[end - 1] == '\t'))
+			end--;
+	};
+	auto skipWord = [&]() {
+		const size_t wordEnd = end;
+		while (end > 0 && isWordChar(sLineBeforeWord[end - 1]))
+			end--;
+		return sLineBeforeWord.substr(end, wordEnd - end);
+	};
+
+	// A plain assignment: not ==, !=, <=, += and such
+	skipSpaces();
+	if (end == 0 || sLineBeforeWord[end - 1] != '=')
+		return {};
+	end--;
+	if (end > 0 && std::string_view("=!<>+-*/%&|^").find(sLineBeforeWord[end - 1]) != std::string_view::npos)
+		return {};
+
+	skipSpaces();
+	const std::string_view variable = skipWord();
+	if (variable.empty() || isDigit(variable[0]))
+		return {};
+
+	const size_t beforeVariable = end;
+	skipSpaces();
+	if (end == beforeVariable)
+		return {};
+
+	const std::string_view type = skipWord();
+	if (type.empty() || isDigit(type[0]))
+		return {};
+
+	return type;
+}
+
+void AutoCompleteIndex::recountUsage()
+{
+	_usage.assign(_symbols.size(), 0);
+	for (const auto& [documentID, usage] : _documentUsage)
+	{
+		for (const auto& [identifier, count] : usage)
+		{
+			auto symbol = _symbolByName.find(identifier);
+			if (symbol != _symbolByName.end())
+				_usage[symbol->second] += count;
+		}
+	}
+}
+
+int32_t AutoCompleteIndex::rank(uint32_t nSymbol, int32_t nMatchScore, std::string_view sExpectedType) const
+{
+	const Symbol& s = _symbols[nSymbol];
+	int32_t score = nMatchScore;
+
+	// A few uses already tell the symbol apart; more count less and less
+	if (_usage[nSymbol] > 0)
+	{
+		int32_t usageBits = 0;
+		for (uint32_t usage = _usage[nSymbol]; usage > 1; usage >>= 1)
+			usageBits++;
+		score += (std::min)(bonusUsageStep * (usageBits + 1), bonusUsageMax);
+	}
+
+	// Something of the declared type, and never a function that returns nothing
+	if (!sExpectedType.empty())
+	{
+		if (s.sType == sExpectedType)
+			score += bonusExpectedType;
+		else if (s.mID == NWScriptParser::MemberID::Function && s.sType == "void")
+			score -= bonusExpectedType;
+	}
+
+	if (s.bUserDefined)
+		score += bonusUserDefined;
+	if (s.mID == NWScriptParser::MemberID::Keyword)
+		score += bonusKeyword;
+
+	return score - penaltyParam * s.nParams;
+}
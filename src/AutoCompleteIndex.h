@@ -0,0 +1,93 @@
+/** @file AutoCompleteIndex.h
+ * Ranked, fuzzy auto-completion over the engine and user-defined tokens.
+ *
+ * Symbols are kept in one array sorted by lowercase name, so the names starting with the typed text
+ * are a contiguous range found by binary search (what a trie gives, without storing any nodes).
+ * Names that only match as an abbreviation (gpcs -> GetPCSpeaker) come from an inverted index of the
+ * characters that start a word inside each name (GetPCSpeaker -> g, p, s; OBJECT_TYPE_CREATURE -> o, t, c).
+ * Each typed character must start a word or follow the previous one, as in "camel hump" matching, and
+ * candidates are screened by a bitmask of the characters in their names before being scored.
+ *
+ * Prefix matches always rank first. Then matches are ordered by how well they fit (word starts, runs
+ * of consecutive characters, short gaps), how often the symbol is used in the open documents, the type
+ * expected at the caret (as in "object oPC = ") and the symbol's kind and number of parameters.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "NWScriptParser.h"
+
+namespace NWScriptPlugin {
+
+	class AutoCompleteIndex final
+	{
+	public:
+		struct Symbol {
+			std::string sName;
+			// Return type for functions, value type for constants
+			std::string sType;
+			NWScriptParser::MemberID mID = NWScriptParser::MemberID::Unknown;
+			uint8_t nParams = 0;
+			bool bUserDefined = false;
+		};
+
+		struct Match {
+			uint32_t nSymbol = 0;		// For GetSymbol()
+			int32_t nScore = 0;
+		};
+
+		void Clear();
+		// Adds the members of a parse result (a name already added is skipped). Call Build() when done.
+		void AddMembers(const NWScriptParser::ScriptParseResults& results, bool bUserDefined);
+		// Sorts and indexes the symbols added. Queries before this return nothing.
+		void Build();
+
+		bool Empty() const { return _symbols.empty(); }
+		size_t Size() const { return _symbols.size(); }
+		const Symbol& GetSymbol(uint32_t nSymbol) const { return _symbols[nSymbol]; }
+
+		// Replaces outMatches with the best maxResults matches for sTyped (case-insensitive), best first.
+		// sExpectedType favors symbols of that type (see ExpectedType()).
+		void Query(std::string_view sTyped, std::vector<Match>& outMatches, size_t maxResults,
+			std::string_view sExpectedType = {}) const;
+
+		// Counts the identifiers used in an open document, replacing its previous counts. Symbols used more
+		// often across all documents rank higher.
+		void SetDocumentUsage(uintptr_t nDocumentID, std::string_view sText);
+		void RemoveDocument(uintptr_t nDocumentID);
+
+		// Type of the variable being declared on a line ending in "type name =" (before the word being
+		// typed), or empty if the line doesn't end like that.
+		static std::string_view ExpectedType(std::string_view sLineBeforeWord);
+
+	private:
+		std::vector<Symbol> _symbols;
+		// Per symbol (same index), for the queries
+		std::vector<std::string> _lowerNames;
+		std::vector<uint64_t> _charMasks;
+		std::vector<uint64_t> _wordStartMasks;		// Bit j: a word starts at sName[j]
+		std::vector<uint32_t> _usage;
+		// Symbols by character found at a word start in their names
+		std::vector<uint32_t> _wordStarts[64];
+		std::unordered_map<std::string_view, uint32_t> _symbolByName;
+		// Every type a symbol has, for ExpectedType()
+		std::set<std::string, std::less<>> _types;
+
+		// Identifiers and how many times they appear, per document
+		std::map<uintptr_t, std::vector<std::pair<std::string, uint32_t>>> _documentUsage;
+
+		void recountUsage();
+		int32_t rank(uint32_t nSymbol, int32_t nMatchScore, std::string_view sExpectedType) const;
+	};
+
+}
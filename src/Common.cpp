@@ -1061,6 +1061,38 @@ namespace NWScriptPluginCommons {
 
     };
 
+    // Opens a file for XML writing the same way XMLDocument::SaveFile() does (text mode), but from an unicode path.
+    FILE* openXMLFile(const generic_string& filePath)
+    {
+        FILE* file = NULL;
+        if (_tfopen_s(&file, filePath.c_str(), TEXT("w")) != 0)
+            return NULL;
+
+        return file;
+    }
+
+    // Closes a file from openXMLFile(). Returns false if writing to it failed at any point.
+    bool closeXMLFile(FILE* file)
+    {
+        bool bWritten = ferror(file) == 0;
+        return (fclose(file) == 0) && bWritten;
+    }
+
+    bool XMLSplicePrinter::VisitEnter(const tinyxml2::XMLElement& element, const tinyxml2::XMLAttribute* attribute)
+    {
+        tinyxml2::XMLPrinter::VisitEnter(element, attribute);
+
+        auto splice = _splices.find(&element);
+        if (splice == _splices.end())
+            return true;
+
+        // An empty text still closes the element with a tag, as SetText("") would
+        PushText("");
+        splice->second(*this);
+
+        return false;
+    }
+
     // Adapted from function source:
     // https://www.codeguru.com/cplusplus/finding-a-menuitem-from-command-id/
     HMENU FindSubMenu(HMENU baseMenu, generic_string menuName)
@@ -1112,47 +1144,6 @@ namespace NWScriptPluginCommons {
             return generic_string(TEXT(""));
     }
 
-    // Creates a file list from a starting directory with recurse options
-    // Sampled from: 
-    // https://stackoverflow.com/questions/612097/how-can-i-get-the-list-of-files-in-a-directory-using-c-or-c
-    // This version have a cancel flag for assynchronous interruptions
-    void createFilesList(std::vector<fs::path>& filesList, const generic_string& startingDir,
-        const generic_string& fileMask, bool recurse, std::atomic<bool>& cancelFlagVariable)
-    {
-
-        WIN32_FIND_DATA findData;
-
-        generic_string searchKey = startingDir + TEXT("\\") + fileMask;
-        HANDLE h = FindFirstFile(searchKey.c_str(), &findData);
-        if (h == INVALID_HANDLE_VALUE)
-            return;
-
-        while (true)
-        {
-            filesList.push_back(startingDir + TEXT("\\") + findData.cFileName);
-            if (!FindNextFile(h, &findData))
-                break;
-
-            if (cancelFlagVariable)
-                return;
-        }
-
-        if (recurse)
-        {
-            for (const auto& entry : fs::directory_iterator(startingDir))
-            {
-                if (cancelFlagVariable)
-                    return;
-
-                std::string s = entry.path().string().c_str();
-                std::string t = entry.path().filename().string().c_str();
-
-                if (entry.is_directory() && entry.path().filename().string() != "." && entry.path().filename().string() != "..")
-                    createFilesList(filesList, properDirNameW(entry.path().c_str()), fileMask, true, cancelFlagVariable);
-            }
-        }
-    }
-
     // Folder browsing function callback
     // For changing default selected directory
     // Extracted from: 
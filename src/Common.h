@@ -10,6 +10,8 @@
 
 #pragma once
 
+#include <functional>
+#include <map>
 #include <string>
 #include <tchar.h>
 #include <Windows.h>
@@ -220,19 +222,39 @@ namespace NWScriptPluginCommons {
     tinyxml2::XMLElement* searchElement(tinyxml2::XMLElement* const from, const std::string& toName,
         const std::string checkAttribute = "", const std::string checkAttributeValue = "");
 
+    // Opens a file for XML writing the same way XMLDocument::SaveFile() does (text mode), but from an unicode path.
+    // Returns NULL on failure.
+    FILE* openXMLFile(const generic_string& filePath);
+
+    // Closes a file from openXMLFile(). Returns false if writing to it failed at any point.
+    bool closeXMLFile(FILE* file);
+
+    // XML printer that streams a document to file like XMLDocument::SaveFile() does, except for the elements
+    // given to SpliceText(): their children are skipped and the writer callback pushes their text instead.
+    // That way huge keyword lists go straight to the file, without being built into strings and text nodes first.
+    class XMLSplicePrinter : public tinyxml2::XMLPrinter
+    {
+    public:
+        typedef std::function<void(tinyxml2::XMLPrinter& printer)> TextWriter;
+
+        explicit XMLSplicePrinter(FILE* file) : tinyxml2::XMLPrinter(file) {}
+
+        void SpliceText(const tinyxml2::XMLElement* element, TextWriter writer) {
+            _splices[element] = std::move(writer);
+        }
+
+        virtual bool VisitEnter(const tinyxml2::XMLElement& element, const tinyxml2::XMLAttribute* attribute) override;
+
+    private:
+        std::map<const tinyxml2::XMLElement*, TextWriter> _splices;
+    };
+
     // Finds the Menu Handle of a submenu with name subMenuName
     HMENU FindSubMenu(HMENU baseMenu, generic_string subMenuName);
 
     // Returns the menu name for a given position inside a menu handle
     generic_string GetMenuItemName(HMENU menu, int position);
 
-    // Creates a file list from a starting directory with recurse options
-    // Sampled from: 
-    // https://stackoverflow.com/questions/612097/how-can-i-get-the-list-of-files-in-a-directory-using-c-or-c
-    // This version have a cancel flag for assynchronous interruptions
-    void createFilesList(std::vector<fs::path>& filesList, const generic_string& startingDir, 
-        const generic_string& fileMask, bool recurse, std::atomic<bool>& cancelFlagVariable);
-
     // Folder browsing function callback
     // For changing default selected directory
     // Extracted from: 
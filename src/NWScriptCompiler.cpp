@@ -7,16 +7,26 @@
 
 
 #include "pch.h"
+#include <functional>
 //#include <fstream>
 //#include "jpcre2.h"
 
 #include "Utf8_16.h"
 #include "NWScriptCompiler.h"
 #include "VersionInfoEx.h"
+#include "NcsDisassembler.h"
+#include "NdbFile.h"
+#include "IncludeDirectives.h"
 
 using namespace NWScriptPlugin;
 
 typedef NWScriptLogger::LogType LogType;
+typedef std::chrono::steady_clock Clock;
+
+static double elapsedMs(Clock::time_point since)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+}
 
 #define DEPENDENCYHEADER " \
 /*************************************************************************************** \r\n\
@@ -29,11 +39,9 @@ typedef NWScriptLogger::LogType LogType;
 "
 
 #define SCRIPTERRORPREFIX "Error"
-#define FORMATDISASMREGEX R"(.+)"
 #define DEPENDENCYPARSEREGEX R"(([^\/]+)\/([^\\\n]+))"
 
 typedef jpcre2::select<char> pcre2;
-static pcre2::Regex assemblyLine(FORMATDISASMREGEX, PCRE2_MULTILINE, jpcre2::JIT_COMPILE);
 static pcre2::Regex dependencyParse(DEPENDENCYPARSEREGEX, 0, jpcre2::JIT_COMPILE);
 
 // This new global resource manager pointer is required for new compiler.
@@ -153,7 +161,7 @@ static std::map<int, std::string> CompileErrorTlk = {
 #define NSC2004_UNKNOWN_COMPILE_ERROR            "NSC2004"
 #define NSC2005_COULD_NOT_WRITE_COMPILED_FILE    "NSC2005"
 #define NSC2006_COULD_NOT_GENERATE_SYMBOL_FILE   "NSC2006"
-#define NSC2007_DISASSEMBLY_COMPILER_INIT_FAIL   "NSC2007"
+#define NSC2007_DISASSEMBLY_INVALID_BINARY       "NSC2007"
 #define NSC2008_COULD_NOT_WRITE_DISASSEMBLY_FILE "NSC2008"
 #define NSC2009_COULD_NOT_WRITE_DEPENDENCY_FILE  "NSC2009"
 #define NSC2010_CANT_COMPILE_NWSCRIPT_NSS        "NSC2010"
@@ -194,6 +202,8 @@ void NWScriptCompiler::reset() {
     _sourcePath = "";
     _destDir = "";
     setMode(0);
+    _batchMode = false;
+    _compileCache = nullptr;
     _processingEndCallback = nullptr;
     clearLog();
 
@@ -261,6 +271,12 @@ void NWScriptCompiler::processFile(bool fromMemory, char* fileContents)
     NWN::ResRef32 fileResRef;
     std::string inFileContents;
 
+    // Failed until proven otherwise: early returns leave it that way
+    const Clock::time_point startTime = Clock::now();
+    _lastFileTimings = BatchTelemetry::FileTimings();
+    _lastFileTimings.path = _sourcePath.string();
+    _lastFileTimings.failed = true;
+
     // First check: safeguard from trying to recompile nwscript.nss
     if (_stricmp(_sourcePath.filename().string().c_str(), "nwscript.nss") == 0 && _compilerMode == 0)
     {
@@ -314,6 +330,7 @@ void NWScriptCompiler::processFile(bool fromMemory, char* fileContents)
         cAPI.ResManLoadScriptSourceFile = ResManLoadScriptSourceFile;
         cAPI.ResManUpdateResourceDirectory = ResManUpdateResourceDirectory;
         cAPI.ResManWriteToFile = ResManWriteToFile;
+        cAPI.ResManTakeFile = ResManTakeFile;
         cAPI.TlkResolve = TlkResolve;
 
         _compilerNative = std::make_unique<CScriptCompiler>(NWN::ResNSS, NWN::ResNCS, NWN::ResNDB, cAPI);
@@ -345,6 +362,8 @@ void NWScriptCompiler::processFile(bool fromMemory, char* fileContents)
             return;
         }
     }
+    _lastFileTimings.bytesRead = inFileContents.size();
+    _lastFileTimings.loadMs = elapsedMs(startTime);
 
     // Determines file encoding. Only a minimal sample is used here since
     // we are not interested in capturing UTF-8 multibyte-like strings, only UTF-16 types.
@@ -378,10 +397,43 @@ void NWScriptCompiler::processFile(bool fromMemory, char* fileContents)
         if (!_fetchPreprocessorOnly && !_makeDependencyView)
         {
             _logger.log("Compiling script: " + _sourcePath.string(), LogType::ConsoleMessage);
-            if (_settings->compilerEngine == 0)
-                bSuccess = compileScriptNative(inFileContents, fileResType, fileResRef);
+
+            // Batches take unchanged scripts from the compile cache. Make dependency files are written
+            // on the side, and the cache doesn't hold them: those scripts always compile.
+            CompileCache::Key cacheKey;
+            CompileCache::Entry cacheEntry;
+            std::set<std::string> keyedSources;
+            const bool bMakeDependencies = _settings->compilerEngine != 0 && (_settings->compilerFlags & NscCompilerFlag_GenerateMakeDeps);
+            const bool bCacheable = _batchMode && _compileCache && !bMakeDependencies &&
+                compileCacheKey(inFileContents, cacheKey, keyedSources);
+
+            if (bCacheable && _compileCache->lookup(cacheKey, cacheEntry))
+                bSuccess = useCachedEntry(cacheEntry);
             else
-                bSuccess = compileScriptLegacy(inFileContents, fileResType, fileResRef);
+            {
+                _loadedSources.clear();
+                _compileCacheEntry = bCacheable ? &cacheEntry : nullptr;
+                if (_settings->compilerEngine == 0)
+                    bSuccess = compileScriptNative(inFileContents, fileResType, fileResRef);
+                else
+                    bSuccess = compileScriptLegacy(inFileContents, fileResType, fileResRef);
+                _compileCacheEntry = nullptr;
+
+                // Stored only if every source the compiler loaded went into the key: the scan can't know
+                // what the compiler resolves in every case, and an entry missing one could go stale unseen.
+                // (The legacy library loads its sources on its own, so there the scan is all there is.)
+                const bool bKeyCoversSources = std::all_of(_loadedSources.begin(), _loadedSources.end(),
+                    [&](const std::string& name) { return keyedSources.contains(name); });
+                if (bCacheable && bSuccess && bKeyCoversSources)
+                {
+                    // No outputs from a successful compile: an include file
+                    cacheEntry.include = cacheEntry.outputs.empty();
+
+                    std::vector<OutputWriter::File> entryFile;
+                    entryFile.push_back({ _compileCache->entryPath(cacheKey), CompileCache::serialize(cacheEntry) });
+                    _outputWriter.submit(std::move(entryFile));
+                }
+            }
         }        
     }
     else
@@ -390,9 +442,130 @@ void NWScriptCompiler::processFile(bool fromMemory, char* fileContents)
         bSuccess = disassemblyBinary(inFileContents, fileResType, fileResRef);
     }
 
+    // Outputs must be on disk before the caller moves on (or reports success). Batches wait once, at the end.
+    const Clock::time_point writeStart = Clock::now();
+    _lastFileTimings.compileMs = std::chrono::duration<double, std::milli>(writeStart - startTime).count() - _lastFileTimings.loadMs;
+    if (!_batchMode)
+        bSuccess = flushOutputs() && bSuccess;
+    _lastFileTimings.writeMs = elapsedMs(writeStart);
+    _lastFileTimings.totalMs = elapsedMs(startTime);
+    _lastFileTimings.failed = !bSuccess;
+
     notifyCaller(bSuccess);
 }
 
+void NWScriptCompiler::queueOutput(OutputWriter::File&& file)
+{
+    _lastFileTimings.bytesWritten += file.size();
+
+    // Going into the compile cache too: keep a copy
+    if (_compileCacheEntry)
+        _compileCacheEntry->outputs.push_back({ file.path.extension().string().substr(1),
+            std::vector<uint8_t>(file.contents(), file.contents() + file.size()) });
+
+    std::vector<OutputWriter::File> files;
+    files.push_back(std::move(file));
+
+    // Called on the output thread: only record failures here, the logger is not thread safe.
+    _outputWriter.submit(std::move(files), [this](const std::vector<OutputWriter::Result>& results, double) {
+        for (const OutputWriter::Result& result : results)
+        {
+            if (result.status == OutputWriter::Result::Status::Failed)
+            {
+                std::lock_guard<std::mutex> guard(_outputFailuresLock);
+                _outputFailures.push_back(result);
+            }
+        }
+    });
+}
+
+bool NWScriptCompiler::flushOutputs()
+{
+    _outputWriter.flush();
+
+    std::vector<OutputWriter::Result> failures;
+    {
+        std::lock_guard<std::mutex> guard(_outputFailuresLock);
+        failures.swap(_outputFailures);
+    }
+
+    for (const OutputWriter::Result& failure : failures)
+    {
+        _logger.log("", LogType::ConsoleMessage);
+        if (_stricmp(failure.path.extension().string().c_str(), debugSymbolsFileSuffix.c_str()) == 0)
+            _logger.log(TEXT("Unable to write generated symbols output file: ") + str2wstr(failure.path.string()), LogType::Critical, TEXT(NSC2006_COULD_NOT_GENERATE_SYMBOL_FILE));
+        else if (_compilerMode != 0)
+            _logger.log(TEXT("Could not write disassembled output file: ") + str2wstr(failure.path.string()), LogType::Critical, TEXT(NSC2008_COULD_NOT_WRITE_DISASSEMBLY_FILE));
+        else
+            _logger.log(TEXT("Unable to write compiled output file: ") + str2wstr(failure.path.string()), LogType::Critical, TEXT(NSC2005_COULD_NOT_WRITE_COMPILED_FILE));
+        _logger.log("", LogType::ConsoleMessage);
+    }
+
+    return failures.empty();
+}
+
+
+bool NWScriptCompiler::compileCacheKey(const std::string& fileContents, CompileCache::Key& key, std::set<std::string>& keyedSources)
+{
+    // Sources resolve as the compiler resolves them, through the resource cache, which keeps them
+    // for the compile that may follow.
+    const char* languageSource = ResManLoadScriptSourceFile("nwscript", NWN::ResNSS);
+    if (!languageSource)
+        return false;
+
+    // Names are hashed without their folders (and in lowercase, as the game sees them), so
+    // the key is the same wherever the sources are.
+    CompileCache::KeyBuilder builder;
+    builder.add(CompileCache::buildId());
+    builder.add(_settings->compilerEngine == 0 ? "native" : "legacy");
+    builder.add(static_cast<uint64_t>(_settings->compileVersion));
+    builder.add(static_cast<uint64_t>(_settings->optimizeScript)).add(static_cast<uint64_t>(_settings->generateSymbols));
+    if (_settings->compilerEngine != 0)
+        builder.add(static_cast<uint64_t>(_settings->useNonBiowareExtenstions)).add(static_cast<uint64_t>(_settings->compilerFlags));
+
+    const std::string scriptName = toLowerCase(_sourcePath.stem().string());
+    builder.add("nwscript").add(languageSource);
+    builder.add(scriptName).add(fileContents);
+    keyedSources = { "nwscript", scriptName };
+
+    // Then the include closure, depth-first, each file once
+    std::function<bool(const std::string&)> addIncludes = [&](const std::string& source) {
+        for (const IncludeDirective& directive : scanIncludeDirectives(source))
+        {
+            const std::string name = toLowerCase(directive.name);
+            if (!keyedSources.insert(name).second)
+                continue;
+
+            const char* include = ResManLoadScriptSourceFile(name.c_str(), NWN::ResNSS);
+            if (!include)
+                return false;
+            builder.add(name).add(include);
+            if (!addIncludes(include))
+                return false;
+        }
+        return true;
+    };
+    if (!addIncludes(fileContents))
+        return false;
+
+    key = builder.finish();
+    return true;
+}
+
+bool NWScriptCompiler::useCachedEntry(const CompileCache::Entry& entry)
+{
+    if (entry.include)
+    {
+        _logger.log(_sourcePath.filename().string() + " is an include file, ignored.", LogType::ConsoleMessage);
+        return true;
+    }
+
+    for (const CompileCache::Output& output : entry.outputs)
+        queueOutput({ _destDir / (_sourcePath.stem().string() + "." + output.extension), output.data });
+
+    _logger.log("Unchanged since last compiled: outputs taken from the compile cache.", LogType::ConsoleMessage);
+    return true;
+}
 
 bool NWScriptCompiler::compileScriptNative(std::string& fileContents,
     const NWN::ResType& fileResType, const NWN::ResRef32& fileResRef)
@@ -405,6 +578,7 @@ bool NWScriptCompiler::compileScriptNative(std::string& fileContents,
     _compilerNative->SetCompileConditionalOrMain(1);
     _compilerNative->SetIdentifierSpecification("nwscript");
     _compilerNative->SetOutputAlias("");
+    _compilerNative->SetMaxErrors(_settings->maxCompileErrors);
 
     // Compile memory allocated file
     NativeCompileResult ret;
@@ -453,7 +627,19 @@ bool NWScriptCompiler::compileScriptNative(std::string& fileContents,
             ret.code = 0;
             break;
         default:
-            _logger.WriteText(ret.str);
+            // Compiled past the first error: report all of them, the captured one included.
+            if (_compilerNative->GetDiagnostics().size() > 1)
+            {
+                for (const CScriptCompilerDiagnostic& diagnostic : _compilerNative->GetDiagnostics())
+                {
+                    if (diagnostic.m_nLine > 0)
+                        _logger.WriteText("%s(%d): %s\n", diagnostic.m_sFileName.CStr(), diagnostic.m_nLine, diagnostic.m_sErrorText.CStr());
+                    else
+                        _logger.WriteText("%s: %s\n", diagnostic.m_sFileName.CStr(), diagnostic.m_sErrorText.CStr());
+                }
+            }
+            else
+                _logger.WriteText(ret.str);
             break;
         }
     }
@@ -494,7 +680,6 @@ bool NWScriptCompiler::compileScriptLegacy(std::string& fileContents,
     //compilerFlags |= NscCompilerFlag_DumpPCode;
 
     // Main compilation step
-    std::string dataRef;                     // Buffer to file is generic and requires a std::string
     swutil::ByteVec generatedCode;
     swutil::ByteVec debugSymbols;
     std::set<std::string> fileDependencies;
@@ -536,31 +721,12 @@ bool NWScriptCompiler::compileScriptLegacy(std::string& fileContents,
     if (_makeDependencyView)
         return MakeDependenciesView(fileDependencies);
 
-    // Now save code data
-    generic_string outputPath = str2wstr(_destDir.string() + "\\" + _sourcePath.stem().string() + compiledScriptSuffix);
-    dataRef.assign(reinterpret_cast<char*>(&generatedCode[0]), generatedCode.size());
-    if (!bufferToFile(outputPath, dataRef))
-    {
-        _logger.log("", LogType::ConsoleMessage);
-        _logger.log(TEXT("Could not write compiled output file: ") + outputPath, LogType::Critical, TEXT(NSC2005_COULD_NOT_WRITE_COMPILED_FILE));
-        _logger.log("", LogType::ConsoleMessage);
-        return false;
-    }
+    // Now save code data. Buffers are handed over to the output writer (see flushOutputs).
+    queueOutput({ _destDir / (_sourcePath.stem().string() + compiledScriptSuffix), std::move(generatedCode) });
 
     // Save debug symbols if apply
     if (_settings->generateSymbols)
-    {
-        dataRef.clear();
-        outputPath = str2wstr(_destDir.string() + "\\" + _sourcePath.stem().string() + debugSymbolsFileSuffix);
-        dataRef.assign(reinterpret_cast<char*>(&debugSymbols[0]), debugSymbols.size());
-        if (!bufferToFile(outputPath, dataRef))
-        {
-            _logger.log("", LogType::ConsoleMessage);
-            _logger.log(TEXT("Could not write generated symbols output file: ") + outputPath, LogType::Critical, TEXT(NSC2006_COULD_NOT_GENERATE_SYMBOL_FILE));
-            _logger.log("", LogType::ConsoleMessage);
-            return false;
-        }
-    }
+        queueOutput({ _destDir / (_sourcePath.stem().string() + debugSymbolsFileSuffix), std::move(debugSymbols) });
 
     // And file dependencies if apply
     if (_settings->compilerFlags & NscCompilerFlag_GenerateMakeDeps)
@@ -572,40 +738,44 @@ bool NWScriptCompiler::compileScriptLegacy(std::string& fileContents,
 bool NWScriptCompiler::disassemblyBinary(std::string& fileContents,
     const NWN::ResType& fileResType, const NWN::ResRef32& fileResRef)
 {
-    std::string generatedCode;
-
-    // Main disassemble step.
-    _compilerLegacy->NscDisassembleScript(fileContents.c_str(), fileContents.size(), generatedCode);
-
-    // This is the way the library returns errors to us on that routine... :D
-    if (generatedCode == "DISASSEMBLY ERROR: COMPILER INITIALIZATION FAILED!")
+    // Annotate with function names and source lines when the debug symbols are around
+    NdbFile symbols;
+    bool haveSymbols = false;
+    fs::path symbolsPath = _sourcePath;
+    symbolsPath.replace_extension(debugSymbolsFileSuffix);
+    if (PathFileExists(symbolsPath.c_str()))
     {
-        _logger.log("", LogType::ConsoleMessage);
-        _logger.log("Disassembler - Compiler Initialization failed!", LogType::Critical, NSC2007_DISASSEMBLY_COMPILER_INIT_FAIL);
-        _logger.log("", LogType::ConsoleMessage);
-        return false;
+        std::string symbolsError;
+        haveSymbols = symbols.load(symbolsPath, symbolsError);
+        if (!haveSymbols)
+            _logger.log("Ignoring debug symbols: " + symbolsError, LogType::Warning);
     }
 
-    // Save file, but first, we remove extra carriage returns the library is generating...
-    generic_string outputPath = str2wstr(_destDir.string() + "\\" + _sourcePath.stem().string() + disassembledScriptSuffix);
-    
-    std::stringstream formatedCode;
-    pcre2::VecNum matches;
-    pcre2::RegexMatch fileMatcher(&assemblyLine);
-    size_t lineCount = fileMatcher.setSubject(generatedCode).setModifier("gm").setNumberedSubstringVector(&matches).match();
+    NcsDisassembler::Options options;
+    options.newLine = "\r\n";
+    NcsDisassembler disassembler(options);
 
-    for (size_t i = 0; i < lineCount; i++)
-        formatedCode << matches[i][0];
+    std::string generatedCode;
+    std::string errorMessage;
+    bool bSuccess = disassembler.disassemble(reinterpret_cast<const uint8_t*>(fileContents.data()), fileContents.size(),
+        haveSymbols ? &symbols : nullptr, generatedCode, errorMessage);
 
-    if (!bufferToFile(outputPath, formatedCode.str()))
+    if (!bSuccess)
     {
         _logger.log("", LogType::ConsoleMessage);
-        _logger.log(TEXT("Could not write disassembled output file: ") + outputPath, LogType::Critical, TEXT(NSC2008_COULD_NOT_WRITE_DISASSEMBLY_FILE));
+        _logger.log("Disassembler - " + errorMessage, LogType::Critical, NSC2007_DISASSEMBLY_INVALID_BINARY);
         _logger.log("", LogType::ConsoleMessage);
-        return false;
+
+        // A damaged header gives nothing worth saving; otherwise keep the listing up to the bad instruction
+        if (generatedCode.empty())
+            return false;
     }
 
-    return true;
+    // Handed over to the output writer, see flushOutputs
+    queueOutput({ _destDir / (_sourcePath.stem().string() + disassembledScriptSuffix),
+        std::vector<uint8_t>(generatedCode.begin(), generatedCode.end()) });
+
+    return bSuccess;
 }
 
 bool NWScriptCompiler::MakeDependenciesView(const std::set<std::string>& dependencies)
@@ -751,43 +921,36 @@ BOOL NWScriptPlugin::ResManUpdateResourceDirectory(const char* sAlias)
     return false;
 }
 
-// Intercepts ResManWriteToFile from CScriptCompiler API. 
+// Intercepts ResManWriteToFile from CScriptCompiler API. Only called if the compiler keeps its buffers
+// (see ResManTakeFile): pData is reused by the next compile, so it is copied here.
 int32_t NWScriptPlugin::ResManWriteToFile(const char* sFileName, RESTYPE nResType, const uint8_t* pData, size_t nSize, bool bBinary)
 {
+    fs::path outputPath = g_NWScriptCompilerV2->getDestinationDirectory() /
+        (fs::path(sFileName).stem().string() + "." + g_ResourceManager->ResTypeToExt(nResType));
 
-    // Decides which type of file to write depending on ResType.
-
-    std::string dataRef;
-    dataRef.assign(reinterpret_cast<const char*>(pData), nSize);
-
-    generic_string outputPath = str2wstr(g_NWScriptCompilerV2->getDestinationDirectory().string() 
-        + "\\" + fs::path(sFileName).stem().string()
-        + "." + g_ResourceManager->ResTypeToExt(nResType)
-    );
+    g_NWScriptCompilerV2->queueOutput({ outputPath, std::vector<uint8_t>(pData, pData + nSize) });
 
-    if (!bufferToFile(outputPath, dataRef))
-    {
-        g_NWScriptCompilerV2->logger().log("", LogType::ConsoleMessage);
+    return 0;
+}
 
-        switch (nResType)
-        {
-        case NWN::ResNCS:
-            g_NWScriptCompilerV2->logger().log(TEXT("Unable to write compiled output file: ") + outputPath, LogType::Critical, TEXT(NSC2005_COULD_NOT_WRITE_COMPILED_FILE));
-            break;
-        case NWN::ResNDB:
-            g_NWScriptCompilerV2->logger().log(TEXT("Unable to write generated symbols output file: ") + outputPath, LogType::Critical, TEXT(NSC2006_COULD_NOT_GENERATE_SYMBOL_FILE));
-            break;
-        }
+// Intercepts ResManTakeFile from CScriptCompiler API: the compiler hands its buffer over, which goes
+// to the output writer as is. Write errors are reported later, by flushOutputs().
+int32_t NWScriptPlugin::ResManTakeFile(const char* sFileName, RESTYPE nResType, char* pData, size_t nSize, bool bBinary)
+{
+    OutputWriter::File file;
+    file.buffer.reset(pData);
+    file.bufferSize = nSize;
+    file.path = g_NWScriptCompilerV2->getDestinationDirectory() /
+        (fs::path(sFileName).stem().string() + "." + g_ResourceManager->ResTypeToExt(nResType));
 
-        g_NWScriptCompilerV2->logger().log("", LogType::ConsoleMessage);
-        return -1;
-    }
+    g_NWScriptCompilerV2->queueOutput(std::move(file));
 
     return 0;
 }
 
 const char* NWScriptPlugin::ResManLoadScriptSourceFile(const char* sFileName, RESTYPE nResType)
 {
+    g_NWScriptCompilerV2->noteSourceLoaded(toLowerCase(fs::path(sFileName).stem().string()));
 
     // Try to find resource on cache first.
     NWN::ResRef32 ResRef;
@@ -812,8 +975,10 @@ const char* NWScriptPlugin::ResManLoadScriptSourceFile(const char* sFileName, RE
 
     if (it != g_NWScriptCompilerV2->getResourceCache().end())
     {
+        g_NWScriptCompilerV2->countResourceCacheLookup(true);
         return it->second.Contents;
     }
+    g_NWScriptCompilerV2->countResourceCacheLookup(false);
 
     size_t fileSize = 0;
     char* fileContents = NULL;
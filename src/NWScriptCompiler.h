@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <mutex>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -17,6 +19,9 @@
 
 #include "Settings.h"
 #include "NWScriptLogger.h"
+#include "BatchTelemetry.h"
+#include "CompileCache.h"
+#include "OutputWriter.h"
 
 namespace NWScriptPlugin
 {
@@ -59,6 +64,7 @@ namespace NWScriptPlugin
 	// Function pointers to resolve new compiler Resource API requirements
 	static BOOL ResManUpdateResourceDirectory(const char* sAlias);
 	static int32_t ResManWriteToFile(const char* sFileName, RESTYPE nResType, const uint8_t* pData, size_t nSize, bool bBinary);
+	static int32_t ResManTakeFile(const char* sFileName, RESTYPE nResType, char* pData, size_t nSize, bool bBinary);
 	static const char* ResManLoadScriptSourceFile(const char* sFileName, RESTYPE nResType);
 	static const char* TlkResolve(STRREF strRef);
 
@@ -107,6 +113,25 @@ namespace NWScriptPlugin
 			return _sourcePath;
 		}
 
+		// Batches leave the outputs of each file queued: the writes overlap the next compiles, and the
+		// batch calls flushOutputs() once, when done. Cleared by reset().
+		void setBatchMode(bool bBatchMode) {
+			_batchMode = bBatchMode;
+		}
+
+		// Batches take the outputs of unchanged scripts from here, and store those they compile.
+		// Owned by the caller; nullptr (what reset() sets) compiles everything.
+		void setCompileCache(CompileCache* compileCache) {
+			_compileCache = compileCache;
+		}
+
+		// Compile cache lookups since the cache was created
+		BatchTelemetry::CacheCounters compileCacheCounters() const {
+			if (!_compileCache)
+				return {};
+			return { _compileCache->hits(), _compileCache->misses() };
+		}
+
 		// Set function callback for calling after finishing processing file
 		void setProcessingEndCallback(void (*processingEndCallback)(HRESULT returnCode))
 		{
@@ -173,13 +198,44 @@ namespace NWScriptPlugin
 			return _ResourceCache;
 		}
 
+		// Notes a script source the compiler asked for (name in lowercase, without extension)
+		void noteSourceLoaded(const std::string& name) {
+			_loadedSources.insert(name);
+		}
+
+		// Counts a script source lookup in the resource cache
+		void countResourceCacheLookup(bool bHit) {
+			if (bHit)
+				_resourceCacheHits++;
+			else
+				_resourceCacheMisses++;
+		}
+
+		// Resource cache lookups since the compiler was created
+		BatchTelemetry::CacheCounters resourceCacheCounters() const {
+			return { _resourceCacheHits, _resourceCacheMisses };
+		}
+
+		// Sizes and per-phase timings of the last file processed (valid inside the processing end callback)
+		const BatchTelemetry::FileTimings& lastFileTimings() const {
+			return _lastFileTimings;
+		}
+
 
 		void processFile(bool fromMemory, char* fileContents);
 
+		// Queues a compiled artifact for writing on the output thread. Takes ownership of the buffer.
+		void queueOutput(OutputWriter::File&& file);
+
+		// Waits for queued outputs and logs the ones that couldn't be written. False if any failed.
+		bool flushOutputs();
+
 	private:
 
 		std::unique_ptr<ResourceManager> _resourceManager;
 		ResourceCache _ResourceCache;
+		std::atomic<uint64_t> _resourceCacheHits = 0;
+		std::atomic<uint64_t> _resourceCacheMisses = 0;
 		std::unique_ptr<CScriptCompiler> _compilerNative;
 
 		// # TODO: Remove old compiler references
@@ -199,6 +255,20 @@ namespace NWScriptPlugin
 
 		NWScriptLogger _logger;
 
+		// Compiled outputs are written in the background; failures are logged by flushOutputs()
+		OutputWriter _outputWriter;
+		std::vector<OutputWriter::Result> _outputFailures;
+		std::mutex _outputFailuresLock;
+
+		BatchTelemetry::FileTimings _lastFileTimings;
+		bool _batchMode = false;
+
+		CompileCache* _compileCache = nullptr;
+		// Set while compiling a script that goes into the compile cache: queueOutput() copies the outputs here
+		CompileCache::Entry* _compileCacheEntry = nullptr;
+		// Sources loaded through ResManLoadScriptSourceFile by the last compile
+		std::set<std::string> _loadedSources;
+
 		// Notify Caller of processing results
 		void notifyCaller(bool success) {
 			if (_processingEndCallback)
@@ -215,6 +285,13 @@ namespace NWScriptPlugin
 		bool compileScriptNative(std::string& fileContents,
 			const NWN::ResType& fileResType, const NWN::ResRef32& fileResRef);
 
+		// Key of a script in the compile cache: the settings that change the outputs, the compiler
+		// build, nwscript.nss and the script with its include closure. False if an include is missing.
+		bool compileCacheKey(const std::string& fileContents, CompileCache::Key& key, std::set<std::string>& keyedSources);
+
+		// Queues the outputs of a compile cache entry, as if the script had just compiled
+		bool useCachedEntry(const CompileCache::Entry& entry);
+
 		// Disassemble a binary file into a pcode assembly text format
 		bool disassemblyBinary(std::string& fileContents,
 			const NWN::ResType& fileResType, const NWN::ResRef32& fileResRef);
@@ -21,33 +21,23 @@
 //#include <locale>
 //#include <ShlObj.h>
 
+#include <unordered_map>
+
 #include "jpcre2.hpp"
 #include "Utf8_16.h"
 #include "NWScriptParser.h"
+#include "ScriptDeclarationScanner.h"
 
-const std::string BASEREGEX = R"((?(DEFINE)(?<word>[\w\d.\-]++)(?<string>"(?>\\.|[^"\\]*+)*+")(?<token>\g<word>|\g<string>)(?<tokenVector>\[\s*+(?>\g<validValue>(?=\])|\g<validValue>,(?=\g<validValue>))*+\])(?<object>\{\s*+(?>\g<validValue>(?=\})|\g<validValue>,(?=\g<validValue>))*+\})(?<validValue>\s*+(?>\g<token>|\g<tokenVector>|\g<object>)\s*+)(?'param'\s*+(?>const)?\s*+(?#paramType)\w+\s*+(?#paramName)\w+\s*+(?>=\s*+(?#paramDefaultValue)\g<validValue>)?\s*+)(?<fnContents>{(?:[^{"}]*+|\g<string>|\g<fnContents>)*})))";
-const std::string COMMENTSREGEX = R"((?(DEFINE)(?'commentLine'\/\/.*+)(?'comment'\/\*(?>\*\/|(?>(?>.|\n)(?!\*\/))*+)(?>(?>.|\n)(?=\*\/)\*\/)?)(?'cnotnull'(?>\g<commentLine>|\g<comment>)++)(?'c'\g<cnotnull>?))\g<cnotnull>)";
-const std::string ENGINESTRUCTREGEX = R"(^\s*+\K(?>#define)\s++(?>ENGINE_STRUCTURE_\d++)\s++(?<name>\w++))";
-const std::string FUNCTIONDECLARATIONREGEX = BASEREGEX + R"(^\s*+\K(?<type>\w+)\s*+(?<name>\w+)\s*+\((?<parametersString>(?>\g<param>(?=\))|\g<param>,(?=\g<param>))*+)\)\s*+;)";
-const std::string FUNCTIONSDEFINITIONREGEX = BASEREGEX + R"(^\s*+\K(?>\w+)\s*+(?>\w+)\s*+\((?>(?>\g<param>,(?=\g<param>)|\g<param>(?=\))))*+\)\s*+\g<fnContents>)";
-const std::string FUNTIONPARAMETERREGEX = BASEREGEX + R"(\s*+(?>const)?\s*+(?'type'\w+)\s*+(?'name'\w+)\s*+(?>=\s*+(?'defaultValue'\g<validValue>))?\s*+,?)";
-const std::string CONSTANTREGEX = BASEREGEX + R"(^\s*+(?>const)?\s*+\K(?<type>\w+)\s*+(?<name>\w+)\s*+=\s*+(?<value>\g<validValue>)\s*+;)";
 const std::string KEYWORDREGEX = R"(#?\w+)";
 
 // We create and compile regexes only once during code initialization
-static const jpcre2::select<char>::Regex commentsRegEx(COMMENTSREGEX, PCRE2_MULTILINE, jpcre2::JIT_COMPILE);
-static const jpcre2::select<char>::Regex engineStructRegEx(ENGINESTRUCTREGEX, PCRE2_MULTILINE, jpcre2::JIT_COMPILE);
-static const jpcre2::select<char>::Regex functionsDeclarationRegEx(FUNCTIONDECLARATIONREGEX, PCRE2_MULTILINE, jpcre2::JIT_COMPILE);
-static const jpcre2::select<char>::Regex functionsDefinitionRegEx(FUNCTIONSDEFINITIONREGEX, PCRE2_MULTILINE, jpcre2::JIT_COMPILE);
-static const jpcre2::select<char>::Regex functionsParamRegEx(FUNTIONPARAMETERREGEX, PCRE2_MULTILINE, jpcre2::JIT_COMPILE);
-static const jpcre2::select<char>::Regex constantsRegEx(CONSTANTREGEX, PCRE2_MULTILINE, jpcre2::JIT_COMPILE);
 static const jpcre2::select<char>::Regex keywordImportW(KEYWORDREGEX, PCRE2_MULTILINE, jpcre2::JIT_COMPILE);
 
 constexpr const int blockSize = 128 * 1024 + 4;
 
 using namespace NWScriptPlugin;
 
-bool NWScriptParser::ParseFile(const generic_string& sFileName, ScriptParseResults& outParseResults)
+bool NWScriptParser::ResolveFileName(const generic_string& sFileName, generic_string& outFullPath)
 {
 	// First resolve possible file link
 	const rsize_t longFileNameBufferSize = MAX_PATH; 
@@ -76,12 +66,13 @@ bool NWScriptParser::ParseFile(const generic_string& sFileName, ScriptParseResul
 	}
 
 	// Reconvert back filename to stop working with TCHAR pointers
-	targetFileName = longFileName;
-	
-	// Read the raw file contents
-	std::string sFileContents;
-	bool success = fileToBuffer(targetFileName, sFileContents);
+	outFullPath = longFileName;
+
+	return true;
+}
 
+void NWScriptParser::ParseFileContents(std::string& sFileContents, ScriptParseResults& outParseResults)
+{
 	// Convert unicode files
 	Utf8_16_Read encoder;
 	int encoding = encoder.determineEncoding((unsigned char*)sFileContents.c_str(), (blockSize > sFileContents.size()) ? sFileContents.size() : blockSize);
@@ -93,6 +84,19 @@ bool NWScriptParser::ParseFile(const generic_string& sFileName, ScriptParseResul
 
 	// Create file structure
 	CreateNWScriptStructure(sFileContents, outParseResults);
+}
+
+bool NWScriptParser::ParseFile(const generic_string& sFileName, ScriptParseResults& outParseResults)
+{
+	generic_string targetFileName;
+	if (!ResolveFileName(sFileName, targetFileName))
+		return false;
+	
+	// Read the raw file contents
+	std::string sFileContents;
+	bool success = fileToBuffer(targetFileName, sFileContents);
+
+	ParseFileContents(sFileContents, outParseResults);
 
 	return true;
 
@@ -109,80 +113,203 @@ bool NWScriptParser::ParseBatch(const std::vector<generic_string>& sFilePaths, S
 	return true;
 }
 
-void NWScriptParser::CreateNWScriptStructure(const std::string& sFileContents, ScriptParseResults& outParseResults)
+// FNV-1a. Only tells file versions apart, nothing else relies on it.
+uint64_t NWScriptParser::ContentHash(std::string_view sContents)
 {
-	typedef jpcre2::select<char> pcre2;
+	uint64_t hash = 14695981039346656037ULL;
+	for (unsigned char c : sContents)
+	{
+		hash ^= c;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
 
-	// Reserve a good amount of space since we're not doing dynamic reallocations. 1 member per line is more than enough
-	// Try standard EOL mode (\n). Then alternative (\r). Minimum to reserve is assumed to 1 member since at least 1 line 
-	// will be processed by the RegEx.
-	size_t lineCount = std::count(sFileContents.begin(), sFileContents.end(), '\n');
-	if (lineCount == 0)
-		lineCount = std::count(sFileContents.begin(), sFileContents.end(), '\r');
-
-	// First we strip all comments - even malformed ones, so we can use faster regexes for the rest
-	std::string cleanFile = pcre2::Regex(commentsRegEx).replace(sFileContents, "", "gm");
-	// And then we strip function definitions - so we don't catch any scoped variable.
-	cleanFile = pcre2::Regex(functionsDefinitionRegEx).replace(cleanFile, "", "gm");
-
-	// Then we create the capture groups and first step: engine structs.
-	pcre2::VecNas captureGroup;
-	pcre2::RegexMatch regexMatch(&engineStructRegEx);
-	regexMatch.setSubject(cleanFile);
-	regexMatch.addModifier("gm");
-	regexMatch.setNamedSubstringVector(&captureGroup);
-	size_t count = regexMatch.match();
+namespace {
 
-	// Iterate through results. Since we're expecting generic_strings here
-	// we also do character conversion.
-	outParseResults.EngineStructuresCount += count;
-	for (size_t i = 0; i < count; i++)
+	// Whether a source file other than sExceptPath still declares the member
+	bool isDeclaredElsewhere(NWScriptParser::ScriptParseResults& results, const generic_string& sExceptPath,
+		const NWScriptParser::ScriptMember& member)
 	{
-		NWScriptParser::ScriptMember n;
-		n.mID = MemberID::EngineStruct; n.sName = captureGroup[i]["name"];
-		outParseResults.Members.insert(n);
+		for (const auto& [path, source] : results.Sources())
+		{
+			if (path != sExceptPath && source.Members.count(member) > 0)
+				return true;
+		}
+		return false;
 	}
 
-	regexMatch.setRegexObject(&functionsDeclarationRegEx);
-	count = regexMatch.match();
+	// Replaces a source file's members with newMembers, applying the difference to the merged members.
+	// Both sets are sorted the same way, so this is a single walk over the two of them.
+	void applySourceMembers(NWScriptParser::ScriptParseResults& results, const generic_string& sPath,
+		std::set<NWScriptParser::ScriptMember>& oldMembers, std::set<NWScriptParser::ScriptMember>&& newMembers,
+		NWScriptParser::SourceSyncResults& syncResults)
+	{
+		auto removeMember = [&](const NWScriptParser::ScriptMember& m) {
+			if (!isDeclaredElsewhere(results, sPath, m) && results.Members().erase(m) > 0)
+				syncResults.MembersRemoved++;
+		};
+		auto addMember = [&](const NWScriptParser::ScriptMember& m) {
+			if (results.Members().insert(m).second)
+				syncResults.MembersAdded++;
+		};
+
+		auto itOld = oldMembers.begin();
+		auto itNew = newMembers.begin();
+		while (itOld != oldMembers.end() || itNew != newMembers.end())
+		{
+			if (itNew == newMembers.end() || (itOld != oldMembers.end() && *itOld < *itNew))
+				removeMember(*itOld++);
+			else if (itOld == oldMembers.end() || *itNew < *itOld)
+				addMember(*itNew++);
+			else
+			{
+				// Same declaration as far as sorting goes; only default parameter values may differ
+				if (!(*itOld == *itNew))
+				{
+					results.Members().erase(*itOld);
+					results.Members().insert(*itNew);
+					syncResults.MembersChanged++;
+				}
+				++itOld;
+				++itNew;
+			}
+		}
+
+		oldMembers = std::move(newMembers);
+	}
+}
 
-	outParseResults.FunctionsCount += count;
+bool NWScriptParser::SyncSources(const std::vector<generic_string>& sFilePaths, ScriptParseResults& ioParseResults,
+	SourceSyncResults& outSyncResults)
+{
+	outSyncResults = {};
 
-	pcre2::RegexMatch regexMatchSubString(&functionsParamRegEx);
-	regexMatchSubString.addModifier("gm");
-	pcre2::VecNas captureSubGroup;
-	regexMatchSubString.setNamedSubstringVector(&captureSubGroup);
-	for (size_t i = 0; i < count; i++)
+	// The files asked for, then everything imported before
+	std::set<generic_string> selectedPaths;
+	for (const generic_string& path : sFilePaths)
 	{
-		std::vector<ScriptParamMember> params;
+		generic_string fullPath;
+		if (!ResolveFileName(path, fullPath))
+			return false;
+		selectedPaths.insert(fullPath);
+	}
+
+	std::map<generic_string, ScriptSourceFile>& knownSources = ioParseResults.Sources();
+	std::set<generic_string> allPaths = selectedPaths;
+	for (const auto& [path, source] : knownSources)
+		allPaths.insert(path);
 
-		regexMatchSubString.setSubject(captureGroup[i]["parametersString"]);
-		size_t nParams = regexMatchSubString.match();
-		for (size_t j = 0; j < nParams; j++)
+	for (const generic_string& path : allPaths)
+	{
+		const bool bSelected = selectedPaths.count(path) > 0;
+		auto known = knownSources.find(path);
+
+		WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+		if (!::GetFileAttributesEx(path.c_str(), GetFileExInfoStandard, &attributes))
 		{
-			ScriptParamMember s;
-			s.sType = captureSubGroup[j]["type"]; s.sName = captureSubGroup[j]["name"];
-			s.sDefaultValue = captureSubGroup[j]["defaultValue"];
-			params.push_back(s);
+			if (bSelected)
+				return false;
+
+			// Deleted since the last import: its members go with it
+			std::set<ScriptMember> droppedMembers = std::move(known->second.Members);
+			knownSources.erase(known);
+			for (const ScriptMember& m : droppedMembers)
+			{
+				if (!isDeclaredElsewhere(ioParseResults, path, m) && ioParseResults.Members().erase(m) > 0)
+					outSyncResults.MembersRemoved++;
+			}
+			outSyncResults.FilesRemoved++;
+			continue;
 		}
 
-		NWScriptParser::ScriptMember Me;
-		Me.mID = MemberID::Function; Me.sType = captureGroup[i]["type"];
-		Me.sName = captureGroup[i]["name"]; Me.params = params;
-		outParseResults.Members.insert(Me);
-	}
+		const int64_t lastWriteTime = (static_cast<int64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32)
+			| attributes.ftLastWriteTime.dwLowDateTime;
+		if (known != knownSources.end() && known->second.nLastWriteTime == lastWriteTime)
+		{
+			outSyncResults.FilesUnchanged++;
+			continue;
+		}
 
-	regexMatch.setRegexObject(&constantsRegEx);
-	count = regexMatch.match();
+		std::string sFileContents;
+		if (!fileToBuffer(path, sFileContents))
+		{
+			if (bSelected)
+				return false;
+			// Can't tell what changed: keep what we have until the file can be read again
+			outSyncResults.FilesUnchanged++;
+			continue;
+		}
 
-	outParseResults.ConstantsCount += count;
-	for (size_t i = 0; i < count; i++)
-	{
-		NWScriptParser::ScriptMember n;
-		n.mID = MemberID::Constant; n.sType = captureGroup[i]["type"]; n.sName = captureGroup[i]["name"];
-		n.sValue = captureGroup[i]["value"];
-		outParseResults.Members.insert(n);
+		// Touched, but the same contents
+		const uint64_t hash = ContentHash(sFileContents);
+		if (known != knownSources.end() && known->second.nContentHash == hash)
+		{
+			known->second.nLastWriteTime = lastWriteTime;
+			outSyncResults.FilesUnchanged++;
+			continue;
+		}
+
+		ScriptParseResults fileResults;
+		ParseFileContents(sFileContents, fileResults);
+
+		ScriptSourceFile& source = knownSources[path];
+		source.nContentHash = hash;
+		source.nLastWriteTime = lastWriteTime;
+		applySourceMembers(ioParseResults, path, source.Members, std::move(fileResults.Members()), outSyncResults);
+		outSyncResults.FilesParsed++;
 	}
+
+	ioParseResults.RecountStructs();
+
+	return true;
+}
+
+void NWScriptParser::CreateNWScriptStructure(const std::string& sFileContents, ScriptParseResults& outParseResults)
+{
+	// One pass over the file for engine structures, function prototypes and constants alike
+	ScriptDeclarationScanner::DeclarationCallback addMember = [&](ScriptDeclaration&& declaration) {
+		ScriptMember member;
+		member.sType = std::move(declaration.sType);
+		member.sName = std::move(declaration.sName);
+		member.sValue = std::move(declaration.sValue);
+		for (ScriptDeclaration::Param& param : declaration.params)
+			member.params.push_back({ std::move(param.sType), std::move(param.sName), std::move(param.sDefaultValue) });
+
+		switch (declaration.kind)
+		{
+		case ScriptDeclaration::Kind::EngineStruct:
+			member.mID = MemberID::EngineStruct;
+			outParseResults.EngineStructuresCount++;
+			break;
+		case ScriptDeclaration::Kind::Function:
+			member.mID = MemberID::Function;
+			outParseResults.FunctionsCount++;
+			break;
+		case ScriptDeclaration::Kind::Constant:
+			member.mID = MemberID::Constant;
+			outParseResults.ConstantsCount++;
+			break;
+		}
+		outParseResults.Members().insert(std::move(member));
+	};
+
+	ScriptDeclarationScanner scanner(sFileContents, addMember);
+	scanner.Scan();
+}
+
+void NWScriptParser::ScriptParseResults::PrintMembersAsSpacedText(tinyxml2::XMLPrinter& printer, MemberID memberType) const
+{
+	bool bFirst = true;
+	ForEachMember([&](const ScriptMember& m) {
+		if (m.mID != memberType)
+			return;
+
+		if (!bFirst)
+			printer.PushText(" ");
+		printer.PushText(m.sName.c_str());
+		bFirst = false;
+	});
 }
 
 void NWScriptParser::ScriptParseResults::AddSpacedStringAsKeywords(const std::string& sKWArray)
@@ -197,38 +324,583 @@ void NWScriptParser::ScriptParseResults::AddSpacedStringAsKeywords(const std::st
 
 	size_t count = regexMatch.match();
 
+	std::set<ScriptMember, std::less<ScriptMember>>& members = Members();
 	for (size_t i = 0; i < count; i++)
 	{
 		ScriptMember m;
 		m.mID = MemberID::Keyword; m.sName = matches[i][0];
-		Members.insert(m);
+		members.insert(m);
 		KeywordCount++;
 	}
 }
 
+std::set<NWScriptParser::ScriptMember, std::less<NWScriptParser::ScriptMember>>& NWScriptParser::ScriptParseResults::Members()
+{
+	if (_pFileView)
+		CopyFromFileView();
+	return _members;
+}
+
+std::map<generic_string, NWScriptParser::ScriptSourceFile>& NWScriptParser::ScriptParseResults::Sources()
+{
+	if (_pFileView)
+		CopyFromFileView();
+	return _sources;
+}
+
+size_t NWScriptParser::ScriptParseResults::MembersCount() const
+{
+	return _pFileView ? _pFileView->MembersCount() : _members.size();
+}
+
+void NWScriptParser::ScriptParseResults::ForEachMember(const std::function<void(const ScriptMember& member)>& onMember) const
+{
+	if (!_pFileView)
+	{
+		for (const ScriptMember& m : _members)
+			onMember(m);
+		return;
+	}
+
+	// The file keeps them in set order. One member is reused, so its strings keep their capacity.
+	ScriptMember member;
+	const size_t count = _pFileView->MembersCount();
+	for (size_t i = 0; i < count; i++)
+	{
+		ScriptParseResultsView::MemberView m = _pFileView->Member(i);
+		member.mID = m.mID;
+		member.sType.assign(m.sType);
+		member.sName.assign(m.sName);
+		member.sValue.assign(m.sValue);
+		member.params.resize(m.paramCount);
+		for (size_t j = 0; j < m.paramCount; j++)
+		{
+			ScriptParseResultsView::ParamView p = _pFileView->Param(m, j);
+			member.params[j].sType.assign(p.sType);
+			member.params[j].sName.assign(p.sName);
+			member.params[j].sDefaultValue.assign(p.sDefaultValue);
+		}
+		onMember(member);
+	}
+}
+
+void NWScriptParser::ScriptParseResults::MergeMembers(const ScriptParseResults& other)
+{
+	std::set<ScriptMember, std::less<ScriptMember>>& members = Members();
+	if (!other._pFileView)
+	{
+		members.insert(other._members.begin(), other._members.end());
+		return;
+	}
+
+	other.ForEachMember([&](const ScriptMember& m) {
+		members.insert(m);
+	});
+}
+
+// Done before the first change: from then on, the results no longer match their file.
+void NWScriptParser::ScriptParseResults::CopyFromFileView()
+{
+	// CopyTo() resets the results, counts included, and those may have been edited already
+	const std::shared_ptr<const ScriptParseResultsView> pView = std::move(_pFileView);
+	const int engineStructuresCount = EngineStructuresCount, functionsCount = FunctionsCount,
+		constantsCount = ConstantsCount, keywordCount = KeywordCount;
+
+	pView->CopyTo(*this);
+
+	EngineStructuresCount = engineStructuresCount;
+	FunctionsCount = functionsCount;
+	ConstantsCount = constantsCount;
+	KeywordCount = keywordCount;
+}
+
+namespace {
+
+	// Flat ScriptParseResults file layout: the header, the member records, the parameter records (each
+	// member's parameters are contiguous) and then the string table. Fields are 32 bit little endian;
+	// strings are (offset, length) pairs into the string table, which null terminates every string.
+	// Version 2 files also list the source files the members came from, just before the string table:
+	// a sources header, the source records and the member indexes they refer to.
+	// Files without sources are still written as version 1.
+	constexpr char flatFormatMagic[4] = { 'N', 'W', 'S', 'R' };
+	constexpr uint32_t flatFormatVersion = 1;
+	constexpr uint32_t flatFormatSourcesVersion = 2;
+
+	struct FlatFileHeader {
+		char magic[4];
+		uint32_t version;
+		int32_t engineStructuresCount;
+		int32_t functionsCount;
+		int32_t constantsCount;
+		int32_t keywordCount;
+		uint32_t membersCount;
+		uint32_t paramsCount;
+		uint32_t stringTableSize;
+	};
+
+	struct FlatString {
+		uint32_t offset;
+		uint32_t length;
+	};
+
+	struct FlatMember {
+		uint32_t mID;
+		FlatString sType;
+		FlatString sName;
+		FlatString sValue;
+		uint32_t firstParam;
+		uint32_t paramCount;
+	};
+
+	struct FlatParam {
+		FlatString sType;
+		FlatString sName;
+		FlatString sDefaultValue;
+	};
+
+	struct FlatSourcesHeader {
+		uint32_t sourcesCount;
+		uint32_t sourceMembersCount;
+	};
+
+	// 64 bit values are split, so every field stays 4 byte aligned
+	struct FlatSource {
+		FlatString sPath;
+		uint32_t contentHashLow;
+		uint32_t contentHashHigh;
+		uint32_t lastWriteTimeLow;
+		uint32_t lastWriteTimeHigh;
+		uint32_t firstMember;
+		uint32_t memberCount;
+	};
+
+	static_assert(sizeof(FlatFileHeader) == 36 && sizeof(FlatMember) == 36 && sizeof(FlatParam) == 24
+		&& sizeof(FlatSourcesHeader) == 8 && sizeof(FlatSource) == 32,
+		"The flat ScriptParseResults records must not be padded");
+
+	inline std::string_view flatString(const char* pStrings, const FlatString& s)
+	{
+		return std::string_view(pStrings + s.offset, s.length);
+	}
+
+	inline bool isValidFlatString(const FlatString& s, uint32_t stringTableSize, const char* pStrings)
+	{
+		return s.offset < stringTableSize && s.length < stringTableSize - s.offset && pStrings[s.offset + s.length] == '\0';
+	}
+}
+
+void NWScriptParser::ScriptParseResults::SerializeToBuffer(std::string& outBuffer) const
+{
+	// Unchanged since read: the file is already in this format, only the counts may have been edited
+	if (_pFileView)
+	{
+		outBuffer.assign(_pFileView->Contents());
+		FlatFileHeader header;
+		memcpy(&header, outBuffer.data(), sizeof(header));
+		header.engineStructuresCount = EngineStructuresCount;
+		header.functionsCount = FunctionsCount;
+		header.constantsCount = ConstantsCount;
+		header.keywordCount = KeywordCount;
+		memcpy(outBuffer.data(), &header, sizeof(header));
+		return;
+	}
+
+	std::vector<FlatMember> members;
+	std::vector<FlatParam> params;
+	members.reserve(_members.size());
+
+	// Strings are pooled: types and default values repeat a lot. Offset 0 is the empty string.
+	std::string strings(1, '\0');
+	std::unordered_map<std::string_view, uint32_t> pooledStrings;
+	auto poolString = [&](const std::string& s) -> FlatString {
+		if (s.empty())
+			return { 0, 0 };
+		auto [it, bInserted] = pooledStrings.try_emplace(s, static_cast<uint32_t>(strings.size()));
+		if (bInserted)
+			strings.append(s).push_back('\0');
+		return { it->second, static_cast<uint32_t>(s.size()) };
+	};
+
+	// Members are already sorted as the set keeps them - the view binary searches on that
+	std::unordered_map<const ScriptMember*, uint32_t> memberIndexes;
+	for (const ScriptMember& m : _members)
+	{
+		if (!_sources.empty())
+			memberIndexes.emplace(&m, static_cast<uint32_t>(members.size()));
+
+		FlatMember member = { static_cast<uint32_t>(m.mID), poolString(m.sType), poolString(m.sName), poolString(m.sValue),
+			static_cast<uint32_t>(params.size()), static_cast<uint32_t>(m.params.size()) };
+		members.push_back(member);
+		for (const ScriptParamMember& p : m.params)
+			params.push_back({ poolString(p.sType), poolString(p.sName), poolString(p.sDefaultValue) });
+	}
+
+	// Source files refer to the members above by index instead of repeating them
+	std::vector<FlatSource> sources;
+	std::vector<uint32_t> sourceMembers;
+	std::vector<std::string> sourcePaths;
+	sources.reserve(_sources.size());
+	sourcePaths.reserve(_sources.size());
+	for (const auto& [path, source] : _sources)
+	{
+		const uint32_t firstMember = static_cast<uint32_t>(sourceMembers.size());
+		for (const ScriptMember& m : source.Members)
+		{
+			auto found = _members.find(m);
+			if (found != _members.end())
+				sourceMembers.push_back(memberIndexes[&*found]);
+		}
+
+		sourcePaths.push_back(wstr2str(path));
+		sources.push_back({ poolString(sourcePaths.back()),
+			static_cast<uint32_t>(source.nContentHash), static_cast<uint32_t>(source.nContentHash >> 32),
+			static_cast<uint32_t>(source.nLastWriteTime), static_cast<uint32_t>(static_cast<uint64_t>(source.nLastWriteTime) >> 32),
+			firstMember, static_cast<uint32_t>(sourceMembers.size()) - firstMember });
+	}
+
+	FlatFileHeader header = {};
+	memcpy(header.magic, flatFormatMagic, sizeof(header.magic));
+	header.version = sources.empty() ? flatFormatVersion : flatFormatSourcesVersion;
+	header.engineStructuresCount = EngineStructuresCount;
+	header.functionsCount = FunctionsCount;
+	header.constantsCount = ConstantsCount;
+	header.keywordCount = KeywordCount;
+	header.membersCount = static_cast<uint32_t>(members.size());
+	header.paramsCount = static_cast<uint32_t>(params.size());
+	header.stringTableSize = static_cast<uint32_t>(strings.size());
+
+	outBuffer.clear();
+	outBuffer.reserve(sizeof(header) + members.size() * sizeof(FlatMember) + params.size() * sizeof(FlatParam) + strings.size());
+	outBuffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+	outBuffer.append(reinterpret_cast<const char*>(members.data()), members.size() * sizeof(FlatMember));
+	outBuffer.append(reinterpret_cast<const char*>(params.data()), params.size() * sizeof(FlatParam));
+	if (!sources.empty())
+	{
+		FlatSourcesHeader sourcesHeader = { static_cast<uint32_t>(sources.size()), static_cast<uint32_t>(sourceMembers.size()) };
+		outBuffer.append(reinterpret_cast<const char*>(&sourcesHeader), sizeof(sourcesHeader));
+		outBuffer.append(reinterpret_cast<const char*>(sources.data()), sources.size() * sizeof(FlatSource));
+		outBuffer.append(reinterpret_cast<const char*>(sourceMembers.data()), sourceMembers.size() * sizeof(uint32_t));
+	}
+	outBuffer.append(strings);
+}
+
 bool NWScriptParser::ScriptParseResults::SerializeToFile(generic_string filePath)
 {
-	Buffer buffer;
-	ScriptParseResults res;
+	// Windows won't rewrite a file that is still mapped: the results may have been read from this one
+	if (_pFileView)
+		CopyFromFileView();
 
-	auto writtenSize = bitsery::quickSerialization<OutputAdapter>(buffer, *this);
 	std::string fileContents;
-	fileContents.assign((char*)buffer.data(), buffer.size());
+	SerializeToBuffer(fileContents);
 
 	return bufferToFile(filePath, fileContents);
 }
 
 bool NWScriptParser::ScriptParseResults::SerializeFromFile(generic_string filePath)
 {
+	auto pView = std::make_shared<ScriptParseResultsView>();
+	if (pView->Open(filePath))
+	{
+		_members.clear();
+		_sources.clear();
+		EngineStructuresCount = pView->EngineStructuresCount();
+		FunctionsCount = pView->FunctionsCount();
+		ConstantsCount = pView->ConstantsCount();
+		KeywordCount = pView->KeywordCount();
+		_pFileView = std::move(pView);
+		return true;
+	}
+
+	// Files from before the flat format (bitsery)
 	Buffer buffer;
 
 	std::string fileContents;
 	if (!fileToBuffer(filePath, fileContents))
 		return false;
 
+	// A flat file the view refused is corrupted; don't read it as the older format
+	if (ScriptParseResultsView::IsFlatFormat(fileContents.data(), fileContents.size()))
+		return false;
+
+	_pFileView.reset();
+	_sources.clear();
 	size_t writtenSize = fileContents.size();
 	buffer.assign(fileContents.begin(), fileContents.end());
 	auto state = bitsery::quickDeserialization<InputAdapter>({ buffer.begin(), writtenSize }, *this);
 
 	return true;
 }
+
+bool NWScriptParser::ScriptParseResultsView::Open(const generic_string& filePath)
+{
+	Close();
+
+	HANDLE hFile = ::CreateFile(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	// Empty files can't be mapped (and aren't valid anyway)
+	LARGE_INTEGER fileSize = {};
+	HANDLE hMapping = NULL;
+	if (::GetFileSizeEx(hFile, &fileSize) && fileSize.QuadPart >= static_cast<LONGLONG>(sizeof(FlatFileHeader)))
+		hMapping = ::CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	::CloseHandle(hFile);
+	if (!hMapping)
+		return false;
+
+	// The view keeps the mapping alive by itself
+	void* pView = ::MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+	::CloseHandle(hMapping);
+	if (!pView)
+		return false;
+
+	_pMappedView = pView;
+	if (!Validate(static_cast<const char*>(pView), static_cast<size_t>(fileSize.QuadPart)))
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+bool NWScriptParser::ScriptParseResultsView::Attach(const char* pData, size_t size)
+{
+	Close();
+	return Validate(pData, size);
+}
+
+void NWScriptParser::ScriptParseResultsView::Close()
+{
+	if (_pMappedView)
+		::UnmapViewOfFile(_pMappedView);
+
+	_pMappedView = nullptr;
+	_pData = _pMembers = _pParams = _pStrings = _pSources = nullptr;
+	_size = 0;
+}
+
+bool NWScriptParser::ScriptParseResultsView::IsFlatFormat(const char* pData, size_t size)
+{
+	return size >= sizeof(FlatFileHeader) && memcmp(pData, flatFormatMagic, sizeof(flatFormatMagic)) == 0;
+}
+
+// Checks the whole file once, so the accessors can trust every offset in it afterwards.
+bool NWScriptParser::ScriptParseResultsView::Validate(const char* pData, size_t size)
+{
+	if (!IsFlatFormat(pData, size))
+		return false;
+
+	const FlatFileHeader* pHeader = reinterpret_cast<const FlatFileHeader*>(pData);
+	if (pHeader->version != flatFormatVersion && pHeader->version != flatFormatSourcesVersion)
+		return false;
+
+	uint64_t expectedSize = sizeof(FlatFileHeader) + static_cast<uint64_t>(pHeader->membersCount) * sizeof(FlatMember)
+		+ static_cast<uint64_t>(pHeader->paramsCount) * sizeof(FlatParam) + pHeader->stringTableSize;
+
+	const FlatMember* pMembers = reinterpret_cast<const FlatMember*>(pData + sizeof(FlatFileHeader));
+	const FlatParam* pParams = reinterpret_cast<const FlatParam*>(pMembers + pHeader->membersCount);
+	const FlatSourcesHeader* pSourcesHeader = nullptr;
+	uint64_t sourcesSize = 0;
+	if (pHeader->version == flatFormatSourcesVersion)
+	{
+		expectedSize += sizeof(FlatSourcesHeader);
+		if (expectedSize > size)
+			return false;
+
+		pSourcesHeader = reinterpret_cast<const FlatSourcesHeader*>(pParams + pHeader->paramsCount);
+		sourcesSize = sizeof(FlatSourcesHeader) + static_cast<uint64_t>(pSourcesHeader->sourcesCount) * sizeof(FlatSource)
+			+ static_cast<uint64_t>(pSourcesHeader->sourceMembersCount) * sizeof(uint32_t);
+		expectedSize += sourcesSize - sizeof(FlatSourcesHeader);
+	}
+
+	if (expectedSize != size || pHeader->stringTableSize == 0)
+		return false;
+
+	const char* pStrings = reinterpret_cast<const char*>(pParams + pHeader->paramsCount) + sourcesSize;
+	const uint32_t stringTableSize = pHeader->stringTableSize;
+
+	for (uint32_t i = 0; i < pHeader->paramsCount; i++)
+	{
+		const FlatParam& p = pParams[i];
+		if (!isValidFlatString(p.sType, stringTableSize, pStrings) || !isValidFlatString(p.sName, stringTableSize, pStrings)
+			|| !isValidFlatString(p.sDefaultValue, stringTableSize, pStrings))
+			return false;
+	}
+
+	for (uint32_t i = 0; i < pHeader->membersCount; i++)
+	{
+		const FlatMember& m = pMembers[i];
+		if (m.mID > static_cast<uint32_t>(MemberID::Keyword) || m.firstParam > pHeader->paramsCount
+			|| m.paramCount > pHeader->paramsCount - m.firstParam)
+			return false;
+		if (!isValidFlatString(m.sType, stringTableSize, pStrings) || !isValidFlatString(m.sName, stringTableSize, pStrings)
+			|| !isValidFlatString(m.sValue, stringTableSize, pStrings))
+			return false;
+
+		// FindMember() binary searches by name
+		if (i > 0 && flatString(pStrings, m.sName) < flatString(pStrings, pMembers[i - 1].sName))
+			return false;
+	}
+
+	if (pSourcesHeader)
+	{
+		const FlatSource* pSources = reinterpret_cast<const FlatSource*>(pSourcesHeader + 1);
+		const uint32_t* pSourceMembers = reinterpret_cast<const uint32_t*>(pSources + pSourcesHeader->sourcesCount);
+		for (uint32_t i = 0; i < pSourcesHeader->sourcesCount; i++)
+		{
+			const FlatSource& source = pSources[i];
+			if (!isValidFlatString(source.sPath, stringTableSize, pStrings) || source.firstMember > pSourcesHeader->sourceMembersCount
+				|| source.memberCount > pSourcesHeader->sourceMembersCount - source.firstMember)
+				return false;
+		}
+
+		for (uint32_t i = 0; i < pSourcesHeader->sourceMembersCount; i++)
+		{
+			if (pSourceMembers[i] >= pHeader->membersCount)
+				return false;
+		}
+	}
+
+	_pData = pData;
+	_size = size;
+	_pMembers = reinterpret_cast<const char*>(pMembers);
+	_pParams = reinterpret_cast<const char*>(pParams);
+	_pSources = reinterpret_cast<const char*>(pSourcesHeader);
+	_pStrings = pStrings;
+
+	return true;
+}
+
+int NWScriptParser::ScriptParseResultsView::EngineStructuresCount() const
+{
+	return _pData ? reinterpret_cast<const FlatFileHeader*>(_pData)->engineStructuresCount : 0;
+}
+
+int NWScriptParser::ScriptParseResultsView::FunctionsCount() const
+{
+	return _pData ? reinterpret_cast<const FlatFileHeader*>(_pData)->functionsCount : 0;
+}
+
+int NWScriptParser::ScriptParseResultsView::ConstantsCount() const
+{
+	return _pData ? reinterpret_cast<const FlatFileHeader*>(_pData)->constantsCount : 0;
+}
+
+int NWScriptParser::ScriptParseResultsView::KeywordCount() const
+{
+	return _pData ? reinterpret_cast<const FlatFileHeader*>(_pData)->keywordCount : 0;
+}
+
+size_t NWScriptParser::ScriptParseResultsView::MembersCount() const
+{
+	return _pData ? reinterpret_cast<const FlatFileHeader*>(_pData)->membersCount : 0;
+}
+
+NWScriptParser::ScriptParseResultsView::MemberView NWScriptParser::ScriptParseResultsView::Member(size_t index) const
+{
+	const FlatMember& m = reinterpret_cast<const FlatMember*>(_pMembers)[index];
+
+	MemberView member;
+	member.mID = static_cast<MemberID>(m.mID);
+	member.sType = flatString(_pStrings, m.sType);
+	member.sName = flatString(_pStrings, m.sName);
+	member.sValue = flatString(_pStrings, m.sValue);
+	member.firstParam = m.firstParam;
+	member.paramCount = m.paramCount;
+
+	return member;
+}
+
+NWScriptParser::ScriptParseResultsView::ParamView NWScriptParser::ScriptParseResultsView::Param(const MemberView& member, size_t index) const
+{
+	const FlatParam& p = reinterpret_cast<const FlatParam*>(_pParams)[member.firstParam + index];
+	return { flatString(_pStrings, p.sType), flatString(_pStrings, p.sName), flatString(_pStrings, p.sDefaultValue) };
+}
+
+size_t NWScriptParser::ScriptParseResultsView::FindMember(std::string_view sName) const
+{
+	const FlatMember* pBegin = reinterpret_cast<const FlatMember*>(_pMembers);
+	const FlatMember* pEnd = pBegin + MembersCount();
+	const FlatMember* pFound = std::lower_bound(pBegin, pEnd, sName,
+		[this](const FlatMember& m, std::string_view sName) { return flatString(_pStrings, m.sName) < sName; });
+
+	if (pFound == pEnd || flatString(_pStrings, pFound->sName) != sName)
+		return MembersCount();
+	return pFound - pBegin;
+}
+
+size_t NWScriptParser::ScriptParseResultsView::SourcesCount() const
+{
+	return _pSources ? reinterpret_cast<const FlatSourcesHeader*>(_pSources)->sourcesCount : 0;
+}
+
+NWScriptParser::ScriptParseResultsView::SourceView NWScriptParser::ScriptParseResultsView::Source(size_t index) const
+{
+	const FlatSource& s = reinterpret_cast<const FlatSource*>(_pSources + sizeof(FlatSourcesHeader))[index];
+
+	SourceView source;
+	source.sPath = flatString(_pStrings, s.sPath);
+	source.nContentHash = (static_cast<uint64_t>(s.contentHashHigh) << 32) | s.contentHashLow;
+	source.nLastWriteTime = static_cast<int64_t>((static_cast<uint64_t>(s.lastWriteTimeHigh) << 32) | s.lastWriteTimeLow);
+	source.firstMember = s.firstMember;
+	source.memberCount = s.memberCount;
+
+	return source;
+}
+
+size_t NWScriptParser::ScriptParseResultsView::SourceMember(const SourceView& source, size_t index) const
+{
+	const FlatSource* pSources = reinterpret_cast<const FlatSource*>(_pSources + sizeof(FlatSourcesHeader));
+	const uint32_t* pSourceMembers = reinterpret_cast<const uint32_t*>(pSources + SourcesCount());
+	return pSourceMembers[source.firstMember + index];
+}
+
+NWScriptParser::ScriptMember NWScriptParser::ScriptParseResultsView::CopyMember(size_t index) const
+{
+	MemberView m = Member(index);
+
+	ScriptMember member;
+	member.mID = m.mID;
+	member.sType = m.sType;
+	member.sName = m.sName;
+	member.sValue = m.sValue;
+	member.params.reserve(m.paramCount);
+	for (size_t j = 0; j < m.paramCount; j++)
+	{
+		ParamView p = Param(m, j);
+		member.params.push_back({ std::string(p.sType), std::string(p.sName), std::string(p.sDefaultValue) });
+	}
+
+	return member;
+}
+
+void NWScriptParser::ScriptParseResultsView::CopyTo(ScriptParseResults& outResults) const
+{
+	// Fresh results aren't backed by any file, so Members() and Sources() below copy nothing
+	outResults = ScriptParseResults();
+	outResults.EngineStructuresCount = EngineStructuresCount();
+	outResults.FunctionsCount = FunctionsCount();
+	outResults.ConstantsCount = ConstantsCount();
+	outResults.KeywordCount = KeywordCount();
+
+	// Stored in set order: every insert goes straight to the end
+	std::set<ScriptMember, std::less<ScriptMember>>& members = outResults.Members();
+	const size_t count = MembersCount();
+	for (size_t i = 0; i < count; i++)
+		members.emplace_hint(members.end(), CopyMember(i));
+
+	// Source member indexes are ascending too
+	std::map<generic_string, ScriptSourceFile>& sources = outResults.Sources();
+	const size_t sourcesCount = SourcesCount();
+	for (size_t i = 0; i < sourcesCount; i++)
+	{
+		SourceView s = Source(i);
+
+		ScriptSourceFile& source = sources[str2wstr(std::string(s.sPath))];
+		source.nContentHash = s.nContentHash;
+		source.nLastWriteTime = s.nLastWriteTime;
+		for (size_t j = 0; j < s.memberCount; j++)
+			source.Members.emplace_hint(source.Members.end(), CopyMember(SourceMember(s, j)));
+	}
+}
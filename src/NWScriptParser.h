@@ -14,6 +14,10 @@
 #include <bitsery/brief_syntax/vector.h>
 #include <bitsery/brief_syntax/set.h>
 
+#include <functional>
+#include <memory>
+#include <string_view>
+
 #include "Common.h"
 
 //some helper types
@@ -128,6 +132,16 @@ namespace NWScriptPlugin {
 			}
 		};
 
+		// A file members were imported from, as it was when last parsed. Lets a later import skip the
+		// files that didn't change and work out which members a changed file added or dropped.
+		struct ScriptSourceFile {
+			uint64_t nContentHash = 0;
+			int64_t nLastWriteTime = 0;
+			std::set<ScriptMember, std::less<ScriptMember>> Members;
+		};
+
+		class ScriptParseResultsView;
+
 		struct ScriptParseResults
 		{
 			friend class bitsery::Access;
@@ -136,16 +150,29 @@ namespace NWScriptPlugin {
 			int FunctionsCount = 0;
 			int ConstantsCount = 0;
 			int KeywordCount = 0;
-			std::set<ScriptMember, std::less<ScriptMember>> Members;
 
-			std::string MembersAsSpacedString(MemberID memberType) {
+			// The members, for changing them. Results read from a flat file are read from the mapped file
+			// until then (see SerializeFromFile()): the first call copies them out, source files included.
+			std::set<ScriptMember, std::less<ScriptMember>>& Members();
+			// Source files by full path. Only kept for user tokens; members from older files have none.
+			// Copies the results out of their file, as Members() does.
+			std::map<generic_string, ScriptSourceFile>& Sources();
+
+			// Read access, from the file the results came from while they are unchanged
+			size_t MembersCount() const;
+			// Calls onMember for every member, in set order
+			void ForEachMember(const std::function<void(const ScriptMember& member)>& onMember) const;
+
+			// Adds the members of other that these results don't have yet (as std::set::merge does)
+			void MergeMembers(const ScriptParseResults& other);
+
+			std::string MembersAsSpacedString(MemberID memberType) const {
 				std::string results;
-				for (ScriptMember m : Members)
-				{
+				ForEachMember([&](const ScriptMember& m) {
 					if (m.mID == memberType) {
 						results.append(m.sName);results.append(" ");
 					}
-				}
+				});
 				// Remove last space
 				if (!results.empty())
 					results.pop_back();
@@ -158,7 +185,7 @@ namespace NWScriptPlugin {
 				ConstantsCount = 0;
 				KeywordCount = 0;
 
-				for (ScriptMember s : Members)
+				for (const ScriptMember& s : Members())
 				{
 					if (s.mID == MemberID::Constant)
 						ConstantsCount++;
@@ -171,20 +198,129 @@ namespace NWScriptPlugin {
 				}
 			}
 
+			// Same as MembersAsSpacedString(), pushed to an XML printer as it goes
+			void PrintMembersAsSpacedText(tinyxml2::XMLPrinter& printer, MemberID memberType) const;
+
 			void AddSpacedStringAsKeywords(const std::string& sKWArray);
 
+			// Writes the results in the flat format read by ScriptParseResultsView
+			void SerializeToBuffer(std::string& outBuffer) const;
+
 			bool SerializeToFile(generic_string filePath);
 
+			// Reads files in the flat format, and the older bitsery format as well. Flat files are mapped
+			// and read in place, not copied, until the results are changed: the file stays mapped (and
+			// can't be rewritten) for as long as unchanged results are kept.
 			bool SerializeFromFile(generic_string filePath);
 
 		private:
+			std::set<ScriptMember, std::less<ScriptMember>> _members;
+			std::map<generic_string, ScriptSourceFile> _sources;
+			// The file the results were read from, while they are unchanged
+			std::shared_ptr<const ScriptParseResultsView> _pFileView;
+
+			// Makes _members and _sources the results, copying them out of _pFileView
+			void CopyFromFileView();
+
 			template <typename S>
 			void serialize(S& s) {
-				s(EngineStructuresCount, FunctionsCount, ConstantsCount, KeywordCount, Members);
+				s(EngineStructuresCount, FunctionsCount, ConstantsCount, KeywordCount, _members);
 			}
 
 		};
 
+		// Read-only view of a file written by ScriptParseResults::SerializeToFile(). The file is mapped
+		// into memory and read in place: a header with the counts, then fixed-size member and parameter
+		// records pointing into one string table. Members are stored sorted (by name first), so they
+		// can be binary searched without building anything.
+		class ScriptParseResultsView {
+		public:
+			struct SourceView {
+				std::string_view sPath;		// UTF-8
+				uint64_t nContentHash = 0;
+				int64_t nLastWriteTime = 0;
+				size_t firstMember = 0;
+				size_t memberCount = 0;
+			};
+
+			struct ParamView {
+				std::string_view sType;
+				std::string_view sName;
+				std::string_view sDefaultValue;
+			};
+
+			struct MemberView {
+				MemberID mID = MemberID::Unknown;
+				std::string_view sType;
+				std::string_view sName;
+				std::string_view sValue;
+				size_t firstParam = 0;
+				size_t paramCount = 0;
+			};
+
+			ScriptParseResultsView() = default;
+			~ScriptParseResultsView() { Close(); }
+			ScriptParseResultsView(const ScriptParseResultsView&) = delete;
+			ScriptParseResultsView& operator=(const ScriptParseResultsView&) = delete;
+
+			// Maps the file in. Fails for missing files and files not in the flat format.
+			bool Open(const generic_string& filePath);
+			// Views a buffer already in memory (not copied: it must outlive the view)
+			bool Attach(const char* pData, size_t size);
+			void Close();
+			bool IsOpen() const { return _pData != nullptr; }
+
+			int EngineStructuresCount() const;
+			int FunctionsCount() const;
+			int ConstantsCount() const;
+			int KeywordCount() const;
+
+			size_t MembersCount() const;
+			MemberView Member(size_t index) const;
+			ParamView Param(const MemberView& member, size_t index) const;
+
+			// Index of the first member called sName; MembersCount() if there's none.
+			size_t FindMember(std::string_view sName) const;
+
+			size_t SourcesCount() const;
+			SourceView Source(size_t index) const;
+			// Index (for Member()) of a source file's member
+			size_t SourceMember(const SourceView& source, size_t index) const;
+
+			// Replaces outResults contents with the members and source files in the file
+			void CopyTo(ScriptParseResults& outResults) const;
+
+			// The whole file, as it is mapped
+			std::string_view Contents() const { return std::string_view(_pData, _size); }
+
+			// Whether a buffer starts like a file in the flat format
+			static bool IsFlatFormat(const char* pData, size_t size);
+
+		private:
+			const char* _pData = nullptr;
+			const char* _pMembers = nullptr;
+			const char* _pParams = nullptr;
+			const char* _pStrings = nullptr;
+			const char* _pSources = nullptr;
+			size_t _size = 0;
+			void* _pMappedView = nullptr;
+
+			bool Validate(const char* pData, size_t size);
+			ScriptMember CopyMember(size_t index) const;
+		};
+
+		// What SyncSources() changed
+		struct SourceSyncResults {
+			int FilesParsed = 0;
+			int FilesUnchanged = 0;
+			int FilesRemoved = 0;
+			int MembersAdded = 0;
+			int MembersRemoved = 0;
+			int MembersChanged = 0;
+
+			bool HasChanges() const { return MembersAdded > 0 || MembersRemoved > 0 || MembersChanged > 0; }
+		};
+
 		explicit NWScriptParser(HWND MyParent) : _hWnd(MyParent) {}
 
 		// Parse the Input file (ANSI or UNICODE) and if successful, returns a sorted members list from that file
@@ -192,9 +328,26 @@ namespace NWScriptPlugin {
 
 		bool ParseBatch(const std::vector<generic_string>& sFilePaths, ScriptParseResults& outParseResults);
 
+		// Brings ioParseResults up to date with sFilePaths and with every source file it already knows about.
+		// Only files whose contents changed since they were last parsed are parsed again; members they
+		// dropped are removed (unless another file still declares them) and new ones are added. Files
+		// that no longer exist are dropped with their members. Returns false if one of sFilePaths can't be
+		// read, leaving ioParseResults partially synced.
+		bool SyncSources(const std::vector<generic_string>& sFilePaths, ScriptParseResults& ioParseResults,
+			SourceSyncResults& outSyncResults);
+
+		// Hash of a file's contents, as in ScriptSourceFile::nContentHash
+		static uint64_t ContentHash(std::string_view sContents);
+
 	private:
 		HWND _hWnd;
 
+		// Full, long path name of a file (links resolved). False if the name can't be resolved.
+		bool ResolveFileName(const generic_string& sFileName, generic_string& outFullPath);
+
+		// Converts UTF-16 contents to UTF-8 and parses them
+		void ParseFileContents(std::string& sFileContents, ScriptParseResults& outParseResults);
+
 		// Transforms a raw FileContent pointer into a ScriptParseResults list (for ASCII and UTF-8 based contents)
 		void CreateNWScriptStructure(const std::string& sFileContents, ScriptParseResults& outParseResults);	
 	};
@@ -820,8 +820,15 @@ CExoString CExoString::RemoveAllExcept(const char* c) const
     return ret;
 }
 
-static thread_local char *CExoStringFormatBuffer = 0;
-static thread_local int32_t   CExoStringFormatBufferSize = 0;
+// Each thread's Format() buffer, released when the thread ends
+struct CExoStringFormatBufferHolder
+{
+	char *m_pBuffer = 0;
+	int32_t m_nSize = 0;
+
+	~CExoStringFormatBufferHolder() { delete[] m_pBuffer; }
+};
+static thread_local CExoStringFormatBufferHolder CExoStringFormatBuffer;
 
 ///////////////////////////////////////////////////////////////////////////////
 //  CExoString:: Format()
@@ -850,13 +857,13 @@ void CExoString::Format(const char *format,...)
 	//    - going to assume the size is les than 1024 chars and grow it bigger if we need.
 	//    - after  successful sprintf we will create a new buffer the exact size and copy
 
-	if (CExoStringFormatBuffer == 0 && CExoStringFormatBufferSize == 0)
+	if (CExoStringFormatBuffer.m_pBuffer == 0 && CExoStringFormatBuffer.m_nSize == 0)
 	{
-		CExoStringFormatBufferSize = 1024;
-		CExoStringFormatBuffer = new char[CExoStringFormatBufferSize];
+		CExoStringFormatBuffer.m_nSize = 1024;
+		CExoStringFormatBuffer.m_pBuffer = new char[CExoStringFormatBuffer.m_nSize];
 	}
 
-	requiredSize = _vsnprintf(CExoStringFormatBuffer, CExoStringFormatBufferSize, format, argList) + 1;
+	requiredSize = _vsnprintf(CExoStringFormatBuffer.m_pBuffer, CExoStringFormatBuffer.m_nSize, format, argList) + 1;
 	if (requiredSize < 0) // error condition
 	{
 		return;
@@ -864,35 +871,35 @@ void CExoString::Format(const char *format,...)
 
 	while (requiredSize <= 0)
 	{
-		CExoStringFormatBufferSize += 1024;
-		if (CExoStringFormatBuffer)
+		CExoStringFormatBuffer.m_nSize += 1024;
+		if (CExoStringFormatBuffer.m_pBuffer)
 		{
-			delete[] CExoStringFormatBuffer;
+			delete[] CExoStringFormatBuffer.m_pBuffer;
 		}
-		CExoStringFormatBuffer = new char[CExoStringFormatBufferSize];
+		CExoStringFormatBuffer.m_pBuffer = new char[CExoStringFormatBuffer.m_nSize];
 
-		requiredSize = _vsnprintf(CExoStringFormatBuffer, CExoStringFormatBufferSize, format, argList) + 1;
+		requiredSize = _vsnprintf(CExoStringFormatBuffer.m_pBuffer, CExoStringFormatBuffer.m_nSize, format, argList) + 1;
 	}
 #else
 
 #endif // WIN32
 
-	if ((CExoStringFormatBuffer == 0) || (CExoStringFormatBufferSize < requiredSize))
+	if ((CExoStringFormatBuffer.m_pBuffer == 0) || (CExoStringFormatBuffer.m_nSize < requiredSize))
 	{
-		if (CExoStringFormatBuffer)
+		if (CExoStringFormatBuffer.m_pBuffer)
 		{
-			delete[] CExoStringFormatBuffer;
+			delete[] CExoStringFormatBuffer.m_pBuffer;
 		}
-		CExoStringFormatBufferSize = (requiredSize + 256);
-		CExoStringFormatBuffer = new char[CExoStringFormatBufferSize];
+		CExoStringFormatBuffer.m_nSize = (requiredSize + 256);
+		CExoStringFormatBuffer.m_pBuffer = new char[CExoStringFormatBuffer.m_nSize];
 	}
 
-	if ( !CExoStringFormatBuffer )
+	if ( !CExoStringFormatBuffer.m_pBuffer )
 	{
 		return;
 	}
 
-	vsnprintf( CExoStringFormatBuffer, requiredSize, format, argList );
+	vsnprintf( CExoStringFormatBuffer.m_pBuffer, requiredSize, format, argList );
 
 	// copy from CExoStringFormatBuffer to string
 	// allocate new string, if necessary.
@@ -904,7 +911,7 @@ void CExoString::Format(const char *format,...)
 		m_sString = new char[m_nBufferLength];
 	}
 
-	strncpy(m_sString, CExoStringFormatBuffer, requiredSize);
+	strncpy(m_sString, CExoStringFormatBuffer.m_pBuffer, requiredSize);
 	m_sString[requiredSize] = 0;
 
 	va_end(argList);
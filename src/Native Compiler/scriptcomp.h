@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include <memory>
+#include <unordered_set>
 #include <vector>
 
 #include "exobase.h"
@@ -26,6 +28,7 @@ class CScriptParseTreeNode;
 class CScriptParseTreeNodeBlock;
 class CScriptCompilerStackEntry;
 class CScriptCompilerIdListEntry;
+class CScriptCompilerArena;
 class CScriptSourceFile;
 class CScriptCompilerVarStackEntry;
 class CScriptCompilerStructureEntry;
@@ -33,6 +36,12 @@ class CScriptCompilerStructureFieldEntry;
 class CScriptCompilerSymbolTableEntry;
 class CScriptCompilerKeyWordEntry;
 class CScriptCompilerIdentifierHashTableEntry;
+class CScriptCompilerIdentifierHashTable;
+class CScriptCompilerLanguageContext;
+
+// Classes defined in scriptcompincludecache.h
+class CScriptCompilerIncludeCache;
+class CScriptCompilerIncludeModule;
 
 // Defines required for static size of values.
 #define CSCRIPTCOMPILER_MAX_TABLE_FILENAMES  512
@@ -54,6 +63,8 @@ class CScriptCompilerIdentifierHashTableEntry;
 #define CSCRIPTCOMPILER_OPTIMIZE_FOLD_CONSTANTS                       0x00000002
 // Post processes generated instructions to merge sequences into shorter equivalents
 #define CSCRIPTCOMPILER_OPTIMIZE_MELD_INSTRUCTIONS                    0x00000004
+// Dispatches large switch statements with a binary search instead of one test per case
+#define CSCRIPTCOMPILER_OPTIMIZE_SWITCH_TREES                         0x00000008
 
 #define CSCRIPTCOMPILER_OPTIMIZE_NOTHING                              0x00000000
 #define CSCRIPTCOMPILER_OPTIMIZE_EVERYTHING                           0xFFFFFFFF
@@ -73,6 +84,101 @@ public:
 	int32_t m_nTokenCharacters;
 };
 
+// An include file loaded during a compile (used to validate precompiled include
+// modules before they are reused).
+class CScriptCompilerLoadedIncludeFile
+{
+public:
+	CExoString m_sFileName;
+	uint64_t   m_nContentHash;
+	int32_t    m_nCompileFileLevel;
+};
+
+// An include being parsed, to be captured as a precompiled module once the
+// parser picks up its functional units.
+class CScriptCompilerIncludeCapture
+{
+public:
+	uint64_t m_nKey;
+	uint64_t m_nEntryStateHash;     // User identifiers defined before the include
+	BOOL     m_bCapture;            // FALSE when the include was spliced from a module
+	int32_t  m_nCompileFileLevel;
+	int32_t  m_nFirstIdentifier;
+	int32_t  m_nFirstFileName;
+	int32_t  m_nFirstLoadedFile;
+	size_t   m_nFirstDiagnostic;    // Errors compiled past in the include leave it out of the cache
+	CScriptParseTreeNode *m_pLastGlobalVariable;   // End of the global variable list (NULL = no list yet)
+};
+
+// An error found by a compile (see CScriptCompiler::SetMaxErrors()).
+class CScriptCompilerDiagnostic
+{
+public:
+	int32_t    m_nError;        // STRREF_CSCRIPTCOMPILER_ERROR_* (negative)
+	CExoString m_sFileName;     // As in the captured error: "script.nss", or "Chunk"
+	int32_t    m_nLine;         // 0 when the error isn't tied to a line
+	CExoString m_sErrorText;    // The message, without the file name and line
+};
+
+// A token handed to the parser (see CScriptCompiler::SetTokenTrace()).
+class CScriptCompilerToken
+{
+public:
+	int32_t    m_nTokenStatus;  // CSCRIPTCOMPILER_TOKEN_*
+	CExoString m_sToken;        // The characters of the token, as the parser saw them
+	int32_t    m_nLine;         // Where the tokenizer was when the token ended
+	int32_t    m_nCharacterOnLine;
+};
+
+// The state of the tree walk at the start of the function being walked, for
+// the walk to go on with the next functional unit after an error in it.
+class CScriptCompilerWalkRecoveryPoint
+{
+public:
+	CScriptParseTreeNode *m_pFunctionalUnit;   // NULL = no function walked yet
+	int32_t m_nOccupiedVariables;
+	int32_t m_nStackCurrentDepth;
+	int32_t m_nVarStackRecursionLevel;
+	int32_t m_nLoopStackDepth;
+	int32_t m_nSwitchLevel;
+	int32_t m_nSwitchStackDepth;
+};
+
+// A node on the stack of one of the iterative tree walks (WalkParseTree(),
+// DeleteParseTree() and friends), and how far the walk has got with it.
+class CScriptCompilerTreeWalkEntry
+{
+public:
+	CScriptParseTreeNode  *m_pNode;
+	int32_t                m_nState;   // 0 = not visited yet, then the children walked so far
+	CScriptParseTreeNode **m_ppCopy;   // Where DuplicateScriptParseTree() links the copy
+};
+
+// The identifier list.  The predefined identifiers are those of the language
+// context (shared with the other compilers using it); the ones defined by the
+// script follow them, in blocks allocated as the script needs them.
+class CScriptCompilerIdentifierList
+{
+public:
+	CScriptCompilerIdentifierList();
+	~CScriptCompilerIdentifierList();
+
+	CScriptCompilerIdentifierList(const CScriptCompilerIdentifierList &) = delete;
+	CScriptCompilerIdentifierList &operator=(const CScriptCompilerIdentifierList &) = delete;
+
+	inline CScriptCompilerIdListEntry &operator[](int32_t nIndex);   // In scriptinternal.h
+
+	void SetShared(CScriptCompilerIdListEntry *pcShared, int32_t nShared);
+	void Clear();
+
+private:
+	CScriptCompilerIdListEntry &AllocateEntry(int32_t nIndex);
+
+	CScriptCompilerIdListEntry *m_pcShared;
+	int32_t m_nShared;
+	std::vector<CScriptCompilerIdListEntry *> m_apBlocks;
+};
+
 class CScriptCompiler;
 
 // Functions you need to implement when invoking script compiler.
@@ -87,6 +193,11 @@ struct CScriptCompilerAPI
     // Return 0 if OK, or error STRREF on failure (scripterrors.h)
     int32_t (*ResManWriteToFile)(const char* sFileName, RESTYPE nResType, const uint8_t* pData, size_t nSize, bool bBinary);
 
+    // Optional. Same as ResManWriteToFile, but takes ownership of pData (allocated with new[]), even on
+    // failure. Used instead of it when the compiler cleans up after compiles, so the buffers it would
+    // delete are handed over rather than copied.
+    int32_t (*ResManTakeFile)(const char* sFileName, RESTYPE nResType, char* pData, size_t nSize, bool bBinary);
+
     // Read the given filename+restype from resman, and return a zero-terminated string containing
     // the content (up to the first null terminator). Returns nullptr if the file cannot be read/loaded.
     // The returned string is a global static buffer and must not be freed by you.
@@ -129,6 +240,23 @@ public:
 	//
 	///////////////////////////////////////////////////////////////////////
 
+	///////////////////////////////////////////////////////////////////////
+	void SetLanguageContext(const std::shared_ptr<const CScriptCompilerLanguageContext> &pContext);
+	std::shared_ptr<const CScriptCompilerLanguageContext> GetLanguageContext() const { return m_pLanguageContext; }
+	//---------------------------------------------------------------------
+	// Desc.: SetIdentifierSpecification() reads the language definition
+	//        into a context, which GetLanguageContext() returns.  Giving
+	//        it to SetLanguageContext() of another compiler sets that
+	//        compiler up with the same definition without reading it
+	//        again: the context is never changed once it has been built,
+	//        so the compilers share it (from any thread) rather than each
+	//        holding a copy.
+	//
+	// pContext:  (IN) The context of another compiler, or NULL to drop
+	//                 the language definition.
+	//
+	///////////////////////////////////////////////////////////////////////
+
 	///////////////////////////////////////////////////////////////////////
 	void SetOutputAlias(const CExoString &sAlias);
 	//---------------------------------------------------------------------
@@ -160,6 +288,58 @@ public:
 	void SetOptimizationFlags(uint32_t nFlags) { m_nOptimizationFlags = nFlags; }
 	uint32_t GetOptimizationFlags() { return m_nOptimizationFlags; }
 
+	///////////////////////////////////////////////////////////////////////
+	void SetIncludeCache(CScriptCompilerIncludeCache *pCache) { m_pIncludeCache = pCache; }
+	//---------------------------------------------------------------------
+	// Desc.: This routine will set the cache of precompiled include
+	//        modules.  The first time an include file is parsed, its
+	//        functional units and identifiers are stored in the cache;
+	//        later compiles (by any compiler sharing the cache) splice
+	//        them in instead of parsing the file again.
+	//
+	// pCache:  (IN) The cache to use (it must outlive the compiles), or
+	//               NULL (default) to parse every include file.
+	//
+	///////////////////////////////////////////////////////////////////////
+
+	///////////////////////////////////////////////////////////////////////
+	void SetMaxErrors(int32_t nMaxErrors) { m_nMaxErrors = nMaxErrors; }
+	const std::vector<CScriptCompilerDiagnostic> &GetDiagnostics() const { return m_aDiagnostics; }
+	//---------------------------------------------------------------------
+	// Desc.: This routine will set how many errors a compile reports
+	//        before it gives up.  Past a syntax error, the parser skips
+	//        to the end of the statement (the next ';' or the '}' of a
+	//        block opened in it), or to the end of the declaration
+	//        outside of functions, and goes on from there.  Past an
+	//        error in a function, the code generation goes on with the
+	//        next function.  A compile that found errors still fails,
+	//        but GetDiagnostics() lists all of them, in the order they
+	//        were found; the captured error is the first one.
+	//
+	// nMaxErrors:  (IN) The number of errors to stop at.  0 or 1
+	//                   (default): stop at the first error.
+	//
+	///////////////////////////////////////////////////////////////////////
+
+	///////////////////////////////////////////////////////////////////////
+	void SetCharacterRuns(BOOL bValue) { m_bCharacterRuns = bValue; }
+	void SetTokenTrace(std::vector<CScriptCompilerToken> *pTokens) { m_pTokenTrace = pTokens; }
+	//---------------------------------------------------------------------
+	// Desc.: These routines are for testing the tokenizer.  With
+	//        character runs off, the tokenizer goes through the scripts
+	//        one character at a time, as it did before the runs of
+	//        characters that only extend a token were consumed in bulk
+	//        (see ParseCharacterRun()): both ways must give the same
+	//        tokens, errors and line numbers.  With a token trace, every
+	//        token handed to the parser (or to the identifier list) is
+	//        added to the list.
+	//
+	// bValue:   (IN) TRUE (default): consume runs of characters in bulk.
+	// pTokens:  (IN) The list to add the tokens to (it must outlive the
+	//                compiles), or NULL (default) for no trace.
+	//
+	///////////////////////////////////////////////////////////////////////
+
 	///////////////////////////////////////////////////////////////////////
 	void SetAutomaticCleanUpAfterCompiles(BOOL bValue);
 	//---------------------------------------------------------------------
@@ -326,6 +506,7 @@ private:
 	int32_t GenerateParseTree();
 
 	float ParseFloatFromTokenString();
+	int32_t m_nTokenConstantIdentifier;   // Identifier whose (float) value the token holds, or -1
 
 	int32_t HandleToken();
 	int32_t TestIdentifierToken();
@@ -367,7 +548,10 @@ private:
 	int32_t ParseCommentedOutCharacter(int32_t ch);
 
 	int32_t ParseNextCharacter(int32_t ch, int32_t chNext, char *pScript, int32_t nScriptLength);
+	int32_t ParseCharacterRun(const char *pScript, int32_t nScriptLength);
+	int32_t ParseCharacterStream(char *pScript, int32_t nScriptLength);
 
+	int32_t OutputParseSourceError(int32_t nParseCharacterError);
 	int32_t PrintParseSourceError(int32_t nParseCharacterError);
 	int32_t ParseSource(char *pScript, int32_t nScriptLength);
 
@@ -451,11 +635,21 @@ private:
 
 	// Variable for storing the values for each character (assembled in HashString) for identifiers
 	int32_t *m_pnHashString;
-	// The actual hash table.
-	CScriptCompilerIdentifierHashTableEntry *m_pIdentifierHashTable;
+	// The actual hash table: the names defined by the script, or all of them while
+	// the language definition is being read (the language context has the others).
+	CScriptCompilerIdentifierHashTable *m_pIdentifierHashTable;
 	uint32_t HashManagerAdd(uint32_t nType, uint32_t nTypeIndice);
 	uint32_t HashManagerDelete(uint32_t nType, uint32_t nTypeIndice);
-	int32_t GetHashEntryByName(const char *psIdentifierName);
+	// Looks for the name among the entries of type nType (0 = any type); NULL if not found.
+	const CScriptCompilerIdentifierHashTableEntry *GetHashEntryByName(const char *psIdentifierName, uint32_t nType = 0);
+	const CScriptCompilerIdentifierHashTableEntry *FindHashEntry(const CScriptCompilerIdentifierHashTable *pTable, uint32_t nHashValue, const char *psIdentifierName, uint32_t nType);
+
+	// The language definition (keywords, engine structures and predefined
+	// identifiers), shared with the other compilers using it.
+	std::shared_ptr<const CScriptCompilerLanguageContext> m_pLanguageContext;
+	void InitializeKeyWords();
+	void ReleaseLanguageContext();
+	std::shared_ptr<const CScriptCompilerLanguageContext> CreateLanguageContext();
 
 	// Status of the current token
 	int32_t m_nTokenStatus;
@@ -467,6 +661,12 @@ private:
 	int32_t m_nSRStackEntries;
 	int32_t m_nSRStackStates;
 
+	// Explicit stack shared by the iterative tree walks.  A walk started by
+	// another one (say, from a visitor) only uses the entries above those of
+	// the outer walk.
+	std::vector<CScriptCompilerTreeWalkEntry> m_aTreeWalkStack;
+	void PushTreeWalkEntry(CScriptParseTreeNode *pNode, CScriptParseTreeNode **ppCopy = NULL);
+
 
 	// Identifiers (read from language definition file)
 	int32_t m_bCompileIdentifierList;
@@ -475,9 +675,13 @@ private:
 	int32_t m_nIdentifierListVector;
 	int32_t m_nIdentifierListEngineStructure;
 	int32_t m_nIdentifierListReturnType;
-	CScriptCompilerIdListEntry *m_pcIdentifierList;
+	CScriptCompilerIdentifierList m_pcIdentifierList;
 	int32_t m_nOccupiedIdentifiers;
 	int32_t m_nMaxPredefinedIdentifierId;
+	// Parameter arrays of the identifiers: those of the language definition live
+	// as long as it does, the ones of the script are released after each compile.
+	CScriptCompilerArena *m_pPredefinedParameterArena;
+	CScriptCompilerArena *m_pUserParameterArena;
 	int32_t m_nPredefinedIdentifierOrder;
 
 	int32_t PrintParseIdentifierFileError(int32_t nParseCharacterError);
@@ -491,6 +695,16 @@ private:
 	int32_t m_nCompileFileLevel;
 	CScriptCompilerIncludeFileStackEntry m_pcIncludeFileStack[CSCRIPTCOMPILER_MAX_INCLUDE_LEVELS];
 
+	// Precompiled include modules (see scriptcompincludecache.h).
+	CScriptCompilerIncludeCache *m_pIncludeCache;
+	std::vector<CScriptCompilerLoadedIncludeFile> m_aIncludeFilesLoaded;
+	std::vector<CScriptCompilerIncludeCapture> m_aIncludeCaptures;
+	uint64_t HashIncludeEntryState(int32_t nIdentifiers);
+	uint64_t GetIncludeModuleKey(const CExoString &sFileName, uint64_t nEntryStateHash);
+	BOOL ValidateIncludeModule(const CScriptCompilerIncludeModule *pModule);
+	CScriptParseTreeNode *SpliceIncludeModule(const CScriptCompilerIncludeModule *pModule);
+	void CaptureIncludeModule(CScriptParseTreeNode *pFunctionalUnits);
+
 
 	// A Variable Stack
 	int32_t m_nVarStackRecursionLevel;
@@ -517,6 +731,14 @@ private:
 	int32_t AddToGlobalVariableList(CScriptParseTreeNode *pGlobalVariableNode);
 
 	BOOL ConstantFoldNode(CScriptParseTreeNode *pNode, BOOL bForce=FALSE);
+	BOOL ConstantFoldNodeOperation(CScriptParseTreeNode *pNode);
+
+	// A condition folded to a constant isn't tested at run time: its CONSTI is taken back out,
+	// and the conditional jump that would have followed it becomes a JMP, or disappears.
+	int32_t m_nFoldedConditionLocation;   // Code offset of that jump (-1 = no folded condition)
+	BOOL m_bFoldedConditionValue;
+	void FoldConstantCondition(CScriptParseTreeNode *pNode);
+	char *EmitConditionalJump();
 
 	BOOL m_bConstantVariableDefinition;
 
@@ -530,11 +752,16 @@ private:
 	CExoString m_sUndefinedIdentifier;
 
 	BOOL m_bSwitchLabelDefault;
-	int32_t  m_nSwitchLabelNumber;
-	int32_t  m_nSwitchLabelArraySize;
-	int32_t* m_pnSwitchLabelStatements;
+	std::vector<int32_t> m_aSwitchLabelValues;            // In source order
+	std::unordered_set<int32_t> m_aSwitchLabelValueSet;   // Duplicate detection
+	int32_t  m_nSwitchTreeLabels;
 	void InitializeSwitchLabelList();
 	int32_t  TraverseTreeForSwitchLabels(CScriptParseTreeNode *pNode);
+	void GenerateSwitchCaseTest(int32_t nCaseValue);
+	void GenerateSwitchCompare(int32_t nValue, uint8_t nOpCode);
+	void GenerateSwitchJump(uint8_t nOpCode, int32_t nSymbolType, int32_t nSymbolSubType1, int32_t nSymbolSubType2);
+	void GenerateSwitchMissJump();
+	void GenerateSwitchDecisionTree(const int32_t *pnValues, int32_t nValues, int64_t nKnownLow, int64_t nKnownHigh, BOOL bLastBranch);
 	void ClearSwitchLabelList();
 	int32_t  GenerateCodeForSwitchLabels(CScriptParseTreeNode *pNode);
 
@@ -635,10 +862,26 @@ private:
 
 	int32_t         m_nFinalBinarySize;
 
+	// Tokenizer testing (see SetCharacterRuns()).
+	BOOL        m_bCharacterRuns;
+	std::vector<CScriptCompilerToken> *m_pTokenTrace;
+
 	// Error generation.
 
 	CExoString  m_sCapturedError;
     STRREF      m_nCapturedErrorStrRef;
 
+	// Error recovery (see SetMaxErrors()).
+	int32_t     m_nMaxErrors;
+	std::vector<CScriptCompilerDiagnostic> m_aDiagnostics;
+	int32_t     m_nRecoveredErrors;       // Errors compiled past in this compile
+	int32_t     m_nRecoverySkipMode;      // CSCRIPTCOMPILER_RECOVERY_SKIP_*
+	int32_t     m_nRecoverySkipBraces;    // Blocks left to close before the skip can end
+	std::unordered_set<CScriptParseTreeNode *> m_aRecoveredFunctionSet;   // Functions a statement was dropped from
+	CScriptCompilerWalkRecoveryPoint m_cWalkRecoveryPoint;
+	BOOL        RecoverFromParseError(int32_t nParsingError);
+	BOOL        SkipTokenDuringRecovery();
+	BOOL        RecoverFromWalkTreeError(CScriptParseTreeNode *pNode, int32_t nError);
+
     void* m_pUserData;
 };
@@ -44,15 +44,21 @@
 //::
 //::///////////////////////////////////////////////////////////////////////////
 
+#include <math.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include <new>
+
 // external header files
 #include "exobase.h"
 #include "scriptcomp.h"
 
 // internal header files
 #include "scriptinternal.h"
+#include "scriptcompincludecache.h"
 
 //::///////////////////////////////////////////////////////////////////////////
 //::
@@ -99,188 +105,403 @@ CScriptCompilerIdListEntry::CScriptCompilerIdListEntry()
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-//  CScriptCompilerIdListEntry::~CScriptCompilerIdListEntry()
+//  CScriptCompilerIdListEntry::ExpandParameterSpace()
 ///////////////////////////////////////////////////////////////////////////////
 //  Created By: Mark Brockington
-//  Created On: 07/10/2001
-//  Description:  Default destructor for class.
+//  Created On: 05/18/2001
+//  Description:  Used to expand the parameter space (when required).  The
+//                arrays come from pArena, which owns them: the old ones are
+//                simply left behind.  With nParameterSpace, room is made for
+//                exactly that many parameters instead of doubling.
 ///////////////////////////////////////////////////////////////////////////////
-CScriptCompilerIdListEntry::~CScriptCompilerIdListEntry()
+
+int32_t CScriptCompilerIdListEntry::ExpandParameterSpace(CScriptCompilerArena *pArena, int32_t nParameterSpace)
 {
+	int32_t nNewParameterSpace;
 
-	// Delete the allocated arrays.
-	if (m_pchParameters)
-	{
-		delete[] m_pchParameters;
-	}
-	if (m_psStructureParameterNames)
+	if (nParameterSpace > 0)
 	{
-		delete[] m_psStructureParameterNames;
-	}
-	if (m_pbOptionalParameters)
-	{
-		delete[] m_pbOptionalParameters;
+		if (nParameterSpace > CSCRIPTCOMPILERIDLISTENTRY_MAX_PARAMETERS)
+		{
+			return STRREF_CSCRIPTCOMPILER_ERROR_TOO_MANY_PARAMETERS_ON_FUNCTION;
+		}
+		if (nParameterSpace <= m_nParameterSpace)
+		{
+			return 0;
+		}
+		nNewParameterSpace = nParameterSpace;
 	}
-	if (m_pnOptionalParameterIntegerData)
+	else
 	{
-		delete[] m_pnOptionalParameterIntegerData;
+		if (m_nParameterSpace == CSCRIPTCOMPILERIDLISTENTRY_MAX_PARAMETERS)
+		{
+			return STRREF_CSCRIPTCOMPILER_ERROR_TOO_MANY_PARAMETERS_ON_FUNCTION;
+		}
+
+		if (m_nParameterSpace == 0)
+		{
+			nNewParameterSpace = 4;
+		}
+		else
+		{
+			nNewParameterSpace = m_nParameterSpace * 2;
+		}
 	}
-	if (m_pfOptionalParameterFloatData)
+
+	// Declare the new arrays: the parameter types (checked on every call) on
+	// their own, and the optional parameter data (only needed when a call
+	// leaves parameters out) in a block of its own.
+	char       *pchNewParameters                    = (char *) pArena->Allocate(nNewParameterSpace * sizeof(char));
+	char       *pchOptionalData                     = (char *) pArena->Allocate(nNewParameterSpace *
+	                                                  (sizeof(BOOL) + sizeof(int32_t) + sizeof(float) + sizeof(OBJECT_ID) + 3 * sizeof(float)));
+	BOOL       *pbNewOptionalParameters             = (BOOL *) pchOptionalData;
+	int32_t        *pnNewOptionalParameterIntegerData   = (int32_t *) (pbNewOptionalParameters + nNewParameterSpace);
+	float      *pfNewOptionalParameterFloatData     = (float *) (pnNewOptionalParameterIntegerData + nNewParameterSpace);
+	OBJECT_ID  *poidNewOptionalParameterObjectData  = (OBJECT_ID *) (pfNewOptionalParameterFloatData + nNewParameterSpace);
+	float      *pfNewOptionalParameterVectorData    = (float *) (poidNewOptionalParameterObjectData + nNewParameterSpace);
+	CExoString *psNewStructureParameterNames        = pArena->AllocateStrings(nNewParameterSpace * 2);
+	CExoString *psNewOptionalParameterStringData    = psNewStructureParameterNames + nNewParameterSpace;
+
+	// Copy the old values to the new arrays.
+	int32_t nCount;
+
+	for (nCount = 0; nCount < m_nParameterSpace; nCount++)
 	{
-		delete[] m_pfOptionalParameterFloatData;
+		pchNewParameters[nCount]                   = m_pchParameters[nCount];
+		psNewStructureParameterNames[nCount]       = m_psStructureParameterNames[nCount];
+		pbNewOptionalParameters[nCount]            = m_pbOptionalParameters[nCount];
+		pnNewOptionalParameterIntegerData[nCount]  = m_pnOptionalParameterIntegerData[nCount];
+		pfNewOptionalParameterFloatData[nCount]    = m_pfOptionalParameterFloatData[nCount];
+		psNewOptionalParameterStringData[nCount]   = m_psOptionalParameterStringData[nCount];
+		poidNewOptionalParameterObjectData[nCount] = m_poidOptionalParameterObjectData[nCount];
 	}
-	if (m_psOptionalParameterStringData)
+	for (nCount = 0; nCount < m_nParameterSpace * 3; nCount++)
 	{
-		delete[] m_psOptionalParameterStringData;
+		pfNewOptionalParameterVectorData[nCount]   = m_pfOptionalParameterVectorData[nCount];
 	}
-	if (m_poidOptionalParameterObjectData)
+
+	// Oh, yeah, it's a good idea to declare what the values are!  (The strings
+	// are constructed empty.)
+	for (nCount = m_nParameterSpace; nCount < nNewParameterSpace; nCount++)
 	{
-		delete[] m_poidOptionalParameterObjectData;
+		pchNewParameters[nCount]                   = 0;
+		pbNewOptionalParameters[nCount]            = FALSE;
+		pnNewOptionalParameterIntegerData[nCount]  = 0;
+		pfNewOptionalParameterFloatData[nCount]    = 0.0f;
+		poidNewOptionalParameterObjectData[nCount] = INVALID_OBJECT_ID;
 	}
-	if (m_pfOptionalParameterVectorData)
+
+	for (nCount = m_nParameterSpace * 3; nCount < nNewParameterSpace * 3; nCount++)
 	{
-		delete[] m_pfOptionalParameterVectorData;
+		pfNewOptionalParameterVectorData[nCount]   = 0.0f;
 	}
+
+	m_nParameterSpace = nNewParameterSpace;
+
+	m_pchParameters                   = pchNewParameters;
+	m_psStructureParameterNames       = psNewStructureParameterNames;
+	m_pbOptionalParameters            = pbNewOptionalParameters;
+	m_pnOptionalParameterIntegerData  = pnNewOptionalParameterIntegerData;
+	m_pfOptionalParameterFloatData    = pfNewOptionalParameterFloatData;
+	m_psOptionalParameterStringData   = psNewOptionalParameterStringData;
+	m_poidOptionalParameterObjectData = poidNewOptionalParameterObjectData;
+	m_pfOptionalParameterVectorData   = pfNewOptionalParameterVectorData;
+
+	return 0;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-//  CScriptCompilerIdListEntry::ExpandParameterSpace()
+//  CScriptCompilerIdListEntry::ReleaseParameterSpace()
 ///////////////////////////////////////////////////////////////////////////////
-//  Created By: Mark Brockington
-//  Created On: 05/18/2001
-//  Description:  Used to expand the parameter space (when required).
+//  Description:  Forgets the parameter arrays.  The memory goes back with the
+//                arena they were allocated from, when it is reset.
 ///////////////////////////////////////////////////////////////////////////////
 
-int32_t CScriptCompilerIdListEntry::ExpandParameterSpace()
+void CScriptCompilerIdListEntry::ReleaseParameterSpace()
 {
-	int32_t nNewParameterSpace;
+	m_nParameterSpace = 0;
+	m_pchParameters = NULL;
+	m_psStructureParameterNames = NULL;
+	m_pbOptionalParameters = NULL;
+	m_pnOptionalParameterIntegerData = NULL;
+	m_pfOptionalParameterFloatData = NULL;
+	m_psOptionalParameterStringData = NULL;
+	m_poidOptionalParameterObjectData = NULL;
+	m_pfOptionalParameterVectorData = NULL;
+}
 
-	if (m_nParameterSpace == CSCRIPTCOMPILERIDLISTENTRY_MAX_PARAMETERS)
-	{
-		return STRREF_CSCRIPTCOMPILER_ERROR_TOO_MANY_PARAMETERS_ON_FUNCTION;
-	}
+//::///////////////////////////////////////////////////////////////////////////
+//::
+//::  class CScriptCompilerArena
+//::
+//::///////////////////////////////////////////////////////////////////////////
+
+// Allocations are rounded to this (enough for any of the parameter arrays).
+#define CSCRIPTCOMPILER_ARENA_ALIGNMENT   16
+#define CSCRIPTCOMPILER_ARENA_BLOCK_SIZE  65536
+
+CScriptCompilerArena::CScriptCompilerArena()
+{
+	m_pBlocks = NULL;
+	m_nTotalSize = 0;
+}
+
+CScriptCompilerArena::~CScriptCompilerArena()
+{
+	Reset();
+	FreeBlocks();
+}
 
-	if (m_nParameterSpace == 0)
+void CScriptCompilerArena::FreeBlocks()
+{
+	while (m_pBlocks != NULL)
 	{
-		nNewParameterSpace = 4;
+		Block *pNext = m_pBlocks->m_pNext;
+		free(m_pBlocks);
+		m_pBlocks = pNext;
 	}
-	else
+	m_nTotalSize = 0;
+}
+
+void *CScriptCompilerArena::Allocate(size_t nSize)
+{
+	const size_t nHeader = (sizeof(Block) + CSCRIPTCOMPILER_ARENA_ALIGNMENT - 1) & ~(size_t) (CSCRIPTCOMPILER_ARENA_ALIGNMENT - 1);
+	nSize = (nSize + CSCRIPTCOMPILER_ARENA_ALIGNMENT - 1) & ~(size_t) (CSCRIPTCOMPILER_ARENA_ALIGNMENT - 1);
+
+	if (m_pBlocks == NULL || m_pBlocks->m_nUsed + nSize > m_pBlocks->m_nSize)
 	{
-		nNewParameterSpace = m_nParameterSpace * 2;
+		size_t nBlockSize = nSize > CSCRIPTCOMPILER_ARENA_BLOCK_SIZE ? nSize : CSCRIPTCOMPILER_ARENA_BLOCK_SIZE;
+		Block *pBlock = (Block *) malloc(nHeader + nBlockSize);
+		if (pBlock == NULL)
+		{
+			throw std::bad_alloc();
+		}
+		pBlock->m_pNext = m_pBlocks;
+		pBlock->m_nSize = nBlockSize;
+		pBlock->m_nUsed = 0;
+		m_pBlocks = pBlock;
+		m_nTotalSize += nBlockSize;
 	}
 
-	// Declare the new arrays.
-	char       *pchNewParameters                    = new char[nNewParameterSpace];
-	CExoString *psNewStructureParameterNames        = new CExoString[nNewParameterSpace];
-	BOOL       *pbNewOptionalParameters             = new BOOL[nNewParameterSpace];
-	int32_t        *pnNewOptionalParameterIntegerData   = new int32_t[nNewParameterSpace];
-	float      *pfNewOptionalParameterFloatData     = new float[nNewParameterSpace];
-	CExoString *psNewOptionalParameterStringData    = new CExoString[nNewParameterSpace];
-	OBJECT_ID  *poidNewOptionalParameterObjectData  = new OBJECT_ID[nNewParameterSpace];
-	float      *pfNewOptionalParameterVectorData    = new float[nNewParameterSpace * 3];
+	void *pResult = (char *) m_pBlocks + nHeader + m_pBlocks->m_nUsed;
+	m_pBlocks->m_nUsed += nSize;
+	return pResult;
+}
 
-	// Copy the old values to the new arrays.
-	int32_t nCount;
+// The strings are constructed empty, and destroyed by Reset().
+CExoString *CScriptCompilerArena::AllocateStrings(int32_t nCount)
+{
+	CExoString *psStrings = (CExoString *) Allocate(nCount * sizeof(CExoString));
+	for (int32_t nString = 0; nString < nCount; nString++)
+	{
+		new (&psStrings[nString]) CExoString();
+	}
+	m_aStrings.push_back(std::make_pair(psStrings, nCount));
+	return psStrings;
+}
 
-	if (m_nParameterSpace != 0)
+void CScriptCompilerArena::Reset()
+{
+	for (size_t nArray = m_aStrings.size(); nArray-- > 0; )
 	{
-		for (nCount = 0; nCount < m_nParameterSpace; nCount++)
-		{
-			pchNewParameters[nCount]                   = m_pchParameters[nCount];
-		}
-		for (nCount = 0; nCount < m_nParameterSpace; nCount++)
-		{
-			psNewStructureParameterNames[nCount]       = m_psStructureParameterNames[nCount];
-		}
-		for (nCount = 0; nCount < m_nParameterSpace; nCount++)
-		{
-			pbNewOptionalParameters[nCount]            = m_pbOptionalParameters[nCount];
-		}
-		for (nCount = 0; nCount < m_nParameterSpace; nCount++)
-		{
-			pnNewOptionalParameterIntegerData[nCount]  = m_pnOptionalParameterIntegerData[nCount];
-		}
-		for (nCount = 0; nCount < m_nParameterSpace; nCount++)
-		{
-			pfNewOptionalParameterFloatData[nCount]    = m_pfOptionalParameterFloatData[nCount];
-		}
-		for (nCount = 0; nCount < m_nParameterSpace; nCount++)
-		{
-			psNewOptionalParameterStringData[nCount]   = m_psOptionalParameterStringData[nCount];
-		}
-		for (nCount = 0; nCount < m_nParameterSpace; nCount++)
-		{
-			poidNewOptionalParameterObjectData[nCount] = m_poidOptionalParameterObjectData[nCount];
-		}
-		for (nCount = 0; nCount < m_nParameterSpace * 3; nCount++)
+		CExoString *psStrings = m_aStrings[nArray].first;
+		for (int32_t nString = m_aStrings[nArray].second; nString-- > 0; )
 		{
-			pfNewOptionalParameterVectorData[nCount]   = m_pfOptionalParameterVectorData[nCount];
+			psStrings[nString].~CExoString();
 		}
 	}
+	m_aStrings.clear();
 
-	// Oh, yeah, it's a good idea to declare what the values are!
-	for (nCount = m_nParameterSpace; nCount < nNewParameterSpace; nCount++)
+	if (m_pBlocks == NULL)
 	{
-		pchNewParameters[nCount]                   = 0;
-		psNewStructureParameterNames[nCount]       = "";
-		pbNewOptionalParameters[nCount]            = FALSE;
-		pnNewOptionalParameterIntegerData[nCount]  = 0;
-		pfNewOptionalParameterFloatData[nCount]    = 0.0f;
-		psNewOptionalParameterStringData[nCount]   = "";
-		poidNewOptionalParameterObjectData[nCount] = INVALID_OBJECT_ID;
+		return;
 	}
 
-	for (nCount = m_nParameterSpace * 3; nCount < nNewParameterSpace * 3; nCount++)
+	// Several blocks: trade them for one that holds it all.
+	if (m_pBlocks->m_pNext != NULL)
 	{
-		pfNewOptionalParameterVectorData[nCount]   = 0.0f;
+		size_t nTotalSize = m_nTotalSize;
+		FreeBlocks();
+		Allocate(nTotalSize);
 	}
+	m_pBlocks->m_nUsed = 0;
+}
 
-	m_nParameterSpace = nNewParameterSpace;
+//::///////////////////////////////////////////////////////////////////////////
+//::
+//::  class CScriptCompilerIdentifierList
+//::
+//::///////////////////////////////////////////////////////////////////////////
 
-	// Delete the old arrays.
-	if (m_pchParameters)
-	{
-		delete[] m_pchParameters;
-	}
-	if (m_psStructureParameterNames)
+#define CSCRIPTCOMPILER_IDENTIFIER_BLOCK_SIZE  (1 << CSCRIPTCOMPILER_IDENTIFIER_BLOCK_SHIFT)
+
+CScriptCompilerIdentifierList::CScriptCompilerIdentifierList()
+{
+	m_pcShared = NULL;
+	m_nShared = 0;
+}
+
+CScriptCompilerIdentifierList::~CScriptCompilerIdentifierList()
+{
+	Clear();
+}
+
+// The shared entries are not owned by the list (they are those of a language
+// context), and are never written to through it.
+void CScriptCompilerIdentifierList::SetShared(CScriptCompilerIdListEntry *pcShared, int32_t nShared)
+{
+	Clear();
+	m_pcShared = pcShared;
+	m_nShared = nShared;
+}
+
+void CScriptCompilerIdentifierList::Clear()
+{
+	for (size_t nBlock = 0; nBlock < m_apBlocks.size(); nBlock++)
 	{
-		delete[] m_psStructureParameterNames;
+		delete[] m_apBlocks[nBlock];
 	}
-	if (m_pbOptionalParameters)
+	m_apBlocks.clear();
+	m_pcShared = NULL;
+	m_nShared = 0;
+}
+
+// Blocks are kept until Clear(), so the next compile of a script that defines
+// as many identifiers allocates nothing.
+CScriptCompilerIdListEntry &CScriptCompilerIdentifierList::AllocateEntry(int32_t nIndex)
+{
+	uint32_t nEntry = (uint32_t) (nIndex - m_nShared);
+	while (m_apBlocks.size() <= (nEntry >> CSCRIPTCOMPILER_IDENTIFIER_BLOCK_SHIFT))
 	{
-		delete[] m_pbOptionalParameters;
+		m_apBlocks.push_back(new CScriptCompilerIdListEntry[CSCRIPTCOMPILER_IDENTIFIER_BLOCK_SIZE]);
 	}
-	if (m_pnOptionalParameterIntegerData)
+	return m_apBlocks[nEntry >> CSCRIPTCOMPILER_IDENTIFIER_BLOCK_SHIFT][nEntry & (CSCRIPTCOMPILER_IDENTIFIER_BLOCK_SIZE - 1)];
+}
+
+//::///////////////////////////////////////////////////////////////////////////
+//::
+//::  class CScriptCompilerIdentifierHashTable
+//::
+//::///////////////////////////////////////////////////////////////////////////
+
+CScriptCompilerIdentifierHashTable::CScriptCompilerIdentifierHashTable()
+{
+	m_pEntries = new CScriptCompilerIdentifierHashTableEntry[CSCRIPTCOMPILER_MIN_SIZE_IDENTIFIER_HASH_TABLE];
+	m_nMask = CSCRIPTCOMPILER_MIN_SIZE_IDENTIFIER_HASH_TABLE - 1;
+	m_nOccupied = 0;
+}
+
+CScriptCompilerIdentifierHashTable::~CScriptCompilerIdentifierHashTable()
+{
+	delete[] m_pEntries;
+}
+
+void CScriptCompilerIdentifierHashTable::Add(uint32_t nHashValue, uint32_t nType, uint32_t nIndex)
+{
+	if ((m_nOccupied + 1) * 2 > m_nMask + 1)
 	{
-		delete[] m_pnOptionalParameterIntegerData;
+		Grow();
 	}
-	if (m_pfOptionalParameterFloatData)
+
+	// Search for an empty entry.
+	uint32_t nHash = nHashValue & m_nMask;
+	while (m_pEntries[nHash].m_nIdentifierType != CSCRIPTCOMPILER_HASH_MANAGER_TYPE_UNKNOWN)
 	{
-		delete[] m_pfOptionalParameterFloatData;
+		nHash = (nHash + 1) & m_nMask;
 	}
-	if (m_psOptionalParameterStringData)
+
+	m_pEntries[nHash].m_nHashValue = nHashValue;
+	m_pEntries[nHash].m_nIdentifierType = nType;
+	m_pEntries[nHash].m_nIdentifierIndex = nIndex;
+	++m_nOccupied;
+}
+
+// Only the last names added are ever deleted (the identifiers of a script, once
+// it has been compiled), so emptying the entry cannot cut a probe short.
+void CScriptCompilerIdentifierHashTable::Delete(uint32_t nHashValue, uint32_t nType, uint32_t nIndex)
+{
+	uint32_t nHash = nHashValue & m_nMask;
+	while (m_pEntries[nHash].m_nIdentifierType != CSCRIPTCOMPILER_HASH_MANAGER_TYPE_UNKNOWN)
 	{
-		delete[] m_psOptionalParameterStringData;
+		if (m_pEntries[nHash].m_nHashValue == nHashValue &&
+		        m_pEntries[nHash].m_nIdentifierType == nType &&
+		        m_pEntries[nHash].m_nIdentifierIndex == nIndex)
+		{
+			m_pEntries[nHash].m_nHashValue = 0;
+			m_pEntries[nHash].m_nIdentifierType = CSCRIPTCOMPILER_HASH_MANAGER_TYPE_UNKNOWN;
+			m_pEntries[nHash].m_nIdentifierIndex = 0;
+			--m_nOccupied;
+			return;
+		}
+		nHash = (nHash + 1) & m_nMask;
 	}
-	if (m_poidOptionalParameterObjectData)
+}
+
+void CScriptCompilerIdentifierHashTable::Clear()
+{
+	delete[] m_pEntries;
+	m_pEntries = new CScriptCompilerIdentifierHashTableEntry[CSCRIPTCOMPILER_MIN_SIZE_IDENTIFIER_HASH_TABLE];
+	m_nMask = CSCRIPTCOMPILER_MIN_SIZE_IDENTIFIER_HASH_TABLE - 1;
+	m_nOccupied = 0;
+}
+
+// Entries are moved over starting just past an empty one, so that each run of
+// entries is walked in probe order: names with the same hash value keep the
+// order in which they were added (the first one is the one found).
+void CScriptCompilerIdentifierHashTable::Grow()
+{
+	CScriptCompilerIdentifierHashTableEntry *pOldEntries = m_pEntries;
+	uint32_t nOldMask = m_nMask;
+
+	m_nMask = nOldMask * 2 + 1;
+	m_pEntries = new CScriptCompilerIdentifierHashTableEntry[m_nMask + 1];
+	m_nOccupied = 0;
+
+	uint32_t nStart = 0;
+	while (pOldEntries[nStart].m_nIdentifierType != CSCRIPTCOMPILER_HASH_MANAGER_TYPE_UNKNOWN)
 	{
-		delete[] m_poidOptionalParameterObjectData;
+		++nStart;
 	}
-	if (m_pfOptionalParameterVectorData)
+
+	for (uint32_t nCount = 1; nCount <= nOldMask + 1; nCount++)
 	{
-		delete[] m_pfOptionalParameterVectorData;
+		const CScriptCompilerIdentifierHashTableEntry &cEntry = pOldEntries[(nStart + nCount) & nOldMask];
+		if (cEntry.m_nIdentifierType != CSCRIPTCOMPILER_HASH_MANAGER_TYPE_UNKNOWN)
+		{
+			Add(cEntry.m_nHashValue, cEntry.m_nIdentifierType, cEntry.m_nIdentifierIndex);
+		}
 	}
 
-	m_pchParameters                   = pchNewParameters;
-	m_psStructureParameterNames       = psNewStructureParameterNames;
-	m_pbOptionalParameters            = pbNewOptionalParameters;
-	m_pnOptionalParameterIntegerData  = pnNewOptionalParameterIntegerData;
-	m_pfOptionalParameterFloatData    = pfNewOptionalParameterFloatData;
-	m_psOptionalParameterStringData   = psNewOptionalParameterStringData;
-	m_poidOptionalParameterObjectData = poidNewOptionalParameterObjectData;
-	m_pfOptionalParameterVectorData   = pfNewOptionalParameterVectorData;
+	delete[] pOldEntries;
+}
 
-	return 0;
+//::///////////////////////////////////////////////////////////////////////////
+//::
+//::  class CScriptCompilerLanguageContext
+//::
+//::///////////////////////////////////////////////////////////////////////////
+
+CScriptCompilerLanguageContext::CScriptCompilerLanguageContext()
+{
+	memset(m_pnHashString, 0, sizeof(m_pnHashString));
+	m_pcKeyWords = NULL;
+	m_nNumEngineDefinedStructures = 0;
+	m_pbEngineDefinedStructureValid = NULL;
+	m_psEngineDefinedStructureName = NULL;
+	m_nIdentifiers = 0;
+	m_pcIdentifierList = NULL;
+	m_pParameterArena = NULL;
+	m_pIdentifierHashTable = NULL;
+}
+
+CScriptCompilerLanguageContext::~CScriptCompilerLanguageContext()
+{
+	delete[] m_pcKeyWords;
+	delete[] m_pbEngineDefinedStructureValid;
+	delete[] m_psEngineDefinedStructureName;
+	delete[] m_pcIdentifierList;
+	delete m_pParameterArena;
+	delete m_pIdentifierHashTable;
 }
 
 //::///////////////////////////////////////////////////////////////////////////
@@ -309,7 +530,10 @@ CScriptCompiler::CScriptCompiler(RESTYPE nSource, RESTYPE nCompiled, RESTYPE nDe
 	m_nIdentifierListState = 0;
 
 	m_pSRStack = NULL;
-	m_pcIdentifierList = NULL;
+	m_nOccupiedIdentifiers = 0;
+	m_nMaxPredefinedIdentifierId = 0;
+	m_pPredefinedParameterArena = new CScriptCompilerArena();
+	m_pUserParameterArena = new CScriptCompilerArena();
 	m_pcVarStackList = NULL;
 	m_pcStructList = NULL;
 	m_pcStructFieldList = NULL;
@@ -331,9 +555,13 @@ CScriptCompiler::CScriptCompiler(RESTYPE nSource, RESTYPE nCompiled, RESTYPE nDe
 		m_pnHashString[nHashCount] = rand();
 	}
 
-	m_pIdentifierHashTable = new CScriptCompilerIdentifierHashTableEntry[CSCRIPTCOMPILER_SIZE_IDENTIFIER_HASH_TABLE];
+	m_pIdentifierHashTable = new CScriptCompilerIdentifierHashTable();
 
 	m_nCompileFileLevel = 0;
+	m_pIncludeCache = NULL;
+	m_nMaxErrors = 0;
+	m_bCharacterRuns = TRUE;
+	m_pTokenTrace = NULL;
 	m_bCompileConditionalFile = FALSE;
 	m_bOldCompileConditionalFile = FALSE;
 	m_bCompileConditionalOrMain = FALSE;
@@ -371,7 +599,7 @@ CScriptCompiler::~CScriptCompiler()
 
 	if (m_pIdentifierHashTable)
 	{
-		delete[] m_pIdentifierHashTable;
+		delete m_pIdentifierHashTable;
 		m_pIdentifierHashTable = NULL;
 	}
 
@@ -381,6 +609,11 @@ CScriptCompiler::~CScriptCompiler()
 		m_pnHashString = NULL;
 	}
 
+	delete m_pPredefinedParameterArena;
+	m_pPredefinedParameterArena = NULL;
+	delete m_pUserParameterArena;
+	m_pUserParameterArena = NULL;
+
 	// Delete linked list of ParseTreeNodeBlock structures.
 	if (m_pParseTreeNodeBlockHead)
 	{
@@ -412,27 +645,12 @@ void CScriptCompiler::ShutDown()
 		delete[]  m_pSRStack;
 	}
 
-	if (m_pcIdentifierList)
-	{
-		delete[] m_pcIdentifierList;
-	}
-
 	if (m_pcVarStackList)
 	{
 		delete[] m_pcVarStackList;
 	}
 
-	int32_t nCount = CSCRIPTCOMPILER_MAX_KEYWORDS - 1;
-	while (nCount >= 0)
-	{
-		HashManagerDelete(CSCRIPTCOMPILER_HASH_MANAGER_TYPE_KEYWORD, nCount);
-		--nCount;
-	}
-
-	if (m_pcKeyWords != NULL)
-	{
-		delete[] m_pcKeyWords;
-	}
+	ReleaseLanguageContext();
 
 	if (m_pcStructList != NULL)
 	{
@@ -446,18 +664,6 @@ void CScriptCompiler::ShutDown()
 		m_pcStructFieldList = NULL;
 	}
 
-	if (m_psEngineDefinedStructureName != NULL)
-	{
-		delete[] m_psEngineDefinedStructureName;
-		m_psEngineDefinedStructureName = NULL;
-	}
-
-	if (m_pbEngineDefinedStructureValid)
-	{
-		delete[] m_pbEngineDefinedStructureValid;
-		m_pbEngineDefinedStructureValid = NULL;
-	}
-
 	if (m_ppsParseTreeFileNames)
 	{
 		for (int32_t count = 0; count < CSCRIPTCOMPILER_MAX_TABLE_FILENAMES; count++)
@@ -471,6 +677,23 @@ void CScriptCompiler::ShutDown()
 		delete[] m_ppsParseTreeFileNames;
 		m_ppsParseTreeFileNames = NULL;
 	}
+
+	// The buffers compiles leave behind: only CleanUpAfterCompiles() released them before.
+	if (m_pchResolvedOutputBuffer != NULL)
+	{
+		delete[] m_pchResolvedOutputBuffer;
+		m_pchResolvedOutputBuffer = NULL;
+		m_nResolvedOutputBufferSize = 0;
+	}
+
+	if (m_pchDebuggerCode != NULL)
+	{
+		delete[] m_pchDebuggerCode;
+		m_pchDebuggerCode = NULL;
+		m_nDebuggerCodeSize = 0;
+	}
+
+	ClearCompiledScriptCode();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -488,6 +711,13 @@ void CScriptCompiler::Initialize( )
 	m_sCapturedError = "";
     m_nCapturedErrorStrRef = 0;
 
+	m_aDiagnostics.clear();
+	m_nRecoveredErrors = 0;
+	m_nRecoverySkipMode = CSCRIPTCOMPILER_RECOVERY_SKIP_NONE;
+	m_nRecoverySkipBraces = 0;
+	m_aRecoveredFunctionSet.clear();
+	m_cWalkRecoveryPoint.m_pFunctionalUnit = NULL;
+
 	m_nLines = 1;
 	m_nCharacterOnLine = 1;
 
@@ -547,56 +777,7 @@ void CScriptCompiler::Initialize( )
 
 	if (m_pcKeyWords == NULL)
 	{
-		m_nKeyWords = CSCRIPTCOMPILER_MAX_KEYWORDS;
-		m_pcKeyWords = new CScriptCompilerKeyWordEntry[CSCRIPTCOMPILER_MAX_KEYWORDS];
-		m_pcKeyWords[0] .Add("if"     ,HashString("if"),    CSCRIPTCOMPILER_TOKEN_KEYWORD_IF);
-		m_pcKeyWords[1] .Add("do"     ,HashString("do"),    CSCRIPTCOMPILER_TOKEN_KEYWORD_DO);
-		m_pcKeyWords[2] .Add("else"   ,HashString("else"),  CSCRIPTCOMPILER_TOKEN_KEYWORD_ELSE);
-		m_pcKeyWords[3] .Add("int"    ,HashString("int"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_INT);
-		m_pcKeyWords[4] .Add("float"  ,HashString("float"), CSCRIPTCOMPILER_TOKEN_KEYWORD_FLOAT);
-		m_pcKeyWords[5] .Add("string" ,HashString("string"),CSCRIPTCOMPILER_TOKEN_KEYWORD_STRING);
-		m_pcKeyWords[6] .Add("object" ,HashString("object"),CSCRIPTCOMPILER_TOKEN_KEYWORD_OBJECT);
-		m_pcKeyWords[7] .Add("return" ,HashString("return"),CSCRIPTCOMPILER_TOKEN_KEYWORD_RETURN);
-		m_pcKeyWords[8] .Add("while"  ,HashString("while"), CSCRIPTCOMPILER_TOKEN_KEYWORD_WHILE);
-		m_pcKeyWords[9] .Add("for"    ,HashString("for"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_FOR);
-		m_pcKeyWords[10].Add("void"   ,HashString("void"),  CSCRIPTCOMPILER_TOKEN_KEYWORD_VOID);
-		m_pcKeyWords[11].Add("case"   ,HashString("case"),  CSCRIPTCOMPILER_TOKEN_KEYWORD_CASE);
-		m_pcKeyWords[12].Add("break"  ,HashString("break"), CSCRIPTCOMPILER_TOKEN_KEYWORD_BREAK);
-		m_pcKeyWords[13].Add("struct" ,HashString("struct"),CSCRIPTCOMPILER_TOKEN_KEYWORD_STRUCT);
-		m_pcKeyWords[14].Add("action" ,HashString("action"),CSCRIPTCOMPILER_TOKEN_KEYWORD_ACTION);
-		m_pcKeyWords[15].Add("switch" ,HashString("switch"),CSCRIPTCOMPILER_TOKEN_KEYWORD_SWITCH);
-		m_pcKeyWords[16].Add("default" ,HashString("default"),  CSCRIPTCOMPILER_TOKEN_KEYWORD_DEFAULT);
-		m_pcKeyWords[17].Add("#include",HashString("#include"), CSCRIPTCOMPILER_TOKEN_KEYWORD_INCLUDE);
-		m_pcKeyWords[18].Add("continue",HashString("continue"), CSCRIPTCOMPILER_TOKEN_KEYWORD_CONTINUE);
-		m_pcKeyWords[19].Add("vector"  ,HashString("vector"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_VECTOR);
-		m_pcKeyWords[20].Add("const"   ,HashString("const"),    CSCRIPTCOMPILER_TOKEN_KEYWORD_CONST);
-		m_pcKeyWords[21].Add("#define" ,HashString("#define"),  CSCRIPTCOMPILER_TOKEN_KEYWORD_DEFINE);
-		m_pcKeyWords[22].Add("OBJECT_SELF"           ,HashString("OBJECT_SELF"),          CSCRIPTCOMPILER_TOKEN_KEYWORD_OBJECT_SELF);
-		m_pcKeyWords[23].Add("OBJECT_INVALID"        ,HashString("OBJECT_INVALID"),       CSCRIPTCOMPILER_TOKEN_KEYWORD_OBJECT_INVALID);
-		m_pcKeyWords[24].Add("ENGINE_NUM_STRUCTURES" ,HashString("ENGINE_NUM_STRUCTURES"),CSCRIPTCOMPILER_TOKEN_KEYWORD_ENGINE_NUM_STRUCTURES_DEFINITION);
-		m_pcKeyWords[25].Add("ENGINE_STRUCTURE_0"    ,HashString("ENGINE_STRUCTURE_0"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_ENGINE_STRUCTURE_DEFINITION);
-		m_pcKeyWords[26].Add("ENGINE_STRUCTURE_1"    ,HashString("ENGINE_STRUCTURE_1"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_ENGINE_STRUCTURE_DEFINITION);
-		m_pcKeyWords[27].Add("ENGINE_STRUCTURE_2"    ,HashString("ENGINE_STRUCTURE_2"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_ENGINE_STRUCTURE_DEFINITION);
-		m_pcKeyWords[28].Add("ENGINE_STRUCTURE_3"    ,HashString("ENGINE_STRUCTURE_3"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_ENGINE_STRUCTURE_DEFINITION);
-		m_pcKeyWords[29].Add("ENGINE_STRUCTURE_4"    ,HashString("ENGINE_STRUCTURE_4"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_ENGINE_STRUCTURE_DEFINITION);
-		m_pcKeyWords[30].Add("ENGINE_STRUCTURE_5"    ,HashString("ENGINE_STRUCTURE_5"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_ENGINE_STRUCTURE_DEFINITION);
-		m_pcKeyWords[31].Add("ENGINE_STRUCTURE_6"    ,HashString("ENGINE_STRUCTURE_6"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_ENGINE_STRUCTURE_DEFINITION);
-		m_pcKeyWords[32].Add("ENGINE_STRUCTURE_7"    ,HashString("ENGINE_STRUCTURE_7"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_ENGINE_STRUCTURE_DEFINITION);
-		m_pcKeyWords[33].Add("ENGINE_STRUCTURE_8"    ,HashString("ENGINE_STRUCTURE_8"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_ENGINE_STRUCTURE_DEFINITION);
-		m_pcKeyWords[34].Add("ENGINE_STRUCTURE_9"    ,HashString("ENGINE_STRUCTURE_9"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_ENGINE_STRUCTURE_DEFINITION);
-        m_pcKeyWords[35].Add("JSON_NULL"             ,HashString("JSON_NULL"),            CSCRIPTCOMPILER_TOKEN_KEYWORD_JSON_NULL);
-        m_pcKeyWords[36].Add("JSON_FALSE"            ,HashString("JSON_FALSE"),           CSCRIPTCOMPILER_TOKEN_KEYWORD_JSON_FALSE);
-        m_pcKeyWords[37].Add("JSON_TRUE"             ,HashString("JSON_TRUE"),            CSCRIPTCOMPILER_TOKEN_KEYWORD_JSON_TRUE);
-        m_pcKeyWords[38].Add("JSON_OBJECT"           ,HashString("JSON_OBJECT"),          CSCRIPTCOMPILER_TOKEN_KEYWORD_JSON_OBJECT);
-        m_pcKeyWords[39].Add("JSON_ARRAY"            ,HashString("JSON_ARRAY"),           CSCRIPTCOMPILER_TOKEN_KEYWORD_JSON_ARRAY);
-        m_pcKeyWords[40].Add("JSON_STRING"           ,HashString("JSON_STRING"),          CSCRIPTCOMPILER_TOKEN_KEYWORD_JSON_STRING);
-		m_pcKeyWords[41].Add("LOCATION_INVALID"      ,HashString("LOCATION_INVALID"),     CSCRIPTCOMPILER_TOKEN_KEYWORD_LOCATION_INVALID);
-
-		int32_t nCount;
-		for (nCount = 0; nCount < CSCRIPTCOMPILER_MAX_KEYWORDS; ++nCount)
-		{
-			HashManagerAdd(CSCRIPTCOMPILER_HASH_MANAGER_TYPE_KEYWORD,nCount);
-		}
+		InitializeKeyWords();
 	}
 
 	//HashManagerAddKeywords();
@@ -615,13 +796,18 @@ void CScriptCompiler::Initialize( )
 	m_nSwitchIdentifier = 0;
 	m_nSwitchStackDepth = 0;
 	m_bSwitchLabelDefault = FALSE;
-	m_nSwitchLabelNumber = 0;
-	m_nSwitchLabelArraySize = 16;
-	m_pnSwitchLabelStatements = NULL;
+	m_nSwitchTreeLabels = 0;
 
 	m_nLoopIdentifier = 0;
 	m_nLoopStackDepth = 0;
 
+	m_nFoldedConditionLocation = -1;
+	m_nTokenConstantIdentifier = -1;
+	m_bFoldedConditionValue = FALSE;
+
+	m_aIncludeFilesLoaded.clear();
+	m_aIncludeCaptures.clear();
+
 	InitializePreDefinedStructures();
 
 	m_bCompileIdentifierConstants = FALSE;
@@ -669,6 +855,67 @@ void CScriptCompiler::Initialize( )
 
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//  CScriptCompiler::InitializeKeyWords()
+///////////////////////////////////////////////////////////////////////////////
+//  Description:  Sets up the keywords of the language, for a compiler that
+//                does not use a language context yet.
+///////////////////////////////////////////////////////////////////////////////
+
+void CScriptCompiler::InitializeKeyWords()
+{
+	m_nKeyWords = CSCRIPTCOMPILER_MAX_KEYWORDS;
+	m_pcKeyWords = new CScriptCompilerKeyWordEntry[CSCRIPTCOMPILER_MAX_KEYWORDS];
+	m_pcKeyWords[0] .Add("if"     ,HashString("if"),    CSCRIPTCOMPILER_TOKEN_KEYWORD_IF);
+	m_pcKeyWords[1] .Add("do"     ,HashString("do"),    CSCRIPTCOMPILER_TOKEN_KEYWORD_DO);
+	m_pcKeyWords[2] .Add("else"   ,HashString("else"),  CSCRIPTCOMPILER_TOKEN_KEYWORD_ELSE);
+	m_pcKeyWords[3] .Add("int"    ,HashString("int"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_INT);
+	m_pcKeyWords[4] .Add("float"  ,HashString("float"), CSCRIPTCOMPILER_TOKEN_KEYWORD_FLOAT);
+	m_pcKeyWords[5] .Add("string" ,HashString("string"),CSCRIPTCOMPILER_TOKEN_KEYWORD_STRING);
+	m_pcKeyWords[6] .Add("object" ,HashString("object"),CSCRIPTCOMPILER_TOKEN_KEYWORD_OBJECT);
+	m_pcKeyWords[7] .Add("return" ,HashString("return"),CSCRIPTCOMPILER_TOKEN_KEYWORD_RETURN);
+	m_pcKeyWords[8] .Add("while"  ,HashString("while"), CSCRIPTCOMPILER_TOKEN_KEYWORD_WHILE);
+	m_pcKeyWords[9] .Add("for"    ,HashString("for"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_FOR);
+	m_pcKeyWords[10].Add("void"   ,HashString("void"),  CSCRIPTCOMPILER_TOKEN_KEYWORD_VOID);
+	m_pcKeyWords[11].Add("case"   ,HashString("case"),  CSCRIPTCOMPILER_TOKEN_KEYWORD_CASE);
+	m_pcKeyWords[12].Add("break"  ,HashString("break"), CSCRIPTCOMPILER_TOKEN_KEYWORD_BREAK);
+	m_pcKeyWords[13].Add("struct" ,HashString("struct"),CSCRIPTCOMPILER_TOKEN_KEYWORD_STRUCT);
+	m_pcKeyWords[14].Add("action" ,HashString("action"),CSCRIPTCOMPILER_TOKEN_KEYWORD_ACTION);
+	m_pcKeyWords[15].Add("switch" ,HashString("switch"),CSCRIPTCOMPILER_TOKEN_KEYWORD_SWITCH);
+	m_pcKeyWords[16].Add("default" ,HashString("default"),  CSCRIPTCOMPILER_TOKEN_KEYWORD_DEFAULT);
+	m_pcKeyWords[17].Add("#include",HashString("#include"), CSCRIPTCOMPILER_TOKEN_KEYWORD_INCLUDE);
+	m_pcKeyWords[18].Add("continue",HashString("continue"), CSCRIPTCOMPILER_TOKEN_KEYWORD_CONTINUE);
+	m_pcKeyWords[19].Add("vector"  ,HashString("vector"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_VECTOR);
+	m_pcKeyWords[20].Add("const"   ,HashString("const"),    CSCRIPTCOMPILER_TOKEN_KEYWORD_CONST);
+	m_pcKeyWords[21].Add("#define" ,HashString("#define"),  CSCRIPTCOMPILER_TOKEN_KEYWORD_DEFINE);
+	m_pcKeyWords[22].Add("OBJECT_SELF"           ,HashString("OBJECT_SELF"),          CSCRIPTCOMPILER_TOKEN_KEYWORD_OBJECT_SELF);
+	m_pcKeyWords[23].Add("OBJECT_INVALID"        ,HashString("OBJECT_INVALID"),       CSCRIPTCOMPILER_TOKEN_KEYWORD_OBJECT_INVALID);
+	m_pcKeyWords[24].Add("ENGINE_NUM_STRUCTURES" ,HashString("ENGINE_NUM_STRUCTURES"),CSCRIPTCOMPILER_TOKEN_KEYWORD_ENGINE_NUM_STRUCTURES_DEFINITION);
+	m_pcKeyWords[25].Add("ENGINE_STRUCTURE_0"    ,HashString("ENGINE_STRUCTURE_0"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_ENGINE_STRUCTURE_DEFINITION);
+	m_pcKeyWords[26].Add("ENGINE_STRUCTURE_1"    ,HashString("ENGINE_STRUCTURE_1"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_ENGINE_STRUCTURE_DEFINITION);
+	m_pcKeyWords[27].Add("ENGINE_STRUCTURE_2"    ,HashString("ENGINE_STRUCTURE_2"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_ENGINE_STRUCTURE_DEFINITION);
+	m_pcKeyWords[28].Add("ENGINE_STRUCTURE_3"    ,HashString("ENGINE_STRUCTURE_3"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_ENGINE_STRUCTURE_DEFINITION);
+	m_pcKeyWords[29].Add("ENGINE_STRUCTURE_4"    ,HashString("ENGINE_STRUCTURE_4"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_ENGINE_STRUCTURE_DEFINITION);
+	m_pcKeyWords[30].Add("ENGINE_STRUCTURE_5"    ,HashString("ENGINE_STRUCTURE_5"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_ENGINE_STRUCTURE_DEFINITION);
+	m_pcKeyWords[31].Add("ENGINE_STRUCTURE_6"    ,HashString("ENGINE_STRUCTURE_6"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_ENGINE_STRUCTURE_DEFINITION);
+	m_pcKeyWords[32].Add("ENGINE_STRUCTURE_7"    ,HashString("ENGINE_STRUCTURE_7"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_ENGINE_STRUCTURE_DEFINITION);
+	m_pcKeyWords[33].Add("ENGINE_STRUCTURE_8"    ,HashString("ENGINE_STRUCTURE_8"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_ENGINE_STRUCTURE_DEFINITION);
+	m_pcKeyWords[34].Add("ENGINE_STRUCTURE_9"    ,HashString("ENGINE_STRUCTURE_9"),   CSCRIPTCOMPILER_TOKEN_KEYWORD_ENGINE_STRUCTURE_DEFINITION);
+    m_pcKeyWords[35].Add("JSON_NULL"             ,HashString("JSON_NULL"),            CSCRIPTCOMPILER_TOKEN_KEYWORD_JSON_NULL);
+    m_pcKeyWords[36].Add("JSON_FALSE"            ,HashString("JSON_FALSE"),           CSCRIPTCOMPILER_TOKEN_KEYWORD_JSON_FALSE);
+    m_pcKeyWords[37].Add("JSON_TRUE"             ,HashString("JSON_TRUE"),            CSCRIPTCOMPILER_TOKEN_KEYWORD_JSON_TRUE);
+    m_pcKeyWords[38].Add("JSON_OBJECT"           ,HashString("JSON_OBJECT"),          CSCRIPTCOMPILER_TOKEN_KEYWORD_JSON_OBJECT);
+    m_pcKeyWords[39].Add("JSON_ARRAY"            ,HashString("JSON_ARRAY"),           CSCRIPTCOMPILER_TOKEN_KEYWORD_JSON_ARRAY);
+    m_pcKeyWords[40].Add("JSON_STRING"           ,HashString("JSON_STRING"),          CSCRIPTCOMPILER_TOKEN_KEYWORD_JSON_STRING);
+	m_pcKeyWords[41].Add("LOCATION_INVALID"      ,HashString("LOCATION_INVALID"),     CSCRIPTCOMPILER_TOKEN_KEYWORD_LOCATION_INVALID);
+
+	int32_t nCount;
+	for (nCount = 0; nCount < CSCRIPTCOMPILER_MAX_KEYWORDS; ++nCount)
+	{
+		HashManagerAdd(CSCRIPTCOMPILER_HASH_MANAGER_TYPE_KEYWORD,nCount);
+	}
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //  CScriptCompiler::HashString()
 ///////////////////////////////////////////////////////////////////////////////
@@ -726,68 +973,72 @@ uint32_t CScriptCompiler::HashString(const CExoString &sString)
 ///////////////////////////////////////////////////////////////////////////////
 //  Created By: Mark Brockington
 //  Created On: Dec. 3, 2002
-//  Description:  This routine will return the location of the entry in the
-//                hash table for the given token.  Returns -1 if no hash entry
-//                has been found.
+//  Description:  This routine will return the entry in the hash table for the
+//                given token (only looking at entries of type nType, unless it
+//                is 0).  The language context is searched before the names
+//                defined by the script.  Returns NULL if no hash entry has
+//                been found.
 ///////////////////////////////////////////////////////////////////////////////
-int32_t CScriptCompiler::GetHashEntryByName(const char *psIdentifierName)
+const CScriptCompilerIdentifierHashTableEntry *CScriptCompiler::GetHashEntryByName(const char *psIdentifierName, uint32_t nType)
 {
-	BOOL bInfiniteLoop = TRUE;
 	uint32_t nOriginalHash = HashString(psIdentifierName);
+	const CScriptCompilerIdentifierHashTableEntry *pEntry = NULL;
 
-	// Search for the exact entry.
-	uint32_t nHash = nOriginalHash % CSCRIPTCOMPILER_SIZE_IDENTIFIER_HASH_TABLE;
-	uint32_t nEndHash = nHash + (CSCRIPTCOMPILER_SIZE_IDENTIFIER_HASH_TABLE - 1) & CSCRIPTCOMPILER_MASK_SIZE_IDENTIFIER_HASH_TABLE;
+	if (m_pLanguageContext != NULL)
+	{
+		pEntry = FindHashEntry(m_pLanguageContext->m_pIdentifierHashTable, nOriginalHash, psIdentifierName, nType);
+	}
+
+	if (pEntry == NULL)
+	{
+		pEntry = FindHashEntry(m_pIdentifierHashTable, nOriginalHash, psIdentifierName, nType);
+	}
+
+	return pEntry;
+}
+
+const CScriptCompilerIdentifierHashTableEntry *CScriptCompiler::FindHashEntry(const CScriptCompilerIdentifierHashTable *pTable, uint32_t nHashValue, const char *psIdentifierName, uint32_t nType)
+{
+	const CScriptCompilerIdentifierHashTableEntry *pEntries = pTable->m_pEntries;
+	uint32_t nHash = nHashValue & pTable->m_nMask;
 
-	while (bInfiniteLoop)
+	// Stop at the first blank entry: then it's not in the table.
+	while (pEntries[nHash].m_nIdentifierType != CSCRIPTCOMPILER_HASH_MANAGER_TYPE_UNKNOWN)
 	{
 		// If we're at the correct entry, confirm that the strings are identical and then
 		// return to the main routine.
-		if (m_pIdentifierHashTable[nHash].m_nHashValue == nOriginalHash)
+		if (pEntries[nHash].m_nHashValue == nHashValue &&
+		        (nType == CSCRIPTCOMPILER_HASH_MANAGER_TYPE_UNKNOWN || pEntries[nHash].m_nIdentifierType == nType))
 		{
-			int32_t nIndex = m_pIdentifierHashTable[nHash].m_nIdentifierIndex;
-			if (m_pIdentifierHashTable[nHash].m_nIdentifierType == CSCRIPTCOMPILER_HASH_MANAGER_TYPE_IDENTIFIER)
+			int32_t nIndex = pEntries[nHash].m_nIdentifierIndex;
+			if (pEntries[nHash].m_nIdentifierType == CSCRIPTCOMPILER_HASH_MANAGER_TYPE_IDENTIFIER)
 			{
 				if (strcmp(m_pcIdentifierList[nIndex].m_psIdentifier.CStr(),psIdentifierName) == 0)
 				{
-					return nHash;
+					return &pEntries[nHash];
 				}
 			}
-			else if (m_pIdentifierHashTable[nHash].m_nIdentifierType == CSCRIPTCOMPILER_HASH_MANAGER_TYPE_KEYWORD)
+			else if (pEntries[nHash].m_nIdentifierType == CSCRIPTCOMPILER_HASH_MANAGER_TYPE_KEYWORD)
 			{
 				if (strcmp((m_pcKeyWords[nIndex].GetPointerToName())->CStr(),psIdentifierName) == 0)
 				{
-					return nHash;
+					return &pEntries[nHash];
 				}
 			}
-			else if (m_pIdentifierHashTable[nHash].m_nIdentifierType == CSCRIPTCOMPILER_HASH_MANAGER_TYPE_ENGINE_STRUCTURE)
+			else if (pEntries[nHash].m_nIdentifierType == CSCRIPTCOMPILER_HASH_MANAGER_TYPE_ENGINE_STRUCTURE)
 			{
 				if (strcmp(m_psEngineDefinedStructureName[nIndex].CStr(),psIdentifierName) == 0)
 				{
-					return nHash;
+					return &pEntries[nHash];
 				}
 			}
 		}
 
-		// Have we hit a blank entry?  Then it's not in the list.
-		if (m_pIdentifierHashTable[nHash].m_nIdentifierType == CSCRIPTCOMPILER_HASH_MANAGER_TYPE_UNKNOWN)
-		{
-			return STRREF_CSCRIPTCOMPILER_ERROR_UNDEFINED_IDENTIFIER;
-		}
-
-		// Have we searched the entire list?
-		if (nEndHash == nHash)
-		{
-			return STRREF_CSCRIPTCOMPILER_ERROR_UNDEFINED_IDENTIFIER;
-		}
-
-		// Move to the next entry in the list.
-		++nHash;
-		nHash &= CSCRIPTCOMPILER_MASK_SIZE_IDENTIFIER_HASH_TABLE;
-
+		// Move to the next entry in the table.
+		nHash = (nHash + 1) & pTable->m_nMask;
 	}
 
-	return STRREF_CSCRIPTCOMPILER_ERROR_UNDEFINED_IDENTIFIER;
+	return NULL;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -800,7 +1051,6 @@ int32_t CScriptCompiler::GetHashEntryByName(const char *psIdentifierName)
 ///////////////////////////////////////////////////////////////////////////////
 uint32_t CScriptCompiler::HashManagerAdd(uint32_t nType, uint32_t nIndice)
 {
-	uint32_t nHash;
 	uint32_t nOriginalHash=0;
 
 	// Get the hash value based on the type of entry.
@@ -819,27 +1069,7 @@ uint32_t CScriptCompiler::HashManagerAdd(uint32_t nType, uint32_t nIndice)
 		nOriginalHash = HashString(m_psEngineDefinedStructureName[nIndice]);
 	}
 
-
-	// Search for an empty entry.
-	nHash = nOriginalHash % CSCRIPTCOMPILER_SIZE_IDENTIFIER_HASH_TABLE;
-	uint32_t nEndHash = nHash + (CSCRIPTCOMPILER_SIZE_IDENTIFIER_HASH_TABLE - 1) & CSCRIPTCOMPILER_MASK_SIZE_IDENTIFIER_HASH_TABLE;
-	while (m_pIdentifierHashTable[nHash].m_nIdentifierType != CSCRIPTCOMPILER_HASH_MANAGER_TYPE_UNKNOWN && nHash != nEndHash)
-	{
-		++nHash;
-		nHash &= CSCRIPTCOMPILER_MASK_SIZE_IDENTIFIER_HASH_TABLE;
-	}
-
-	// If we found an empty entry, do something about it.
-	if (m_pIdentifierHashTable[nHash].m_nIdentifierType == CSCRIPTCOMPILER_HASH_MANAGER_TYPE_UNKNOWN)
-	{
-		m_pIdentifierHashTable[nHash].m_nHashValue = nOriginalHash;
-		m_pIdentifierHashTable[nHash].m_nIdentifierType = nType;
-		m_pIdentifierHashTable[nHash].m_nIdentifierIndex = nIndice;
-
-		return 0;
-	}
-
-	// We didn't find an empty entry.  This is bad.
+	m_pIdentifierHashTable->Add(nOriginalHash, nType, nIndice);
 	return 0;
 }
 
@@ -853,7 +1083,6 @@ uint32_t CScriptCompiler::HashManagerAdd(uint32_t nType, uint32_t nIndice)
 ///////////////////////////////////////////////////////////////////////////////
 uint32_t CScriptCompiler::HashManagerDelete(uint32_t nType, uint32_t nIndice)
 {
-	uint32_t nHash;
 	uint32_t nOriginalHash=0;
 
 	// Generate the hash value based on the type
@@ -872,29 +1101,7 @@ uint32_t CScriptCompiler::HashManagerDelete(uint32_t nType, uint32_t nIndice)
 		nOriginalHash = HashString(m_psEngineDefinedStructureName[nIndice]);
 	}
 
-	// Search for the exact entry.
-	nHash = nOriginalHash % CSCRIPTCOMPILER_SIZE_IDENTIFIER_HASH_TABLE;
-	uint32_t nEndHash = nHash + (CSCRIPTCOMPILER_SIZE_IDENTIFIER_HASH_TABLE - 1) & CSCRIPTCOMPILER_MASK_SIZE_IDENTIFIER_HASH_TABLE;
-	while (((m_pIdentifierHashTable[nHash].m_nHashValue != nOriginalHash) ||
-	        (m_pIdentifierHashTable[nHash].m_nIdentifierType != nType) ||
-	        (m_pIdentifierHashTable[nHash].m_nIdentifierIndex != nIndice)) && nHash != nEndHash)
-	{
-		++nHash;
-		nHash &= CSCRIPTCOMPILER_MASK_SIZE_IDENTIFIER_HASH_TABLE;
-	}
-
-	// Delete the entry if we find its exact match.
-	if (m_pIdentifierHashTable[nHash].m_nIdentifierType == nType &&
-	        m_pIdentifierHashTable[nHash].m_nIdentifierIndex == nIndice &&
-	        m_pIdentifierHashTable[nHash].m_nHashValue == nOriginalHash)
-	{
-		m_pIdentifierHashTable[nHash].m_nHashValue = 0;
-		m_pIdentifierHashTable[nHash].m_nIdentifierType = CSCRIPTCOMPILER_HASH_MANAGER_TYPE_UNKNOWN;
-		m_pIdentifierHashTable[nHash].m_nIdentifierIndex = 0;
-		return 0;
-	}
-
-	// We didn't find it ... this is also bad.
+	m_pIdentifierHashTable->Delete(nOriginalHash, nType, nIndice);
 	return 0;
 }
 
@@ -980,39 +1187,55 @@ void CScriptCompiler::ShutdownIncludeFile(int32_t nCompileFileLevel)
 ///////////////////////////////////////////////////////////////////////////////
 //  Created By: Mark Brockington
 //  Created On: 08/05/99
-//  Description:  This routine will take the root of a compile tree, ensure that
-//                each of its branches have been deleted (recursively), and
-//                then we can delete the node itself!
+//  Description:  This routine will take the root of a compile tree, and
+//                delete each of its nodes (walking the branches with the
+//                tree walk stack, rather than recursively).
 ///////////////////////////////////////////////////////////////////////////////
 
 void CScriptCompiler::DeleteParseTree(BOOL bStack, CScriptParseTreeNode *pNode)
 {
-	if (pNode != NULL)
+	if (pNode == NULL)
+	{
+		return;
+	}
+
+	size_t nBase = m_aTreeWalkStack.size();
+	PushTreeWalkEntry(pNode);
+
+	while (m_aTreeWalkStack.size() > nBase)
 	{
-		// Delete all of the subtrees
-		DeleteParseTree(bStack, pNode->pLeft);
-		DeleteParseTree(bStack, pNode->pRight);
+		CScriptParseTreeNode *pDeleteNode = m_aTreeWalkStack.back().m_pNode;
+		m_aTreeWalkStack.pop_back();
 
-		if (bStack == TRUE)
+		// Queue up the subtrees before the node forgets about them.
+		if (pDeleteNode->pRight != NULL)
+		{
+			PushTreeWalkEntry(pDeleteNode->pRight);
+		}
+		if (pDeleteNode->pLeft != NULL)
 		{
-			// Delete any references to this node from the stack.
-			int32_t i;
+			PushTreeWalkEntry(pDeleteNode->pLeft);
+		}
 
-			for (i=0; i <= m_nSRStackStates; i++)
+		DeleteScriptParseTreeNode(pDeleteNode);
+	}
+
+	if (bStack == TRUE)
+	{
+		// Delete any references to the nodes from the stack.
+		int32_t i;
+
+		for (i=0; i <= m_nSRStackStates; i++)
+		{
+			if (m_pSRStack[i].pCurrentTree != NULL)
 			{
-				if (m_pSRStack[i].pCurrentTree != NULL)
-				{
-					m_pSRStack[i].pCurrentTree = NULL;
-				}
-				if (m_pSRStack[i].pReturnTree != NULL)
-				{
-					m_pSRStack[i].pReturnTree = NULL;
-				}
+				m_pSRStack[i].pCurrentTree = NULL;
+			}
+			if (m_pSRStack[i].pReturnTree != NULL)
+			{
+				m_pSRStack[i].pReturnTree = NULL;
 			}
 		}
-
-		// Finally delete the node itself.
-		DeleteScriptParseTreeNode(pNode);
 	}
 }
 
@@ -1043,51 +1266,144 @@ void CScriptCompiler::SetIdentifierSpecification(const CExoString &sLanguageSour
 
 	if (m_sLanguageSource != sLanguageSource)
 	{
+		ReleaseLanguageContext();
+		InitializeKeyWords();
 		m_sLanguageSource = sLanguageSource;
 
-		if (m_pcIdentifierList != NULL)
-		{
-			while (m_nOccupiedIdentifiers > 0)
-			{
-				--m_nOccupiedIdentifiers;
-				HashManagerDelete(CSCRIPTCOMPILER_HASH_MANAGER_TYPE_IDENTIFIER, m_nOccupiedIdentifiers);
-			}
+		m_bCompileIdentifierList = TRUE;
+		m_bCompileIdentifierConstants = TRUE;
+		ParseIdentifierFile();
 
-			delete[] m_pcIdentifierList;
-		}
+		m_nLines = 1;
+		m_nCharacterOnLine = 1;
+		m_nSRStackStates = -1;
 
-		if (m_pbEngineDefinedStructureValid != NULL)
-		{
-			int32_t nCount = 9;
-			while (nCount >= 0)
-			{
-				if (m_pbEngineDefinedStructureValid[nCount] == TRUE)
-				{
-					HashManagerDelete(CSCRIPTCOMPILER_HASH_MANAGER_TYPE_ENGINE_STRUCTURE, nCount);
-					m_pbEngineDefinedStructureValid[nCount] = FALSE;
-				}
-				--nCount;
-			}
-		}
+		m_bCompileIdentifierList = FALSE;
+		m_bCompileIdentifierConstants = FALSE;
 
-		if (m_pcIdentifierList == NULL)
-		{
-			m_pcIdentifierList = new CScriptCompilerIdListEntry[CSCRIPTCOMPILER_MAX_IDENTIFIERS];
-			m_bCompileIdentifierList = TRUE;
-			m_bCompileIdentifierConstants = TRUE;
-			m_nOccupiedIdentifiers = 0;
-			m_nMaxPredefinedIdentifierId = 0;
-			ParseIdentifierFile();
-
-			m_nLines = 1;
-			m_nCharacterOnLine = 1;
-			m_nSRStackStates = -1;
-
-			m_bCompileIdentifierList = FALSE;
-			m_bCompileIdentifierConstants = FALSE;
-		}
+		// Everything read goes to a language context, which this compiler
+		// then uses like any other compiler it is given to.
+		SetLanguageContext(CreateLanguageContext());
+	}
+
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  CScriptCompiler::SetLanguageContext()
+///////////////////////////////////////////////////////////////////////////////
+//  Description:  Uses the language definition of another compiler (see
+//                GetLanguageContext()).  Only the script's own identifiers
+//                are kept by this compiler: everything that comes from the
+//                language definition is read from the context.
+///////////////////////////////////////////////////////////////////////////////
+
+void CScriptCompiler::SetLanguageContext(const std::shared_ptr<const CScriptCompilerLanguageContext> &pContext)
+{
+	if (pContext == m_pLanguageContext)
+	{
+		return;
+	}
+
+	ReleaseLanguageContext();
+
+	if (pContext == NULL)
+	{
+		InitializeKeyWords();
+		return;
+	}
+
+	m_pLanguageContext = pContext;
+	m_sLanguageSource = pContext->m_sLanguageSource;
+
+	// Names are looked up with the hash values of the context.
+	memcpy(m_pnHashString, pContext->m_pnHashString, sizeof(pContext->m_pnHashString));
+
+	m_nKeyWords = CSCRIPTCOMPILER_MAX_KEYWORDS;
+	m_pcKeyWords = pContext->m_pcKeyWords;
+	m_nNumEngineDefinedStructures = pContext->m_nNumEngineDefinedStructures;
+	m_pbEngineDefinedStructureValid = pContext->m_pbEngineDefinedStructureValid;
+	m_psEngineDefinedStructureName = pContext->m_psEngineDefinedStructureName;
+
+	m_pcIdentifierList.SetShared(pContext->m_pcIdentifierList, pContext->m_nIdentifiers);
+	m_nOccupiedIdentifiers = pContext->m_nIdentifiers;
+	m_nMaxPredefinedIdentifierId = pContext->m_nIdentifiers;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  CScriptCompiler::ReleaseLanguageContext()
+///////////////////////////////////////////////////////////////////////////////
+//  Description:  Forgets the language definition (and the identifiers of the
+//                script), freeing whatever of it the compiler owns.
+///////////////////////////////////////////////////////////////////////////////
+
+void CScriptCompiler::ReleaseLanguageContext()
+{
+	m_pcIdentifierList.Clear();
+	m_nOccupiedIdentifiers = 0;
+	m_nMaxPredefinedIdentifierId = 0;
+	m_pIdentifierHashTable->Clear();
+	m_pPredefinedParameterArena->Reset();
+	m_pUserParameterArena->Reset();
+
+	// Without a context, these were read by this compiler.
+	if (m_pLanguageContext == NULL)
+	{
+		delete[] m_pcKeyWords;
+		delete[] m_pbEngineDefinedStructureValid;
+		delete[] m_psEngineDefinedStructureName;
 	}
 
+	m_pcKeyWords = NULL;
+	m_nNumEngineDefinedStructures = 0;
+	m_pbEngineDefinedStructureValid = NULL;
+	m_psEngineDefinedStructureName = NULL;
+
+	m_pLanguageContext.reset();
+	m_sLanguageSource = "";
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  CScriptCompiler::CreateLanguageContext()
+///////////////////////////////////////////////////////////////////////////////
+//  Description:  Moves the language definition that was just read (the
+//                keywords, engine structures and identifiers, with their
+//                hash table) to a new language context.
+///////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<const CScriptCompilerLanguageContext> CScriptCompiler::CreateLanguageContext()
+{
+	std::shared_ptr<CScriptCompilerLanguageContext> pContext = std::make_shared<CScriptCompilerLanguageContext>();
+
+	pContext->m_sLanguageSource = m_sLanguageSource;
+	memcpy(pContext->m_pnHashString, m_pnHashString, sizeof(pContext->m_pnHashString));
+
+	pContext->m_pcKeyWords = m_pcKeyWords;
+	pContext->m_nNumEngineDefinedStructures = m_nNumEngineDefinedStructures;
+	pContext->m_pbEngineDefinedStructureValid = m_pbEngineDefinedStructureValid;
+	pContext->m_psEngineDefinedStructureName = m_psEngineDefinedStructureName;
+	m_pcKeyWords = NULL;
+	m_pbEngineDefinedStructureValid = NULL;
+	m_psEngineDefinedStructureName = NULL;
+
+	// The identifiers move to a single array (the parameter arrays they point
+	// to stay where they are, in the arena that goes with them).
+	pContext->m_nIdentifiers = m_nOccupiedIdentifiers;
+	pContext->m_pcIdentifierList = new CScriptCompilerIdListEntry[m_nOccupiedIdentifiers > 0 ? m_nOccupiedIdentifiers : 1];
+	for (int32_t count = 0; count < m_nOccupiedIdentifiers; count++)
+	{
+		pContext->m_pcIdentifierList[count] = m_pcIdentifierList[count];
+	}
+	pContext->m_pParameterArena = m_pPredefinedParameterArena;
+	m_pPredefinedParameterArena = new CScriptCompilerArena();
+
+	pContext->m_pIdentifierHashTable = m_pIdentifierHashTable;
+	m_pIdentifierHashTable = new CScriptCompilerIdentifierHashTable();
+
+	m_pcIdentifierList.Clear();
+	m_nOccupiedIdentifiers = 0;
+	m_nMaxPredefinedIdentifierId = 0;
+
+	return pContext;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1238,6 +1554,17 @@ int32_t CScriptCompiler::CompileFile(const CExoString &sFileName)
     pScript = m_pcIncludeFileStack[m_nCompileFileLevel].m_sSourceScript.CStr();
     nScriptLength = m_pcIncludeFileStack[m_nCompileFileLevel].m_sSourceScript.GetLength();
 
+	// Remember what the includes were made of, for the precompiled modules
+	// captured from them.
+	if (m_pIncludeCache != NULL && m_nCompileFileLevel > 0)
+	{
+		CScriptCompilerLoadedIncludeFile cLoadedFile;
+		cLoadedFile.m_sFileName = sFileName;
+		cLoadedFile.m_nContentHash = CScriptCompilerIncludeCache::HashContents(pScript, nScriptLength);
+		cLoadedFile.m_nCompileFileLevel = m_nCompileFileLevel;
+		m_aIncludeFilesLoaded.push_back(cLoadedFile);
+	}
+
 	++m_nCompileFileLevel;
 
 	int32_t nReturnValue = ParseSource(pScript,nScriptLength);
@@ -1484,8 +1811,27 @@ int32_t CScriptCompiler::OutputError(int32_t nError, CExoString *psFileName, int
 		}
 	}
 
-	m_sCapturedError = sFullErrorText;
-    m_nCapturedErrorStrRef = nError;
+	// When the compile goes on past errors, the first one is the error
+	// the compile failed with.
+	if (m_nMaxErrors <= 1 || m_aDiagnostics.empty())
+	{
+		m_sCapturedError = sFullErrorText;
+		m_nCapturedErrorStrRef = nError;
+	}
+
+	CScriptCompilerDiagnostic cDiagnostic;
+	cDiagnostic.m_nError = nError;
+	if (psFileName->Left(1) == "!")
+	{
+		cDiagnostic.m_sFileName = psFileName->Right(psFileName->GetLength()-1);
+	}
+	else
+	{
+		cDiagnostic.m_sFileName.Format("%s.nss",psFileName->CStr());
+	}
+	cDiagnostic.m_nLine = nLineNumber > 0 ? nLineNumber : 0;
+	cDiagnostic.m_sErrorText = sErrorText;
+	m_aDiagnostics.push_back(cDiagnostic);
 
 	// Print the full error text to the log file.
     // This is used and parsed by the toolset :( Do not remove.
@@ -1499,9 +1845,207 @@ int32_t CScriptCompiler::OutputError(int32_t nError, CExoString *psFileName, int
 }
 
 
+// Integer operations, with the game virtual machine's semantics: two's complement
+// wrap around, shift counts taken modulo 32, >> keeping the sign and >>> not.
+// Operations that fail at run time (division by zero, INT_MIN / -1) are not
+// folded: the script keeps running into them, as it would without folding.
+static BOOL FoldIntegerOperation(int32_t nOperation, int32_t left, int32_t right, int32_t &result)
+{
+	uint32_t uleft = (uint32_t) left;
+	uint32_t uright = (uint32_t) right;
+	switch (nOperation)
+	{
+		case CSCRIPTCOMPILER_OPERATION_LOGICAL_OR:           result = left || right; break;
+		case CSCRIPTCOMPILER_OPERATION_LOGICAL_AND:          result = left && right; break;
+		case CSCRIPTCOMPILER_OPERATION_INCLUSIVE_OR:         result = left |  right; break;
+		case CSCRIPTCOMPILER_OPERATION_EXCLUSIVE_OR:         result = left ^  right; break;
+		case CSCRIPTCOMPILER_OPERATION_BOOLEAN_AND:          result = left &  right; break;
+		case CSCRIPTCOMPILER_OPERATION_CONDITION_EQUAL:      result = left == right; break;
+		case CSCRIPTCOMPILER_OPERATION_CONDITION_NOT_EQUAL:  result = left != right; break;
+		case CSCRIPTCOMPILER_OPERATION_CONDITION_GEQ:        result = left >= right; break;
+		case CSCRIPTCOMPILER_OPERATION_CONDITION_GT:         result = left >  right; break;
+		case CSCRIPTCOMPILER_OPERATION_CONDITION_LT:         result = left <  right; break;
+		case CSCRIPTCOMPILER_OPERATION_CONDITION_LEQ:        result = left <= right; break;
+		case CSCRIPTCOMPILER_OPERATION_SHIFT_LEFT:           result = (int32_t) (uleft << (right & 31)); break;
+		case CSCRIPTCOMPILER_OPERATION_SHIFT_RIGHT:          result = left >> (right & 31); break;
+		case CSCRIPTCOMPILER_OPERATION_UNSIGNED_SHIFT_RIGHT: result = (int32_t) (uleft >> (right & 31)); break;
+		case CSCRIPTCOMPILER_OPERATION_ADD:                  result = (int32_t) (uleft + uright); break;
+		case CSCRIPTCOMPILER_OPERATION_SUBTRACT:             result = (int32_t) (uleft - uright); break;
+		case CSCRIPTCOMPILER_OPERATION_MULTIPLY:             result = (int32_t) (uleft * uright); break;
+		case CSCRIPTCOMPILER_OPERATION_DIVIDE:
+			if (right == 0 || (left == INT32_MIN && right == -1))
+				return FALSE;
+			result = left / right;
+			break;
+		case CSCRIPTCOMPILER_OPERATION_MODULUS:
+			if (right == 0)
+				return FALSE;
+			result = (right == -1) ? 0 : left % right;
+			break;
+		default: return FALSE;
+	}
+	return TRUE;
+}
+
+// Float operations. Relational ones produce an integer, in nResultBool.
+// Division by zero is left for run time, like the integer one.
+static BOOL FoldFloatOperation(int32_t nOperation, float left, float right, float &result, int32_t &nResultBool)
+{
+	nResultBool = -1;
+	switch (nOperation)
+	{
+		case CSCRIPTCOMPILER_OPERATION_ADD:                 result = left +  right; break;
+		case CSCRIPTCOMPILER_OPERATION_SUBTRACT:            result = left -  right; break;
+		case CSCRIPTCOMPILER_OPERATION_MULTIPLY:            result = left *  right; break;
+		case CSCRIPTCOMPILER_OPERATION_DIVIDE:
+			if (right == 0.0f)
+				return FALSE;
+			result = left / right;
+			break;
+		case CSCRIPTCOMPILER_OPERATION_CONDITION_EQUAL:     nResultBool = left == right; break;
+		case CSCRIPTCOMPILER_OPERATION_CONDITION_NOT_EQUAL: nResultBool = left != right; break;
+		case CSCRIPTCOMPILER_OPERATION_CONDITION_GEQ:       nResultBool = left >= right; break;
+		case CSCRIPTCOMPILER_OPERATION_CONDITION_GT:        nResultBool = left >  right; break;
+		case CSCRIPTCOMPILER_OPERATION_CONDITION_LT:        nResultBool = left <  right; break;
+		case CSCRIPTCOMPILER_OPERATION_CONDITION_LEQ:       nResultBool = left <= right; break;
+		default: return FALSE;
+	}
+	return TRUE;
+}
+
+// Decays pNode into a constant leaf, dropping its operands. The source position
+// is kept, so errors reported against the folded node still point at the code.
+static void MakeConstantNode(CScriptParseTreeNode *pNode, int32_t nOperation)
+{
+	int32_t nFileReference = pNode->m_nFileReference;
+	int32_t nLine = pNode->nLine;
+	int32_t nChar = pNode->nChar;
+
+	if (pNode->pLeft)
+		pNode->pLeft->Clean();
+	if (pNode->pRight)
+		pNode->pRight->Clean();
+	pNode->Clean();
+
+	pNode->nOperation = nOperation;
+	pNode->m_nFileReference = nFileReference;
+	pNode->nLine = nLine;
+	pNode->nChar = nChar;
+}
+
+// Unary operations (the operand hangs on the left): - on ints and floats,
+// ~ and ! on ints.
+static BOOL ConstantFoldUnaryNode(CScriptParseTreeNode *pNode)
+{
+	CScriptParseTreeNode *pOperand = pNode->pLeft;
+
+	if (pOperand->nOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_INTEGER)
+	{
+		uint32_t operand = (uint32_t) pOperand->nIntegerData;
+		int32_t result;
+		switch (pNode->nOperation)
+		{
+			case CSCRIPTCOMPILER_OPERATION_NEGATION:        result = (int32_t) (0u - operand); break;
+			case CSCRIPTCOMPILER_OPERATION_ONES_COMPLEMENT: result = (int32_t) ~operand; break;
+			case CSCRIPTCOMPILER_OPERATION_BOOLEAN_NOT:     result = operand == 0; break;
+			default: return FALSE;
+		}
+		MakeConstantNode(pNode, CSCRIPTCOMPILER_OPERATION_CONSTANT_INTEGER);
+		pNode->nIntegerData = result;
+		return TRUE;
+	}
+
+	if (pOperand->nOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_FLOAT &&
+	        pNode->nOperation == CSCRIPTCOMPILER_OPERATION_NEGATION)
+	{
+		float result = -pOperand->fFloatData;
+		MakeConstantNode(pNode, CSCRIPTCOMPILER_OPERATION_CONSTANT_FLOAT);
+		pNode->fFloatData = result;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+// Vector arithmetic: v+v, v-v, v*f, f*v and v/f, the operations the code
+// generator accepts for vectors.
+static BOOL ConstantFoldVectorNode(CScriptParseTreeNode *pNode)
+{
+	CScriptParseTreeNode *pLeft = pNode->pLeft;
+	CScriptParseTreeNode *pRight = pNode->pRight;
+	float result[3];
+
+	if (pLeft->nOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_VECTOR &&
+	        pRight->nOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_VECTOR)
+	{
+		if (pNode->nOperation != CSCRIPTCOMPILER_OPERATION_ADD &&
+		        pNode->nOperation != CSCRIPTCOMPILER_OPERATION_SUBTRACT)
+		{
+			return FALSE;
+		}
+		for (int32_t nCount = 0; nCount < 3; nCount++)
+		{
+			result[nCount] = (pNode->nOperation == CSCRIPTCOMPILER_OPERATION_ADD) ?
+			                 pLeft->fVectorData[nCount] + pRight->fVectorData[nCount] :
+			                 pLeft->fVectorData[nCount] - pRight->fVectorData[nCount];
+		}
+	}
+	else if (pLeft->nOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_VECTOR &&
+	         pRight->nOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_FLOAT)
+	{
+		float fScalar = pRight->fFloatData;
+		if (pNode->nOperation == CSCRIPTCOMPILER_OPERATION_DIVIDE)
+		{
+			// The virtual machine may divide through the reciprocal: both ways
+			// only agree to the last bit for powers of two, so fold just those.
+			int nExponent;
+			float fMantissa = frexpf(fScalar, &nExponent);
+			if (fMantissa != 0.5f && fMantissa != -0.5f)
+			{
+				return FALSE;
+			}
+			fScalar = 1.0f / fScalar;
+		}
+		else if (pNode->nOperation != CSCRIPTCOMPILER_OPERATION_MULTIPLY)
+		{
+			return FALSE;
+		}
+		for (int32_t nCount = 0; nCount < 3; nCount++)
+		{
+			result[nCount] = pLeft->fVectorData[nCount] * fScalar;
+		}
+	}
+	else if (pLeft->nOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_FLOAT &&
+	         pRight->nOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_VECTOR)
+	{
+		if (pNode->nOperation != CSCRIPTCOMPILER_OPERATION_MULTIPLY)
+		{
+			return FALSE;
+		}
+		for (int32_t nCount = 0; nCount < 3; nCount++)
+		{
+			result[nCount] = pRight->fVectorData[nCount] * pLeft->fFloatData;
+		}
+	}
+	else
+	{
+		return FALSE;
+	}
+
+	MakeConstantNode(pNode, CSCRIPTCOMPILER_OPERATION_CONSTANT_VECTOR);
+	pNode->fVectorData[0] = result[0];
+	pNode->fVectorData[1] = result[1];
+	pNode->fVectorData[2] = result[2];
+	return TRUE;
+}
+
 // Destructively modify a node and all its children to decay it into a single
 // CONSTANT operation, if possible.
 // This function is safe to call multiple times on the same node.
+//
+// Only operations the code generator accepts for the operand types are folded
+// (so type errors are still reported), and every fold computes exactly what
+// the game's virtual machine would have at run time.
 BOOL CScriptCompiler::ConstantFoldNode(CScriptParseTreeNode *pNode, BOOL bForce)
 {
 	if (!bForce && !(m_nOptimizationFlags & CSCRIPTCOMPILER_OPTIMIZE_FOLD_CONSTANTS))
@@ -1510,101 +2054,121 @@ BOOL CScriptCompiler::ConstantFoldNode(CScriptParseTreeNode *pNode, BOOL bForce)
 	if (!pNode)
 		return FALSE;
 
-	// Only fold operations that have two operands
-	// TODO: ~0 unary op?
-	if (!pNode->pLeft || !pNode->pRight)
-		return FALSE;
-
 	// In case of complex expression, start folding at the leaf nodes
 	// e.g.:  C = 3 + 2*4 - First fold 2*4 into 8, then 3+8 into 11
-	ConstantFoldNode(pNode->pLeft, bForce);
-	ConstantFoldNode(pNode->pRight, bForce);
+	BOOL bFolded = FALSE;
+	size_t nBase = m_aTreeWalkStack.size();
+	PushTreeWalkEntry(pNode);
 
-	// Can only fold if the operands are constants.
-	if (pNode->pLeft->nOperation != CSCRIPTCOMPILER_OPERATION_CONSTANT_INTEGER &&
-		pNode->pLeft->nOperation != CSCRIPTCOMPILER_OPERATION_CONSTANT_FLOAT &&
-		pNode->pLeft->nOperation != CSCRIPTCOMPILER_OPERATION_CONSTANT_STRING)
+	while (m_aTreeWalkStack.size() > nBase)
 	{
-		return FALSE;
+		size_t nEntry = m_aTreeWalkStack.size() - 1;
+		CScriptParseTreeNode *pFoldNode = m_aTreeWalkStack[nEntry].m_pNode;
+		int32_t nState = m_aTreeWalkStack[nEntry].m_nState;
+
+		BOOL bUnary = pFoldNode->pLeft && !pFoldNode->pRight &&
+		              (pFoldNode->nOperation == CSCRIPTCOMPILER_OPERATION_NEGATION ||
+		               pFoldNode->nOperation == CSCRIPTCOMPILER_OPERATION_ONES_COMPLEMENT ||
+		               pFoldNode->nOperation == CSCRIPTCOMPILER_OPERATION_BOOLEAN_NOT);
+		BOOL bBinary = pFoldNode->pLeft && pFoldNode->pRight;
+
+		if (nState == 0 && (bUnary || bBinary))
+		{
+			m_aTreeWalkStack[nEntry].m_nState = 1;
+			PushTreeWalkEntry(pFoldNode->pLeft);
+			continue;
+		}
+
+		if (nState == 1 && bBinary)
+		{
+			m_aTreeWalkStack[nEntry].m_nState = 2;
+			PushTreeWalkEntry(pFoldNode->pRight);
+			continue;
+		}
+
+		// The operands are as folded as they get.
+		bFolded = ConstantFoldNodeOperation(pFoldNode);
+		m_aTreeWalkStack.pop_back();
 	}
 
-	// Only fold operations on same type. Expressions like "3.0f + 1" are not folded
-	if (pNode->pLeft->nOperation != pNode->pRight->nOperation)
+	return bFolded;
+}
+
+// Fold pNode itself, once its operands have been folded.
+BOOL CScriptCompiler::ConstantFoldNodeOperation(CScriptParseTreeNode *pNode)
+{
+	if (pNode->pLeft && !pNode->pRight &&
+	        (pNode->nOperation == CSCRIPTCOMPILER_OPERATION_NEGATION ||
+	         pNode->nOperation == CSCRIPTCOMPILER_OPERATION_ONES_COMPLEMENT ||
+	         pNode->nOperation == CSCRIPTCOMPILER_OPERATION_BOOLEAN_NOT))
+	{
+		return ConstantFoldUnaryNode(pNode);
+	}
+
+	// Everything else that folds has two operands
+	if (!pNode->pLeft || !pNode->pRight)
 		return FALSE;
 
-	if (pNode->pLeft->nOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_INTEGER)
+	int32_t nLeftOperation = pNode->pLeft->nOperation;
+	int32_t nRightOperation = pNode->pRight->nOperation;
+
+	if (nLeftOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_VECTOR ||
+	        nRightOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_VECTOR)
+	{
+		return ConstantFoldVectorNode(pNode);
+	}
+
+	if (nLeftOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_INTEGER &&
+	        nRightOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_INTEGER)
 	{
 		int32_t result;
-		int32_t left = pNode->pLeft->nIntegerData;
-		int32_t right = pNode->pRight->nIntegerData;
-		switch (pNode->nOperation)
-		{
-			case CSCRIPTCOMPILER_OPERATION_LOGICAL_OR:          result = left || right; break;
-			case CSCRIPTCOMPILER_OPERATION_LOGICAL_AND:         result = left && right; break;
-			case CSCRIPTCOMPILER_OPERATION_INCLUSIVE_OR:        result = left |  right; break;
-			case CSCRIPTCOMPILER_OPERATION_EXCLUSIVE_OR:        result = left ^  right; break;
-			case CSCRIPTCOMPILER_OPERATION_BOOLEAN_AND:         result = left &  right; break;
-			case CSCRIPTCOMPILER_OPERATION_CONDITION_EQUAL:     result = left == right; break;
-			case CSCRIPTCOMPILER_OPERATION_CONDITION_NOT_EQUAL: result = left != right; break;
-			case CSCRIPTCOMPILER_OPERATION_CONDITION_GEQ:       result = left >= right; break;
-			case CSCRIPTCOMPILER_OPERATION_CONDITION_GT:        result = left >  right; break;
-			case CSCRIPTCOMPILER_OPERATION_CONDITION_LT:        result = left <  right; break;
-			case CSCRIPTCOMPILER_OPERATION_CONDITION_LEQ:       result = left <= right; break;
-			case CSCRIPTCOMPILER_OPERATION_SHIFT_LEFT:          result = left << right; break;
-			case CSCRIPTCOMPILER_OPERATION_SHIFT_RIGHT:         result = left >> right; break;
-			case CSCRIPTCOMPILER_OPERATION_ADD:                 result = left +  right; break;
-			case CSCRIPTCOMPILER_OPERATION_SUBTRACT:            result = left -  right; break;
-			case CSCRIPTCOMPILER_OPERATION_MULTIPLY:            result = left *  right; break;
-			case CSCRIPTCOMPILER_OPERATION_DIVIDE:              result = left /  right; break;
-			case CSCRIPTCOMPILER_OPERATION_MODULUS:             result = left %  right; break;
-			default: return FALSE;
-		}
-		pNode->pLeft->Clean();
-		pNode->pRight->Clean();
-		pNode->Clean();
-		pNode->nOperation = CSCRIPTCOMPILER_OPERATION_CONSTANT_INTEGER;
+		if (!FoldIntegerOperation(pNode->nOperation, pNode->pLeft->nIntegerData, pNode->pRight->nIntegerData, result))
+			return FALSE;
+
+		MakeConstantNode(pNode, CSCRIPTCOMPILER_OPERATION_CONSTANT_INTEGER);
 		pNode->nIntegerData = result;
 		return TRUE;
 	}
 
-	if (pNode->pLeft->nOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_FLOAT)
+	// Floats, and ints promoted to float for the arithmetic operations that
+	// mix them ("3.0f + 1"). Relational operations need matching types.
+	BOOL bLeftFloat = nLeftOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_FLOAT;
+	BOOL bRightFloat = nRightOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_FLOAT;
+	if ((bLeftFloat && bRightFloat) ||
+	        (bLeftFloat && nRightOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_INTEGER) ||
+	        (bRightFloat && nLeftOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_INTEGER))
 	{
-		float result;
-		int resultBool = -1;
-		float left = pNode->pLeft->fFloatData;
-		float right = pNode->pRight->fFloatData;
-		switch (pNode->nOperation)
+		if (!(bLeftFloat && bRightFloat) &&
+		        pNode->nOperation != CSCRIPTCOMPILER_OPERATION_ADD &&
+		        pNode->nOperation != CSCRIPTCOMPILER_OPERATION_SUBTRACT &&
+		        pNode->nOperation != CSCRIPTCOMPILER_OPERATION_MULTIPLY &&
+		        pNode->nOperation != CSCRIPTCOMPILER_OPERATION_DIVIDE)
 		{
-			case CSCRIPTCOMPILER_OPERATION_ADD:                 result = left +  right; break;
-			case CSCRIPTCOMPILER_OPERATION_SUBTRACT:            result = left -  right; break;
-			case CSCRIPTCOMPILER_OPERATION_MULTIPLY:            result = left *  right; break;
-			case CSCRIPTCOMPILER_OPERATION_DIVIDE:              result = left /  right; break;
-			// Relational ops on floats produce a bool result
-			case CSCRIPTCOMPILER_OPERATION_CONDITION_EQUAL:     resultBool = left == right; break;
-			case CSCRIPTCOMPILER_OPERATION_CONDITION_NOT_EQUAL: resultBool = left != right; break;
-			case CSCRIPTCOMPILER_OPERATION_CONDITION_GEQ:       resultBool = left >= right; break;
-			case CSCRIPTCOMPILER_OPERATION_CONDITION_GT:        resultBool = left >  right; break;
-			case CSCRIPTCOMPILER_OPERATION_CONDITION_LT:        resultBool = left <  right; break;
-			case CSCRIPTCOMPILER_OPERATION_CONDITION_LEQ:       resultBool = left <= right; break;
-			default: return FALSE;
+			return FALSE;
 		}
-		pNode->pLeft->Clean();
-		pNode->pRight->Clean();
-		pNode->Clean();
-		if (resultBool != -1)
+
+		float left = bLeftFloat ? pNode->pLeft->fFloatData : (float) pNode->pLeft->nIntegerData;
+		float right = bRightFloat ? pNode->pRight->fFloatData : (float) pNode->pRight->nIntegerData;
+		float result;
+		int32_t nResultBool;
+		if (!FoldFloatOperation(pNode->nOperation, left, right, result, nResultBool))
+			return FALSE;
+
+		if (nResultBool != -1)
 		{
-			pNode->nOperation = CSCRIPTCOMPILER_OPERATION_CONSTANT_INTEGER;
-			pNode->nIntegerData = resultBool;
+			MakeConstantNode(pNode, CSCRIPTCOMPILER_OPERATION_CONSTANT_INTEGER);
+			pNode->nIntegerData = nResultBool;
 		}
 		else
 		{
-			pNode->nOperation = CSCRIPTCOMPILER_OPERATION_CONSTANT_FLOAT;
+			MakeConstantNode(pNode, CSCRIPTCOMPILER_OPERATION_CONSTANT_FLOAT);
 			pNode->fFloatData = result;
 		}
 		return TRUE;
 	}
 
-	if (pNode->pLeft->nOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_STRING)
+	if (nLeftOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_STRING &&
+	        nRightOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_STRING)
 	{
 		CExoString left = (pNode->pLeft->m_psStringData ? *pNode->pLeft->m_psStringData : CExoString(""));
 		CExoString right = (pNode->pRight->m_psStringData ? *pNode->pRight->m_psStringData : CExoString(""));
@@ -1618,17 +2182,14 @@ BOOL CScriptCompiler::ConstantFoldNode(CScriptParseTreeNode *pNode, BOOL bForce)
 			case CSCRIPTCOMPILER_OPERATION_CONDITION_NOT_EQUAL: resultBool = left != right; break;
 			default: return FALSE;
 		}
-		pNode->pLeft->Clean();
-		pNode->pRight->Clean();
-		pNode->Clean();
 		if (resultBool != -1)
 		{
-			pNode->nOperation = CSCRIPTCOMPILER_OPERATION_CONSTANT_INTEGER;
+			MakeConstantNode(pNode, CSCRIPTCOMPILER_OPERATION_CONSTANT_INTEGER);
 			pNode->nIntegerData = resultBool;
 		}
 		else
 		{
-			pNode->nOperation = CSCRIPTCOMPILER_OPERATION_CONSTANT_STRING;
+			MakeConstantNode(pNode, CSCRIPTCOMPILER_OPERATION_CONSTANT_STRING);
 			pNode->m_psStringData = new CExoString(result);
 		}
 		return TRUE;
@@ -47,6 +47,8 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <algorithm>
+
 // external header files
 #include "exobase.h"
 #include "scriptcomp.h"
@@ -88,11 +90,20 @@ int32_t CScriptCompiler::GenerateFinalCodeFromParseTree(CExoString sFileName)
 	{
 		nReturnValue = WalkParseTree(pNewReturnTree);
 	}
-	else
+	else if (m_nRecoveredErrors == 0)
 	{
+		// (With errors before it, a missing main() is likely one of their
+		// doings, or the script is an include file.)
 		OutputWalkTreeError(nReturnValue, NULL);
 	}
 
+	// The errors the compile went on past fail it all the same, with the
+	// first of them (the captured error).
+	if (m_nRecoveredErrors > 0)
+	{
+		nReturnValue = STRREF_CSCRIPTCOMPILER_ERROR_ALREADY_PRINTED;
+	}
+
 	if (nReturnValue < 0)
 	{
 		return CleanUpAfterCompile(nReturnValue,pNewReturnTree);
@@ -175,9 +186,23 @@ int32_t CScriptCompiler::WriteFinalCodeToFile(const CExoString &sFileName)
 	CExoString sModifiedFileName;
 	sModifiedFileName.Format("%s:%s",m_sOutputAlias.CStr(),sFileName.CStr());
 
-    const int32_t ret = m_cAPI.ResManWriteToFile(
-        sModifiedFileName.CStr(), m_nResTypeCompiled,
-        (const uint8_t*) m_pchOutputCode, m_nOutputCodeLength, true);
+    int32_t ret;
+    if (m_bAutomaticCleanUpAfterCompiles == TRUE && m_cAPI.ResManTakeFile)
+    {
+        // The buffer would be deleted below: hand it over instead
+        char* pchOutputCode = m_pchOutputCode;
+        m_pchOutputCode = NULL;
+        m_nOutputCodeSize = 0;
+        ret = m_cAPI.ResManTakeFile(
+            sModifiedFileName.CStr(), m_nResTypeCompiled,
+            pchOutputCode, m_nOutputCodeLength, true);
+    }
+    else
+    {
+        ret = m_cAPI.ResManWriteToFile(
+            sModifiedFileName.CStr(), m_nResTypeCompiled,
+            (const uint8_t*) m_pchOutputCode, m_nOutputCodeLength, true);
+    }
 
     if (ret != 0)
     {
@@ -234,49 +259,7 @@ void CScriptCompiler::ClearUserDefinedIdentifiers()
 		m_pcIdentifierList[count].m_nIdIdentifier = -1;
 		m_pcIdentifierList[count].m_nParameters = 0;
 		m_pcIdentifierList[count].m_nNonOptionalParameters = 0;
-		m_pcIdentifierList[count].m_nParameterSpace = 0;
-
-		if (m_pcIdentifierList[count].m_pchParameters)
-		{
-			delete[] m_pcIdentifierList[count].m_pchParameters;
-			m_pcIdentifierList[count].m_pchParameters = NULL;
-		}
-		if (m_pcIdentifierList[count].m_psStructureParameterNames)
-		{
-			delete[] m_pcIdentifierList[count].m_psStructureParameterNames;
-			m_pcIdentifierList[count].m_psStructureParameterNames = NULL;
-		}
-		if (m_pcIdentifierList[count].m_pbOptionalParameters)
-		{
-			delete[] m_pcIdentifierList[count].m_pbOptionalParameters;
-			m_pcIdentifierList[count].m_pbOptionalParameters = NULL;
-		}
-		if (m_pcIdentifierList[count].m_pnOptionalParameterIntegerData)
-		{
-			delete[] m_pcIdentifierList[count].m_pnOptionalParameterIntegerData;
-			m_pcIdentifierList[count].m_pnOptionalParameterIntegerData = NULL;
-		}
-		if (m_pcIdentifierList[count].m_pfOptionalParameterFloatData)
-		{
-			delete[] m_pcIdentifierList[count].m_pfOptionalParameterFloatData;
-			m_pcIdentifierList[count].m_pfOptionalParameterFloatData = NULL;
-		}
-		if (m_pcIdentifierList[count].m_psOptionalParameterStringData)
-		{
-			delete[] m_pcIdentifierList[count].m_psOptionalParameterStringData;
-			m_pcIdentifierList[count].m_psOptionalParameterStringData = NULL;
-		}
-		if (m_pcIdentifierList[count].m_poidOptionalParameterObjectData)
-		{
-			delete[] m_pcIdentifierList[count].m_poidOptionalParameterObjectData;
-			m_pcIdentifierList[count].m_poidOptionalParameterObjectData = NULL;
-		}
-		if (m_pcIdentifierList[count].m_pfOptionalParameterVectorData)
-		{
-			delete[] m_pcIdentifierList[count].m_pfOptionalParameterVectorData;
-			m_pcIdentifierList[count].m_pfOptionalParameterVectorData = NULL;
-		}
-
+		m_pcIdentifierList[count].ReleaseParameterSpace();
 
 		// For user-defined identifiers
 		m_pcIdentifierList[count].m_nBinarySourceStart        = -1;
@@ -286,8 +269,17 @@ void CScriptCompiler::ClearUserDefinedIdentifiers()
 
 	}
 
+	// The entry past the last one is used to build new functions, and may hold
+	// arrays, too (when the function turned out to be declared already).
+	if (m_nOccupiedIdentifiers < CSCRIPTCOMPILER_MAX_IDENTIFIERS)
+	{
+		m_pcIdentifierList[m_nOccupiedIdentifiers].ReleaseParameterSpace();
+	}
+
 	m_nOccupiedIdentifiers = m_nMaxPredefinedIdentifierId;
 
+	// All of their parameter arrays at once.
+	m_pUserParameterArena->Reset();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -905,9 +897,9 @@ int32_t CScriptCompiler::ResolveLabels()
 void CScriptCompiler::InitializeSwitchLabelList()
 {
 	m_bSwitchLabelDefault = FALSE;
-	m_nSwitchLabelNumber = 0;
-	m_nSwitchLabelArraySize = 16;
-	m_pnSwitchLabelStatements = new int32_t[m_nSwitchLabelArraySize];
+	m_nSwitchTreeLabels = 0;
+	m_aSwitchLabelValues.clear();
+	m_aSwitchLabelValueSet.clear();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -916,182 +908,184 @@ void CScriptCompiler::InitializeSwitchLabelList()
 //  Created By: Mark Brockington
 //  Created On: 02/25/2000
 // Description: This function will resolve the labels within this level of
-//              switch statement.
+//              switch statement.  The case values are only collected here;
+//              GenerateCodeForSwitchLabels() writes the tests afterwards.
 ///////////////////////////////////////////////////////////////////////////////
 int32_t CScriptCompiler::TraverseTreeForSwitchLabels(CScriptParseTreeNode *pNode)
 {
 	// First, we scan to see if there are multiple labels of the same type.
-	int nReturnValue;
+	int nReturnValue = 0;
 
 	if (pNode == NULL)
 	{
 		return 0;
 	}
-	// First of all, if we are about to go into another switch block, abort!
-	if (pNode->nOperation == CSCRIPTCOMPILER_OPERATION_SWITCH_BLOCK)
-	{
-		return 0;
-	}
 
-	nReturnValue = TraverseTreeForSwitchLabels(pNode->pLeft);
-	if (nReturnValue < 0)
-	{
-		return nReturnValue;
-	}
+	// The labels are checked in order: left subtree, node, right subtree.
+	size_t nBase = m_aTreeWalkStack.size();
+	PushTreeWalkEntry(pNode);
 
-	if (pNode->nOperation == CSCRIPTCOMPILER_OPERATION_DEFAULT)
-	{
-		if (m_bSwitchLabelDefault == TRUE)
-		{
-			return OutputWalkTreeError(STRREF_CSCRIPTCOMPILER_ERROR_MULTIPLE_DEFAULT_STATEMENTS_WITHIN_SWITCH, pNode);
-		}
-		m_bSwitchLabelDefault = TRUE;
-	}
-
-	if (pNode->nOperation == CSCRIPTCOMPILER_OPERATION_CASE)
+	while (m_aTreeWalkStack.size() > nBase)
 	{
-		int32_t nCaseValue;
+		size_t nEntry = m_aTreeWalkStack.size() - 1;
+		CScriptParseTreeNode *pLabelNode = m_aTreeWalkStack[nEntry].m_pNode;
 
-		ConstantFoldNode(pNode->pLeft, TRUE);
-		// Evaluate the constant value that is contained.
-		if (pNode->pLeft != NULL &&
-		        pNode->pLeft->nOperation == CSCRIPTCOMPILER_OPERATION_NEGATION &&
-		        pNode->pLeft->pLeft != NULL &&
-		        pNode->pLeft->pLeft->nOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_INTEGER)
-		{
-			nCaseValue = -pNode->pLeft->pLeft->nIntegerData;
-		}
-		else if (pNode->pLeft != NULL &&
-		         pNode->pLeft->nOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_INTEGER)
-		{
-			nCaseValue = pNode->pLeft->nIntegerData;
-		}
-		else if (pNode->pLeft != NULL &&
-		         pNode->pLeft->nOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_STRING)
-		{
-			nCaseValue = pNode->pLeft->m_psStringData->GetHash();
-		}
-		else
+		if (m_aTreeWalkStack[nEntry].m_nState == 0)
 		{
-			return OutputWalkTreeError(STRREF_CSCRIPTCOMPILER_ERROR_CASE_PARAMETER_NOT_A_CONSTANT_INTEGER,pNode);
-		}
-
-		// Now, we have to check if any of the previous case statements have the same value.
-		int nCount;
+			// First of all, if we are about to go into another switch block, abort!
+			if (pLabelNode->nOperation == CSCRIPTCOMPILER_OPERATION_SWITCH_BLOCK)
+			{
+				m_aTreeWalkStack.pop_back();
+				continue;
+			}
 
-		for (nCount = 0; nCount < m_nSwitchLabelNumber; ++nCount)
-		{
-			if (m_pnSwitchLabelStatements[nCount] == nCaseValue)
+			m_aTreeWalkStack[nEntry].m_nState = 1;
+			if (pLabelNode->pLeft != NULL)
 			{
-				return OutputWalkTreeError(STRREF_CSCRIPTCOMPILER_ERROR_MULTIPLE_CASE_CONSTANT_STATEMENTS_WITHIN_SWITCH,pNode);
+				PushTreeWalkEntry(pLabelNode->pLeft);
 			}
+			continue;
 		}
 
-		// Add the case statement to the list.
-		if (m_nSwitchLabelNumber >= m_nSwitchLabelArraySize)
+		// The left subtree is done: the right one takes the node's place.
+		m_aTreeWalkStack.pop_back();
+
+		if (pLabelNode->nOperation == CSCRIPTCOMPILER_OPERATION_DEFAULT)
 		{
-			int32_t *pNewIntArray = new int32_t[m_nSwitchLabelArraySize * 2];
-			for (nCount = 0; nCount < m_nSwitchLabelNumber; ++nCount)
+			if (m_bSwitchLabelDefault == TRUE)
 			{
-				pNewIntArray[nCount] = m_pnSwitchLabelStatements[nCount];
+				nReturnValue = OutputWalkTreeError(STRREF_CSCRIPTCOMPILER_ERROR_MULTIPLE_DEFAULT_STATEMENTS_WITHIN_SWITCH, pLabelNode);
+				break;
 			}
-			m_nSwitchLabelArraySize *= 2;
-			delete[] m_pnSwitchLabelStatements;
-			m_pnSwitchLabelStatements = pNewIntArray;
+			m_bSwitchLabelDefault = TRUE;
 		}
 
-		m_pnSwitchLabelStatements[m_nSwitchLabelNumber] = nCaseValue;
-		++m_nSwitchLabelNumber;
-
-		// Now, we add the pseudocode:
-		// COPYTOP fffffffc,0004  // copies the switch result so that we can use it.
-		// CONSTI  nCaseValue     // adds the constant that we're to compare against.
-		// EQUALII                // compares the two, leaving the result on the stack.
-		// JNZ    _SC_nCaseValue_nSwitchIdentifier  // result goes away, jump executed.
-
-		// CODE GENERATION
-		// Here, we would dump the "appropriate" data from the run-time stack
-		// on to the top of the stack, making a copy of it ... that's why
-		// we're adding one to the appropriate run time stack.
-
-		int32_t nStackElementsDown = -4;
-		int32_t nSize = 4;
-
-		m_pchOutputCode[m_nOutputCodeLength + CVIRTUALMACHINE_OPCODE_LOCATION] = CVIRTUALMACHINE_OPCODE_RUNSTACK_COPY;
-		m_pchOutputCode[m_nOutputCodeLength+CVIRTUALMACHINE_AUXCODE_LOCATION] = CVIRTUALMACHINE_AUXCODE_TYPE_VOID;
-
-		m_pchOutputCode[m_nOutputCodeLength + CVIRTUALMACHINE_EXTRA_DATA_LOCATION] = (char) (((nStackElementsDown) >> 24) & 0x0ff);
-		m_pchOutputCode[m_nOutputCodeLength+CVIRTUALMACHINE_EXTRA_DATA_LOCATION+1] = (char) (((nStackElementsDown) >> 16) & 0x0ff);
-		m_pchOutputCode[m_nOutputCodeLength+CVIRTUALMACHINE_EXTRA_DATA_LOCATION+2] = (char) (((nStackElementsDown) >> 8) & 0x0ff);
-		m_pchOutputCode[m_nOutputCodeLength+CVIRTUALMACHINE_EXTRA_DATA_LOCATION+3] = (char) (((nStackElementsDown)) & 0x0ff);
-
-		m_pchOutputCode[m_nOutputCodeLength+CVIRTUALMACHINE_EXTRA_DATA_LOCATION+4] = (char) (((nSize) >> 8) & 0x0ff);
-		m_pchOutputCode[m_nOutputCodeLength+CVIRTUALMACHINE_EXTRA_DATA_LOCATION+5] = (char) (((nSize)) & 0x0ff);
-
-		m_nOutputCodeLength += CVIRTUALMACHINE_OPERATION_BASE_SIZE + 6;
-		m_aOutputCodeInstructionBoundaries.push_back(m_nOutputCodeLength);
-
-		// CODE GENERATION
-		// Here, we have a "constant integer" op-code that would be added.
-		int32_t nIntegerData = nCaseValue;
-
-		m_pchOutputCode[m_nOutputCodeLength + CVIRTUALMACHINE_OPCODE_LOCATION] = CVIRTUALMACHINE_OPCODE_CONSTANT;
-		m_pchOutputCode[m_nOutputCodeLength + CVIRTUALMACHINE_AUXCODE_LOCATION] = CVIRTUALMACHINE_AUXCODE_TYPE_INTEGER;
+		if (pLabelNode->nOperation == CSCRIPTCOMPILER_OPERATION_CASE)
+		{
+			int32_t nCaseValue;
 
-		// Enter the integer constant.
-		m_pchOutputCode[m_nOutputCodeLength+CVIRTUALMACHINE_EXTRA_DATA_LOCATION] = (char) (((nIntegerData) >> 24) & 0x0ff);
-		m_pchOutputCode[m_nOutputCodeLength+CVIRTUALMACHINE_EXTRA_DATA_LOCATION+1] = (char) (((nIntegerData) >> 16) & 0x0ff);
-		m_pchOutputCode[m_nOutputCodeLength+CVIRTUALMACHINE_EXTRA_DATA_LOCATION+2] = (char) (((nIntegerData) >> 8) & 0x0ff);
-		m_pchOutputCode[m_nOutputCodeLength+CVIRTUALMACHINE_EXTRA_DATA_LOCATION+3] = (char) (((nIntegerData)) & 0x0ff);
+			ConstantFoldNode(pLabelNode->pLeft, TRUE);
+			// Evaluate the constant value that is contained.
+			if (pLabelNode->pLeft != NULL &&
+			        pLabelNode->pLeft->nOperation == CSCRIPTCOMPILER_OPERATION_NEGATION &&
+			        pLabelNode->pLeft->pLeft != NULL &&
+			        pLabelNode->pLeft->pLeft->nOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_INTEGER)
+			{
+				nCaseValue = -pLabelNode->pLeft->pLeft->nIntegerData;
+			}
+			else if (pLabelNode->pLeft != NULL &&
+			         pLabelNode->pLeft->nOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_INTEGER)
+			{
+				nCaseValue = pLabelNode->pLeft->nIntegerData;
+			}
+			else if (pLabelNode->pLeft != NULL &&
+			         pLabelNode->pLeft->nOperation == CSCRIPTCOMPILER_OPERATION_CONSTANT_STRING)
+			{
+				nCaseValue = pLabelNode->pLeft->m_psStringData->GetHash();
+			}
+			else
+			{
+				nReturnValue = OutputWalkTreeError(STRREF_CSCRIPTCOMPILER_ERROR_CASE_PARAMETER_NOT_A_CONSTANT_INTEGER,pLabelNode);
+				break;
+			}
 
-		m_nOutputCodeLength += CVIRTUALMACHINE_OPERATION_BASE_SIZE + 4;
-		m_aOutputCodeInstructionBoundaries.push_back(m_nOutputCodeLength);
+			// Now, we have to check if any of the previous case statements have the same value.
+			if (!m_aSwitchLabelValueSet.insert(nCaseValue).second)
+			{
+				nReturnValue = OutputWalkTreeError(STRREF_CSCRIPTCOMPILER_ERROR_MULTIPLE_CASE_CONSTANT_STATEMENTS_WITHIN_SWITCH,pLabelNode);
+				break;
+			}
 
-		// CODE GENERATION
-		// Write an "condition EQUALII" operation.
-		m_pchOutputCode[m_nOutputCodeLength + CVIRTUALMACHINE_OPCODE_LOCATION] = CVIRTUALMACHINE_OPCODE_EQUAL;
-		m_pchOutputCode[m_nOutputCodeLength + CVIRTUALMACHINE_AUXCODE_LOCATION] = CVIRTUALMACHINE_AUXCODE_TYPETYPE_INTEGER_INTEGER;
-		m_nOutputCodeLength += CVIRTUALMACHINE_OPERATION_BASE_SIZE;
-		m_aOutputCodeInstructionBoundaries.push_back(m_nOutputCodeLength);
+			// Add the case statement to the list.
+			m_aSwitchLabelValues.push_back(nCaseValue);
+		}
 
-		// CODE GENERATION
-		// Add the "JNZ _SC_nCaseValue_nSwitchIdentifier" operation.
-		m_pchOutputCode[m_nOutputCodeLength + CVIRTUALMACHINE_OPCODE_LOCATION] = CVIRTUALMACHINE_OPCODE_JNZ;
-		m_pchOutputCode[m_nOutputCodeLength + CVIRTUALMACHINE_AUXCODE_LOCATION] = 0;
+		if (pLabelNode->pRight != NULL)
+		{
+			PushTreeWalkEntry(pLabelNode->pRight);
+		}
+	}
 
-		/* CExoString sSymbolName;
-		sSymbolName.Format("_SC_%08x_%08x",nCaseValue,m_nSwitchIdentifier); */
-		AddSymbolToQueryList(m_nOutputCodeLength + CVIRTUALMACHINE_EXTRA_DATA_LOCATION,
-		                     CSCRIPTCOMPILER_SYMBOL_TABLE_ENTRY_TYPE_SWITCH_CASE,
-		                     nCaseValue,m_nSwitchIdentifier);
+	m_aTreeWalkStack.resize(nBase);
+	return nReturnValue;
+}
 
-		m_nOutputCodeLength += CVIRTUALMACHINE_OPERATION_BASE_SIZE + 4;
-		m_aOutputCodeInstructionBoundaries.push_back(m_nOutputCodeLength);
+///////////////////////////////////////////////////////////////////////////////
+//  CScriptCompiler::GenerateSwitchCompare()
+///////////////////////////////////////////////////////////////////////////////
+// Description: Compares a copy of the switch value (on top of the stack) with
+//              a constant, leaving the integer result on the stack:
+//
+//              COPYTOP fffffffc,0004  // copies the switch result so that we can use it.
+//              CONSTI  nValue         // adds the constant that we're to compare against.
+//              <nOpCode>II            // compares the two, leaving the result on the stack.
+///////////////////////////////////////////////////////////////////////////////
+void CScriptCompiler::GenerateSwitchCompare(int32_t nValue, uint8_t nOpCode)
+{
+	// CODE GENERATION
+	// Here, we would dump the "appropriate" data from the run-time stack
+	// on to the top of the stack, making a copy of it ... that's why
+	// we're adding one to the appropriate run time stack.
+
+	int32_t nStackElementsDown = -4;
+	int32_t nSize = 4;
+
+	char *buf = EmitInstruction(CVIRTUALMACHINE_OPCODE_RUNSTACK_COPY, CVIRTUALMACHINE_AUXCODE_TYPE_VOID, 6);
+	WriteByteSwap32(buf, nStackElementsDown);
+	buf[4] = (char) (((nSize) >> 8) & 0x0ff);
+	buf[5] = (char) (((nSize)) & 0x0ff);
+
+	// CODE GENERATION
+	// Here, we have a "constant integer" op-code that would be added.
+	buf = EmitInstruction(CVIRTUALMACHINE_OPCODE_CONSTANT, CVIRTUALMACHINE_AUXCODE_TYPE_INTEGER, 4);
+	WriteByteSwap32(buf, nValue);
+
+	// CODE GENERATION
+	// Write the condition operation.
+	EmitInstruction(nOpCode, CVIRTUALMACHINE_AUXCODE_TYPETYPE_INTEGER_INTEGER);
+}
 
-	}
+///////////////////////////////////////////////////////////////////////////////
+//  CScriptCompiler::GenerateSwitchJump()
+///////////////////////////////////////////////////////////////////////////////
+// Description: Writes a JMP/JZ/JNZ to a label that is resolved later on.
+///////////////////////////////////////////////////////////////////////////////
+void CScriptCompiler::GenerateSwitchJump(uint8_t nOpCode, int32_t nSymbolType, int32_t nSymbolSubType1, int32_t nSymbolSubType2)
+{
+	AddSymbolToQueryList(m_nOutputCodeLength + CVIRTUALMACHINE_EXTRA_DATA_LOCATION,
+	                     nSymbolType, nSymbolSubType1, nSymbolSubType2);
+	EmitInstruction(nOpCode, 0, 4);
+}
 
-	nReturnValue = TraverseTreeForSwitchLabels(pNode->pRight);
-	if (nReturnValue < 0)
-	{
-		return nReturnValue;
-	}
+///////////////////////////////////////////////////////////////////////////////
+//  CScriptCompiler::GenerateSwitchCaseTest()
+///////////////////////////////////////////////////////////////////////////////
+// Description: Jumps to a case label if the switch value matches it:
+//
+//              COPYTOP fffffffc,0004
+//              CONSTI  nCaseValue
+//              EQUALII
+//              JNZ     _SC_nCaseValue_nSwitchIdentifier  // result goes away, jump executed.
+///////////////////////////////////////////////////////////////////////////////
+void CScriptCompiler::GenerateSwitchCaseTest(int32_t nCaseValue)
+{
+	GenerateSwitchCompare(nCaseValue, CVIRTUALMACHINE_OPCODE_EQUAL);
 
-	return 0;
+	/* CExoString sSymbolName;
+	sSymbolName.Format("_SC_%08x_%08x",nCaseValue,m_nSwitchIdentifier); */
+	GenerateSwitchJump(CVIRTUALMACHINE_OPCODE_JNZ,
+	                   CSCRIPTCOMPILER_SYMBOL_TABLE_ENTRY_TYPE_SWITCH_CASE,
+	                   nCaseValue,m_nSwitchIdentifier);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-//  CScriptCompiler::ClearSwitchLabelList()
+//  CScriptCompiler::GenerateSwitchMissJump()
 ///////////////////////////////////////////////////////////////////////////////
-//  Created By: Mark Brockington
-//  Created On: 02/25/2000
-// Description: This function will resolve the labels within this level of
-//              switch statement.
+// Description: Jumps to the default label if it exists, or out of the switch
+//              otherwise.  Used once no case label matches.
 ///////////////////////////////////////////////////////////////////////////////
-void CScriptCompiler::ClearSwitchLabelList()
+void CScriptCompiler::GenerateSwitchMissJump()
 {
-	// Finally, don't forget the last piece of code, where we jump to the
-	// default label, if it exists.
-
 	if (m_bSwitchLabelDefault == TRUE)
 	{
 		// There is a default statement ... we jump there immediately.
@@ -1099,17 +1093,11 @@ void CScriptCompiler::ClearSwitchLabelList()
 		// CODE GENERATION
 		// Add the "JMP _SC_DEFAULT_nSwitchIdentifier" operation.
 
-		m_pchOutputCode[m_nOutputCodeLength + CVIRTUALMACHINE_OPCODE_LOCATION] = CVIRTUALMACHINE_OPCODE_JMP;
-		m_pchOutputCode[m_nOutputCodeLength + CVIRTUALMACHINE_AUXCODE_LOCATION] = 0;
-
 		/* CExoString sSymbolName;
 		sSymbolName.Format("_SC_DEFAULT_%08x",m_nSwitchIdentifier); */
-		AddSymbolToQueryList(m_nOutputCodeLength + CVIRTUALMACHINE_EXTRA_DATA_LOCATION,
-		                     CSCRIPTCOMPILER_SYMBOL_TABLE_ENTRY_TYPE_SWITCH_DEFAULT,
-		                     m_nSwitchIdentifier,0);
-
-		m_nOutputCodeLength += CVIRTUALMACHINE_OPERATION_BASE_SIZE + 4;
-		m_aOutputCodeInstructionBoundaries.push_back(m_nOutputCodeLength);
+		GenerateSwitchJump(CVIRTUALMACHINE_OPCODE_JMP,
+		                   CSCRIPTCOMPILER_SYMBOL_TABLE_ENTRY_TYPE_SWITCH_DEFAULT,
+		                   m_nSwitchIdentifier,0);
 	}
 	else
 	{
@@ -1119,25 +1107,101 @@ void CScriptCompiler::ClearSwitchLabelList()
 		// CODE GENERATION
 		// Add the "JMP _BR_nSwitchIdentifier" operation.
 
-		m_pchOutputCode[m_nOutputCodeLength + CVIRTUALMACHINE_OPCODE_LOCATION] = CVIRTUALMACHINE_OPCODE_JMP;
-		m_pchOutputCode[m_nOutputCodeLength + CVIRTUALMACHINE_AUXCODE_LOCATION] = 0;
-
 		/*CExoString sSymbolName;
 		sSymbolName.Format("_BR_%08x",m_nSwitchIdentifier);*/
-		AddSymbolToQueryList(m_nOutputCodeLength + CVIRTUALMACHINE_EXTRA_DATA_LOCATION,
-		                     CSCRIPTCOMPILER_SYMBOL_TABLE_ENTRY_TYPE_BREAK,
-		                     m_nSwitchIdentifier,0);
+		GenerateSwitchJump(CVIRTUALMACHINE_OPCODE_JMP,
+		                   CSCRIPTCOMPILER_SYMBOL_TABLE_ENTRY_TYPE_BREAK,
+		                   m_nSwitchIdentifier,0);
+	}
+}
 
-		m_nOutputCodeLength += CVIRTUALMACHINE_OPERATION_BASE_SIZE + 4;
-		m_aOutputCodeInstructionBoundaries.push_back(m_nOutputCodeLength);
+///////////////////////////////////////////////////////////////////////////////
+//  CScriptCompiler::GenerateSwitchDecisionTree()
+///////////////////////////////////////////////////////////////////////////////
+// Description: Binary search over the sorted case values pnValues.  Every
+//              internal node halves the range:
+//
+//              COPYTOP fffffffc,0004
+//              CONSTI  nPivot
+//              LTII
+//              JNZ     _ST_nLabel_nSwitchIdentifier
+//              <values >= nPivot>
+//            _ST_nLabel_nSwitchIdentifier:
+//              <values < nPivot>
+//
+//              and leaves test their few values one by one.  nKnownLow and
+//              nKnownHigh are the bounds the switch value is known to lie in
+//              by the time the range is reached: when a leaf covers every
+//              value in between (a dense range), its last test can't fail
+//              and becomes a plain JMP.  bLastBranch is set on the range that
+//              is emitted last, which falls through to the final miss jump
+//              written by ClearSwitchLabelList().
+///////////////////////////////////////////////////////////////////////////////
+void CScriptCompiler::GenerateSwitchDecisionTree(const int32_t *pnValues, int32_t nValues, int64_t nKnownLow, int64_t nKnownHigh, BOOL bLastBranch)
+{
+	if (nValues <= CSCRIPTCOMPILER_SWITCH_TREE_LEAF_SIZE)
+	{
+		BOOL bDense = (nKnownLow == pnValues[0] &&
+		               nKnownHigh == pnValues[nValues - 1] &&
+		               nKnownHigh - nKnownLow + 1 == nValues);
+
+		for (int32_t nCount = 0; nCount < nValues; ++nCount)
+		{
+			if (bDense == TRUE && nCount == nValues - 1)
+			{
+				GenerateSwitchJump(CVIRTUALMACHINE_OPCODE_JMP,
+				                   CSCRIPTCOMPILER_SYMBOL_TABLE_ENTRY_TYPE_SWITCH_CASE,
+				                   pnValues[nCount],m_nSwitchIdentifier);
+			}
+			else
+			{
+				GenerateSwitchCaseTest(pnValues[nCount]);
+			}
+		}
+
+		if (bDense == FALSE && bLastBranch == FALSE)
+		{
+			GenerateSwitchMissJump();
+		}
+		return;
 	}
 
+	int32_t nMiddle = nValues / 2;
+	int32_t nPivot = pnValues[nMiddle];
+	int32_t nLabel = m_nSwitchTreeLabels++;
+
+	GenerateSwitchCompare(nPivot, CVIRTUALMACHINE_OPCODE_LT);
+	GenerateSwitchJump(CVIRTUALMACHINE_OPCODE_JNZ,
+	                   CSCRIPTCOMPILER_SYMBOL_TABLE_ENTRY_TYPE_SWITCH_TREE,
+	                   nLabel,m_nSwitchIdentifier);
+
+	GenerateSwitchDecisionTree(pnValues + nMiddle, nValues - nMiddle, nPivot, nKnownHigh, FALSE);
+
+	AddSymbolToLabelList(m_nOutputCodeLength,
+	                     CSCRIPTCOMPILER_SYMBOL_TABLE_ENTRY_TYPE_SWITCH_TREE,
+	                     nLabel,m_nSwitchIdentifier);
+
+	GenerateSwitchDecisionTree(pnValues, nMiddle, nKnownLow, (int64_t) nPivot - 1, bLastBranch);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  CScriptCompiler::ClearSwitchLabelList()
+///////////////////////////////////////////////////////////////////////////////
+//  Created By: Mark Brockington
+//  Created On: 02/25/2000
+// Description: This function will resolve the labels within this level of
+//              switch statement.
+///////////////////////////////////////////////////////////////////////////////
+void CScriptCompiler::ClearSwitchLabelList()
+{
+	// Finally, don't forget the last piece of code, where we jump to the
+	// default label, if it exists.
+	GenerateSwitchMissJump();
 
 	m_bSwitchLabelDefault = FALSE;
-	m_nSwitchLabelNumber = 0;
-	m_nSwitchLabelArraySize = 16;
-	delete[] m_pnSwitchLabelStatements;
-	m_pnSwitchLabelStatements = NULL;
+	m_nSwitchTreeLabels = 0;
+	m_aSwitchLabelValues.clear();
+	m_aSwitchLabelValueSet.clear();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1303,6 +1367,37 @@ int32_t CScriptCompiler::GenerateCodeForSwitchLabels(CScriptParseTreeNode *pNode
 	{
 		return nReturnValue;
 	}
+
+	int32_t nCases = (int32_t) m_aSwitchLabelValues.size();
+
+	// All of the tests are written in one go, so make sure they fit: the
+	// usual check in WalkParseTree() only leaves 16K of headroom.
+	int32_t nMaxTestSize = (nCases + 1) * 48;
+	if (m_nOutputCodeLength + nMaxTestSize >= m_nOutputCodeSize - 16384)
+	{
+		m_nOutputCodeSize += CSCRIPTCOMPILER_MAX_CODE_SIZE + nMaxTestSize;
+		char *pNewArray = new char[m_nOutputCodeSize];
+		memcpy(pNewArray,m_pchOutputCode,m_nOutputCodeLength);
+		delete[] m_pchOutputCode;
+		m_pchOutputCode = pNewArray;
+	}
+
+	if ((m_nOptimizationFlags & CSCRIPTCOMPILER_OPTIMIZE_SWITCH_TREES) &&
+	        nCases >= CSCRIPTCOMPILER_SWITCH_TREE_THRESHOLD)
+	{
+		std::vector<int32_t> aSortedValues(m_aSwitchLabelValues);
+		std::sort(aSortedValues.begin(), aSortedValues.end());
+		GenerateSwitchDecisionTree(aSortedValues.data(), nCases, INT32_MIN, INT32_MAX, TRUE);
+	}
+	else
+	{
+		// One test per case label, in source order.
+		for (int32_t nCount = 0; nCount < nCases; ++nCount)
+		{
+			GenerateSwitchCaseTest(m_aSwitchLabelValues[nCount]);
+		}
+	}
+
 	ClearSwitchLabelList();
 
 	// MGB - For Script Debugger
@@ -2029,15 +2124,15 @@ int32_t CScriptCompiler::PreVisitGenerateCode(CScriptParseTreeNode *pNode)
 		}
 		--m_nStackCurrentDepth;
 
-		m_pchOutputCode[m_nOutputCodeLength + CVIRTUALMACHINE_OPCODE_LOCATION] = CVIRTUALMACHINE_OPCODE_JZ;
-		m_pchOutputCode[m_nOutputCodeLength + CVIRTUALMACHINE_AUXCODE_LOCATION] = 0;
-
 		// Save the current state of the binary code length for the purpose
 		// of generating a good jump over the code within this instruction in
-		// the PostVisitGenerateCode() call.
+		// the PostVisitGenerateCode() call.  A condition folded to TRUE has
+		// no jump at all, and nothing to fix up later.
 
-		m_nOutputCodeLength += CVIRTUALMACHINE_OPERATION_BASE_SIZE + 4;
-		m_aOutputCodeInstructionBoundaries.push_back(m_nOutputCodeLength);
+		if (EmitConditionalJump() == NULL)
+		{
+			pNode->nIntegerData = -1;
+		}
 
 	}
 
@@ -2055,15 +2150,15 @@ int32_t CScriptCompiler::PreVisitGenerateCode(CScriptParseTreeNode *pNode)
 		}
 		--m_nStackCurrentDepth;
 
-		m_pchOutputCode[m_nOutputCodeLength + CVIRTUALMACHINE_OPCODE_LOCATION] = CVIRTUALMACHINE_OPCODE_JZ;
-		m_pchOutputCode[m_nOutputCodeLength + CVIRTUALMACHINE_AUXCODE_LOCATION] = 0;
-
 		// Save the current state of the binary code length for the purpose
 		// of generating a good jump over the code within this instruction in
-		// the PostVisitGenerateCode() call.
+		// the PostVisitGenerateCode() call.  A condition folded to TRUE has
+		// no jump at all, and nothing to fix up later.
 
-		m_nOutputCodeLength += CVIRTUALMACHINE_OPERATION_BASE_SIZE + 4;
-		m_aOutputCodeInstructionBoundaries.push_back(m_nOutputCodeLength);
+		if (EmitConditionalJump() == NULL)
+		{
+			pNode->nIntegerData = -1;
+		}
 	}
 
 	if (pNode->nOperation == CSCRIPTCOMPILER_OPERATION_IF_CONDITION)
@@ -2247,15 +2342,14 @@ int32_t CScriptCompiler::InVisitGenerateCode(CScriptParseTreeNode *pNode)
 		}
 		--m_nStackCurrentDepth;
 
-		m_pchOutputCode[m_nOutputCodeLength + CVIRTUALMACHINE_OPCODE_LOCATION] = CVIRTUALMACHINE_OPCODE_JZ;
-		m_pchOutputCode[m_nOutputCodeLength + CVIRTUALMACHINE_AUXCODE_LOCATION] = 0;
-
 		// Save the current state of the binary code length for the purpose
 		// of generating a good jump over the code within this instruction in
-		// the PostVisitGenerateCode() call.
+		// the PostVisitGenerateCode() call.  (A while (TRUE) loop has none.)
 
-		m_nOutputCodeLength += CVIRTUALMACHINE_OPERATION_BASE_SIZE + 4;
-		m_aOutputCodeInstructionBoundaries.push_back(m_nOutputCodeLength);
+		if (EmitConditionalJump() == NULL)
+		{
+			pNode->nIntegerData2 = -1;
+		}
 
 		if (m_nGenerateDebuggerOutput != 0)
 		{
@@ -2281,11 +2375,14 @@ int32_t CScriptCompiler::InVisitGenerateCode(CScriptParseTreeNode *pNode)
 		// the PreVisit() [code located at pNode->nIntegerdata].
 		// This is an awfully good thing to do.
 
-		int32_t nJmpLength = m_nOutputCodeLength - pNode->nIntegerData;
-		m_pchOutputCode[pNode->nIntegerData + CVIRTUALMACHINE_EXTRA_DATA_LOCATION]     = (char) (((nJmpLength) >> 24) & 0x0ff);
-		m_pchOutputCode[pNode->nIntegerData + CVIRTUALMACHINE_EXTRA_DATA_LOCATION + 1] = (char) (((nJmpLength) >> 16) & 0x0ff);
-		m_pchOutputCode[pNode->nIntegerData + CVIRTUALMACHINE_EXTRA_DATA_LOCATION + 2] = (char) (((nJmpLength) >> 8 ) & 0x0ff);
-		m_pchOutputCode[pNode->nIntegerData + CVIRTUALMACHINE_EXTRA_DATA_LOCATION + 3] = (char) (((nJmpLength)      ) & 0x0ff);
+		if (pNode->nIntegerData >= 0)
+		{
+			int32_t nJmpLength = m_nOutputCodeLength - pNode->nIntegerData;
+			m_pchOutputCode[pNode->nIntegerData + CVIRTUALMACHINE_EXTRA_DATA_LOCATION]     = (char) (((nJmpLength) >> 24) & 0x0ff);
+			m_pchOutputCode[pNode->nIntegerData + CVIRTUALMACHINE_EXTRA_DATA_LOCATION + 1] = (char) (((nJmpLength) >> 16) & 0x0ff);
+			m_pchOutputCode[pNode->nIntegerData + CVIRTUALMACHINE_EXTRA_DATA_LOCATION + 2] = (char) (((nJmpLength) >> 8 ) & 0x0ff);
+			m_pchOutputCode[pNode->nIntegerData + CVIRTUALMACHINE_EXTRA_DATA_LOCATION + 3] = (char) (((nJmpLength)      ) & 0x0ff);
+		}
 
 		// MGB - For Script Debugger
 		if (pNode->pRight != NULL)
@@ -2331,11 +2428,14 @@ int32_t CScriptCompiler::InVisitGenerateCode(CScriptParseTreeNode *pNode)
 		// the PreVisit() [code located at pNode->nIntegerdata].
 		// This is an awfully good thing to do.
 
-		int32_t nJmpLength = m_nOutputCodeLength - pNode->nIntegerData;
-		m_pchOutputCode[pNode->nIntegerData + CVIRTUALMACHINE_EXTRA_DATA_LOCATION]     = (char) (((nJmpLength) >> 24) & 0x0ff);
-		m_pchOutputCode[pNode->nIntegerData + CVIRTUALMACHINE_EXTRA_DATA_LOCATION + 1] = (char) (((nJmpLength) >> 16) & 0x0ff);
-		m_pchOutputCode[pNode->nIntegerData + CVIRTUALMACHINE_EXTRA_DATA_LOCATION + 2] = (char) (((nJmpLength) >> 8 ) & 0x0ff);
-		m_pchOutputCode[pNode->nIntegerData + CVIRTUALMACHINE_EXTRA_DATA_LOCATION + 3] = (char) (((nJmpLength)      ) & 0x0ff);
+		if (pNode->nIntegerData >= 0)
+		{
+			int32_t nJmpLength = m_nOutputCodeLength - pNode->nIntegerData;
+			m_pchOutputCode[pNode->nIntegerData + CVIRTUALMACHINE_EXTRA_DATA_LOCATION]     = (char) (((nJmpLength) >> 24) & 0x0ff);
+			m_pchOutputCode[pNode->nIntegerData + CVIRTUALMACHINE_EXTRA_DATA_LOCATION + 1] = (char) (((nJmpLength) >> 16) & 0x0ff);
+			m_pchOutputCode[pNode->nIntegerData + CVIRTUALMACHINE_EXTRA_DATA_LOCATION + 2] = (char) (((nJmpLength) >> 8 ) & 0x0ff);
+			m_pchOutputCode[pNode->nIntegerData + CVIRTUALMACHINE_EXTRA_DATA_LOCATION + 3] = (char) (((nJmpLength)      ) & 0x0ff);
+		}
 
 		// NOTE:  We've got to get rid of the first thing on the stack here, otherwise, we're
 		// TOTALLY boned when using variables in the second part.
@@ -3516,6 +3616,11 @@ int32_t CScriptCompiler::PostVisitGenerateCode(CScriptParseTreeNode *pNode)
 			}
 		}
 
+		if (pNode->nOperation != CSCRIPTCOMPILER_OPERATION_SWITCH_CONDITION)
+		{
+			FoldConstantCondition(pNode);
+		}
+
 		// If we're a switch condition, confirm that we're an integer at this stage!
 		if (pNode->nOperation == CSCRIPTCOMPILER_OPERATION_SWITCH_CONDITION)
 		{
@@ -3624,11 +3729,14 @@ int32_t CScriptCompiler::PostVisitGenerateCode(CScriptParseTreeNode *pNode)
 		// the InVisit() [code located at pNode->nIntegerdata2].
 		// This is an awfully good thing to do.
 
-		nJmpLength = m_nOutputCodeLength - pNode->nIntegerData2;
-		m_pchOutputCode[pNode->nIntegerData2 + CVIRTUALMACHINE_EXTRA_DATA_LOCATION]     = (char) (((nJmpLength) >> 24) & 0x0ff);
-		m_pchOutputCode[pNode->nIntegerData2 + CVIRTUALMACHINE_EXTRA_DATA_LOCATION + 1] = (char) (((nJmpLength) >> 16) & 0x0ff);
-		m_pchOutputCode[pNode->nIntegerData2 + CVIRTUALMACHINE_EXTRA_DATA_LOCATION + 2] = (char) (((nJmpLength) >> 8 ) & 0x0ff);
-		m_pchOutputCode[pNode->nIntegerData2 + CVIRTUALMACHINE_EXTRA_DATA_LOCATION + 3] = (char) (((nJmpLength)      ) & 0x0ff);
+		if (pNode->nIntegerData2 >= 0)
+		{
+			nJmpLength = m_nOutputCodeLength - pNode->nIntegerData2;
+			m_pchOutputCode[pNode->nIntegerData2 + CVIRTUALMACHINE_EXTRA_DATA_LOCATION]     = (char) (((nJmpLength) >> 24) & 0x0ff);
+			m_pchOutputCode[pNode->nIntegerData2 + CVIRTUALMACHINE_EXTRA_DATA_LOCATION + 1] = (char) (((nJmpLength) >> 16) & 0x0ff);
+			m_pchOutputCode[pNode->nIntegerData2 + CVIRTUALMACHINE_EXTRA_DATA_LOCATION + 2] = (char) (((nJmpLength) >> 8 ) & 0x0ff);
+			m_pchOutputCode[pNode->nIntegerData2 + CVIRTUALMACHINE_EXTRA_DATA_LOCATION + 3] = (char) (((nJmpLength)      ) & 0x0ff);
+		}
 
 		// Generate a label for the end of the function (used by the break keyword)
 		/* CExoString sSymbolName;
@@ -3677,20 +3785,15 @@ int32_t CScriptCompiler::PostVisitGenerateCode(CScriptParseTreeNode *pNode)
 		}
 		--m_nStackCurrentDepth;
 
-		m_pchOutputCode[m_nOutputCodeLength + CVIRTUALMACHINE_OPCODE_LOCATION] = CVIRTUALMACHINE_OPCODE_JZ;
-		m_pchOutputCode[m_nOutputCodeLength + CVIRTUALMACHINE_AUXCODE_LOCATION] = 0;
-
 		// The jump length is over this instruction and the jmp instruction, both of
 		// which are OPERATION_BASE_SIZE + 4 (for the address).
 
 		int32_t nJmpLength = (CVIRTUALMACHINE_OPERATION_BASE_SIZE + 4) << 1;
-		m_pchOutputCode[m_nOutputCodeLength+ CVIRTUALMACHINE_EXTRA_DATA_LOCATION ] = (char) (((nJmpLength) >> 24) & 0x0ff);
-		m_pchOutputCode[m_nOutputCodeLength+CVIRTUALMACHINE_EXTRA_DATA_LOCATION+1] = (char) (((nJmpLength) >> 16) & 0x0ff);
-		m_pchOutputCode[m_nOutputCodeLength+CVIRTUALMACHINE_EXTRA_DATA_LOCATION+2] = (char) (((nJmpLength) >> 8) & 0x0ff);
-		m_pchOutputCode[m_nOutputCodeLength+CVIRTUALMACHINE_EXTRA_DATA_LOCATION+3] = (char) (((nJmpLength)) & 0x0ff);
-
-		m_nOutputCodeLength += CVIRTUALMACHINE_OPERATION_BASE_SIZE + 4;
-		m_aOutputCodeInstructionBoundaries.push_back(m_nOutputCodeLength);
+		char *pJmpData = EmitConditionalJump();
+		if (pJmpData != NULL)
+		{
+			WriteByteSwap32(pJmpData, nJmpLength);
+		}
 
 		//
 		// And now, the JMP instruction.
@@ -4958,7 +5061,10 @@ int32_t CScriptCompiler::PostVisitGenerateCode(CScriptParseTreeNode *pNode)
 		// Remove the last variable (#retval), and reset the state of the
 		// variable stack.
 
-		if (m_nFunctionImpReturnType != CSCRIPTCOMPILER_TOKEN_KEYWORD_VOID)
+		// A function a statement was dropped from (see SetMaxErrors()) may
+		// have lost its return statement with it: its error is reported already.
+		if (m_nFunctionImpReturnType != CSCRIPTCOMPILER_TOKEN_KEYWORD_VOID &&
+		        m_aRecoveredFunctionSet.find(pNode) == m_aRecoveredFunctionSet.end())
 		{
 			// Check the function using our custom function to handle this.
 			if (FoundReturnStatementOnAllBranches(pNode->pRight) == FALSE)
@@ -5779,62 +5885,80 @@ int32_t CScriptCompiler::PostVisitGenerateCode(CScriptParseTreeNode *pNode)
 
 int32_t CScriptCompiler::FoundReturnStatementOnAllBranches(CScriptParseTreeNode *pNode)
 {
-
 	// Clearly, if the NODE is NULL, then we don't need to
 	if (pNode == NULL)
 	{
 		return FALSE;
 	}
 
-	// Here, we want to verify that BOTH paths have a RETURN statement
-	// before letting people know that both sides of it are protected.
+	// The answer for the branch looked at last.
+	int32_t bFound = FALSE;
 
-	if (pNode->nOperation == CSCRIPTCOMPILER_OPERATION_RETURN)
+	size_t nBase = m_aTreeWalkStack.size();
+	PushTreeWalkEntry(pNode);
+
+	while (m_aTreeWalkStack.size() > nBase)
 	{
-		return TRUE;
-	}
+		size_t nEntry = m_aTreeWalkStack.size() - 1;
+		CScriptParseTreeNode *pBranchNode = m_aTreeWalkStack[nEntry].m_pNode;
+		int32_t nState = m_aTreeWalkStack[nEntry].m_nState;
 
-	// Here, we want to verify that BOTH paths have a RETURN statement
-	// before letting people know that both sides of it are protected.
+		// Here, we want to verify that BOTH paths have a RETURN statement
+		// before letting people know that both sides of it are protected.
+		BOOL bIfChoice = pBranchNode->nOperation == CSCRIPTCOMPILER_OPERATION_IF_CHOICE;
 
-	if (pNode->nOperation == CSCRIPTCOMPILER_OPERATION_IF_CHOICE)
-	{
-		if (FoundReturnStatementOnAllBranches(pNode->pLeft) == TRUE)
+		// We want to pass through these functions, and if either side reports that
+		// they have a RETURN statement in them, that's good enough for me.
+		BOOL bPassThrough = pBranchNode->nOperation == CSCRIPTCOMPILER_OPERATION_COMPOUND_STATEMENT ||
+		                    pBranchNode->nOperation == CSCRIPTCOMPILER_OPERATION_STATEMENT ||
+		                    pBranchNode->nOperation == CSCRIPTCOMPILER_OPERATION_STATEMENT_NO_DEBUG ||
+		                    pBranchNode->nOperation == CSCRIPTCOMPILER_OPERATION_STATEMENT_LIST ||
+		                    pBranchNode->nOperation == CSCRIPTCOMPILER_OPERATION_IF_BLOCK;
+
+		CScriptParseTreeNode *pNextBranch = NULL;
+
+		if (nState == 0)
 		{
-			if (FoundReturnStatementOnAllBranches(pNode->pRight) == TRUE)
+			if (pBranchNode->nOperation == CSCRIPTCOMPILER_OPERATION_RETURN)
 			{
-				return TRUE;
+				bFound = TRUE;
+			}
+			else if (bIfChoice || bPassThrough)
+			{
+				// Both start with the left branch.
+				m_aTreeWalkStack[nEntry].m_nState = 1;
+				pNextBranch = pBranchNode->pLeft;
+			}
+			else
+			{
+				// We don't want to scan through any other part of the tree.
+				bFound = FALSE;
 			}
 		}
-		return FALSE;
-	}
-
-	// We want to pass through these functions, and if either side reports that
-	// they have a RETURN statement in them, that's good enough for me.
-	if (pNode->nOperation == CSCRIPTCOMPILER_OPERATION_COMPOUND_STATEMENT ||
-	        pNode->nOperation == CSCRIPTCOMPILER_OPERATION_STATEMENT ||
-	        pNode->nOperation == CSCRIPTCOMPILER_OPERATION_STATEMENT_NO_DEBUG ||
-	        pNode->nOperation == CSCRIPTCOMPILER_OPERATION_STATEMENT_LIST ||
-	        pNode->nOperation == CSCRIPTCOMPILER_OPERATION_IF_BLOCK)
-	{
-		if (FoundReturnStatementOnAllBranches(pNode->pLeft) == TRUE)
+		else if (nState == 1 && (bIfChoice ? bFound == TRUE : bFound != TRUE))
 		{
-			return TRUE;
+			// The left branch doesn't settle it: the right one does.
+			m_aTreeWalkStack[nEntry].m_nState = 2;
+			pNextBranch = pBranchNode->pRight;
 		}
 
-		if (FoundReturnStatementOnAllBranches(pNode->pRight) == TRUE)
+		if (m_aTreeWalkStack[nEntry].m_nState != nState)
 		{
-			return TRUE;
+			if (pNextBranch != NULL)
+			{
+				PushTreeWalkEntry(pNextBranch);
+			}
+			else
+			{
+				bFound = FALSE;
+			}
+			continue;
 		}
 
-		return FALSE;
+		m_aTreeWalkStack.pop_back();
 	}
 
-	// We don't want to scan through any other part of the tree, so we
-	// should return FALSE here.
-
-	return FALSE;
-
+	return bFound;
 }
 
 
@@ -5874,47 +5998,14 @@ int32_t CScriptCompiler::GetStructureSize(const CExoString &sStructureName)
 ///////////////////////////////////////////////////////////////////////////////
 int32_t CScriptCompiler::GetIdentifierByName(const CExoString &sIdentifierName)
 {
-	BOOL bInfiniteLoop = TRUE;
-	uint32_t nOriginalHash = HashString(sIdentifierName);
-
-	// Search for the exact entry.
-	uint32_t nHash = nOriginalHash % CSCRIPTCOMPILER_SIZE_IDENTIFIER_HASH_TABLE;
-	uint32_t nEndHash = nHash + (CSCRIPTCOMPILER_SIZE_IDENTIFIER_HASH_TABLE - 1) & CSCRIPTCOMPILER_MASK_SIZE_IDENTIFIER_HASH_TABLE;
+	const CScriptCompilerIdentifierHashTableEntry *pHashEntry = GetHashEntryByName(sIdentifierName.CStr(), CSCRIPTCOMPILER_HASH_MANAGER_TYPE_IDENTIFIER);
 
-	while (bInfiniteLoop)
+	if (pHashEntry == NULL)
 	{
-		// If we're at the correct entry, confirm that the strings are identical and then
-		// return to the main routine.
-		if (m_pIdentifierHashTable[nHash].m_nHashValue == nOriginalHash &&
-		        m_pIdentifierHashTable[nHash].m_nIdentifierType == CSCRIPTCOMPILER_HASH_MANAGER_TYPE_IDENTIFIER)
-		{
-			int32_t count = m_pIdentifierHashTable[nHash].m_nIdentifierIndex;
-			if (m_pcIdentifierList[count].m_psIdentifier == sIdentifierName)
-			{
-				return count;
-			}
-		}
-
-		// Have we hit a blank entry?  Then it's not in the list.
-		if (m_pIdentifierHashTable[nHash].m_nIdentifierType == CSCRIPTCOMPILER_HASH_MANAGER_TYPE_UNKNOWN)
-		{
-			return STRREF_CSCRIPTCOMPILER_ERROR_UNDEFINED_IDENTIFIER;
-		}
-
-		// Have we searched the entire list?
-		if (nEndHash == nHash)
-		{
-			return STRREF_CSCRIPTCOMPILER_ERROR_UNDEFINED_IDENTIFIER;
-		}
-
-		// Move to the next entry in the list.
-		++nHash;
-		nHash &= CSCRIPTCOMPILER_MASK_SIZE_IDENTIFIER_HASH_TABLE;
-
+		return STRREF_CSCRIPTCOMPILER_ERROR_UNDEFINED_IDENTIFIER;
 	}
 
-	return STRREF_CSCRIPTCOMPILER_ERROR_UNDEFINED_IDENTIFIER;
-
+	return pHashEntry->m_nIdentifierIndex;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -6254,43 +6345,96 @@ int32_t CScriptCompiler::AddSymbolToQueryList(int32_t nLocationPointer, int32_t
 //  Created By: Mark Brockington
 //  Created On: 07/22/99
 //  Description:  This routine will walk the compile tree, generating a postfix
-//                listing of the nodes (if necessary).
+//                listing of the nodes (if necessary).  The walk keeps its
+//                place on the tree walk stack rather than recursing, so
+//                long statement lists and else if chains don't run out of
+//                (thread) stack.
 ///////////////////////////////////////////////////////////////////////////////
 
 int32_t CScriptCompiler::WalkParseTree(CScriptParseTreeNode *pNode)
 {
-	if (pNode != NULL)
+	// A Null pointer is not an error.
+	if (pNode == NULL)
 	{
-		//INT bPrinted = 0;
+		return 0;
+	}
 
+	int nReturnCode = 0;   // Of the node (or subtree) visited last
 
-		int nReturnCode;
+	size_t nBase = m_aTreeWalkStack.size();
+	PushTreeWalkEntry(pNode);
 
-		ConstantFoldNode(pNode);
-		nReturnCode = PreVisitGenerateCode(pNode);
+	while (m_aTreeWalkStack.size() > nBase)
+	{
+		size_t nEntry = m_aTreeWalkStack.size() - 1;
+		CScriptParseTreeNode *pVisitNode = m_aTreeWalkStack[nEntry].m_pNode;
+		int32_t nState = m_aTreeWalkStack[nEntry].m_nState;
 
-		if (nReturnCode == 0)
+		if (nState == 0)
 		{
-			nReturnCode = WalkParseTree(pNode->pLeft);
-		}
+			// Where the walk goes back to, past an error in a function.
+			if (m_nMaxErrors > 1 &&
+			        pVisitNode->nOperation == CSCRIPTCOMPILER_OPERATION_FUNCTIONAL_UNIT &&
+			        pVisitNode->pLeft != NULL &&
+			        pVisitNode->pLeft->nOperation == CSCRIPTCOMPILER_OPERATION_FUNCTION)
+			{
+				m_cWalkRecoveryPoint.m_pFunctionalUnit = pVisitNode;
+				m_cWalkRecoveryPoint.m_nOccupiedVariables = m_nOccupiedVariables;
+				m_cWalkRecoveryPoint.m_nStackCurrentDepth = m_nStackCurrentDepth;
+				m_cWalkRecoveryPoint.m_nVarStackRecursionLevel = m_nVarStackRecursionLevel;
+				m_cWalkRecoveryPoint.m_nLoopStackDepth = m_nLoopStackDepth;
+				m_cWalkRecoveryPoint.m_nSwitchLevel = m_nSwitchLevel;
+				m_cWalkRecoveryPoint.m_nSwitchStackDepth = m_nSwitchStackDepth;
+			}
 
-		if (nReturnCode == 0)
-		{
-			ConstantFoldNode(pNode);
-			nReturnCode = InVisitGenerateCode(pNode);
-		}
+			ConstantFoldNode(pVisitNode);
+			nReturnCode = PreVisitGenerateCode(pVisitNode);
 
-		if (nReturnCode == 0)
-		{
-			nReturnCode = WalkParseTree(pNode->pRight);
+			if (nReturnCode == 0)
+			{
+				m_aTreeWalkStack[nEntry].m_nState = 1;
+				if (pVisitNode->pLeft != NULL)
+				{
+					PushTreeWalkEntry(pVisitNode->pLeft);
+				}
+				continue;
+			}
 		}
+		else if (nState == 1)
+		{
+			if (nReturnCode < 0 && RecoverFromWalkTreeError(pVisitNode, nReturnCode) == TRUE)
+			{
+				nReturnCode = 0;
+			}
 
-		if (nReturnCode == 0)
+			if (nReturnCode == 0)
+			{
+				ConstantFoldNode(pVisitNode);
+				nReturnCode = InVisitGenerateCode(pVisitNode);
+			}
+
+			if (nReturnCode == 0)
+			{
+				m_aTreeWalkStack[nEntry].m_nState = 2;
+				if (pVisitNode->pRight != NULL)
+				{
+					PushTreeWalkEntry(pVisitNode->pRight);
+				}
+				continue;
+			}
+		}
+		else
 		{
-			ConstantFoldNode(pNode);
-			nReturnCode = PostVisitGenerateCode(pNode);
+			if (nReturnCode == 0)
+			{
+				ConstantFoldNode(pVisitNode);
+				nReturnCode = PostVisitGenerateCode(pVisitNode);
+			}
 		}
 
+		// Done with this node.
+		m_aTreeWalkStack.pop_back();
+
 		if (nReturnCode > 0)
 		{
 			nReturnCode = 0;
@@ -6310,12 +6454,54 @@ int32_t CScriptCompiler::WalkParseTree(CScriptParseTreeNode *pNode)
 			m_pchOutputCode = pNewArray;
 			// return OutputWalkTreeError(STRREF_CSCRIPTCOMPILER_ERROR_SCRIPT_TOO_LARGE,pNode);
 		}
+	}
 
-		return nReturnCode;
+	return nReturnCode;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  CScriptCompiler::RecoverFromWalkTreeError()
+///////////////////////////////////////////////////////////////////////////////
+//  Description:  Called by WalkParseTree() when the walk of the left branch of
+//                pNode returned nError.  If pNode is the functional unit of
+//                the function the error is in, and the compile may report
+//                more errors (see SetMaxErrors()), puts the state of the
+//                walk back to where it was before the function, for the walk
+//                to go on with the next functional unit.
+///////////////////////////////////////////////////////////////////////////////
+
+BOOL CScriptCompiler::RecoverFromWalkTreeError(CScriptParseTreeNode *pNode, int32_t nError)
+{
+	if (m_nMaxErrors <= 1 ||
+	        pNode != m_cWalkRecoveryPoint.m_pFunctionalUnit ||
+	        (int32_t) m_aDiagnostics.size() >= m_nMaxErrors)
+	{
+		return FALSE;
 	}
 
-	// A Null pointer is not an error.
-	return 0;
+	if (nError != STRREF_CSCRIPTCOMPILER_ERROR_ALREADY_PRINTED)
+	{
+		OutputWalkTreeError(nError, pNode->pLeft);
+	}
+	++m_nRecoveredErrors;
+
+	m_nOccupiedVariables = m_cWalkRecoveryPoint.m_nOccupiedVariables;
+	m_nStackCurrentDepth = m_cWalkRecoveryPoint.m_nStackCurrentDepth;
+	m_nVarStackRecursionLevel = m_cWalkRecoveryPoint.m_nVarStackRecursionLevel;
+	m_nLoopStackDepth = m_cWalkRecoveryPoint.m_nLoopStackDepth;
+	m_nSwitchLevel = m_cWalkRecoveryPoint.m_nSwitchLevel;
+	m_nSwitchStackDepth = m_cWalkRecoveryPoint.m_nSwitchStackDepth;
+
+	m_bFunctionImp = FALSE;
+	m_nStructureDefinition = 0;
+	m_bAssignmentToVariable = FALSE;
+	m_bInStructurePart = FALSE;
+	m_bConstantVariableDefinition = FALSE;
+	m_nFoldedConditionLocation = -1;
+
+	m_cWalkRecoveryPoint.m_pFunctionalUnit = NULL;
+
+	return TRUE;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -6938,9 +7124,23 @@ int32_t CScriptCompiler::WriteDebuggerOutputToFile(CExoString sFileName)
 		CExoString sModifiedFileName;
 		sModifiedFileName.Format("%s:%s",m_sOutputAlias.CStr(),sFileName.CStr());
 
-        const int32_t ret = m_cAPI.ResManWriteToFile(
-            sModifiedFileName.CStr(), m_nResTypeDebug,
-            (const uint8_t*) m_pchDebuggerCode, m_nDebuggerCodeLength, false);
+        int32_t ret;
+        if (m_bAutomaticCleanUpAfterCompiles == TRUE && m_cAPI.ResManTakeFile)
+        {
+            // Same as the final code: the buffer would be deleted below
+            char* pchDebuggerCode = m_pchDebuggerCode;
+            m_pchDebuggerCode = NULL;
+            m_nDebuggerCodeSize = 0;
+            ret = m_cAPI.ResManTakeFile(
+                sModifiedFileName.CStr(), m_nResTypeDebug,
+                pchDebuggerCode, m_nDebuggerCodeLength, false);
+        }
+        else
+        {
+            ret = m_cAPI.ResManWriteToFile(
+                sModifiedFileName.CStr(), m_nResTypeDebug,
+                (const uint8_t*) m_pchDebuggerCode, m_nDebuggerCodeLength, false);
+        }
 
         if (ret != 0)
         {
@@ -6999,6 +7199,74 @@ char *CScriptCompiler::EmitInstruction(uint8_t nOpCode, uint8_t nAuxCode, int32_
 	return ret;
 }
 
+// Called at the end of an if/while/do-while/?: condition. If the condition
+// folded to an integer constant, its CONSTI was the last instruction emitted
+// (and, being a single instruction, no jump lands after it): take it back out,
+// and let EmitConditionalJump() know what the condition evaluates to.
+void CScriptCompiler::FoldConstantCondition(CScriptParseTreeNode *pNode)
+{
+	m_nFoldedConditionLocation = -1;
+
+	if (!(m_nOptimizationFlags & CSCRIPTCOMPILER_OPTIMIZE_FOLD_CONSTANTS))
+		return;
+
+	// Skip the (code-less) expression wrappers down to the constant.
+	CScriptParseTreeNode *pCondition = pNode->pLeft;
+	while (pCondition != NULL && pCondition->pRight == NULL &&
+	       (pCondition->nOperation == CSCRIPTCOMPILER_OPERATION_INTEGER_EXPRESSION ||
+	        pCondition->nOperation == CSCRIPTCOMPILER_OPERATION_NON_VOID_EXPRESSION))
+	{
+		pCondition = pCondition->pLeft;
+	}
+	if (pCondition == NULL || pCondition->nOperation != CSCRIPTCOMPILER_OPERATION_CONSTANT_INTEGER)
+		return;
+
+	if (m_aOutputCodeInstructionBoundaries.size() < 2 ||
+	    m_aOutputCodeInstructionBoundaries.back() != m_nOutputCodeLength)
+	{
+		return;
+	}
+
+	char pchValue[4];
+	WriteByteSwap32(pchValue, pCondition->nIntegerData);
+
+	char *last = InstructionLookback(1);
+	if (m_nOutputCodeLength - (int32_t) (last - m_pchOutputCode) != CVIRTUALMACHINE_OPERATION_BASE_SIZE + 4 ||
+	    last[CVIRTUALMACHINE_OPCODE_LOCATION] != CVIRTUALMACHINE_OPCODE_CONSTANT ||
+	    last[CVIRTUALMACHINE_AUXCODE_LOCATION] != CVIRTUALMACHINE_AUXCODE_TYPE_INTEGER ||
+	    memcmp(&last[CVIRTUALMACHINE_EXTRA_DATA_LOCATION], pchValue, 4) != 0)
+	{
+		return;
+	}
+
+	m_nOutputCodeLength = (int32_t) (last - m_pchOutputCode);
+	m_aOutputCodeInstructionBoundaries.pop_back();
+
+	m_nFoldedConditionLocation = m_nOutputCodeLength;
+	m_bFoldedConditionValue = (pCondition->nIntegerData != 0);
+}
+
+// Emits the jump that skips the code guarded by the condition just generated,
+// with its offset left for the caller to fill in (the returned pointer). A JZ,
+// unless the condition was folded: FALSE always jumps, so a JMP, and TRUE never
+// does, so nothing at all is emitted and NULL returned.
+char *CScriptCompiler::EmitConditionalJump()
+{
+	uint8_t nOpCode = CVIRTUALMACHINE_OPCODE_JZ;
+
+	if (m_nFoldedConditionLocation == m_nOutputCodeLength)
+	{
+		m_nFoldedConditionLocation = -1;
+		if (m_bFoldedConditionValue)
+		{
+			return NULL;
+		}
+		nOpCode = CVIRTUALMACHINE_OPCODE_JMP;
+	}
+
+	return EmitInstruction(nOpCode, 0, 4);
+}
+
 void CScriptCompiler::EmitModifyStackPointer(int32_t nModifyBy)
 {
 	if (m_nOptimizationFlags & CSCRIPTCOMPILER_OPTIMIZE_MELD_INSTRUCTIONS)
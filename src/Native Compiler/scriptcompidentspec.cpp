@@ -105,7 +105,7 @@ int32_t CScriptCompiler::GenerateIdentifierList()
 
 			if (nValue == m_pcIdentifierList[m_nOccupiedIdentifiers-1].m_nParameterSpace)
 			{
-				int nReturnValue = m_pcIdentifierList[m_nOccupiedIdentifiers-1].ExpandParameterSpace();
+				int nReturnValue = m_pcIdentifierList[m_nOccupiedIdentifiers-1].ExpandParameterSpace(m_pPredefinedParameterArena);
 				if (nReturnValue < 0)
 				{
 					return nReturnValue;
@@ -812,9 +812,6 @@ int32_t CScriptCompiler::ParseIdentifierFile()
 
 	char *pScript;
 	uint32_t nScriptLength;
-	uint32_t i;
-	int32_t ch;
-	int32_t chNext;
 
 	int32_t nParseCharacterReturn;
 
@@ -832,68 +829,7 @@ int32_t CScriptCompiler::ParseIdentifierFile()
     pScript = m_pcIncludeFileStack[0].m_sSourceScript.CStr();
     nScriptLength = m_pcIncludeFileStack[0].m_sSourceScript.GetLength();
 
-	if ( nScriptLength < 1 )
-	{
-		ch = -1;
-	}
-	else
-	{
-		ch = pScript[0];
-	}
-
-	if ( nScriptLength < 2 )
-	{
-		chNext = -1;
-	}
-	else
-	{
-		chNext = pScript[1];
-	}
-
-	i = 2;
-
-	while (ch != -1)
-	{
-		nParseCharacterReturn = ParseNextCharacter(ch,chNext, pScript + i, nScriptLength - i);
-		if (nParseCharacterReturn < 0)
-		{
-			m_pcIncludeFileStack[0].m_sSourceScript = "";
-			return PrintParseIdentifierFileError(nParseCharacterReturn);
-		}
-
-		while (nParseCharacterReturn >= 0)
-		{
-			// Process the location of the next character.
-			if (ch == '\n')
-			{
-				++m_nLines;
-				m_nCharacterOnLine = 1;
-			}
-			else
-			{
-				++m_nCharacterOnLine;
-			}
-
-			// Fetch the "next" character and update the status
-			// of the current character that we are looking at.
-			ch = chNext;
-
-			if ( i >= nScriptLength )
-			{
-				chNext = -1;
-			}
-			else
-			{
-				chNext = (unsigned char) pScript[i];
-			}
-
-			--nParseCharacterReturn;
-
-			++i;
-		}
-	}
-
-	nParseCharacterReturn = ParseNextCharacter(-1,-1, nullptr, 0);
+	nParseCharacterReturn = ParseCharacterStream(pScript, (int32_t) nScriptLength);
 
 	m_pcIncludeFileStack[0].m_sSourceScript = "";
 
@@ -0,0 +1,550 @@
+//
+// SPDX-License-Identifier: GPL-3.0
+//
+// This file is part of the NWScript compiler open source release.
+//
+// The initial source release is licensed under GPL-3.0.
+//
+// All subsequent changes you submit are required to be licensed under MIT.
+//
+// However, the project overall will still be GPL-3.0.
+//
+// The intent is for the base game to be able to pick up changes you explicitly
+// submit for inclusion painlessly, while ensuring the overall project source code
+// remains available for everyone.
+//
+
+//::///////////////////////////////////////////////////////////////////////////
+//::
+//::  ScriptCompIncludeCache.cpp
+//::
+//::  Capture of the parse of an include file into a precompiled module, and
+//::  splicing of the module into later compiles (see scriptcompincludecache.h).
+//::
+//::///////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <string.h>
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// external header files
+#include "exobase.h"
+#include "scriptcomp.h"
+
+// internal header files
+#include "scriptinternal.h"
+#include "scriptcompincludecache.h"
+
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+
+//::///////////////////////////////////////////////////////////////////////////
+//::
+//::  class CScriptCompilerIncludeCache
+//::
+//::///////////////////////////////////////////////////////////////////////////
+
+CScriptCompilerIncludeCache::CScriptCompilerIncludeCache(size_t nMaxModules)
+	: m_nMaxModules(nMaxModules), m_nHits(0), m_nMisses(0)
+{
+}
+
+std::shared_ptr<const CScriptCompilerIncludeModule> CScriptCompilerIncludeCache::Find(uint64_t nKey) const
+{
+	std::lock_guard<std::mutex> cGuard(m_cLock);
+
+	auto it = m_aModules.find(nKey);
+	if (it == m_aModules.end())
+	{
+		return nullptr;
+	}
+
+	return it->second;
+}
+
+void CScriptCompilerIncludeCache::Add(uint64_t nKey, std::shared_ptr<const CScriptCompilerIncludeModule> pModule)
+{
+	std::lock_guard<std::mutex> cGuard(m_cLock);
+
+	if (m_aModules.size() >= m_nMaxModules && m_aModules.find(nKey) == m_aModules.end())
+	{
+		m_aModules.clear();
+	}
+
+	m_aModules[nKey] = std::move(pModule);
+}
+
+void CScriptCompilerIncludeCache::Clear()
+{
+	std::lock_guard<std::mutex> cGuard(m_cLock);
+	m_aModules.clear();
+}
+
+size_t CScriptCompilerIncludeCache::GetSize() const
+{
+	std::lock_guard<std::mutex> cGuard(m_cLock);
+	return m_aModules.size();
+}
+
+void CScriptCompilerIncludeCache::RecordLookup(BOOL bHit)
+{
+	if (bHit)
+	{
+		m_nHits.fetch_add(1, std::memory_order_relaxed);
+	}
+	else
+	{
+		m_nMisses.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+uint64_t CScriptCompilerIncludeCache::HashContents(const char *pData, size_t nLength)
+{
+	return XXH64(pData, nLength, 0);
+}
+
+//::///////////////////////////////////////////////////////////////////////////
+//::
+//::  class CScriptCompiler
+//::
+//::///////////////////////////////////////////////////////////////////////////
+
+static void HashUpdateInteger(XXH64_state_t *pState, int32_t nValue)
+{
+	XXH64_update(pState, &nValue, sizeof(nValue));
+}
+
+static void HashUpdateFloat(XXH64_state_t *pState, float fValue)
+{
+	XXH64_update(pState, &fValue, sizeof(fValue));
+}
+
+static void HashUpdateString(XXH64_state_t *pState, const CExoString &sString)
+{
+	int32_t nLength = sString.GetLength();
+	XXH64_update(pState, &nLength, sizeof(nLength));
+	XXH64_update(pState, sString.CStr(), nLength);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  CScriptCompiler::HashIncludeEntryState()
+///////////////////////////////////////////////////////////////////////////////
+//  Description:  Hashes the user defined identifiers below nIdentifiers: the
+//                ones an include file could see (or change) while it was
+//                parsed.
+///////////////////////////////////////////////////////////////////////////////
+
+uint64_t CScriptCompiler::HashIncludeEntryState(int32_t nIdentifiers)
+{
+	XXH64_state_t cState;
+	XXH64_reset(&cState, 0);
+
+	HashUpdateInteger(&cState, nIdentifiers - m_nMaxPredefinedIdentifierId);
+
+	for (int32_t count = m_nMaxPredefinedIdentifierId; count < nIdentifiers; count++)
+	{
+		CScriptCompilerIdListEntry *pEntry = &(m_pcIdentifierList[count]);
+
+		HashUpdateString(&cState, pEntry->m_psIdentifier);
+		HashUpdateInteger(&cState, pEntry->m_nIdentifierType);
+		HashUpdateInteger(&cState, pEntry->m_nReturnType);
+		HashUpdateString(&cState, pEntry->m_psStructureReturnName);
+		HashUpdateInteger(&cState, pEntry->m_bImplementationInPlace);
+		HashUpdateInteger(&cState, pEntry->m_nIntegerData);
+		HashUpdateFloat(&cState, pEntry->m_fFloatData);
+		HashUpdateString(&cState, pEntry->m_psStringData);
+		HashUpdateInteger(&cState, pEntry->m_nParameters);
+		HashUpdateInteger(&cState, pEntry->m_nNonOptionalParameters);
+
+		for (int32_t count2 = 0; count2 < pEntry->m_nParameters; count2++)
+		{
+			HashUpdateInteger(&cState, pEntry->m_pchParameters[count2]);
+			HashUpdateString(&cState, pEntry->m_psStructureParameterNames[count2]);
+		}
+	}
+
+	return XXH64_digest(&cState);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  CScriptCompiler::GetIncludeModuleKey()
+///////////////////////////////////////////////////////////////////////////////
+//  Description:  Identifies the parse of sFileName, included with the
+//                identifiers hashed in nEntryStateHash, at this point of
+//                the compile.
+///////////////////////////////////////////////////////////////////////////////
+
+uint64_t CScriptCompiler::GetIncludeModuleKey(const CExoString &sFileName, uint64_t nEntryStateHash)
+{
+	XXH64_state_t cState;
+	XXH64_reset(&cState, 0);
+
+	HashUpdateString(&cState, sFileName);
+	XXH64_update(&cState, &nEntryStateHash, sizeof(nEntryStateHash));
+
+	// The language definition, and the options.
+	HashUpdateString(&cState, m_sLanguageSource);
+	HashUpdateInteger(&cState, m_nMaxPredefinedIdentifierId);
+	HashUpdateInteger(&cState, (int32_t) m_nOptimizationFlags);
+	HashUpdateInteger(&cState, m_nGenerateDebuggerOutput);
+
+	// The first global variable starts the list.
+	HashUpdateInteger(&cState, m_pGlobalVariableParseTree != NULL);
+
+	// The file references of the nodes.
+	HashUpdateInteger(&cState, m_nNextParseTreeFileName);
+	HashUpdateInteger(&cState, m_nCurrentParseTreeFileName);
+	for (int32_t count = 0; count < m_nNextParseTreeFileName; count++)
+	{
+		HashUpdateString(&cState, *(m_ppsParseTreeFileNames[count]));
+	}
+
+	return XXH64_digest(&cState);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  CScriptCompiler::ValidateIncludeModule()
+///////////////////////////////////////////////////////////////////////////////
+//  Description:  Checks that a module can take the place of parsing its
+//                include file here: the files it was built from are
+//                unchanged, and parsing them would not have failed (on
+//                recursion, include depth or a full table).
+///////////////////////////////////////////////////////////////////////////////
+
+BOOL CScriptCompiler::ValidateIncludeModule(const CScriptCompilerIncludeModule *pModule)
+{
+	if (m_nNextParseTreeFileName + (int32_t) pModule->m_aFileNames.size() > CSCRIPTCOMPILER_MAX_TABLE_FILENAMES ||
+	        m_nOccupiedIdentifiers + (int32_t) pModule->m_aIdentifiers.size() > CSCRIPTCOMPILER_MAX_IDENTIFIERS)
+	{
+		return FALSE;
+	}
+
+	for (const CScriptCompilerLoadedIncludeFile &cFile : pModule->m_aLoadedFiles)
+	{
+		if (m_nCompileFileLevel + cFile.m_nCompileFileLevel >= CSCRIPTCOMPILER_MAX_INCLUDE_LEVELS)
+		{
+			return FALSE;
+		}
+
+		for (int32_t count = 0; count < m_nCompileFileLevel; count++)
+		{
+			if (m_pcIncludeFileStack[count].m_sCompiledScriptName == cFile.m_sFileName)
+			{
+				return FALSE;
+			}
+		}
+
+		const char *sSource = m_cAPI.ResManLoadScriptSourceFile(cFile.m_sFileName.CStr(), m_nResTypeSource);
+		if (sSource == NULL ||
+		        CScriptCompilerIncludeCache::HashContents(sSource, strlen(sSource)) != cFile.m_nContentHash)
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  CScriptCompiler::SpliceIncludeModule()
+///////////////////////////////////////////////////////////////////////////////
+//  Description:  Adds the file names, identifiers and global variables of
+//                a module, and returns a copy of its functional units (as
+//                the parse of the include file would have).
+///////////////////////////////////////////////////////////////////////////////
+
+CScriptParseTreeNode *CScriptCompiler::SpliceIncludeModule(const CScriptCompilerIncludeModule *pModule)
+{
+	for (const CExoString &sFileName : pModule->m_aFileNames)
+	{
+		m_ppsParseTreeFileNames[m_nNextParseTreeFileName] = new CExoString(sFileName);
+		++m_nNextParseTreeFileName;
+	}
+	m_nCurrentParseTreeFileName = pModule->m_nCurrentParseTreeFileName;
+
+	// The identifiers, and the entry past them (where the last declaration
+	// that didn't add an identifier was built).
+	int32_t nIdentifiers = (int32_t) pModule->m_aIdentifiers.size() - 1;
+
+	for (int32_t count = 0; count <= nIdentifiers; count++)
+	{
+		const CScriptCompilerIncludeModule::Identifier &cIdentifier = pModule->m_aIdentifiers[count];
+		CScriptCompilerIdListEntry *pEntry = &(m_pcIdentifierList[m_nOccupiedIdentifiers + count]);
+
+		pEntry->m_psIdentifier = cIdentifier.sIdentifier;
+		pEntry->m_nIdentifierHash = HashString(cIdentifier.sIdentifier);
+		pEntry->m_nIdentifierLength = cIdentifier.sIdentifier.GetLength();
+		pEntry->m_nIdentifierType = cIdentifier.nIdentifierType;
+		pEntry->m_nReturnType = cIdentifier.nReturnType;
+		pEntry->m_nIdIdentifier = cIdentifier.nIdIdentifier;
+		pEntry->m_nParameters = cIdentifier.nParameters;
+		pEntry->m_nNonOptionalParameters = cIdentifier.nNonOptionalParameters;
+		pEntry->m_bImplementationInPlace = cIdentifier.bImplementationInPlace;
+		pEntry->m_nIntegerData = cIdentifier.nIntegerData;
+		pEntry->m_fFloatData = cIdentifier.fFloatData;
+		pEntry->m_fVectorData[0] = cIdentifier.fVectorData[0];
+		pEntry->m_fVectorData[1] = cIdentifier.fVectorData[1];
+		pEntry->m_fVectorData[2] = cIdentifier.fVectorData[2];
+		pEntry->m_psStringData = cIdentifier.sStringData;
+		pEntry->m_psStructureReturnName = cIdentifier.sStructureReturnName;
+		pEntry->m_nBinarySourceStart = cIdentifier.nBinarySourceStart;
+		pEntry->m_nBinarySourceFinish = cIdentifier.nBinarySourceFinish;
+		pEntry->m_nBinaryDestinationStart = cIdentifier.nBinaryDestinationStart;
+		pEntry->m_nBinaryDestinationFinish = cIdentifier.nBinaryDestinationFinish;
+
+		if (cIdentifier.nParameterSpace > 0)
+		{
+			pEntry->ExpandParameterSpace(m_pUserParameterArena, cIdentifier.nParameterSpace);
+
+			for (int32_t count2 = 0; count2 < cIdentifier.nParameterSpace; count2++)
+			{
+				pEntry->m_pchParameters[count2]                   = cIdentifier.aParameters[count2];
+				pEntry->m_psStructureParameterNames[count2]       = cIdentifier.aStructureParameterNames[count2];
+				pEntry->m_pbOptionalParameters[count2]            = cIdentifier.aOptionalParameters[count2];
+				pEntry->m_pnOptionalParameterIntegerData[count2]  = cIdentifier.aOptionalParameterIntegerData[count2];
+				pEntry->m_pfOptionalParameterFloatData[count2]    = cIdentifier.aOptionalParameterFloatData[count2];
+				pEntry->m_psOptionalParameterStringData[count2]   = cIdentifier.aOptionalParameterStringData[count2];
+				pEntry->m_poidOptionalParameterObjectData[count2] = cIdentifier.aOptionalParameterObjectData[count2];
+			}
+			for (int32_t count2 = 0; count2 < cIdentifier.nParameterSpace * 3; count2++)
+			{
+				pEntry->m_pfOptionalParameterVectorData[count2]   = cIdentifier.aOptionalParameterVectorData[count2];
+			}
+		}
+
+		if (count < nIdentifiers)
+		{
+			HashManagerAdd(CSCRIPTCOMPILER_HASH_MANAGER_TYPE_IDENTIFIER, m_nOccupiedIdentifiers + count);
+		}
+	}
+	m_nOccupiedIdentifiers += nIdentifiers;
+
+	// The files, for the modules of the includes around this one.
+	for (const CScriptCompilerLoadedIncludeFile &cFile : pModule->m_aLoadedFiles)
+	{
+		CScriptCompilerLoadedIncludeFile cLoadedFile = cFile;
+		cLoadedFile.m_nCompileFileLevel += m_nCompileFileLevel;
+		m_aIncludeFilesLoaded.push_back(cLoadedFile);
+	}
+
+	// And the parse trees.
+	std::vector<CScriptParseTreeNode *> apNodes(pModule->m_aNodes.size());
+	for (size_t count = 0; count < apNodes.size(); count++)
+	{
+		apNodes[count] = GetNewScriptParseTreeNode();
+	}
+
+	for (size_t count = 0; count < apNodes.size(); count++)
+	{
+		const CScriptCompilerIncludeModule::Node &cNode = pModule->m_aNodes[count];
+		CScriptParseTreeNode *pNode = apNodes[count];
+
+		pNode->nOperation       = cNode.nOperation;
+		pNode->nIntegerData     = cNode.nIntegerData;
+		pNode->nIntegerData2    = cNode.nIntegerData2;
+		pNode->nIntegerData3    = cNode.nIntegerData3;
+		pNode->nIntegerData4    = cNode.nIntegerData4;
+		pNode->fFloatData       = cNode.fFloatData;
+		pNode->fVectorData[0]   = cNode.fVectorData[0];
+		pNode->fVectorData[1]   = cNode.fVectorData[1];
+		pNode->fVectorData[2]   = cNode.fVectorData[2];
+		pNode->m_nFileReference = cNode.nFileReference;
+		pNode->nLine            = cNode.nLine;
+		pNode->nChar            = cNode.nChar;
+		pNode->nType            = cNode.nType;
+		pNode->m_nStackPointer  = cNode.nStackPointer;
+		pNode->pLeft            = cNode.nLeft >= 0 ? apNodes[cNode.nLeft] : NULL;
+		pNode->pRight           = cNode.nRight >= 0 ? apNodes[cNode.nRight] : NULL;
+		pNode->m_psStringData   = cNode.nStringData >= 0 ? new CExoString(pModule->m_aStrings[cNode.nStringData]) : NULL;
+		pNode->m_psTypeName     = cNode.nTypeName >= 0 ? new CExoString(pModule->m_aStrings[cNode.nTypeName]) : NULL;
+	}
+
+	if (pModule->m_nGlobalVariables >= 0)
+	{
+		if (m_pGlobalVariableParseTree == NULL)
+		{
+			m_pGlobalVariableParseTree = apNodes[pModule->m_nGlobalVariables];
+		}
+		else
+		{
+			CScriptParseTreeNode *pFindLastStatement = m_pGlobalVariableParseTree;
+			while (pFindLastStatement->pRight != NULL)
+			{
+				pFindLastStatement = pFindLastStatement->pRight;
+			}
+			pFindLastStatement->pRight = apNodes[pModule->m_nGlobalVariables];
+		}
+	}
+
+	return pModule->m_nFunctionalUnits >= 0 ? apNodes[pModule->m_nFunctionalUnits] : NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  CScriptCompiler::CaptureIncludeModule()
+///////////////////////////////////////////////////////////////////////////////
+//  Description:  Called with the functional units of the include file that
+//                was parsed last (once the parser has come back to the
+//                file that included it).  Stores them, and everything the
+//                include added, as a module.
+///////////////////////////////////////////////////////////////////////////////
+
+void CScriptCompiler::CaptureIncludeModule(CScriptParseTreeNode *pFunctionalUnits)
+{
+	if (m_aIncludeCaptures.empty())
+	{
+		return;
+	}
+
+	CScriptCompilerIncludeCapture cCapture = m_aIncludeCaptures.back();
+	m_aIncludeCaptures.pop_back();
+
+	// Spliced from a module already, or parsed in a way a module can't
+	// reproduce: the include ended inside the grammar of the file around it,
+	// changed an identifier that was there before it, or had errors the
+	// parse went on past.
+	if (cCapture.m_bCapture == FALSE ||
+	        cCapture.m_nCompileFileLevel != m_nCompileFileLevel ||
+	        cCapture.m_nFirstDiagnostic != m_aDiagnostics.size() ||
+	        m_nOccupiedIdentifiers >= CSCRIPTCOMPILER_MAX_IDENTIFIERS ||
+	        HashIncludeEntryState(cCapture.m_nFirstIdentifier) != cCapture.m_nEntryStateHash)
+	{
+		return;
+	}
+
+	std::shared_ptr<CScriptCompilerIncludeModule> pModule = std::make_shared<CScriptCompilerIncludeModule>();
+
+	for (int32_t count = cCapture.m_nFirstFileName; count < m_nNextParseTreeFileName; count++)
+	{
+		pModule->m_aFileNames.push_back(*(m_ppsParseTreeFileNames[count]));
+	}
+	pModule->m_nCurrentParseTreeFileName = m_nCurrentParseTreeFileName;
+
+	for (size_t count = cCapture.m_nFirstLoadedFile; count < m_aIncludeFilesLoaded.size(); count++)
+	{
+		CScriptCompilerLoadedIncludeFile cLoadedFile = m_aIncludeFilesLoaded[count];
+		cLoadedFile.m_nCompileFileLevel -= cCapture.m_nCompileFileLevel;
+		pModule->m_aLoadedFiles.push_back(cLoadedFile);
+	}
+
+	for (int32_t count = cCapture.m_nFirstIdentifier; count <= m_nOccupiedIdentifiers; count++)
+	{
+		CScriptCompilerIdListEntry *pEntry = &(m_pcIdentifierList[count]);
+		CScriptCompilerIncludeModule::Identifier cIdentifier;
+
+		cIdentifier.sIdentifier = pEntry->m_psIdentifier;
+		cIdentifier.nIdentifierType = pEntry->m_nIdentifierType;
+		cIdentifier.nReturnType = pEntry->m_nReturnType;
+		cIdentifier.nIdIdentifier = pEntry->m_nIdIdentifier;
+		cIdentifier.nParameters = pEntry->m_nParameters;
+		cIdentifier.nNonOptionalParameters = pEntry->m_nNonOptionalParameters;
+		cIdentifier.bImplementationInPlace = pEntry->m_bImplementationInPlace;
+		cIdentifier.nIntegerData = pEntry->m_nIntegerData;
+		cIdentifier.fFloatData = pEntry->m_fFloatData;
+		cIdentifier.fVectorData[0] = pEntry->m_fVectorData[0];
+		cIdentifier.fVectorData[1] = pEntry->m_fVectorData[1];
+		cIdentifier.fVectorData[2] = pEntry->m_fVectorData[2];
+		cIdentifier.sStringData = pEntry->m_psStringData;
+		cIdentifier.sStructureReturnName = pEntry->m_psStructureReturnName;
+		cIdentifier.nBinarySourceStart = pEntry->m_nBinarySourceStart;
+		cIdentifier.nBinarySourceFinish = pEntry->m_nBinarySourceFinish;
+		cIdentifier.nBinaryDestinationStart = pEntry->m_nBinaryDestinationStart;
+		cIdentifier.nBinaryDestinationFinish = pEntry->m_nBinaryDestinationFinish;
+
+		int32_t nSpace = pEntry->m_nParameterSpace;
+		cIdentifier.nParameterSpace = nSpace;
+		if (nSpace > 0)
+		{
+			cIdentifier.aParameters.assign(pEntry->m_pchParameters, pEntry->m_pchParameters + nSpace);
+			cIdentifier.aStructureParameterNames.assign(pEntry->m_psStructureParameterNames, pEntry->m_psStructureParameterNames + nSpace);
+			cIdentifier.aOptionalParameters.assign(pEntry->m_pbOptionalParameters, pEntry->m_pbOptionalParameters + nSpace);
+			cIdentifier.aOptionalParameterIntegerData.assign(pEntry->m_pnOptionalParameterIntegerData, pEntry->m_pnOptionalParameterIntegerData + nSpace);
+			cIdentifier.aOptionalParameterFloatData.assign(pEntry->m_pfOptionalParameterFloatData, pEntry->m_pfOptionalParameterFloatData + nSpace);
+			cIdentifier.aOptionalParameterStringData.assign(pEntry->m_psOptionalParameterStringData, pEntry->m_psOptionalParameterStringData + nSpace);
+			cIdentifier.aOptionalParameterObjectData.assign(pEntry->m_poidOptionalParameterObjectData, pEntry->m_poidOptionalParameterObjectData + nSpace);
+			cIdentifier.aOptionalParameterVectorData.assign(pEntry->m_pfOptionalParameterVectorData, pEntry->m_pfOptionalParameterVectorData + nSpace * 3);
+		}
+
+		pModule->m_aIdentifiers.push_back(cIdentifier);
+	}
+
+	// The parse trees: the functional units, and the global variable
+	// statements the include added to the list (all of it, if the include
+	// started the list).
+	CScriptParseTreeNode *pGlobalVariables = m_pGlobalVariableParseTree;
+	if (cCapture.m_pLastGlobalVariable != NULL)
+	{
+		pGlobalVariables = cCapture.m_pLastGlobalVariable->pRight;
+	}
+
+	{
+		std::unordered_map<const CScriptParseTreeNode *, int32_t> aNodeIndices;
+		std::vector<const CScriptParseTreeNode *> apPending;
+
+		auto GetNodeIndex = [&](const CScriptParseTreeNode *pNode) -> int32_t
+		{
+			if (pNode == NULL)
+			{
+				return -1;
+			}
+
+			auto it = aNodeIndices.find(pNode);
+			if (it != aNodeIndices.end())
+			{
+				return it->second;
+			}
+
+			int32_t nIndex = (int32_t) pModule->m_aNodes.size();
+			pModule->m_aNodes.emplace_back();
+			aNodeIndices.emplace(pNode, nIndex);
+			apPending.push_back(pNode);
+			return nIndex;
+		};
+
+		auto GetStringIndex = [&](const CExoString *psString) -> int32_t
+		{
+			if (psString == NULL)
+			{
+				return -1;
+			}
+
+			pModule->m_aStrings.push_back(*psString);
+			return (int32_t) pModule->m_aStrings.size() - 1;
+		};
+
+		pModule->m_nFunctionalUnits = GetNodeIndex(pFunctionalUnits);
+		pModule->m_nGlobalVariables = GetNodeIndex(pGlobalVariables);
+
+		while (!apPending.empty())
+		{
+			const CScriptParseTreeNode *pNode = apPending.back();
+			apPending.pop_back();
+
+			CScriptCompilerIncludeModule::Node cNode;
+			cNode.nOperation     = pNode->nOperation;
+			cNode.nIntegerData   = pNode->nIntegerData;
+			cNode.nIntegerData2  = pNode->nIntegerData2;
+			cNode.nIntegerData3  = pNode->nIntegerData3;
+			cNode.nIntegerData4  = pNode->nIntegerData4;
+			cNode.fFloatData     = pNode->fFloatData;
+			cNode.fVectorData[0] = pNode->fVectorData[0];
+			cNode.fVectorData[1] = pNode->fVectorData[1];
+			cNode.fVectorData[2] = pNode->fVectorData[2];
+			cNode.nFileReference = pNode->m_nFileReference;
+			cNode.nLine          = pNode->nLine;
+			cNode.nChar          = pNode->nChar;
+			cNode.nType          = pNode->nType;
+			cNode.nStackPointer  = pNode->m_nStackPointer;
+			cNode.nStringData    = GetStringIndex(pNode->m_psStringData);
+			cNode.nTypeName      = GetStringIndex(pNode->m_psTypeName);
+			cNode.nLeft          = GetNodeIndex(pNode->pLeft);
+			cNode.nRight         = GetNodeIndex(pNode->pRight);
+
+			pModule->m_aNodes[aNodeIndices[pNode]] = cNode;
+		}
+	}
+
+	m_pIncludeCache->Add(cCapture.m_nKey, std::move(pModule));
+}
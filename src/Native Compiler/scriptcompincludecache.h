@@ -0,0 +1,153 @@
+//
+// SPDX-License-Identifier: GPL-3.0
+//
+// This file is part of the NWScript compiler open source release.
+//
+// The initial source release is licensed under GPL-3.0.
+//
+// All subsequent changes you submit are required to be licensed under MIT.
+//
+// However, the project overall will still be GPL-3.0.
+//
+// The intent is for the base game to be able to pick up changes you explicitly
+// submit for inclusion painlessly, while ensuring the overall project source code
+// remains available for everyone.
+//
+
+//::///////////////////////////////////////////////////////////////////////////
+//::
+//::  ScriptCompIncludeCache.h
+//::
+//::  Precompiled include modules.
+//::
+//::  The first time a file is included, the functional units, global
+//::  variables, identifiers and file names its parse produced (along with
+//::  those of everything it includes in turn) are captured in a module.
+//::  Later compiles that include the same file in the same state splice a
+//::  copy of the module in, instead of loading, tokenizing and parsing it
+//::  again.
+//::
+//::  A module is keyed on everything the parse of an include depends on: its
+//::  name, the user defined identifiers before it, the parse tree file names,
+//::  whether there are global variables yet and the compiler options.  It is
+//::  only reused once every file it was built from is found to be unchanged
+//::  (by content hash).
+//::
+//::///////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "exobase.h"
+#include "scriptcomp.h"
+
+class CScriptCompilerIncludeModule
+{
+public:
+	// A parse tree node.  Nodes refer to each other, and to their strings, by
+	// index (-1 = NULL).
+	struct Node
+	{
+		int32_t nOperation;
+		int32_t nStringData;
+		int32_t nIntegerData;
+		int32_t nIntegerData2;
+		int32_t nIntegerData3;
+		int32_t nIntegerData4;
+		float   fFloatData;
+		float   fVectorData[3];
+		int32_t nFileReference;
+		int32_t nLine;
+		int32_t nChar;
+		int32_t nLeft;
+		int32_t nRight;
+		int32_t nType;
+		int32_t nTypeName;
+		int32_t nStackPointer;
+	};
+
+	// A user defined identifier (function or constant).  The hash is not kept:
+	// it depends on the compiler instance.
+	struct Identifier
+	{
+		CExoString sIdentifier;
+		int32_t    nIdentifierType;
+		int32_t    nReturnType;
+		int32_t    nIdIdentifier;
+		int32_t    nParameters;
+		int32_t    nNonOptionalParameters;
+		BOOL       bImplementationInPlace;
+		int32_t    nIntegerData;
+		float      fFloatData;
+		float      fVectorData[3];
+		CExoString sStringData;
+		CExoString sStructureReturnName;
+		int32_t    nBinarySourceStart;
+		int32_t    nBinarySourceFinish;
+		int32_t    nBinaryDestinationStart;
+		int32_t    nBinaryDestinationFinish;
+
+		// Parameter arrays (nParameterSpace entries each).
+		int32_t                 nParameterSpace;
+		std::vector<char>       aParameters;
+		std::vector<CExoString> aStructureParameterNames;
+		std::vector<BOOL>       aOptionalParameters;
+		std::vector<int32_t>    aOptionalParameterIntegerData;
+		std::vector<float>      aOptionalParameterFloatData;
+		std::vector<CExoString> aOptionalParameterStringData;
+		std::vector<OBJECT_ID>  aOptionalParameterObjectData;
+		std::vector<float>      aOptionalParameterVectorData;
+	};
+
+	std::vector<Node>       m_aNodes;
+	std::vector<CExoString> m_aStrings;
+	int32_t                 m_nFunctionalUnits;    // First functional unit (-1 = none)
+	int32_t                 m_nGlobalVariables;    // Global variable statements added (-1 = none), or
+	                                               // the whole list when the include started it
+	std::vector<Identifier> m_aIdentifiers;        // Followed by the entry past them
+	std::vector<CExoString> m_aFileNames;          // Parse tree file names added by the include
+	int32_t                 m_nCurrentParseTreeFileName;
+
+	// Every file that was loaded, with levels relative to the include itself.
+	std::vector<CScriptCompilerLoadedIncludeFile> m_aLoadedFiles;
+};
+
+// Modules shared by any number of compilers (and threads).  Modules are
+// immutable once added.
+class CScriptCompilerIncludeCache
+{
+public:
+	explicit CScriptCompilerIncludeCache(size_t nMaxModules = 4096);
+
+	CScriptCompilerIncludeCache(const CScriptCompilerIncludeCache &) = delete;
+	CScriptCompilerIncludeCache &operator=(const CScriptCompilerIncludeCache &) = delete;
+
+	std::shared_ptr<const CScriptCompilerIncludeModule> Find(uint64_t nKey) const;
+
+	// Replaces any module with the same key.  The cache starts over once it
+	// holds nMaxModules.
+	void Add(uint64_t nKey, std::shared_ptr<const CScriptCompilerIncludeModule> pModule);
+
+	void Clear();
+	size_t GetSize() const;
+
+	// Lookups of the compilers: hits were spliced in, misses were parsed.
+	void RecordLookup(BOOL bHit);
+	uint64_t GetHits() const   { return m_nHits.load(std::memory_order_relaxed); }
+	uint64_t GetMisses() const { return m_nMisses.load(std::memory_order_relaxed); }
+
+	static uint64_t HashContents(const char *pData, size_t nLength);
+
+private:
+	size_t m_nMaxModules;
+	std::unordered_map<uint64_t, std::shared_ptr<const CScriptCompilerIncludeModule>> m_aModules;
+	mutable std::mutex m_cLock;
+
+	std::atomic<uint64_t> m_nHits;
+	std::atomic<uint64_t> m_nMisses;
+};
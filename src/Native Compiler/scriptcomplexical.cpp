@@ -54,6 +54,42 @@
 // internal header files
 #include "scriptinternal.h"
 
+// Character classes, for the runs of characters that are consumed without
+// going through ParseNextCharacter() (see ParseCharacterRun()).
+#define CSCRIPTCOMPILER_CHARACTER_BLANK          0x01
+#define CSCRIPTCOMPILER_CHARACTER_ALPHABET       0x02
+#define CSCRIPTCOMPILER_CHARACTER_NUMERIC        0x04
+#define CSCRIPTCOMPILER_CHARACTER_STRING_SPECIAL 0x08
+
+struct CScriptCompilerCharacterClasses
+{
+	uint8_t m_nClass[256];
+
+	constexpr CScriptCompilerCharacterClasses() : m_nClass()
+	{
+		m_nClass[(uint8_t) ' ']  = CSCRIPTCOMPILER_CHARACTER_BLANK;
+		m_nClass[(uint8_t) '\t'] = CSCRIPTCOMPILER_CHARACTER_BLANK;
+		m_nClass[(uint8_t) '\r'] = CSCRIPTCOMPILER_CHARACTER_BLANK;
+		m_nClass[(uint8_t) '\n'] = CSCRIPTCOMPILER_CHARACTER_BLANK | CSCRIPTCOMPILER_CHARACTER_STRING_SPECIAL;
+		m_nClass[(uint8_t) '"']  = CSCRIPTCOMPILER_CHARACTER_STRING_SPECIAL;
+		m_nClass[(uint8_t) '\\'] = CSCRIPTCOMPILER_CHARACTER_STRING_SPECIAL;
+		m_nClass[(uint8_t) '_']  = CSCRIPTCOMPILER_CHARACTER_ALPHABET;
+
+		for (int32_t ch = 'a'; ch <= 'z'; ch++)
+		{
+			m_nClass[ch] = CSCRIPTCOMPILER_CHARACTER_ALPHABET;
+			m_nClass[ch - 'a' + 'A'] = CSCRIPTCOMPILER_CHARACTER_ALPHABET;
+		}
+
+		for (int32_t ch = '0'; ch <= '9'; ch++)
+		{
+			m_nClass[ch] = CSCRIPTCOMPILER_CHARACTER_NUMERIC;
+		}
+	}
+};
+
+static constexpr CScriptCompilerCharacterClasses g_cCharacterClasses;
+
 //::///////////////////////////////////////////////////////////////////////////
 //::
 //::  Class CScriptCompiler
@@ -78,6 +114,12 @@ float CScriptCompiler::ParseFloatFromTokenString()
 	float fDecimalConstant = 1.0f;
 	float fSign = 1.0f;
 
+	// A float constant substituted by TestIdentifierToken().
+	if (m_nTokenConstantIdentifier >= 0)
+	{
+		return m_pcIdentifierList[m_nTokenConstantIdentifier].m_fFloatData;
+	}
+
 	for (int32_t nCount = 0; nCount < m_nTokenCharacters; nCount++)
 	{
 		if (m_pchToken[nCount] == '-' && nCount == 0)
@@ -139,7 +181,8 @@ int32_t CScriptCompiler::ParseCharacterNumeric(int32_t ch)
 	{
 		m_pchToken[m_nTokenCharacters] = (char) ch;
 		++m_nTokenCharacters;
-		if (m_nTokenCharacters > CSCRIPTCOMPILER_MAX_TOKEN_LENGTH)
+		// The token is terminated in place: it can't fill the whole buffer.
+		if (m_nTokenCharacters >= CSCRIPTCOMPILER_MAX_TOKEN_LENGTH)
 		{
 			return STRREF_CSCRIPTCOMPILER_ERROR_TOKEN_TOO_LONG;
 		}
@@ -588,6 +631,10 @@ int32_t CScriptCompiler::ParseStringCharacter(int32_t ch, int32_t chNext, char *
 			    char* ptr = nullptr;
 			    // can never be >byte, we only parse two bytes
 			    m_pchToken[m_nTokenCharacters++] = (char) strtol(hex, &ptr, 16);
+			    if (m_nTokenCharacters >= CSCRIPTCOMPILER_MAX_TOKEN_LENGTH)
+			    {
+			        return STRREF_CSCRIPTCOMPILER_ERROR_TOKEN_TOO_LONG;
+			    }
 			    return 3; // eat "xXX"
 			}
 			else
@@ -1420,13 +1467,38 @@ int32_t CScriptCompiler::HandleToken()
 	// Do something with the token.
 	int32_t nReturnValue;
 
+	if (m_pTokenTrace != NULL)
+	{
+		CScriptCompilerToken cToken;
+		cToken.m_nTokenStatus = m_nTokenStatus;
+		cToken.m_sToken = CExoString(m_pchToken, m_nTokenCharacters);
+		cToken.m_nLine = m_nLines;
+		cToken.m_nCharacterOnLine = m_nCharacterOnLine;
+		m_pTokenTrace->push_back(cToken);
+	}
+
 	if (m_bCompileIdentifierList == TRUE)
 	{
 		nReturnValue = GenerateIdentifierList();
 	}
+	else if (m_nRecoverySkipMode != CSCRIPTCOMPILER_RECOVERY_SKIP_NONE && SkipTokenDuringRecovery() == TRUE)
+	{
+		nReturnValue = 0;
+	}
 	else
 	{
 		nReturnValue = GenerateParseTree();
+
+		// Going on past an error (see SetMaxErrors()): the token may be the
+		// end of the statement already.
+		while (nReturnValue < 0 && RecoverFromParseError(nReturnValue) == TRUE)
+		{
+			nReturnValue = 0;
+			if (SkipTokenDuringRecovery() == FALSE)
+			{
+				nReturnValue = GenerateParseTree();
+			}
+		}
 	}
 
 	if (m_nNextParseTreeFileName >= CSCRIPTCOMPILER_MAX_TABLE_FILENAMES)
@@ -1459,10 +1531,10 @@ int32_t CScriptCompiler::TestIdentifierToken()
 
 	char cTemp = m_pchToken[m_nTokenCharacters];
 	m_pchToken[m_nTokenCharacters] = 0;
-	int32_t nHashLocation = GetHashEntryByName(m_pchToken);
+	const CScriptCompilerIdentifierHashTableEntry *pHashEntry = GetHashEntryByName(m_pchToken);
 	m_pchToken[m_nTokenCharacters] = cTemp;
 
-	if (nHashLocation == STRREF_CSCRIPTCOMPILER_ERROR_UNDEFINED_IDENTIFIER)
+	if (pHashEntry == NULL)
 	{
 		if (m_pchToken[0] == '#')
 		{
@@ -1473,8 +1545,8 @@ int32_t CScriptCompiler::TestIdentifierToken()
 		return 0;
 	}
 
-	int32_t nIdentifierType = m_pIdentifierHashTable[nHashLocation].m_nIdentifierType;
-	int32_t nIdentifierIndex = m_pIdentifierHashTable[nHashLocation].m_nIdentifierIndex;
+	int32_t nIdentifierType = pHashEntry->m_nIdentifierType;
+	int32_t nIdentifierIndex = pHashEntry->m_nIdentifierIndex;
 
 	if (nIdentifierType == CSCRIPTCOMPILER_HASH_MANAGER_TYPE_IDENTIFIER)
 	{
@@ -1493,6 +1565,8 @@ int32_t CScriptCompiler::TestIdentifierToken()
 			else if (m_pcIdentifierList[nIdentifierIndex].m_nReturnType == CSCRIPTCOMPILER_TOKEN_FLOAT_IDENTIFIER)
 			{
 				m_nTokenStatus = CSCRIPTCOMPILER_TOKEN_FLOAT;
+				// The text below is only printed with six decimals: keep the exact value at hand.
+				m_nTokenConstantIdentifier = nIdentifierIndex;
 			}
 			else if (m_pcIdentifierList[nIdentifierIndex].m_nReturnType == CSCRIPTCOMPILER_TOKEN_STRING_IDENTIFIER)
 			{
@@ -1660,115 +1734,350 @@ int32_t CScriptCompiler::ParseNextCharacter(int32_t ch, int32_t chNext, char *pS
 		}
 	}
 
-	if (ch == '/')
+	// Everything else is dispatched on the character itself.
+	switch (ch)
 	{
+	case '/':
 		return ParseCharacterSlash(chNext);
-	}
-	else if (ch == '*')
-	{
+	case '*':
 		return ParseCharacterAsterisk(chNext);
-	}
-	else if (ch == '&')
-	{
+	case '&':
 		return ParseCharacterAmpersand(chNext);
-	}
-	else if (ch == '|')
-	{
+	case '|':
 		return ParseCharacterVerticalBar(chNext);
-	}
 
 	// Toss out blank space.
-	if (ch == ' ' || ch == '\n' || ch == '\t')
-	{
+	case ' ':
+	case '\n':
+	case '\t':
 		return 0;
-	}
 
-	if (ch == '"')
-	{
+	case '"':
 		return ParseCharacterQuotationMark();
-	}
-	if (ch == '-')
-	{
+	case '-':
 		return ParseCharacterHyphen(chNext);
-	}
-	if (ch == '{')
-	{
+	case '{':
 		return ParseCharacterLeftBrace();
-	}
-	if (ch == '}')
-	{
+	case '}':
 		return ParseCharacterRightBrace();
-	}
-	if (ch == '(')
-	{
+	case '(':
 		return ParseCharacterLeftBracket();
-	}
-	if (ch == ')')
-	{
+	case ')':
 		return ParseCharacterRightBracket();
-	}
-
-	if (ch == '[')
-	{
+	case '[':
 		return ParseCharacterLeftSquareBracket();
-	}
-	if (ch == ']')
-	{
+	case ']':
 		return ParseCharacterRightSquareBracket();
-	}
-
-	if (ch == '<')
-	{
+	case '<':
 		return ParseCharacterLeftAngle(chNext);
-	}
-	if (ch == '>')
-	{
+	case '>':
 		return ParseCharacterRightAngle(chNext);
-	}
-	if (ch == '!')
-	{
+	case '!':
 		return ParseCharacterExclamationPoint(chNext);
-	}
-	if (ch == '=')
-	{
+	case '=':
 		return ParseCharacterEqualSign(chNext);
-	}
-	if (ch == '+')
-	{
+	case '+':
 		return ParseCharacterPlusSign(chNext);
-	}
-	if (ch == '%')
-	{
+	case '%':
 		return ParseCharacterPercentSign(chNext);
-	}
-	if (ch == ';')
-	{
+	case ';':
 		return ParseCharacterSemicolon();
+	case ',':
+		return ParseCharacterComma();
+	case '^':
+		return ParseCharacterCarat(chNext);
+	case '~':
+		return ParseCharacterTilde();
+	case '#':
+		return ParseCharacterEllipsis();
+	case '?':
+		return ParseCharacterQuestionMark();
+	case ':':
+		return ParseCharacterColon();
 	}
-	if (ch == ',')
+
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  CScriptCompiler::ParseCharacterRun()
+///////////////////////////////////////////////////////////////////////////////
+//  Description:  Consumes the characters at pScript that only extend (or are
+//                skipped by) the current token: identifier and number
+//                characters, blank space between tokens, and the bodies of
+//                comments and strings.  Each one is handled exactly as
+//                ParseNextCharacter() would, but without dispatching on it.
+//                Returns the number of characters consumed (the line and
+//                character counts are updated for them), or an error.
+///////////////////////////////////////////////////////////////////////////////
+
+int32_t CScriptCompiler::ParseCharacterRun(const char *pScript, int32_t nScriptLength)
+{
+	const uint8_t *pCharacters = (const uint8_t *) pScript;
+	int32_t nRun = 0;
+
+	switch (m_nTokenStatus)
 	{
-		return ParseCharacterComma();
+	case CSCRIPTCOMPILER_TOKEN_UNKNOWN:
+		while (nRun < nScriptLength &&
+		        (g_cCharacterClasses.m_nClass[pCharacters[nRun]] & CSCRIPTCOMPILER_CHARACTER_BLANK))
+		{
+			if (pCharacters[nRun] == '\n')
+			{
+				++m_nLines;
+				m_nCharacterOnLine = 1;
+			}
+			else
+			{
+				++m_nCharacterOnLine;
+			}
+			++nRun;
+		}
+		break;
+
+	case CSCRIPTCOMPILER_TOKEN_IDENTIFIER:
+		while (nRun < nScriptLength)
+		{
+			uint8_t ch = pCharacters[nRun];
+			uint8_t nClass = g_cCharacterClasses.m_nClass[ch];
+
+			// r" starts a raw string, even in the middle of an identifier.
+			if ((nClass & (CSCRIPTCOMPILER_CHARACTER_ALPHABET | CSCRIPTCOMPILER_CHARACTER_NUMERIC)) == 0 ||
+			        ((ch == 'r' || ch == 'R') && nRun + 1 < nScriptLength && pCharacters[nRun + 1] == '"'))
+			{
+				break;
+			}
+
+			m_pchToken[m_nTokenCharacters] = (char) ch;
+			++m_nTokenCharacters;
+			if (m_nTokenCharacters >= CSCRIPTCOMPILER_MAX_TOKEN_LENGTH)
+			{
+				return STRREF_CSCRIPTCOMPILER_ERROR_TOKEN_TOO_LONG;
+			}
+
+			++m_nCharacterOnLine;
+			++nRun;
+		}
+		break;
+
+	case CSCRIPTCOMPILER_TOKEN_INTEGER:
+	case CSCRIPTCOMPILER_TOKEN_HEX_INTEGER:
+	case CSCRIPTCOMPILER_TOKEN_FLOAT:
+		while (nRun < nScriptLength &&
+		        g_cCharacterClasses.m_nClass[pCharacters[nRun]] == CSCRIPTCOMPILER_CHARACTER_NUMERIC)
+		{
+			m_pchToken[m_nTokenCharacters] = (char) pCharacters[nRun];
+			++m_nTokenCharacters;
+			if (m_nTokenCharacters >= CSCRIPTCOMPILER_MAX_TOKEN_LENGTH)
+			{
+				return STRREF_CSCRIPTCOMPILER_ERROR_TOKEN_TOO_LONG;
+			}
+
+			++m_nCharacterOnLine;
+			++nRun;
+		}
+		break;
+
+	case CSCRIPTCOMPILER_TOKEN_CPLUSCOMMENT:
+		// The identifier file keeps its comments (see ParseCommentedOutCharacter()).
+		if (m_bCompileIdentifierList == FALSE)
+		{
+			const void *pNewLine = memchr(pCharacters, '\n', nScriptLength);
+			nRun = pNewLine != NULL ? (int32_t) ((const uint8_t *) pNewLine - pCharacters) : nScriptLength;
+			m_nCharacterOnLine += nRun;
+		}
+		break;
+
+	case CSCRIPTCOMPILER_TOKEN_CCOMMENT:
+		// m_nTokenCharacters is 1 just after an asterisk: the slash that ends
+		// the comment is left to ParseCommentedOutCharacter().
+		while (nRun < nScriptLength)
+		{
+			uint8_t ch = pCharacters[nRun];
+
+			if (ch == '*')
+			{
+				m_nTokenCharacters = 1;
+			}
+			else if (ch == '/')
+			{
+				if (m_nTokenCharacters == 1)
+				{
+					break;
+				}
+			}
+			else
+			{
+				m_nTokenCharacters = 0;
+			}
+
+			if (ch == '\n')
+			{
+				++m_nLines;
+				m_nCharacterOnLine = 1;
+			}
+			else
+			{
+				++m_nCharacterOnLine;
+			}
+			++nRun;
+		}
+		break;
+
+	case CSCRIPTCOMPILER_TOKEN_STRING:
+		while (nRun < nScriptLength &&
+		        (g_cCharacterClasses.m_nClass[pCharacters[nRun]] & CSCRIPTCOMPILER_CHARACTER_STRING_SPECIAL) == 0)
+		{
+			m_pchToken[m_nTokenCharacters] = (char) pCharacters[nRun];
+			++m_nTokenCharacters;
+			if (m_nTokenCharacters >= CSCRIPTCOMPILER_MAX_TOKEN_LENGTH)
+			{
+				return STRREF_CSCRIPTCOMPILER_ERROR_TOKEN_TOO_LONG;
+			}
+
+			++m_nCharacterOnLine;
+			++nRun;
+		}
+		break;
+
+	case CSCRIPTCOMPILER_TOKEN_RAW_STRING:
+		while (nRun < nScriptLength && pCharacters[nRun] != '"')
+		{
+			m_pchToken[m_nTokenCharacters] = (char) pCharacters[nRun];
+			++m_nTokenCharacters;
+			if (m_nTokenCharacters >= CSCRIPTCOMPILER_MAX_TOKEN_LENGTH)
+			{
+				return STRREF_CSCRIPTCOMPILER_ERROR_TOKEN_TOO_LONG;
+			}
+
+			if (pCharacters[nRun] == '\n')
+			{
+				++m_nLines;
+				m_nCharacterOnLine = 1;
+			}
+			else
+			{
+				++m_nCharacterOnLine;
+			}
+			++nRun;
+		}
+		break;
 	}
-	if (ch == '^')
+
+	return nRun;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  CScriptCompiler::ParseCharacterStream()
+///////////////////////////////////////////////////////////////////////////////
+//  Description:  Breaks the string specified in pScript (of length
+//                nScriptLength) into tokens, up to and including the EOF.
+//                Runs of characters are consumed by ParseCharacterRun(), and
+//                the rest one at a time by ParseNextCharacter().
+///////////////////////////////////////////////////////////////////////////////
+
+int32_t CScriptCompiler::ParseCharacterStream(char *pScript, int32_t nScriptLength)
+{
+	int32_t i;                     // location in the string, past chNext
+	int32_t nParseNextCharReturn;  // returned value from ParseNextCharacter
+
+	int32_t ch;       // character at location pScript[i-2]
+	int32_t chNext;   // character at location pScript[i-1]
+
+	///////////////////////////////////////////////
+	//
+	// Initialize with the first two characters.
+	//
+	///////////////////////////////////////////////
+
+	// Unsigned, like the characters after them: a 0xFF byte is not the EOF.
+	if ( nScriptLength < 1 )
 	{
-		return ParseCharacterCarat(chNext);
+		ch = -1;
 	}
-	if (ch == '~')
+	else
 	{
-		return ParseCharacterTilde();
+		ch = (unsigned char) pScript[0];
 	}
-	if (ch == '#')
+
+	if ( nScriptLength < 2 )
 	{
-		return ParseCharacterEllipsis();
+		chNext = -1;
 	}
-	if (ch == '?')
+	else
 	{
-		return ParseCharacterQuestionMark();
+		chNext = (unsigned char) pScript[1];
 	}
-	if (ch == ':')
+
+	i = 2;
+
+	///////////////////////////////////////////////
+	//
+	// Loop through all remaining characters.
+	//
+	///////////////////////////////////////////////
+
+	while (ch != -1)
 	{
-		return ParseCharacterColon();
+		int32_t nRun = m_bCharacterRuns ? ParseCharacterRun(pScript + i - 2, nScriptLength - (i - 2)) : 0;
+
+		if (nRun < 0)
+		{
+			return nRun;
+		}
+
+		if (nRun > 0)
+		{
+			i += nRun;
+			ch = (i - 2 < nScriptLength) ? (unsigned char) pScript[i - 2] : -1;
+			chNext = (i - 1 < nScriptLength) ? (unsigned char) pScript[i - 1] : -1;
+			continue;
+		}
+
+		nParseNextCharReturn = ParseNextCharacter(ch,chNext,pScript + i,nScriptLength - i);
+
+		if (nParseNextCharReturn < 0)
+		{
+			return nParseNextCharReturn;
+		}
+
+		while (nParseNextCharReturn >= 0)
+		{
+			// Process the location of the next character.
+			if (ch == '\n')
+			{
+				++m_nLines;
+				m_nCharacterOnLine = 1;
+			}
+			else
+			{
+				++m_nCharacterOnLine;
+			}
+
+			// Fetch the "next" character and update the status
+			// of the current character that we are looking at.
+			ch = chNext;
+
+			if ( i >= nScriptLength )
+			{
+				chNext = -1;
+			}
+			else
+			{
+				chNext = (unsigned char) pScript[i];
+			}
+
+			--nParseNextCharReturn;
+
+			++i;
+		}
 	}
 
-	return 0;
+	///////////////////////////////////////////////
+	//
+	// Parse an EOF.
+	//
+	///////////////////////////////////////////////
+
+	return ParseNextCharacter(-1,-1, nullptr, 0);
 }
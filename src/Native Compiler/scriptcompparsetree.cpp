@@ -55,6 +55,7 @@
 
 // internal header files
 #include "scriptinternal.h"
+#include "scriptcompincludecache.h"
 
 
 //::///////////////////////////////////////////////////////////////////////////
@@ -75,6 +76,7 @@ void CScriptCompiler::TokenInitialize()
 {
 	m_nTokenStatus = 0; // TOKEN_UNKNOWN;
 	m_nTokenCharacters = 0;
+	m_nTokenConstantIdentifier = -1;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -302,6 +304,21 @@ CScriptParseTreeNode *CScriptCompiler::CreateScriptParseTreeNode(
 
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//  CScriptCompiler::PushTreeWalkEntry()
+///////////////////////////////////////////////////////////////////////////////
+//  Description:  Places a node, not visited yet, on the tree walk stack.
+///////////////////////////////////////////////////////////////////////////////
+
+void CScriptCompiler::PushTreeWalkEntry(CScriptParseTreeNode *pNode, CScriptParseTreeNode **ppCopy)
+{
+	CScriptCompilerTreeWalkEntry cEntry;
+	cEntry.m_pNode  = pNode;
+	cEntry.m_nState = 0;
+	cEntry.m_ppCopy = ppCopy;
+	m_aTreeWalkStack.push_back(cEntry);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //  CScriptCompiler::DuplicateScriptParseTree()
 ///////////////////////////////////////////////////////////////////////////////
@@ -312,41 +329,65 @@ CScriptParseTreeNode *CScriptCompiler::CreateScriptParseTreeNode(
 
 CScriptParseTreeNode *CScriptCompiler::DuplicateScriptParseTree(CScriptParseTreeNode *pNode)
 {
+	CScriptParseTreeNode *pNewTree = NULL;
+
 	if (pNode == NULL)
 	{
 		return NULL;
 	}
 
-	CScriptParseTreeNode *pNewNode = GetNewScriptParseTreeNode();
+	// Each node is copied before its left subtree, and that before its right
+	// subtree.
+	size_t nBase = m_aTreeWalkStack.size();
+	PushTreeWalkEntry(pNode, &pNewTree);
 
-	pNewNode->nOperation     = pNode->nOperation;
-	pNewNode->nIntegerData   = pNode->nIntegerData;
-	pNewNode->nIntegerData2  = pNode->nIntegerData2;
-	pNewNode->fFloatData     = pNode->fFloatData;
-	pNewNode->fVectorData[0] = pNode->fVectorData[0];
-	pNewNode->fVectorData[1] = pNode->fVectorData[1];
-	pNewNode->fVectorData[2] = pNode->fVectorData[2];
-	pNewNode->nLine          = pNode->nLine;
-	pNewNode->nChar          = pNode->nChar;
-	pNewNode->nType          = pNode->nType;
-	pNewNode->m_nStackPointer= pNode->m_nStackPointer;
-	pNewNode->m_nFileReference = pNode->m_nFileReference;
-
-	if (pNode->m_psStringData != NULL)
+	while (m_aTreeWalkStack.size() > nBase)
 	{
-		pNewNode->m_psStringData = new CExoString(pNode->m_psStringData->CStr());
-	}
+		CScriptCompilerTreeWalkEntry cEntry = m_aTreeWalkStack.back();
+		m_aTreeWalkStack.pop_back();
+
+		pNode = cEntry.m_pNode;
+		CScriptParseTreeNode *pNewNode = GetNewScriptParseTreeNode();
+
+		pNewNode->nOperation     = pNode->nOperation;
+		pNewNode->nIntegerData   = pNode->nIntegerData;
+		pNewNode->nIntegerData2  = pNode->nIntegerData2;
+		pNewNode->fFloatData     = pNode->fFloatData;
+		pNewNode->fVectorData[0] = pNode->fVectorData[0];
+		pNewNode->fVectorData[1] = pNode->fVectorData[1];
+		pNewNode->fVectorData[2] = pNode->fVectorData[2];
+		pNewNode->nLine          = pNode->nLine;
+		pNewNode->nChar          = pNode->nChar;
+		pNewNode->nType          = pNode->nType;
+		pNewNode->m_nStackPointer= pNode->m_nStackPointer;
+		pNewNode->m_nFileReference = pNode->m_nFileReference;
+
+		if (pNode->m_psStringData != NULL)
+		{
+			pNewNode->m_psStringData = new CExoString(pNode->m_psStringData->CStr());
+		}
 
 
-	if (pNode->m_psTypeName != NULL)
-	{
-		pNewNode->m_psTypeName   = new CExoString(pNode->m_psTypeName->CStr());
-	}
+		if (pNode->m_psTypeName != NULL)
+		{
+			pNewNode->m_psTypeName   = new CExoString(pNode->m_psTypeName->CStr());
+		}
 
-	pNewNode->pLeft  = DuplicateScriptParseTree(pNode->pLeft);
-	pNewNode->pRight = DuplicateScriptParseTree(pNode->pRight);
+		pNewNode->pLeft  = NULL;
+		pNewNode->pRight = NULL;
+		*(cEntry.m_ppCopy) = pNewNode;
 
-	return pNewNode;
+		if (pNode->pRight != NULL)
+		{
+			PushTreeWalkEntry(pNode->pRight, &(pNewNode->pRight));
+		}
+		if (pNode->pLeft != NULL)
+		{
+			PushTreeWalkEntry(pNode->pLeft, &(pNewNode->pLeft));
+		}
+	}
+
+	return pNewTree;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -3797,6 +3838,44 @@ int32_t CScriptCompiler::GenerateParseTree()
 					// If we have got to here, the file hasn't already been included,
 					// and we should prepare to load it in!
 
+					// ... unless it has been parsed before, in this same state: then
+					// its precompiled module is handed to (3,2) in place of the
+					// functional units the file would have given.
+					if (m_pIncludeCache != NULL)
+					{
+						CScriptCompilerIncludeCapture cCapture;
+						cCapture.m_nEntryStateHash = HashIncludeEntryState(m_nOccupiedIdentifiers);
+						cCapture.m_nKey = GetIncludeModuleKey(sStringToCompile, cCapture.m_nEntryStateHash);
+						cCapture.m_bCapture = TRUE;
+						cCapture.m_nCompileFileLevel = m_nCompileFileLevel;
+						cCapture.m_nFirstIdentifier = m_nOccupiedIdentifiers;
+						cCapture.m_nFirstFileName = m_nNextParseTreeFileName;
+						cCapture.m_nFirstLoadedFile = (int32_t) m_aIncludeFilesLoaded.size();
+						cCapture.m_nFirstDiagnostic = m_aDiagnostics.size();
+						cCapture.m_pLastGlobalVariable = m_pGlobalVariableParseTree;
+						while (cCapture.m_pLastGlobalVariable != NULL && cCapture.m_pLastGlobalVariable->pRight != NULL)
+						{
+							cCapture.m_pLastGlobalVariable = cCapture.m_pLastGlobalVariable->pRight;
+						}
+
+						std::shared_ptr<const CScriptCompilerIncludeModule> pModule = m_pIncludeCache->Find(cCapture.m_nKey);
+						BOOL bSpliceModule = pModule != nullptr && ValidateIncludeModule(pModule.get());
+						m_pIncludeCache->RecordLookup(bSpliceModule);
+
+						if (bSpliceModule == TRUE)
+						{
+							cCapture.m_bCapture = FALSE;
+							m_aIncludeCaptures.push_back(cCapture);
+
+							PushSRStack(CSCRIPTCOMPILER_GRAMMAR_PROGRAM,3,2,pTopStackCurrentNode);
+							ModifySRStackReturnTree(SpliceIncludeModule(pModule.get()));
+							TokenInitialize();
+							return 0;
+						}
+
+						m_aIncludeCaptures.push_back(cCapture);
+					}
+
 					PushSRStack(CSCRIPTCOMPILER_GRAMMAR_PROGRAM,3,2,pTopStackCurrentNode);
 					PushSRStack(CSCRIPTCOMPILER_GRAMMAR_PROGRAM,0,0,pTopStackCurrentNode);
 
@@ -3817,6 +3896,13 @@ int32_t CScriptCompiler::GenerateParseTree()
 				// are all detached from one another to allow the code
 				// for this script to operate correctly.
 
+				// Keep them (and the identifiers the file added) as a
+				// precompiled module, for the next script to include it.
+				if (m_pIncludeCache != NULL)
+				{
+					CaptureIncludeModule(pTopStackReturnNode);
+				}
+
 				CScriptParseTreeNode *pRunnerNode;
 				CScriptParseTreeNode *pNextNode;
 				CScriptParseTreeNode *pLastNode;
@@ -3940,9 +4026,9 @@ int32_t CScriptCompiler::AddUserDefinedIdentifier(CScriptParseTreeNode *pFunctio
 		pNode = pNode->pLeft;
 	}
 
-	while (nTotalParameters > m_pcIdentifierList[m_nOccupiedIdentifiers].m_nParameterSpace)
+	if (nTotalParameters > m_pcIdentifierList[m_nOccupiedIdentifiers].m_nParameterSpace)
 	{
-		int nReturnValue = m_pcIdentifierList[m_nOccupiedIdentifiers].ExpandParameterSpace();
+		int nReturnValue = m_pcIdentifierList[m_nOccupiedIdentifiers].ExpandParameterSpace(m_pUserParameterArena, nTotalParameters);
 		if (nReturnValue < 0)
 		{
 			return nReturnValue;
@@ -4282,13 +4368,13 @@ int32_t CScriptCompiler::AddUserDefinedIdentifier(CScriptParseTreeNode *pFunctio
 	// Check to see if the function is already in the list.  If
 	// it is, then we don't need to do anything about this one.
 
-	int32_t nHashLocation = GetHashEntryByName(m_pcIdentifierList[m_nOccupiedIdentifiers].m_psIdentifier.CStr());
+	const CScriptCompilerIdentifierHashTableEntry *pHashEntry = GetHashEntryByName(m_pcIdentifierList[m_nOccupiedIdentifiers].m_psIdentifier.CStr());
 	BOOL bFoundIdenticalFunction = FALSE;
 
-	if (nHashLocation != STRREF_CSCRIPTCOMPILER_ERROR_UNDEFINED_IDENTIFIER)
+	if (pHashEntry != NULL)
 	{
-		int32_t nIdentifierType = m_pIdentifierHashTable[nHashLocation].m_nIdentifierType;
-		int32_t nIdentifierIndex = m_pIdentifierHashTable[nHashLocation].m_nIdentifierIndex;
+		int32_t nIdentifierType = pHashEntry->m_nIdentifierType;
+		int32_t nIdentifierIndex = pHashEntry->m_nIdentifierIndex;
 
 		if (nIdentifierType == CSCRIPTCOMPILER_HASH_MANAGER_TYPE_IDENTIFIER)
 		{
@@ -4407,15 +4493,13 @@ int32_t CScriptCompiler::AddToGlobalVariableList(CScriptParseTreeNode *pGlobalVa
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-//  CScriptCompiler::PrintParseSourceError()
+//  CScriptCompiler::OutputParseSourceError()
 ///////////////////////////////////////////////////////////////////////////////
-//  Created By: Mark Brockington
-//  Created On: 01/15/2001
-//  Description:  This routine will generate an error log based on the value
-//                passed in.
+//  Description:  Logs the error the parser returned, at the current line of
+//                the file being parsed.
 ///////////////////////////////////////////////////////////////////////////////
 
-int32_t CScriptCompiler::PrintParseSourceError(int32_t nParsingError)
+int32_t CScriptCompiler::OutputParseSourceError(int32_t nParsingError)
 {
 	CExoString strRes = m_cAPI.TlkResolve(-nParsingError);
 
@@ -4433,9 +4517,173 @@ int32_t CScriptCompiler::PrintParseSourceError(int32_t nParsingError)
 
 	OutputError(nParsingError,psFileName,m_nLines,sErrorText);
 
-	nParsingError = STRREF_CSCRIPTCOMPILER_ERROR_ALREADY_PRINTED;
+	return STRREF_CSCRIPTCOMPILER_ERROR_ALREADY_PRINTED;
+}
 
-	return CleanUpDuringCompile(nParsingError);
+///////////////////////////////////////////////////////////////////////////////
+//  CScriptCompiler::PrintParseSourceError()
+///////////////////////////////////////////////////////////////////////////////
+//  Created By: Mark Brockington
+//  Created On: 01/15/2001
+//  Description:  This routine will generate an error log based on the value
+//                passed in.
+///////////////////////////////////////////////////////////////////////////////
+
+int32_t CScriptCompiler::PrintParseSourceError(int32_t nParsingError)
+{
+	return CleanUpDuringCompile(OutputParseSourceError(nParsingError));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  CScriptCompiler::RecoverFromParseError()
+///////////////////////////////////////////////////////////////////////////////
+//  Description:  Called with an error GenerateParseTree() returned for the
+//                current token.  If the compile may report more errors (see
+//                SetMaxErrors()), logs it and sets the parser up to go on:
+//                the statement the error is in becomes an empty one (or,
+//                outside of functions, the functional unit is dropped), and
+//                the tokens up to its end are skipped.  Returns FALSE if the
+//                error has to stop the parse.
+///////////////////////////////////////////////////////////////////////////////
+
+BOOL CScriptCompiler::RecoverFromParseError(int32_t nParsingError)
+{
+	// There is nothing left to resynchronize on at the end of the file, and
+	// an error logged already (from an include) has cleaned up after itself.
+	if (m_nMaxErrors <= 1 ||
+	        (int32_t) m_aDiagnostics.size() + 1 >= m_nMaxErrors ||
+	        nParsingError == STRREF_CSCRIPTCOMPILER_ERROR_ALREADY_PRINTED ||
+	        m_nTokenStatus == CSCRIPTCOMPILER_TOKEN_EOF)
+	{
+		return FALSE;
+	}
+
+	// The statement being parsed sits in a statement list, waiting at (1,1)
+	// for the tree of the statement.  Outside of any statement, the program
+	// is waiting at (1,2) for the functional unit.
+	int32_t nResumeEntry = -1;
+	int32_t nSkipMode = CSCRIPTCOMPILER_RECOVERY_SKIP_NONE;
+	for (int32_t nEntry = m_nSRStackStates; nEntry >= 0 && nResumeEntry < 0; --nEntry)
+	{
+		const CScriptCompilerStackEntry *pEntry = &(m_pSRStack[nEntry]);
+		if (pEntry->nState == CSCRIPTCOMPILER_GRAMMAR_WITHIN_STATEMENT_LIST && pEntry->nRule == 1 && pEntry->nTerm == 1)
+		{
+			nResumeEntry = nEntry;
+			nSkipMode = CSCRIPTCOMPILER_RECOVERY_SKIP_STATEMENT;
+		}
+		else if (pEntry->nState == CSCRIPTCOMPILER_GRAMMAR_PROGRAM && pEntry->nRule == 1 && pEntry->nTerm == 2)
+		{
+			nResumeEntry = nEntry;
+			nSkipMode = CSCRIPTCOMPILER_RECOVERY_SKIP_DECLARATION;
+		}
+	}
+
+	if (nResumeEntry < 0)
+	{
+		return FALSE;
+	}
+
+	// The blocks opened since then have to be closed by the tokens skipped.
+	int32_t nBraces = 0;
+	for (int32_t nEntry = nResumeEntry + 1; nEntry <= m_nSRStackStates; ++nEntry)
+	{
+		const CScriptCompilerStackEntry *pEntry = &(m_pSRStack[nEntry]);
+		if (pEntry->nState == CSCRIPTCOMPILER_GRAMMAR_WITHIN_COMPOUND_STATEMENT ||
+		        (pEntry->nState == CSCRIPTCOMPILER_GRAMMAR_FUNCTIONAL_UNIT && pEntry->nRule == 3 && pEntry->nTerm == 4))
+		{
+			++nBraces;
+		}
+	}
+
+	// The function the statement is dropped from can't be checked for its
+	// return statements any more.
+	if (nSkipMode == CSCRIPTCOMPILER_RECOVERY_SKIP_STATEMENT)
+	{
+		for (int32_t nEntry = nResumeEntry; nEntry >= 0; --nEntry)
+		{
+			const CScriptCompilerStackEntry *pEntry = &(m_pSRStack[nEntry]);
+			if (pEntry->nState == CSCRIPTCOMPILER_GRAMMAR_FUNCTIONAL_UNIT && pEntry->nRule == 2 && pEntry->nTerm == 8)
+			{
+				m_aRecoveredFunctionSet.insert(pEntry->pCurrentTree);
+				break;
+			}
+		}
+	}
+
+	OutputParseSourceError(nParsingError);
+	++m_nRecoveredErrors;
+
+	// The nodes built for the rest of the stack are left to the node blocks.
+	m_nSRStackStates = nResumeEntry;
+	m_pSRStack[nResumeEntry].pReturnTree = NULL;
+
+	m_nRecoverySkipMode = nSkipMode;
+	m_nRecoverySkipBraces = nBraces;
+
+	return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  CScriptCompiler::SkipTokenDuringRecovery()
+///////////////////////////////////////////////////////////////////////////////
+//  Description:  Decides whether the current token is one of those skipped
+//                after an error (TRUE), or the one the parser goes on with
+//                (FALSE).
+///////////////////////////////////////////////////////////////////////////////
+
+BOOL CScriptCompiler::SkipTokenDuringRecovery()
+{
+	int32_t nSkipMode = m_nRecoverySkipMode;
+
+	if (m_nTokenStatus == CSCRIPTCOMPILER_TOKEN_EOF)
+	{
+		m_nRecoverySkipMode = CSCRIPTCOMPILER_RECOVERY_SKIP_NONE;
+		return FALSE;
+	}
+
+	// A structure definition ends with "};".
+	if (nSkipMode == CSCRIPTCOMPILER_RECOVERY_SKIP_DECLARATION_END)
+	{
+		m_nRecoverySkipMode = CSCRIPTCOMPILER_RECOVERY_SKIP_NONE;
+		return m_nTokenStatus == CSCRIPTCOMPILER_TOKEN_SEMICOLON;
+	}
+
+	if (m_nTokenStatus == CSCRIPTCOMPILER_TOKEN_LEFT_BRACE)
+	{
+		++m_nRecoverySkipBraces;
+	}
+	else if (m_nTokenStatus == CSCRIPTCOMPILER_TOKEN_RIGHT_BRACE)
+	{
+		if (m_nRecoverySkipBraces == 0 && nSkipMode == CSCRIPTCOMPILER_RECOVERY_SKIP_STATEMENT)
+		{
+			// The end of the block the statement is in.
+			m_nRecoverySkipMode = CSCRIPTCOMPILER_RECOVERY_SKIP_NONE;
+			return FALSE;
+		}
+
+		if (m_nRecoverySkipBraces > 0)
+		{
+			--m_nRecoverySkipBraces;
+		}
+
+		if (m_nRecoverySkipBraces == 0)
+		{
+			if (nSkipMode == CSCRIPTCOMPILER_RECOVERY_SKIP_STATEMENT)
+			{
+				m_nRecoverySkipMode = CSCRIPTCOMPILER_RECOVERY_SKIP_NONE;
+			}
+			else
+			{
+				m_nRecoverySkipMode = CSCRIPTCOMPILER_RECOVERY_SKIP_DECLARATION_END;
+			}
+		}
+	}
+	else if (m_nTokenStatus == CSCRIPTCOMPILER_TOKEN_SEMICOLON && m_nRecoverySkipBraces == 0)
+	{
+		m_nRecoverySkipMode = CSCRIPTCOMPILER_RECOVERY_SKIP_NONE;
+	}
+
+	return TRUE;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -4499,15 +4747,6 @@ int32_t CScriptCompiler::CleanUpDuringCompile(int32_t nReturnValue)
 
 int32_t CScriptCompiler::ParseSource(char *pScript, int32_t nScriptLength)
 {
-
-	int32_t i;                     // location in the string
-	int32_t nParseNextCharReturn;  // returned value from ParseNextCharacter
-
-	int32_t ch;       // character at location pScript[i]
-	int32_t chNext;   // character at location pScript[i+1].  Yes, I freakin' cheat and
-	// look ahead a character.  Gonna make something out of it, weasel boy?
-	// I didn't think so.
-
 	if (m_nOccupiedIdentifiers == 0)
 	{
 		int32_t nReturnValue = ParseIdentifierFile();
@@ -4517,92 +4756,11 @@ int32_t CScriptCompiler::ParseSource(char *pScript, int32_t nScriptLength)
 		}
 	}
 
-	///////////////////////////////////////////////
-	//
-	// Initialize with the first two characters.
-	//
-	///////////////////////////////////////////////
-
-	if ( nScriptLength < 1 )
-	{
-		ch = -1;
-	}
-	else
-	{
-		ch = pScript[0];
-	}
-
-	if ( nScriptLength < 2 )
-	{
-		chNext = -1;
-	}
-	else
-	{
-		chNext = pScript[1];
-	}
-
-	i = 2;
-
-	///////////////////////////////////////////////
-	//
-	// Loop through all remaining characters.
-	//
-	///////////////////////////////////////////////
+	int32_t nParseCharacterStreamReturn = ParseCharacterStream(pScript,nScriptLength);
 
-	while (ch != -1)
+	if (nParseCharacterStreamReturn < 0)
 	{
-		nParseNextCharReturn = ParseNextCharacter(ch,chNext,pScript + i,nScriptLength - i);
-
-		if (nParseNextCharReturn < 0)
-		{
-			return PrintParseSourceError(nParseNextCharReturn);
-		}
-
-		while (nParseNextCharReturn >= 0)
-		{
-			// Process the location of the next character.
-			if (ch == '\n')
-			{
-				++m_nLines;
-				m_nCharacterOnLine = 1;
-			}
-			else
-			{
-				++m_nCharacterOnLine;
-			}
-
-			// Fetch the "next" character and update the status
-			// of the current character that we are looking at.
-			ch = chNext;
-
-			if ( i >= nScriptLength )
-			{
-				chNext = -1;
-			}
-			else
-			{
-				chNext = (unsigned char) pScript[i];
-			}
-
-			--nParseNextCharReturn;
-
-			++i;
-		}
-
-	}
-
-	///////////////////////////////////////////////
-	//
-	// Parse an EOF.
-	//
-	///////////////////////////////////////////////
-
-	nParseNextCharReturn = ParseNextCharacter(-1,-1, nullptr, 0);
-
-	if (nParseNextCharReturn < 0)
-	{
-
-		return PrintParseSourceError(nParseNextCharReturn);
+		return PrintParseSourceError(nParseCharacterStreamReturn);
 	}
 
 	return 0;
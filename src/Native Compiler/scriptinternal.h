@@ -45,8 +45,8 @@
 #define CSCRIPTCOMPILER_MAX_STACK_ENTRIES    1024
 #define CSCRIPTCOMPILER_MAX_OPERATIONS       88
 #define CSCRIPTCOMPILER_MAX_IDENTIFIERS      65536
-#define CSCRIPTCOMPILER_SIZE_IDENTIFIER_HASH_TABLE  131072  // NOTE:  This should be larger than MAX_IDENTIFIERS
-#define CSCRIPTCOMPILER_MASK_SIZE_IDENTIFIER_HASH_TABLE 0x0001ffff
+#define CSCRIPTCOMPILER_MIN_SIZE_IDENTIFIER_HASH_TABLE 1024    // Grows (by doubling) when half full
+#define CSCRIPTCOMPILER_IDENTIFIER_BLOCK_SHIFT     8       // 256 user-defined identifiers per block
 #define CSCRIPTCOMPILER_MAX_VARIABLES        1024
 #define CSCRIPTCOMPILER_MAX_CODE_SIZE        524288  // 512K.
 #define CSCRIPTCOMPILER_MAX_DEBUG_OUTPUT_SIZE 2097152 // 2048K, 1048576 = 1024K.
@@ -216,6 +216,12 @@ const char *TokenKeywordToString(int nTokenKeyword);
 
 const char *GrammarToString(int nGrammar);
 
+// What the parser skips after an error it compiles past (see SetMaxErrors()).
+#define CSCRIPTCOMPILER_RECOVERY_SKIP_NONE                 0
+#define CSCRIPTCOMPILER_RECOVERY_SKIP_STATEMENT            1   // To the end of the statement
+#define CSCRIPTCOMPILER_RECOVERY_SKIP_DECLARATION          2   // To the end of the functional unit
+#define CSCRIPTCOMPILER_RECOVERY_SKIP_DECLARATION_END      3   // The ';' after a '}' ending one
+
 #define CSCRIPTCOMPILER_OPERATION_COMPOUND_STATEMENT   0
 #define CSCRIPTCOMPILER_OPERATION_STATEMENT            1
 #define CSCRIPTCOMPILER_OPERATION_KEYWORD_DECLARATION  2
@@ -642,33 +648,86 @@ public:
 	uint32_t  m_nIdentifierIndex;
 };
 
+// Open addressing (linear probing) table of the names known to the compiler.
+// It never gets more than half full, so every probe ends on an empty entry.
+class CScriptCompilerIdentifierHashTable
+{
+public:
+	CScriptCompilerIdentifierHashTable();
+	~CScriptCompilerIdentifierHashTable();
+
+	CScriptCompilerIdentifierHashTable(const CScriptCompilerIdentifierHashTable &) = delete;
+	CScriptCompilerIdentifierHashTable &operator=(const CScriptCompilerIdentifierHashTable &) = delete;
+
+	void Add(uint32_t nHashValue, uint32_t nType, uint32_t nIndex);
+	void Delete(uint32_t nHashValue, uint32_t nType, uint32_t nIndex);
+	void Clear();
+
+	CScriptCompilerIdentifierHashTableEntry *m_pEntries;
+	uint32_t m_nMask;       // Number of entries - 1 (a power of two)
+	uint32_t m_nOccupied;
+
+private:
+	void Grow();
+};
+
+// Bump allocator for the parameter arrays of the identifier list.  Nothing is
+// freed on its own: Reset() releases everything at once (running the CExoString
+// destructors), and keeps a single block as large as everything that was in use,
+// so the next compile allocates nothing.
+class CScriptCompilerArena
+{
+public:
+	CScriptCompilerArena();
+	~CScriptCompilerArena();
+
+	void *Allocate(size_t nSize);
+	CExoString *AllocateStrings(int32_t nCount);
+	void Reset();
+
+private:
+	struct Block
+	{
+		Block  *m_pNext;
+		size_t  m_nSize;
+		size_t  m_nUsed;
+	};
+
+	Block *m_pBlocks;       // Current block first
+	size_t m_nTotalSize;
+	std::vector<std::pair<CExoString *, int32_t>> m_aStrings;
+
+	void FreeBlocks();
+};
+
 class CScriptCompilerIdListEntry
 {
 public:
-	CExoString m_psIdentifier;
-	uint32_t m_nIdentifierLength;
+	// Looked at on every identifier lookup and function call: kept together at
+	// the start of the entry.
 	uint32_t m_nIdentifierHash;
+	uint32_t m_nIdentifierLength;
 	int32_t   m_nIdentifierType;
 	int32_t   m_nReturnType;
+	int32_t   m_nIdIdentifier;
+	int32_t   m_nParameters;
+	int32_t   m_nNonOptionalParameters;
 	int32_t   m_bImplementationInPlace;
-	CExoString m_psStructureReturnName;
+	// For each parameter ...
+	char       *m_pchParameters;
+	CExoString m_psIdentifier;
 	//INT   m_nIdentifierOrder;
 
 	// For constants ...
-	CExoString m_psStringData;
 	int32_t   m_nIntegerData;
 	float m_fFloatData;
 	float m_fVectorData[3];
+	CExoString m_psStringData;
+	CExoString m_psStructureReturnName;
 
-	// For identifiers ..
-	int32_t   m_nIdIdentifier;
-	int32_t   m_nParameters;
-	int32_t   m_nNonOptionalParameters;
-
+	// The rest of the parameter arrays, allocated with m_pchParameters from
+	// one of the compiler's arenas (see ExpandParameterSpace()).
 	int32_t   m_nParameterSpace;
-
-	// For each parameter ...
-	char       *m_pchParameters;
 	CExoString *m_psStructureParameterNames;
 	// For the optional part of each parameter ...
 	BOOL       *m_pbOptionalParameters;
@@ -686,8 +745,54 @@ public:
 	int32_t   m_nBinaryDestinationFinish;
 
 	CScriptCompilerIdListEntry();
-	~CScriptCompilerIdListEntry();
-	int32_t ExpandParameterSpace();
+	int32_t ExpandParameterSpace(CScriptCompilerArena *pArena, int32_t nParameterSpace = 0);
+	void ReleaseParameterSpace();
+};
+
+inline CScriptCompilerIdListEntry &CScriptCompilerIdentifierList::operator[](int32_t nIndex)
+{
+	if (nIndex < m_nShared)
+	{
+		return m_pcShared[nIndex];
+	}
+
+	uint32_t nEntry = (uint32_t) (nIndex - m_nShared);
+	uint32_t nBlock = nEntry >> CSCRIPTCOMPILER_IDENTIFIER_BLOCK_SHIFT;
+	if (nBlock < m_apBlocks.size())
+	{
+		return m_apBlocks[nBlock][nEntry & ((1 << CSCRIPTCOMPILER_IDENTIFIER_BLOCK_SHIFT) - 1)];
+	}
+	return AllocateEntry(nIndex);
+}
+
+// What the compiler reads from the language definition (nwscript.nss).  Built
+// by SetIdentifierSpecification(), and never changed afterwards: every compiler
+// given it with SetLanguageContext() reads from the same one.
+class CScriptCompilerLanguageContext
+{
+public:
+	CScriptCompilerLanguageContext();
+	~CScriptCompilerLanguageContext();
+
+	CScriptCompilerLanguageContext(const CScriptCompilerLanguageContext &) = delete;
+	CScriptCompilerLanguageContext &operator=(const CScriptCompilerLanguageContext &) = delete;
+
+	CExoString m_sLanguageSource;
+	int32_t    m_pnHashString[256];     // The HashString() values the hash table was built with
+
+	CScriptCompilerKeyWordEntry *m_pcKeyWords;
+
+	int32_t     m_nNumEngineDefinedStructures;
+	BOOL       *m_pbEngineDefinedStructureValid;
+	CExoString *m_psEngineDefinedStructureName;
+
+	// The predefined identifiers, and the arena holding their parameter arrays.
+	int32_t m_nIdentifiers;
+	CScriptCompilerIdListEntry *m_pcIdentifierList;
+	CScriptCompilerArena *m_pParameterArena;
+
+	// Keywords, engine structures and predefined identifiers.
+	CScriptCompilerIdentifierHashTable *m_pIdentifierHashTable;
 };
 
 class CScriptCompilerVarStackEntry
@@ -747,6 +852,13 @@ public:
 #define CSCRIPTCOMPILER_SYMBOL_TABLE_ENTRY_TYPE_CONTINUE       4
 #define CSCRIPTCOMPILER_SYMBOL_TABLE_ENTRY_TYPE_SWITCH_CASE    5
 #define CSCRIPTCOMPILER_SYMBOL_TABLE_ENTRY_TYPE_SWITCH_DEFAULT 6
+#define CSCRIPTCOMPILER_SYMBOL_TABLE_ENTRY_TYPE_SWITCH_TREE    7
+
+// Switches with at least this many case labels are dispatched through a
+// balanced binary search over the sorted case values (the VM has no jump
+// table). Each leaf of the search tree tests up to LEAF_SIZE values in turn.
+#define CSCRIPTCOMPILER_SWITCH_TREE_THRESHOLD  8
+#define CSCRIPTCOMPILER_SWITCH_TREE_LEAF_SIZE  3
 
 class CScriptCompilerSymbolTableEntry
 {
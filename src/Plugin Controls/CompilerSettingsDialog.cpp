@@ -78,7 +78,16 @@ intptr_t CALLBACK CompilerSettingsDialog::run_dlgProc(UINT message, WPARAM wPara
 				EnableWindow(GetDlgItem(_hSelf, IDC_LBLTARGETVERSION), false);
 			}
 			else
+			{
 				::CheckRadioButton(_hSelf, IDC_USEBEAMDOGCOMPILER, IDC_USELEGACYCOMPILER, IDC_USELEGACYCOMPILER);
+				EnableWindow(GetDlgItem(_hSelf, IDC_LBLMAXERRORS), false);
+				EnableWindow(GetDlgItem(_hSelf, IDC_TXTMAXERRORS), false);
+				EnableWindow(GetDlgItem(_hSelf, IDC_LBLMAXERRORS2), false);
+			}
+
+			// Errors the native compiler reports per script (1 = stops at the first)
+			SendMessage(GetDlgItem(_hSelf, IDC_TXTMAXERRORS), EM_LIMITTEXT, 3, 0);
+			SetDlgItemInt(_hSelf, IDC_TXTMAXERRORS, (std::max)(myset.maxCompileErrors, 1), FALSE);
 
 			CheckDlgButton(_hSelf, IDC_CHKCOMPOPTIMIZE, myset.optimizeScript);
 			CheckDlgButton(_hSelf, IDC_CHKCOMPNDBSYMBOLS, myset.generateSymbols);
@@ -175,6 +184,9 @@ intptr_t CALLBACK CompilerSettingsDialog::run_dlgProc(UINT message, WPARAM wPara
 					EnableWindow(GetDlgItem(_hSelf, IDC_CHKCOMPDISABLESLASHPARSE), false);
 					EnableWindow(GetDlgItem(_hSelf, IDC_CBOTARGETVERSION), false);
 					EnableWindow(GetDlgItem(_hSelf, IDC_LBLTARGETVERSION), false);
+					EnableWindow(GetDlgItem(_hSelf, IDC_LBLMAXERRORS), true);
+					EnableWindow(GetDlgItem(_hSelf, IDC_TXTMAXERRORS), true);
+					EnableWindow(GetDlgItem(_hSelf, IDC_LBLMAXERRORS2), true);
 					return FALSE;
 				}
 
@@ -186,6 +198,9 @@ intptr_t CALLBACK CompilerSettingsDialog::run_dlgProc(UINT message, WPARAM wPara
 					EnableWindow(GetDlgItem(_hSelf, IDC_CHKCOMPDISABLESLASHPARSE), true);
 					EnableWindow(GetDlgItem(_hSelf, IDC_CBOTARGETVERSION), true);
 					EnableWindow(GetDlgItem(_hSelf, IDC_LBLTARGETVERSION), true);
+					EnableWindow(GetDlgItem(_hSelf, IDC_LBLMAXERRORS), false);
+					EnableWindow(GetDlgItem(_hSelf, IDC_TXTMAXERRORS), false);
+					EnableWindow(GetDlgItem(_hSelf, IDC_LBLMAXERRORS2), false);
 					return FALSE;
 				}
 
@@ -405,6 +420,7 @@ bool CompilerSettingsDialog::keepSettings()
 	myset.compilerFlags |= IsDlgButtonChecked(_hSelf, IDC_CHKCOMPDISABLESLASHPARSE) ? NscCompilerFlag_DisableDoubleQuote : 0;
 
 	myset.compileVersion = (ComboBox_GetCurSel(GetDlgItem(_hSelf, IDC_CBOTARGETVERSION)) == 0) ? 174 : 169;
+	myset.maxCompileErrors = (std::max)(static_cast<int>(GetDlgItemInt(_hSelf, IDC_TXTMAXERRORS, NULL, FALSE)), 1);
 
 	myset.useScriptPathToCompile = IsDlgButtonChecked(_hSelf, IDC_CHKOUTPUTDIR);
 	GetDlgItemText(_hSelf, IDC_TXTOUTPUTDIR, tempBuffer, std::size(tempBuffer));
@@ -76,6 +76,11 @@ namespace NWScriptPlugin {
 				switchToErrors();
 		}
 
+		// Shows the errors list, for results logged as messages the user browses there
+		void showErrorsList() {
+			switchToErrors();
+		}
+
 		void LogMessage(const CompilerMessage& message, const generic_string& filePath = TEXT(""));
 
 		void LockControls(bool toLock);
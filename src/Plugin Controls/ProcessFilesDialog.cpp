@@ -60,3 +60,16 @@ void ProcessFilesDialog::showDialog()
 	//Show and centralize
 	goToCenter();
 }
+
+void ProcessFilesDialog::setTelemetry(const BatchTelemetry::Snapshot& snapshot)
+{
+	generic_string sText = std::format(TEXT("{} of {} files - {:.1f} files/s - {:.1f} KB/s"),
+		snapshot.filesDone, snapshot.filesQueued, snapshot.filesPerSecond, snapshot.bytesPerSecond / 1024.0);
+
+	if (snapshot.includeCache.hits + snapshot.includeCache.misses > 0)
+		sText += std::format(TEXT(" - include cache {:.0f}%"), snapshot.includeCache.hitRate() * 100.0);
+	if (snapshot.resourceCache.hits + snapshot.resourceCache.misses > 0)
+		sText += std::format(TEXT(" - resource cache {:.0f}%"), snapshot.resourceCache.hitRate() * 100.0);
+
+	SetDlgItemText(_hSelf, IDC_LBLTELEMETRY, sText.c_str());
+}
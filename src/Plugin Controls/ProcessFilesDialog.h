@@ -7,6 +7,7 @@
 
 #pragma once
 #include "StaticDialog.h"
+#include "BatchTelemetry.h"
 
 namespace NWScriptPlugin {
 
@@ -25,6 +26,9 @@ namespace NWScriptPlugin {
 			SetDlgItemText(_hSelf, IDC_LBLSTATUS, status.c_str());
 		}
 
+		// Shows progress, throughput and cache hit rates under the file being processed
+		void setTelemetry(const BatchTelemetry::Snapshot& snapshot);
+
 		void lockWindow(bool toLock) {
 			EnableWindow(_hSelf, !toLock);
 		}
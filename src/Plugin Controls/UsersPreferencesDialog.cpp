@@ -29,6 +29,8 @@ intptr_t CALLBACK UsersPreferencesDialog::run_dlgProc(UINT message, WPARAM wPara
 		{
 			CheckDlgButton(_hSelf, IDC_CHKAUTOOPENDISASSEMBLED, _settings->autoDisplayDisassembled ? BST_CHECKED : BST_UNCHECKED);
 			CheckDlgButton(_hSelf, IDC_CHKAUTOOPENDEBUGSYMBOLS, _settings->autoDisplayDebugSymbols ? BST_CHECKED : BST_UNCHECKED);
+			CheckDlgButton(_hSelf, IDC_CHKAUTOREFRESHUSERTOKENS, _settings->autoRefreshUserTokens ? BST_CHECKED : BST_UNCHECKED);
+			CheckDlgButton(_hSelf, IDC_CHKRANKEDAUTOCOMPLETE, _settings->rankedAutoComplete ? BST_CHECKED : BST_UNCHECKED);
 
 			if (_darkModeInstalled)
 				CheckDlgButton(_hSelf, IDC_CHKAUTOINSTALLDARKTHEME, _settings->autoInstallDarkTheme ? BST_CHECKED : BST_UNCHECKED);
@@ -61,6 +63,8 @@ intptr_t CALLBACK UsersPreferencesDialog::run_dlgProc(UINT message, WPARAM wPara
 					keepSettings();
 				display(false);
 				destroy();
+				if (wParam == IDOK && _okDialogCallback != nullptr)
+					_okDialogCallback(static_cast<HRESULT>(wParam));
 				return TRUE;
 			}
 			break;
@@ -86,6 +90,8 @@ void UsersPreferencesDialog::keepSettings()
 {
 	_settings->autoDisplayDisassembled = IsDlgButtonChecked(_hSelf, IDC_CHKAUTOOPENDISASSEMBLED);
 	_settings->autoDisplayDebugSymbols = IsDlgButtonChecked(_hSelf, IDC_CHKAUTOOPENDEBUGSYMBOLS);
+	_settings->autoRefreshUserTokens = IsDlgButtonChecked(_hSelf, IDC_CHKAUTOREFRESHUSERTOKENS);
+	_settings->rankedAutoComplete = IsDlgButtonChecked(_hSelf, IDC_CHKRANKEDAUTOCOMPLETE);
 
 	if (_darkModeInstalled)
 		_settings->autoInstallDarkTheme = IsDlgButtonChecked(_hSelf, IDC_CHKAUTOINSTALLDARKTHEME);
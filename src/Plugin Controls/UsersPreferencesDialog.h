@@ -30,6 +30,10 @@ namespace NWScriptPlugin {
 			_darkModeInstalled = installed;
 		}
 
+		void setOkDialogCallback(void (*OkDialogCallback)(HRESULT decision)) {
+			_okDialogCallback = OkDialogCallback;
+		}
+
 		void doDialog();
 
 	protected:
@@ -39,6 +43,7 @@ namespace NWScriptPlugin {
 		Settings* _settings = nullptr;
 
 		bool _darkModeInstalled = false;
+		void (*_okDialogCallback)(HRESULT decision) = nullptr;
 
 		HICON _hWindowIcon = nullptr;
 	};
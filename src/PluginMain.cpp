@@ -20,6 +20,7 @@
 //#include <Shlwapi.h>
 
 #include "menuCmdID.h"
+#include "SciLexer.h"
 
 #include "Common.h"
 #include "LexerCatalogue.h"
@@ -31,6 +32,7 @@
 
 #include "BatchProcessingDialog.h"
 #include "CompilerSettingsDialog.h"
+#include "DirectoryWalker.h"
 #include "FileParseSummaryDialog.h"
 #include "PathAccessDialog.h"
 #include "ProcessFilesDialog.h"
@@ -49,6 +51,12 @@
 //#define DEBUG_AUTO_INDENT_833      // Uncomment to test auto-indent with message
 #define USE_THREADS                  // Process compilations and batchs in multi-threaded operations
 #define NAGIVATECALLBACKTIMER 0x800  // Temporary timer to schedule navigations
+#define USERTOKENSUPDATETIMER 0x801  // Picks up the user tokens watcher's updates
+#define USERTOKENSUPDATEINTERVAL 1000
+
+#define AUTOCOMPLETEMINCHARS 2       // Characters typed before the ranked auto-complete shows up
+#define AUTOCOMPLETEMAXITEMS 50
+#define COMPILECACHEMAXBYTES (512ull << 20)  // Size of the batch compile cache, least recently used entries going first
 
 
 using namespace NWScriptPlugin;
@@ -68,22 +76,24 @@ generic_string Plugin::pluginName = TEXT("NWScript Tools");
 #define PLUGINMENU_DASH2 6
 #define PLUGINMENU_FETCHPREPROCESSORTEXT 7
 #define PLUGINMENU_VIEWSCRIPTDEPENDENCIES 8
-#define PLUGINMENU_DASH3 9
-#define PLUGINMENU_SHOWCONSOLE 10
-#define PLUGINMENU_DASH4 11
-#define PLUGINMENU_SETTINGS 12
-#define PLUGINMENU_USERPREFERENCES 13
-#define PLUGINMENU_DASH5 14
-#define PLUGINMENU_INSTALLDARKTHEME 15
-#define PLUGINMENU_IMPORTDEFINITIONS 16
-#define PLUGINMENU_IMPORTUSERTOKENS 17
-#define PLUGINMENU_RESETUSERTOKENS 18
-#define PLUGINMENU_RESETEDITORCOLORS 19
-#define PLUGINMENU_REPAIRXMLASSOCIATION 20
-#define PLUGINMENU_DASH6 21
-#define PLUGINMENU_INSTALLCOMPLEMENTFILES 22
-#define PLUGINMENU_DASH7 23
-#define PLUGINMENU_ABOUTME 24
+#define PLUGINMENU_GOTODEFINITION 9
+#define PLUGINMENU_FINDALLREFERENCES 10
+#define PLUGINMENU_DASH3 11
+#define PLUGINMENU_SHOWCONSOLE 12
+#define PLUGINMENU_DASH4 13
+#define PLUGINMENU_SETTINGS 14
+#define PLUGINMENU_USERPREFERENCES 15
+#define PLUGINMENU_DASH5 16
+#define PLUGINMENU_INSTALLDARKTHEME 17
+#define PLUGINMENU_IMPORTDEFINITIONS 18
+#define PLUGINMENU_IMPORTUSERTOKENS 19
+#define PLUGINMENU_RESETUSERTOKENS 20
+#define PLUGINMENU_RESETEDITORCOLORS 21
+#define PLUGINMENU_REPAIRXMLASSOCIATION 22
+#define PLUGINMENU_DASH6 23
+#define PLUGINMENU_INSTALLCOMPLEMENTFILES 24
+#define PLUGINMENU_DASH7 25
+#define PLUGINMENU_ABOUTME 26
 
 #define PLUGIN_HOMEPATH TEXT("https://github.com/Leonard-The-Wise/NWScript-Npp")
 #define PLUGIN_ONLINEHELP TEXT("https://github.com/Leonard-The-Wise/NWScript-Npp/blob/master/OnlineHelp.md")
@@ -104,6 +114,8 @@ FuncItem Plugin::pluginFunctions[] = {
     {TEXT("---")},
     {TEXT("Fetch preprocessed output"), Plugin::FetchPreprocessorText},
     {TEXT("View NWScript dependencies"), Plugin::ViewScriptDependencies},
+    {TEXT("Go to definition"), Plugin::GoToDefinition},
+    {TEXT("Find all references"), Plugin::FindAllReferences},
     {TEXT("---")},
     {TEXT("Toggle NWScript Compiler Console"), Plugin::ToggleLogger, 0, false, &toggleConsoleKey},
     {TEXT("---")},
@@ -152,6 +164,8 @@ constexpr const TCHAR PseudoBatchRestartFile[] = TEXT("~doNWScriptNotepadRestart
 constexpr const TCHAR NWScriptEngineObjectsFile[] = TEXT("NWScript-Npp-EngineObjects.bin");
 // NWScript known user objects file
 constexpr const TCHAR NWScriptUserObjectsFile[] = TEXT("NWScript-Npp-UserObjects.bin");
+// Workspace cross-references cache
+constexpr const TCHAR NWScriptWorkspaceIndexFile[] = TEXT("NWScript-Npp-WorkspaceIndex.bin");
 
 
 #pragma region
@@ -273,6 +287,10 @@ void Plugin::MakePluginFilePaths()
     sPath.append(TEXT("\\")).append(NWScriptUserObjectsFile);
     _pluginPaths.insert({ "NWScriptUserObjectsFile", fs::path(sPath) });
 
+    sPath = _pluginPaths["PluginConfigDir"];
+    sPath.append(TEXT("\\")).append(NWScriptWorkspaceIndexFile);
+    _pluginPaths.insert({ "NWScriptWorkspaceIndexFile", fs::path(sPath) });
+
     // Step 2:
     // For any file not present on Plugins Config Dir, we then check on the Notepad++ executable sPath.
 
@@ -445,13 +463,14 @@ plugin creator:\r\n File: PluginMain.cpp, function 'CheckupPluginObjectFiles()'"
 
         FreeResource(hMemory);
 
-        // Retrieve statistics
-        _NWScriptParseResults = std::make_unique<NWScriptParser::ScriptParseResults>();
-        _NWScriptParseResults->SerializeFromFile(_pluginPaths["NWScriptEngineObjectsFile"].c_str());
-        Settings().engineStructs = _NWScriptParseResults->EngineStructuresCount;
-        Settings().engineFunctionCount = _NWScriptParseResults->FunctionsCount;
-        Settings().engineConstants = _NWScriptParseResults->ConstantsCount;
-        _NWScriptParseResults = nullptr;
+        // Retrieve statistics (straight from the file header)
+        NWScriptParser::ScriptParseResultsView engineObjects;
+        if (engineObjects.Open(_pluginPaths["NWScriptEngineObjectsFile"].c_str()))
+        {
+            Settings().engineStructs = engineObjects.EngineStructuresCount();
+            Settings().engineFunctionCount = engineObjects.FunctionsCount();
+            Settings().engineConstants = engineObjects.ConstantsCount();
+        }
     }
 
     // Create or restore the plugin XML configuration file
@@ -682,6 +701,13 @@ void Plugin::ProcessMessagesSci(SCNotification* notifyCode)
         // This must always execute after processing the hooks.
         SetRestartHook(RestartMode::None, RestartFunctionHook::None);
 
+        // Opt-in: watch the user tokens files for changes
+        SetupUserTokensWatcher();
+
+        // Index the workspace in the background, for "Go to definition" and "Find all references"
+        _workspaceIndex.Start(_pluginPaths["NWScriptWorkspaceIndexFile"]);
+        UpdateWorkspaceFolders();
+
         // Mark plugin ready to use. Last step on the initialization chain
         _isReady = true;
 
@@ -696,6 +722,17 @@ void Plugin::ProcessMessagesSci(SCNotification* notifyCode)
     case NPPN_SHUTDOWN:
     {
         _isReady = false;
+
+        // Can't be left to the destructor: it runs on DLL detach, and joining threads there deadlocks
+        KillTimer(NotepadHwnd(), USERTOKENSUPDATETIMER);
+        _userTokensWatcher.Stop();
+        _workspaceIndex.Stop();
+
+        // A batch still listing files stops soon. Its thread may be waiting on us (status messages), so it's not joined.
+        _batchInterrupt = true;
+        if (_batchFilesBuilder.joinable())
+            _batchFilesBuilder.detach();
+
         Settings().Save();
 
         // If we have a restart hook setup, call out shell to execute it.
@@ -710,12 +747,35 @@ void Plugin::ProcessMessagesSci(SCNotification* notifyCode)
     case NPPN_LANGCHANGED:
     {
         LoadNotepadLexer();
+        PushUserTokensToLexer();
         break;
     }
     case NPPN_BUFFERACTIVATED:
     {
         if (_isReady)
+        {
             LoadNotepadLexer();
+            PushUserTokensToLexer();
+            CountAutoCompleteUsage();
+        }
+        break;
+    }
+    case NPPN_FILESAVED:
+    {
+        if (_isReady)
+        {
+            CountAutoCompleteUsage();
+
+            TCHAR filePath[MAX_PATH] = { 0 };
+            if (Messenger().SendNppMessage<int>(NPPM_GETFULLPATHFROMBUFFERID, notifyCode->nmhdr.idFrom,
+                reinterpret_cast<LPARAM>(filePath)) > 0)
+                _workspaceIndex.RefreshFile(filePath);
+        }
+        break;
+    }
+    case NPPN_FILECLOSED:
+    {
+        _autoCompleteIndex.RemoveDocument(notifyCode->nmhdr.idFrom);
         break;
     }
     case SCN_CHARADDED:
@@ -727,6 +787,22 @@ void Plugin::ProcessMessagesSci(SCNotification* notifyCode)
         if (_isReady && IsPluginLanguage() && _needPluginAutoIndent
             && Settings().enableAutoIndentation)
             Indentor().IndentLine(static_cast<TCHAR>(notifyCode->ch));
+
+        if (_isReady && IsPluginLanguage() && Settings().rankedAutoComplete)
+            ShowRankedAutoComplete();
+        break;
+    }
+    case SCN_AUTOCCHARDELETED:
+    {
+        // The list isn't filtered by prefix, so it's redone for the shorter word
+        if (_rankedAutoCompleteShown)
+            ShowRankedAutoComplete();
+        break;
+    }
+    case SCN_AUTOCCOMPLETED:
+    case SCN_AUTOCCANCELLED:
+    {
+        CloseRankedAutoComplete();
         break;
     }
     case NPPN_DARKMODECHANGED:
@@ -971,6 +1047,283 @@ void Plugin::SetNotepadToPluginLexer()
         Messenger().SendNppMessage<void>(NPPM_MENUCOMMAND, 0, commandID);
 }
 
+void Plugin::SetupUserTokensWatcher()
+{
+    if (Settings().autoRefreshUserTokens && !_userTokensWatcher.IsRunning())
+    {
+        _userTokensWatcher.Start(_pluginPaths["NWScriptUserObjectsFile"]);
+        SetTimer(NotepadHwnd(), USERTOKENSUPDATETIMER, USERTOKENSUPDATEINTERVAL, (TIMERPROC)RunUserTokensUpdate);
+    }
+    else if (!Settings().autoRefreshUserTokens && _userTokensWatcher.IsRunning())
+    {
+        KillTimer(NotepadHwnd(), USERTOKENSUPDATETIMER);
+        _userTokensWatcher.Stop();
+    }
+}
+
+// The parsing happens in the watcher's thread. Here (the UI thread) we only hand the new lists to the lexer and
+// write them to the plugin's files, which are streamed and take a few milliseconds.
+void CALLBACK Plugin::RunUserTokensUpdate(HWND hwnd, UINT message, UINT idTimer, DWORD dwTime)
+{
+    Plugin& inst = Instance();
+
+    // An import is waiting for the user to confirm it: try again on the next tick
+    if (!inst._isReady || inst._NWScriptParseResults)
+        return;
+
+    UserTokensWatcher::Update update;
+    if (!inst._userTokensWatcher.TakeUpdate(update))
+        return;
+
+    // The user imported or reset tokens after the watcher read them: start over from the new file
+    if (update.nUserObjectsFileTime != UserTokensWatcher::FileWriteTime(inst._pluginPaths["NWScriptUserObjectsFile"]))
+    {
+        inst._userTokensWatcher.Reload();
+        return;
+    }
+
+    inst._liveUserConstants = update.results->MembersAsSpacedString(NWScriptParser::MemberID::Constant);
+    inst._liveUserFunctions = update.results->MembersAsSpacedString(NWScriptParser::MemberID::Function);
+    inst._liveUserTokens = true;
+    inst.PushUserTokensToLexer();
+
+    // And for the next sessions (also updates the auto-complete file)
+    inst._NWScriptParseResults = std::move(update.results);
+    inst.DoImportUserTokens(false);
+}
+
+void Plugin::PushUserTokensToLexer()
+{
+    // Notepad++ sets the keywords it loaded on startup every time a document is activated, so this is done
+    // again each time. Lists 6 and 8 are the lexer's type5 (user constants) and type7 (user functions).
+    if (!_liveUserTokens || !IsPluginLanguage())
+        return;
+
+    Messenger().SendSciMessage<void>(SCI_SETKEYWORDS, 6, reinterpret_cast<LPARAM>(_liveUserConstants.c_str()));
+    Messenger().SendSciMessage<void>(SCI_SETKEYWORDS, 8, reinterpret_cast<LPARAM>(_liveUserFunctions.c_str()));
+}
+
+void Plugin::ShowRankedAutoComplete()
+{
+    if (_autoCompleteIndexStale)
+    {
+        // Same members as the auto-complete file: the fixed keywords plus engine objects, then user objects.
+        // The keywords go apart, so the engine objects are read straight from their file, not copied.
+        NWScriptParser::ScriptParseResults keywords;
+        std::string kw = fixedPreProcInstructionSet;
+        kw.append(" ").append(fixedInstructionSet).append(" ").append(fixedKeywordSet).append(" ").append(fixedObjKeywordSet);
+        keywords.AddSpacedStringAsKeywords(kw);
+
+        NWScriptParser::ScriptParseResults engineObjects;
+        engineObjects.SerializeFromFile(_pluginPaths["NWScriptEngineObjectsFile"]);
+
+        NWScriptParser::ScriptParseResults userObjects;
+        userObjects.SerializeFromFile(_pluginPaths["NWScriptUserObjectsFile"]);
+
+        _autoCompleteIndex.Clear();
+        _autoCompleteIndex.AddMembers(keywords, false);
+        _autoCompleteIndex.AddMembers(engineObjects, false);
+        _autoCompleteIndex.AddMembers(userObjects, true);
+        _autoCompleteIndex.Build();
+        _autoCompleteIndexStale = false;
+    }
+
+    const Sci_Position caret = Messenger().SendSciMessage<Sci_Position>(SCI_GETCURRENTPOS);
+    const Sci_Position wordStart = Messenger().SendSciMessage<Sci_Position>(SCI_WORDSTARTPOSITION, caret, true);
+    const Sci_Position lineStart = Messenger().SendSciMessage<Sci_Position>(SCI_POSITIONFROMLINE,
+        Messenger().SendSciMessage<Sci_Position>(SCI_LINEFROMPOSITION, caret));
+
+    // Not for comments or strings. The word itself may not be styled yet, so we check the character before it
+    // (without the inactive code flag).
+    bool bShow = caret - wordStart >= AUTOCOMPLETEMINCHARS && wordStart >= lineStart;
+    if (bShow && wordStart > 0)
+    {
+        const int style = Messenger().SendSciMessage<int>(SCI_GETSTYLEAT, wordStart - 1) & ~0x40;
+        bShow = style != SCE_C_COMMENT && style != SCE_C_COMMENTLINE && style != SCE_C_COMMENTDOC && style != SCE_C_COMMENTLINEDOC
+            && style != SCE_C_STRING && style != SCE_C_STRINGEOL && style != SCE_C_CHARACTER && style != SCE_C_PREPROCESSOR;
+    }
+
+    if (bShow)
+    {
+        const char* pLine = reinterpret_cast<const char*>(Messenger().SendSciMessage<LRESULT>(SCI_GETRANGEPOINTER, lineStart, caret - lineStart));
+        const std::string_view line(pLine, caret - lineStart);
+        const std::string_view word = line.substr(wordStart - lineStart);
+        if (!isdigit(static_cast<unsigned char>(word[0])))
+            _autoCompleteIndex.Query(word, _autoCompleteMatches, AUTOCOMPLETEMAXITEMS,
+                AutoCompleteIndex::ExpectedType(line.substr(0, wordStart - lineStart)));
+        else
+            _autoCompleteMatches.clear();
+        bShow = !_autoCompleteMatches.empty();
+    }
+
+    if (!bShow)
+    {
+        CloseRankedAutoComplete();
+        return;
+    }
+
+    std::string list;
+    for (const AutoCompleteIndex::Match& m : _autoCompleteMatches)
+        list.append(_autoCompleteIndex.GetSymbol(m.nSymbol).sName).append(" ");
+    list.pop_back();
+
+    // Our order is the ranking, and most items don't start with the typed text (which would make Scintilla hide
+    // the list). Selecting the first item by its full name works for any order.
+    Messenger().SendSciMessage<void>(SCI_AUTOCSETSEPARATOR, ' ');
+    Messenger().SendSciMessage<void>(SCI_AUTOCSETIGNORECASE, true);
+    Messenger().SendSciMessage<void>(SCI_AUTOCSETORDER, SC_ORDER_CUSTOM);
+    Messenger().SendSciMessage<void>(SCI_AUTOCSETAUTOHIDE, false);
+    Messenger().SendSciMessage<void>(SCI_AUTOCSHOW, caret - wordStart, reinterpret_cast<LPARAM>(list.c_str()));
+    Messenger().SendSciMessage<void>(SCI_AUTOCSELECT, 0,
+        reinterpret_cast<LPARAM>(_autoCompleteIndex.GetSymbol(_autoCompleteMatches[0].nSymbol).sName.c_str()));
+    _rankedAutoCompleteShown = true;
+}
+
+void Plugin::CloseRankedAutoComplete()
+{
+    if (!_rankedAutoCompleteShown)
+        return;
+
+    if (Messenger().SendSciMessage<bool>(SCI_AUTOCACTIVE))
+        Messenger().SendSciMessage<void>(SCI_AUTOCCANCEL);
+    Messenger().SendSciMessage<void>(SCI_AUTOCSETAUTOHIDE, true);
+    Messenger().SendSciMessage<void>(SCI_AUTOCSETORDER, SC_ORDER_PRESORTED);
+    _rankedAutoCompleteShown = false;
+}
+
+void Plugin::CountAutoCompleteUsage()
+{
+    if (!Settings().rankedAutoComplete || !IsPluginLanguage())
+        return;
+
+    const uintptr_t bufferID = Messenger().SendNppMessage<uintptr_t>(NPPM_GETCURRENTBUFFERID);
+    const Sci_Position length = Messenger().SendSciMessage<Sci_Position>(SCI_GETLENGTH);
+    const char* pText = reinterpret_cast<const char*>(Messenger().SendSciMessage<LRESULT>(SCI_GETCHARACTERPOINTER));
+    _autoCompleteIndex.SetDocumentUsage(bufferID, std::string_view(pText, length));
+}
+
+void Plugin::UpdateWorkspaceFolders()
+{
+    std::vector<WorkspaceIndex::Folder> folders;
+    for (const generic_string& includeDir : Settings().getIncludeDirsV())
+        folders.push_back({ includeDir, false });
+    if (!Settings().startingBatchFolder.empty())
+        folders.push_back({ Settings().startingBatchFolder, Settings().recurseSubFolders });
+    folders.insert(folders.end(), _workspaceDocumentFolders.begin(), _workspaceDocumentFolders.end());
+
+    // Only rescans if something changed
+    _workspaceIndex.SetFolders(folders);
+}
+
+std::string Plugin::GetWordAtCaret()
+{
+    const Sci_Position caret = Messenger().SendSciMessage<Sci_Position>(SCI_GETCURRENTPOS);
+    const Sci_Position wordStart = Messenger().SendSciMessage<Sci_Position>(SCI_WORDSTARTPOSITION, caret, true);
+    const Sci_Position wordEnd = Messenger().SendSciMessage<Sci_Position>(SCI_WORDENDPOSITION, caret, true);
+    if (wordEnd <= wordStart)
+        return {};
+
+    const char* pWord = reinterpret_cast<const char*>(Messenger().SendSciMessage<LRESULT>(SCI_GETRANGEPOINTER, wordStart, wordEnd - wordStart));
+    std::string word(pWord, wordEnd - wordStart);
+    if (isdigit(static_cast<unsigned char>(word[0])))
+        return {};
+    return word;
+}
+
+void Plugin::LookupInWorkspace(bool bDefinitions)
+{
+    const std::string word = GetWordAtCaret();
+    if (word.empty())
+    {
+        MessageBox(NotepadHwnd(), TEXT("Please place the cursor over a function, variable, constant or #include name first."),
+            TEXT("Nothing to look up"), MB_OK | MB_ICONINFORMATION);
+        return;
+    }
+
+    // The current script's folder joins the workspace for the rest of the session
+    TCHAR nameBuffer[MAX_PATH] = { 0 };
+    Messenger().SendNppMessage<void>(NPPM_GETFULLCURRENTPATH, std::size(nameBuffer) - sizeof(TCHAR), reinterpret_cast<LPARAM>(nameBuffer));
+    fs::path scriptPath = generic_string(nameBuffer);
+    if (scriptPath.has_parent_path())
+    {
+        WorkspaceIndex::Folder scriptFolder = { scriptPath.parent_path().c_str(), false };
+        if (std::find(_workspaceDocumentFolders.begin(), _workspaceDocumentFolders.end(), scriptFolder) == _workspaceDocumentFolders.end())
+            _workspaceDocumentFolders.push_back(scriptFolder);
+    }
+    UpdateWorkspaceFolders();
+
+    std::vector<WorkspaceIndex::Location> locations;
+    _workspaceIndex.Find(word, bDefinitions, locations);
+
+    // Picks up files changed outside of Notepad++, for the next lookup
+    _workspaceIndex.Refresh();
+
+    if (locations.empty())
+    {
+        generic_string message = _workspaceIndex.IsIndexing() && _workspaceIndex.ScriptsCount() == 0 ?
+            generic_string(TEXT("The workspace scripts are still being indexed. Please try again in a moment.")) :
+            std::format(TEXT("No {} of \"{}\" found in the {} scripts of the include folders, the batch processing folder and the folders of the scripts you looked up from."),
+                bDefinitions ? TEXT("definition") : TEXT("reference"), str2wstr(word), _workspaceIndex.ScriptsCount());
+        MessageBox(NotepadHwnd(), message.c_str(), TEXT("NWScript workspace"), MB_OK | MB_ICONINFORMATION);
+        return;
+    }
+
+    // A single definition (prototypes aside): just go there
+    if (bDefinitions)
+    {
+        const WorkspaceIndex::Location* target = locations.size() == 1 ? &locations[0] : nullptr;
+        if (!target)
+        {
+            for (const WorkspaceIndex::Location& location : locations)
+            {
+                if (location.kind != WorkspaceIndex::UseKind::Definition)
+                    continue;
+                if (target)
+                {
+                    target = nullptr;
+                    break;
+                }
+                target = &location;
+            }
+        }
+
+        if (target)
+        {
+            const fs::path filePath = target->sFilePath;
+            NavigateToCode(filePath.filename().c_str(), target->nLine, TEXT(""), filePath);
+            return;
+        }
+    }
+
+    // Everything else goes to the errors list, where a double-click opens it
+    DisplayCompilerLogWindow(true);
+    _loggerWindow->reset();
+
+    static const TCHAR* kindNames[] = { TEXT("Reference"), TEXT("Declaration"), TEXT("Definition"), TEXT("Local"), TEXT("Include") };
+    std::set<generic_string> scripts;
+    for (const WorkspaceIndex::Location& location : locations)
+    {
+        const fs::path filePath = location.sFilePath;
+        generic_string extension = filePath.extension().c_str();
+        if (!extension.empty())
+            extension.erase(0, 1);
+
+        _loggerWindow->LogMessage({ LogType::Info,
+            std::format(TEXT("{} (column {})"), str2wstr(word), location.nColumn), kindNames[static_cast<int>(location.kind)],
+            filePath.stem().c_str(), extension, std::to_wstring(location.nLine) }, location.sFilePath);
+        scripts.insert(location.sFilePath);
+    }
+
+    WriteToCompilerLog({ LogType::ConsoleMessage, std::format(TEXT("{} {} of \"{}\" in {} of {} workspace scripts.{}"),
+        locations.size(), bDefinitions ? TEXT("definitions") : TEXT("references"), str2wstr(word), scripts.size(),
+        _workspaceIndex.ScriptsCount(), _workspaceIndex.IsIndexing() ? TEXT(" (still indexing, the list may be incomplete)") : TEXT("")) });
+
+    if (Settings().compilerWindowShowInfos)
+        _loggerWindow->showErrorsList();
+    else
+        WriteToCompilerLog({ LogType::ConsoleMessage, TEXT("Turn on the Messages filter of the errors list to browse them.") });
+}
+
 // Handling functions for plugin menu
 #pragma region
 
@@ -1233,6 +1586,9 @@ void Plugin::LockPluginMenu(bool toLock)
         EnablePluginMenuItem(PLUGINMENU_VIEWSCRIPTDEPENDENCIES, false);
     }
 
+    // Lookups write to the compiler window too
+    EnablePluginMenuItem(PLUGINMENU_GOTODEFINITION, !toLock);
+    EnablePluginMenuItem(PLUGINMENU_FINDALLREFERENCES, !toLock);
     EnablePluginMenuItem(PLUGINMENU_SHOWCONSOLE, !toLock);
     EnablePluginMenuItem(PLUGINMENU_SETTINGS, !toLock);
     EnablePluginMenuItem(PLUGINMENU_USERPREFERENCES, !toLock);
@@ -1509,7 +1865,9 @@ void Plugin::DoImportDefinitions()
 
     // We use a post-check to see whether all tags where updated. Also useful to avoid processing same tag twice 
     // (only happens if user tampered) with the file.
+    // The members lists are huge: they're written straight into the file when saving it (see below).
     bool bInstre1 = false, bType1 = false, bType2 = false, bType3 = false, bType4 = false, bType6 = false;
+    tinyxml2::XMLElement* engineStructsKeywords = nullptr, * constantsKeywords = nullptr, * functionsKeywords = nullptr;
     while (Keywords)
     {
         if (Keywords->Attribute("name", "instre1") && !bInstre1)
@@ -1526,8 +1884,7 @@ void Plugin::DoImportDefinitions()
 
         if (Keywords->Attribute("name", "type2") && !bType2)
         {
-            std::string generic_output = myResults.MembersAsSpacedString(NWScriptParser::MemberID::EngineStruct);
-            Keywords->SetText(generic_output.c_str());
+            engineStructsKeywords = Keywords;
             bType2 = true;
         }
 
@@ -1539,15 +1896,13 @@ void Plugin::DoImportDefinitions()
 
         if (Keywords->Attribute("name", "type4") && !bType4)
         {
-            std::string generic_output = myResults.MembersAsSpacedString(NWScriptParser::MemberID::Constant);
-            Keywords->SetText(generic_output.c_str());
+            constantsKeywords = Keywords;
             bType4 = true;
         }
 
         if (Keywords->Attribute("name", "type6") && !bType6)
         {
-            std::string generic_output = myResults.MembersAsSpacedString(NWScriptParser::MemberID::Function);
-            Keywords->SetText(generic_output.c_str());
+            functionsKeywords = Keywords;
             bType6 = true;
         }
 
@@ -1567,6 +1922,29 @@ void Plugin::DoImportDefinitions()
         return;
     }
 
+    // Save the lexer file now, while the results hold only the imported definitions (user objects and
+    // keywords are merged in below)
+    FILE* lexerFile = openXMLFile(_pluginPaths["PluginLexerConfigFilePath"]);
+    if (lexerFile)
+    {
+        XMLSplicePrinter lexerPrinter(lexerFile);
+        lexerPrinter.SpliceText(engineStructsKeywords, [&myResults](tinyxml2::XMLPrinter& printer) {
+            myResults.PrintMembersAsSpacedText(printer, NWScriptParser::MemberID::EngineStruct); });
+        lexerPrinter.SpliceText(constantsKeywords, [&myResults](tinyxml2::XMLPrinter& printer) {
+            myResults.PrintMembersAsSpacedText(printer, NWScriptParser::MemberID::Constant); });
+        lexerPrinter.SpliceText(functionsKeywords, [&myResults](tinyxml2::XMLPrinter& printer) {
+            myResults.PrintMembersAsSpacedText(printer, NWScriptParser::MemberID::Function); });
+        nwscriptDoc.Print(&lexerPrinter);
+    }
+    if (!lexerFile || !closeXMLFile(lexerFile))
+    {
+        errorStream << TEXT("Error while saving file: ") << _pluginPaths["PluginLexerConfigFilePath"] << "! \r\n";
+        errorStream << TEXT("Could not write to the file.");
+        MessageBox(NotepadHwnd(), errorStream.str().c_str(), pluginName.c_str(), MB_OK | MB_ICONERROR);
+        _NWScriptParseResults.reset();
+        return;
+    }
+
     if (!_NWScriptParseResults->SerializeToFile(_pluginPaths["NWScriptEngineObjectsFile"]))
     {
         errorStream << TEXT("Error while saving file: ") << _pluginPaths["NWScriptEngineObjectsFile"] << "! \r\n";
@@ -1575,6 +1953,7 @@ void Plugin::DoImportDefinitions()
         _NWScriptParseResults.reset();
         return;
     }
+    _autoCompleteIndexStale = true;
 
     // Now building auto-complete file.
     // We retrieve all fixed keywords and emplace them on results, so we can sort everything out
@@ -1586,21 +1965,11 @@ void Plugin::DoImportDefinitions()
     // Merge with known user objects to rebuild autoComplete file
     NWScriptParser::ScriptParseResults knownUserObjects;
     knownUserObjects.SerializeFromFile(_pluginPaths["NWScriptUserObjectsFile"]);
-    _NWScriptParseResults->Members.merge(knownUserObjects.Members);
+    _NWScriptParseResults->MergeMembers(knownUserObjects);
 
     if (!MergeAutoComplete())
         return;
 
-    error = nwscriptDoc.SaveFile(asciiFileStyler.c_str());
-    if (error)
-    {
-        errorStream << TEXT("Error while saving file: ") << _pluginPaths["PluginLexerConfigFilePath"] << "! \r\n";
-        errorStream << TEXT("Error ID: ") << nwscriptDoc.ErrorID();
-        MessageBox(NotepadHwnd(), errorStream.str().c_str(), pluginName.c_str(), MB_OK | MB_ICONERROR);
-        _NWScriptParseResults.reset();
-        return;
-    }
-
     // Save statistics.
     Settings().engineStructs = _NWScriptParseResults->EngineStructuresCount;
     Settings().engineFunctionCount = _NWScriptParseResults->FunctionsCount;
@@ -1622,17 +1991,12 @@ void Plugin::DoImportDefinitions()
 
 }
 
-void Plugin::DoImportUserTokens()
+bool Plugin::DoImportUserTokens(bool bInteractive)
 {
+    // The results already hold every known user object, synced with the source files (see ImportUserTokens)
     NWScriptParser::ScriptParseResults& myResults = *_NWScriptParseResults;
     tinyxml2::XMLDocument nwscriptDoc;
 
-    // Retrieve previous results and merge
-    NWScriptParser::ScriptParseResults knownUserObjects;
-    knownUserObjects.SerializeFromFile(_pluginPaths["NWScriptUserObjectsFile"]);
-    _NWScriptParseResults->Members.merge(knownUserObjects.Members);
-    _NWScriptParseResults->RecountStructs();
-
     // Set some Timestamp headers
     char timestamp[128]; time_t currTime;  struct tm currTimeP;
     time(&currTime);
@@ -1650,9 +2014,10 @@ void Plugin::DoImportUserTokens()
         errorStream << TEXT("Error while parsing file: ") << _pluginPaths["PluginLexerConfigFilePath"] << "! \r\n";
         errorStream << TEXT("File might be corrupted!\r\n");
         errorStream << TEXT("Error ID: ") << nwscriptDoc.ErrorID();
-        MessageBox(NotepadHwnd(), errorStream.str().c_str(), pluginName.c_str(), MB_OK | MB_ICONERROR);
+        if (bInteractive)
+            MessageBox(NotepadHwnd(), errorStream.str().c_str(), pluginName.c_str(), MB_OK | MB_ICONERROR);
         _NWScriptParseResults.reset();
-        return;
+        return false;
     }
 
     // Navigate to Keywords
@@ -1685,9 +2050,10 @@ void Plugin::DoImportUserTokens()
     {
         errorStream << TEXT("Error while parsing file: ") << _pluginPaths["PluginLexerConfigFilePath"] << "! \r\n";
         errorStream << TEXT("File might be corrupted!\r\n");
-        MessageBox(NotepadHwnd(), errorStream.str().c_str(), pluginName.c_str(), MB_OK | MB_ICONERROR);
+        if (bInteractive)
+            MessageBox(NotepadHwnd(), errorStream.str().c_str(), pluginName.c_str(), MB_OK | MB_ICONERROR);
         _NWScriptParseResults.reset();
-        return;
+        return false;
     }
 
     // We are only supporting our default lexer here
@@ -1696,9 +2062,10 @@ void Plugin::DoImportUserTokens()
         errorStream << TEXT("Error while parsing file: ") << _pluginPaths["PluginLexerConfigFilePath"] << "! \r\n";
         errorStream << TEXT("LexerType name for ") << str2wstr(LexerCatalogue::GetLexerName(0)) << TEXT(" not found!\r\n");
         errorStream << TEXT("File might be corrupted!\r\n");
-        MessageBox(NotepadHwnd(), errorStream.str().c_str(), pluginName.c_str(), MB_OK | MB_ICONERROR);
+        if (bInteractive)
+            MessageBox(NotepadHwnd(), errorStream.str().c_str(), pluginName.c_str(), MB_OK | MB_ICONERROR);
         _NWScriptParseResults.reset();
-        return;
+        return false;
     }
 
     // Call helper function to strip all comments from document, since we're merging the file, not recreating it.
@@ -1719,20 +2086,20 @@ void Plugin::DoImportUserTokens()
 
     // We use a post-check to see whether all tags where updated. Also useful to avoid processing same tag twice 
     // (only happens if user tampered) with the file.
+    // The members lists are written straight into the file when saving it (see below).
     bool bType5 = false, bType7 = false;
+    tinyxml2::XMLElement* constantsWordsStyle = nullptr, * functionsWordsStyle = nullptr;
     while (WordsStyle)
     {
         if (WordsStyle->Attribute("keywordClass", "type5") && !bType5)
         {
-            std::string generic_output = myResults.MembersAsSpacedString(NWScriptParser::MemberID::Constant);
-            WordsStyle->SetText(generic_output.c_str());
+            constantsWordsStyle = WordsStyle;
             bType5 = true;
         }
 
         if (WordsStyle->Attribute("keywordClass", "type7") && !bType7)
         {
-            std::string generic_output = myResults.MembersAsSpacedString(NWScriptParser::MemberID::Function);
-            WordsStyle->SetText(generic_output.c_str());
+            functionsWordsStyle = WordsStyle;
             bType7 = true;
         }
 
@@ -1746,37 +2113,50 @@ void Plugin::DoImportUserTokens()
         errorStream << TEXT("The following nodes could not be found!\r\n");
         errorStream << TEXT("Nodes: [") << (!bType5 ? TEXT(" type2") : TEXT("")) << (!bType7 ? TEXT(" type4") : TEXT(""));
         errorStream << TEXT("File might be corrupted!\r\n");
-        MessageBox(NotepadHwnd(), errorStream.str().c_str(), pluginName.c_str(), MB_OK | MB_ICONERROR);
+        if (bInteractive)
+            MessageBox(NotepadHwnd(), errorStream.str().c_str(), pluginName.c_str(), MB_OK | MB_ICONERROR);
         _NWScriptParseResults.reset();
-        return;
+        return false;
+    }
+
+    // Save the lexer file now, while the results hold only user objects (engine objects are merged in below)
+    FILE* lexerFile = openXMLFile(_pluginPaths["PluginLexerConfigFilePath"]);
+    if (lexerFile)
+    {
+        XMLSplicePrinter lexerPrinter(lexerFile);
+        lexerPrinter.SpliceText(constantsWordsStyle, [&myResults](tinyxml2::XMLPrinter& printer) {
+            myResults.PrintMembersAsSpacedText(printer, NWScriptParser::MemberID::Constant); });
+        lexerPrinter.SpliceText(functionsWordsStyle, [&myResults](tinyxml2::XMLPrinter& printer) {
+            myResults.PrintMembersAsSpacedText(printer, NWScriptParser::MemberID::Function); });
+        nwscriptDoc.Print(&lexerPrinter);
+    }
+    if (!lexerFile || !closeXMLFile(lexerFile))
+    {
+        errorStream << TEXT("Error while saving file: ") << _pluginPaths["PluginLexerConfigFilePath"] << "! \r\n";
+        errorStream << TEXT("Could not write to the file.");
+        if (bInteractive)
+            MessageBox(NotepadHwnd(), errorStream.str().c_str(), pluginName.c_str(), MB_OK | MB_ICONERROR);
+        _NWScriptParseResults.reset();
+        return false;
     }
 
     if (!_NWScriptParseResults->SerializeToFile(_pluginPaths["NWScriptUserObjectsFile"]))
     {
         errorStream << TEXT("Error while saving file: ") << _pluginPaths["NWScriptUserObjectsFile"] << "! \r\n";
         errorStream << TEXT("Error ID: ") << nwscriptDoc.ErrorID();
-        MessageBox(NotepadHwnd(), errorStream.str().c_str(), pluginName.c_str(), MB_OK | MB_ICONERROR);
+        if (bInteractive)
+            MessageBox(NotepadHwnd(), errorStream.str().c_str(), pluginName.c_str(), MB_OK | MB_ICONERROR);
         _NWScriptParseResults.reset();
-        return;
+        return false;
     }
 
     // Merge with known user engine to rebuild autoComplete file
     NWScriptParser::ScriptParseResults knownEngineObjects;
     knownEngineObjects.SerializeFromFile(_pluginPaths["NWScriptEngineObjectsFile"]);
-    _NWScriptParseResults->Members.merge(knownEngineObjects.Members);
-
-    if (!MergeAutoComplete())
-        return;
+    _NWScriptParseResults->MergeMembers(knownEngineObjects);
 
-    error = nwscriptDoc.SaveFile(asciiFileStyler.c_str());
-    if (error)
-    {
-        errorStream << TEXT("Error while saving file: ") << _pluginPaths["PluginLexerConfigFilePath"] << "! \r\n";
-        errorStream << TEXT("Error ID: ") << nwscriptDoc.ErrorID();
-        MessageBox(NotepadHwnd(), errorStream.str().c_str(), pluginName.c_str(), MB_OK | MB_ICONERROR);
-        _NWScriptParseResults.reset();
-        return;
-    }
+    if (!MergeAutoComplete(bInteractive))
+        return false;
 
     // Save statistics.
     Settings().userFunctionCount = _NWScriptParseResults->FunctionsCount;
@@ -1784,6 +2164,11 @@ void Plugin::DoImportUserTokens()
 
     // Close our results (for memory cleanup) and report back.
     _NWScriptParseResults.reset();
+    _userTokensWatcher.Reload();
+    _autoCompleteIndexStale = true;
+    if (!bInteractive)
+        return true;
+
     int mResult = MessageBox(NotepadHwnd(),
         TEXT("Notepad++ needs to be restarted for the new settings to be reflected. Do it now?"),
         TEXT("Import successful!"), MB_YESNO | MB_ICONINFORMATION);
@@ -1795,6 +2180,8 @@ void Plugin::DoImportUserTokens()
         SetRestartHook(RestartMode::Normal, RestartFunctionHook::None);
         Messenger().SendNppMessage(WM_CLOSE, 0, 0);
     }
+
+    return true;
 }
 
 RestartMode Plugin::DoResetUserTokens(RestartFunctionHook whichPhase)
@@ -1913,6 +2300,9 @@ RestartMode Plugin::DoResetUserTokens(RestartFunctionHook whichPhase)
     }
 
     DeleteFile(_pluginPaths["NWScriptUserObjectsFile"].c_str());
+    _userTokensWatcher.Reload();
+    _liveUserTokens = false;
+    _autoCompleteIndexStale = true;
 
     // Save statistics.
     Settings().userFunctionCount = 0;
@@ -2307,7 +2697,7 @@ bool Plugin::PatchDarkThemeXMLFile()
     return true;
 }
 
-bool Plugin::MergeAutoComplete()
+bool Plugin::MergeAutoComplete(bool bInteractive)
 {
     NWScriptParser::ScriptParseResults& myResults = *_NWScriptParseResults;
 
@@ -2319,63 +2709,72 @@ bool Plugin::MergeAutoComplete()
     std::string xmlHeaderComment = XMLDOCHEADER;
     xmlHeaderComment.append(timestamp).append(".\r\n");
 
-    std::string asciiFileAutoC = wstr2str(_pluginPaths["PluginAutoCompleteFilePath"]);
-    tinyxml2::XMLDocument nwscriptAutoc;
-
-    nwscriptAutoc.InsertFirstChild(nwscriptAutoc.NewDeclaration());
-    nwscriptAutoc.InsertEndChild(nwscriptAutoc.NewComment(xmlHeaderComment.c_str()));
+    // Recreating the file from scratch, it's streamed straight to disk (there's a node per member and param,
+    // thousands of them)
+    generic_stringstream errorStream;
+    FILE* autoCompleteFile = openXMLFile(_pluginPaths["PluginAutoCompleteFilePath"]);
+    if (!autoCompleteFile)
+    {
+        errorStream << TEXT("Error while saving file: ") << _pluginPaths["PluginAutoCompleteFilePath"] << "! \r\n";
+        errorStream << TEXT("Could not open the file for writing.");
+        if (bInteractive)
+            MessageBox(NotepadHwnd(), errorStream.str().c_str(), pluginName.c_str(), MB_OK | MB_ICONERROR);
+        _NWScriptParseResults.reset();
+        return false;
+    }
 
-    tinyxml2::XMLNode* autocRoot = nwscriptAutoc.NewElement("NotepadPlus");
-    nwscriptAutoc.InsertEndChild(autocRoot);
+    tinyxml2::XMLPrinter autoc(autoCompleteFile);
+    autoc.PushDeclaration("xml version=\"1.0\" encoding=\"UTF-8\"");
+    autoc.PushComment(xmlHeaderComment.c_str());
 
-    autocRoot->InsertEndChild(nwscriptAutoc.NewComment(XMLAUTOCLANGCOMMENT));
-    tinyxml2::XMLElement* autocNode = nwscriptAutoc.NewElement("AutoComplete");
-    autocNode->SetAttribute("language", LexerCatalogue::GetLexerName(0).c_str());
-    autocRoot->InsertEndChild(autocNode);
+    autoc.OpenElement("NotepadPlus");
+    autoc.PushComment(XMLAUTOCLANGCOMMENT);
+    autoc.OpenElement("AutoComplete");
+    autoc.PushAttribute("language", LexerCatalogue::GetLexerName(0).c_str());
 
-    autocNode->InsertEndChild(nwscriptAutoc.NewComment(XMLAUTOCENVCOMMENT));
-    tinyxml2::XMLElement* environmentNode = nwscriptAutoc.NewElement("Environment");
-    environmentNode->SetAttribute("ignoreCase", "no"); environmentNode->SetAttribute("startFunc", "("); environmentNode->SetAttribute("stopFunc", ")");
-    environmentNode->SetAttribute("paramSeparator", ","); environmentNode->SetAttribute("terminal", ";"); environmentNode->SetAttribute("additionalWordChar", "");
-    autocNode->InsertEndChild(environmentNode);
+    autoc.PushComment(XMLAUTOCENVCOMMENT);
+    autoc.OpenElement("Environment");
+    autoc.PushAttribute("ignoreCase", "no"); autoc.PushAttribute("startFunc", "("); autoc.PushAttribute("stopFunc", ")");
+    autoc.PushAttribute("paramSeparator", ","); autoc.PushAttribute("terminal", ";"); autoc.PushAttribute("additionalWordChar", "");
+    autoc.CloseElement();
 
-    autocNode->InsertEndChild(nwscriptAutoc.NewComment(XMLAUTOCSORTNOTICE));
+    autoc.PushComment(XMLAUTOCSORTNOTICE);
 
-    // Now, we iterate through all parsing results and add their nodes to autocNode
-    for (NWScriptParser::ScriptMember m : myResults.Members)
-    {
-        tinyxml2::XMLElement* keyword = nwscriptAutoc.NewElement("KeyWord");
-        keyword->SetAttribute("name", m.sName.c_str());
+    // Now, we iterate through all parsing results and write their nodes inside AutoComplete
+    std::string paramName;
+    myResults.ForEachMember([&](const NWScriptParser::ScriptMember& m) {
+        autoc.OpenElement("KeyWord");
+        autoc.PushAttribute("name", m.sName.c_str());
         if (m.mID == NWScriptParser::MemberID::Function)
         {
-            keyword->SetAttribute("func", "yes");
-            tinyxml2::XMLElement* overload = nwscriptAutoc.NewElement("Overload");
-            overload->SetAttribute("retVal", m.sType.c_str());
+            autoc.PushAttribute("func", "yes");
+            autoc.OpenElement("Overload");
+            autoc.PushAttribute("retVal", m.sType.c_str());
 
-            for (NWScriptParser::ScriptParamMember p : m.params)
+            for (const NWScriptParser::ScriptParamMember& p : m.params)
             {
-                tinyxml2::XMLElement* param = nwscriptAutoc.NewElement("Param");
-                std::string paramName = p.sType.c_str();
-                paramName.append(" ").append(p.sName);
+                autoc.OpenElement("Param");
+                paramName.assign(p.sType).append(" ").append(p.sName);
                 if (!p.sDefaultValue.empty())
                     paramName.append("=").append(p.sDefaultValue);
-                param->SetAttribute("name", paramName.c_str());
-
-                overload->InsertEndChild(param);
+                autoc.PushAttribute("name", paramName.c_str());
+                autoc.CloseElement();
             }
-            keyword->InsertEndChild(overload);
+            autoc.CloseElement();
         }
-        autocNode->InsertEndChild(keyword);
-    }
+        autoc.CloseElement();
+    });
 
-    // Finally, save files...
-    generic_stringstream errorStream;
-    error = nwscriptAutoc.SaveFile(asciiFileAutoC.c_str());
-    if (error)
+    autoc.CloseElement();
+    autoc.CloseElement();
+
+    // Finally, close the file...
+    if (!closeXMLFile(autoCompleteFile))
     {
         errorStream << TEXT("Error while saving file: ") << _pluginPaths["PluginAutoCompleteFilePath"] << "! \r\n";
-        errorStream << TEXT("Error ID: ") << nwscriptAutoc.ErrorID();
-        MessageBox(NotepadHwnd(), errorStream.str().c_str(), pluginName.c_str(), MB_OK | MB_ICONERROR);
+        errorStream << TEXT("Could not write to the file.");
+        if (bInteractive)
+            MessageBox(NotepadHwnd(), errorStream.str().c_str(), pluginName.c_str(), MB_OK | MB_ICONERROR);
         _NWScriptParseResults.reset();
         return false;
     }
@@ -2460,6 +2859,12 @@ void Plugin::ImportUserTokensCallback(HRESULT decision)
     Instance().DoImportUserTokens();
 }
 
+// Receives notifications from User's Preferences Dialog (only when accepted)
+void Plugin::UserPreferencesCallback(HRESULT decision)
+{
+    Instance().SetupUserTokensWatcher();
+}
+
 // Receives notifications from Batch Processing Dialog
 void Plugin::BatchProcessDialogCallback(HRESULT decision)
 {
@@ -2484,27 +2889,52 @@ void Plugin::BatchProcessDialogCallback(HRESULT decision)
     // Setup interrupt flag
     inst._processingFilesDialog->setInterruptFlag(inst._batchInterrupt);
 
+    // The previous batch's files list may still be winding down (stopped batches stop it too)
+    if (inst._batchFilesBuilder.joinable())
+        inst._batchFilesBuilder.join();
+
     // Reset batch state
     inst.ResetBatchStates();
+    inst._batchTelemetry.start(1);
+    inst._batchResourceCacheBaseline = inst._compiler.resourceCacheCounters();
 
     // Prepare compiler
     inst.Compiler().reset();
     inst.Compiler().setMode(inst._settings.batchCompileMode);
-    // Set callback to batch process
+    // Set callback to batch process. Outputs are only waited for once the batch ends.
     inst.Compiler().setProcessingEndCallback(BatchProcessFilesCallback);
+    inst.Compiler().setBatchMode(true);
 
     // Display and clear compiler log window
     inst._loggerWindow->reset();
     inst.DisplayCompilerLogWindow(true);
 
+    // Unchanged scripts take their outputs from the compile cache. Trimmed here rather than when
+    // the batch ends, so finishing one doesn't wait on it.
+    if (!inst._compileCache)
+    {
+        inst._compileCache = std::make_unique<CompileCache>(inst._pluginPaths["PluginConfigDir"] / "CompileCache", COMPILECACHEMAXBYTES);
+        std::string errorMessage;
+        if (!inst._compileCache->open(errorMessage))
+        {
+            WriteToCompilerLog({ LogType::Warning, str2wstr(errorMessage) + TEXT(". Compiling without the compile cache.") });
+            inst._compileCache = nullptr;
+        }
+    }
+    if (inst._compileCache)
+    {
+        inst._compileCache->trim();
+        inst.Compiler().setCompileCache(inst._compileCache.get());
+    }
+    inst._batchCompileCacheBaseline = inst.Compiler().compileCacheCounters();
+
     // Initial status dialog
     inst._processingFilesDialog->setStatus(TEXT("Building files list..."));
     inst._processingFilesDialog->showDialog();
 
     // The rest processes when file filters are done in separate thread
 #ifdef USE_THREADS
-    std::thread tBuilder(&Plugin::BuildFilesList, &inst);
-    tBuilder.detach();
+    inst._batchFilesBuilder = std::thread(&Plugin::BuildFilesList, &inst);
 #else
     inst.BuildFilesList();
 #endif
@@ -2617,14 +3047,83 @@ void Plugin::BuildFilesList()
     else
         fileFilters = _settings.getFileFiltersDisasmV();
 
-    // Iterate on all filters
-    for (const auto& entry : fileFilters)
-        createFilesList(_batchFilesToProcess, _settings.startingBatchFolder, entry, _settings.recurseSubFolders, _batchInterrupt);
+    // All filters are matched in a single walk of the folders, done in the background: the batch
+    // starts with the first file found instead of waiting for the whole list.
+    std::thread walker([this, fileFilters]() {
+        DirectoryWalker::Walk(_settings.startingBatchFolder, fileFilters, _settings.recurseSubFolders, _batchInterrupt,
+            [this](const generic_string& filePath) {
+                std::lock_guard<std::mutex> guard(_batchFilesLock);
+                _batchFilesToProcess.push_back(filePath);
+                _batchTelemetry.filesQueued();
+                _batchFilesFound.notify_all();
+            });
+
+        std::lock_guard<std::mutex> guard(_batchFilesLock);
+        _batchFilesListDone = true;
+        _batchFilesFound.notify_all();
+    });
 
     // Kickstart the batch process. We may be creating a 3rd thread here, because
     // batch will process on separate threads, but
     // for now, I don't see a better way of doing this...
     BatchProcessFilesCallback(static_cast<HRESULT>(static_cast<int>(true)));
+
+    walker.join();
+}
+
+bool Plugin::TakeNextBatchFile(generic_string& outFile)
+{
+    std::unique_lock<std::mutex> guard(_batchFilesLock);
+
+    // Nobody notifies interruptions, so check them once in a while
+    while (_batchCurrentFileIndex >= _batchFilesToProcess.size() && !_batchFilesListDone && !_batchInterrupt)
+        _batchFilesFound.wait_for(guard, std::chrono::milliseconds(100));
+
+    if (_batchCurrentFileIndex >= _batchFilesToProcess.size() || _batchInterrupt)
+        return false;
+
+    outFile = _batchFilesToProcess[_batchCurrentFileIndex].c_str();
+    _batchCurrentFileIndex++;
+    return true;
+}
+
+void Plugin::UpdateBatchTelemetry()
+{
+    _batchTelemetry.fileCompleted();
+    _batchTelemetry.fileDone(_compiler.lastFileTimings());
+
+    // Batches run on the plugin's single compiler, which has no include cache
+    const BatchTelemetry::CacheCounters resourceCache = _compiler.resourceCacheCounters();
+    const BatchTelemetry::CacheCounters compileCache = _compiler.compileCacheCounters();
+    _batchTelemetry.setCacheCounters({}, { resourceCache.hits - _batchResourceCacheBaseline.hits,
+        resourceCache.misses - _batchResourceCacheBaseline.misses }, { compileCache.hits - _batchCompileCacheBaseline.hits,
+        compileCache.misses - _batchCompileCacheBaseline.misses });
+
+    _processingFilesDialog->setTelemetry(_batchTelemetry.snapshot());
+}
+
+void Plugin::WriteBatchTelemetryReport()
+{
+    _batchTelemetry.finish();
+    const BatchTelemetry::Snapshot snapshot = _batchTelemetry.snapshot();
+    if (snapshot.filesDone == 0)
+        return;
+
+    WriteToCompilerLog({ LogType::ConsoleMessage, std::format(TEXT("Throughput: {:.1f} files/s, {:.1f} KB/s read, {:.1f} KB written, compiler busy {:.0f}% of the time."),
+        snapshot.filesPerSecond, snapshot.bytesPerSecond / 1024.0, snapshot.bytesWritten / 1024.0, snapshot.workerUtilization * 100.0) });
+    if (snapshot.resourceCache.hits + snapshot.resourceCache.misses > 0)
+        WriteToCompilerLog({ LogType::ConsoleMessage, std::format(TEXT("Resource cache: {} hits, {} misses ({:.0f}% hit rate)."),
+            snapshot.resourceCache.hits, snapshot.resourceCache.misses, snapshot.resourceCache.hitRate() * 100.0) });
+    if (snapshot.compileCache.hits + snapshot.compileCache.misses > 0)
+        WriteToCompilerLog({ LogType::ConsoleMessage, std::format(TEXT("Compile cache: {} hits, {} misses ({:.0f}% hit rate)."),
+            snapshot.compileCache.hits, snapshot.compileCache.misses, snapshot.compileCache.hitRate() * 100.0) });
+
+    WriteToCompilerLog({ LogType::ConsoleMessage, TEXT("Slowest files:") });
+    for (const BatchTelemetry::FileTimings& file : snapshot.slowest)
+    {
+        WriteToCompilerLog({ LogType::ConsoleMessage, std::format(TEXT("  {:8.1f} ms  {} (load {:.1f} ms, compile {:.1f} ms, write {:.1f} ms)"),
+            file.totalMs, str2wstr(file.path), file.loadMs, file.compileMs, file.writeMs) });
+    }
 }
 
 // Receives notifications when a "Compile" menu command ends
@@ -2701,13 +3200,22 @@ void Plugin::BatchProcessFilesCallback(HRESULT decision)
 {
     Plugin& inst = Instance();
 
+    // The first call starts the batch, the others come after each file
+    if (inst._batchCurrentFileIndex > 0)
+        inst.UpdateBatchTelemetry();
+
     // Check for failed results
     if (static_cast<int>(decision) == static_cast<int>(false) && !inst._settings.continueCompileOnFail)
     {
+        inst.Compiler().flushOutputs();
         WriteToCompilerLog({ LogType::ConsoleMessage, TEXT("") });
         WriteToCompilerLog({ LogType::ConsoleMessage, TEXT("Failed to process file... batch processing stopped.") });
         WriteToCompilerLog({ LogType::ConsoleMessage, TEXT("Done.") });
 
+        // Stops the files list too, if it's still being built
+        inst._batchInterrupt = true;
+        inst.WriteBatchTelemetryReport();
+
         inst._processingFilesDialog->display(false);
         inst._loggerWindow->LockControls(false);
         inst.LockPluginMenu(false);
@@ -2718,11 +3226,17 @@ void Plugin::BatchProcessFilesCallback(HRESULT decision)
         return;
     }
 
+    // Pick next (or first) file in line. The files list may still be growing, so this can wait for it.
+    generic_string nextFile;
+    const bool bHasNextFile = inst.TakeNextBatchFile(nextFile);
+
     // Check for interruption requests.
     if (inst._batchInterrupt)
     {
+        inst.Compiler().flushOutputs();
         WriteToCompilerLog({ LogType::ConsoleMessage, TEXT("") });
         WriteToCompilerLog({ LogType::ConsoleMessage, TEXT("Batch processing interrupted by user's request.") });
+        inst.WriteBatchTelemetryReport();
 
         inst._processingFilesDialog->display(false);
         inst._loggerWindow->LockControls(false);
@@ -2730,24 +3244,27 @@ void Plugin::BatchProcessFilesCallback(HRESULT decision)
         return;
     }
 
-    // Pick next (or first) file in line.
-    if (inst._batchCurrentFileIndex < inst._batchFilesToProcess.size())
+    if (bHasNextFile)
     {
-        generic_string nextFile = inst._batchFilesToProcess[inst._batchCurrentFileIndex];
-        inst._batchCurrentFileIndex++;
-
         // Update status
         inst._processingFilesDialog->setStatus(nextFile);
 
         // This function will create a thread that will callback here again for next file...
+        inst._batchTelemetry.fileStarted();
         inst.DoCompileOrDisasm(nextFile, false, true);
     }
     else
     {
-        // Done processing, write messages to log, close processing dialog.
+        // Done processing: wait for the last outputs, write messages to log, close processing dialog.
+        const bool bOutputsWritten = inst.Compiler().flushOutputs();
         WriteToCompilerLog({ LogType::ConsoleMessage, TEXT("") });
-        WriteToCompilerLog({ LogType::ConsoleMessage, TEXT("Finished processing ") +
-            std::to_wstring(inst._batchFilesToProcess.size()) + TEXT(" files successfully.") });
+        if (bOutputsWritten)
+            WriteToCompilerLog({ LogType::ConsoleMessage, TEXT("Finished processing ") +
+                std::to_wstring(inst._batchFilesToProcess.size()) + TEXT(" files successfully.") });
+        else
+            WriteToCompilerLog({ LogType::ConsoleMessage, TEXT("Finished processing ") +
+                std::to_wstring(inst._batchFilesToProcess.size()) + TEXT(" files, but some outputs could not be written.") });
+        inst.WriteBatchTelemetryReport();
 
         inst._processingFilesDialog->display(false);
 
@@ -2878,6 +3395,7 @@ void Plugin::NavigateToCode(const generic_string& fileName, size_t lineNum, cons
     // So we schedule the execution to happen assynchronously with the smallest possible time frame.
     if (success && lineNum > -1)
     {
+        Instance()._navigationLine = lineNum;
         SetTimer(Instance().NotepadHwnd(), NAGIVATECALLBACKTIMER, USER_TIMER_MINIMUM, (TIMERPROC)RunScheduledReposition);
     }
 }
@@ -2888,7 +3406,7 @@ void Plugin::NavigateToCode(const generic_string& fileName, size_t lineNum, cons
 void CALLBACK Plugin::RunScheduledReposition(HWND hwnd, UINT message, UINT idTimer, DWORD dwTime)
 {
     PluginMessenger msg = Instance().Messenger();
-    int lineNum = Instance()._loggerWindow->getCurrentNavigationLine();
+    int lineNum = static_cast<int>(Instance()._navigationLine);
 
     int currentPosition = msg.SendSciMessage<int>(SCI_GETCURRENTPOS);
     int linePositionStart = msg.SendSciMessage<int>(SCI_POSITIONFROMLINE, (WPARAM)lineNum - 1);
@@ -3105,6 +3623,18 @@ PLUGINCOMMAND Plugin::ViewScriptDependencies()
     Instance().DoCompileOrDisasm(TEXT(""), true);
 }
 
+// Menu Command "Go to definition" function handler. 
+PLUGINCOMMAND Plugin::GoToDefinition()
+{
+    Instance().LookupInWorkspace(true);
+}
+
+// Menu Command "Find all references" function handler. 
+PLUGINCOMMAND Plugin::FindAllReferences()
+{
+    Instance().LookupInWorkspace(false);
+}
+
 //-------------------------------------------------------------
 
 // Opens the Plugin's Compiler Settings panel
@@ -3139,6 +3669,7 @@ PLUGINCOMMAND Plugin::UserPreferences()
     userPreferences.init(Instance().DllHModule(), Instance().NotepadHwnd());
     userPreferences.appendSettings(&Instance()._settings);
     userPreferences.setDarkModeInstalled(Instance()._pluginDarkThemeIs == DarkThemeStatus::Installed);
+    userPreferences.setOkDialogCallback(&Plugin::UserPreferencesCallback);
     userPreferences.doDialog();
 }
 
@@ -3270,28 +3801,44 @@ PLUGINCOMMAND Plugin::ImportUserTokens()
         TEXT("NWScript Files (*.nss)\0*.nss\0All Files (*.*)\0*.*"),
         properDirNameW(Instance().Settings().lastOpenedDir), true))
     {
-        // Opens the NWScript file and parse it. Keep the results for later use
+        // Start from the known user objects and only parse the files (selected or imported before) that changed
+        // since. Keep the results for later use
         NWScriptParser nParser(Instance().NotepadHwnd());
 
         Instance()._NWScriptParseResults = std::make_unique<NWScriptParser::ScriptParseResults>();
         NWScriptParser::ScriptParseResults& myResults = *Instance()._NWScriptParseResults;
+        myResults.SerializeFromFile(Instance()._pluginPaths["NWScriptUserObjectsFile"]);
 
-        bool bSuccess = nParser.ParseBatch(nFileNames, myResults);
+        NWScriptParser::SourceSyncResults syncResults;
+        bool bSuccess = nParser.SyncSources(nFileNames, myResults, syncResults);
         if (!bSuccess)
         {
+            Instance()._NWScriptParseResults.reset();
             MessageBox(Instance().NotepadHwnd(), TEXT("Error while parsing file(s).\r\nOne or more of the selected files might be inaccessible."),
                 TEXT("Error parsing file"), MB_ICONERROR | MB_OK);
             return;
         }
 
         // Last check for results: File empty?
-        if (myResults.FunctionsCount == 0 && myResults.ConstantsCount == 0)
+        if (myResults.FunctionsCount == 0 && myResults.ConstantsCount == 0 && !syncResults.HasChanges())
         {
+            Instance()._NWScriptParseResults.reset();
             MessageBox(Instance().NotepadHwnd(), TEXT("File analysis didn't find anything to import!"), pluginName.c_str(),
                 MB_ICONEXCLAMATION | MB_OK);
             return;
         }
 
+        // Nothing to rewrite in the lexer and auto-complete files; still store the new file times, so next
+        // time these files aren't read again.
+        if (!syncResults.HasChanges())
+        {
+            myResults.SerializeToFile(Instance()._pluginPaths["NWScriptUserObjectsFile"]);
+            Instance()._NWScriptParseResults.reset();
+            MessageBox(Instance().NotepadHwnd(), TEXT("User-defined tokens are already up to date."), pluginName.c_str(),
+                MB_ICONINFORMATION | MB_OK);
+            return;
+        }
+
         // Show File Parsing Results dialog message and since we don't want it to be modal, wait for callback in ImportDefinitionsCallback.
         parseDialog.setEngineStructuresCount(myResults.EngineStructuresCount);
         parseDialog.setFunctionDefinitionsCount(myResults.FunctionsCount);
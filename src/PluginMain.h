@@ -9,6 +9,8 @@
 
 #include <vector>
 #include <filesystem>
+#include <condition_variable>
+#include <mutex>
 
 #include "Common.h"
 #include "Notepad_plus_msgs.h"
@@ -19,6 +21,9 @@
 #include "Settings.h"
 #include "NWScriptParser.h"
 #include "NWScriptCompiler.h"
+#include "UserTokensWatcher.h"
+#include "AutoCompleteIndex.h"
+#include "WorkspaceIndex.h"
 
 #include "AboutDialog.h"
 #include "LoggerDialog.h"
@@ -100,6 +105,8 @@ namespace NWScriptPlugin {
 		LineIndentor& Indentor() { return _indentor; }
 		// Retrieve the Compiler Object
 		NWScriptCompiler& Compiler() { return _compiler; };
+		// Progress and throughput of the running (or last) batch
+		BatchTelemetry::Snapshot BatchTelemetrySnapshot() const { return _batchTelemetry.snapshot(); }
 		// Retrieve's Plugin's Module Handle
 		HMODULE DllHModule() const { return _dllHModule; }
 		// Retrieves Notepad++ HWND
@@ -143,6 +150,10 @@ namespace NWScriptPlugin {
 		static PLUGINCOMMAND FetchPreprocessorText();
 		// Menu Command "View Script Dependencies" function handler. 
 		static PLUGINCOMMAND ViewScriptDependencies();
+		// Menu Command "Go to definition" function handler. 
+		static PLUGINCOMMAND GoToDefinition();
+		// Menu Command "Find all references" function handler. 
+		static PLUGINCOMMAND FindAllReferences();
 		// Menu Command "Compiler settings" function handler. 
 		static PLUGINCOMMAND CompilerSettings();
 		// Menu Command "Compiler settings" function handler. 
@@ -206,6 +217,24 @@ namespace NWScriptPlugin {
 		void CheckDarkModeLegacy();
 		// Detects Dark Mode usage (for Notepad++ 8.3.4 and above)
 		void RefreshDarkMode(bool ForceUseDark = false, bool UseDark = false);
+		// Starts/stops the background user tokens watcher, following Settings().autoRefreshUserTokens
+		void SetupUserTokensWatcher();
+		// Applies the user tokens from the watcher to the lexer and the config files. Runs on a timer.
+		static void CALLBACK RunUserTokensUpdate(HWND hwnd, UINT message, UINT idTimer, DWORD dwTime);
+		// Sends the live user tokens lists to the current editor (when it's using the plugin's lexer)
+		void PushUserTokensToLexer();
+		// Shows the ranked auto-complete list for the word at the caret (Settings().rankedAutoComplete)
+		void ShowRankedAutoComplete();
+		// Closes the ranked auto-complete list and gives Notepad++ back its auto-complete settings
+		void CloseRankedAutoComplete();
+		// Counts the symbols used in the current document, for the auto-complete ranking
+		void CountAutoCompleteUsage();
+		// Points the workspace index to the include and batch folders, plus the folders of the scripts looked up from
+		void UpdateWorkspaceFolders();
+		// Identifier at the caret, for the workspace lookups (empty if there's none)
+		std::string GetWordAtCaret();
+		// Looks an identifier up in the workspace index. Goes straight to a single definition, lists anything else.
+		void LookupInWorkspace(bool bDefinitions);
 
 		// ### Initialization -> Menu handling
 
@@ -232,6 +261,8 @@ namespace NWScriptPlugin {
 		static void ImportUserTokensCallback(HRESULT decision);
 		// Batch processing Dialog callback
 		static void BatchProcessDialogCallback(HRESULT decision);
+		// User's preferences callback
+		static void UserPreferencesCallback(HRESULT decision);
 
 		// ### Compiler functionality
 
@@ -242,12 +273,20 @@ namespace NWScriptPlugin {
 		void DoCompileOrDisasm(generic_string filePath = TEXT(""), bool fromCurrentScintilla = false, bool batchOperations = false);
 		// Reset batch processing states
 		void ResetBatchStates() {
+			std::lock_guard<std::mutex> guard(_batchFilesLock);
 			_batchCurrentFileIndex = 0;
 			_batchInterrupt = 0;
 			_batchFilesToProcess.clear();
+			_batchFilesListDone = false;
 		}
-		// Build the batch files list in async thread
+		// Build the batch files list in async thread, starting the batch with the first file found
 		void BuildFilesList();
+		// Next file of the batch, waiting for the files list if needed. False when the list is done (or interrupted).
+		bool TakeNextBatchFile(generic_string& outFile);
+		// Adds the file the compiler just processed to the batch telemetry and shows the progress
+		void UpdateBatchTelemetry();
+		// Writes throughput, cache hit rates and the slowest files of the batch to the compiler log
+		void WriteBatchTelemetryReport();
 
 		// Some callback functions for different operations
 
@@ -273,8 +312,9 @@ namespace NWScriptPlugin {
 
 		// Import a parsed result from NWScript file definitions into our language XML file. Function HEAVY on error handling!
 		void DoImportDefinitions();
-		// Import a parsed result from User tokens definitions into our language XML file.
-		void DoImportUserTokens();
+		// Import a parsed result from User tokens definitions into our language XML file. Non-interactive imports
+		// (from the user tokens watcher) don't show errors nor ask to restart.
+		bool DoImportUserTokens(bool bInteractive = true);
 		// Clear all user tokens
 		RestartMode DoResetUserTokens(RestartFunctionHook whichPhase = RestartFunctionHook::None);
 		// Resets the Editor Colors. Returns a restart mode if necessary.
@@ -290,7 +330,7 @@ namespace NWScriptPlugin {
 		// Helper to patch the Default XML Styler. This is different, since we must preserve user information.
 		bool PatchDefaultThemeXMLFile();
 		// Helper to merge AutoComplete file
-		bool MergeAutoComplete();
+		bool MergeAutoComplete(bool bInteractive = true);
 		// Patch the OverrideMap XML list
 		bool CheckAndPatchOverrideMapXMLFile();
 
@@ -332,6 +372,21 @@ namespace NWScriptPlugin {
 		HICON _dockingIcon;				// needs persistent info for docking data
 		generic_string _dockingTitle;   // needs persistent info for docking data
 		std::unique_ptr<NWScriptParser::ScriptParseResults> _NWScriptParseResults;
+		UserTokensWatcher _userTokensWatcher;
+		// User tokens lists pushed to the lexer, once the watcher found changes (_liveUserTokens)
+		bool _liveUserTokens = false;
+		std::string _liveUserConstants;
+		std::string _liveUserFunctions;
+		// Ranked auto-complete. Built when first needed, then again after the objects files change.
+		AutoCompleteIndex _autoCompleteIndex;
+		std::vector<AutoCompleteIndex::Match> _autoCompleteMatches;
+		bool _autoCompleteIndexStale = true;
+		bool _rankedAutoCompleteShown = false;
+		// Identifier cross-references of the workspace scripts
+		WorkspaceIndex _workspaceIndex;
+		std::vector<WorkspaceIndex::Folder> _workspaceDocumentFolders;
+		// Line to go to, when a navigation timer fires
+		size_t _navigationLine = 0;
 
 		// Persistent dialogs
 		std::unique_ptr<LoggerDialog> _loggerWindow;
@@ -354,6 +409,18 @@ namespace NWScriptPlugin {
 		std::vector<fs::path> _batchFilesToProcess;
 		size_t _batchCurrentFileIndex = 0;
 		std::atomic<bool> _batchInterrupt = false;
+		// The files list grows while the batch runs: these guard it and tell when it's done
+		std::mutex _batchFilesLock;
+		std::condition_variable _batchFilesFound;
+		bool _batchFilesListDone = false;
+		std::thread _batchFilesBuilder;
+		// Progress of the batch. The resource and compile cache counters go on between batches, so the
+		// values they had when the batch started are kept.
+		BatchTelemetry _batchTelemetry;
+		BatchTelemetry::CacheCounters _batchResourceCacheBaseline;
+		BatchTelemetry::CacheCounters _batchCompileCacheBaseline;
+		// Outputs of the scripts batches compiled, in the plugin's config directory. Opened by the first batch.
+		std::unique_ptr<CompileCache> _compileCache;
 
 		// Meta Information about the plugin paths
 		std::map<std::string, fs::path> _pluginPaths;
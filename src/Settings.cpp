@@ -58,6 +58,7 @@ void Settings::Load()
 	useNonBiowareExtenstions = GetBoolean(TEXT("Compiler Settings"), TEXT("useNonBiowareExtenstions"));
 	generateSymbols = GetBoolean(TEXT("Compiler Settings"), TEXT("generateSymbols"));
 	compileVersion = GetNumber<int>(TEXT("Compiler Settings"), TEXT("compileVersion"));
+	maxCompileErrors = GetNumber<int>(TEXT("Compiler Settings"), TEXT("maxCompileErrors"));
 	useScriptPathToCompile = GetBoolean(TEXT("Compiler Settings"), TEXT("useScriptPathToCompile"));
 	outputCompileDir = properDirNameW(GetString(TEXT("Compiler Settings"), TEXT("outputCompileDir")));
 
@@ -75,6 +76,8 @@ void Settings::Load()
 	autoDisplayDisassembled = GetBoolean(TEXT("User's Preferences"), TEXT("autoDisplayDisassembled"));
 	autoDisplayDebugSymbols = GetBoolean(TEXT("User's Preferences"), TEXT("autoDisplayDebugSymbols"));
 	autoInstallDarkTheme = GetBoolean(TEXT("User's Preferences"), TEXT("autoInstallDarkTheme"));
+	autoRefreshUserTokens = GetBoolean(TEXT("User's Preferences"), TEXT("autoRefreshUserTokens"));
+	rankedAutoComplete = GetBoolean(TEXT("User's Preferences"), TEXT("rankedAutoComplete"));
 	legacyDarkModeUse = GetBoolean(TEXT("User's Preferences"), TEXT("legacyDarkModeUse"));
 	lastOpenedDir = properDirNameW(GetString(TEXT("User's Preferences"), TEXT("lastOpenedDir")));
 
@@ -180,6 +183,7 @@ void Settings::Save()
 	SetBoolean(TEXT("Compiler Settings"), TEXT("useNonBiowareExtenstions"), useNonBiowareExtenstions);
 	SetBoolean(TEXT("Compiler Settings"), TEXT("generateSymbols"), generateSymbols);
 	SetNumber<int>(TEXT("Compiler Settings"), TEXT("compileVersion"), compileVersion);
+	SetNumber<int>(TEXT("Compiler Settings"), TEXT("maxCompileErrors"), maxCompileErrors);
 	SetBoolean(TEXT("Compiler Settings"), TEXT("useScriptPathToCompile"), useScriptPathToCompile);
 	SetString(TEXT("Compiler Settings"), TEXT("outputCompileDir"), outputCompileDir);
 
@@ -197,6 +201,8 @@ void Settings::Save()
 	SetBoolean(TEXT("User's Preferences"), TEXT("autoDisplayDisassembled"), autoDisplayDisassembled);
 	SetBoolean(TEXT("User's Preferences"), TEXT("autoDisplayDebugSymbols"), autoDisplayDebugSymbols);
 	SetBoolean(TEXT("User's Preferences"), TEXT("autoInstallDarkTheme"), autoInstallDarkTheme);
+	SetBoolean(TEXT("User's Preferences"), TEXT("autoRefreshUserTokens"), autoRefreshUserTokens);
+	SetBoolean(TEXT("User's Preferences"), TEXT("rankedAutoComplete"), rankedAutoComplete);
 	SetBoolean(TEXT("User's Preferences"), TEXT("legacyDarkModeUse"), legacyDarkModeUse);
 	SetString(TEXT("User's Preferences"), TEXT("lastOpenedDir"), lastOpenedDir);
 
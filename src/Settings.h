@@ -57,6 +57,7 @@ namespace NWScriptPlugin {
 		bool useNonBiowareExtenstions = false;
 		bool generateSymbols = false;
 		int compileVersion = 174;
+		int maxCompileErrors = 0;       // Native compiler: errors to report before giving up (0/1 = stop at the first)
 		bool useScriptPathToCompile = true;
 		generic_string outputCompileDir;
 
@@ -72,6 +73,8 @@ namespace NWScriptPlugin {
 		bool autoDisplayDisassembled = true;
 		bool autoDisplayDebugSymbols = true;
 		bool autoInstallDarkTheme = false;
+		bool autoRefreshUserTokens = false;
+		bool rankedAutoComplete = false;
 		bool legacyDarkModeUse = false;
 		generic_string lastOpenedDir;
 
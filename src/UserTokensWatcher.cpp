@@ -0,0 +1,220 @@
+/** @file UserTokensWatcher.cpp
+ * Keeps the user-defined tokens in sync with their source files, in the background.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include "pch.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <set>
+
+#include "UserTokensWatcher.h"
+
+using namespace NWScriptPlugin;
+
+namespace {
+
+	// Copies the results out of their file: the watcher keeps them, and the plugin must still be able
+	// to rewrite that file meanwhile.
+	std::set<std::filesystem::path> sourceDirectories(NWScriptParser::ScriptParseResults& results)
+	{
+		std::set<std::filesystem::path> directories;
+		for (const auto& [path, source] : results.Sources())
+			directories.insert(std::filesystem::path(path).parent_path());
+		return directories;
+	}
+}
+
+void UserTokensWatcher::Start(const generic_string& userObjectsFile)
+{
+	if (IsRunning())
+		return;
+
+	_userObjectsFile = userObjectsFile;
+	_hStopEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+	_hReloadEvent = ::CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (!_hStopEvent || !_hReloadEvent)
+	{
+		Stop();
+		return;
+	}
+
+	_thread = std::thread(&UserTokensWatcher::Run, this);
+}
+
+void UserTokensWatcher::Stop()
+{
+	if (_thread.joinable())
+	{
+		::SetEvent(_hStopEvent);
+		_thread.join();
+	}
+
+	if (_hStopEvent)
+		::CloseHandle(_hStopEvent);
+	if (_hReloadEvent)
+		::CloseHandle(_hReloadEvent);
+	_hStopEvent = _hReloadEvent = NULL;
+
+	std::lock_guard<std::mutex> guard(_lock);
+	_pendingUpdate.reset();
+}
+
+void UserTokensWatcher::Reload()
+{
+	if (IsRunning())
+		::SetEvent(_hReloadEvent);
+}
+
+bool UserTokensWatcher::TakeUpdate(Update& outUpdate)
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	if (!_pendingUpdate)
+		return false;
+
+	outUpdate = std::move(*_pendingUpdate);
+	_pendingUpdate.reset();
+	return true;
+}
+
+int64_t UserTokensWatcher::FileWriteTime(const generic_string& filePath)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+	if (!::GetFileAttributesEx(filePath.c_str(), GetFileExInfoStandard, &attributes))
+		return 0;
+
+	return (static_cast<int64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+}
+
+void UserTokensWatcher::Run()
+{
+	NWScriptParser parser(NULL);
+	NWScriptParser::ScriptParseResults results;
+	int64_t userObjectsFileTime = 0;
+
+	// Wait handles: stop, reload, then one change notification per watched folder
+	std::vector<HANDLE> handles = { _hStopEvent, _hReloadEvent };
+	std::set<std::filesystem::path> directories;
+	bool bPolling = false;
+	bool bReload = true;
+	bool bStop = false;
+
+	auto closeWatches = [&handles]() {
+		for (size_t i = 2; i < handles.size(); i++)
+			::FindCloseChangeNotification(handles[i]);
+		handles.resize(2);
+	};
+
+	while (!bStop)
+	{
+		bool bRewatch = false;
+		if (bReload)
+		{
+			userObjectsFileTime = FileWriteTime(_userObjectsFile);
+			results = {};
+			results.SerializeFromFile(_userObjectsFile);
+			bReload = false;
+			bRewatch = true;
+		}
+
+		// The folders to watch change with the sources (new imports, deleted files)
+		std::set<std::filesystem::path> currentDirectories = sourceDirectories(results);
+		if (bRewatch || currentDirectories != directories)
+		{
+			closeWatches();
+			directories = std::move(currentDirectories);
+			bPolling = false;
+			for (const std::filesystem::path& directory : directories)
+			{
+				HANDLE hChange = INVALID_HANDLE_VALUE;
+				if (handles.size() < MAXIMUM_WAIT_OBJECTS)
+					hChange = ::FindFirstChangeNotification(directory.c_str(), FALSE,
+						FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+
+				if (hChange == INVALID_HANDLE_VALUE)
+					bPolling = true;
+				else
+					handles.push_back(hChange);
+			}
+
+			// Catches whatever changed before the folders were watched (also while Notepad++ was closed)
+			Sync(parser, results, userObjectsFileTime);
+			continue;
+		}
+
+		DWORD waitResult = ::WaitForMultipleObjects(static_cast<DWORD>(handles.size()), handles.data(), FALSE,
+			bPolling ? pollIntervalMs : INFINITE);
+		if (waitResult == WAIT_OBJECT_0)
+			break;
+		if (waitResult == WAIT_OBJECT_0 + 1)
+		{
+			bReload = true;
+			continue;
+		}
+		if (waitResult == WAIT_FAILED)
+		{
+			// Shouldn't happen; fall back to polling rather than spinning on a broken handle
+			closeWatches();
+			bPolling = true;
+			continue;
+		}
+
+		// A folder changed. Editors usually write a file in several steps (and a checkout touches many
+		// files), so collect changes until things settle down and sync them all at once.
+		if (waitResult != WAIT_TIMEOUT)
+		{
+			::FindNextChangeNotification(handles[waitResult - WAIT_OBJECT_0]);
+
+			const ULONGLONG firstChange = ::GetTickCount64();
+			for (;;)
+			{
+				const DWORD elapsed = static_cast<DWORD>(::GetTickCount64() - firstChange);
+				if (elapsed >= maxDelayMs)
+					break;
+
+				waitResult = ::WaitForMultipleObjects(static_cast<DWORD>(handles.size()), handles.data(), FALSE,
+					(std::min)(debounceMs, maxDelayMs - elapsed));
+				if (waitResult == WAIT_TIMEOUT || waitResult == WAIT_FAILED)
+					break;
+				if (waitResult == WAIT_OBJECT_0)
+				{
+					bStop = true;
+					break;
+				}
+				if (waitResult == WAIT_OBJECT_0 + 1)
+				{
+					bReload = true;
+					break;
+				}
+				::FindNextChangeNotification(handles[waitResult - WAIT_OBJECT_0]);
+			}
+
+			if (bStop || bReload)
+				continue;
+		}
+
+		Sync(parser, results, userObjectsFileTime);
+	}
+
+	closeWatches();
+}
+
+void UserTokensWatcher::Sync(NWScriptParser& parser, NWScriptParser::ScriptParseResults& results, int64_t nUserObjectsFileTime)
+{
+	// No files given: just the ones already imported
+	NWScriptParser::SourceSyncResults syncResults;
+	if (!parser.SyncSources({}, results, syncResults) || !syncResults.HasChanges())
+		return;
+
+	auto update = std::make_unique<Update>();
+	update->results = std::make_unique<NWScriptParser::ScriptParseResults>(results);
+	update->syncResults = syncResults;
+	update->nUserObjectsFileTime = nUserObjectsFileTime;
+
+	// Results are complete, not deltas: a newer update replaces one the UI didn't take yet
+	std::lock_guard<std::mutex> guard(_lock);
+	_pendingUpdate = std::move(update);
+}
@@ -0,0 +1,76 @@
+/** @file UserTokensWatcher.h
+ * Keeps the user-defined tokens in sync with their source files, in the background.
+ *
+ * Watches the folders of every file imported as user tokens (the sources recorded in the user objects
+ * file) with Windows change notifications. Folders that can't be watched (some network shares, or more
+ * of them than one wait can take) are polled instead. Change events are debounced and batched: a sync
+ * only runs once the folders stay quiet for a moment, and NWScriptParser::SyncSources() then re-parses
+ * just the files that changed. The results are handed to the UI thread, which polls TakeUpdate().
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "NWScriptParser.h"
+
+namespace NWScriptPlugin {
+
+	class UserTokensWatcher final
+	{
+	public:
+		struct Update {
+			std::unique_ptr<NWScriptParser::ScriptParseResults> results;
+			NWScriptParser::SourceSyncResults syncResults;
+			// Write time of the user objects file the results were synced from. If the file changed
+			// since (an import or reset), the update is stale.
+			int64_t nUserObjectsFileTime = 0;
+		};
+
+		// Waits this long without changes before syncing...
+		static constexpr DWORD debounceMs = 500;
+		// ...but no longer than this after the first change
+		static constexpr DWORD maxDelayMs = 5000;
+		// Interval for folders that can't be watched
+		static constexpr DWORD pollIntervalMs = 3000;
+
+		UserTokensWatcher() = default;
+		~UserTokensWatcher() { Stop(); }
+
+		UserTokensWatcher(const UserTokensWatcher&) = delete;
+		UserTokensWatcher& operator=(const UserTokensWatcher&) = delete;
+
+		// Starts watching the sources listed in the user objects file. Does nothing if already running.
+		void Start(const generic_string& userObjectsFile);
+		void Stop();
+		bool IsRunning() const { return _thread.joinable(); }
+
+		// Reads the user objects file again (after an import or reset) and syncs with it
+		void Reload();
+
+		// Takes the most recent update not yet taken. Called by the UI thread.
+		bool TakeUpdate(Update& outUpdate);
+
+		// Write time of a file, as stored in Update::nUserObjectsFileTime (0 if it doesn't exist)
+		static int64_t FileWriteTime(const generic_string& filePath);
+
+	private:
+		generic_string _userObjectsFile;
+		std::thread _thread;
+		HANDLE _hStopEvent = NULL;
+		HANDLE _hReloadEvent = NULL;
+
+		std::mutex _lock;
+		std::unique_ptr<Update> _pendingUpdate;
+
+		void Run();
+		// Syncs results with their sources and publishes them if anything changed
+		void Sync(NWScriptParser& parser, NWScriptParser::ScriptParseResults& results, int64_t nUserObjectsFileTime);
+	};
+
+}
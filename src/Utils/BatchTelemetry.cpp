@@ -0,0 +1,129 @@
+/** @file BatchTelemetry.cpp
+ * Progress and throughput counters of a batch run, readable while the batch goes on.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <algorithm>
+
+#include "BatchTelemetry.h"
+
+using namespace NWScriptPlugin;
+
+static bool slowerThan(const BatchTelemetry::FileTimings& a, const BatchTelemetry::FileTimings& b)
+{
+	return a.totalMs > b.totalMs;
+}
+
+void BatchTelemetry::start(int workers)
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	_counters = Snapshot();
+	_counters.workers = workers;
+	_slowest.clear();
+	_busyMs = 0;
+	_startTime = _lastBusyChange = Clock::now();
+	_endTime = Clock::time_point();
+}
+
+void BatchTelemetry::finish()
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	_endTime = Clock::now();
+	accumulateBusy(_endTime);
+	_counters.finished = true;
+}
+
+void BatchTelemetry::filesQueued(uint64_t count)
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	_counters.filesQueued += count;
+}
+
+void BatchTelemetry::fileStarted()
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	accumulateBusy(Clock::now());
+	_counters.filesStarted++;
+	_counters.workersBusy++;
+}
+
+void BatchTelemetry::fileCompleted()
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	accumulateBusy(Clock::now());
+	if (_counters.workersBusy > 0)
+		_counters.workersBusy--;
+}
+
+void BatchTelemetry::fileDone(const FileTimings& timings)
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	_counters.filesDone++;
+	if (timings.failed)
+		_counters.filesFailed++;
+	_counters.bytesRead += timings.bytesRead;
+	_counters.bytesWritten += timings.bytesWritten;
+
+	if (_slowestCount == 0)
+		return;
+
+	// The heap's front is the fastest of the slowest files kept so far
+	if (_slowest.size() < _slowestCount)
+	{
+		_slowest.push_back(timings);
+		std::push_heap(_slowest.begin(), _slowest.end(), slowerThan);
+	}
+	else if (timings.totalMs > _slowest.front().totalMs)
+	{
+		std::pop_heap(_slowest.begin(), _slowest.end(), slowerThan);
+		_slowest.back() = timings;
+		std::push_heap(_slowest.begin(), _slowest.end(), slowerThan);
+	}
+}
+
+void BatchTelemetry::setCacheCounters(const CacheCounters& includeCache, const CacheCounters& resourceCache,
+	const CacheCounters& compileCache)
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	_counters.includeCache = includeCache;
+	_counters.resourceCache = resourceCache;
+	_counters.compileCache = compileCache;
+}
+
+BatchTelemetry::Snapshot BatchTelemetry::snapshot() const
+{
+	std::lock_guard<std::mutex> guard(_lock);
+
+	Snapshot result = _counters;
+	Clock::time_point now = _counters.finished ? _endTime : Clock::now();
+	result.elapsedMs = std::chrono::duration<double, std::milli>(now - _startTime).count();
+	result.queueDepth = _counters.filesQueued > _counters.filesStarted ? _counters.filesQueued - _counters.filesStarted : 0;
+
+	if (result.elapsedMs > 0)
+	{
+		double seconds = result.elapsedMs / 1000.0;
+		result.filesPerSecond = static_cast<double>(result.filesDone) / seconds;
+		result.bytesPerSecond = static_cast<double>(result.bytesRead) / seconds;
+
+		if (result.workers > 0)
+		{
+			double busyMs = _busyMs + _counters.workersBusy * std::chrono::duration<double, std::milli>(now - _lastBusyChange).count();
+			result.workerUtilization = std::min(1.0, busyMs / (result.elapsedMs * result.workers));
+		}
+	}
+
+	result.slowest = _slowest;
+	std::sort_heap(result.slowest.begin(), result.slowest.end(), slowerThan);
+	return result;
+}
+
+void BatchTelemetry::accumulateBusy(Clock::time_point now)
+{
+	if (now > _lastBusyChange)
+	{
+		_busyMs += _counters.workersBusy * std::chrono::duration<double, std::milli>(now - _lastBusyChange).count();
+		_lastBusyChange = now;
+	}
+}
@@ -0,0 +1,124 @@
+/** @file BatchTelemetry.h
+ * Progress and throughput counters of a batch run, readable while the batch goes on.
+ *
+ * Workers report when they start and finish a file, and the per-phase timings of each
+ * finished file; cache owners report their hit counters. snapshot() returns everything
+ * as one plain struct (rates already computed), which is what the processing dialog
+ * shows, what nwnsc-native prints as JSON lines and what tools can assert on.
+ *
+ * Worker utilization is the time workers spent on files over the time they were
+ * available: the number of busy workers is integrated over time at every start/finish.
+ *
+ * Portable code (no Windows headers): shared by the plugin and nwnsc-native.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace NWScriptPlugin
+{
+	class BatchTelemetry final
+	{
+	public:
+
+		// One finished file. Timings in milliseconds.
+		struct FileTimings
+		{
+			std::string path;
+			bool failed = false;
+			uint64_t bytesRead = 0;               // Source size
+			uint64_t bytesWritten = 0;            // Size of every output
+			double loadMs = 0;
+			double compileMs = 0;
+			double writeMs = 0;
+			double totalMs = 0;
+		};
+
+		struct CacheCounters
+		{
+			uint64_t hits = 0;
+			uint64_t misses = 0;
+
+			// 0 when the cache wasn't used
+			double hitRate() const {
+				return hits + misses ? static_cast<double>(hits) / static_cast<double>(hits + misses) : 0.0;
+			}
+		};
+
+		struct Snapshot
+		{
+			double elapsedMs = 0;
+			bool finished = false;
+
+			uint64_t filesQueued = 0;             // Known so far (the files list may still be growing)
+			uint64_t filesStarted = 0;
+			uint64_t filesDone = 0;
+			uint64_t filesFailed = 0;
+			uint64_t queueDepth = 0;              // Queued, not started yet
+
+			uint64_t bytesRead = 0;
+			uint64_t bytesWritten = 0;
+			double filesPerSecond = 0;
+			double bytesPerSecond = 0;            // Source bytes
+
+			int workers = 0;
+			int workersBusy = 0;
+			double workerUtilization = 0;         // 0 to 1
+
+			CacheCounters includeCache;           // Include modules reused between scripts
+			CacheCounters resourceCache;          // Script sources (files and game resources) already loaded
+			CacheCounters compileCache;           // Scripts whose outputs were reused instead of compiled
+
+			std::vector<FileTimings> slowest;     // Slowest files, slowest first
+		};
+
+		explicit BatchTelemetry(size_t slowestCount = 10)
+			: _slowestCount(slowestCount), _startTime(Clock::now()), _lastBusyChange(_startTime) {}
+
+		BatchTelemetry(const BatchTelemetry&) = delete;
+		BatchTelemetry& operator=(const BatchTelemetry&) = delete;
+
+		// Resets every counter and starts the clock
+		void start(int workers);
+		// Stops the clock: later snapshots report the final rates
+		void finish();
+
+		// More files waiting for a worker
+		void filesQueued(uint64_t count = 1);
+		// A worker took a file / is free again
+		void fileStarted();
+		void fileCompleted();
+		// Final timings of a file (outputs may be written after the worker moved on)
+		void fileDone(const FileTimings& timings);
+
+		// Counters since the batch started
+		void setCacheCounters(const CacheCounters& includeCache, const CacheCounters& resourceCache,
+			const CacheCounters& compileCache);
+
+		Snapshot snapshot() const;
+
+	private:
+
+		typedef std::chrono::steady_clock Clock;
+
+		const size_t _slowestCount;
+
+		mutable std::mutex _lock;
+		Snapshot _counters;                       // Everything but the computed rates and the slowest list
+		std::vector<FileTimings> _slowest;        // Min-heap on totalMs, at most _slowestCount
+		Clock::time_point _startTime;
+		Clock::time_point _endTime;
+		Clock::time_point _lastBusyChange;
+		double _busyMs = 0;                       // Integral of busy workers over time
+
+		void accumulateBusy(Clock::time_point now);
+	};
+}
@@ -0,0 +1,292 @@
+/** @file CompileCache.cpp
+ * On-disk cache of compiled outputs, keyed by everything the outputs depend on.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#define XXH_INLINE_ALL
+#include "Native Compiler/xxhash.h"
+
+#include "CompileCache.h"
+
+using namespace NWScriptPlugin;
+
+// Entry format (little-endian):
+//   char magic[4]; uint32 version; uint8 include; uint8 outputCount;
+//   outputCount x (uint8 extensionLength; char extension[]; uint64 size; uint8 data[size]);
+//   uint64 checksum (XXH64 of everything before it)
+#define COMPILECACHE_MAGIC     "NWCC"
+#define COMPILECACHE_VERSION   1
+#define COMPILECACHE_EXTENSION ".nwcc"
+
+// Seeds of the two halves of a key
+#define COMPILECACHE_SEED_HIGH 0x4E574343u
+#define COMPILECACHE_SEED_LOW  0x6B657973u
+
+std::string CompileCache::Key::toString() const
+{
+	char buffer[33];
+	std::snprintf(buffer, sizeof(buffer), "%016llx%016llx", static_cast<unsigned long long>(high), static_cast<unsigned long long>(low));
+	return buffer;
+}
+
+CompileCache::KeyBuilder& CompileCache::KeyBuilder::add(std::string_view part)
+{
+	add(static_cast<uint64_t>(part.size()));
+	_data.append(part);
+	return *this;
+}
+
+CompileCache::KeyBuilder& CompileCache::KeyBuilder::add(uint64_t value)
+{
+	_data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+	return *this;
+}
+
+CompileCache::Key CompileCache::KeyBuilder::finish() const
+{
+	Key key;
+	key.high = XXH64(_data.data(), _data.size(), COMPILECACHE_SEED_HIGH);
+	key.low = XXH64(_data.data(), _data.size(), COMPILECACHE_SEED_LOW);
+	return key;
+}
+
+CompileCache::CompileCache(const fs::path& directory, uint64_t maxBytes)
+	: _directory(directory), _maxBytes(maxBytes)
+{
+}
+
+bool CompileCache::open(std::string& errorMessage)
+{
+	std::error_code ec;
+	fs::create_directories(_directory, ec);
+	if (!fs::is_directory(_directory, ec))
+	{
+		errorMessage = "Unable to create the compile cache directory: " + _directory.string();
+		return false;
+	}
+
+	return true;
+}
+
+// Path of the executable or library this code is linked into
+static fs::path modulePath()
+{
+#ifdef _WIN32
+	HMODULE module = nullptr;
+	if (!GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+		reinterpret_cast<LPCWSTR>(&modulePath), &module))
+		return fs::path();
+
+	wchar_t path[MAX_PATH];
+	const DWORD length = GetModuleFileNameW(module, path, MAX_PATH);
+	return length > 0 && length < MAX_PATH ? fs::path(std::wstring(path, length)) : fs::path();
+#else
+	Dl_info info;
+	if (dladdr(reinterpret_cast<void*>(&modulePath), &info) == 0 || !info.dli_fname)
+		return fs::path();
+	return fs::path(info.dli_fname);
+#endif
+}
+
+uint64_t CompileCache::buildId()
+{
+	static const uint64_t id = []() {
+		std::ifstream module(modulePath(), std::ios::binary);
+		if (module)
+		{
+			XXH64_state_t state;
+			XXH64_reset(&state, 0);
+
+			char buffer[64 * 1024];
+			while (module.read(buffer, sizeof(buffer)) || module.gcount() > 0)
+				XXH64_update(&state, buffer, static_cast<size_t>(module.gcount()));
+			if (module.eof())
+				return static_cast<uint64_t>(XXH64_digest(&state));
+		}
+
+		// No way to read ourselves: tell builds apart by their build time
+		const char fallback[] = "NWScript compiler " __DATE__ " " __TIME__;
+		return static_cast<uint64_t>(XXH64(fallback, sizeof(fallback) - 1, 0));
+	}();
+	return id;
+}
+
+fs::path CompileCache::entryPath(const Key& key) const
+{
+	return _directory / (key.toString() + COMPILECACHE_EXTENSION);
+}
+
+bool CompileCache::lookup(const Key& key, Entry& entry)
+{
+	fs::path path = entryPath(key);
+
+	std::vector<uint8_t> data;
+	{
+		std::ifstream in(path, std::ios::binary);
+		if (in)
+			data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+
+	if (data.empty() || !deserialize(data, entry))
+	{
+		_misses.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	// Recently used: the last to be evicted
+	std::error_code ec;
+	fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+
+	_hits.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+static void appendBytes(std::vector<uint8_t>& data, const void* bytes, size_t size)
+{
+	if (size == 0)
+		return;
+	size_t offset = data.size();
+	data.resize(offset + size);
+	std::memcpy(data.data() + offset, bytes, size);
+}
+
+template <typename T>
+static void appendValue(std::vector<uint8_t>& data, T value)
+{
+	appendBytes(data, &value, sizeof(T));
+}
+
+std::vector<uint8_t> CompileCache::serialize(const Entry& entry)
+{
+	size_t size = 4 + sizeof(uint32_t) + 2 + sizeof(uint64_t);
+	for (const Output& output : entry.outputs)
+		size += 1 + output.extension.size() + sizeof(uint64_t) + output.data.size();
+
+	std::vector<uint8_t> data;
+	data.reserve(size);
+	appendBytes(data, COMPILECACHE_MAGIC, 4);
+	appendValue<uint32_t>(data, COMPILECACHE_VERSION);
+	appendValue<uint8_t>(data, entry.include ? 1 : 0);
+	appendValue<uint8_t>(data, static_cast<uint8_t>(entry.outputs.size()));
+
+	for (const Output& output : entry.outputs)
+	{
+		appendValue<uint8_t>(data, static_cast<uint8_t>(output.extension.size()));
+		appendBytes(data, output.extension.data(), output.extension.size());
+		appendValue<uint64_t>(data, output.data.size());
+		appendBytes(data, output.data.data(), output.data.size());
+	}
+
+	appendValue<uint64_t>(data, XXH64(data.data(), data.size(), 0));
+	return data;
+}
+
+bool CompileCache::deserialize(const std::vector<uint8_t>& data, Entry& entry)
+{
+	if (data.size() < 4 + sizeof(uint32_t) + 2 + sizeof(uint64_t) || std::memcmp(data.data(), COMPILECACHE_MAGIC, 4) != 0)
+		return false;
+
+	const size_t payloadSize = data.size() - sizeof(uint64_t);
+	uint64_t checksum = 0;
+	std::memcpy(&checksum, data.data() + payloadSize, sizeof(checksum));
+	if (checksum != XXH64(data.data(), payloadSize, 0))
+		return false;
+
+	size_t offset = 4;
+	auto read = [&](void* value, size_t size) -> bool {
+		if (size > payloadSize - offset)
+			return false;
+		std::memcpy(value, data.data() + offset, size);
+		offset += size;
+		return true;
+	};
+
+	uint32_t version = 0;
+	uint8_t include = 0, count = 0;
+	if (!read(&version, sizeof(version)) || version != COMPILECACHE_VERSION || !read(&include, 1) || !read(&count, 1))
+		return false;
+
+	entry.include = include != 0;
+	entry.outputs.resize(count);
+	for (Output& output : entry.outputs)
+	{
+		uint8_t extensionLength = 0;
+		uint64_t size = 0;
+		if (!read(&extensionLength, 1))
+			return false;
+		output.extension.resize(extensionLength);
+		if (!read(output.extension.data(), extensionLength) || !read(&size, sizeof(size)) || size > payloadSize - offset)
+			return false;
+		output.data.assign(data.begin() + offset, data.begin() + offset + size);
+		offset += size;
+	}
+
+	return offset == payloadSize;
+}
+
+size_t CompileCache::trim()
+{
+	struct CachedFile
+	{
+		fs::path path;
+		uint64_t size = 0;
+		fs::file_time_type lastUse;
+	};
+
+	std::vector<CachedFile> files;
+	uint64_t totalBytes = 0;
+
+	std::error_code ec;
+	for (fs::directory_iterator it(_directory, ec), end; !ec && it != end; it.increment(ec))
+	{
+		if (it->path().extension() != COMPILECACHE_EXTENSION)
+			continue;
+
+		std::error_code fileError;
+		CachedFile file;
+		file.path = it->path();
+		file.size = it->file_size(fileError);
+		file.lastUse = it->last_write_time(fileError);
+		if (fileError)
+			continue;
+
+		totalBytes += file.size;
+		files.push_back(std::move(file));
+	}
+
+	if (totalBytes <= _maxBytes)
+		return 0;
+
+	std::sort(files.begin(), files.end(), [](const CachedFile& a, const CachedFile& b) { return a.lastUse < b.lastUse; });
+
+	size_t removed = 0;
+	for (const CachedFile& file : files)
+	{
+		if (totalBytes <= _maxBytes)
+			break;
+
+		// Another machine sharing the directory may have removed it already
+		std::error_code removeError;
+		fs::remove(file.path, removeError);
+		totalBytes -= file.size;
+		removed++;
+	}
+
+	return removed;
+}
@@ -0,0 +1,111 @@
+/** @file CompileCache.h
+ * On-disk cache of compiled outputs, keyed by everything the outputs depend on.
+ *
+ * A key hashes (XXH64, twice with different seeds) the script and its whole include closure
+ * (names and contents, in include order), the identifier specification, the settings that
+ * change the generated code and the compiler build. Nothing machine specific goes in, so a
+ * cache directory can be shared between checkouts, branches and machines: switching back to
+ * a branch finds the outputs of its scripts still there.
+ *
+ * Each entry is one file named after its key, written atomically (temporary name + rename).
+ * Hits refresh the entry's modification time, and trim() evicts the least recently used
+ * entries once the directory grows past its size limit.
+ *
+ * Portable code (no Windows headers): shared by the plugin and nwnsc-native.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace NWScriptPlugin
+{
+	class CompileCache final
+	{
+	public:
+
+		struct Key
+		{
+			uint64_t high = 0;
+			uint64_t low = 0;
+
+			std::string toString() const;   // 32 hex digits
+		};
+
+		// Collects the inputs of a key. Every part is length-prefixed, so parts can't run into each other.
+		class KeyBuilder final
+		{
+		public:
+			KeyBuilder& add(std::string_view part);
+			KeyBuilder& add(uint64_t value);
+			Key finish() const;
+
+		private:
+			std::string _data;
+		};
+
+		struct Output
+		{
+			std::string extension;            // Without the dot (ncs, ndb)
+			std::vector<uint8_t> data;
+		};
+
+		struct Entry
+		{
+			bool include = false;             // An include file (no entry point): nothing to write
+			std::vector<Output> outputs;
+		};
+
+		CompileCache(const fs::path& directory, uint64_t maxBytes);
+
+		CompileCache(const CompileCache&) = delete;
+		CompileCache& operator=(const CompileCache&) = delete;
+
+		// Creates the cache directory if needed
+		bool open(std::string& errorMessage);
+
+		const fs::path& directory() const {
+			return _directory;
+		}
+
+		// Identifies the running compiler build: hash of the module holding this code (the
+		// nwnsc-native executable, or the plugin's DLL).
+		static uint64_t buildId();
+
+		// Reads an entry. Damaged or foreign files are treated as misses.
+		bool lookup(const Key& key, Entry& entry);
+
+		// Where an entry is stored
+		fs::path entryPath(const Key& key) const;
+		// Contents of an entry file. Callers write it themselves (on their output thread), so
+		// storing never holds up a compile.
+		static std::vector<uint8_t> serialize(const Entry& entry);
+
+		// Evicts the least recently used entries until the directory fits its size limit.
+		// Returns the number of entries removed.
+		size_t trim();
+
+		uint64_t hits() const { return _hits.load(std::memory_order_relaxed); }
+		uint64_t misses() const { return _misses.load(std::memory_order_relaxed); }
+
+	private:
+
+		fs::path _directory;
+		uint64_t _maxBytes;
+
+		std::atomic<uint64_t> _hits = 0;
+		std::atomic<uint64_t> _misses = 0;
+
+		static bool deserialize(const std::vector<uint8_t>& data, Entry& entry);
+	};
+}
@@ -0,0 +1,323 @@
+/** @file DirectoryWalker.cpp
+ * Lists the files of a directory tree matching a set of masks, walking the tree once on several threads.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <algorithm>
+#include <condition_variable>
+#include <cwctype>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "DirectoryWalker.h"
+
+using namespace NWScriptPlugin;
+
+namespace {
+
+	using PathString = DirectoryWalker::PathString;
+	using PathChar = DirectoryWalker::PathChar;
+	using PathView = std::basic_string_view<PathChar>;
+
+#ifdef _WIN32
+	constexpr PathChar pathSeparator = L'\\';
+
+	inline wint_t foldCase(PathChar c)
+	{
+		return std::towlower(c);
+	}
+#else
+	constexpr PathChar pathSeparator = '/';
+
+	// Names are bytes (usually UTF-8) here: only ASCII letters fold
+	inline PathChar foldCase(PathChar c)
+	{
+		return (c >= 'A' && c <= 'Z') ? static_cast<PathChar>(c - 'A' + 'a') : c;
+	}
+#endif
+
+	// "dir" + "name", without doubling the separator of a root ("/")
+	PathString joinPath(const PathString& directory, const PathString& name)
+	{
+		PathString path = directory;
+		if (!path.empty() && path.back() != pathSeparator && path.back() != '/')
+			path += pathSeparator;
+		return path.append(name);
+	}
+
+	bool matchesAnyMask(PathView sFileName, const std::vector<PathString>& fileMasks)
+	{
+		for (const PathString& mask : fileMasks)
+			if (DirectoryWalker::MatchesMask(sFileName, mask))
+				return true;
+		return false;
+	}
+
+	// Reads one directory, reporting its files and subdirectories. Returns false if it can't be read.
+	template <typename OnFile, typename OnDirectory>
+	bool readDirectory(const PathString& directory, OnFile&& onFile, OnDirectory&& onDirectory)
+	{
+#ifdef _WIN32
+		WIN32_FIND_DATAW findData;
+		const PathString searchKey = joinPath(directory, L"*");
+		// Basic info skips the 8.3 names, large fetch asks for more entries per round trip (network shares)
+		HANDLE h = FindFirstFileExW(searchKey.c_str(), FindExInfoBasic, &findData, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+		if (h == INVALID_HANDLE_VALUE)
+			return false;
+
+		do
+		{
+			const PathView name = findData.cFileName;
+			if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			{
+				if (name != L"." && name != L"..")
+					onDirectory(name);
+			}
+			else
+				onFile(name);
+		} while (FindNextFileW(h, &findData));
+
+		FindClose(h);
+		return true;
+#else
+		const int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (fd < 0)
+			return false;
+		DIR* dir = fdopendir(fd);
+		if (!dir)
+		{
+			close(fd);
+			return false;
+		}
+
+		while (const dirent* entry = readdir(dir))
+		{
+			const PathView name = entry->d_name;
+			if (name == "." || name == "..")
+				continue;
+
+			// The type comes with the listing on most file systems. Links to files are followed; links to
+			// directories are not, so a link back up the tree can't make the walk endless.
+			unsigned char type = entry->d_type;
+			struct stat st;
+			if (type == DT_UNKNOWN)
+			{
+				if (fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+					continue;
+				type = S_ISLNK(st.st_mode) ? DT_LNK : S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+			}
+			if (type == DT_LNK)
+				type = (fstatat(fd, entry->d_name, &st, 0) == 0 && S_ISREG(st.st_mode)) ? DT_REG : DT_UNKNOWN;
+
+			if (type == DT_DIR)
+				onDirectory(name);
+			else if (type == DT_REG)
+				onFile(name);
+		}
+
+		closedir(dir);
+		return true;
+#endif
+	}
+
+	// A directory of the tree. Its entries are known once it has been read.
+	struct DirectoryNode
+	{
+		struct Entry
+		{
+			PathString name;
+			DirectoryNode* directory = nullptr;   // Null for files
+		};
+
+		PathString path;
+		bool bRead = false;
+		std::vector<Entry> entries;               // Matching files and subdirectories, sorted by name
+	};
+
+	// Where the walk order has got to: files are handed out once every entry before them is known.
+	struct WalkCursor
+	{
+		struct Frame
+		{
+			const DirectoryNode* node;
+			size_t nextEntry;
+		};
+
+		std::vector<Frame> stack;
+
+		// Collects the files that can be reported now, stopping at the first directory not read yet.
+		void advance(std::vector<PathString>& ready)
+		{
+			while (!stack.empty())
+			{
+				Frame& frame = stack.back();
+				if (!frame.node->bRead)
+					break;
+				if (frame.nextEntry >= frame.node->entries.size())
+				{
+					stack.pop_back();
+					continue;
+				}
+
+				const DirectoryNode::Entry& entry = frame.node->entries[frame.nextEntry++];
+				if (entry.directory)
+					stack.push_back({ entry.directory, 0 });
+				else
+					ready.push_back(joinPath(frame.node->path, entry.name));
+			}
+		}
+	};
+}
+
+bool DirectoryWalker::MatchesMask(std::basic_string_view<PathChar> sFileName, std::basic_string_view<PathChar> sMask)
+{
+	if (sMask.size() == 3 && sMask[0] == '*' && sMask[1] == '.' && sMask[2] == '*')
+		sMask = sMask.substr(0, 1);
+
+	// Greedy matching, going back to the last '*' on a mismatch
+	size_t n = 0, m = 0;
+	size_t starMask = PathView::npos, starName = 0;
+	while (n < sFileName.size())
+	{
+		if (m < sMask.size() && (sMask[m] == '?' || (sMask[m] != '*' && foldCase(sMask[m]) == foldCase(sFileName[n]))))
+		{
+			n++;
+			m++;
+		}
+		else if (m < sMask.size() && sMask[m] == '*')
+		{
+			starMask = m++;
+			starName = n;
+		}
+		else if (starMask != PathView::npos)
+		{
+			m = starMask + 1;
+			n = ++starName;
+		}
+		else
+			return false;
+	}
+
+	while (m < sMask.size() && sMask[m] == '*')
+		m++;
+	return m == sMask.size();
+}
+
+void DirectoryWalker::Walk(const PathString& startingDir, const std::vector<PathString>& fileMasks, bool bRecurse,
+	const std::atomic<bool>& cancelFlag, const FileFoundCallback& onFileFound)
+{
+	PathString root = startingDir;
+	while (root.size() > 1 && (root.back() == '\\' || root.back() == '/'))
+		root.pop_back();
+
+	// The tree as far as it is known (nodes never move), directories waiting to be read, and how many
+	// are either waiting or being read: the walk ends at 0
+	std::mutex lock;
+	std::condition_variable wakeUp;
+	std::deque<DirectoryNode> nodes(1);
+	nodes.front().path = root;
+	std::deque<DirectoryNode*> pending = { &nodes.front() };
+	size_t nUnfinished = 1;
+
+	WalkCursor cursor;
+	cursor.stack.push_back({ &nodes.front(), 0 });
+
+	// Taken before the tree lock is released, so files go out in the order they were made ready
+	std::mutex reportLock;
+
+	auto worker = [&]() {
+		std::unique_lock<std::mutex> guard(lock);
+		for (;;)
+		{
+			wakeUp.wait(guard, [&]() { return !pending.empty() || nUnfinished == 0 || cancelFlag; });
+			if (nUnfinished == 0 || cancelFlag)
+			{
+				// The others may still be waiting for work
+				wakeUp.notify_all();
+				break;
+			}
+
+			DirectoryNode* directory = pending.front();
+			pending.pop_front();
+			guard.unlock();
+
+			std::vector<DirectoryNode::Entry> entries;
+			std::vector<PathString> subdirectories;
+			readDirectory(directory->path,
+				[&](PathView name) {
+					if (matchesAnyMask(name, fileMasks))
+						entries.push_back({ PathString(name), nullptr });
+				},
+				[&](PathView name) {
+					if (bRecurse)
+						subdirectories.emplace_back(name);
+				});
+
+			guard.lock();
+			std::vector<DirectoryNode*> children;
+			for (PathString& name : subdirectories)
+			{
+				nodes.emplace_back();
+				nodes.back().path = joinPath(directory->path, name);
+				entries.push_back({ std::move(name), &nodes.back() });
+				children.push_back(&nodes.back());
+			}
+			std::sort(entries.begin(), entries.end(),
+				[](const DirectoryNode::Entry& a, const DirectoryNode::Entry& b) { return a.name < b.name; });
+			directory->entries = std::move(entries);
+			directory->bRead = true;
+
+			// Subdirectories go first, in walk order: the files the caller waits for are found sooner
+			std::sort(children.begin(), children.end(),
+				[](const DirectoryNode* a, const DirectoryNode* b) { return a->path < b->path; });
+			pending.insert(pending.begin(), children.begin(), children.end());
+			nUnfinished += children.size();
+			nUnfinished--;
+
+			std::vector<PathString> ready;
+			cursor.advance(ready);
+
+			// The cancel flag doesn't notify anyone: whoever finishes a directory passes it on
+			if (nUnfinished == 0 || !children.empty() || cancelFlag)
+				wakeUp.notify_all();
+
+			if (!ready.empty() && !cancelFlag)
+			{
+				std::unique_lock<std::mutex> reportGuard(reportLock);
+				guard.unlock();
+				for (const PathString& filePath : ready)
+				{
+					if (cancelFlag)
+						break;
+					onFileFound(filePath);
+				}
+				reportGuard.unlock();
+				guard.lock();
+			}
+		}
+	};
+
+	// A lone directory doesn't need helpers
+	const unsigned nThreads = bRecurse ? (std::min)((std::max)(std::thread::hardware_concurrency(), 4u), maxThreads) : 1;
+	std::vector<std::thread> threads;
+	for (unsigned i = 1; i < nThreads; i++)
+		threads.emplace_back(worker);
+	worker();
+	for (std::thread& thread : threads)
+		thread.join();
+}
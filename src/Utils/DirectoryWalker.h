@@ -0,0 +1,57 @@
+/** @file DirectoryWalker.h
+ * Lists the files of a directory tree matching a set of masks, walking the tree once on several threads.
+ *
+ * Each directory is read a single time and every file name in it is tested against all masks (Windows
+ * wildcards: * and ?, case-insensitive), so adding masks costs nothing on disk. Subdirectories are put
+ * on a queue shared by the walker threads, which keeps several directory reads in flight: most of the
+ * time goes waiting for the file system, especially on network shares. The entry types come with the
+ * directory listing (FindFirstFileEx on Windows, readdir's d_type elsewhere), so no file is opened or
+ * stat'ed just to know what it is.
+ *
+ * Files are reported as soon as every file before them is known, in a fixed order whatever the thread
+ * timings: sorted by path, component by component (a directory's entries by name, each subdirectory's
+ * files where its name falls). The caller can start working on the first files before the walk ends.
+ *
+ * Portable code (no Windows headers in the interface): shared by the plugin and nwnsc-native.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace NWScriptPlugin {
+
+	class DirectoryWalker final
+	{
+	public:
+		// Native path strings: UTF-16 on Windows (the plugin's generic_string), bytes elsewhere
+#ifdef _WIN32
+		using PathString = std::wstring;
+#else
+		using PathString = std::string;
+#endif
+		using PathChar = PathString::value_type;
+
+		// Receives each file found (full path). Called from one walker thread at a time, in walk order.
+		using FileFoundCallback = std::function<void(const PathString& filePath)>;
+
+		// Directory reads in flight, at most
+		static constexpr unsigned maxThreads = 16;
+
+		// Walks startingDir (and its subdirectories, if bRecurse), calling onFileFound for every file matching
+		// any of fileMasks. Returns when the walk is done, or soon after cancelFlag is set.
+		static void Walk(const PathString& startingDir, const std::vector<PathString>& fileMasks, bool bRecurse,
+			const std::atomic<bool>& cancelFlag, const FileFoundCallback& onFileFound);
+
+		// Whether a file name matches a mask as the Windows file functions do ("*.*" matches names without a dot)
+		static bool MatchesMask(std::basic_string_view<PathChar> sFileName, std::basic_string_view<PathChar> sMask);
+	};
+
+}
@@ -0,0 +1,188 @@
+/** @file IncludeDirectives.cpp
+ * Finds the #include directives of NWScript sources, the way the compiler's lexer reads them.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+
+#include "IncludeDirectives.h"
+
+namespace fs = std::filesystem;
+
+using namespace NWScriptPlugin;
+
+// Characters that extend an identifier token ("#include2" is not the keyword)
+static bool isIdentifierCharacter(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// Skips a comment starting at i, if any. Returns false when there is none.
+static bool skipComment(const std::string& source, size_t& i, int& line)
+{
+	const size_t size = source.size();
+	if (source[i] != '/' || i + 1 >= size)
+		return false;
+
+	if (source[i + 1] == '/')
+	{
+		while (i < size && source[i] != '\n')
+			i++;
+		return true;
+	}
+
+	if (source[i + 1] == '*')
+	{
+		i += 2;
+		while (i < size && !(source[i] == '*' && i + 1 < size && source[i + 1] == '/'))
+		{
+			if (source[i] == '\n')
+				line++;
+			i++;
+		}
+		i = std::min(i + 2, size);
+		return true;
+	}
+
+	return false;
+}
+
+// Reads a string constant starting at i ("..." or r"..."), the way the compiler does.
+// Leaves i past the closing quote. Returns false if it is not terminated.
+static bool readString(const std::string& source, size_t& i, int& line, std::string& value)
+{
+	const size_t size = source.size();
+	value.clear();
+
+	if (source[i] == 'r' || source[i] == 'R')
+	{
+		// Raw strings span lines; "" is a quote
+		for (i += 2; i < size; i++)
+		{
+			if (source[i] == '"')
+			{
+				if (i + 1 < size && source[i + 1] == '"')
+					i++;
+				else
+				{
+					i++;
+					return true;
+				}
+			}
+			else if (source[i] == '\n')
+				line++;
+			value += source[i];
+		}
+		return false;
+	}
+
+	for (i++; i < size && source[i] != '\n'; i++)
+	{
+		if (source[i] == '"')
+		{
+			i++;
+			return true;
+		}
+
+		if (source[i] == '\\' && i + 1 < size)
+		{
+			char next = source[i + 1];
+			if (next == 'n' || next == '\\' || next == '"')
+			{
+				value += next == 'n' ? '\n' : next;
+				i++;
+				continue;
+			}
+			if (next == 'x' && i + 3 < size)
+			{
+				value += static_cast<char>(std::strtol(source.substr(i + 2, 2).c_str(), nullptr, 16));
+				i += 3;
+				continue;
+			}
+			// Any other backslash is dropped
+			continue;
+		}
+
+		value += source[i];
+	}
+
+	return false;
+}
+
+static bool isStringStart(const std::string& source, size_t i)
+{
+	return source[i] == '"' || ((source[i] == 'r' || source[i] == 'R') && i + 1 < source.size() && source[i + 1] == '"');
+}
+
+std::vector<IncludeDirective> NWScriptPlugin::scanIncludeDirectives(const std::string& source)
+{
+	std::vector<IncludeDirective> directives;
+	const size_t size = source.size();
+	int line = 1;
+	std::string value;
+
+	// '#' always starts a token of its own (outside comments and strings), so the
+	// directive is recognized anywhere on a line, like the compiler's lexer does.
+	size_t i = 0;
+	while (i < size)
+	{
+		const char c = source[i];
+
+		if (c == '\n')
+		{
+			line++;
+			i++;
+			continue;
+		}
+
+		if (skipComment(source, i, line))
+			continue;
+
+		// Strings may hold anything, #include and comment starts too. An identifier ending in
+		// 'r' right before a quote is cut there by the compiler as well.
+		if (isStringStart(source, i))
+		{
+			readString(source, i, line, value);
+			continue;
+		}
+
+		if (c != '#' || source.compare(i + 1, 7, "include") != 0 || (i + 8 < size && isIdentifierCharacter(source[i + 8])))
+		{
+			i++;
+			continue;
+		}
+
+		// The file name is the next token: blank space, new lines and comments may come before it
+		const size_t directiveBegin = i;
+		const int directiveLine = line;
+		i += 8;
+		while (i < size)
+		{
+			if (source[i] == '\n')
+			{
+				line++;
+				i++;
+			}
+			else if (source[i] == ' ' || source[i] == '\t' || source[i] == '\r')
+				i++;
+			else if (!skipComment(source, i, line))
+				break;
+		}
+
+		if (i < size && isStringStart(source, i) && readString(source, i, line, value))
+		{
+			IncludeDirective directive;
+			directive.name = fs::path(value).stem().string();
+			directive.begin = directiveBegin;
+			directive.end = i;
+			directive.line = directiveLine;
+			directives.push_back(std::move(directive));
+		}
+	}
+
+	return directives;
+}
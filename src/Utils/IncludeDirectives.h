@@ -0,0 +1,31 @@
+/** @file IncludeDirectives.h
+ * Finds the #include directives of NWScript sources, the way the compiler's lexer reads them.
+ * nwnsc-native builds include closures from them (ScriptDependencies), and both it and the plugin
+ * key their compile caches on those closures.
+ *
+ * Portable code (no Windows headers): shared by the plugin and nwnsc-native.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace NWScriptPlugin
+{
+	struct IncludeDirective
+	{
+		std::string name;    // As written, without quotes or extension
+		size_t begin = 0;    // Offset of the '#'
+		size_t end = 0;      // Offset past the closing quote
+		int line = 0;
+	};
+
+	// Finds every #include "name" directive, skipping comments and string literals. Follows the
+	// compiler's lexer: the directive may start anywhere on a line, and comments or new lines
+	// may separate it from its file name (a "..." or r"..." string).
+	std::vector<IncludeDirective> scanIncludeDirectives(const std::string& source);
+}
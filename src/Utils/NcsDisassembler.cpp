@@ -0,0 +1,263 @@
+/** @file NcsDisassembler.cpp
+ * Table driven disassembler for compiled NWScript (NCS) files.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <algorithm>
+#include <cstdio>
+
+#include "Native Compiler/exobase.h"
+#include "Native Compiler/scriptcomp.h"
+#include "Native Compiler/scriptinternal.h"
+
+#include "NcsDisassembler.h"
+#include "NcsInstruction.h"
+#include "NdbFile.h"
+
+using namespace NWScriptPlugin;
+
+// Raw bytes shown per instruction; longer ones (string constants) end with ".."
+#define NCS_DISASM_MAX_RAW_BYTES 8
+
+// Appends to the (preallocated) output, tracking where the current line starts for padding.
+class LineBuilder
+{
+public:
+
+	explicit LineBuilder(std::string& output) : _output(output), _lineStart(output.size()) {}
+
+	void append(const char* text, size_t length) { _output.append(text, length); }
+	void append(const char* text) { _output.append(text); }
+	void append(const std::string& text) { _output.append(text); }
+	void append(char c) { _output.push_back(c); }
+
+	template <typename... Args>
+	void format(const char* fmt, Args... args) {
+		char text[64];
+		int length = std::snprintf(text, sizeof(text), fmt, args...);
+		if (length > 0)
+			_output.append(text, std::min(static_cast<size_t>(length), sizeof(text) - 1));
+	}
+
+	void padTo(size_t column) {
+		size_t current = _output.size() - _lineStart;
+		if (current < column)
+			_output.append(column - current, ' ');
+	}
+
+	void endLine(const char* newLine) {
+		_output.append(newLine);
+		_lineStart = _output.size();
+	}
+
+private:
+
+	std::string& _output;
+	size_t _lineStart;
+};
+
+static void appendQuoted(LineBuilder& line, std::string_view text)
+{
+	line.append('"');
+	for (char c : text)
+	{
+		switch (c)
+		{
+		case '"': line.append("\\\"", 2); break;
+		case '\\': line.append("\\\\", 2); break;
+		case '\n': line.append("\\n", 2); break;
+		case '\r': line.append("\\r", 2); break;
+		case '\t': line.append("\\t", 2); break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20)
+				line.format("\\x%02x", static_cast<unsigned char>(c));
+			else
+				line.append(c);
+		}
+	}
+	line.append('"');
+}
+
+static void appendFunctionName(LineBuilder& line, const NdbFile* symbols, uint32_t address)
+{
+	if (!symbols)
+		return;
+	int32_t function = symbols->functionIndexStartingAt(address);
+	if (function >= 0)
+	{
+		line.append(" ; ");
+		line.append(symbols->functions()[function].name);
+	}
+}
+
+bool NcsDisassembler::disassemble(const uint8_t* code, size_t codeSize, const NdbFile* symbols,
+	std::string& output, std::string& errorMessage) const
+{
+	output.clear();
+	if (!checkNcsHeader(code, codeSize, errorMessage))
+		return false;
+
+	// Lines average well under 16 characters per code byte: one allocation for the whole file
+	output.reserve(codeSize * 16 + 256);
+
+	LineBuilder line(output);
+	const char* newLine = _options.newLine;
+
+	line.format("; NCS V1.0, %u bytes", static_cast<unsigned>(codeSize));
+	line.endLine(newLine);
+
+	int32_t currentLine = -1;
+	NcsInstruction instruction;
+	uint32_t address = NCS_HEADER_SIZE;
+	bool success = true;
+
+	while (address < codeSize)
+	{
+		if (symbols)
+		{
+			int32_t function = symbols->functionIndexStartingAt(address);
+			if (function >= 0)
+			{
+				const NdbFile::Function& entry = symbols->functions()[function];
+				line.endLine(newLine);
+				line.append("; ---- ");
+				line.append(entry.name);
+				line.format(" (returns %s, %u parameter(s))", entry.returnType.c_str(), entry.parameters);
+				line.endLine(newLine);
+				currentLine = -1;
+			}
+
+			int32_t lineIndex = symbols->lineIndexAt(address);
+			if (lineIndex >= 0 && lineIndex != currentLine)
+			{
+				const NdbFile::Line& entry = symbols->lines()[lineIndex];
+				line.append(";      ");
+				line.append(entry.file < symbols->files().size() ? symbols->files()[entry.file] : std::string("?"));
+				line.format(".nss(%u)", entry.line);
+				line.endLine(newLine);
+			}
+			currentLine = lineIndex;
+		}
+
+		if (!decodeNcsInstruction(code, codeSize, address, instruction))
+		{
+			char buffer[96];
+			std::snprintf(buffer, sizeof(buffer), "Invalid instruction at 0x%08x (opcode 0x%02x).", address, code[address]);
+			errorMessage = buffer;
+			line.append("; ");
+			line.append(errorMessage);
+			line.endLine(newLine);
+			success = false;
+			break;
+		}
+
+		size_t column = 0;
+		if (_options.addresses)
+		{
+			line.format("%08X  ", address);
+			column += 10;
+		}
+
+		if (_options.rawBytes)
+		{
+			uint32_t shown = instruction.size < NCS_DISASM_MAX_RAW_BYTES ? instruction.size : NCS_DISASM_MAX_RAW_BYTES;
+			for (uint32_t i = 0; i < shown; i++)
+				line.format("%02X ", code[address + i]);
+			if (shown < instruction.size)
+				line.append("..");
+			column += NCS_DISASM_MAX_RAW_BYTES * 3 + 3;
+			line.padTo(column);
+		}
+
+		const NcsOpcodeInfo& info = ncsOpcodeInfo(instruction.opcode);
+		line.append(info.mnemonic);
+		if (info.operands != NcsOperands::StoreState)
+			line.append(ncsAuxcodeSuffix(instruction.auxcode));
+
+		column += 14;
+		switch (info.operands)
+		{
+		case NcsOperands::None:
+			break;
+
+		case NcsOperands::StackOffsetSize:
+			line.padTo(column);
+			line.format("%d, %d", instruction.operand1, instruction.operand2);
+			break;
+
+		case NcsOperands::Int32:
+			line.padTo(column);
+			line.format("%d", instruction.operand1);
+			break;
+
+		case NcsOperands::Jump:
+		{
+			uint32_t target = address + static_cast<uint32_t>(instruction.operand1);
+			line.padTo(column);
+			if (_options.addresses)
+				line.format("0x%08X", target);
+			else
+				line.format("%+d", instruction.operand1);
+			appendFunctionName(line, symbols, target);
+			break;
+		}
+
+		case NcsOperands::Constant:
+			line.padTo(column);
+			switch (instruction.auxcode)
+			{
+			case CVIRTUALMACHINE_AUXCODE_TYPE_FLOAT:
+				line.format("%.9g", static_cast<double>(instruction.floatValue));
+				break;
+			case CVIRTUALMACHINE_AUXCODE_TYPE_STRING:
+			case CVIRTUALMACHINE_AUXCODE_TYPE_ENGST7:    // Json
+				appendQuoted(line, instruction.stringValue);
+				break;
+			case CVIRTUALMACHINE_AUXCODE_TYPE_OBJECT:
+				if (instruction.operand1 == 0)
+					line.append("OBJECT_SELF");
+				else if (instruction.operand1 == 1)
+					line.append("OBJECT_INVALID");
+				else
+					line.format("0x%08X", static_cast<uint32_t>(instruction.operand1));
+				break;
+			default:
+				line.format("%d", instruction.operand1);
+			}
+			break;
+
+		case NcsOperands::Action:
+			line.padTo(column);
+			line.format("%d, %d", instruction.operand1, instruction.operand2);
+			break;
+
+		case NcsOperands::Destruct:
+			line.padTo(column);
+			line.format("%d, %d, %d", instruction.operand1, instruction.operand2, instruction.operand3);
+			break;
+
+		case NcsOperands::StoreState:
+			line.padTo(column);
+			line.format("%d, %d, %d", instruction.auxcode, instruction.operand1, instruction.operand2);
+			break;
+
+		case NcsOperands::Comparison:
+			if (instruction.size > 2)
+			{
+				line.padTo(column);
+				line.format("%d", instruction.operand2);
+			}
+			break;
+
+		case NcsOperands::Invalid:
+			break;
+		}
+
+		line.endLine(newLine);
+		address += instruction.size;
+	}
+
+	return success;
+}
@@ -0,0 +1,48 @@
+/** @file NcsDisassembler.h
+ * Table driven disassembler for compiled NWScript (NCS) files.
+ *
+ * Decodes with NcsInstruction straight into one preallocated text buffer: one line per
+ * instruction with its address, raw bytes, mnemonic and operands. Given the NDB symbols,
+ * function starts and source lines are annotated and jump targets named.
+ *
+ * Portable code (no Windows headers): shared by the plugin and nwnsc-native.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace NWScriptPlugin
+{
+	class NdbFile;
+
+	class NcsDisassembler final
+	{
+	public:
+
+		struct Options
+		{
+			bool addresses = true;     // Instruction addresses (leave out to diff builds where code moved)
+			bool rawBytes = true;      // Hex dump of each instruction
+			const char* newLine = "\n";
+		};
+
+		NcsDisassembler() = default;
+		explicit NcsDisassembler(const Options& options) : _options(options) {}
+
+		// Disassembles a whole NCS file into output (replaced). symbols may be null.
+		// On a bad header or an undecodable instruction, returns false with the listing up to
+		// that point in output and the reason in errorMessage.
+		bool disassemble(const uint8_t* code, size_t codeSize, const NdbFile* symbols,
+			std::string& output, std::string& errorMessage) const;
+
+	private:
+
+		Options _options;
+	};
+}
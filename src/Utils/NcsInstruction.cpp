@@ -0,0 +1,259 @@
+/** @file NcsInstruction.cpp
+ * Table driven decoding of compiled NWScript (NCS) instructions.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <cstring>
+
+#include "Native Compiler/exobase.h"
+#include "Native Compiler/scriptcomp.h"
+#include "Native Compiler/scriptinternal.h"
+
+#include "NcsInstruction.h"
+
+using namespace NWScriptPlugin;
+
+static const NcsOpcodeInfo invalidOpcode = { "???", NcsOperands::Invalid };
+
+// Indexed by opcode.
+static const NcsOpcodeInfo opcodeTable[] = {
+	{ "???",         NcsOperands::Invalid },           // 0x00
+	{ "CPDOWNSP",    NcsOperands::StackOffsetSize },   // CVIRTUALMACHINE_OPCODE_ASSIGNMENT
+	{ "RSADD",       NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_RUNSTACK_ADD
+	{ "CPTOPSP",     NcsOperands::StackOffsetSize },   // CVIRTUALMACHINE_OPCODE_RUNSTACK_COPY
+	{ "CONST",       NcsOperands::Constant },          // CVIRTUALMACHINE_OPCODE_CONSTANT
+	{ "ACTION",      NcsOperands::Action },            // CVIRTUALMACHINE_OPCODE_EXECUTE_COMMAND
+	{ "LOGAND",      NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_LOGICAL_AND
+	{ "LOGOR",       NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_LOGICAL_OR
+	{ "INCOR",       NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_INCLUSIVE_OR
+	{ "EXCOR",       NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_EXCLUSIVE_OR
+	{ "BOOLAND",     NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_BOOLEAN_AND
+	{ "EQUAL",       NcsOperands::Comparison },        // CVIRTUALMACHINE_OPCODE_EQUAL
+	{ "NEQUAL",      NcsOperands::Comparison },        // CVIRTUALMACHINE_OPCODE_NOT_EQUAL
+	{ "GEQ",         NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_GEQ
+	{ "GT",          NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_GT
+	{ "LT",          NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_LT
+	{ "LEQ",         NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_LEQ
+	{ "SHLEFT",      NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_SHIFT_LEFT
+	{ "SHRIGHT",     NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_SHIFT_RIGHT
+	{ "USHRIGHT",    NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_USHIFT_RIGHT
+	{ "ADD",         NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_ADD
+	{ "SUB",         NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_SUB
+	{ "MUL",         NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_MUL
+	{ "DIV",         NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_DIV
+	{ "MOD",         NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_MODULUS
+	{ "NEG",         NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_NEGATION
+	{ "COMP",        NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_ONES_COMPLEMENT
+	{ "MOVSP",       NcsOperands::Int32 },             // CVIRTUALMACHINE_OPCODE_MODIFY_STACK_POINTER
+	{ "STOREIP",     NcsOperands::Invalid },           // CVIRTUALMACHINE_OPCODE_STORE_IP (never generated)
+	{ "JMP",         NcsOperands::Jump },              // CVIRTUALMACHINE_OPCODE_JMP
+	{ "JSR",         NcsOperands::Jump },              // CVIRTUALMACHINE_OPCODE_JSR
+	{ "JZ",          NcsOperands::Jump },              // CVIRTUALMACHINE_OPCODE_JZ
+	{ "RETN",        NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_RET
+	{ "DESTRUCT",    NcsOperands::Destruct },          // CVIRTUALMACHINE_OPCODE_DE_STRUCT
+	{ "NOT",         NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_BOOLEAN_NOT
+	{ "DECISP",      NcsOperands::Int32 },             // CVIRTUALMACHINE_OPCODE_DECREMENT
+	{ "INCISP",      NcsOperands::Int32 },             // CVIRTUALMACHINE_OPCODE_INCREMENT
+	{ "JNZ",         NcsOperands::Jump },              // CVIRTUALMACHINE_OPCODE_JNZ
+	{ "CPDOWNBP",    NcsOperands::StackOffsetSize },   // CVIRTUALMACHINE_OPCODE_ASSIGNMENT_BASE
+	{ "CPTOPBP",     NcsOperands::StackOffsetSize },   // CVIRTUALMACHINE_OPCODE_RUNSTACK_COPY_BASE
+	{ "DECIBP",      NcsOperands::Int32 },             // CVIRTUALMACHINE_OPCODE_DECREMENT_BASE
+	{ "INCIBP",      NcsOperands::Int32 },             // CVIRTUALMACHINE_OPCODE_INCREMENT_BASE
+	{ "SAVEBP",      NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_SAVE_BASE_POINTER
+	{ "RESTOREBP",   NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_RESTORE_BASE_POINTER
+	{ "STORE_STATE", NcsOperands::StoreState },        // CVIRTUALMACHINE_OPCODE_STORE_STATE
+	{ "NOP",         NcsOperands::None },              // CVIRTUALMACHINE_OPCODE_NO_OPERATION
+};
+
+static_assert(sizeof(opcodeTable) / sizeof(opcodeTable[0]) == CVIRTUALMACHINE_OPCODE_NO_OPERATION + 1,
+	"The opcode table must cover every CVIRTUALMACHINE_OPCODE_*");
+
+const NcsOpcodeInfo& NWScriptPlugin::ncsOpcodeInfo(uint8_t opcode)
+{
+	if (opcode < sizeof(opcodeTable) / sizeof(opcodeTable[0]))
+		return opcodeTable[opcode];
+	return invalidOpcode;
+}
+
+const char* NWScriptPlugin::ncsAuxcodeSuffix(uint8_t auxcode)
+{
+	static const char* engineStructures[] = { "E0", "E1", "E2", "E3", "E4", "E5", "E6", "E7", "E8", "E9" };
+	static const char* engineStructurePairs[] = { "E0E0", "E1E1", "E2E2", "E3E3", "E4E4", "E5E5", "E6E6", "E7E7", "E8E8", "E9E9" };
+
+	switch (auxcode)
+	{
+	case CVIRTUALMACHINE_AUXCODE_TYPE_INTEGER: return "I";
+	case CVIRTUALMACHINE_AUXCODE_TYPE_FLOAT: return "F";
+	case CVIRTUALMACHINE_AUXCODE_TYPE_STRING: return "S";
+	case CVIRTUALMACHINE_AUXCODE_TYPE_OBJECT: return "O";
+	case CVIRTUALMACHINE_AUXCODE_TYPETYPE_INTEGER_INTEGER: return "II";
+	case CVIRTUALMACHINE_AUXCODE_TYPETYPE_FLOAT_FLOAT: return "FF";
+	case CVIRTUALMACHINE_AUXCODE_TYPETYPE_OBJECT_OBJECT: return "OO";
+	case CVIRTUALMACHINE_AUXCODE_TYPETYPE_STRING_STRING: return "SS";
+	case CVIRTUALMACHINE_AUXCODE_TYPETYPE_STRUCT_STRUCT: return "TT";
+	case CVIRTUALMACHINE_AUXCODE_TYPETYPE_INTEGER_FLOAT: return "IF";
+	case CVIRTUALMACHINE_AUXCODE_TYPETYPE_FLOAT_INTEGER: return "FI";
+	case CVIRTUALMACHINE_AUXCODE_TYPETYPE_VECTOR_VECTOR: return "VV";
+	case CVIRTUALMACHINE_AUXCODE_TYPETYPE_VECTOR_FLOAT: return "VF";
+	case CVIRTUALMACHINE_AUXCODE_TYPETYPE_FLOAT_VECTOR: return "FV";
+	}
+
+	if (auxcode >= CVIRTUALMACHINE_AUXCODE_TYPE_ENGST0 && auxcode <= CVIRTUALMACHINE_AUXCODE_TYPE_ENGST9)
+		return engineStructures[auxcode - CVIRTUALMACHINE_AUXCODE_TYPE_ENGST0];
+	if (auxcode >= CVIRTUALMACHINE_AUXCODE_TYPETYPE_ENGST0_ENGST0 && auxcode <= CVIRTUALMACHINE_AUXCODE_TYPETYPE_ENGST9_ENGST9)
+		return engineStructurePairs[auxcode - CVIRTUALMACHINE_AUXCODE_TYPETYPE_ENGST0_ENGST0];
+
+	return "";
+}
+
+static inline int32_t readInt32(const uint8_t* p)
+{
+	return static_cast<int32_t>((static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+		(static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]));
+}
+
+static inline uint16_t readUInt16(const uint8_t* p)
+{
+	return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+bool NWScriptPlugin::decodeNcsInstruction(const uint8_t* code, size_t codeSize, uint32_t address, NcsInstruction& instruction)
+{
+	if (static_cast<size_t>(address) + CVIRTUALMACHINE_OPERATION_BASE_SIZE > codeSize)
+		return false;
+
+	const uint8_t* p = code + address;
+	const uint8_t* data = p + CVIRTUALMACHINE_EXTRA_DATA_LOCATION;
+	size_t available = codeSize - address - CVIRTUALMACHINE_OPERATION_BASE_SIZE;
+
+	instruction = NcsInstruction();
+	instruction.address = address;
+	instruction.opcode = p[CVIRTUALMACHINE_OPCODE_LOCATION];
+	instruction.auxcode = p[CVIRTUALMACHINE_AUXCODE_LOCATION];
+
+	size_t dataSize = 0;
+	switch (ncsOpcodeInfo(instruction.opcode).operands)
+	{
+	case NcsOperands::None:
+		break;
+
+	case NcsOperands::StackOffsetSize:
+		dataSize = 6;
+		if (available < dataSize)
+			return false;
+		instruction.operand1 = readInt32(data);
+		instruction.operand2 = readUInt16(data + 4);
+		break;
+
+	case NcsOperands::Int32:
+	case NcsOperands::Jump:
+		dataSize = 4;
+		if (available < dataSize)
+			return false;
+		instruction.operand1 = readInt32(data);
+		break;
+
+	case NcsOperands::Action:
+		dataSize = 3;
+		if (available < dataSize)
+			return false;
+		instruction.operand1 = readUInt16(data);
+		instruction.operand2 = data[2];
+		break;
+
+	case NcsOperands::Destruct:
+		dataSize = 6;
+		if (available < dataSize)
+			return false;
+		instruction.operand1 = readUInt16(data);
+		instruction.operand2 = readUInt16(data + 2);
+		instruction.operand3 = readUInt16(data + 4);
+		break;
+
+	case NcsOperands::StoreState:
+		dataSize = 8;
+		if (available < dataSize)
+			return false;
+		instruction.operand1 = readInt32(data);
+		instruction.operand2 = readInt32(data + 4);
+		break;
+
+	case NcsOperands::Comparison:
+		if (instruction.auxcode == CVIRTUALMACHINE_AUXCODE_TYPETYPE_STRUCT_STRUCT)
+		{
+			dataSize = 2;
+			if (available < dataSize)
+				return false;
+			instruction.operand2 = readUInt16(data);
+		}
+		break;
+
+	case NcsOperands::Constant:
+		switch (instruction.auxcode)
+		{
+		case CVIRTUALMACHINE_AUXCODE_TYPE_INTEGER:
+		case CVIRTUALMACHINE_AUXCODE_TYPE_OBJECT:
+		case CVIRTUALMACHINE_AUXCODE_TYPE_ENGST2:    // Location: 0 = LOCATION_INVALID
+			dataSize = 4;
+			if (available < dataSize)
+				return false;
+			instruction.operand1 = readInt32(data);
+			break;
+
+		case CVIRTUALMACHINE_AUXCODE_TYPE_FLOAT:
+		{
+			dataSize = 4;
+			if (available < dataSize)
+				return false;
+			uint32_t bits = static_cast<uint32_t>(readInt32(data));
+			std::memcpy(&instruction.floatValue, &bits, sizeof(float));
+			break;
+		}
+
+		case CVIRTUALMACHINE_AUXCODE_TYPE_STRING:
+		case CVIRTUALMACHINE_AUXCODE_TYPE_ENGST7:    // Json, as text
+		{
+			if (available < 2)
+				return false;
+			uint16_t length = readUInt16(data);
+			dataSize = 2 + static_cast<size_t>(length);
+			if (available < dataSize)
+				return false;
+			instruction.operand1 = length;
+			instruction.stringValue = std::string_view(reinterpret_cast<const char*>(data + 2), length);
+			break;
+		}
+
+		default:
+			return false;
+		}
+		break;
+
+	case NcsOperands::Invalid:
+		return false;
+	}
+
+	instruction.size = static_cast<uint32_t>(CVIRTUALMACHINE_OPERATION_BASE_SIZE + dataSize);
+	return true;
+}
+
+bool NWScriptPlugin::checkNcsHeader(const uint8_t* code, size_t codeSize, std::string& errorMessage)
+{
+	if (codeSize < NCS_HEADER_SIZE || std::memcmp(code, "NCS V1.0", 8) != 0 || code[8] != 'B')
+	{
+		errorMessage = "Not a compiled NWScript file (bad NCS header).";
+		return false;
+	}
+
+	uint32_t declaredSize = static_cast<uint32_t>(readInt32(code + 9));
+	if (declaredSize != codeSize)
+	{
+		errorMessage = "Truncated or damaged NCS file: header declares " + std::to_string(declaredSize) +
+			" bytes, file has " + std::to_string(codeSize) + ".";
+		return false;
+	}
+
+	return true;
+}
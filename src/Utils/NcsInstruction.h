@@ -0,0 +1,74 @@
+/** @file NcsInstruction.h
+ * Table driven decoding of compiled NWScript (NCS) instructions.
+ *
+ * Opcode and auxcode values are the CVIRTUALMACHINE_* definitions of the native compiler
+ * (scriptinternal.h). Every instruction is a 1 byte opcode, a 1 byte auxcode (usually the
+ * type of the operands) and opcode specific data, all big endian. Addresses are offsets
+ * from the start of the file, header included, like the compiler and NDB files use.
+ *
+ * Portable code (no Windows headers): shared by the plugin and nwnsc-native.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// "NCS V1.0", the 'B' program marker and the big endian file size
+#define NCS_HEADER_SIZE 13
+
+namespace NWScriptPlugin
+{
+	// Layout of the data that follows the opcode and auxcode bytes
+	enum class NcsOperands : uint8_t
+	{
+		None,
+		StackOffsetSize,   // int32 offset, uint16 size (CPDOWNSP, CPTOPSP, CPDOWNBP, CPTOPBP)
+		Int32,             // int32 (MOVSP, DECISP, INCISP, DECIBP, INCIBP)
+		Jump,              // int32 offset from the instruction's own address (JMP, JSR, JZ, JNZ)
+		Constant,          // Depends on the auxcode type (CONST)
+		Action,            // uint16 action id, uint8 argument count (ACTION)
+		Destruct,          // uint16 size, uint16 offset, uint16 size to keep (DESTRUCT)
+		StoreState,        // int32 globals size, int32 locals size; auxcode = offset to resume at (STORE_STATE)
+		Comparison,        // uint16 size when comparing structures, nothing otherwise (EQUAL, NEQUAL)
+		Invalid            // Not an opcode
+	};
+
+	struct NcsOpcodeInfo
+	{
+		const char* mnemonic;
+		NcsOperands operands;
+	};
+
+	struct NcsInstruction
+	{
+		uint32_t address = 0;
+		uint32_t size = 0;
+		uint8_t opcode = 0;
+		uint8_t auxcode = 0;
+		int32_t operand1 = 0;           // Offset, jump offset, action id, integer/object constant...
+		int32_t operand2 = 0;           // Size, argument count, locals size...
+		int32_t operand3 = 0;           // DESTRUCT size to keep
+		float floatValue = 0.0f;        // Float constant
+		std::string_view stringValue;   // String or json constant (points into the code)
+	};
+
+	// Information of an opcode. Unknown opcodes return an entry with NcsOperands::Invalid.
+	const NcsOpcodeInfo& ncsOpcodeInfo(uint8_t opcode);
+
+	// Type suffix of an auxcode, as appended to mnemonics ("I", "FF", "E2"...). Empty if the
+	// auxcode isn't a type.
+	const char* ncsAuxcodeSuffix(uint8_t auxcode);
+
+	// Decodes the instruction at address. Returns false if the opcode is unknown, the
+	// operands don't match the auxcode or the instruction runs past the end of the code.
+	bool decodeNcsInstruction(const uint8_t* code, size_t codeSize, uint32_t address, NcsInstruction& instruction);
+
+	// Checks the file header (signature and size).
+	bool checkNcsHeader(const uint8_t* code, size_t codeSize, std::string& errorMessage);
+}
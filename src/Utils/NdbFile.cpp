@@ -0,0 +1,151 @@
+/** @file NdbFile.cpp
+ * Reader for NDB debug symbol files.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "NdbFile.h"
+
+using namespace NWScriptPlugin;
+
+bool NdbFile::load(const fs::path& file, std::string& errorMessage)
+{
+	std::ifstream in(file, std::ios::binary);
+	if (!in)
+	{
+		errorMessage = "Unable to read debug symbols: " + file.string();
+		return false;
+	}
+
+	std::stringstream contents;
+	contents << in.rdbuf();
+	if (!parse(contents.str(), errorMessage))
+	{
+		errorMessage = file.string() + ": " + errorMessage;
+		return false;
+	}
+	return true;
+}
+
+// Splits a line into space separated fields.
+static std::vector<std::string_view> splitFields(std::string_view line)
+{
+	std::vector<std::string_view> fields;
+	size_t pos = 0;
+	while (pos < line.size())
+	{
+		while (pos < line.size() && line[pos] == ' ')
+			pos++;
+		size_t end = line.find(' ', pos);
+		if (end == std::string_view::npos)
+			end = line.size();
+		if (end > pos)
+			fields.push_back(line.substr(pos, end - pos));
+		pos = end;
+	}
+	return fields;
+}
+
+static uint32_t parseNumber(std::string_view field, int base)
+{
+	std::string value(field);
+	return static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, base));
+}
+
+bool NdbFile::parse(std::string_view text, std::string& errorMessage)
+{
+	_files.clear();
+	_functions.clear();
+	_lines.clear();
+
+	if (text.substr(0, 8) != "NDB V1.0")
+	{
+		errorMessage = "Not an NDB file.";
+		return false;
+	}
+
+	size_t pos = 0;
+	while (pos < text.size())
+	{
+		size_t end = text.find('\n', pos);
+		if (end == std::string_view::npos)
+			end = text.size();
+		std::string_view line = text.substr(pos, end - pos);
+		pos = end + 1;
+
+		if (!line.empty() && line.back() == '\r')
+			line.remove_suffix(1);
+		if (line.empty())
+			continue;
+
+		std::vector<std::string_view> fields = splitFields(line);
+
+		// "N00 name" (the script itself) or "n01 name" (an include)
+		if ((line[0] == 'N' || line[0] == 'n') && line.size() > 4 && line[1] != 'D')
+		{
+			size_t index = parseNumber(line.substr(1, 2), 10);
+			if (_files.size() <= index)
+				_files.resize(index + 1);
+			_files[index] = std::string(line.substr(4));
+		}
+		// "f start end params type name"
+		else if (fields.size() >= 6 && fields[0] == "f")
+		{
+			Function function;
+			function.start = parseNumber(fields[1], 16);
+			function.end = parseNumber(fields[2], 16);
+			function.parameters = parseNumber(fields[3], 10);
+			function.returnType = std::string(fields[4]);
+			function.name = std::string(fields[5]);
+			_functions.push_back(std::move(function));
+		}
+		// "lFF line start end"
+		else if (fields.size() >= 4 && line[0] == 'l' && line.size() > 3)
+		{
+			Line entry;
+			entry.file = parseNumber(fields[0].substr(1), 10);
+			entry.line = parseNumber(fields[1], 10);
+			entry.start = parseNumber(fields[2], 16);
+			entry.end = parseNumber(fields[3], 16);
+			_lines.push_back(entry);
+		}
+	}
+
+	auto byStart = [](const auto& a, const auto& b) { return a.start < b.start; };
+	std::stable_sort(_functions.begin(), _functions.end(), byStart);
+	std::stable_sort(_lines.begin(), _lines.end(), byStart);
+	return true;
+}
+
+template <typename T>
+static int32_t indexAt(const std::vector<T>& entries, uint32_t address)
+{
+	auto it = std::upper_bound(entries.begin(), entries.end(), address,
+		[](uint32_t value, const T& entry) { return value < entry.start; });
+	if (it == entries.begin())
+		return -1;
+	--it;
+	return address < it->end ? static_cast<int32_t>(it - entries.begin()) : -1;
+}
+
+int32_t NdbFile::functionIndexAt(uint32_t address) const
+{
+	return indexAt(_functions, address);
+}
+
+int32_t NdbFile::lineIndexAt(uint32_t address) const
+{
+	return indexAt(_lines, address);
+}
+
+int32_t NdbFile::functionIndexStartingAt(uint32_t address) const
+{
+	int32_t index = functionIndexAt(address);
+	return (index >= 0 && _functions[index].start == address) ? index : -1;
+}
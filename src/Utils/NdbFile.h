@@ -0,0 +1,67 @@
+/** @file NdbFile.h
+ * Reader for NDB debug symbol files, as written by the compiler next to the NCS.
+ *
+ * Only what is needed to map code addresses back to the source is kept: the source file
+ * table, the function ranges and the line ranges.
+ *
+ * Portable code (no Windows headers): shared by the plugin and nwnsc-native.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace NWScriptPlugin
+{
+	class NdbFile final
+	{
+	public:
+
+		// Address ranges are [start, end), file offsets of the NCS.
+		struct Function
+		{
+			std::string name;
+			std::string returnType;   // NDB type abbreviation ("i", "v", "e2", "t0001"...)
+			uint32_t start = 0;
+			uint32_t end = 0;
+			uint32_t parameters = 0;
+		};
+
+		struct Line
+		{
+			uint32_t file = 0;        // Index into files()
+			uint32_t line = 0;
+			uint32_t start = 0;
+			uint32_t end = 0;
+		};
+
+		bool load(const fs::path& file, std::string& errorMessage);
+		bool parse(std::string_view text, std::string& errorMessage);
+
+		const std::vector<std::string>& files() const { return _files; }
+		const std::vector<Function>& functions() const { return _functions; }   // Sorted by address
+		const std::vector<Line>& lines() const { return _lines; }               // Sorted by address
+
+		// Entry containing the address, or -1.
+		int32_t functionIndexAt(uint32_t address) const;
+		int32_t lineIndexAt(uint32_t address) const;
+
+		// Function starting exactly at address, or -1.
+		int32_t functionIndexStartingAt(uint32_t address) const;
+
+	private:
+
+		std::vector<std::string> _files;
+		std::vector<Function> _functions;
+		std::vector<Line> _lines;
+	};
+}
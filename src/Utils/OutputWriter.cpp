@@ -0,0 +1,213 @@
+/** @file OutputWriter.cpp
+ * Writes compiled artifacts (.ncs, .ndb) on a dedicated I/O thread.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+#include "OutputWriter.h"
+
+using namespace NWScriptPlugin;
+
+#define OUTPUTWRITER_COMPARE_CHUNK 65536
+
+OutputWriter::OutputWriter() = default;
+
+OutputWriter::~OutputWriter()
+{
+	{
+		std::lock_guard<std::mutex> guard(_lock);
+		_stop = true;
+	}
+	_wakeWriter.notify_one();
+	if (_thread.joinable())
+		_thread.join();
+}
+
+void OutputWriter::submit(std::vector<File>&& files, JobCallback onDone)
+{
+	{
+		std::lock_guard<std::mutex> guard(_lock);
+		_queue.push_back({ std::move(files), std::move(onDone) });
+
+		// Started on first use: the plugin's instance is created while the DLL loads.
+		if (!_thread.joinable())
+			_thread = std::thread(&OutputWriter::run, this);
+	}
+	_wakeWriter.notify_one();
+}
+
+void OutputWriter::flush()
+{
+	std::unique_lock<std::mutex> guard(_lock);
+	_idle.wait(guard, [this]() { return _queue.empty() && _inFlight == 0; });
+}
+
+uint64_t OutputWriter::filesWritten() const
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	return _written;
+}
+
+uint64_t OutputWriter::filesUnchanged() const
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	return _unchanged;
+}
+
+uint64_t OutputWriter::filesFailed() const
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	return _failed;
+}
+
+void OutputWriter::run()
+{
+	std::unique_lock<std::mutex> guard(_lock);
+	for (;;)
+	{
+		_wakeWriter.wait(guard, [this]() { return _stop || !_queue.empty(); });
+		if (_queue.empty())
+			break;
+
+		// Take every queued job at once: one wake-up per batch, not per file.
+		std::deque<Job> batch;
+		batch.swap(_queue);
+		_inFlight = batch.size();
+		guard.unlock();
+
+		for (Job& job : batch)
+		{
+			auto start = std::chrono::steady_clock::now();
+
+			std::vector<Result> results;
+			results.reserve(job.files.size());
+			for (const File& file : job.files)
+				results.push_back(writeFile(file));
+
+			// Release the buffers before notifying
+			job.files.clear();
+			job.files.shrink_to_fit();
+
+			double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			uint64_t written = 0, unchanged = 0, failed = 0;
+			for (const Result& result : results)
+			{
+				switch (result.status)
+				{
+				case Result::Status::Written: written++; break;
+				case Result::Status::Unchanged: unchanged++; break;
+				case Result::Status::Failed: failed++; break;
+				}
+			}
+
+			if (job.onDone)
+				job.onDone(results, elapsedMs);
+
+			std::lock_guard<std::mutex> countGuard(_lock);
+			_written += written;
+			_unchanged += unchanged;
+			_failed += failed;
+			_inFlight--;
+		}
+
+		guard.lock();
+		if (_queue.empty() && _inFlight == 0)
+			_idle.notify_all();
+	}
+
+	_idle.notify_all();
+}
+
+// True if the file at path has exactly the given contents.
+static bool hasSameContents(const fs::path& path, const OutputWriter::File& file)
+{
+	std::error_code ec;
+	uintmax_t size = fs::file_size(path, ec);
+	if (ec || size != file.size())
+		return false;
+
+	std::ifstream in(path, std::ios::binary);
+	if (!in)
+		return false;
+
+	char buffer[OUTPUTWRITER_COMPARE_CHUNK];
+	size_t offset = 0;
+	while (offset < file.size())
+	{
+		size_t chunk = std::min<size_t>(sizeof(buffer), file.size() - offset);
+		if (!in.read(buffer, static_cast<std::streamsize>(chunk)) ||
+			std::memcmp(buffer, file.contents() + offset, chunk) != 0)
+			return false;
+		offset += chunk;
+	}
+
+	return true;
+}
+
+static bool writeContents(const fs::path& path, const OutputWriter::File& file)
+{
+	std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out)
+		return false;
+
+	out.write(reinterpret_cast<const char*>(file.contents()), static_cast<std::streamsize>(file.size()));
+	out.close();
+	return static_cast<bool>(out);
+}
+
+OutputWriter::Result OutputWriter::writeFile(const File& file)
+{
+	static std::atomic<uint64_t> tempCounter = 0;
+
+	Result result;
+	result.path = file.path;
+
+	if (hasSameContents(file.path, file))
+	{
+		result.status = Result::Status::Unchanged;
+		return result;
+	}
+
+	// Temporary name next to the destination, so the rename never crosses volumes.
+	fs::path temp = file.path;
+	temp += ".tmp" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) +
+		"-" + std::to_string(tempCounter.fetch_add(1));
+
+	std::error_code ec;
+	if (!writeContents(temp, file))
+	{
+		// Disk full, quota, no access: the old file stays as it was rather than being truncated
+		fs::remove(temp, ec);
+		result.status = Result::Status::Failed;
+		result.errorMessage = "Unable to write file: " + file.path.string();
+		return result;
+	}
+
+	fs::rename(temp, file.path, ec);
+	if (!ec)
+	{
+		result.status = Result::Status::Written;
+		return result;
+	}
+	fs::remove(temp, ec);
+
+	// Some destinations refuse the rename (e.g.: the old file is held open without delete sharing
+	// on Windows). The contents could be written, so overwriting in place is better than failing.
+	if (writeContents(file.path, file))
+	{
+		result.status = Result::Status::Written;
+		return result;
+	}
+
+	result.status = Result::Status::Failed;
+	result.errorMessage = "Unable to write file: " + file.path.string();
+	return result;
+}
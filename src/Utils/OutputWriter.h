@@ -0,0 +1,102 @@
+/** @file OutputWriter.h
+ * Writes compiled artifacts (.ncs, .ndb) on a dedicated I/O thread.
+ *
+ * Buffers are moved into the writer, so the compile thread never waits on disk. Each file
+ * is written to a temporary name and renamed over the destination, and files whose current
+ * contents are already identical are left untouched (keeps their timestamps stable, so
+ * module packers don't repack unchanged scripts). Jobs are processed in submission order.
+ *
+ * Portable code (no Windows headers): shared by the plugin and nwnsc-native.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace NWScriptPlugin
+{
+	class OutputWriter final
+	{
+	public:
+
+		struct File
+		{
+			fs::path path;
+			std::vector<uint8_t> data;
+			// A buffer handed over by its owner (allocated with new[]), written instead of data when set
+			std::unique_ptr<char[]> buffer = nullptr;
+			size_t bufferSize = 0;
+
+			const uint8_t* contents() const { return buffer ? reinterpret_cast<const uint8_t*>(buffer.get()) : data.data(); }
+			size_t size() const { return buffer ? bufferSize : data.size(); }
+		};
+
+		struct Result
+		{
+			enum class Status { Written, Unchanged, Failed };
+
+			fs::path path;
+			Status status = Status::Failed;
+			std::string errorMessage;
+		};
+
+		// Called on the I/O thread once every file of a job is processed (results in the same order).
+		typedef std::function<void(const std::vector<Result>& results, double elapsedMs)> JobCallback;
+
+		OutputWriter();
+		~OutputWriter();   // Finishes every pending job
+
+		OutputWriter(const OutputWriter&) = delete;
+		OutputWriter& operator=(const OutputWriter&) = delete;
+
+		// Queues a group of files. Takes ownership of the buffers.
+		void submit(std::vector<File>&& files, JobCallback onDone = nullptr);
+
+		// Blocks until every job submitted so far is written and its callback returned.
+		void flush();
+
+		uint64_t filesWritten() const;
+		uint64_t filesUnchanged() const;
+		uint64_t filesFailed() const;
+
+		// Synchronous version of one file write, as done by the I/O thread.
+		static Result writeFile(const File& file);
+
+	private:
+
+		struct Job
+		{
+			std::vector<File> files;
+			JobCallback onDone;
+		};
+
+		std::deque<Job> _queue;
+		size_t _inFlight = 0;
+		bool _stop = false;
+		mutable std::mutex _lock;
+		std::condition_variable _wakeWriter;
+		std::condition_variable _idle;
+
+		uint64_t _written = 0;
+		uint64_t _unchanged = 0;
+		uint64_t _failed = 0;
+
+		std::thread _thread;
+
+		void run();
+	};
+}
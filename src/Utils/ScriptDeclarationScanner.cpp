@@ -0,0 +1,348 @@
+/** @file ScriptDeclarationScanner.cpp
+ * Single pass scanner for the declarations at the top level of a script.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include <algorithm>
+#include <cstring>
+
+#include "ScriptDeclarationScanner.h"
+
+using namespace NWScriptPlugin;
+
+void ScriptDeclarationScanner::Scan()
+{
+	bool bLineStart = true;
+	int nDepth = 0;
+
+	const char* p = _pBegin;
+	while (p < _pEnd)
+	{
+		const char c = *p;
+		if (c == '\n')
+		{
+			bLineStart = true;
+			p++;
+			continue;
+		}
+		if (isSpace(c))
+		{
+			p++;
+			continue;
+		}
+		if (c == '/')
+		{
+			const char* pAfter = SkipComment(p);
+			if (pAfter != p)
+			{
+				// A comment is blanked out - the line still starts after it.
+				p = pAfter;
+				continue;
+			}
+		}
+
+		if (bLineStart && nDepth == 0)
+		{
+			bLineStart = false;
+			const char* pAfter = (c == '#') ? ScanEngineStructure(p) : ScanFunctionOrConstant(p, true);
+			if (pAfter)
+			{
+				p = pAfter;
+				continue;
+			}
+		}
+		bLineStart = false;
+
+		if (c == '"')
+		{
+			const char* pAfter = SkipString(p);
+			p = pAfter ? pAfter : std::find(p + 1, _pEnd, '\n');
+		}
+		else
+		{
+			if (c == '{')
+				nDepth++;
+			else if (c == '}' && nDepth > 0)
+				nDepth--;
+			p++;
+		}
+	}
+}
+
+// Returns the position after a comment starting at p; or p itself if there's no comment there.
+const char* ScriptDeclarationScanner::SkipComment(const char* p) const
+{
+	if (p + 1 >= _pEnd || p[0] != '/')
+		return p;
+
+	if (p[1] == '/')
+	{
+		p += 2;
+		while (p < _pEnd && *p != '\n')
+			p++;
+		return p;
+	}
+
+	if (p[1] == '*')
+	{
+		// Unterminated comments run to the end of the file
+		p += 2;
+		while (p + 1 < _pEnd && !(p[0] == '*' && p[1] == '/'))
+			p++;
+		return (p + 1 < _pEnd) ? p + 2 : _pEnd;
+	}
+
+	return p;
+}
+
+// Skips whitespace and comments, appending the whitespace to sWhitespace and counting it into nSpaces
+const char* ScriptDeclarationScanner::SkipTrivia(const char* p, std::string* sWhitespace, size_t* nSpaces) const
+{
+	while (p < _pEnd)
+	{
+		if (isSpace(*p))
+		{
+			const char* pStart = p;
+			while (p < _pEnd && isSpace(*p))
+				p++;
+			if (sWhitespace)
+				sWhitespace->append(pStart, p);
+			if (nSpaces)
+				*nSpaces += p - pStart;
+			continue;
+		}
+
+		const char* pAfter = SkipComment(p);
+		if (pAfter == p)
+			break;
+		p = pAfter;
+	}
+
+	return p;
+}
+
+// Returns the position after the closing quote of a string starting at p; nullptr if it's
+// unterminated (strings end on their line).
+const char* ScriptDeclarationScanner::SkipString(const char* p) const
+{
+	for (p++; p < _pEnd && *p != '\n'; p++)
+	{
+		if (*p == '\\')
+		{
+			if (++p == _pEnd || *p == '\n')
+				break;
+		}
+		else if (*p == '"')
+			return p + 1;
+	}
+
+	return nullptr;
+}
+
+const char* ScriptDeclarationScanner::SkipWord(const char* p) const
+{
+	while (p < _pEnd && isWordChar(*p))
+		p++;
+	return p;
+}
+
+// Reads a value starting at p into sValue, together with the whitespace trailing it.
+// Returns the position after that whitespace, or nullptr if there's no value at p.
+const char* ScriptDeclarationScanner::ReadValue(const char* p, std::string& sValue, int nNesting) const
+{
+	if (p >= _pEnd)
+		return nullptr;
+
+	const char* pStart = p;
+	if (*p == '"')
+	{
+		p = SkipString(p);
+		if (!p)
+			return nullptr;
+		sValue.append(pStart, p);
+	}
+	else if (*p == '[' || *p == '{')
+	{
+		// Comma separated list of values
+		const char cClose = (*p == '[') ? ']' : '}';
+		if (nNesting >= maxValueNesting)
+			return nullptr;
+
+		sValue.push_back(*p);
+		p = SkipTrivia(p + 1, &sValue);
+		if (p < _pEnd && *p != cClose)
+		{
+			while (true)
+			{
+				p = ReadValue(p, sValue, nNesting + 1);
+				if (!p || p >= _pEnd)
+					return nullptr;
+				if (*p == cClose)
+					break;
+				if (*p != ',')
+					return nullptr;
+				sValue.push_back(',');
+				p = SkipTrivia(p + 1, &sValue);
+			}
+		}
+		if (p >= _pEnd)
+			return nullptr;
+		sValue.push_back(cClose);
+		p++;
+	}
+	else
+	{
+		while (p < _pEnd && isValueWordChar(*p))
+			p++;
+		if (p == pStart)
+			return nullptr;
+		sValue.append(pStart, p);
+	}
+
+	return SkipTrivia(p, &sValue);
+}
+
+// Reads a [const] <type> <name> [= <value>] parameter, leading and trailing whitespace included.
+const char* ScriptDeclarationScanner::ReadParameter(const char* p, ScriptDeclaration::Param& outParam) const
+{
+	const char* pWords[3];
+	const char* pWordEnds[3];
+	int nWords = 0;
+
+	p = SkipTrivia(p);
+	while (nWords < 3)
+	{
+		const char* pWordEnd = SkipWord(p);
+		if (pWordEnd == p)
+			break;
+		pWords[nWords] = p;
+		pWordEnds[nWords] = pWordEnd;
+		nWords++;
+		p = SkipTrivia(pWordEnd);
+	}
+
+	// "const" is only a qualifier when there's a type and a name after it
+	int nType = (nWords == 3 && pWordEnds[0] - pWords[0] == 5 && strncmp(pWords[0], "const", 5) == 0) ? 1 : 0;
+	if (nWords != nType + 2)
+		return nullptr;
+
+	outParam.sType.assign(pWords[nType], pWordEnds[nType]);
+	outParam.sName.assign(pWords[nType + 1], pWordEnds[nType + 1]);
+	if (p < _pEnd && *p == '=')
+	{
+		p = ReadValue(SkipTrivia(p + 1), outParam.sDefaultValue);
+		if (!p)
+			return nullptr;
+	}
+
+	return p;
+}
+
+const char* ScriptDeclarationScanner::ScanEngineStructure(const char* p)
+{
+	static constexpr char define[] = "#define";
+	static constexpr char prefix[] = "ENGINE_STRUCTURE_";
+	constexpr size_t defineLen = sizeof(define) - 1;
+	constexpr size_t prefixLen = sizeof(prefix) - 1;
+
+	if (static_cast<size_t>(_pEnd - p) < defineLen || strncmp(p, define, defineLen) != 0)
+		return nullptr;
+
+	size_t nSpaces = 0;
+	p = SkipTrivia(p + defineLen, nullptr, &nSpaces);
+	if (nSpaces == 0 || static_cast<size_t>(_pEnd - p) < prefixLen || strncmp(p, prefix, prefixLen) != 0)
+		return nullptr;
+
+	const char* pDigits = p + prefixLen;
+	p = pDigits;
+	while (p < _pEnd && *p >= '0' && *p <= '9')
+		p++;
+	if (p == pDigits)
+		return nullptr;
+
+	nSpaces = 0;
+	p = SkipTrivia(p, nullptr, &nSpaces);
+	const char* pNameEnd = SkipWord(p);
+	if (nSpaces == 0 || pNameEnd == p)
+		return nullptr;
+
+	ScriptDeclaration declaration;
+	declaration.kind = ScriptDeclaration::Kind::EngineStruct;
+	declaration.sName.assign(p, pNameEnd);
+	_onDeclaration(std::move(declaration));
+
+	return pNameEnd;
+}
+
+// Scans a function prototype or a constant; returns the position after its ';', or nullptr if there's none at p.
+const char* ScriptDeclarationScanner::ScanFunctionOrConstant(const char* p, bool bAllowConst)
+{
+	const char* pType = p;
+	const char* pTypeEnd = SkipWord(pType);
+	if (pTypeEnd == pType)
+		return nullptr;
+
+	const char* pName = SkipTrivia(pTypeEnd);
+	const char* pNameEnd = SkipWord(pName);
+	if (pNameEnd == pName)
+		return nullptr;
+
+	p = SkipTrivia(pNameEnd);
+	if (p >= _pEnd)
+		return nullptr;
+
+	if (bAllowConst && pTypeEnd - pType == 5 && strncmp(pType, "const", 5) == 0)
+	{
+		// const <type> <name> = <value>; - or else "const" is the type
+		const char* pAfter = ScanFunctionOrConstant(pName, false);
+		if (pAfter)
+			return pAfter;
+	}
+
+	ScriptDeclaration declaration;
+	declaration.sType.assign(pType, pTypeEnd);
+	declaration.sName.assign(pName, pNameEnd);
+
+	if (*p == '(')
+	{
+		p = SkipTrivia(p + 1);
+		if (p < _pEnd && *p != ')')
+		{
+			while (true)
+			{
+				ScriptDeclaration::Param param;
+				p = ReadParameter(p, param);
+				if (!p || p >= _pEnd)
+					return nullptr;
+				declaration.params.push_back(std::move(param));
+				if (*p == ')')
+					break;
+				if (*p != ',')
+					return nullptr;
+				p++;
+			}
+		}
+
+		p = SkipTrivia(p + 1);
+		if (p >= _pEnd || *p != ';')
+			return nullptr;
+
+		declaration.kind = ScriptDeclaration::Kind::Function;
+		_onDeclaration(std::move(declaration));
+	}
+	else if (*p == '=')
+	{
+		p = ReadValue(SkipTrivia(p + 1), declaration.sValue);
+		if (!p || p >= _pEnd || *p != ';')
+			return nullptr;
+
+		declaration.kind = ScriptDeclaration::Kind::Constant;
+		_onDeclaration(std::move(declaration));
+	}
+	else
+		return nullptr;
+
+	return p + 1;
+}
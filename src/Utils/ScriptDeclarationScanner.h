@@ -0,0 +1,87 @@
+/** @file ScriptDeclarationScanner.h
+ * Single pass scanner for the declarations at the top level of a script. Recognizes, each of them
+ * starting a line:
+ *   #define ENGINE_STRUCTURE_<n> <name>
+ *   <type> <name>([[const] <type> <name> [= <value>], ...]);
+ *   [const] <type> <name> = <value>;
+ * where a <value> is a word (letters, digits, '.' and '-'), a string, a [...] vector or a {...} list.
+ * Comments count as whitespace, and function bodies and structure definitions are stepped over by
+ * counting braces, so nothing declared inside them is picked up.
+ *
+ * Values and default values keep the whitespace trailing them, as the regular expressions this
+ * scanner replaced did: the results of both are compared by nwnsc-native's DeclarationScannerTests.
+ *
+ * Portable code (no Windows headers in the interface): shared by the plugin and nwnsc-native.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace NWScriptPlugin {
+
+	struct ScriptDeclaration
+	{
+		enum class Kind { EngineStruct, Function, Constant };
+
+		struct Param
+		{
+			std::string sType;
+			std::string sName;
+			std::string sDefaultValue;
+		};
+
+		Kind kind = Kind::Constant;
+		std::string sType;                  // Empty for engine structures
+		std::string sName;
+		std::string sValue;                 // Constants only
+		std::vector<Param> params;          // Functions only
+	};
+
+	class ScriptDeclarationScanner final
+	{
+	public:
+		// Receives each declaration found, in file order
+		using DeclarationCallback = std::function<void(ScriptDeclaration&& declaration)>;
+
+		// The contents are read in place: they must outlive the scanner
+		ScriptDeclarationScanner(std::string_view sFileContents, const DeclarationCallback& onDeclaration)
+			: _pBegin(sFileContents.data()), _pEnd(sFileContents.data() + sFileContents.size()), _onDeclaration(onDeclaration) {}
+
+		void Scan();
+
+	private:
+		// Values nested deeper than this ([[[...]]]) are not taken as values
+		static constexpr int maxValueNesting = 32;
+
+		const char* const _pBegin;
+		const char* const _pEnd;
+		const DeclarationCallback& _onDeclaration;
+
+		static bool isSpace(char c) {
+			return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+		}
+		static bool isWordChar(char c) {
+			return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+		}
+		static bool isValueWordChar(char c) {
+			return isWordChar(c) || c == '.' || c == '-';
+		}
+
+		const char* SkipComment(const char* p) const;
+		const char* SkipTrivia(const char* p, std::string* sWhitespace = nullptr, size_t* nSpaces = nullptr) const;
+		const char* SkipString(const char* p) const;
+		const char* SkipWord(const char* p) const;
+		const char* ReadValue(const char* p, std::string& sValue, int nNesting = 0) const;
+		const char* ReadParameter(const char* p, ScriptDeclaration::Param& outParam) const;
+		const char* ScanEngineStructure(const char* p);
+		const char* ScanFunctionOrConstant(const char* p, bool bAllowConst);
+	};
+
+}
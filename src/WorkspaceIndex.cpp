@@ -0,0 +1,880 @@
+/** @file WorkspaceIndex.cpp
+ * Cross-reference index of the identifiers used by every script in the workspace.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#include "pch.h"
+
+#include <algorithm>
+#include <cwctype>
+#include <filesystem>
+#include <set>
+#include <unordered_set>
+
+#include "NWScriptParser.h"
+#include "WorkspaceIndex.h"
+
+using namespace NWScriptPlugin;
+namespace fs = std::filesystem;
+
+struct WorkspaceIndex::Job {
+	generic_string sFilePath;
+	int64_t nLastWriteTime = 0;
+	// Hash of the version indexed, if any
+	bool bKnown = false;
+	uint64_t nKnownHash = 0;
+
+	// Results
+	bool bRead = false;
+	bool bChanged = false;
+	ScriptIndex index;
+};
+
+namespace {
+
+	const char cacheMagic[4] = { 'N', 'W', 'X', 'R' };
+
+	// Keywords and built-in types: they are everywhere and never what someone looks up
+	const std::unordered_set<std::string_view> ignoredWords = {
+		"if", "else", "for", "while", "do", "switch", "case", "default", "break", "continue", "return",
+		"const", "struct", "void", "int", "float", "string", "object", "vector", "location", "effect",
+		"itemproperty", "talent", "event", "action", "json", "sqlquery", "cassowary"
+	};
+
+	// A name after one of these is not being declared ("return x", "else Foo()")
+	const std::unordered_set<std::string_view> statementWords = {
+		"return", "case", "else", "do", "default", "break", "continue", "if", "while", "for", "switch"
+	};
+
+	inline bool isIdentifierStart(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; }
+	inline bool isIdentifierChar(char c) { return isIdentifierStart(c) || (c >= '0' && c <= '9'); }
+	inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f'; }
+
+	// Skips blanks and comments from i, returning the next character (0 at the end)
+	char peekToken(std::string_view s, size_t i, size_t* outPos = nullptr)
+	{
+		while (i < s.size())
+		{
+			if (isSpace(s[i]))
+				i++;
+			else if (s[i] == '/' && i + 1 < s.size() && s[i + 1] == '/')
+			{
+				while (i < s.size() && s[i] != '\n')
+					i++;
+			}
+			else if (s[i] == '/' && i + 1 < s.size() && s[i + 1] == '*')
+			{
+				const size_t end = s.find("*/", i + 2);
+				i = end == std::string_view::npos ? s.size() : end + 2;
+			}
+			else
+				break;
+		}
+
+		if (outPos)
+			*outPos = i;
+		return i < s.size() ? s[i] : 0;
+	}
+
+	// Position after the ')' matching the '(' at i (or the end of the script)
+	size_t skipParentheses(std::string_view s, size_t i)
+	{
+		int nDepth = 0;
+		while (i < s.size())
+		{
+			const char c = peekToken(s, i, &i);
+			if (!c)
+				break;
+			if (c == '"')
+			{
+				for (i++; i < s.size() && s[i] != '"' && s[i] != '\n'; i++)
+					if (s[i] == '\\')
+						i++;
+			}
+			else if (c == '(')
+				nDepth++;
+			else if (c == ')' && --nDepth == 0)
+				return i + 1;
+			// A brace or semicolon means the parentheses were never closed
+			else if (c == '{' || c == '}' || c == ';')
+				return i;
+			i++;
+		}
+		return i;
+	}
+
+	// Little-endian, variable length integers for the cache file
+	void writeVarint(std::string& buffer, uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			buffer.push_back(static_cast<char>((value & 0x7F) | 0x80));
+			value >>= 7;
+		}
+		buffer.push_back(static_cast<char>(value));
+	}
+
+	void writeFixed64(std::string& buffer, uint64_t value)
+	{
+		for (int i = 0; i < 8; i++)
+			buffer.push_back(static_cast<char>(value >> (i * 8)));
+	}
+
+	void writeString(std::string& buffer, std::string_view value)
+	{
+		writeVarint(buffer, value.size());
+		buffer.append(value);
+	}
+
+	// Reads the cache file, checking every bound: a truncated or damaged file just fails
+	class CacheReader {
+	public:
+		CacheReader(const std::string& buffer, size_t start) : _buffer(buffer), _pos(start) {}
+
+		bool Failed() const { return _bFailed; }
+		bool AtEnd() const { return _pos == _buffer.size(); }
+
+		uint64_t Varint()
+		{
+			uint64_t value = 0;
+			for (int shift = 0; shift < 64; shift += 7)
+			{
+				if (_pos >= _buffer.size())
+					break;
+				const uint8_t byte = static_cast<uint8_t>(_buffer[_pos++]);
+				value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+				if (!(byte & 0x80))
+					return value;
+			}
+			_bFailed = true;
+			return 0;
+		}
+
+		uint64_t Fixed64()
+		{
+			if (_buffer.size() - _pos < 8)
+			{
+				_bFailed = true;
+				return 0;
+			}
+			uint64_t value = 0;
+			for (int i = 0; i < 8; i++)
+				value |= static_cast<uint64_t>(static_cast<uint8_t>(_buffer[_pos++])) << (i * 8);
+			return value;
+		}
+
+		uint8_t Byte()
+		{
+			if (_pos >= _buffer.size())
+			{
+				_bFailed = true;
+				return 0;
+			}
+			return static_cast<uint8_t>(_buffer[_pos++]);
+		}
+
+		std::string_view String()
+		{
+			const uint64_t size = Varint();
+			if (_bFailed || size > _buffer.size() - _pos)
+			{
+				_bFailed = true;
+				return {};
+			}
+			std::string_view value(_buffer.data() + _pos, static_cast<size_t>(size));
+			_pos += static_cast<size_t>(size);
+			return value;
+		}
+
+		// A count of items taking at least nMinItemSize bytes each, checked against what is left
+		size_t Count(size_t nMinItemSize)
+		{
+			const uint64_t count = Varint();
+			if (_bFailed || count > (_buffer.size() - _pos) / nMinItemSize)
+			{
+				_bFailed = true;
+				return 0;
+			}
+			return static_cast<size_t>(count);
+		}
+
+	private:
+		const std::string& _buffer;
+		size_t _pos;
+		bool _bFailed = false;
+	};
+
+	int64_t fileWriteTime(const fs::path& filePath)
+	{
+		std::error_code ec;
+		const auto time = fs::last_write_time(filePath, ec);
+		return ec ? 0 : static_cast<int64_t>(time.time_since_epoch().count());
+	}
+
+	template <typename CharT>
+	bool hasScriptExtension(std::basic_string_view<CharT> sName)
+	{
+		if (sName.size() < 4)
+			return false;
+		const std::basic_string_view<CharT> sExtension = sName.substr(sName.size() - 4);
+		const char* sExpected = ".nss";
+		for (size_t i = 0; i < 4; i++)
+			if (std::towlower(static_cast<std::make_unsigned_t<CharT>>(sExtension[i])) != static_cast<wint_t>(sExpected[i]))
+				return false;
+		return true;
+	}
+
+	bool isScriptFile(const fs::path& filePath)
+	{
+		return hasScriptExtension(std::basic_string_view<TCHAR>(filePath.native()));
+	}
+
+	bool isInFolder(const fs::path& filePath, const WorkspaceIndex::Folder& folder)
+	{
+		fs::path folderPath = fs::path(folder.sPath).lexically_normal();
+		if (!folderPath.has_filename())
+			folderPath = folderPath.parent_path();
+		const fs::path parent = filePath.parent_path();
+		if (!folder.bRecursive)
+			return !WorkspaceIndex::PathCompare(parent.native(), folderPath.native());
+
+		const fs::path relative = parent.lexically_relative(folderPath);
+		return !relative.empty() && *relative.begin() != "..";
+	}
+}
+
+int WorkspaceIndex::PathCompare(const generic_string& a, const generic_string& b)
+{
+	const size_t size = (std::min)(a.size(), b.size());
+	for (size_t i = 0; i < size; i++)
+	{
+		const auto ca = std::towlower(static_cast<std::make_unsigned_t<TCHAR>>(a[i]));
+		const auto cb = std::towlower(static_cast<std::make_unsigned_t<TCHAR>>(b[i]));
+		if (ca != cb)
+			return ca < cb ? -1 : 1;
+	}
+	return a.size() == b.size() ? 0 : (a.size() < b.size() ? -1 : 1);
+}
+
+bool WorkspaceIndex::PathLess::operator()(const generic_string& a, const generic_string& b) const
+{
+	return PathCompare(a, b) < 0;
+}
+
+std::string_view WorkspaceIndex::ScriptIndex::Identifier(size_t index) const
+{
+	const uint32_t start = index ? IdentifierEnds[index - 1] : 0;
+	return std::string_view(sIdentifiers.data() + start, IdentifierEnds[index] - start);
+}
+
+std::pair<size_t, size_t> WorkspaceIndex::ScriptIndex::FindEntries(std::string_view sIdentifier) const
+{
+	size_t low = 0, high = IdentifiersCount();
+	while (low < high)
+	{
+		const size_t middle = (low + high) / 2;
+		if (Identifier(middle) < sIdentifier)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	if (low == IdentifiersCount() || Identifier(low) != sIdentifier)
+		return { 0, 0 };
+	return { low ? EntryEnds[low - 1] : 0, EntryEnds[low] };
+}
+
+void WorkspaceIndex::IndexScript(std::string_view s, ScriptIndex& outIndex)
+{
+	std::vector<std::pair<std::string_view, ScriptIndex::Entry>> uses;
+
+	uint32_t nLine = 1;
+	size_t lineStart = 0;
+	int nBraces = 0;
+	int nParentheses = 0;
+
+	// The last token, if it was a word (keywords included)
+	std::string_view previousWord;
+	bool bAfterComma = false;
+	bool bAfterStruct = false;
+	// A declaration whose list may continue after a comma ("int a, b;" or a parameter list), and where
+	bool bDeclarationList = false;
+	int nListBraces = 0, nListParentheses = 0;
+
+	auto addUse = [&](std::string_view sName, size_t pos, UseKind kind) {
+		const size_t column = pos - lineStart + 1;
+		uses.push_back({ sName, { nLine, static_cast<uint16_t>((std::min)(column, static_cast<size_t>(UINT16_MAX))), kind } });
+	};
+
+	auto newLines = [&](size_t from, size_t to) {
+		for (size_t j = from; j < to; j++)
+			if (s[j] == '\n')
+			{
+				nLine++;
+				lineStart = j + 1;
+			}
+	};
+
+	size_t i = 0;
+	while (i < s.size())
+	{
+		const char c = s[i];
+		if (c == '\n')
+		{
+			nLine++;
+			lineStart = ++i;
+			continue;
+		}
+		if (isSpace(c))
+		{
+			i++;
+			continue;
+		}
+
+		// Comments don't break the token sequence
+		if (c == '/' && i + 1 < s.size() && (s[i + 1] == '/' || s[i + 1] == '*'))
+		{
+			size_t end = 0;
+			if (s[i + 1] == '/')
+				end = (std::min)(s.find('\n', i), s.size());
+			else
+			{
+				end = s.find("*/", i + 2);
+				end = end == std::string_view::npos ? s.size() : end + 2;
+			}
+			newLines(i, end);
+			i = end;
+			continue;
+		}
+
+		if (isIdentifierStart(c))
+		{
+			const size_t start = i;
+			while (i < s.size() && isIdentifierChar(s[i]))
+				i++;
+			const std::string_view sWord = s.substr(start, i - start);
+
+			if (ignoredWords.count(sWord))
+			{
+				bAfterStruct = sWord == "struct";
+				previousWord = sWord;
+				bAfterComma = false;
+				continue;
+			}
+
+			UseKind kind = UseKind::Reference;
+			bool bFunction = false;
+			if (bAfterStruct)
+			{
+				// "struct Name {" at file level defines it; anywhere else it's the type of something
+				if (nBraces == 0 && peekToken(s, i) == '{')
+					kind = UseKind::Definition;
+			}
+			else if ((!previousWord.empty() && !statementWords.count(previousWord))
+				|| (bAfterComma && bDeclarationList && nBraces == nListBraces && nParentheses == nListParentheses))
+			{
+				if (nBraces == 0 && nParentheses == 0)
+				{
+					size_t next = 0;
+					bFunction = peekToken(s, i, &next) == '(';
+					if (bFunction)
+						kind = peekToken(s, skipParentheses(s, next)) == '{' ? UseKind::Definition : UseKind::Declaration;
+					else
+						kind = UseKind::Definition;
+				}
+				else
+					kind = UseKind::Local;
+
+				// Function names don't start a list, their parameters do
+				if (!bFunction)
+				{
+					bDeclarationList = true;
+					nListBraces = nBraces;
+					nListParentheses = nParentheses;
+				}
+			}
+
+			addUse(sWord, start, kind);
+			bAfterStruct = false;
+			bAfterComma = false;
+			previousWord = sWord;
+			continue;
+		}
+
+		previousWord = {};
+		bAfterStruct = false;
+		bAfterComma = false;
+
+		if (c >= '0' && c <= '9')
+		{
+			while (i < s.size() && (isIdentifierChar(s[i]) || s[i] == '.'))
+				i++;
+			continue;
+		}
+
+		if (c == '"')
+		{
+			for (i++; i < s.size() && s[i] != '"' && s[i] != '\n'; i++)
+				if (s[i] == '\\' && i + 1 < s.size() && s[i + 1] != '\n')
+					i++;
+			if (i < s.size() && s[i] == '"')
+				i++;
+			continue;
+		}
+
+		// Preprocessor directives take the rest of the line
+		if (c == '#')
+		{
+			size_t end = i + 1;
+			while (end < s.size() && s[end] != '\n')
+				end++;
+			const std::string_view sDirective = s.substr(i, end - i);
+
+			size_t j = 1;
+			while (j < sDirective.size() && (sDirective[j] == ' ' || sDirective[j] == '\t'))
+				j++;
+			if (sDirective.substr(j, 7) == "include")
+			{
+				const size_t open = sDirective.find('"', j + 7);
+				const size_t close = open == std::string_view::npos ? open : sDirective.find('"', open + 1);
+				if (close != std::string_view::npos && close > open + 1)
+				{
+					std::string_view sName = sDirective.substr(open + 1, close - open - 1);
+					if (sName.size() > 4 && hasScriptExtension(sName))
+						sName.remove_suffix(4);
+					addUse(sName, i + open + 1, UseKind::Include);
+				}
+			}
+			else if (sDirective.substr(j, 6) == "define")
+			{
+				j += 6;
+				while (j < sDirective.size() && (sDirective[j] == ' ' || sDirective[j] == '\t'))
+					j++;
+				size_t nameEnd = j;
+				while (nameEnd < sDirective.size() && isIdentifierChar(sDirective[nameEnd]))
+					nameEnd++;
+				if (nameEnd > j && isIdentifierStart(sDirective[j]))
+					addUse(sDirective.substr(j, nameEnd - j), i + j, UseKind::Definition);
+			}
+			i = end;
+			continue;
+		}
+
+		switch (c)
+		{
+		case '{':
+			nBraces++;
+			bDeclarationList = false;
+			break;
+		case '}':
+			nBraces = (std::max)(nBraces - 1, 0);
+			nParentheses = 0;
+			bDeclarationList = false;
+			break;
+		case '(':
+			nParentheses++;
+			break;
+		case ')':
+			nParentheses = (std::max)(nParentheses - 1, 0);
+			if (nParentheses < nListParentheses)
+				bDeclarationList = false;
+			break;
+		case ';':
+			bDeclarationList = false;
+			break;
+		case ',':
+			bAfterComma = true;
+			break;
+		}
+		i++;
+	}
+
+	// Group by identifier, keeping the order of appearance inside each group
+	std::stable_sort(uses.begin(), uses.end(),
+		[](const auto& a, const auto& b) { return a.first < b.first; });
+
+	outIndex.sIdentifiers.clear();
+	outIndex.IdentifierEnds.clear();
+	outIndex.Entries.clear();
+	outIndex.EntryEnds.clear();
+	outIndex.Entries.reserve(uses.size());
+	for (size_t j = 0; j < uses.size(); j++)
+	{
+		if (j > 0 && uses[j].first != uses[j - 1].first)
+		{
+			outIndex.IdentifierEnds.push_back(static_cast<uint32_t>(outIndex.sIdentifiers.size()));
+			outIndex.EntryEnds.push_back(static_cast<uint32_t>(outIndex.Entries.size()));
+		}
+		if (j == 0 || uses[j].first != uses[j - 1].first)
+			outIndex.sIdentifiers.append(uses[j].first);
+		outIndex.Entries.push_back(uses[j].second);
+	}
+	if (!uses.empty())
+	{
+		outIndex.IdentifierEnds.push_back(static_cast<uint32_t>(outIndex.sIdentifiers.size()));
+		outIndex.EntryEnds.push_back(static_cast<uint32_t>(outIndex.Entries.size()));
+	}
+}
+
+void WorkspaceIndex::Start(const generic_string& cacheFile)
+{
+	if (_thread.joinable())
+		return;
+
+	_cacheFile = cacheFile;
+	std::string sBuffer;
+	if (!_cacheFile.empty() && fileToBuffer(_cacheFile, sBuffer))
+	{
+		std::lock_guard<std::mutex> guard(_lock);
+		if (!SerializeFromBuffer(sBuffer))
+			_scripts.clear();
+	}
+
+	_bStop = false;
+	_bAbort = false;
+	_thread = std::thread(&WorkspaceIndex::Run, this);
+}
+
+void WorkspaceIndex::Stop()
+{
+	if (!_thread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> guard(_lock);
+		_bStop = true;
+	}
+	_bAbort = true;
+	_wakeUp.notify_all();
+	_thread.join();
+}
+
+void WorkspaceIndex::SetFolders(const std::vector<Folder>& folders)
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	if (folders == _folders)
+		return;
+
+	_folders = folders;
+	_bRescan = true;
+	_wakeUp.notify_all();
+}
+
+void WorkspaceIndex::AddFolder(const Folder& folder)
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	for (const Folder& existing : _folders)
+		if (existing.bRecursive == folder.bRecursive && !PathCompare(existing.sPath, folder.sPath))
+			return;
+
+	_folders.push_back(folder);
+	_bRescan = true;
+	_wakeUp.notify_all();
+}
+
+void WorkspaceIndex::Refresh()
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	_bRescan = true;
+	_wakeUp.notify_all();
+}
+
+void WorkspaceIndex::RefreshFile(const generic_string& sFilePath)
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	_filesToRefresh.push_back(sFilePath);
+	_wakeUp.notify_all();
+}
+
+size_t WorkspaceIndex::ScriptsCount() const
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	return _scripts.size();
+}
+
+void WorkspaceIndex::Find(std::string_view sIdentifier, bool bDefinitionsOnly, std::vector<Location>& outLocations) const
+{
+	outLocations.clear();
+	const generic_string sScriptName = str2wstr(std::string(sIdentifier));
+
+	std::lock_guard<std::mutex> guard(_lock);
+	for (const auto& [path, script] : _scripts)
+	{
+		// The script itself, for names in #include
+		if (bDefinitionsOnly)
+		{
+			const size_t nameStart = path.find_last_of(TEXT("\\/")) + 1;
+			if (path.size() - nameStart == sScriptName.size() + 4
+				&& !PathCompare(path.substr(nameStart, sScriptName.size()), sScriptName))
+				outLocations.push_back({ path, 1, 1, UseKind::Definition });
+		}
+
+		const auto [first, last] = script.FindEntries(sIdentifier);
+		for (size_t i = first; i < last; i++)
+		{
+			const ScriptIndex::Entry& entry = script.Entries[i];
+			if (bDefinitionsOnly && entry.kind != UseKind::Definition && entry.kind != UseKind::Declaration)
+				continue;
+			outLocations.push_back({ path, entry.nLine, entry.nColumn, entry.kind });
+		}
+	}
+}
+
+void WorkspaceIndex::Run()
+{
+	std::unique_lock<std::mutex> lock(_lock);
+	for (;;)
+	{
+		_wakeUp.wait(lock, [this]() { return _bStop || _bRescan || !_filesToRefresh.empty(); });
+		if (_bStop)
+			break;
+
+		const std::vector<Folder> folders = _folders;
+		const bool bRescan = _bRescan;
+		std::vector<generic_string> filesToRefresh = std::move(_filesToRefresh);
+		_filesToRefresh.clear();
+		_bRescan = false;
+
+		// What is indexed now, to compare with the files found
+		std::map<generic_string, std::pair<int64_t, uint64_t>, PathLess> known;
+		for (const auto& [path, script] : _scripts)
+			known.emplace(path, std::make_pair(script.nLastWriteTime, script.nContentHash));
+
+		_bIndexing = true;
+		lock.unlock();
+
+		std::vector<Job> jobs;
+		std::vector<generic_string> removed;
+		auto addJob = [&](const generic_string& sFilePath, int64_t nLastWriteTime) {
+			Job& job = jobs.emplace_back();
+			job.sFilePath = sFilePath;
+			job.nLastWriteTime = nLastWriteTime;
+			const auto it = known.find(sFilePath);
+			if (it != known.end())
+			{
+				job.bKnown = true;
+				job.nKnownHash = it->second.second;
+			}
+		};
+
+		if (bRescan)
+		{
+			std::set<generic_string, PathLess> found;
+			for (const Folder& folder : folders)
+			{
+				std::error_code ec;
+				auto visit = [&](const fs::directory_entry& entry) {
+					std::error_code fileError;
+					if (!entry.is_regular_file(fileError) || !isScriptFile(entry.path()))
+						return;
+					const generic_string sFilePath = entry.path().lexically_normal().native();
+					if (!found.insert(sFilePath).second)
+						return;
+					const int64_t nLastWriteTime = fileWriteTime(entry.path());
+					const auto it = known.find(sFilePath);
+					if (it == known.end() || it->second.first != nLastWriteTime)
+						addJob(sFilePath, nLastWriteTime);
+				};
+
+				if (folder.bRecursive)
+				{
+					for (fs::recursive_directory_iterator it(folder.sPath, fs::directory_options::skip_permission_denied, ec), end;
+						!ec && it != end; it.increment(ec))
+						visit(*it);
+				}
+				else
+				{
+					for (fs::directory_iterator it(folder.sPath, ec), end; !ec && it != end; it.increment(ec))
+						visit(*it);
+				}
+			}
+
+			for (const auto& [path, times] : known)
+				if (!found.count(path))
+					removed.push_back(path);
+		}
+		else
+		{
+			for (const generic_string& sFile : filesToRefresh)
+			{
+				const fs::path filePath = fs::path(sFile).lexically_normal();
+				const bool bKnown = known.count(filePath.native()) > 0;
+				if (!bKnown && std::none_of(folders.begin(), folders.end(),
+					[&filePath](const Folder& folder) { return isInFolder(filePath, folder); }))
+					continue;
+
+				std::error_code ec;
+				if (fs::is_regular_file(filePath, ec) && isScriptFile(filePath))
+					addJob(filePath.native(), fileWriteTime(filePath));
+				else if (bKnown)
+					removed.push_back(filePath.native());
+			}
+		}
+
+		RunJobs(jobs);
+
+		lock.lock();
+		for (const generic_string& path : removed)
+			_bDirty |= _scripts.erase(path) > 0;
+
+		for (Job& job : jobs)
+		{
+			if (!job.bRead)
+				continue;
+
+			_bDirty = true;
+			if (job.bChanged)
+				_scripts[job.sFilePath] = std::move(job.index);
+			else
+				_scripts[job.sFilePath].nLastWriteTime = job.nLastWriteTime;
+		}
+		_bIndexing = false;
+
+		if (_bDirty && !_bStop)
+			SaveCache(lock);
+	}
+
+	if (_bDirty)
+		SaveCache(lock);
+}
+
+void WorkspaceIndex::RunJobs(std::vector<Job>& jobs)
+{
+	std::atomic<size_t> nextJob = 0;
+	auto worker = [this, &jobs, &nextJob]() {
+		std::string sContents;
+		for (size_t i = nextJob++; i < jobs.size() && !_bAbort; i = nextJob++)
+		{
+			Job& job = jobs[i];
+			if (!fileToBuffer(job.sFilePath, sContents))
+				continue;
+
+			job.bRead = true;
+			job.index.nLastWriteTime = job.nLastWriteTime;
+			job.index.nContentHash = NWScriptParser::ContentHash(sContents);
+			job.bChanged = !job.bKnown || job.index.nContentHash != job.nKnownHash;
+			if (job.bChanged)
+				IndexScript(sContents, job.index);
+		}
+	};
+
+	// Small batches (a file saved) aren't worth starting threads for
+	const size_t nThreads = (std::min)(static_cast<size_t>((std::max)(std::thread::hardware_concurrency(), 1u)),
+		(jobs.size() + 15) / 16);
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < nThreads; i++)
+		threads.emplace_back(worker);
+	worker();
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+void WorkspaceIndex::SaveCache(std::unique_lock<std::mutex>& lock)
+{
+	if (_cacheFile.empty())
+		return;
+
+	std::string sBuffer;
+	SerializeToBuffer(sBuffer);
+	_bDirty = false;
+
+	lock.unlock();
+	const bool bSaved = bufferToFile(_cacheFile, sBuffer);
+	lock.lock();
+
+	if (!bSaved)
+		_bDirty = true;
+}
+
+void WorkspaceIndex::SerializeToBuffer(std::string& outBuffer) const
+{
+	outBuffer.assign(cacheMagic, sizeof(cacheMagic));
+	writeVarint(outBuffer, cacheVersion);
+	writeVarint(outBuffer, _scripts.size());
+
+	for (const auto& [path, script] : _scripts)
+	{
+		writeString(outBuffer, wstr2str(path));
+		writeFixed64(outBuffer, static_cast<uint64_t>(script.nLastWriteTime));
+		writeFixed64(outBuffer, script.nContentHash);
+		writeVarint(outBuffer, script.IdentifiersCount());
+
+		for (size_t i = 0; i < script.IdentifiersCount(); i++)
+		{
+			writeString(outBuffer, script.Identifier(i));
+			const size_t first = i ? script.EntryEnds[i - 1] : 0;
+			writeVarint(outBuffer, script.EntryEnds[i] - first);
+
+			// Entries are in order of appearance: lines only go forward
+			uint32_t nLine = 0;
+			for (size_t j = first; j < script.EntryEnds[i]; j++)
+			{
+				const ScriptIndex::Entry& entry = script.Entries[j];
+				writeVarint(outBuffer, entry.nLine - nLine);
+				writeVarint(outBuffer, entry.nColumn);
+				outBuffer.push_back(static_cast<char>(entry.kind));
+				nLine = entry.nLine;
+			}
+		}
+	}
+}
+
+bool WorkspaceIndex::SerializeFromBuffer(const std::string& sBuffer)
+{
+	_scripts.clear();
+	if (sBuffer.size() < sizeof(cacheMagic) || sBuffer.compare(0, sizeof(cacheMagic), cacheMagic, sizeof(cacheMagic)) != 0)
+		return false;
+
+	CacheReader reader(sBuffer, sizeof(cacheMagic));
+	if (reader.Varint() != cacheVersion)
+		return false;
+
+	const size_t nScripts = reader.Count(18);
+	for (size_t s = 0; s < nScripts && !reader.Failed(); s++)
+	{
+		const generic_string path = str2wstr(std::string(reader.String()));
+		ScriptIndex script;
+		script.nLastWriteTime = static_cast<int64_t>(reader.Fixed64());
+		script.nContentHash = reader.Fixed64();
+
+		const size_t nIdentifiers = reader.Count(2);
+		script.IdentifierEnds.reserve(nIdentifiers);
+		script.EntryEnds.reserve(nIdentifiers);
+		for (size_t i = 0; i < nIdentifiers && !reader.Failed(); i++)
+		{
+			const std::string_view sIdentifier = reader.String();
+			if (sIdentifier.empty() || (i > 0 && sIdentifier <= script.Identifier(i - 1)))
+				return false;
+			script.sIdentifiers.append(sIdentifier);
+			script.IdentifierEnds.push_back(static_cast<uint32_t>(script.sIdentifiers.size()));
+
+			const size_t nEntries = reader.Count(3);
+			uint32_t nLine = 0;
+			for (size_t j = 0; j < nEntries && !reader.Failed(); j++)
+			{
+				ScriptIndex::Entry entry;
+				nLine += static_cast<uint32_t>(reader.Varint());
+				entry.nLine = nLine;
+				entry.nColumn = static_cast<uint16_t>(reader.Varint());
+				const uint8_t kind = reader.Byte();
+				if (kind > static_cast<uint8_t>(UseKind::Include))
+					return false;
+				entry.kind = static_cast<UseKind>(kind);
+				script.Entries.push_back(entry);
+			}
+			script.EntryEnds.push_back(static_cast<uint32_t>(script.Entries.size()));
+		}
+
+		if (!reader.Failed())
+			_scripts[path] = std::move(script);
+	}
+
+	if (reader.Failed() || !reader.AtEnd())
+	{
+		_scripts.clear();
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,147 @@
+/** @file WorkspaceIndex.h
+ * Cross-reference index of the identifiers used by every script in the workspace.
+ *
+ * The workspace is the scripts (.nss) in a set of folders: the compiler's include folders, the batch
+ * processing folder, and the folders of the scripts lookups were made from. Each script is tokenized
+ * into the identifiers it uses, with the line and column of each use and what it is there: a definition
+ * (function body, global constant or variable, structure, #define), a declaration (function prototype),
+ * a local (variable or parameter), a plain reference, or the script name of an #include.
+ *
+ * Every script's entries are kept apart, sorted by identifier. A lookup binary-searches each script,
+ * re-indexing a script replaces only its own entries, and scripts can be indexed in parallel with
+ * nothing shared between threads. The index is saved to a cache file together with each script's
+ * write time and content hash: the next session only reads the scripts whose write time changed, and
+ * only tokenizes again the ones whose contents changed.
+ *
+ * Indexing runs on a background thread; lookups answer from whatever is indexed at the time.
+ *
+ **/
+ // Copyright (C) 2022 - Leonardo Silva
+ // The License.txt file describes the conditions under which this software may be distributed.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "Common.h"
+
+namespace NWScriptPlugin {
+
+	class WorkspaceIndex final
+	{
+	public:
+		enum class UseKind : uint8_t { Reference, Declaration, Definition, Local, Include };
+
+		struct Folder {
+			generic_string sPath;
+			bool bRecursive = false;
+
+			bool operator==(const Folder& other) const { return sPath == other.sPath && bRecursive == other.bRecursive; }
+		};
+
+		struct Location {
+			generic_string sFilePath;
+			uint32_t nLine = 0;			// 1-based
+			uint32_t nColumn = 0;		// 1-based, in bytes
+			UseKind kind = UseKind::Reference;
+		};
+
+		// The identifiers of one script
+		struct ScriptIndex {
+			struct Entry {
+				uint32_t nLine = 0;
+				uint16_t nColumn = 0;	// Capped at 65535
+				UseKind kind = UseKind::Reference;
+			};
+
+			int64_t nLastWriteTime = 0;
+			uint64_t nContentHash = 0;
+			// Sorted identifiers, back to back, and where each one ends
+			std::string sIdentifiers;
+			std::vector<uint32_t> IdentifierEnds;
+			// Entries grouped by identifier (in order of appearance), and where each group ends
+			std::vector<Entry> Entries;
+			std::vector<uint32_t> EntryEnds;
+
+			size_t IdentifiersCount() const { return IdentifierEnds.size(); }
+			std::string_view Identifier(size_t index) const;
+			// Range of Entries for an identifier; empty if the script doesn't use it
+			std::pair<size_t, size_t> FindEntries(std::string_view sIdentifier) const;
+		};
+
+		// Version of the cache file format
+		static constexpr uint32_t cacheVersion = 1;
+
+		WorkspaceIndex() = default;
+		~WorkspaceIndex() { Stop(); }
+
+		WorkspaceIndex(const WorkspaceIndex&) = delete;
+		WorkspaceIndex& operator=(const WorkspaceIndex&) = delete;
+
+		// Loads the cache file and starts the indexer thread. Nothing is scanned until folders are set.
+		void Start(const generic_string& cacheFile);
+		// Stops the indexer thread and saves the cache file
+		void Stop();
+
+		// Sets the folders to index; rescans them if they changed
+		void SetFolders(const std::vector<Folder>& folders);
+		// Adds a folder (if it isn't there already) and rescans
+		void AddFolder(const Folder& folder);
+		// Rescans all folders, for changes made outside the editor
+		void Refresh();
+		// Indexes a script again, after it was saved. Ignored if it's not part of the workspace.
+		void RefreshFile(const generic_string& sFilePath);
+
+		bool IsIndexing() const { return _bIndexing; }
+		size_t ScriptsCount() const;
+
+		// Uses of an identifier in every script, sorted by file then position. With bDefinitionsOnly, only
+		// definitions and declarations, plus the scripts called sIdentifier (for #include names).
+		void Find(std::string_view sIdentifier, bool bDefinitionsOnly, std::vector<Location>& outLocations) const;
+
+		// Compares paths as Windows does, ignoring case
+		static int PathCompare(const generic_string& a, const generic_string& b);
+
+		// Tokenizes a script's contents into outIndex (write time and hash are left as they are)
+		static void IndexScript(std::string_view sContents, ScriptIndex& outIndex);
+
+		// Cache file contents
+		void SerializeToBuffer(std::string& outBuffer) const;
+		bool SerializeFromBuffer(const std::string& sBuffer);
+
+	private:
+		struct Job;
+
+		// Windows paths are case-insensitive: a saved file must find the script enumerated from its folder
+		struct PathLess {
+			bool operator()(const generic_string& a, const generic_string& b) const;
+		};
+
+		generic_string _cacheFile;
+		std::thread _thread;
+
+		mutable std::mutex _lock;
+		std::condition_variable _wakeUp;
+		std::map<generic_string, ScriptIndex, PathLess> _scripts;
+		std::vector<Folder> _folders;
+		std::vector<generic_string> _filesToRefresh;
+		bool _bRescan = false;
+		bool _bStop = false;
+		bool _bDirty = false;
+
+		std::atomic<bool> _bIndexing = false;
+		std::atomic<bool> _bAbort = false;
+
+		void Run();
+		// Indexes the jobs' scripts, spread over the available cores
+		void RunJobs(std::vector<Job>& jobs);
+		void SaveCache(std::unique_lock<std::mutex>& lock);
+	};
+
+}